@@ -0,0 +1,91 @@
+#include <cstdlib>
+#include <new>
+#include "./bench.h"
+
+namespace
+{
+    // every block is prefixed by its size so that delete knows how many bytes are freed
+    const size_t kHeader = 16;
+    lilang::bench::AllocStats stats = {0, 0, 0, 0};
+}
+
+void *operator new(size_t n)
+{
+    auto p = static_cast<char *>(std::malloc(n + kHeader));
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t *>(p) = n;
+    stats.allocs++;
+    stats.bytes += n;
+    stats.live_bytes += n;
+    if (stats.live_bytes > stats.peak_bytes)
+    {
+        stats.peak_bytes = stats.live_bytes;
+    }
+    return p + kHeader;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p == nullptr)
+    {
+        return;
+    }
+    auto block = static_cast<char *>(p) - kHeader;
+    stats.live_bytes -= *reinterpret_cast<size_t *>(block);
+    std::free(block);
+}
+
+void *operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace lilang
+{
+    namespace bench
+    {
+        AllocStats Allocations()
+        {
+            return stats;
+        }
+
+        void ResetPeak()
+        {
+            stats.peak_bytes = stats.live_bytes;
+        }
+
+        class NodeCounter : public ast::Walker
+        {
+        public:
+            size_t count = 0;
+
+        protected:
+            void Pre(ast::Node *) override { count++; }
+        };
+
+        size_t CountNodes(ast::Node *root)
+        {
+            NodeCounter c;
+            c.Walk(root);
+            return c.count;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef LILANG_BENCH_BENCH
+#define LILANG_BENCH_BENCH
+
+#include <chrono>
+#include <cstddef>
+#include "../src/compiler/ast.h"
+
+namespace lilang
+{
+    namespace bench
+    {
+        // global operator new/delete are replaced in bench.cpp
+        struct AllocStats
+        {
+            size_t allocs;     // number of allocations
+            size_t bytes;      // bytes allocated in total
+            size_t live_bytes; // bytes not freed yet
+            size_t peak_bytes; // max of live_bytes
+        };
+        AllocStats Allocations();
+        void ResetPeak();
+
+        class Timer
+        {
+        public:
+            Timer() : start(std::chrono::steady_clock::now()) {}
+            double Seconds() const
+            {
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+        private:
+            std::chrono::steady_clock::time_point start;
+        };
+
+        // number of ast nodes reachable from root, fields included
+        size_t CountNodes(ast::Node *root);
+    }
+}
+
+#endif
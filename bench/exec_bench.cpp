@@ -0,0 +1,242 @@
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/runtime/interpreter.h"
+#include "../src/runtime/vm.h"
+#include "./bench.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+namespace
+{
+    struct Program
+    {
+        string_t name;
+        string_t source;
+        int64_t expect; // what main returns
+    };
+
+    // calls dominate
+    const char *kFib =
+        "fn fib(int n) int {\n"
+        "    if (n < 2) {\n"
+        "        return n;\n"
+        "    }\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "fn main() int {\n"
+        "    return fib(27);\n"
+        "}\n";
+
+    // int arithmetic in nested loops
+    const char *kLoop =
+        "fn main() int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < 3000; i += 1) {\n"
+        "        let j = 0;\n"
+        "        while (j < 1000) {\n"
+        "            s = s + (i ^ j) % 7 - 3;\n"
+        "            j += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    // array stores and loads
+    const char *kSieve =
+        "fn main() int {\n"
+        "    let n = 2000000;\n"
+        "    let composite []bool;\n"
+        "    composite[n] = false;\n"
+        "    let count = 0;\n"
+        "    for (let i = 2; i <= n; i += 1) {\n"
+        "        if (!composite[i]) {\n"
+        "            count += 1;\n"
+        "            for (let k = i * 2; k <= n; k += i) {\n"
+        "                composite[k] = true;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    return count;\n"
+        "}\n";
+
+    // float arithmetic and compares
+    const char *kMandel =
+        "fn escapes(float cx, float cy) int {\n"
+        "    let x, y = 0.0, 0.0;\n"
+        "    for (let n = 0; n < 100; n += 1) {\n"
+        "        if (x * x + y * y > 4.0) {\n"
+        "            return n;\n"
+        "        }\n"
+        "        x, y = x * x - y * y + cx, 2.0 * x * y + cy;\n"
+        "    }\n"
+        "    return 100;\n"
+        "}\n"
+        "fn main() int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < 200; i += 1) {\n"
+        "        for (let j = 0; j < 200; j += 1) {\n"
+        "            s += escapes(float(i) / 100.0 - 1.5, float(j) / 100.0 - 1.0);\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    struct Result
+    {
+        double load_ms = 0;
+        double run_ms = 0; // best of the iterations
+        int64_t value = 0;
+    };
+
+    // loads and runs a fresh engine each iteration
+    template <typename Engine>
+    bool Measure(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, int iterations, Result &r)
+    {
+        for (int i = 0; i < iterations; i++)
+        {
+            Engine in;
+            bench::Timer load;
+            if (!in.Load(root, semantic))
+            {
+                in.Diags().Print();
+                return false;
+            }
+            double ms = load.Seconds() * 1000;
+            r.load_ms = i == 0 ? ms : std::min(r.load_ms, ms);
+            bench::Timer run;
+            if (!in.Run(r.value))
+            {
+                in.Diags().Print();
+                return false;
+            }
+            ms = run.Seconds() * 1000;
+            r.run_ms = i == 0 ? ms : std::min(r.run_ms, ms);
+        }
+        return true;
+    }
+
+    // the most frequent opcode pairs a profiled run of the vm executes
+    bool PrintPairs(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, size_t count)
+    {
+        runtime::VM vm;
+        int64_t value = 0;
+        if (!vm.Load(root, semantic))
+        {
+            vm.Diags().Print();
+            return false;
+        }
+        vm.SetProfile(true);
+        if (!vm.Run(value))
+        {
+            vm.Diags().Print();
+            return false;
+        }
+        auto pairs = vm.Pairs();
+        uint64_t total = 0;
+        for (auto &pair : pairs)
+        {
+            total += pair.count;
+        }
+        for (size_t i = 0; i < pairs.size() && i < count; i++)
+        {
+            std::cout << "  " << std::left << std::setw(14) << runtime::OpName(pairs[i].first) << std::setw(14)
+                      << runtime::OpName(pairs[i].second) << std::right << std::setw(12) << pairs[i].count
+                      << std::setw(8) << 100.0 * pairs[i].count / total << "%" << std::endl;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 3;
+    size_t pairs = 0;
+    string_t only;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (arg.compare(0, 10, "--program=") == 0)
+        {
+            only = arg.substr(10);
+        }
+        else if (arg.compare(0, 8, "--pairs=") == 0)
+        {
+            pairs = std::atoi(arg.c_str() + 8);
+        }
+        else
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Program> programs = {
+        {"fib", kFib, 196418},
+        {"loop", kLoop, -3176},
+        {"sieve", kSieve, 148933},
+        {"mandel", kMandel, 1758057},
+    };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "program  engine         load ms     run ms      result   speedup" << std::endl;
+    for (auto &p : programs)
+    {
+        if (!only.empty() && only != p.name)
+        {
+            continue;
+        }
+        Diagnostics diag;
+        Parser parser(diag);
+        auto root = parser.ParseString(p.source);
+        ast::SemanticVisitor semantic(diag);
+        semantic.Analyze(root);
+        if (diag.HasErrors())
+        {
+            diag.Print();
+            return 1;
+        }
+        struct Engine
+        {
+            const char *name;
+            std::function<bool(Result &)> measure;
+        };
+        std::vector<Engine> engines = {
+            {"closure", [&](Result &r) { return Measure<runtime::Interpreter>(root, semantic, iterations, r); }},
+            {"vm", [&](Result &r) { return Measure<runtime::VM>(root, semantic, iterations, r); }},
+        };
+        double base = 0;
+        for (auto &e : engines)
+        {
+            Result r;
+            if (!e.measure(r))
+            {
+                std::cout << p.name << ": run on " << e.name << " failed" << std::endl;
+                return 1;
+            }
+            if (base == 0)
+            {
+                base = r.run_ms;
+            }
+            std::cout << std::left << std::setw(9) << p.name << std::setw(11) << e.name << std::right
+                      << std::setw(11) << r.load_ms << std::setw(11) << r.run_ms << std::setw(12) << r.value
+                      << std::setw(10) << base / r.run_ms << "x" << std::endl;
+            if (r.value != p.expect)
+            {
+                std::cout << p.name << ": expect " << p.expect << std::endl;
+                return 1;
+            }
+        }
+        if (pairs != 0 && !PrintPairs(root, semantic, pairs))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
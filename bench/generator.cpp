@@ -0,0 +1,599 @@
+#include <cstdlib>
+#include "./generator.h"
+
+namespace lilang
+{
+    namespace bench
+    {
+        bool GeneratorOptions::ParseArg(const string_t &arg)
+        {
+            auto eq = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || eq == string_t::npos)
+            {
+                return false;
+            }
+            auto key = arg.substr(2, eq - 2);
+            auto val = arg.substr(eq + 1);
+            if (key == "functions")
+            {
+                functions = std::atoi(val.c_str());
+            }
+            else if (key == "statements")
+            {
+                statements = std::atoi(val.c_str());
+            }
+            else if (key == "depth")
+            {
+                max_depth = std::atoi(val.c_str());
+            }
+            else if (key == "width")
+            {
+                expr_width = std::atoi(val.c_str());
+            }
+            else if (key == "calls")
+            {
+                call_density = std::atof(val.c_str());
+            }
+            else if (key == "globals")
+            {
+                globals = std::atoi(val.c_str());
+            }
+            else if (key == "seed")
+            {
+                seed = std::atoi(val.c_str());
+            }
+            else
+            {
+                return false;
+            }
+            return true;
+        }
+
+        string_t GeneratorOptions::String() const
+        {
+            stringstream_t ss;
+            ss << "functions=" << functions
+               << " statements=" << statements
+               << " depth=" << max_depth
+               << " width=" << expr_width
+               << " calls=" << call_density
+               << " globals=" << globals
+               << " seed=" << seed;
+            return ss.str();
+        }
+
+        ProgramGenerator::ProgramGenerator(const GeneratorOptions &opt)
+            : opt(opt), rng(opt.seed), indent(0), name_seq(0), cur_func(0), call_depth(0)
+        {
+        }
+
+        string_t ProgramGenerator::Generate()
+        {
+            out.str("");
+            funcs.clear();
+            scopes.clear();
+            EnterScope(); // global scope
+            for (int i = 0; i < opt.globals; i++)
+            {
+                GlobalDecl();
+            }
+            for (int i = 0; i < opt.functions; i++)
+            {
+                FuncDecl(i);
+            }
+            MainDecl();
+            LeaveScope();
+            return out.str();
+        }
+
+        //********************************************************************
+        // helper
+        //********************************************************************
+
+        int ProgramGenerator::Rand(int lo, int hi)
+        {
+            if (hi <= lo)
+            {
+                return lo;
+            }
+            return std::uniform_int_distribution<int>(lo, hi)(rng);
+        }
+
+        bool ProgramGenerator::Chance(double p)
+        {
+            return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+        }
+
+        string_t ProgramGenerator::NewName(const string_t &prefix)
+        {
+            return prefix + std::to_string(name_seq++);
+        }
+
+        void ProgramGenerator::Line(const string_t &s)
+        {
+            for (int i = 0; i < indent; i++)
+            {
+                out << "    ";
+            }
+            out << s << "\n";
+        }
+
+        void ProgramGenerator::EnterScope()
+        {
+            scopes.emplace_back();
+        }
+
+        void ProgramGenerator::LeaveScope()
+        {
+            scopes.pop_back();
+        }
+
+        void ProgramGenerator::AddVar(const string_t &name, VarType t, bool assignable)
+        {
+            scopes.back().push_back({name, t, assignable});
+        }
+
+        // pick a visible variable, nullptr if none
+        const ProgramGenerator::Var *ProgramGenerator::PickVar(VarType t, bool assignable)
+        {
+            int count = 0;
+            for (auto &scope : scopes)
+            {
+                for (auto &v : scope)
+                {
+                    if (v.type == t && (!assignable || v.assignable))
+                    {
+                        count++;
+                    }
+                }
+            }
+            if (count == 0)
+            {
+                return nullptr;
+            }
+            int n = Rand(0, count - 1);
+            for (auto &scope : scopes)
+            {
+                for (auto &v : scope)
+                {
+                    if (v.type == t && (!assignable || v.assignable) && n-- == 0)
+                    {
+                        return &v;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        //********************************************************************
+        // expression related
+        //********************************************************************
+
+        string_t ProgramGenerator::IntLit()
+        {
+            switch (Rand(0, 9))
+            {
+            case 0:
+                return "0b101";
+            case 1:
+                return "0o17";
+            case 2:
+                return "0xff";
+            default:
+                return std::to_string(Rand(1, 1000));
+            }
+        }
+
+        string_t ProgramGenerator::FloatLit()
+        {
+            return std::to_string(Rand(0, 100)) + "." + std::to_string(Rand(0, 99));
+        }
+
+        // an expression of type int exactly, usable by bit operators
+        string_t ProgramGenerator::IntExpr(int width)
+        {
+            if (width <= 1)
+            {
+                if (call_depth < 2 && Chance(opt.call_density))
+                {
+                    auto call = CallExpr(2);
+                    if (call != "")
+                    {
+                        return call;
+                    }
+                }
+                switch (Rand(0, 5))
+                {
+                case 0:
+                    return IntLit();
+                case 1:
+                    return "-" + IntLit();
+                case 2:
+                    return "int(" + FloatLit() + ")";
+                default:
+                {
+                    auto v = PickVar(VarType::kInt, false);
+                    return v != nullptr ? v->name : IntLit();
+                }
+                }
+            }
+            static const char *ops[] = {" & ", " | ", " ^ "};
+            int left = Rand(1, width - 1);
+            auto e = IntExpr(left) + ops[Rand(0, 2)] + IntExpr(width - left);
+            return Chance(0.3) ? "(" + e + ")" : e;
+        }
+
+        // an arithmetic expression of type int or float
+        string_t ProgramGenerator::NumExpr(int width)
+        {
+            if (width <= 1)
+            {
+                switch (Rand(0, 3))
+                {
+                case 0:
+                    return FloatLit();
+                case 1:
+                {
+                    auto v = PickVar(VarType::kFloat, false);
+                    return v != nullptr ? v->name : FloatLit();
+                }
+                default:
+                    return IntExpr(1);
+                }
+            }
+            static const char *ops[] = {" + ", " - ", " * "};
+            int left = Rand(1, width - 1);
+            auto l = NumExpr(left);
+            if (Chance(0.15))
+            {
+                // keep the divisor a non-zero literal
+                return l + " / " + std::to_string(Rand(1, 9));
+            }
+            auto e = l + ops[Rand(0, 2)] + NumExpr(width - left);
+            return Chance(0.3) ? "(" + e + ")" : e;
+        }
+
+        string_t ProgramGenerator::BoolExpr(int width)
+        {
+            if (width <= 2)
+            {
+                switch (Rand(0, 5))
+                {
+                case 0:
+                    return Chance(0.5) ? "true" : "false";
+                case 1:
+                {
+                    auto v = PickVar(VarType::kBool, false);
+                    return v != nullptr ? v->name : "true";
+                }
+                default:
+                {
+                    static const char *ops[] = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+                    int w = width < 2 ? 2 : width;
+                    return NumExpr(w / 2) + ops[Rand(0, 5)] + NumExpr(w - w / 2);
+                }
+                }
+            }
+            int left = Rand(2, width - 1);
+            switch (Rand(0, 4))
+            {
+            case 0:
+                return "!(" + BoolExpr(width) + ")";
+            case 1:
+            case 2:
+                return BoolExpr(left) + " && " + BoolExpr(width - left);
+            default:
+                return BoolExpr(left) + " || " + BoolExpr(width - left);
+            }
+        }
+
+        // call an int-returning function declared before, "" if none
+        string_t ProgramGenerator::CallExpr(int width)
+        {
+            std::vector<int> candidates;
+            for (int i = 0; i < cur_func; i++)
+            {
+                if (funcs[i].returns)
+                {
+                    candidates.push_back(i);
+                }
+            }
+            if (candidates.empty())
+            {
+                return "";
+            }
+            auto &f = funcs[candidates[Rand(0, candidates.size() - 1)]];
+            string_t s = f.name + "(";
+            call_depth++;
+            for (int i = 0; i < f.params; i++)
+            {
+                if (i > 0)
+                {
+                    s += ", ";
+                }
+                s += Chance(0.5) ? IntExpr(width) : NumExpr(width);
+            }
+            call_depth--;
+            return s + ")";
+        }
+
+        string_t ProgramGenerator::ExprOf(VarType t, int width)
+        {
+            switch (t)
+            {
+            case VarType::kInt:
+                return IntExpr(width);
+            case VarType::kFloat:
+                return NumExpr(width);
+            default:
+                return BoolExpr(width);
+            }
+        }
+
+        //********************************************************************
+        // statement related
+        //********************************************************************
+
+        void ProgramGenerator::StmtList(int n, int depth)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                Stmt(depth);
+            }
+        }
+
+        void ProgramGenerator::Stmt(int depth)
+        {
+            int kind = Rand(0, 9);
+            if (depth >= opt.max_depth && kind >= 6)
+            {
+                kind = kind % 6;
+            }
+            switch (kind)
+            {
+            case 0:
+            case 1:
+            case 2:
+                VarDeclStmt();
+                break;
+            case 3:
+            case 4:
+                AssignStmt();
+                break;
+            case 5:
+            {
+                auto call = CallExpr(opt.expr_width / 2 + 1);
+                if (call == "")
+                {
+                    VarDeclStmt();
+                }
+                else
+                {
+                    Line(call + ";");
+                }
+            }
+            break;
+            case 6:
+            case 7:
+                IfStmt(depth);
+                break;
+            case 8:
+                Chance(0.5) ? WhileStmt(depth) : ForStmt(depth);
+                break;
+            default:
+                BlockStmt(depth);
+            }
+        }
+
+        // let x = e;
+        // let x, y = e1, e2;
+        // let x float;
+        void ProgramGenerator::VarDeclStmt()
+        {
+            auto t = static_cast<VarType>(Rand(0, 2));
+            auto width = Rand(1, opt.expr_width);
+            switch (Rand(0, 3))
+            {
+            case 0:
+            {
+                auto a = NewName("v");
+                auto b = NewName("v");
+                auto t2 = static_cast<VarType>(Rand(0, 2));
+                Line("let " + a + ", " + b + " = " + ExprOf(t, width) + ", " + ExprOf(t2, width) + ";");
+                AddVar(a, t, true);
+                AddVar(b, t2, true);
+                return;
+            }
+            case 1:
+            {
+                static const char *names[] = {"int", "float", "bool"};
+                auto a = NewName("v");
+                Line("let " + a + " " + names[static_cast<int>(t)] + ";");
+                AddVar(a, t, true);
+                return;
+            }
+            default:
+            {
+                auto a = NewName("v");
+                Line("let " + a + " = " + ExprOf(t, width) + ";");
+                AddVar(a, t, true);
+                return;
+            }
+            }
+        }
+
+        void ProgramGenerator::AssignStmt()
+        {
+            auto t = static_cast<VarType>(Rand(0, 2));
+            auto v = PickVar(t, true);
+            if (v == nullptr)
+            {
+                VarDeclStmt();
+                return;
+            }
+            auto width = Rand(1, opt.expr_width);
+            if (t == VarType::kInt && Chance(0.3))
+            {
+                Line(v->name + " += " + IntExpr(width) + ";");
+                return;
+            }
+            Line(v->name + " = " + ExprOf(t, width) + ";");
+        }
+
+        void ProgramGenerator::IfStmt(int depth)
+        {
+            Line("if (" + BoolExpr(Rand(2, opt.expr_width + 1)) + ") {");
+            indent++;
+            EnterScope();
+            StmtList(Rand(1, 3), depth + 1);
+            LeaveScope();
+            indent--;
+            while (Chance(0.3))
+            {
+                Line("} else if (" + BoolExpr(Rand(2, opt.expr_width + 1)) + ") {");
+                indent++;
+                EnterScope();
+                StmtList(Rand(1, 3), depth + 1);
+                LeaveScope();
+                indent--;
+            }
+            if (Chance(0.5))
+            {
+                Line("} else {");
+                indent++;
+                EnterScope();
+                StmtList(Rand(1, 3), depth + 1);
+                LeaveScope();
+                indent--;
+            }
+            Line("}");
+        }
+
+        // the counter keeps the loop finite
+        void ProgramGenerator::WhileStmt(int depth)
+        {
+            auto counter = NewName("w");
+            Line("let " + counter + " = 0;");
+            AddVar(counter, VarType::kInt, false);
+            Line("while (" + counter + " < " + std::to_string(Rand(1, 20)) + " && " +
+                 BoolExpr(Rand(2, opt.expr_width)) + ") {");
+            indent++;
+            EnterScope();
+            StmtList(Rand(1, 3), depth + 1);
+            if (Chance(0.2))
+            {
+                Line("if (" + BoolExpr(2) + ") {");
+                Line("    break;");
+                Line("}");
+            }
+            Line(counter + " += 1;");
+            LeaveScope();
+            indent--;
+            Line("}");
+        }
+
+        void ProgramGenerator::ForStmt(int depth)
+        {
+            auto i = NewName("i");
+            Line("for (let " + i + " = 0; " + i + " < " + std::to_string(Rand(1, 20)) +
+                 "; " + i + " += 1) {");
+            indent++;
+            EnterScope();
+            AddVar(i, VarType::kInt, false);
+            if (Chance(0.2))
+            {
+                Line("if (" + BoolExpr(2) + ") {");
+                Line("    continue;");
+                Line("}");
+            }
+            StmtList(Rand(1, 3), depth + 1);
+            LeaveScope();
+            indent--;
+            Line("}");
+        }
+
+        void ProgramGenerator::BlockStmt(int depth)
+        {
+            Line("{");
+            indent++;
+            EnterScope();
+            StmtList(Rand(1, 3), depth + 1);
+            LeaveScope();
+            indent--;
+            Line("}");
+        }
+
+        //********************************************************************
+        // declaration related
+        //********************************************************************
+
+        void ProgramGenerator::GlobalDecl()
+        {
+            auto name = NewName("g");
+            if (Chance(0.5))
+            {
+                Line("let " + name + " = " + IntLit() + ";");
+                AddVar(name, VarType::kInt, true);
+            }
+            else
+            {
+                Line("let " + name + " float;");
+                AddVar(name, VarType::kFloat, true);
+            }
+        }
+
+        // fn f_3(int p0, int p1) int
+        void ProgramGenerator::FuncDecl(int index)
+        {
+            Func f;
+            f.name = "f_" + std::to_string(index);
+            f.params = Rand(0, 3);
+            f.returns = Chance(0.7);
+            cur_func = index;
+
+            EnterScope();
+            string_t sig = "fn " + f.name + "(";
+            for (int i = 0; i < f.params; i++)
+            {
+                auto p = "p" + std::to_string(i);
+                sig += (i > 0 ? ", int " : "int ") + p;
+                AddVar(p, VarType::kInt, false); // parameters are not assignable
+            }
+            sig += f.returns ? ") int {" : ") {";
+            Line(sig);
+            indent++;
+            StmtList(opt.statements, 0);
+            if (f.returns)
+            {
+                Line("return " + IntExpr(Rand(1, opt.expr_width)) + ";");
+            }
+            indent--;
+            Line("}");
+            Line("");
+            LeaveScope();
+            funcs.push_back(f);
+        }
+
+        void ProgramGenerator::MainDecl()
+        {
+            cur_func = funcs.size();
+            Line("fn main() int {");
+            indent++;
+            EnterScope();
+            Line("let r = 0;");
+            AddVar("r", VarType::kInt, true);
+            for (int i = 0; i < 4; i++)
+            {
+                auto call = CallExpr(1);
+                if (call != "")
+                {
+                    Line("r += " + call + ";");
+                }
+            }
+            Line("return r;");
+            LeaveScope();
+            indent--;
+            Line("}");
+        }
+    }
+}
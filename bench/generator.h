@@ -0,0 +1,114 @@
+#ifndef LILANG_BENCH_GENERATOR
+#define LILANG_BENCH_GENERATOR
+
+#include <vector>
+#include <random>
+#include "../src/listl.h"
+
+/*
+grammar-driven program generator, every emitted program is expected to be
+accepted by both the parser and the semantic checker.
+
+knobs:
+functions       number of top level functions (main excluded)
+statements      statements per function body
+max_depth       nesting depth of if/while/for/block statements
+expr_width      max number of leaves in one expression
+call_density    probability of an operand being a function call
+globals         number of top level variables
+*/
+namespace lilang
+{
+    namespace bench
+    {
+        struct GeneratorOptions
+        {
+            int functions = 100;
+            int statements = 20;
+            int max_depth = 3;
+            int expr_width = 4;
+            double call_density = 0.2;
+            int globals = 10;
+            unsigned int seed = 1;
+
+            // --functions=100 --statements=20 ...
+            bool ParseArg(const string_t &);
+            string_t String() const;
+        };
+
+        class ProgramGenerator
+        {
+        public:
+            ProgramGenerator(const GeneratorOptions &opt);
+            string_t Generate();
+
+        private:
+            enum class VarType
+            {
+                kInt,
+                kFloat,
+                kBool,
+            };
+
+            struct Var
+            {
+                string_t name;
+                VarType type;
+                bool assignable;
+            };
+
+            struct Func
+            {
+                string_t name;
+                int params;
+                bool returns;
+            };
+
+            GeneratorOptions opt;
+            std::mt19937 rng;
+            stringstream_t out;
+            int indent;
+            int name_seq;
+            int cur_func;
+            int call_depth; // calls nested in call arguments
+            std::vector<Func> funcs;
+            std::vector<std::vector<Var>> scopes;
+
+            // helper
+            int Rand(int lo, int hi); // [lo, hi]
+            bool Chance(double p);
+            string_t NewName(const string_t &prefix);
+            void Line(const string_t &s);
+            void EnterScope();
+            void LeaveScope();
+            void AddVar(const string_t &, VarType, bool);
+            const Var *PickVar(VarType, bool assignable);
+
+            // expression related
+            string_t IntLit();
+            string_t FloatLit();
+            string_t IntExpr(int width);
+            string_t NumExpr(int width);
+            string_t BoolExpr(int width);
+            string_t CallExpr(int width);
+            string_t ExprOf(VarType, int width);
+
+            // statement related
+            void Stmt(int depth);
+            void StmtList(int n, int depth);
+            void VarDeclStmt();
+            void AssignStmt();
+            void IfStmt(int depth);
+            void WhileStmt(int depth);
+            void ForStmt(int depth);
+            void BlockStmt(int depth);
+
+            // declaration related
+            void GlobalDecl();
+            void FuncDecl(int index);
+            void MainDecl();
+        };
+    }
+}
+
+#endif
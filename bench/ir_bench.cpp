@@ -0,0 +1,59 @@
+#include <iostream>
+#include <iomanip>
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/ir/lower.h"
+#include "../src/ir/pass_manager.h"
+#include "./bench.h"
+#include "./generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// where the optimizer spends its time on a generated program
+// usage: ir_bench [-O0|-O1|-O2] [--passes=a,b] [--rounds=N] [--verify] [generator options]
+int main(int argc, char **argv)
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 1000;
+    Diagnostics diag;
+    ir::PassManager pm(diag);
+    pm.SetLevel(2);
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (!opt.ParseArg(arg) && !pm.ParseArg(arg))
+        {
+            diag.Print();
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    auto src = bench::ProgramGenerator(opt).Generate();
+    bench::Timer check;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    double check_ms = check.Seconds() * 1000;
+    bench::Timer lower;
+    ir::Module m;
+    if (diag.HasErrors() || !ir::Lowering(diag).Lower(root, semantic, m))
+    {
+        diag.Print();
+        return 1;
+    }
+    double lower_ms = lower.Seconds() * 1000;
+    if (!pm.Run(m))
+    {
+        diag.Print();
+        return 1;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "options: " << opt.String() << std::endl;
+    std::cout << "parse and check " << check_ms << " ms, lower " << lower_ms << " ms, " << m.functions.size()
+              << " functions" << std::endl;
+    pm.PrintReport(std::cout);
+    return 0;
+}
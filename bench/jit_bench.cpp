@@ -0,0 +1,283 @@
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/native/jit.h"
+#include "./bench.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+namespace
+{
+    typedef int64_t (*Kernel)(int64_t);
+
+    // a numeric loop in the language and the same loop in c, both called with arg
+    struct Program
+    {
+        string_t name;
+        string_t source; // declares fn run(int n) int
+        Kernel c;
+        int64_t arg;
+        int64_t expect;
+    };
+
+    const char *kLoop =
+        "fn run(int n) int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < n; i += 1) {\n"
+        "        let j = 0;\n"
+        "        while (j < 1000) {\n"
+        "            s = s + (i ^ j) % 7 - 3;\n"
+        "            j += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    int64_t LoopC(int64_t n)
+    {
+        int64_t s = 0;
+        for (int64_t i = 0; i < n; i += 1)
+        {
+            int64_t j = 0;
+            while (j < 1000)
+            {
+                s = s + (i ^ j) % 7 - 3;
+                j += 1;
+            }
+        }
+        return s;
+    }
+
+    const char *kCollatz =
+        "fn run(int n) int {\n"
+        "    let steps = 0;\n"
+        "    for (let i = 1; i <= n; i += 1) {\n"
+        "        let x = i;\n"
+        "        while (x != 1) {\n"
+        "            if (x % 2 == 0) {\n"
+        "                x = x / 2;\n"
+        "            } else {\n"
+        "                x = 3 * x + 1;\n"
+        "            }\n"
+        "            steps += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    return steps;\n"
+        "}\n";
+
+    int64_t CollatzC(int64_t n)
+    {
+        int64_t steps = 0;
+        for (int64_t i = 1; i <= n; i += 1)
+        {
+            int64_t x = i;
+            while (x != 1)
+            {
+                if (x % 2 == 0)
+                {
+                    x = x / 2;
+                }
+                else
+                {
+                    x = 3 * x + 1;
+                }
+                steps += 1;
+            }
+        }
+        return steps;
+    }
+
+    const char *kPi =
+        "fn run(int n) int {\n"
+        "    let s, h = 0.0, 1.0 / float(n);\n"
+        "    for (let i = 0; i < n; i += 1) {\n"
+        "        let x = (float(i) + 0.5) * h;\n"
+        "        s += 4.0 / (1.0 + x * x);\n"
+        "    }\n"
+        "    return int(s * h * 1000000.0);\n"
+        "}\n";
+
+    int64_t PiC(int64_t n)
+    {
+        double s = 0.0, h = 1.0 / static_cast<double>(n);
+        for (int64_t i = 0; i < n; i += 1)
+        {
+            double x = (static_cast<double>(i) + 0.5) * h;
+            s += 4.0 / (1.0 + x * x);
+        }
+        return static_cast<int64_t>(s * h * 1000000.0);
+    }
+
+    const char *kMandel =
+        "fn escapes(float cx, float cy) int {\n"
+        "    let x, y = 0.0, 0.0;\n"
+        "    for (let n = 0; n < 100; n += 1) {\n"
+        "        if (x * x + y * y > 4.0) {\n"
+        "            return n;\n"
+        "        }\n"
+        "        x, y = x * x - y * y + cx, 2.0 * x * y + cy;\n"
+        "    }\n"
+        "    return 100;\n"
+        "}\n"
+        "fn run(int size) int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < size; i += 1) {\n"
+        "        for (let j = 0; j < size; j += 1) {\n"
+        "            s += escapes(float(i) / 100.0 - 1.5, float(j) / 100.0 - 1.0);\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    int64_t Escapes(double cx, double cy)
+    {
+        double x = 0.0, y = 0.0;
+        for (int64_t n = 0; n < 100; n += 1)
+        {
+            if (x * x + y * y > 4.0)
+            {
+                return n;
+            }
+            double nx = x * x - y * y + cx;
+            y = 2.0 * x * y + cy;
+            x = nx;
+        }
+        return 100;
+    }
+
+    int64_t MandelC(int64_t size)
+    {
+        int64_t s = 0;
+        for (int64_t i = 0; i < size; i += 1)
+        {
+            for (int64_t j = 0; j < size; j += 1)
+            {
+                s += Escapes(static_cast<double>(i) / 100.0 - 1.5, static_cast<double>(j) / 100.0 - 1.0);
+            }
+        }
+        return s;
+    }
+
+    const char *kSieve =
+        "fn run(int n) int {\n"
+        "    let composite []bool;\n"
+        "    composite[n] = false;\n"
+        "    let count = 0;\n"
+        "    for (let i = 2; i <= n; i += 1) {\n"
+        "        if (!composite[i]) {\n"
+        "            count += 1;\n"
+        "            for (let k = i * 2; k <= n; k += i) {\n"
+        "                composite[k] = true;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    return count;\n"
+        "}\n";
+
+    int64_t SieveC(int64_t n)
+    {
+        char *composite = static_cast<char *>(std::calloc(n + 1, 1));
+        int64_t count = 0;
+        for (int64_t i = 2; i <= n; i += 1)
+        {
+            if (!composite[i])
+            {
+                count += 1;
+                for (int64_t k = i * 2; k <= n; k += i)
+                {
+                    composite[k] = 1;
+                }
+            }
+        }
+        std::free(composite);
+        return count;
+    }
+
+    // the best of the calls after a first one, in ms
+    double SteadyState(Kernel k, int64_t arg, int iterations, int64_t &value)
+    {
+        value = k(arg);
+        double best = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            bench::Timer t;
+            value = k(arg);
+            double ms = t.Seconds() * 1000;
+            best = i == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 5;
+    string_t only;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (arg.compare(0, 10, "--program=") == 0)
+        {
+            only = arg.substr(10);
+        }
+        else
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // the kernels are called through pointers, so neither side is inlined into the loop
+    std::vector<Program> programs = {
+        {"loop", kLoop, LoopC, 3000, -3176},
+        {"collatz", kCollatz, CollatzC, 300000, 35669725},
+        {"pi", kPi, PiC, 10000000, 3141592},
+        {"mandel", kMandel, MandelC, 200, 1758057},
+        {"sieve", kSieve, SieveC, 2000000, 148933},
+    };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "program  engine     compile ms     run ms      result   of c" << std::endl;
+    for (auto &p : programs)
+    {
+        if (!only.empty() && only != p.name)
+        {
+            continue;
+        }
+        Diagnostics diag;
+        Parser parser(diag);
+        auto root = parser.ParseString(p.source);
+        ast::SemanticVisitor semantic(diag);
+        semantic.Analyze(root);
+        bench::Timer compile;
+        native::Jit jit(diag);
+        auto run = diag.HasErrors() || !jit.Load(root, semantic) ? nullptr : jit.Entry<int64_t(int64_t)>("run");
+        double compile_ms = compile.Seconds() * 1000;
+        if (run == nullptr)
+        {
+            diag.Print();
+            return 1;
+        }
+
+        int64_t c_value = 0, jit_value = 0;
+        double c_ms = SteadyState(p.c, p.arg, iterations, c_value);
+        double jit_ms = SteadyState(run, p.arg, iterations, jit_value);
+        std::cout << std::left << std::setw(9) << p.name << std::setw(8) << "c -O2" << std::right << std::setw(13)
+                  << 0.0 << std::setw(11) << c_ms << std::setw(12) << c_value << std::setw(8) << 1.0 << std::endl;
+        std::cout << std::left << std::setw(9) << p.name << std::setw(8) << "jit" << std::right << std::setw(13)
+                  << compile_ms << std::setw(11) << jit_ms << std::setw(12) << jit_value << std::setw(8)
+                  << jit_ms / c_ms << std::endl;
+        if (c_value != p.expect || jit_value != p.expect || jit.Trapped())
+        {
+            std::cout << p.name << ": expect " << p.expect << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,349 @@
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/native/aot.h"
+#include "../src/native/transpile.h"
+#include "../src/runtime/vm.h"
+#include "./bench.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+namespace
+{
+    struct Program
+    {
+        string_t name;
+        string_t source;
+        string_t c; // the same program in c, printing what main returns
+        int64_t expect;
+    };
+
+    // the programs of exec_bench
+    const char *kFib =
+        "fn fib(int n) int {\n"
+        "    if (n < 2) {\n"
+        "        return n;\n"
+        "    }\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "fn main() int {\n"
+        "    return fib(27);\n"
+        "}\n";
+
+    const char *kFibC =
+        "#include <stdio.h>\n"
+        "#include <stdint.h>\n"
+        "int64_t fib(int64_t n) {\n"
+        "    if (n < 2) {\n"
+        "        return n;\n"
+        "    }\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "int main(void) {\n"
+        "    printf(\"%lld\\n\", (long long)fib(27));\n"
+        "    return 0;\n"
+        "}\n";
+
+    const char *kLoop =
+        "fn main() int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < 3000; i += 1) {\n"
+        "        let j = 0;\n"
+        "        while (j < 1000) {\n"
+        "            s = s + (i ^ j) % 7 - 3;\n"
+        "            j += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    const char *kLoopC =
+        "#include <stdio.h>\n"
+        "#include <stdint.h>\n"
+        "int main(void) {\n"
+        "    int64_t s = 0;\n"
+        "    for (int64_t i = 0; i < 3000; i += 1) {\n"
+        "        int64_t j = 0;\n"
+        "        while (j < 1000) {\n"
+        "            s = s + (i ^ j) % 7 - 3;\n"
+        "            j += 1;\n"
+        "        }\n"
+        "    }\n"
+        "    printf(\"%lld\\n\", (long long)s);\n"
+        "    return 0;\n"
+        "}\n";
+
+    const char *kSieve =
+        "fn main() int {\n"
+        "    let n = 2000000;\n"
+        "    let composite []bool;\n"
+        "    composite[n] = false;\n"
+        "    let count = 0;\n"
+        "    for (let i = 2; i <= n; i += 1) {\n"
+        "        if (!composite[i]) {\n"
+        "            count += 1;\n"
+        "            for (let k = i * 2; k <= n; k += i) {\n"
+        "                composite[k] = true;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    return count;\n"
+        "}\n";
+
+    const char *kSieveC =
+        "#include <stdio.h>\n"
+        "#include <stdint.h>\n"
+        "#include <stdlib.h>\n"
+        "int main(void) {\n"
+        "    int64_t n = 2000000;\n"
+        "    char *composite = calloc(n + 1, 1);\n"
+        "    int64_t count = 0;\n"
+        "    for (int64_t i = 2; i <= n; i += 1) {\n"
+        "        if (!composite[i]) {\n"
+        "            count += 1;\n"
+        "            for (int64_t k = i * 2; k <= n; k += i) {\n"
+        "                composite[k] = 1;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "    printf(\"%lld\\n\", (long long)count);\n"
+        "    return 0;\n"
+        "}\n";
+
+    const char *kMandel =
+        "fn escapes(float cx, float cy) int {\n"
+        "    let x, y = 0.0, 0.0;\n"
+        "    for (let n = 0; n < 100; n += 1) {\n"
+        "        if (x * x + y * y > 4.0) {\n"
+        "            return n;\n"
+        "        }\n"
+        "        x, y = x * x - y * y + cx, 2.0 * x * y + cy;\n"
+        "    }\n"
+        "    return 100;\n"
+        "}\n"
+        "fn main() int {\n"
+        "    let s = 0;\n"
+        "    for (let i = 0; i < 200; i += 1) {\n"
+        "        for (let j = 0; j < 200; j += 1) {\n"
+        "            s += escapes(float(i) / 100.0 - 1.5, float(j) / 100.0 - 1.0);\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n";
+
+    const char *kMandelC =
+        "#include <stdio.h>\n"
+        "#include <stdint.h>\n"
+        "int64_t escapes(double cx, double cy) {\n"
+        "    double x = 0.0, y = 0.0;\n"
+        "    for (int64_t n = 0; n < 100; n += 1) {\n"
+        "        if (x * x + y * y > 4.0) {\n"
+        "            return n;\n"
+        "        }\n"
+        "        double nx = x * x - y * y + cx;\n"
+        "        y = 2.0 * x * y + cy;\n"
+        "        x = nx;\n"
+        "    }\n"
+        "    return 100;\n"
+        "}\n"
+        "int main(void) {\n"
+        "    int64_t s = 0;\n"
+        "    for (int64_t i = 0; i < 200; i += 1) {\n"
+        "        for (int64_t j = 0; j < 200; j += 1) {\n"
+        "            s += escapes((double)i / 100.0 - 1.5, (double)j / 100.0 - 1.0);\n"
+        "        }\n"
+        "    }\n"
+        "    printf(\"%lld\\n\", (long long)s);\n"
+        "    return 0;\n"
+        "}\n";
+
+    struct Result
+    {
+        double build_ms = 0;
+        double run_ms = 0; // best of the iterations
+        int64_t value = 0;
+    };
+
+    // runs an executable, the time includes starting the process
+    bool Execute(const string_t &path, int iterations, Result &r)
+    {
+        for (int i = 0; i < iterations; i++)
+        {
+            bench::Timer run;
+            int status = std::system((path + " > " + path + ".out").c_str());
+            double ms = run.Seconds() * 1000;
+            r.run_ms = i == 0 ? ms : std::min(r.run_ms, ms);
+            std::ifstream in(path + ".out");
+            if (status != 0 || !(in >> r.value))
+            {
+                return false;
+            }
+        }
+        std::remove((path + ".out").c_str());
+        return true;
+    }
+
+    bool Native(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, int level, int iterations, Result &r)
+    {
+        Diagnostics diag;
+        native::Aot aot(diag);
+        string_t path = "./bench_native_bin";
+        bench::Timer build;
+        if (!aot.Passes().SetLevel(level) || !aot.Build(root, semantic, path))
+        {
+            diag.Print();
+            return false;
+        }
+        r.build_ms = build.Seconds() * 1000;
+        bool ok = Execute(path, iterations, r);
+        std::remove(path.c_str());
+        return ok;
+    }
+
+    bool Transpiled(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, int iterations, Result &r)
+    {
+        Diagnostics diag;
+        native::Transpiler transpiler(diag);
+        string_t path = "./bench_native_tc";
+        bench::Timer build;
+        if (!transpiler.Build(root, semantic, path))
+        {
+            diag.Print();
+            return false;
+        }
+        r.build_ms = build.Seconds() * 1000;
+        bool ok = Execute(path, iterations, r);
+        std::remove(path.c_str());
+        return ok;
+    }
+
+    bool C(const string_t &source, int iterations, Result &r)
+    {
+        string_t path = "./bench_native_c";
+        {
+            std::ofstream out(path + ".c");
+            out << source;
+        }
+        bench::Timer build;
+        bool ok = std::system(("gcc -O2 -o " + path + " " + path + ".c").c_str()) == 0;
+        r.build_ms = build.Seconds() * 1000;
+        ok = ok && Execute(path, iterations, r);
+        std::remove((path + ".c").c_str());
+        std::remove(path.c_str());
+        return ok;
+    }
+
+    bool Vm(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, int iterations, Result &r)
+    {
+        for (int i = 0; i < iterations; i++)
+        {
+            runtime::VM vm;
+            bench::Timer load;
+            if (!vm.Load(root, semantic))
+            {
+                vm.Diags().Print();
+                return false;
+            }
+            r.build_ms = load.Seconds() * 1000;
+            bench::Timer run;
+            if (!vm.Run(r.value))
+            {
+                vm.Diags().Print();
+                return false;
+            }
+            double ms = run.Seconds() * 1000;
+            r.run_ms = i == 0 ? ms : std::min(r.run_ms, ms);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 3;
+    string_t only;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (arg.compare(0, 10, "--program=") == 0)
+        {
+            only = arg.substr(10);
+        }
+        else
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Program> programs = {
+        {"fib", kFib, kFibC, 196418},
+        {"loop", kLoop, kLoopC, -3176},
+        {"sieve", kSieve, kSieveC, 148933},
+        {"mandel", kMandel, kMandelC, 1758057},
+    };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "program  engine        build ms     run ms      result   speedup" << std::endl;
+    for (auto &p : programs)
+    {
+        if (!only.empty() && only != p.name)
+        {
+            continue;
+        }
+        Diagnostics diag;
+        Parser parser(diag);
+        auto root = parser.ParseString(p.source);
+        ast::SemanticVisitor semantic(diag);
+        semantic.Analyze(root);
+        if (diag.HasErrors())
+        {
+            diag.Print();
+            return 1;
+        }
+        struct Engine
+        {
+            const char *name;
+            std::function<bool(Result &)> measure;
+        };
+        std::vector<Engine> engines = {
+            {"vm", [&](Result &r) { return Vm(root, semantic, iterations, r); }},
+            {"native -O0", [&](Result &r) { return Native(root, semantic, 0, iterations, r); }},
+            {"native -O2", [&](Result &r) { return Native(root, semantic, 2, iterations, r); }},
+            {"c -O2", [&](Result &r) { return Transpiled(root, semantic, iterations, r); }},
+            {"gcc -O2", [&](Result &r) { return C(p.c, iterations, r); }},
+        };
+        double base = 0;
+        for (auto &e : engines)
+        {
+            Result r;
+            if (!e.measure(r))
+            {
+                std::cout << p.name << ": run on " << e.name << " failed" << std::endl;
+                return 1;
+            }
+            if (base == 0)
+            {
+                base = r.run_ms;
+            }
+            std::cout << std::left << std::setw(9) << p.name << std::setw(11) << e.name << std::right
+                      << std::setw(11) << r.build_ms << std::setw(11) << r.run_ms << std::setw(12) << r.value
+                      << std::setw(10) << base / r.run_ms << "x" << std::endl;
+            if (r.value != p.expect)
+            {
+                std::cout << p.name << ": expect " << p.expect << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
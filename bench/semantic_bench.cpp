@@ -0,0 +1,258 @@
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "./bench.h"
+#include "./generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+namespace
+{
+    // about the same number of nodes for every size of an axis, so that a
+    // growing time per node means the checker does not scale along it
+    const int kBudget = 20000;
+
+    // blocks nested n deep, every level reads names of all outer levels
+    string_t ScopeDepth(int n)
+    {
+        stringstream_t ss;
+        ss << "fn main() {\n";
+        for (int rep = 0; rep < kBudget / (n * 8) + 1; rep++)
+        {
+            ss << "{\nlet s0 = " << rep << ";\n";
+            for (int i = 1; i < n; i++)
+            {
+                ss << "{\nlet s" << i << " = s" << i - 1 << " + s0;\n";
+            }
+            for (int i = 1; i < n; i++)
+            {
+                ss << "}\n";
+            }
+            ss << "}\n";
+        }
+        return ss.str() + "}\n";
+    }
+
+    // n names in one scope, each read by the next declaration
+    string_t ScopeSymbols(int n)
+    {
+        stringstream_t ss;
+        for (int rep = 0; rep < kBudget / (n * 6) + 1; rep++)
+        {
+            ss << "fn f_" << rep << "() {\nlet v0 = 1;\n";
+            for (int i = 1; i < n; i++)
+            {
+                ss << "let v" << i << " = v" << i - 1 << " * v" << i / 2 << ";\n";
+            }
+            ss << "}\n";
+        }
+        return ss.str();
+    }
+
+    // f_1_1(f_1_1(f_1_1(...))) n calls deep
+    string_t CallChain(int n)
+    {
+        stringstream_t ss;
+        ss << "fn f_1_1(int x) int {\nreturn x;\n}\nfn main() {\n";
+        for (int rep = 0; rep < kBudget / (n * 4) + 1; rep++)
+        {
+            ss << "let c" << rep << " = ";
+            for (int i = 0; i < n; i++)
+            {
+                ss << "f_1_1(";
+            }
+            ss << rep;
+            for (int i = 0; i < n; i++)
+            {
+                ss << ")";
+            }
+            ss << ";\n";
+        }
+        return ss.str() + "}\n";
+    }
+
+    // tuples of n values returned, passed on and destructured
+    string_t TupleCalls(int n)
+    {
+        stringstream_t ss;
+        ss << "fn t(";
+        for (int i = 0; i < n; i++)
+        {
+            ss << (i > 0 ? ", " : "") << "int a" << i;
+        }
+        ss << ") (";
+        for (int i = 0; i < n; i++)
+        {
+            ss << (i > 0 ? ", " : "") << "int";
+        }
+        ss << ") {\nreturn ";
+        for (int i = 0; i < n; i++)
+        {
+            ss << (i > 0 ? ", " : "") << "a" << i;
+        }
+        ss << ";\n}\nfn main() {\n";
+        for (int rep = 0; rep < kBudget / (n * 4) + 1; rep++)
+        {
+            ss << "let ";
+            for (int i = 0; i < n; i++)
+            {
+                ss << (i > 0 ? ", " : "") << "r" << rep << "_" << i;
+            }
+            ss << " = t(t(";
+            for (int i = 0; i < n; i++)
+            {
+                ss << (i > 0 ? ", " : "") << i;
+            }
+            ss << "));\n";
+        }
+        return ss.str() + "}\n";
+    }
+
+    // function literals nested n deep, each calling the one inside
+    string_t FuncNesting(int n)
+    {
+        stringstream_t ss;
+        ss << "fn main() {\n";
+        for (int rep = 0; rep < kBudget / (n * 16) + 1; rep++)
+        {
+            ss << "{\n";
+            for (int i = 0; i < n; i++)
+            {
+                ss << "let l" << i << " = fn(int x) int {\n";
+            }
+            ss << "return x;\n";
+            for (int i = n - 1; i > 0; i--)
+            {
+                ss << "};\nreturn l" << i << "(x) + x;\n";
+            }
+            ss << "};\n}\n";
+        }
+        return ss.str() + "}\n";
+    }
+
+    struct Result
+    {
+        size_t nodes;
+        double seconds; // best of the iterations
+        size_t allocs;
+        size_t peak_bytes; // above what was live before the check
+    };
+
+    bool Measure(const string_t &src, int iterations, Result &r)
+    {
+        Parser parser;
+        auto root = parser.ParseString(src);
+        if (parser.HasErrors())
+        {
+            parser.PrintErrors();
+            return false;
+        }
+        r.nodes = bench::CountNodes(root.get());
+        r.seconds = 1e9;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto before = bench::Allocations();
+            bench::ResetPeak();
+            bench::Timer timer;
+            {
+                ast::SemanticVisitor semantic;
+                semantic.SetJobs(1);
+                semantic.Analyze(root);
+                if (semantic.Diags().HasErrors())
+                {
+                    semantic.PrintErrors();
+                    return false;
+                }
+            }
+            r.seconds = std::min(r.seconds, timer.Seconds());
+            auto after = bench::Allocations();
+            r.allocs = after.allocs - before.allocs;
+            r.peak_bytes = after.peak_bytes - before.live_bytes;
+        }
+        return true;
+    }
+
+    void Report(const string_t &axis, int n, const Result &r)
+    {
+        std::cout << std::left << std::setw(10) << axis << std::right << std::setw(6) << n
+                  << std::setw(9) << r.nodes
+                  << std::setw(10) << r.seconds * 1000
+                  << std::setw(10) << r.seconds * 1e9 / r.nodes
+                  << std::setw(12) << double(r.allocs) / r.nodes
+                  << std::setw(11) << r.peak_bytes / 1024 << std::endl;
+    }
+}
+
+// checker cost along the axes that stress scopes, types and objects
+// usage: semantic_bench [--iterations=N] [--axis=name] [generator options]
+int main(int argc, char **argv)
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 1000;
+    int iterations = 5;
+    string_t only;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (arg.compare(0, 7, "--axis=") == 0)
+        {
+            only = arg.substr(7);
+        }
+        else if (!opt.ParseArg(arg))
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    struct Axis
+    {
+        string_t name;
+        std::function<string_t(int)> source;
+        std::vector<int> sizes;
+    };
+    std::vector<Axis> axes = {
+        {"depth", ScopeDepth, {1, 10, 100, 1000}},
+        {"symbols", ScopeSymbols, {10, 100, 1000, 10000}},
+        {"calls", CallChain, {1, 10, 100, 500}},
+        {"tuples", TupleCalls, {2, 8, 32, 128}},
+        {"funcs", FuncNesting, {1, 10, 100, 500}},
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "axis        size    nodes        ms   ns/node allocs/node    peak KB" << std::endl;
+    for (auto &axis : axes)
+    {
+        if (!only.empty() && only != axis.name)
+        {
+            continue;
+        }
+        for (int n : axis.sizes)
+        {
+            Result r;
+            if (!Measure(axis.source(n), iterations, r))
+            {
+                std::cout << axis.name << " " << n << ": check failed" << std::endl;
+                return 1;
+            }
+            Report(axis.name, n, r);
+        }
+    }
+    if (only.empty() || only == "program")
+    {
+        Result r;
+        if (!Measure(bench::ProgramGenerator(opt).Generate(), iterations, r))
+        {
+            return 1;
+        }
+        Report("program", opt.functions, r);
+        std::cout << "options: " << opt.String() << std::endl;
+    }
+}
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <iomanip>
+#include "../src/compiler/syntax.h"
+#include "./bench.h"
+#include "./generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// parse throughput on a generated program
+// usage: syntax_bench [--iterations=N] [generator options]
+int main(int argc, char **argv)
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 1000;
+    int iterations = 5;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (!opt.ParseArg(arg))
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    auto src = bench::ProgramGenerator(opt).Generate();
+
+    double lex_time = 1e9;
+    double parse_time = 1e9;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t ast_bytes = 0;
+    size_t ast_allocs = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        Diagnostics diag;
+        bench::Timer lex_timer;
+        auto tok_list = LexicalParser::ParseString(src, diag);
+        lex_time = std::min(lex_time, lex_timer.Seconds());
+        if (diag.HasErrors())
+        {
+            diag.Print();
+            return 1;
+        }
+        tokens = tok_list.size() - 1; // EOF excluded
+
+        ast::File::Ptr root;
+        auto before = bench::Allocations();
+        {
+            Parser parser;
+            bench::Timer parse_timer;
+            root = parser.ParseTokens(tok_list);
+            parse_time = std::min(parse_time, parse_timer.Seconds());
+            parser.PrintErrors();
+        }
+        // the parser has released its token copy, what is left is the ast
+        auto after = bench::Allocations();
+        ast_bytes = after.live_bytes - before.live_bytes;
+        ast_allocs = after.allocs - before.allocs;
+        nodes = bench::CountNodes(root.get());
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "options: " << opt.String() << std::endl;
+    std::cout << "source:  " << src.size() << " bytes, " << tokens << " tokens, "
+              << nodes << " nodes" << std::endl;
+    std::cout << "lex:     " << lex_time * 1000 << " ms, "
+              << tokens / lex_time / 1e6 << " M tokens/s" << std::endl;
+    std::cout << "parse:   " << parse_time * 1000 << " ms, "
+              << tokens / parse_time / 1e6 << " M tokens/s, "
+              << nodes / parse_time / 1e6 << " M nodes/s" << std::endl;
+    std::cout << "ast:     " << double(ast_bytes) / tokens << " bytes/token, "
+              << double(ast_bytes) / nodes << " bytes/node, "
+              << double(ast_allocs) / nodes << " allocations/node" << std::endl;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <iomanip>
+#include "../src/compiler/syntax.h"
+#include "./bench.h"
+#include "./generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+namespace
+{
+    // the same work through every walker: count nodes and sum their rows,
+    // so the walk cannot be optimized away
+
+    class VirtualCounter : public ast::Walker
+    {
+    public:
+        size_t count = 0;
+        size_t rows = 0;
+
+    protected:
+        void Pre(ast::Node *n) override
+        {
+            count++;
+            rows += n->row_number;
+        }
+    };
+
+    class SwitchCounter final : public ast::StaticWalker<SwitchCounter>
+    {
+    public:
+        size_t count = 0;
+        size_t rows = 0;
+
+        void Pre(ast::Node *n)
+        {
+            count++;
+            rows += n->row_number;
+        }
+    };
+
+    class StackCounter final : public ast::IterativeWalker<StackCounter>
+    {
+    public:
+        size_t count = 0;
+        size_t rows = 0;
+
+        bool Pre(ast::Node *n)
+        {
+            count++;
+            rows += n->row_number;
+            return true;
+        }
+    };
+}
+
+// traversal cost of the virtual Visitor against the node kind switch, recursive
+// and with an explicit stack
+// usage: traversal_bench [--iterations=N] [generator options]
+int main(int argc, char **argv)
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 1000;
+    int iterations = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        string_t arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            iterations = std::atoi(arg.c_str() + 13);
+        }
+        else if (!opt.ParseArg(arg))
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    Parser parser;
+    auto root = parser.ParseString(bench::ProgramGenerator(opt).Generate());
+    if (parser.HasErrors())
+    {
+        parser.PrintErrors();
+        return 1;
+    }
+
+    double virtual_time = 1e9;
+    double switch_time = 1e9;
+    double stack_time = 1e9;
+    size_t nodes = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        VirtualCounter v;
+        bench::Timer virtual_timer;
+        v.Walk(root.get());
+        virtual_time = std::min(virtual_time, virtual_timer.Seconds());
+
+        SwitchCounter s;
+        bench::Timer switch_timer;
+        s.Walk(root.get());
+        switch_time = std::min(switch_time, switch_timer.Seconds());
+
+        StackCounter k;
+        bench::Timer stack_timer;
+        k.Walk(root.get());
+        stack_time = std::min(stack_time, stack_timer.Seconds());
+
+        if (v.count != s.count || v.rows != s.rows || v.count != k.count || v.rows != k.rows)
+        {
+            std::cout << "walkers disagree: " << v.count << ", " << s.count << " and " << k.count
+                      << " nodes" << std::endl;
+            return 1;
+        }
+        nodes = v.count;
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "options: " << opt.String() << std::endl;
+    std::cout << "nodes:   " << nodes << std::endl;
+    std::cout << "virtual: " << virtual_time * 1000 << " ms, "
+              << virtual_time * 1e9 / nodes << " ns/node" << std::endl;
+    std::cout << "switch:  " << switch_time * 1000 << " ms, "
+              << switch_time * 1e9 / nodes << " ns/node, "
+              << virtual_time / switch_time << "x" << std::endl;
+    std::cout << "stack:   " << stack_time * 1000 << " ms, "
+              << stack_time * 1e9 / nodes << " ns/node, "
+              << virtual_time / stack_time << "x" << std::endl;
+}
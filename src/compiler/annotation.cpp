@@ -0,0 +1,71 @@
+#include "./annotation.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        void Annotations::Reset(uint32_t node_count)
+        {
+            base = 0;
+            types.assign(node_count, nullptr);
+            kinds.assign(node_count, Obj::Kind::kValue);
+        }
+
+        void Annotations::Clear()
+        {
+            base = 0;
+            std::vector<Type::Ptr>().swap(types);
+            std::vector<Obj::Kind>().swap(kinds);
+        }
+
+        void Annotations::Set(const Node *n, Obj::Kind kind, Type::Ptr type)
+        {
+            uint32_t id = n->node_id;
+            if (types.empty())
+            {
+                base = id;
+            }
+            else if (id < base)
+            {
+                types.insert(types.begin(), base - id, nullptr);
+                kinds.insert(kinds.begin(), base - id, Obj::Kind::kValue);
+                base = id;
+            }
+            if (id - base >= types.size())
+            {
+                types.resize(id - base + 1, nullptr);
+                kinds.resize(id - base + 1, Obj::Kind::kValue);
+            }
+            types[id - base] = type;
+            kinds[id - base] = kind;
+        }
+
+        void Annotations::SetInvalid(const Node *n)
+        {
+            Set(n, Obj::Kind::kValue, TypeTable::Invalid());
+        }
+
+        Type::Ptr Annotations::TypeOf(const Node *n) const
+        {
+            if (n->node_id < base || n->node_id - base >= types.size() || types[n->node_id - base] == nullptr)
+            {
+                return TypeTable::Invalid();
+            }
+            return types[n->node_id - base];
+        }
+
+        Obj::Kind Annotations::KindOf(const Node *n) const
+        {
+            if (n->node_id < base || n->node_id - base >= kinds.size())
+            {
+                return Obj::Kind::kValue;
+            }
+            return kinds[n->node_id - base];
+        }
+
+        size_t Annotations::Size() const
+        {
+            return types.size();
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LILANG_COMPILER_ANNOTATION
+#define LILANG_COMPILER_ANNOTATION
+
+#include <vector>
+#include "./ast.h"
+
+/*
+what the semantic pass learns about each expression, its type and value
+category, kept in dense arrays indexed by node id rather than in an Obj
+per expression: one pointer and one byte per node.
+
+the tables live outside the ast, they can be cleared or refilled for
+another analysis without touching the nodes. an expression never
+annotated reads as an invalid value.
+*/
+namespace lilang
+{
+    namespace ast
+    {
+        class Annotations
+        {
+        public:
+            // forget everything, ids below node_count need no growth
+            void Reset(uint32_t node_count);
+            // forget everything and free the cells, the table then starts at the first id set,
+            // so it only spans the ids of one declaration however large the ids have grown
+            void Clear();
+            // growing is not thread safe, concurrent writers need a Reset first
+            void Set(const Node *, Obj::Kind, Type::Ptr);
+            void SetInvalid(const Node *);
+            Type::Ptr TypeOf(const Node *) const;
+            Obj::Kind KindOf(const Node *) const;
+            size_t Size() const;
+
+        private:
+            uint32_t base = 0;            // id of the first cell
+            std::vector<Type::Ptr> types; // nullptr if not annotated
+            std::vector<Obj::Kind> kinds;
+        };
+    }
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "./ast.h"
 
 namespace lilang
@@ -6,65 +7,13 @@ namespace lilang
     namespace ast
     {
 
-        // absolutely same
-        bool Type::Match(const Type::Ptr &t1, const Type::Ptr &t2)
+        // absolutely same, types are interned
+        bool Type::Match(Ptr t1, Ptr t2)
         {
-            if (t1 == nullptr || t2 == nullptr)
-            {
-                return false;
-            }
-            // skip invalid, errors may have beed emitted before
-            // if (t1->kind == Type::Kind::kInvalid || t2->kind == Type::Kind::kInvalid)
-            // {
-            //     return true;
-            // }
-            if (t1->kind != t2->kind)
-            {
-                return false;
-            }
-            if (t1->kind == Type::Kind::kArray)
-            {
-                return Match(t1->base, t2->base);
-            }
-            if (t1->kind == Type::Kind::kPointer)
-            {
-                return Match(t1->base, t2->base);
-            }
-            if (t1->kind == Type::Kind::kFn)
-            {
-                if (t1->params.size() != t2->params.size() || t1->returns.size() != t2->returns.size())
-                {
-                    return false;
-                }
-                for (int i = 0; i < t1->params.size(); i++)
-                {
-                    if (!Match(t1->params[i], t2->params[i]))
-                    {
-                        return false;
-                    }
-                }
-                for (int i = 0; i < t1->returns.size(); i++)
-                {
-                    if (!Match(t1->returns[i], t2->returns[i]))
-                    {
-                        return false;
-                    }
-                }
-            }
-            if (t1->kind == Type::Kind::kTuple)
-            {
-                for (int i = 0; i < t1->vals.size(); i++)
-                {
-                    if (!Match(t1->vals[i], t2->vals[2]))
-                    {
-                        return false;
-                    }
-                }
-            }
-            return true;
+            return t1 != nullptr && t1 == t2;
         }
 
-        bool Type::Comparable(const Ptr &t)
+        bool Type::Comparable(Ptr t)
         {
             if (t->kind == Kind::kInt ||
                 t->kind == Kind::kFloat ||
@@ -75,7 +24,7 @@ namespace lilang
             return false;
         }
 
-        bool Type::CouldAssign(const Ptr &from, const Ptr &to)
+        bool Type::CouldAssign(Ptr from, Ptr to)
         {
             if (Match(from, to))
             {
@@ -94,7 +43,7 @@ namespace lilang
             return false;
         }
 
-        string_t Type::String(const Ptr &t)
+        string_t Type::String(Ptr t)
         {
             if (t == nullptr)
             {
@@ -114,12 +63,12 @@ namespace lilang
             {
                 stringstream_t ss;
                 ss << "fn(";
-                for (auto arg : t->params)
+                for (auto arg : t->Params())
                 {
                     ss << String(arg) << ",";
                 }
                 ss << ")(";
-                for (auto ret : t->returns)
+                for (auto ret : t->Returns())
                 {
                     ss << String(ret) << ",";
                 }
@@ -134,7 +83,7 @@ namespace lilang
             {
                 stringstream_t ss;
                 ss << "(";
-                for (auto tt : t->vals)
+                for (auto tt : t->Vals())
                 {
                     ss << String(tt) << ",";
                 }
@@ -148,7 +97,169 @@ namespace lilang
             }
         }
 
+        TypeTable &TypeTable::Global()
+        {
+            static TypeTable table;
+            return table;
+        }
+
+        Type::Ptr TypeTable::Int()
+        {
+            static const Type t(Type::Kind::kInt);
+            return &t;
+        }
+
+        Type::Ptr TypeTable::Float()
+        {
+            static const Type t(Type::Kind::kFloat);
+            return &t;
+        }
+
+        Type::Ptr TypeTable::String()
+        {
+            static const Type t(Type::Kind::kString);
+            return &t;
+        }
+
+        Type::Ptr TypeTable::Bool()
+        {
+            static const Type t(Type::Kind::kBool);
+            return &t;
+        }
+
+        Type::Ptr TypeTable::Invalid()
+        {
+            static const Type t(Type::Kind::kInvalid);
+            return &t;
+        }
+
+        Type::Ptr TypeTable::Pointer(Type::Ptr base)
+        {
+            Type probe(Type::Kind::kPointer);
+            probe.base = base;
+            return Intern(probe);
+        }
+
+        Type::Ptr TypeTable::Array(Type::Ptr base)
+        {
+            Type probe(Type::Kind::kArray);
+            probe.base = base;
+            return Intern(probe);
+        }
+
+        Type::Ptr TypeTable::Func(const Type::List &params, const Type::List &returns)
+        {
+            Type::List elems(params);
+            elems.insert(elems.end(), returns.begin(), returns.end());
+            Type probe(Type::Kind::kFn);
+            probe.param_count = params.size();
+            probe.elem_count = elems.size();
+            probe.elems = elems.data();
+            return Intern(probe);
+        }
+
+        Type::Ptr TypeTable::Tuple(const Type::List &vals)
+        {
+            Type probe(Type::Kind::kTuple);
+            probe.elem_count = vals.size();
+            probe.elems = vals.data();
+            return Intern(probe);
+        }
+
+        size_t TypeTable::Size()
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            return types.size();
+        }
+
+        // the probe may point to temporary elements, the interned copy owns its own.
+        // each thread remembers the types it got, types are never freed and there is
+        // only the global table, so a worker takes the lock once per distinct type
+        Type::Ptr TypeTable::Intern(const Type &probe)
+        {
+            thread_local std::unordered_set<Type::Ptr, Hash, Equal> seen;
+            auto hit = seen.find(&probe);
+            if (hit != seen.end())
+            {
+                return *hit;
+            }
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = types.find(&probe);
+            if (it != types.end())
+            {
+                seen.insert(*it);
+                return *it;
+            }
+            auto t = new Type(probe);
+            if (probe.elem_count > 0)
+            {
+                auto elems = new Type::Ptr[probe.elem_count];
+                std::copy(probe.elems, probe.elems + probe.elem_count, elems);
+                t->elems = elems;
+            }
+            types.insert(t);
+            seen.insert(t);
+            return t;
+        }
+
+        // elements are interned already, hashing their addresses is enough
+        size_t TypeTable::Hash::operator()(Type::Ptr t) const
+        {
+            size_t h = static_cast<size_t>(t->kind) * 31 + t->param_count;
+            h = h * 1000003 ^ std::hash<Type::Ptr>()(t->base);
+            for (uint32_t i = 0; i < t->elem_count; i++)
+            {
+                h = h * 1000003 ^ std::hash<Type::Ptr>()(t->elems[i]);
+            }
+            return h;
+        }
+
+        bool TypeTable::Equal::operator()(Type::Ptr t1, Type::Ptr t2) const
+        {
+            return t1->kind == t2->kind &&
+                   t1->param_count == t2->param_count &&
+                   t1->elem_count == t2->elem_count &&
+                   t1->base == t2->base &&
+                   std::equal(t1->elems, t1->elems + t1->elem_count, t2->elems);
+        }
+
+        NameTable &NameTable::Global()
+        {
+            static NameTable table;
+            return table;
+        }
+
+        NameId NameTable::Intern(const string_t &name)
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = ids.find(name);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            NameId id = names.size();
+            names.push_back(name);
+            ids.emplace(name, id);
+            return id;
+        }
+
+        string_t NameTable::Str(NameId id)
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            return names[id];
+        }
+
         bool Obj::Addressable()
+        {
+            return Addressable(kind);
+        }
+
+        bool Obj::Assignable()
+        {
+            return Assignable(kind);
+        }
+
+        bool Obj::Addressable(Kind kind)
         {
             if (kind == Kind::kVar ||
                 kind == Kind::kIndexValue)
@@ -158,7 +269,7 @@ namespace lilang
             return false;
         }
 
-        bool Obj::Assignable()
+        bool Obj::Assignable(Kind kind)
         {
             if (kind == Kind::kVar ||
                 kind == Kind::kIndexValue ||
@@ -198,7 +309,7 @@ namespace lilang
 
         Obj::Ptr Obj::InvalidInstance()
         {
-            static Ptr o = std::make_shared<Obj>(Obj::Kind::kValue, std::make_shared<Type>(Type::Kind::kInvalid));
+            static Ptr o = std::make_shared<Obj>(Obj::Kind::kValue, TypeTable::Invalid());
             return o;
         }
 
@@ -341,83 +452,454 @@ namespace lilang
 
         // has terminating
 
-        bool BreakStmt::HasTerminating()
+        namespace
         {
-            return false;
+            // only statements that hold blocks are entered, each block, if and
+            // loop leaves whether it terminates on the value stack, a return
+            // leaves true
+            class TerminationWalker : public IterativeWalker<TerminationWalker>
+            {
+            public:
+                std::vector<bool> values;
+                std::vector<size_t> marks; // size of values when entering each node
+
+                bool Pre(Node *n)
+                {
+                    switch (n->node_kind)
+                    {
+                    case NodeKind::kBlock:
+                    case NodeKind::kIfStmt:
+                    case NodeKind::kWhileStmt:
+                    case NodeKind::kForStmt:
+                        marks.push_back(values.size());
+                        return true;
+                    case NodeKind::kRetStmt:
+                        values.push_back(true);
+                        return false;
+                    default:
+                        return false;
+                    }
+                }
+
+                void Post(Node *n)
+                {
+                    size_t mark = marks.back();
+                    marks.pop_back();
+                    bool any = false;
+                    bool all = true;
+                    for (size_t i = mark; i < values.size(); i++)
+                    {
+                        any = any || values[i];
+                        all = all && values[i];
+                    }
+                    values.resize(mark);
+                    switch (n->node_kind)
+                    {
+                    case NodeKind::kBlock:
+                        values.push_back(any); // any statement
+                        break;
+                    case NodeKind::kIfStmt:
+                        values.push_back(all); // every branch, an if without else only needs its block
+                        break;
+                    default:
+                        values.push_back(any); // the body of a loop
+                    }
+                }
+            };
         }
 
-        bool IfStmt::HasTerminating()
+        bool Stmt::HasTerminating()
         {
-            if (!if_block->HasTerminating())
+            // most bodies return at their top level, no need to walk them
+            if (node_kind == NodeKind::kBlock)
             {
-                return false;
+                for (auto &st : static_cast<Block *>(this)->stmts)
+                {
+                    if (st->node_kind == NodeKind::kRetStmt)
+                    {
+                        return true;
+                    }
+                }
             }
-            if (else_block != nullptr)
+            TerminationWalker w;
+            w.Walk(this);
+            return !w.values.empty() && w.values.back();
+        }
+
+        // nesting
+
+        namespace
+        {
+            // keeps the path down from the root, the first node at the limit that has
+            // a child is kept and nothing below it is entered. the file and a function
+            // declaration add no level, a body counts the same from either
+            class NestingWalker : public IterativeWalker<NestingWalker>
             {
-                if (!else_block->HasTerminating())
+            public:
+                std::vector<Node *> path;
+                Node *deep = nullptr;
+                bool expr = false;
+
+                static bool Counted(Node *n)
                 {
-                    return false;
+                    return n->node_kind != NodeKind::kFile && n->node_kind != NodeKind::kFuncDecl;
                 }
-                return true;
-            }
-            return true;
+
+                bool Pre(Node *n)
+                {
+                    if (deep != nullptr || !Counted(n))
+                    {
+                        return deep == nullptr;
+                    }
+                    if (path.size() == size_t(kMaxNesting))
+                    {
+                        // an expression below an expression is a long operator spine,
+                        // not statements nested deep that hold a short one
+                        deep = path.back();
+                        expr = dynamic_cast<Expr *>(deep) != nullptr &&
+                               dynamic_cast<Expr *>(path[path.size() - 2]) != nullptr;
+                        return false;
+                    }
+                    path.push_back(n);
+                    return true;
+                }
+
+                void Post(Node *n)
+                {
+                    if (Counted(n))
+                    {
+                        path.pop_back();
+                    }
+                }
+            };
         }
 
-        bool ForStmt::HasTerminating()
+        Node *TooDeep(Node *n, string_t &msg)
         {
-            return block->HasTerminating();
+            NestingWalker w;
+            w.Walk(n);
+            if (w.deep != nullptr)
+            {
+                msg = w.expr ? "expression too deep" : "statement too deep";
+            }
+            return w.deep;
         }
 
-        bool WhileStmt::HasTerminating()
+        // the children of each node are moved out before it is destroyed, so
+        // freeing a long chain never nests destructors
+        static void TakeChildren(Node *n, std::vector<Node::Ptr> &out)
         {
-            return block->HasTerminating();
+            auto take = [&](Node::Ptr p) {
+                if (p != nullptr)
+                {
+                    out.push_back(std::move(p));
+                }
+            };
+            switch (n->node_kind)
+            {
+            case NodeKind::kFile:
+                for (auto &d : static_cast<File *>(n)->declarations)
+                {
+                    take(std::move(d));
+                }
+                break;
+            case NodeKind::kBinaryExpr:
+                take(std::move(static_cast<BinaryExpr *>(n)->left));
+                take(std::move(static_cast<BinaryExpr *>(n)->right));
+                break;
+            case NodeKind::kUnaryExpr:
+                take(std::move(static_cast<UnaryExpr *>(n)->expr));
+                break;
+            case NodeKind::kParenExpr:
+                take(std::move(static_cast<ParenExpr *>(n)->expr));
+                break;
+            case NodeKind::kCallExpr:
+                take(std::move(static_cast<CallExpr *>(n)->expr));
+                for (auto &e : static_cast<CallExpr *>(n)->args)
+                {
+                    take(std::move(e));
+                }
+                break;
+            case NodeKind::kIndexExpr:
+                take(std::move(static_cast<IndexExpr *>(n)->operand));
+                take(std::move(static_cast<IndexExpr *>(n)->index));
+                break;
+            case NodeKind::kStarExpr:
+                take(std::move(static_cast<StarExpr *>(n)->expr));
+                break;
+            case NodeKind::kArrayType:
+                take(std::move(static_cast<ArrayType *>(n)->expr));
+                break;
+            case NodeKind::kFuncType:
+                for (auto &f : static_cast<FuncType *>(n)->args)
+                {
+                    take(std::move(f->type));
+                }
+                for (auto &e : static_cast<FuncType *>(n)->returns)
+                {
+                    take(std::move(e));
+                }
+                break;
+            case NodeKind::kFuncLit:
+                take(std::move(static_cast<FuncLit *>(n)->type));
+                take(std::move(static_cast<FuncLit *>(n)->body));
+                break;
+            case NodeKind::kVarDecl:
+                take(std::move(static_cast<VarDecl *>(n)->type));
+                for (auto &e : static_cast<VarDecl *>(n)->vals)
+                {
+                    take(std::move(e));
+                }
+                break;
+            case NodeKind::kFuncDecl:
+                take(std::move(static_cast<FuncDecl *>(n)->fn_lit));
+                break;
+            case NodeKind::kIfStmt:
+                take(std::move(static_cast<IfStmt *>(n)->condition));
+                take(std::move(static_cast<IfStmt *>(n)->if_block));
+                take(std::move(static_cast<IfStmt *>(n)->else_block));
+                break;
+            case NodeKind::kWhileStmt:
+                take(std::move(static_cast<WhileStmt *>(n)->condition));
+                take(std::move(static_cast<WhileStmt *>(n)->block));
+                break;
+            case NodeKind::kForStmt:
+                take(std::move(static_cast<ForStmt *>(n)->init));
+                take(std::move(static_cast<ForStmt *>(n)->condition));
+                take(std::move(static_cast<ForStmt *>(n)->post));
+                take(std::move(static_cast<ForStmt *>(n)->block));
+                break;
+            case NodeKind::kAssignStmt:
+                for (auto &e : static_cast<AssignStmt *>(n)->lhs)
+                {
+                    take(std::move(e));
+                }
+                for (auto &e : static_cast<AssignStmt *>(n)->rhs)
+                {
+                    take(std::move(e));
+                }
+                break;
+            case NodeKind::kDeclStmt:
+                take(std::move(static_cast<DeclStmt *>(n)->decl));
+                break;
+            case NodeKind::kRetStmt:
+                for (auto &e : static_cast<RetStmt *>(n)->vals)
+                {
+                    take(std::move(e));
+                }
+                break;
+            case NodeKind::kBlock:
+                for (auto &st : static_cast<Block *>(n)->stmts)
+                {
+                    take(std::move(st));
+                }
+                break;
+            case NodeKind::kExprStmt:
+                take(std::move(static_cast<ExprStmt *>(n)->expr));
+                break;
+            default:
+                break;
+            }
         }
 
-        bool Block::HasTerminating()
+        // nodes still shared with another tree, e.g. by the incremental parser,
+        // are left to their other owners
+        File::~File()
         {
-            for (auto stmt : stmts)
+            std::vector<Node::Ptr> pending;
+            TakeChildren(this, pending);
+            while (!pending.empty())
             {
-                if (stmt->HasTerminating())
+                auto n = std::move(pending.back());
+                pending.pop_back();
+                if (n.use_count() == 1)
                 {
-                    return true;
+                    TakeChildren(n.get(), pending);
                 }
             }
-            return false;
         }
 
-        bool RetStmt::HasTerminating()
+        //********************************************************************
+        // walker
+        //********************************************************************
+
+        void Walker::Walk(Node *n)
         {
-            return true;
+            if (n != nullptr)
+            {
+                n->Accept(this);
+            }
         }
 
-        bool EmptyStmt::HasTerminating()
+        void Walker::Visit(File *n)
         {
-            return false;
+            Pre(n);
+            WalkList(n->declarations);
         }
 
-        bool ExprStmt::HasTerminating()
+        void Walker::Visit(Ident *n)
         {
-            return false;
+            Pre(n);
         }
 
-        bool AssignStmt::HasTerminating()
+        void Walker::Visit(BinaryExpr *n)
         {
-            return false;
+            Pre(n);
+            Walk(n->left.get());
+            Walk(n->right.get());
         }
 
-        bool DeclStmt::HasTerminating()
+        void Walker::Visit(UnaryExpr *n)
         {
-            return false;
+            Pre(n);
+            Walk(n->expr.get());
         }
 
-        bool BadStmt::HasTerminating()
+        void Walker::Visit(BasicLiteral *n)
         {
-            return false;
+            Pre(n);
         }
 
-        bool ContinueStmt::HasTerminating()
+        void Walker::Visit(ParenExpr *n)
         {
-            return false;
+            Pre(n);
+            Walk(n->expr.get());
+        }
+
+        void Walker::Visit(CallExpr *n)
+        {
+            Pre(n);
+            Walk(n->expr.get());
+            WalkList(n->args);
+        }
+
+        void Walker::Visit(IndexExpr *n)
+        {
+            Pre(n);
+            Walk(n->operand.get());
+            Walk(n->index.get());
+        }
+
+        void Walker::Visit(StarExpr *n)
+        {
+            Pre(n);
+            Walk(n->expr.get());
+        }
+
+        void Walker::Visit(ArrayType *n)
+        {
+            Pre(n);
+            Walk(n->expr.get());
+        }
+
+        void Walker::Visit(FuncType *n)
+        {
+            Pre(n);
+            for (auto &f : n->args)
+            {
+                Walk(f->type.get());
+            }
+            WalkList(n->returns);
+        }
+
+        void Walker::Visit(FuncLit *n)
+        {
+            Pre(n);
+            Walk(n->type.get());
+            Walk(n->body.get());
+        }
+
+        void Walker::Visit(VarDecl *n)
+        {
+            Pre(n);
+            Walk(n->type.get());
+            WalkList(n->vals);
+        }
+
+        void Walker::Visit(FuncDecl *n)
+        {
+            Pre(n);
+            Walk(n->fn_lit.get());
+        }
+
+        void Walker::Visit(IfStmt *n)
+        {
+            Pre(n);
+            Walk(n->condition.get());
+            Walk(n->if_block.get());
+            Walk(n->else_block.get());
+        }
+
+        void Walker::Visit(WhileStmt *n)
+        {
+            Pre(n);
+            Walk(n->condition.get());
+            Walk(n->block.get());
+        }
+
+        void Walker::Visit(ForStmt *n)
+        {
+            Pre(n);
+            Walk(n->init.get());
+            Walk(n->condition.get());
+            Walk(n->post.get());
+            Walk(n->block.get());
+        }
+
+        void Walker::Visit(AssignStmt *n)
+        {
+            Pre(n);
+            WalkList(n->lhs);
+            WalkList(n->rhs);
+        }
+
+        void Walker::Visit(DeclStmt *n)
+        {
+            Pre(n);
+            Walk(n->decl.get());
+        }
+
+        void Walker::Visit(RetStmt *n)
+        {
+            Pre(n);
+            WalkList(n->vals);
+        }
+
+        void Walker::Visit(Block *n)
+        {
+            Pre(n);
+            WalkList(n->stmts);
+        }
+
+        void Walker::Visit(ExprStmt *n)
+        {
+            Pre(n);
+            Walk(n->expr.get());
+        }
+
+        void Walker::Visit(EmptyStmt *n)
+        {
+            Pre(n);
+        }
+
+        void Walker::Visit(BadExpr *n)
+        {
+            Pre(n);
+        }
+
+        void Walker::Visit(BadStmt *n)
+        {
+            Pre(n);
+        }
+
+        void Walker::Visit(ContinueStmt *n)
+        {
+            Pre(n);
+        }
+
+        void Walker::Visit(BreakStmt *n)
+        {
+            Pre(n);
         }
 
     }
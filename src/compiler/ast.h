@@ -3,8 +3,13 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <unordered_map>
+#include <type_traits>
 #include "../listl.h"
 #include "./lexical.h"
+#include "./small_vector.h"
 
 #define RepeatStringLit(N, S)   \
     for (int i = 0; i < N; i++) \
@@ -17,16 +22,38 @@ namespace lilang
     namespace ast
     {
         using TokenPos = int;
+        using NameId = uint32_t;
         class Visitor;
 
         //********************************************************************
         // ast node attribute
         //********************************************************************
 
+        class Type;
+
+        // view of interned types, owned by the TypeTable
+        class TypeSpan
+        {
+        public:
+            typedef const Type *const *iterator;
+
+            TypeSpan(iterator b, size_t n) : b(b), n(n) {}
+            iterator begin() const { return b; }
+            iterator end() const { return b + n; }
+            size_t size() const { return n; }
+            const Type *operator[](size_t i) const { return b[i]; }
+
+        private:
+            iterator b;
+            size_t n;
+        };
+
+        // types are interned by TypeTable, each distinct type exists exactly once,
+        // so two types match iff they are the same pointer
         class Type
         {
         public:
-            typedef std::shared_ptr<Type> Ptr;
+            typedef const Type *Ptr;
             typedef std::vector<Ptr> List;
 
             enum class Kind
@@ -43,24 +70,94 @@ namespace lilang
             };
 
             Kind kind;
+            // function: elems[0, param_count) are params, the rest are returns
+            // tuple: elems are the values
+            uint32_t param_count;
+            uint32_t elem_count;
             // pointer OR array
             Ptr base;
-            // function
-            List params;
-            List returns;
-            // tuple
-            List vals;
+            const Ptr *elems;
+
+            Type(Kind k) : kind(k), param_count(0), elem_count(0), base(nullptr), elems(nullptr) {}
+
+            TypeSpan Params() const { return TypeSpan(elems, param_count); }
+            TypeSpan Returns() const { return TypeSpan(elems + param_count, elem_count - param_count); }
+            TypeSpan Vals() const { return TypeSpan(elems, elem_count); }
+
+            static bool Match(Ptr, Ptr);
+            static bool Comparable(Ptr);
+            static string_t String(Ptr);
+            static bool CouldAssign(Ptr, Ptr);
+        };
+
+        class TypeTable
+        {
+        public:
+            static TypeTable &Global();
+
+            static Type::Ptr Int();
+            static Type::Ptr Float();
+            static Type::Ptr String();
+            static Type::Ptr Bool();
+            static Type::Ptr Invalid();
+            Type::Ptr Pointer(Type::Ptr base);
+            Type::Ptr Array(Type::Ptr base);
+            Type::Ptr Func(const Type::List &params, const Type::List &returns);
+            Type::Ptr Tuple(const Type::List &vals);
+            size_t Size(); // number of distinct composite types
+
+        private:
+            struct Hash
+            {
+                size_t operator()(Type::Ptr) const;
+            };
+            struct Equal
+            {
+                bool operator()(Type::Ptr, Type::Ptr) const;
+            };
+
+            std::mutex mu;
+            std::unordered_set<Type::Ptr, Hash, Equal> types;
+
+            Type::Ptr Intern(const Type &probe);
+        };
+
+        // identifiers are interned once, later passes compare and hash ids
+        class NameTable
+        {
+        public:
+            static NameTable &Global();
+
+            NameId Intern(const string_t &);
+            string_t Str(NameId);
+
+        private:
+            std::mutex mu;
+            std::unordered_map<string_t, NameId> ids;
+            std::vector<string_t> names;
+        };
 
-            Type() = default;
-            Type(Kind k) : kind(k) {}
-            Type(Kind k, Ptr b) : kind(k), base(b) {}
-            Type(Kind k, List args, List rets) : kind(k), params(args), returns(rets) {}
-            Type(Kind k, List vals) : kind(k), vals(vals) {}
+        class FuncLit;
 
-            static bool Match(const Ptr &, const Ptr &);
-            static bool Comparable(const Ptr &);
-            static string_t String(const Ptr &);
-            static bool CouldAssign(const Ptr &, const Ptr &);
+        // where a named object lives at run time, assigned by the semantic pass
+        // local:  slot index in the frame of func
+        // global: index in the global slots
+        // func:   the function itself, index unused
+        // extern: declared by an imported module, only type checked, backends reject a use
+        struct Storage
+        {
+            enum class Kind
+            {
+                kNone,
+                kLocal,
+                kGlobal,
+                kFunc,
+                kExtern,
+            };
+
+            Kind kind = Kind::kNone;
+            int index = -1;
+            FuncLit *func = nullptr;
         };
 
         class Obj
@@ -70,7 +167,7 @@ namespace lilang
             typedef std::vector<Ptr> List;
 
             // Variable/IndexValue/IndirectPointer can be left value
-            enum class Kind
+            enum class Kind : uint8_t
             {
                 kVar,             // variable
                 kFunc,            // function lit
@@ -82,12 +179,15 @@ namespace lilang
 
             Kind kind;
             Type::Ptr type;
+            Storage storage; // variables and functions only
 
             Obj() = default;
             Obj(Kind k, Type::Ptr t) : type(t), kind(k) {}
 
             bool Addressable();
             bool Assignable();
+            static bool Addressable(Kind);
+            static bool Assignable(Kind);
             string_t String();
             static Ptr InvalidInstance();
         };
@@ -96,12 +196,50 @@ namespace lilang
         // ast node related
         //********************************************************************
 
+        // concrete class of a node, lets a pass dispatch with one switch
+        enum class NodeKind : uint8_t
+        {
+            kFile,
+            kIdent,
+            kBinaryExpr,
+            kUnaryExpr,
+            kBasicLiteral,
+            kParenExpr,
+            kCallExpr,
+            kIndexExpr,
+            kStarExpr,
+            kArrayType,
+            kFuncType,
+            kFuncLit,
+            kVarDecl,
+            kFuncDecl,
+            kIfStmt,
+            kWhileStmt,
+            kForStmt,
+            kAssignStmt,
+            kDeclStmt,
+            kRetStmt,
+            kBlock,
+            kExprStmt,
+            kEmptyStmt,
+            kBadExpr,
+            kBadStmt,
+            kContinueStmt,
+            kBreakStmt,
+        };
+
         class Node
         {
         public:
             typedef std::shared_ptr<Node> Ptr;
             typedef std::vector<Ptr> List;
 
+            int row_number = 0; // first token, set by the parser
+            int column_number = 0;
+            uint32_t node_id = 0; // unique in its file, set by the parser
+            const NodeKind node_kind;
+
+            explicit Node(NodeKind k) : node_kind(k) {}
             virtual void Accept(Visitor *v) = 0;
         };
 
@@ -110,49 +248,67 @@ namespace lilang
         public:
             typedef std::shared_ptr<Decl> Ptr;
             typedef std::vector<Ptr> List;
+
+            explicit Decl(NodeKind k) : Node(k) {}
         };
 
         class Stmt : public Node
         {
         public:
             typedef std::shared_ptr<Stmt> Ptr;
-            typedef std::vector<Ptr> List;
+            typedef SmallVector<Ptr, 4> List;
 
-            virtual bool HasTerminating() = 0;
+            explicit Stmt(NodeKind k) : Node(k) {}
+            // every path through the statement ends in a return
+            bool HasTerminating();
         };
 
         class Expr : public Node
         {
         public:
-            Obj::Ptr obj;
-
             typedef std::shared_ptr<Expr> Ptr;
-            typedef std::vector<Ptr> List;
+            typedef SmallVector<Ptr, 4> List;
+
+            explicit Expr(NodeKind k) : Node(k) {}
         };
 
         class Field
         {
         public:
             typedef std::shared_ptr<Field> Ptr;
-            typedef std::vector<Ptr> List;
+            typedef SmallVector<Ptr, 4> List;
 
             string_t var_name;
+            NameId var_id = 0; // var_name interned by the parser
             Expr::Ptr type;
             Field() = default;
-            Field(string_t n, Expr::Ptr t) : var_name(n), type(t) {}
+            Field(string_t n, Expr::Ptr t) : var_name(std::move(n)), var_id(NameTable::Global().Intern(var_name)), type(std::move(t)) {}
         };
 
         //********************************************************************
         //  start symbol
         //********************************************************************
 
+        // import name; at the head of a file, brings the exports of the
+        // module name into the top level scope
+        struct Import
+        {
+            string_t name;
+            int row_number;
+            int column_number;
+        };
+
         class File : public Node
         {
         public:
             typedef std::shared_ptr<File> Ptr;
 
+            std::vector<Import> imports;
             Decl::List declarations;
-            File() = default;
+            uint32_t node_count = 0; // node ids are below it
+            int global_count = 0;    // global slots, set by the semantic pass
+            File() : Node(NodeKind::kFile) {}
+            ~File(); // frees deep trees without recursion
             inline void AddDecl(Decl::Ptr d)
             {
                 declarations.push_back(std::move(d));
@@ -167,7 +323,7 @@ namespace lilang
         class BadExpr : public Expr
         {
         public:
-            BadExpr() = default;
+            BadExpr() : Expr(NodeKind::kBadExpr) {}
             void Accept(Visitor *v);
         };
 
@@ -175,8 +331,10 @@ namespace lilang
         {
         public:
             string_t name;
-            Ident() = default;
-            Ident(string_t n) : name(n) {}
+            NameId id;
+            Storage storage; // of the object the name resolved to
+            Ident() : Expr(NodeKind::kIdent) {}
+            Ident(string_t n) : Expr(NodeKind::kIdent), name(std::move(n)), id(NameTable::Global().Intern(name)) {}
             void Accept(Visitor *v);
         };
 
@@ -187,8 +345,8 @@ namespace lilang
             Expr::Ptr left;
             compiler::CodeType op;
             Expr::Ptr right;
-            BinaryExpr() = default;
-            BinaryExpr(Expr::Ptr l, compiler::CodeType t, Expr::Ptr r) : left(l), op(t), right(r) {}
+            BinaryExpr() : Expr(NodeKind::kBinaryExpr) {}
+            BinaryExpr(Expr::Ptr l, compiler::CodeType t, Expr::Ptr r) : Expr(NodeKind::kBinaryExpr), left(std::move(l)), op(t), right(std::move(r)) {}
             void Accept(Visitor *v);
         };
 
@@ -198,8 +356,8 @@ namespace lilang
         public:
             compiler::CodeType op;
             Expr::Ptr expr;
-            UnaryExpr() = default;
-            UnaryExpr(compiler::CodeType t, Expr::Ptr e) : op(t), expr(e) {}
+            UnaryExpr() : Expr(NodeKind::kUnaryExpr) {}
+            UnaryExpr(compiler::CodeType t, Expr::Ptr e) : Expr(NodeKind::kUnaryExpr), op(t), expr(std::move(e)) {}
             void Accept(Visitor *v);
         };
 
@@ -209,8 +367,8 @@ namespace lilang
         public:
             string_t value;
             compiler::CodeType type;
-            BasicLiteral() = default;
-            BasicLiteral(string_t v, compiler::CodeType t) : value(v), type(t) {}
+            BasicLiteral() : Expr(NodeKind::kBasicLiteral) {}
+            BasicLiteral(string_t v, compiler::CodeType t) : Expr(NodeKind::kBasicLiteral), value(std::move(v)), type(t) {}
             void Accept(Visitor *v);
         };
 
@@ -219,8 +377,8 @@ namespace lilang
         {
         public:
             Expr::Ptr expr;
-            ParenExpr() = default;
-            ParenExpr(Expr::Ptr e) : expr(e) {}
+            ParenExpr() : Expr(NodeKind::kParenExpr) {}
+            ParenExpr(Expr::Ptr e) : Expr(NodeKind::kParenExpr), expr(std::move(e)) {}
             void Accept(Visitor *v);
         };
 
@@ -230,9 +388,9 @@ namespace lilang
         public:
             Expr::Ptr expr;
             Expr::List args;
-            CallExpr() = default;
-            CallExpr(Expr::Ptr f) : expr(f) {}
-            CallExpr(Expr::Ptr f, Expr::List a) : expr(f), args(a) {}
+            CallExpr() : Expr(NodeKind::kCallExpr) {}
+            CallExpr(Expr::Ptr f) : Expr(NodeKind::kCallExpr), expr(std::move(f)) {}
+            CallExpr(Expr::Ptr f, Expr::List a) : Expr(NodeKind::kCallExpr), expr(std::move(f)), args(std::move(a)) {}
             void Accept(Visitor *v);
         };
 
@@ -242,8 +400,8 @@ namespace lilang
         public:
             Expr::Ptr operand;
             Expr::Ptr index;
-            IndexExpr() = default;
-            IndexExpr(Expr::Ptr o, Expr::Ptr i) : operand(o), index(i) {}
+            IndexExpr() : Expr(NodeKind::kIndexExpr) {}
+            IndexExpr(Expr::Ptr o, Expr::Ptr i) : Expr(NodeKind::kIndexExpr), operand(std::move(o)), index(std::move(i)) {}
             void Accept(Visitor *v);
         };
 
@@ -251,8 +409,8 @@ namespace lilang
         {
         public:
             Expr::Ptr expr;
-            StarExpr() = default;
-            StarExpr(Expr::Ptr e) : expr(e) {}
+            StarExpr() : Expr(NodeKind::kStarExpr) {}
+            StarExpr(Expr::Ptr e) : Expr(NodeKind::kStarExpr), expr(std::move(e)) {}
             void Accept(Visitor *v);
         };
 
@@ -260,8 +418,8 @@ namespace lilang
         {
         public:
             Expr::Ptr expr;
-            ArrayType() = default;
-            ArrayType(Expr::Ptr e) : expr(e) {}
+            ArrayType() : Expr(NodeKind::kArrayType) {}
+            ArrayType(Expr::Ptr e) : Expr(NodeKind::kArrayType), expr(std::move(e)) {}
             void Accept(Visitor *v);
         };
 
@@ -272,8 +430,8 @@ namespace lilang
 
             Field::List args;
             Expr::List returns;
-            FuncType() = default;
-            FuncType(Field::List args, Expr::List rets) : args(args), returns(rets) {}
+            FuncType() : Expr(NodeKind::kFuncType) {}
+            FuncType(Field::List args, Expr::List rets) : Expr(NodeKind::kFuncType), args(std::move(args)), returns(std::move(rets)) {}
             void Accept(Visitor *v);
         };
 
@@ -284,10 +442,12 @@ namespace lilang
             typedef std::shared_ptr<FuncLit> Ptr;
 
             string_t name;
+            NameId id = 0; // name interned by the parser, unset for an anonymous function
             FuncType::Ptr type;
             std::shared_ptr<Block> body;
-            FuncLit() = default;
-            FuncLit(FuncType::Ptr t, std::shared_ptr<Block> b) : type(t), body(b) {}
+            int frame_size = 0; // slots of params and locals, set by the semantic pass
+            FuncLit() : Expr(NodeKind::kFuncLit) {}
+            FuncLit(FuncType::Ptr t, std::shared_ptr<Block> b) : Expr(NodeKind::kFuncLit), type(std::move(t)), body(std::move(b)) {}
             void Accept(Visitor *v);
         };
 
@@ -300,13 +460,26 @@ namespace lilang
         class VarDecl : public Decl
         {
         public:
-            std::vector<string_t> names;
+            typedef SmallVector<string_t, 4> NameList;
+
+            NameList names;
+            SmallVector<NameId, 4> ids; // names interned by the parser, so checking bodies in parallel never locks
             Expr::Ptr type;
             Expr::List vals;
-            VarDecl() = default;
-            VarDecl(std::vector<string_t> n, Expr::Ptr t) : names(n), type(t) {}
-            VarDecl(std::vector<string_t> n, Expr::List vals) : names(n), vals(vals) {}
+            int first_slot = -1; // slot of names[0], the others follow, set by the semantic pass
+            VarDecl() : Decl(NodeKind::kVarDecl) {}
+            VarDecl(NameList n, Expr::Ptr t) : Decl(NodeKind::kVarDecl), names(std::move(n)), type(std::move(t)) { InternNames(); }
+            VarDecl(NameList n, Expr::List vals) : Decl(NodeKind::kVarDecl), names(std::move(n)), vals(std::move(vals)) { InternNames(); }
             void Accept(Visitor *v);
+
+        private:
+            void InternNames()
+            {
+                for (auto &n : names)
+                {
+                    ids.push_back(NameTable::Global().Intern(n));
+                }
+            }
         };
 
         // fn name()()
@@ -314,8 +487,8 @@ namespace lilang
         {
         public:
             FuncLit::Ptr fn_lit;
-            FuncDecl() = default;
-            FuncDecl(FuncLit::Ptr f) : fn_lit(f) {}
+            FuncDecl() : Decl(NodeKind::kFuncDecl) {}
+            FuncDecl(FuncLit::Ptr f) : Decl(NodeKind::kFuncDecl), fn_lit(std::move(f)) {}
             void Accept(Visitor *v);
         };
 
@@ -329,18 +502,16 @@ namespace lilang
             typedef std::shared_ptr<Block> Ptr;
 
             Stmt::List stmts;
-            Block() = default;
-            Block(Stmt::List stmts) : stmts(stmts) {}
+            Block() : Stmt(NodeKind::kBlock) {}
+            Block(Stmt::List stmts) : Stmt(NodeKind::kBlock), stmts(std::move(stmts)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class BadStmt : public Stmt
         {
         public:
-            BadStmt() = default;
+            BadStmt() : Stmt(NodeKind::kBadStmt) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class IfStmt : public Stmt
@@ -349,11 +520,10 @@ namespace lilang
             Expr::Ptr condition;
             Stmt::Ptr if_block;
             Stmt::Ptr else_block;
-            IfStmt() = default;
+            IfStmt() : Stmt(NodeKind::kIfStmt) {}
             IfStmt(Expr::Ptr cond, Stmt::Ptr if_block, Stmt::Ptr else_block)
-                : condition(cond), if_block(if_block), else_block(else_block) {}
+                : Stmt(NodeKind::kIfStmt), condition(std::move(cond)), if_block(std::move(if_block)), else_block(std::move(else_block)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class WhileStmt : public Stmt
@@ -361,11 +531,10 @@ namespace lilang
         public:
             Expr::Ptr condition;
             Stmt::Ptr block;
-            WhileStmt() = default;
+            WhileStmt() : Stmt(NodeKind::kWhileStmt) {}
             WhileStmt(Expr::Ptr cond, Stmt::Ptr block)
-                : condition(cond), block(block) {}
+                : Stmt(NodeKind::kWhileStmt), condition(std::move(cond)), block(std::move(block)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class ForStmt : public Stmt
@@ -375,74 +544,71 @@ namespace lilang
             Expr::Ptr condition;
             Stmt::Ptr post;
             Block::Ptr block;
-            ForStmt() = default;
+            ForStmt() : Stmt(NodeKind::kForStmt) {}
             ForStmt(Stmt::Ptr i, Expr::Ptr c, Stmt::Ptr p, Block::Ptr b)
-                : init(i), condition(c), post(p), block(b) {}
+                : Stmt(NodeKind::kForStmt), init(std::move(i)), condition(std::move(c)), post(std::move(p)), block(std::move(b)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class RetStmt : public Stmt
         {
         public:
             Expr::List vals;
-            RetStmt() = default;
-            RetStmt(Expr::List v) : vals(v) {}
+            RetStmt() : Stmt(NodeKind::kRetStmt) {}
+            RetStmt(Expr::List v) : Stmt(NodeKind::kRetStmt), vals(std::move(v)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class EmptyStmt : public Stmt
         {
         public:
-            EmptyStmt() = default;
+            EmptyStmt() : Stmt(NodeKind::kEmptyStmt) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class ExprStmt : public Stmt
         {
         public:
             Expr::Ptr expr;
-            ExprStmt() = default;
-            ExprStmt(Expr::Ptr e) : expr(e) {}
+            ExprStmt() : Stmt(NodeKind::kExprStmt) {}
+            ExprStmt(Expr::Ptr e) : Stmt(NodeKind::kExprStmt), expr(std::move(e)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class AssignStmt : public Stmt
         {
         public:
             Expr::List lhs;
+            compiler::CodeType op = compiler::CodeType::kAssign; // = or a compound operator like +=
             Expr::List rhs;
-            AssignStmt() = default;
-            AssignStmt(Expr::List l, Expr::List r) : lhs(l), rhs(r) {}
+            AssignStmt() : Stmt(NodeKind::kAssignStmt) {}
+            AssignStmt(Expr::List l, Expr::List r) : Stmt(NodeKind::kAssignStmt), lhs(std::move(l)), rhs(std::move(r)) {}
+            AssignStmt(Expr::List l, compiler::CodeType t, Expr::List r)
+                : Stmt(NodeKind::kAssignStmt), lhs(std::move(l)), op(t), rhs(std::move(r)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class DeclStmt : public Stmt
         {
         public:
             Decl::Ptr decl;
-            DeclStmt() = default;
-            DeclStmt(Decl::Ptr d) : decl(d) {}
+            DeclStmt() : Stmt(NodeKind::kDeclStmt) {}
+            DeclStmt(Decl::Ptr d) : Stmt(NodeKind::kDeclStmt), decl(std::move(d)) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class ContinueStmt : public Stmt
         {
         public:
+            ContinueStmt() : Stmt(NodeKind::kContinueStmt) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         class BreakStmt : public Stmt
         {
         public:
+            BreakStmt() : Stmt(NodeKind::kBreakStmt) {}
             void Accept(Visitor *v);
-            bool HasTerminating();
         };
 
         //********************************************************************
@@ -480,6 +646,510 @@ namespace lilang
             virtual void Visit(BreakStmt *) = 0;
         };
 
+        // visits every node of a subtree in source order, Pre is called on
+        // each node before its children
+        class Walker : public Visitor
+        {
+        public:
+            void Walk(Node *);
+            void Visit(File *) override;
+            void Visit(Ident *) override;
+            void Visit(BinaryExpr *) override;
+            void Visit(UnaryExpr *) override;
+            void Visit(BasicLiteral *) override;
+            void Visit(ParenExpr *) override;
+            void Visit(CallExpr *) override;
+            void Visit(IndexExpr *) override;
+            void Visit(StarExpr *) override;
+            void Visit(ArrayType *) override;
+            void Visit(FuncType *) override;
+            void Visit(FuncLit *) override;
+            void Visit(VarDecl *) override;
+            void Visit(FuncDecl *) override;
+            void Visit(IfStmt *) override;
+            void Visit(WhileStmt *) override;
+            void Visit(ForStmt *) override;
+            void Visit(AssignStmt *) override;
+            void Visit(DeclStmt *) override;
+            void Visit(RetStmt *) override;
+            void Visit(Block *) override;
+            void Visit(ExprStmt *) override;
+            void Visit(EmptyStmt *) override;
+            void Visit(BadExpr *) override;
+            void Visit(BadStmt *) override;
+            void Visit(ContinueStmt *) override;
+            void Visit(BreakStmt *) override;
+
+        protected:
+            virtual void Pre(Node *) = 0;
+
+        private:
+            template <typename L>
+            void WalkList(L &list)
+            {
+                for (auto &n : list)
+                {
+                    Walk(n.get());
+                }
+            }
+        };
+
+        // static counterpart of Visitor: Dispatch switches on the node kind and
+        // calls Derived::Visit on the concrete class, no virtual call is made when
+        // Derived is final, and small Visit bodies can be inlined
+        template <typename Derived, typename R = void>
+        class StaticVisitor
+        {
+        public:
+            R Dispatch(Node *n)
+            {
+                auto d = static_cast<Derived *>(this);
+                switch (n->node_kind)
+                {
+                case NodeKind::kFile:
+                    return d->Visit(static_cast<File *>(n));
+                case NodeKind::kIdent:
+                    return d->Visit(static_cast<Ident *>(n));
+                case NodeKind::kBinaryExpr:
+                    return d->Visit(static_cast<BinaryExpr *>(n));
+                case NodeKind::kUnaryExpr:
+                    return d->Visit(static_cast<UnaryExpr *>(n));
+                case NodeKind::kBasicLiteral:
+                    return d->Visit(static_cast<BasicLiteral *>(n));
+                case NodeKind::kParenExpr:
+                    return d->Visit(static_cast<ParenExpr *>(n));
+                case NodeKind::kCallExpr:
+                    return d->Visit(static_cast<CallExpr *>(n));
+                case NodeKind::kIndexExpr:
+                    return d->Visit(static_cast<IndexExpr *>(n));
+                case NodeKind::kStarExpr:
+                    return d->Visit(static_cast<StarExpr *>(n));
+                case NodeKind::kArrayType:
+                    return d->Visit(static_cast<ArrayType *>(n));
+                case NodeKind::kFuncType:
+                    return d->Visit(static_cast<FuncType *>(n));
+                case NodeKind::kFuncLit:
+                    return d->Visit(static_cast<FuncLit *>(n));
+                case NodeKind::kVarDecl:
+                    return d->Visit(static_cast<VarDecl *>(n));
+                case NodeKind::kFuncDecl:
+                    return d->Visit(static_cast<FuncDecl *>(n));
+                case NodeKind::kIfStmt:
+                    return d->Visit(static_cast<IfStmt *>(n));
+                case NodeKind::kWhileStmt:
+                    return d->Visit(static_cast<WhileStmt *>(n));
+                case NodeKind::kForStmt:
+                    return d->Visit(static_cast<ForStmt *>(n));
+                case NodeKind::kAssignStmt:
+                    return d->Visit(static_cast<AssignStmt *>(n));
+                case NodeKind::kDeclStmt:
+                    return d->Visit(static_cast<DeclStmt *>(n));
+                case NodeKind::kRetStmt:
+                    return d->Visit(static_cast<RetStmt *>(n));
+                case NodeKind::kBlock:
+                    return d->Visit(static_cast<Block *>(n));
+                case NodeKind::kExprStmt:
+                    return d->Visit(static_cast<ExprStmt *>(n));
+                case NodeKind::kEmptyStmt:
+                    return d->Visit(static_cast<EmptyStmt *>(n));
+                case NodeKind::kBadExpr:
+                    return d->Visit(static_cast<BadExpr *>(n));
+                case NodeKind::kBadStmt:
+                    return d->Visit(static_cast<BadStmt *>(n));
+                case NodeKind::kContinueStmt:
+                    return d->Visit(static_cast<ContinueStmt *>(n));
+                case NodeKind::kBreakStmt:
+                    return d->Visit(static_cast<BreakStmt *>(n));
+                }
+                return R();
+            }
+        };
+
+        // Walker with switch dispatch, Derived provides Pre(Node *)
+        template <typename Derived>
+        class StaticWalker
+        {
+        public:
+            void Walk(Node *n)
+            {
+                if (n == nullptr)
+                {
+                    return;
+                }
+                static_cast<Derived *>(this)->Pre(n);
+                switch (n->node_kind)
+                {
+                case NodeKind::kFile:
+                    WalkList(static_cast<File *>(n)->declarations);
+                    break;
+                case NodeKind::kBinaryExpr:
+                    Walk(static_cast<BinaryExpr *>(n)->left.get());
+                    Walk(static_cast<BinaryExpr *>(n)->right.get());
+                    break;
+                case NodeKind::kUnaryExpr:
+                    Walk(static_cast<UnaryExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kParenExpr:
+                    Walk(static_cast<ParenExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kCallExpr:
+                    Walk(static_cast<CallExpr *>(n)->expr.get());
+                    WalkList(static_cast<CallExpr *>(n)->args);
+                    break;
+                case NodeKind::kIndexExpr:
+                    Walk(static_cast<IndexExpr *>(n)->operand.get());
+                    Walk(static_cast<IndexExpr *>(n)->index.get());
+                    break;
+                case NodeKind::kStarExpr:
+                    Walk(static_cast<StarExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kArrayType:
+                    Walk(static_cast<ArrayType *>(n)->expr.get());
+                    break;
+                case NodeKind::kFuncType:
+                    for (auto &f : static_cast<FuncType *>(n)->args)
+                    {
+                        Walk(f->type.get());
+                    }
+                    WalkList(static_cast<FuncType *>(n)->returns);
+                    break;
+                case NodeKind::kFuncLit:
+                    Walk(static_cast<FuncLit *>(n)->type.get());
+                    Walk(static_cast<FuncLit *>(n)->body.get());
+                    break;
+                case NodeKind::kVarDecl:
+                    Walk(static_cast<VarDecl *>(n)->type.get());
+                    WalkList(static_cast<VarDecl *>(n)->vals);
+                    break;
+                case NodeKind::kFuncDecl:
+                    Walk(static_cast<FuncDecl *>(n)->fn_lit.get());
+                    break;
+                case NodeKind::kIfStmt:
+                    Walk(static_cast<IfStmt *>(n)->condition.get());
+                    Walk(static_cast<IfStmt *>(n)->if_block.get());
+                    Walk(static_cast<IfStmt *>(n)->else_block.get());
+                    break;
+                case NodeKind::kWhileStmt:
+                    Walk(static_cast<WhileStmt *>(n)->condition.get());
+                    Walk(static_cast<WhileStmt *>(n)->block.get());
+                    break;
+                case NodeKind::kForStmt:
+                    Walk(static_cast<ForStmt *>(n)->init.get());
+                    Walk(static_cast<ForStmt *>(n)->condition.get());
+                    Walk(static_cast<ForStmt *>(n)->post.get());
+                    Walk(static_cast<ForStmt *>(n)->block.get());
+                    break;
+                case NodeKind::kAssignStmt:
+                    WalkList(static_cast<AssignStmt *>(n)->lhs);
+                    WalkList(static_cast<AssignStmt *>(n)->rhs);
+                    break;
+                case NodeKind::kDeclStmt:
+                    Walk(static_cast<DeclStmt *>(n)->decl.get());
+                    break;
+                case NodeKind::kRetStmt:
+                    WalkList(static_cast<RetStmt *>(n)->vals);
+                    break;
+                case NodeKind::kBlock:
+                    WalkList(static_cast<Block *>(n)->stmts);
+                    break;
+                case NodeKind::kExprStmt:
+                    Walk(static_cast<ExprStmt *>(n)->expr.get());
+                    break;
+                case NodeKind::kIdent:
+                case NodeKind::kBasicLiteral:
+                case NodeKind::kEmptyStmt:
+                case NodeKind::kBadExpr:
+                case NodeKind::kBadStmt:
+                case NodeKind::kContinueStmt:
+                case NodeKind::kBreakStmt:
+                    break;
+                }
+            }
+
+        private:
+            template <typename L>
+            void WalkList(L &list)
+            {
+                for (auto &n : list)
+                {
+                    Walk(n.get());
+                }
+            }
+        };
+
+        // walks a subtree with an explicit stack instead of recursion, so the
+        // depth of a tree is only bounded by memory. the stack holds the nodes
+        // still to enter, the nodes to leave once their children are done and
+        // the steps between children. Derived may provide
+        //   bool Pre(Node *)          before the children, false skips them and Post
+        //   bool Stepped(Node *)      whether Step is called between its children
+        //   void Step(Node *, int i)  before child i, also when it is absent
+        //   void Post(Node *)         after the children
+        // SkipChildren called from Step drops child i and the ones after it.
+        // Walk may be called again from a hook, the walks share the stack
+        template <typename Derived>
+        class IterativeWalker
+        {
+        public:
+            void Walk(Node *root)
+            {
+                if (root == nullptr)
+                {
+                    return;
+                }
+                auto d = static_cast<Derived *>(this);
+                Reserve(1);
+                size_t base = top - first; // an index, a nested walk may move the stack
+                Push(root, kEnter);
+                while (size_t(top - first) > base)
+                {
+                    auto e = *--top;
+                    if (e.step == kEnter)
+                    {
+                        if (!d->Pre(e.node))
+                        {
+                            continue;
+                        }
+                        if ((kLeafKinds >> static_cast<int>(e.node->node_kind)) & 1)
+                        {
+                            d->Post(e.node);
+                            continue;
+                        }
+                        if (!kLeaves)
+                        {
+                            Expand<false>(e.node); // nothing to do after the children
+                            continue;
+                        }
+                        Reserve(1);
+                        size_t mark = top - first;
+                        Push(e.node, kLeave);
+                        if (d->Stepped(e.node))
+                        {
+                            Expand<true>(e.node);
+                        }
+                        else
+                        {
+                            Expand<false>(e.node);
+                        }
+                        if (size_t(top - first) == mark + 1)
+                        {
+                            top--; // no children present
+                            d->Post(e.node);
+                        }
+                    }
+                    else if (e.step == kLeave)
+                    {
+                        d->Post(e.node);
+                    }
+                    else
+                    {
+                        d->Step(e.node, e.step);
+                    }
+                }
+            }
+
+        protected:
+            bool Pre(Node *) { return true; }
+            bool Stepped(Node *) { return false; }
+            void Step(Node *, int) {}
+            void Post(Node *) {}
+
+            // the pending children of the node of the current step
+            void SkipChildren()
+            {
+                while (top[-1].step != kLeave)
+                {
+                    top--;
+                }
+            }
+
+        private:
+            static const int kEnter = -2;
+            static const int kLeave = -1;
+            static const int kFixed = 4; // most children of a node without a list
+            static const uint32_t kLeafKinds = 1u << static_cast<int>(NodeKind::kIdent) |
+                                               1u << static_cast<int>(NodeKind::kBasicLiteral) |
+                                               1u << static_cast<int>(NodeKind::kEmptyStmt) |
+                                               1u << static_cast<int>(NodeKind::kBadExpr) |
+                                               1u << static_cast<int>(NodeKind::kBadStmt) |
+                                               1u << static_cast<int>(NodeKind::kContinueStmt) |
+                                               1u << static_cast<int>(NodeKind::kBreakStmt);
+            struct Entry
+            {
+                Node *node;
+                int step; // kEnter, kLeave or the child a step comes before
+            };
+            // a walker without Post or Step pushes no entry to leave a node, a hook is
+            // declared by Derived when taking its address does not give the default
+            static const bool kLeaves =
+                !std::is_same<decltype(&Derived::Post), void (IterativeWalker::*)(Node *)>::value ||
+                !std::is_same<decltype(&Derived::Stepped), bool (IterativeWalker::*)(Node *)>::value;
+
+            std::vector<Entry> stack;
+            Entry *first = nullptr;
+            Entry *top = nullptr;
+            Entry *limit = nullptr;
+
+            // room for n more entries, so a push never checks
+            void Reserve(size_t n)
+            {
+                if (size_t(limit - top) >= n)
+                {
+                    return;
+                }
+                size_t used = top - first;
+                size_t size = stack.empty() ? 64 : stack.size() * 2;
+                stack.resize(size < used + n ? used + n : size);
+                first = stack.data();
+                top = first + used;
+                limit = first + stack.size();
+            }
+            void Push(Node *n, int step)
+            {
+                *top++ = {n, step};
+            }
+
+            // children are pushed last first, so they are entered in order
+            template <bool stepped>
+            void Child(Node *n, int i, Node *c)
+            {
+                if (c != nullptr)
+                {
+#if defined(__GNUC__)
+                    __builtin_prefetch(c); // its kind is read soon, a recursive walk could not know it yet
+#endif
+                    Push(c, kEnter);
+                }
+                if (stepped)
+                {
+                    Push(n, i);
+                }
+            }
+
+            template <bool stepped, typename L>
+            void ChildList(Node *n, int first_index, L &list)
+            {
+                Reserve(2 * list.size());
+                int i = first_index + list.size();
+                for (auto it = list.end(); it != list.begin();)
+                {
+                    --it;
+                    Child<stepped>(n, --i, it->get());
+                }
+            }
+
+            template <bool stepped>
+            void Expand(Node *n)
+            {
+                Reserve(2 * kFixed); // lists reserve their own
+                switch (n->node_kind)
+                {
+                case NodeKind::kFile:
+                    ChildList<stepped>(n, 0, static_cast<File *>(n)->declarations);
+                    break;
+                case NodeKind::kBinaryExpr:
+                    Child<stepped>(n, 1, static_cast<BinaryExpr *>(n)->right.get());
+                    Child<stepped>(n, 0, static_cast<BinaryExpr *>(n)->left.get());
+                    break;
+                case NodeKind::kUnaryExpr:
+                    Child<stepped>(n, 0, static_cast<UnaryExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kParenExpr:
+                    Child<stepped>(n, 0, static_cast<ParenExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kCallExpr:
+                    ChildList<stepped>(n, 1, static_cast<CallExpr *>(n)->args);
+                    Child<stepped>(n, 0, static_cast<CallExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kIndexExpr:
+                    Child<stepped>(n, 1, static_cast<IndexExpr *>(n)->index.get());
+                    Child<stepped>(n, 0, static_cast<IndexExpr *>(n)->operand.get());
+                    break;
+                case NodeKind::kStarExpr:
+                    Child<stepped>(n, 0, static_cast<StarExpr *>(n)->expr.get());
+                    break;
+                case NodeKind::kArrayType:
+                    Child<stepped>(n, 0, static_cast<ArrayType *>(n)->expr.get());
+                    break;
+                case NodeKind::kFuncType:
+                {
+                    // parameter types, then return types
+                    auto t = static_cast<FuncType *>(n);
+                    int i = t->args.size();
+                    ChildList<stepped>(n, i, t->returns);
+                    Reserve(2 * t->args.size());
+                    for (auto it = t->args.end(); it != t->args.begin();)
+                    {
+                        --it;
+                        Child<stepped>(n, --i, (*it)->type.get());
+                    }
+                }
+                break;
+                case NodeKind::kFuncLit:
+                    Child<stepped>(n, 1, static_cast<FuncLit *>(n)->body.get());
+                    Child<stepped>(n, 0, static_cast<FuncLit *>(n)->type.get());
+                    break;
+                case NodeKind::kVarDecl:
+                    ChildList<stepped>(n, 1, static_cast<VarDecl *>(n)->vals);
+                    Child<stepped>(n, 0, static_cast<VarDecl *>(n)->type.get());
+                    break;
+                case NodeKind::kFuncDecl:
+                    Child<stepped>(n, 0, static_cast<FuncDecl *>(n)->fn_lit.get());
+                    break;
+                case NodeKind::kIfStmt:
+                    Child<stepped>(n, 2, static_cast<IfStmt *>(n)->else_block.get());
+                    Child<stepped>(n, 1, static_cast<IfStmt *>(n)->if_block.get());
+                    Child<stepped>(n, 0, static_cast<IfStmt *>(n)->condition.get());
+                    break;
+                case NodeKind::kWhileStmt:
+                    Child<stepped>(n, 1, static_cast<WhileStmt *>(n)->block.get());
+                    Child<stepped>(n, 0, static_cast<WhileStmt *>(n)->condition.get());
+                    break;
+                case NodeKind::kForStmt:
+                    Child<stepped>(n, 3, static_cast<ForStmt *>(n)->block.get());
+                    Child<stepped>(n, 2, static_cast<ForStmt *>(n)->post.get());
+                    Child<stepped>(n, 1, static_cast<ForStmt *>(n)->condition.get());
+                    Child<stepped>(n, 0, static_cast<ForStmt *>(n)->init.get());
+                    break;
+                case NodeKind::kAssignStmt:
+                {
+                    auto s = static_cast<AssignStmt *>(n);
+                    ChildList<stepped>(n, s->lhs.size(), s->rhs);
+                    ChildList<stepped>(n, 0, s->lhs);
+                }
+                break;
+                case NodeKind::kDeclStmt:
+                    Child<stepped>(n, 0, static_cast<DeclStmt *>(n)->decl.get());
+                    break;
+                case NodeKind::kRetStmt:
+                    ChildList<stepped>(n, 0, static_cast<RetStmt *>(n)->vals);
+                    break;
+                case NodeKind::kBlock:
+                    ChildList<stepped>(n, 0, static_cast<Block *>(n)->stmts);
+                    break;
+                case NodeKind::kExprStmt:
+                    Child<stepped>(n, 0, static_cast<ExprStmt *>(n)->expr.get());
+                    break;
+                case NodeKind::kIdent:
+                case NodeKind::kBasicLiteral:
+                case NodeKind::kEmptyStmt:
+                case NodeKind::kBadExpr:
+                case NodeKind::kBadStmt:
+                case NodeKind::kContinueStmt:
+                case NodeKind::kBreakStmt:
+                    break;
+                }
+            }
+        };
+
+        // the engines compile a body by recursion, a few native frames per level
+        // of nesting, and refuse a file nested deeper than this
+        const int kMaxNesting = 1000;
+
+        // the first node kMaxNesting levels below n that has children, nullptr if
+        // none. msg says whether it is an expression or a statement. a node is as
+        // deep below the file as below the declaration of its function
+        Node *TooDeep(Node *n, string_t &msg);
     }
 }
 
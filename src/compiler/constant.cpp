@@ -0,0 +1,299 @@
+#include <cstdlib>
+#include "./constant.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        using compiler::CodeType;
+
+        Constant Constant::Int(int64_t v)
+        {
+            Constant c;
+            c.kind = Type::Kind::kInt;
+            c.i = v;
+            return c;
+        }
+
+        Constant Constant::Float(double v)
+        {
+            Constant c;
+            c.kind = Type::Kind::kFloat;
+            c.f = v;
+            return c;
+        }
+
+        Constant Constant::Bool(bool v)
+        {
+            Constant c;
+            c.kind = Type::Kind::kBool;
+            c.b = v;
+            return c;
+        }
+
+        // 0x1f, 0b101, 0o17 and 017 are accepted by the lexer
+        bool Constant::FromLiteral(BasicLiteral *lit, Constant &out)
+        {
+            auto &v = lit->value;
+            switch (lit->type)
+            {
+            case CodeType::kNumber:
+            {
+                int base = 10;
+                size_t skip = 0;
+                if (v.size() > 1 && v[0] == '0')
+                {
+                    switch (v[1])
+                    {
+                    case 'x':
+                    case 'X':
+                        base = 16, skip = 2;
+                        break;
+                    case 'b':
+                    case 'B':
+                        base = 2, skip = 2;
+                        break;
+                    case 'o':
+                    case 'O':
+                        base = 8, skip = 2;
+                        break;
+                    default:
+                        base = 8, skip = 1;
+                    }
+                }
+                out = Int(static_cast<int64_t>(std::strtoull(v.c_str() + skip, nullptr, base)));
+                return true;
+            }
+            case CodeType::kFloat:
+                out = Float(std::strtod(v.c_str(), nullptr));
+                return true;
+            case CodeType::kBoolLit:
+                out = Bool(v == "true");
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        bool Constant::Unary(CodeType op, const Constant &x, Constant &out)
+        {
+            switch (op)
+            {
+            case CodeType::kAdd:
+                out = x;
+                return x.kind == Type::Kind::kInt || x.kind == Type::Kind::kFloat;
+            case CodeType::kSub:
+                if (x.kind == Type::Kind::kInt)
+                {
+                    out = Int(static_cast<int64_t>(0 - static_cast<uint64_t>(x.i)));
+                    return true;
+                }
+                out = Float(-x.f);
+                return x.kind == Type::Kind::kFloat;
+            case CodeType::kBitsXor:
+                out = Int(~x.i);
+                return x.kind == Type::Kind::kInt;
+            case CodeType::kLogicNot:
+                out = Bool(!x.b);
+                return x.kind == Type::Kind::kBool;
+            default:
+                return false;
+            }
+        }
+
+        // int op int stays int and wraps around, mixed with float it is float
+        bool Constant::Binary(CodeType op, const Constant &l, const Constant &r, Constant &out)
+        {
+            bool ints = l.kind == Type::Kind::kInt && r.kind == Type::Kind::kInt;
+            bool bools = l.kind == Type::Kind::kBool && r.kind == Type::Kind::kBool;
+            bool nums = (l.kind == Type::Kind::kInt || l.kind == Type::Kind::kFloat) &&
+                        (r.kind == Type::Kind::kInt || r.kind == Type::Kind::kFloat);
+            auto a = static_cast<uint64_t>(l.i);
+            auto b = static_cast<uint64_t>(r.i);
+            switch (op)
+            {
+            case CodeType::kLogicAnd:
+                out = Bool(l.b && r.b);
+                return bools;
+            case CodeType::kLogicOr:
+                out = Bool(l.b || r.b);
+                return bools;
+            case CodeType::kEqual:
+            case CodeType::kNotEqual:
+            {
+                bool eq;
+                if (bools)
+                {
+                    eq = l.b == r.b;
+                }
+                else if (ints)
+                {
+                    eq = l.i == r.i;
+                }
+                else if (nums)
+                {
+                    eq = l.AsFloat() == r.AsFloat();
+                }
+                else
+                {
+                    return false;
+                }
+                out = Bool(op == CodeType::kEqual ? eq : !eq);
+                return true;
+            }
+            case CodeType::kLess:
+            case CodeType::kGreater:
+            case CodeType::kNotGreater:
+            case CodeType::kNotLess:
+            {
+                if (!nums)
+                {
+                    return false;
+                }
+                // -1, 0, 1
+                int cmp;
+                if (ints)
+                {
+                    cmp = (l.i > r.i) - (l.i < r.i);
+                }
+                else
+                {
+                    cmp = (l.AsFloat() > r.AsFloat()) - (l.AsFloat() < r.AsFloat());
+                }
+                bool res = op == CodeType::kLess ? cmp < 0 : op == CodeType::kGreater ? cmp > 0 : op == CodeType::kNotGreater ? cmp <= 0 : cmp >= 0;
+                out = Bool(res);
+                return true;
+            }
+            case CodeType::kAdd:
+                out = ints ? Int(static_cast<int64_t>(a + b)) : Float(l.AsFloat() + r.AsFloat());
+                return nums;
+            case CodeType::kSub:
+                out = ints ? Int(static_cast<int64_t>(a - b)) : Float(l.AsFloat() - r.AsFloat());
+                return nums;
+            case CodeType::kMultiply:
+                out = ints ? Int(static_cast<int64_t>(a * b)) : Float(l.AsFloat() * r.AsFloat());
+                return nums;
+            case CodeType::kDivide:
+                if (ints)
+                {
+                    // left to the runtime
+                    if (r.i == 0 || (r.i == -1 && l.i == INT64_MIN))
+                    {
+                        return false;
+                    }
+                    out = Int(l.i / r.i);
+                    return true;
+                }
+                out = Float(l.AsFloat() / r.AsFloat());
+                return nums;
+            case CodeType::kMod:
+                if (!ints || r.i == 0 || (r.i == -1 && l.i == INT64_MIN))
+                {
+                    return false;
+                }
+                out = Int(l.i % r.i);
+                return true;
+            case CodeType::kBitsAnd:
+                out = Int(l.i & r.i);
+                return ints;
+            case CodeType::kBitsOr:
+                out = Int(l.i | r.i);
+                return ints;
+            case CodeType::kBitsXor:
+                out = Int(l.i ^ r.i);
+                return ints;
+            default:
+                return false;
+            }
+        }
+
+        // float to int truncates towards zero
+        bool Constant::Cast(const Constant &x, Type::Ptr to, Constant &out)
+        {
+            if (to->kind == x.kind)
+            {
+                out = x;
+                return true;
+            }
+            if (to->kind == Type::Kind::kFloat && x.kind == Type::Kind::kInt)
+            {
+                out = Float(static_cast<double>(x.i));
+                return true;
+            }
+            if (to->kind == Type::Kind::kInt && x.kind == Type::Kind::kFloat)
+            {
+                // out of range is undefined in C++, leave it to the runtime
+                if (!(x.f > -9223372036854775808.0 && x.f < 9223372036854775808.0))
+                {
+                    return false;
+                }
+                out = Int(static_cast<int64_t>(x.f));
+                return true;
+            }
+            return false;
+        }
+
+        double Constant::AsFloat() const
+        {
+            return kind == Type::Kind::kInt ? static_cast<double>(i) : f;
+        }
+
+        string_t Constant::String() const
+        {
+            stringstream_t ss;
+            switch (kind)
+            {
+            case Type::Kind::kInt:
+                ss << i;
+                break;
+            case Type::Kind::kFloat:
+                ss << f;
+                break;
+            case Type::Kind::kBool:
+                ss << (b ? "true" : "false");
+                break;
+            default:
+                ss << "?";
+            }
+            return ss.str();
+        }
+
+        void ConstantTable::Set(const Expr *e, const Constant &c)
+        {
+            values[e->node_id] = c;
+        }
+
+        const Constant *ConstantTable::Find(const Expr *e) const
+        {
+            auto it = values.find(e->node_id);
+            return it == values.end() ? nullptr : &it->second;
+        }
+
+        bool ConstantTable::IsTrue(const Expr *e) const
+        {
+            auto c = Find(e);
+            return c != nullptr && c->kind == Type::Kind::kBool && c->b;
+        }
+
+        bool ConstantTable::IsFalse(const Expr *e) const
+        {
+            auto c = Find(e);
+            return c != nullptr && c->kind == Type::Kind::kBool && !c->b;
+        }
+
+        void ConstantTable::Merge(const ConstantTable &other)
+        {
+            values.insert(other.values.begin(), other.values.end());
+        }
+
+        void ConstantTable::Clear()
+        {
+            values.clear();
+        }
+
+        size_t ConstantTable::Size() const
+        {
+            return values.size();
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef LILANG_COMPILER_CONSTANT
+#define LILANG_COMPILER_CONSTANT
+
+#include <cstdint>
+#include <unordered_map>
+#include "./ast.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        // value of a constant int, float or bool expression
+        class Constant
+        {
+        public:
+            Type::Kind kind;
+            union
+            {
+                int64_t i;
+                double f;
+                bool b;
+            };
+
+            static Constant Int(int64_t);
+            static Constant Float(double);
+            static Constant Bool(bool);
+            // false if the result is not a constant, e.g. division by zero
+            static bool FromLiteral(BasicLiteral *, Constant &);
+            static bool Unary(compiler::CodeType, const Constant &, Constant &);
+            static bool Binary(compiler::CodeType, const Constant &, const Constant &, Constant &);
+            static bool Cast(const Constant &, Type::Ptr, Constant &);
+
+            double AsFloat() const;
+            string_t String() const;
+        };
+
+        // folded values of the constant expressions by node id, filled by the semantic pass
+        // an expression missing here is not known before running the program
+        class ConstantTable
+        {
+        public:
+            void Set(const Expr *, const Constant &);
+            const Constant *Find(const Expr *) const;
+            // condition known statically
+            bool IsTrue(const Expr *) const;
+            bool IsFalse(const Expr *) const;
+            void Merge(const ConstantTable &);
+            void Clear();
+            size_t Size() const;
+
+        private:
+            std::unordered_map<uint32_t, Constant> values;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include <iostream>
+#include "./diagnostics.h"
+
+namespace lilang
+{
+    namespace compiler
+    {
+        string_t Diagnostic::String() const
+        {
+            stringstream_t ss;
+            if (row_number > 0)
+            {
+                ss << "(" << row_number << ", " << column_number << ") ";
+            }
+            ss << msg;
+            return ss.str();
+        }
+
+        Diagnostics::Diagnostics(size_t limit) : limit(limit), dropped(0)
+        {
+        }
+
+        bool Diagnostics::Report(Phase phase, int row_number, int column_number, const string_t &msg)
+        {
+            // past the cap nothing is kept, not even the key, so duplicates count as dropped too
+            if (Full())
+            {
+                dropped++;
+                return false;
+            }
+            stringstream_t key;
+            key << static_cast<int>(phase) << ":" << row_number << ":" << column_number << ":" << msg;
+            if (!seen.insert(key.str()).second)
+            {
+                return false;
+            }
+            records.push_back({phase, row_number, column_number, msg});
+            return true;
+        }
+
+        void Diagnostics::Merge(const Diagnostics &other)
+        {
+            for (auto &d : other.records)
+            {
+                Report(d.phase, d.row_number, d.column_number, d.msg);
+            }
+            dropped += other.dropped;
+        }
+
+        void Diagnostics::Clear()
+        {
+            records.clear();
+            seen.clear();
+            dropped = 0;
+        }
+
+        void Diagnostics::SetLimit(size_t n)
+        {
+            limit = n;
+        }
+
+        bool Diagnostics::HasErrors() const
+        {
+            return records.size() != 0;
+        }
+
+        bool Diagnostics::Full() const
+        {
+            return records.size() >= limit;
+        }
+
+        size_t Diagnostics::Count() const
+        {
+            return records.size();
+        }
+
+        size_t Diagnostics::Count(Phase phase) const
+        {
+            size_t n = 0;
+            for (auto &d : records)
+            {
+                n += d.phase == phase;
+            }
+            return n;
+        }
+
+        size_t Diagnostics::Dropped() const
+        {
+            return dropped;
+        }
+
+        const Diagnostic::List &Diagnostics::All() const
+        {
+            return records;
+        }
+
+        void Diagnostics::Print(std::ostream &out) const
+        {
+            for (auto &d : records)
+            {
+                out << d.String() << "\n";
+            }
+            if (dropped != 0)
+            {
+                out << "too many errors, " << dropped << " more not shown\n";
+            }
+            out.flush();
+        }
+
+        void Diagnostics::Print() const
+        {
+            Print(std::cout);
+        }
+    }
+}
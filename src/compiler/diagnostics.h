@@ -0,0 +1,77 @@
+#ifndef LILANG_COMPILER_DIAGNOSTICS
+#define LILANG_COMPILER_DIAGNOSTICS
+
+#include <vector>
+#include <ostream>
+#include <unordered_set>
+#include "../listl.h"
+
+/*
+diagnostics shared by the lexer, the parser, the semantic checker and the
+execution engines
+
+every phase appends positioned records to one buffer, nothing is printed
+until the driver asks for it. a record reported twice at the same position
+is kept once, and once the error cap is reached further records are only
+counted.
+
+debug traces are compiled out unless lilang_syntax_trace or
+lilang_semantic_trace is defined (e.g. -Dlilang_semantic_trace).
+*/
+namespace lilang
+{
+    namespace compiler
+    {
+        enum class Phase
+        {
+            kLexical,
+            kSyntax,
+            kSemantic,
+            kRuntime, // the execution engines, when loading or running a program
+            kIr,      // lowering to the ir, reading its text and verifying it
+            kNative,  // generating machine code, assembling and linking it
+        };
+
+        struct Diagnostic
+        {
+            Phase phase;
+            int row_number; // 0 when unknown
+            int column_number;
+            string_t msg;
+
+            typedef std::vector<Diagnostic> List;
+            string_t String() const;
+        };
+
+        class Diagnostics
+        {
+        public:
+            static const size_t kDefaultLimit = 100;
+
+            explicit Diagnostics(size_t limit = kDefaultLimit);
+            // false if the record is a duplicate or the cap is reached
+            bool Report(Phase, int row_number, int column_number, const string_t &msg);
+            // appends the records of another buffer in order
+            void Merge(const Diagnostics &);
+            void Clear();
+            void SetLimit(size_t);
+
+            bool HasErrors() const;
+            bool Full() const;
+            size_t Count() const;
+            size_t Count(Phase) const;
+            size_t Dropped() const; // reported after the cap was reached
+            const Diagnostic::List &All() const;
+            void Print(std::ostream &) const;
+            void Print() const; // to std::cout
+
+        private:
+            size_t limit;
+            size_t dropped;
+            Diagnostic::List records;
+            std::unordered_set<string_t> seen; // phase, position and message of each record
+        };
+    }
+}
+
+#endif
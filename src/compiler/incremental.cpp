@@ -0,0 +1,261 @@
+#include <algorithm>
+#include "./incremental.h"
+
+using namespace lilang::compiler;
+using namespace lilang;
+
+namespace
+{
+    // moves reused nodes behind an edit to their new position
+    class PositionShift : public ast::Walker
+    {
+    public:
+        PositionShift(int row, int row_delta, int column_delta)
+            : row(row), row_delta(row_delta), column_delta(column_delta) {}
+
+    protected:
+        void Pre(ast::Node *n) override
+        {
+            if (n->row_number == row)
+            {
+                n->column_number += column_delta; // on the line the edit ends
+            }
+            n->row_number += row_delta;
+        }
+
+    private:
+        int row;
+        int row_delta;
+        int column_delta;
+    };
+
+    int ColumnOf(const string_t &s, int offset)
+    {
+        auto nl = offset == 0 ? string_t::npos : s.rfind('\n', offset - 1);
+        return nl == string_t::npos ? offset : offset - nl - 1;
+    }
+}
+
+ast::File::Ptr IncrementalParser::Parse(const string_t &src)
+{
+    source = src;
+    file = nullptr;
+    FullParse();
+    return file;
+}
+
+ast::File::Ptr IncrementalParser::File()
+{
+    return file;
+}
+
+const string_t &IncrementalParser::Source()
+{
+    return source;
+}
+
+void IncrementalParser::PrintErrors()
+{
+    parser.PrintErrors();
+}
+
+bool IncrementalParser::HasErrors()
+{
+    return parser.HasErrors();
+}
+
+ChangeSet IncrementalParser::FullParse()
+{
+    ChangeSet changes;
+    changes.malformed = false;
+    changes.full = true;
+    if (file != nullptr)
+    {
+        changes.removed = file->declarations;
+    }
+    parser.Diags().Clear();
+    auto tokens = LexicalParser::ParseString(source, parser.Diags());
+    file = parser.ParseTokens(tokens);
+    auto &pos = parser.DeclPositions();
+    regions.clear();
+    for (size_t i = 0; i < pos.size(); i++)
+    {
+        auto &tok = tokens[pos[i]];
+        regions.push_back({tok.offset, tok.row_number, tok.column_number});
+        changes.changed.push_back(i);
+    }
+    if (regions.size() > 0)
+    {
+        regions[0] = {0, 1, 0}; // leading comments belong to the first declaration
+    }
+    return changes;
+}
+
+// the last region starting at or before offset
+int IncrementalParser::FindRegion(int offset)
+{
+    auto it = std::upper_bound(regions.begin(), regions.end(), offset,
+                               [](int off, const Region &r) { return off < r.offset; });
+    return std::max(0, static_cast<int>(it - regions.begin()) - 1);
+}
+
+ChangeSet IncrementalParser::Update(const TextEdit &edit)
+{
+    if (edit.offset < 0 || edit.length < 0 || static_cast<size_t>(edit.offset) > source.size() ||
+        static_cast<size_t>(edit.length) > source.size() - edit.offset)
+    {
+        ChangeSet none;
+        none.malformed = true;
+        none.full = false;
+        return none;
+    }
+    auto old_source = source;
+    source.replace(edit.offset, edit.length, edit.text);
+    if (HasErrors() || regions.size() == 0)
+    {
+        return FullParse();
+    }
+    int delta = edit.text.size() - edit.length;
+    int lo = FindRegion(edit.offset);
+    int hi = FindRegion(std::max(edit.offset, edit.offset + edit.length - 1));
+    int start = regions[lo].offset;
+    int old_end = hi + 1 < static_cast<int>(regions.size()) ? regions[hi + 1].offset : old_source.size();
+    int new_end = old_end + delta;
+    auto text = source.substr(start, new_end - start);
+
+    // lex and parse the affected range alone, positions are shifted to the whole file
+    Diagnostics errs;
+    CodeToken::List tokens;
+    if (text.size() > 0)
+    {
+        tokens = LexicalParser::ParseString(text, errs);
+    }
+    else
+    {
+        tokens.push_back({CodeType::kEOF, "$", 1, 0, 0});
+    }
+    if (errs.HasErrors())
+    {
+        return FullParse();
+    }
+    for (auto &tok : tokens)
+    {
+        if (tok.row_number == 1)
+        {
+            tok.column_number += regions[lo].column_number;
+        }
+        tok.row_number += regions[lo].row_number - 1;
+        tok.offset += start;
+    }
+    // new nodes never share an id with the nodes they are spliced among
+    Parser p;
+    p.SetFirstNodeId(file->node_count);
+    auto part = p.ParseTokens(tokens);
+    if (p.HasErrors() || (lo > 0 && !part->imports.empty()))
+    {
+        return FullParse(); // imports only belong to the head of the file
+    }
+
+    std::vector<Region> new_regions;
+    auto &pos = p.DeclPositions();
+    for (size_t i = 0; i < pos.size(); i++)
+    {
+        auto &tok = tokens[pos[i]];
+        new_regions.push_back({tok.offset, tok.row_number, tok.column_number});
+    }
+    if (new_regions.size() > 0)
+    {
+        new_regions[0] = regions[lo];
+    }
+
+    // declarations with untouched text keep their old nodes
+    auto old_text = [&](int i) {
+        int end = i + 1 < static_cast<int>(regions.size()) ? regions[i + 1].offset : old_source.size();
+        return old_source.substr(regions[i].offset, end - regions[i].offset);
+    };
+    auto new_text = [&](int i) {
+        int end = i + 1 < static_cast<int>(new_regions.size()) ? new_regions[i + 1].offset : new_end;
+        return source.substr(new_regions[i].offset, end - new_regions[i].offset);
+    };
+    auto &old_decls = file->declarations;
+    auto &new_decls = part->declarations;
+    int old_count = hi - lo + 1;
+    int new_count = new_decls.size();
+    int prefix = 0;
+    while (prefix < old_count && prefix < new_count && old_text(lo + prefix) == new_text(prefix))
+    {
+        new_decls[prefix] = old_decls[lo + prefix];
+        prefix++;
+    }
+    int suffix = 0;
+    while (suffix < old_count - prefix && suffix < new_count - prefix &&
+           old_text(hi - suffix) == new_text(new_count - 1 - suffix))
+    {
+        new_decls[new_count - 1 - suffix] = old_decls[hi - suffix];
+        suffix++;
+    }
+
+    ChangeSet changes;
+    changes.malformed = false;
+    changes.full = false;
+    for (int i = prefix; i < new_count - suffix; i++)
+    {
+        changes.changed.push_back(lo + i);
+    }
+    for (int i = lo + prefix; i <= hi - suffix; i++)
+    {
+        changes.removed.push_back(old_decls[i]);
+    }
+
+    // shift the regions behind the edit
+    int old_rows = std::count(old_source.begin() + start, old_source.begin() + old_end, '\n');
+    int new_rows = std::count(text.begin(), text.end(), '\n');
+    int first_row = hi + 1 < static_cast<int>(regions.size()) ? regions[hi + 1].row_number : -1;
+
+    // and the nodes reused there, unless they stay where they were
+    int edit_end = edit.offset + edit.length;
+    int end_row = regions[lo].row_number + std::count(old_source.begin() + start, old_source.begin() + edit_end, '\n');
+    int column_delta = ColumnOf(source, edit.offset + edit.text.size()) - ColumnOf(old_source, edit_end);
+    PositionShift shift(end_row, new_rows - old_rows, column_delta);
+    auto moved = [&](const ast::Decl::Ptr &d) {
+        if (new_rows != old_rows || (column_delta != 0 && d->row_number == end_row))
+        {
+            shift.Walk(d.get());
+        }
+    };
+    for (int i = new_count - suffix; i < new_count; i++)
+    {
+        moved(new_decls[i]);
+    }
+    for (size_t i = hi + 1; i < old_decls.size(); i++)
+    {
+        moved(old_decls[i]);
+    }
+    for (size_t i = hi + 1; i < regions.size(); i++)
+    {
+        auto &r = regions[i];
+        r.offset += delta;
+        if (r.row_number == first_row)
+        {
+            // shares the last edited line, column may move
+            auto nl = source.rfind('\n', r.offset - 1);
+            r.column_number = nl == string_t::npos ? r.offset : r.offset - nl - 1;
+        }
+        r.row_number += new_rows - old_rows;
+    }
+
+    file->node_count = part->node_count;
+    if (lo == 0)
+    {
+        file->imports = std::move(part->imports);
+    }
+    old_decls.erase(old_decls.begin() + lo, old_decls.begin() + hi + 1);
+    old_decls.insert(old_decls.begin() + lo, new_decls.begin(), new_decls.end());
+    regions.erase(regions.begin() + lo, regions.begin() + hi + 1);
+    regions.insert(regions.begin() + lo, new_regions.begin(), new_regions.end());
+    if (regions.size() > 0)
+    {
+        regions[0] = {0, 1, 0};
+    }
+    return changes;
+}
@@ -0,0 +1,70 @@
+#ifndef LILANG_COMPILER_INCREMENTAL
+#define LILANG_COMPILER_INCREMENTAL
+
+#include "./syntax.h"
+
+/*
+incremental reparsing on top level declarations
+
+the source is partitioned into regions, one per top level declaration,
+a region starts at the first token of its declaration and ends where the
+next one starts. an edit is mapped to the regions it touches, only those
+are lexed and parsed again, every other Decl node is kept by identity.
+
+a reparsed declaration whose text is unchanged keeps its old node too,
+so downstream passes only see the declarations that really changed.
+whenever the file or the reparsed range has syntax errors, the whole file
+is parsed again.
+*/
+namespace lilang
+{
+    namespace compiler
+    {
+        // replace [offset, offset + length) with text
+        struct TextEdit
+        {
+            int offset;
+            int length;
+            string_t text;
+        };
+
+        struct ChangeSet
+        {
+            bool malformed;           // the edit is not inside the source, nothing changed
+            bool full;                // whole file reparsed
+            std::vector<int> changed; // indexes of new or reparsed declarations
+            ast::Decl::List removed;  // declarations that are gone
+        };
+
+        class IncrementalParser
+        {
+        public:
+            IncrementalParser() = default;
+            ast::File::Ptr Parse(const string_t &);
+            ChangeSet Update(const TextEdit &);
+            ast::File::Ptr File();
+            const string_t &Source();
+            void PrintErrors();
+
+        private:
+            // start of one declaration region
+            struct Region
+            {
+                int offset;
+                int row_number;
+                int column_number;
+            };
+
+            string_t source;
+            ast::File::Ptr file;
+            std::vector<Region> regions; // one per declaration
+            Parser parser; // last full parse, its lexical and syntax errors live here
+
+            ChangeSet FullParse();
+            bool HasErrors();
+            int FindRegion(int offset);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iomanip>
+#include "./interface.h"
+#include "./semantic.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        static const char *kMagic = "lilang-interface 1";
+
+        // a whole hex number that fits 64 bits, strtoull alone would take a sign or blanks
+        static bool ParseHash(const string_t &text, uint64_t &hash)
+        {
+            if (text.empty() || !std::isxdigit(static_cast<unsigned char>(text[0])))
+            {
+                return false;
+            }
+            char *end = nullptr;
+            errno = 0;
+            auto v = std::strtoull(text.c_str(), &end, 16);
+            if (errno != 0 || *end != '\0')
+            {
+                return false;
+            }
+            hash = v;
+            return true;
+        }
+
+        // redeclared names and imported ones are not exported
+        Interface Interface::Build(const string_t &module, const File *file, SemanticVisitor &v)
+        {
+            Interface in;
+            in.module = module;
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind == NodeKind::kFuncDecl)
+                {
+                    auto lit = static_cast<FuncDecl *>(decl.get())->fn_lit.get();
+                    auto obj = v.Global(lit->name);
+                    if (obj != nullptr && obj->storage.kind == Storage::Kind::kFunc && obj->storage.func == lit)
+                    {
+                        in.exports.push_back({lit->name, Obj::Kind::kFunc, obj->type});
+                    }
+                    continue;
+                }
+                for (auto &name : static_cast<VarDecl *>(decl.get())->names)
+                {
+                    auto obj = v.Global(name);
+                    if (obj != nullptr && obj->storage.kind == Storage::Kind::kGlobal)
+                    {
+                        in.exports.push_back({name, Obj::Kind::kVar, obj->type});
+                    }
+                }
+            }
+            return in;
+        }
+
+        void Interface::Write(std::ostream &out) const
+        {
+            out << kMagic << "\n";
+            out << "module " << module << "\n";
+            out << "source " << std::hex << source_hash << std::dec << "\n";
+            for (auto &dep : imports)
+            {
+                out << "import " << dep.module << " " << std::hex << dep.hash << std::dec << "\n";
+            }
+            for (auto &e : exports)
+            {
+                out << (e.kind == Obj::Kind::kFunc ? "fn " : "var ") << e.name << " " << EncodeType(e.type) << "\n";
+            }
+        }
+
+        bool Interface::Read(std::istream &in, Interface &result, string_t &error)
+        {
+            Interface r;
+            string_t line;
+            if (!std::getline(in, line) || line != kMagic)
+            {
+                error = "not an interface summary";
+                return false;
+            }
+            int row = 1;
+            bool has_module = false, has_source = false;
+            while (std::getline(in, line))
+            {
+                row++;
+                stringstream_t ss(line);
+                string_t key, name, value;
+                ss >> key >> name;
+                bool ok = !ss.fail();
+                uint64_t hash = 0;
+                if (key == "module" && ok)
+                {
+                    r.module = name;
+                    has_module = true;
+                }
+                else if (key == "source" && ok && ParseHash(name, hash))
+                {
+                    r.source_hash = hash;
+                    has_source = true;
+                }
+                else if (key == "import" && ok && (ss >> value) && ParseHash(value, hash))
+                {
+                    r.imports.push_back({name, hash});
+                }
+                else if ((key == "fn" || key == "var") && ok && (ss >> value))
+                {
+                    auto t = DecodeType(value);
+                    if (t == nullptr)
+                    {
+                        error = "bad type " + value + " in line " + std::to_string(row);
+                        return false;
+                    }
+                    r.exports.push_back({name, key == "fn" ? Obj::Kind::kFunc : Obj::Kind::kVar, t});
+                }
+                else
+                {
+                    error = "bad line " + std::to_string(row);
+                    return false;
+                }
+            }
+            if (!has_module || !has_source)
+            {
+                error = has_module ? "no source line" : "no module line";
+                return false;
+            }
+            result = std::move(r);
+            return true;
+        }
+
+        // FNV-1a over the exports as written
+        uint64_t Interface::Hash() const
+        {
+            stringstream_t ss;
+            for (auto &e : exports)
+            {
+                ss << (e.kind == Obj::Kind::kFunc ? "fn " : "var ") << e.name << " " << EncodeType(e.type) << "\n";
+            }
+            return HashText(ss.str());
+        }
+
+        uint64_t Interface::HashText(const string_t &text)
+        {
+            uint64_t h = 14695981039346656037ull;
+            for (unsigned char c : text)
+            {
+                h = (h ^ c) * 1099511628211ull;
+            }
+            return h;
+        }
+
+        string_t Interface::EncodeType(Type::Ptr t)
+        {
+            switch (t->kind)
+            {
+            case Type::Kind::kInt:
+                return "i";
+            case Type::Kind::kFloat:
+                return "f";
+            case Type::Kind::kString:
+                return "s";
+            case Type::Kind::kBool:
+                return "b";
+            case Type::Kind::kPointer:
+                return "*" + EncodeType(t->base);
+            case Type::Kind::kArray:
+                return "[" + EncodeType(t->base);
+            case Type::Kind::kFn:
+            {
+                string_t s = "F" + std::to_string(t->param_count) + "." +
+                             std::to_string(t->elem_count - t->param_count) + ".";
+                for (auto e : t->Vals())
+                {
+                    s += EncodeType(e);
+                }
+                return s;
+            }
+            case Type::Kind::kTuple:
+            {
+                string_t s = "T" + std::to_string(t->elem_count) + ".";
+                for (auto e : t->Vals())
+                {
+                    s += EncodeType(e);
+                }
+                return s;
+            }
+            default:
+                return "?";
+            }
+        }
+
+        namespace
+        {
+            class TypeDecoder
+            {
+            public:
+                TypeDecoder(const string_t &code) : code(code), pos(0) {}
+
+                Type::Ptr Decode()
+                {
+                    auto t = Next();
+                    return pos == code.size() ? t : nullptr;
+                }
+
+            private:
+                const string_t &code;
+                size_t pos;
+
+                bool Count(int &n)
+                {
+                    size_t start = pos;
+                    while (pos < code.size() && code[pos] >= '0' && code[pos] <= '9')
+                    {
+                        pos++;
+                    }
+                    if (pos == start || pos == code.size() || code[pos] != '.')
+                    {
+                        return false;
+                    }
+                    // each element takes a character at least, a larger count is corrupt
+                    errno = 0;
+                    long v = std::strtol(code.c_str() + start, nullptr, 10);
+                    if (errno != 0 || v > static_cast<long>(code.size() - pos))
+                    {
+                        return false;
+                    }
+                    n = static_cast<int>(v);
+                    pos++;
+                    return true;
+                }
+
+                bool List(int n, Type::List &list)
+                {
+                    for (int i = 0; i < n; i++)
+                    {
+                        auto t = Next();
+                        if (t == nullptr)
+                        {
+                            return false;
+                        }
+                        list.push_back(t);
+                    }
+                    return true;
+                }
+
+                Type::Ptr Next()
+                {
+                    if (pos == code.size())
+                    {
+                        return nullptr;
+                    }
+                    auto &types = TypeTable::Global();
+                    switch (code[pos++])
+                    {
+                    case 'i':
+                        return TypeTable::Int();
+                    case 'f':
+                        return TypeTable::Float();
+                    case 's':
+                        return TypeTable::String();
+                    case 'b':
+                        return TypeTable::Bool();
+                    case '*':
+                    {
+                        auto base = Next();
+                        return base == nullptr ? nullptr : types.Pointer(base);
+                    }
+                    case '[':
+                    {
+                        auto base = Next();
+                        return base == nullptr ? nullptr : types.Array(base);
+                    }
+                    case 'F':
+                    {
+                        int params, returns;
+                        Type::List p, r;
+                        if (!Count(params) || !Count(returns) || !List(params, p) || !List(returns, r))
+                        {
+                            return nullptr;
+                        }
+                        return types.Func(p, r);
+                    }
+                    case 'T':
+                    {
+                        int n;
+                        Type::List vals;
+                        if (!Count(n) || !List(n, vals))
+                        {
+                            return nullptr;
+                        }
+                        return types.Tuple(vals);
+                    }
+                    default:
+                        return nullptr;
+                    }
+                }
+            };
+        }
+
+        Type::Ptr Interface::DecodeType(const string_t &code)
+        {
+            return TypeDecoder(code).Decode();
+        }
+    }
+}
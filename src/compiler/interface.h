@@ -0,0 +1,69 @@
+#ifndef LILANG_COMPILER_INTERFACE
+#define LILANG_COMPILER_INTERFACE
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include "./ast.h"
+
+/*
+interface summary of a module: the signatures of its top level functions
+and the types of its global variables, all a dependent needs to be checked.
+
+a summary is a small line based text file:
+
+    lilang-interface 1
+    module geometry
+    source 9f3c...                    hash of the text it was built from
+    import shapes 51d0...             hash of each import's interface then
+    fn area F1.1.*[ff                 name and encoded type of each export
+    var origin [f
+
+types are encoded in prefix form: i f s b for the basic types, *T pointer,
+[T array, Fp.r.T... function with p params and r returns, Tn.T... tuple.
+
+the interface hash only covers the exports, a module whose body changed
+but whose exports did not keeps its hash, so its dependents stay valid.
+*/
+namespace lilang
+{
+    namespace ast
+    {
+        class SemanticVisitor;
+
+        class Interface
+        {
+        public:
+            struct Export
+            {
+                string_t name;
+                Obj::Kind kind; // kFunc or kVar
+                Type::Ptr type;
+            };
+            struct Dep
+            {
+                string_t module;
+                uint64_t hash; // of its interface when this one was built
+            };
+
+            string_t module;
+            uint64_t source_hash = 0;
+            std::vector<Dep> imports;
+            std::vector<Export> exports;
+
+            // the exports of a file checked by the visitor without errors
+            static Interface Build(const string_t &module, const File *, SemanticVisitor &);
+            void Write(std::ostream &) const;
+            // false and the reason if the text is not a valid summary
+            static bool Read(std::istream &, Interface &, string_t &error);
+            uint64_t Hash() const;
+
+            static uint64_t HashText(const string_t &);
+            static string_t EncodeType(Type::Ptr);
+            // nullptr if the code is malformed
+            static Type::Ptr DecodeType(const string_t &);
+        };
+    }
+}
+
+#endif
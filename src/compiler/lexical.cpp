@@ -5,15 +5,15 @@ namespace lilang
 {
     namespace compiler
     {
-        CodeToken::List LexicalParser::ParseFile(const string_t &file_name, CodeError::List &err_list)
+        CodeToken::List LexicalParser::ParseFile(const string_t &file_name, Diagnostics &diag)
         {
             fstream_t f(file_name);
             stringstream_t ss;
             ss << f.rdbuf();
-            return ParseString(ss.str(), err_list);
+            return ParseString(ss.str(), diag);
         }
 
-        CodeToken::List LexicalParser::ParseString(const string_t &file, CodeError::List &err_list)
+        CodeToken::List LexicalParser::ParseString(const string_t &file, Diagnostics &diag)
         {
             enum class ParseState
             {
@@ -89,17 +89,17 @@ namespace lilang
                     {
                         cur_token.type = CodeType::kBreak;
                     }
+                    else if (tok == "import")
+                    {
+                        cur_token.type = CodeType::kImport;
+                    }
                 }
                 tok_list.push_back(cur_token);
                 NextState(ParseState::kStart);
             };
 
             auto AddError = [&](string_t msg) {
-                CodeError err;
-                err.error_msg = msg;
-                err.row_number = row_number;
-                err.column_number = str - row_begin;
-                err_list.push_back(err);
+                diag.Report(Phase::kLexical, row_number, str - row_begin, msg);
                 NextState(ParseState::kStart);
             };
             while (*str)
@@ -111,6 +111,7 @@ namespace lilang
                     token_begin = str;
                     cur_token.row_number = row_number;
                     cur_token.column_number = str - row_begin;
+                    cur_token.offset = str - file.c_str();
                     switch (*str)
                     {
                     case '/':
@@ -188,6 +189,9 @@ namespace lilang
                             AddToken(1, CodeType::kBitsXor);
                         }
                         break;
+                    case '%':
+                        AddToken(1, CodeType::kMod);
+                        break;
                     case '|':
                         switch (*(str + 1))
                         {
@@ -492,6 +496,7 @@ namespace lilang
             end_token.type = CodeType::kEOF;
             end_token.row_number = row_number;
             end_token.column_number = str - row_begin;
+            end_token.offset = str - file.c_str();
             end_token.value = "$";
             tok_list.push_back(end_token);
             return tok_list;
@@ -678,6 +683,8 @@ namespace lilang
                 return "FN";
             case CodeType::kReturn:
                 return "RETUEN";
+            case CodeType::kImport:
+                return "IMPORT";
             default:
                 return "UNKNOWN";
             }
@@ -713,15 +720,6 @@ namespace lilang
             }
         }
 
-        void CodeError::Print(CodeError::List &list)
-        {
-            for (auto err : list)
-            {
-                std::cout << "(" << err.row_number << ", " << err.column_number << ") "
-                          << err.error_msg << std::endl;
-            }
-        }
-
         void CodeToken::Print(CodeToken::List &list)
         {
             for (auto err : list)
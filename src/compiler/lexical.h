@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "../listl.h"
+#include "./diagnostics.h"
 
 /*
 string literal:
@@ -76,6 +77,7 @@ namespace lilang
             kReturn,          // return
             kContinue,        // continue
             kBreak,           // break
+            kImport,          // import
         };
 
         struct CodeToken
@@ -84,6 +86,7 @@ namespace lilang
             string_t value;
             int row_number;
             int column_number;
+            int offset; // byte offset in source
 
             typedef std::vector<CodeToken> List;
             static string_t EscapeString(string_t);
@@ -97,21 +100,11 @@ namespace lilang
             static void Print(List &);
         };
 
-        struct CodeError
-        {
-            string_t error_msg;
-            int row_number;
-            int column_number;
-
-            typedef std::vector<CodeError> List;
-            static void Print(List &);
-        };
-
         struct LexicalParser
         {
             int _;
-            static CodeToken::List ParseString(const string_t &, CodeError::List &);
-            static CodeToken::List ParseFile(const string_t &, CodeError::List &);
+            static CodeToken::List ParseString(const string_t &, Diagnostics &);
+            static CodeToken::List ParseFile(const string_t &, Diagnostics &);
         };
 
     }
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "./module.h"
+#include "./semantic.h"
+#include "./syntax.h"
+#include "./thread_pool.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        ModuleBuilder::ModuleBuilder(const string_t &dir) : dir(dir), jobs(1)
+        {
+        }
+
+        void ModuleBuilder::SetJobs(int n)
+        {
+            jobs = n < 1 ? 1 : n;
+        }
+
+        const ModuleBuilder::Stats &ModuleBuilder::LastStats()
+        {
+            return stats;
+        }
+
+        const Interface *ModuleBuilder::InterfaceOf(const string_t &module)
+        {
+            auto it = modules.find(module);
+            if (it == modules.end() || it->second->failed)
+            {
+                return nullptr;
+            }
+            return &it->second->interface;
+        }
+
+        const compiler::Diagnostics *ModuleBuilder::Diags(const string_t &module)
+        {
+            auto it = modules.find(module);
+            return it == modules.end() ? nullptr : &it->second->diag;
+        }
+
+        void ModuleBuilder::PrintErrors()
+        {
+            for (auto &it : modules)
+            {
+                if (it.second->diag.HasErrors())
+                {
+                    std::cout << PathOf(it.first, ".li") << ":" << std::endl;
+                    it.second->diag.Print();
+                }
+            }
+        }
+
+        string_t ModuleBuilder::PathOf(const string_t &module, const char *ext)
+        {
+            return dir + "/" + module + ext;
+        }
+
+        //********************************************************************
+        // build
+        //********************************************************************
+
+        bool ModuleBuilder::Build(const string_t &root)
+        {
+            modules.clear();
+            stats = Stats();
+            WorkStealingPool pool(jobs);
+
+            // find the modules wave by wave, a wave is loaded in parallel
+            std::vector<Module *> wave;
+            auto add = [&](const string_t &name) {
+                auto &m = modules[name];
+                if (m == nullptr)
+                {
+                    m.reset(new Module());
+                    m->name = name;
+                    wave.push_back(m.get());
+                }
+            };
+            add(root);
+            while (!wave.empty())
+            {
+                auto loading = std::move(wave);
+                wave.clear();
+                pool.ParallelFor(loading.size(), [&](int, int i) { Load(*loading[i]); });
+                for (auto m : loading)
+                {
+                    for (auto &at : m->imports)
+                    {
+                        add(at.name);
+                    }
+                }
+            }
+            Link();
+            auto &r = *modules[root];
+            if (!r.found)
+            {
+                r.diag.Report(compiler::Phase::kSemantic, 0, 0, "module " + root + " is not found");
+            }
+
+            std::vector<std::vector<Module *>> levels;
+            for (auto &it : modules)
+            {
+                auto m = it.second.get();
+                if (m->found)
+                {
+                    if (m->level >= static_cast<int>(levels.size()))
+                    {
+                        levels.resize(m->level + 1);
+                    }
+                    levels[m->level].push_back(m);
+                }
+            }
+            for (auto &level : levels)
+            {
+                pool.ParallelFor(level.size(), [&](int, int i) { Check(*level[i]); });
+            }
+
+            bool ok = true;
+            for (auto &it : modules)
+            {
+                auto m = it.second.get();
+                stats.parsed += m->parsed;
+                stats.checked += m->checked;
+                stats.reused += m->found && !m->failed && !m->checked;
+                ok = ok && !m->failed;
+            }
+            return ok;
+        }
+
+        // reads the source and, if the summary is still valid, the imports from it
+        void ModuleBuilder::Load(Module &m)
+        {
+            std::ifstream in(PathOf(m.name, ".li"));
+            if (!in)
+            {
+                m.failed = true;
+                return;
+            }
+            m.found = true;
+            stringstream_t ss;
+            ss << in.rdbuf();
+            m.source = ss.str();
+            m.source_hash = Interface::HashText(m.source);
+
+            std::ifstream summary(PathOf(m.name, ".lii"));
+            string_t error;
+            if (summary && Interface::Read(summary, m.summary, error) &&
+                m.summary.module == m.name && m.summary.source_hash == m.source_hash)
+            {
+                m.summarized = true;
+                for (auto &dep : m.summary.imports)
+                {
+                    m.imports.push_back(Import{dep.module, 0, 0});
+                }
+                return;
+            }
+            Parse(m);
+        }
+
+        void ModuleBuilder::Parse(Module &m)
+        {
+            compiler::Parser p(m.diag);
+            m.file = p.ParseString(m.source);
+            m.imports = m.file->imports;
+            m.parsed = true;
+            m.failed = m.failed || m.diag.HasErrors();
+        }
+
+        // binds every import to its module and orders the modules by levels,
+        // a summarized module is parsed when an error needs its import positions
+        void ModuleBuilder::Link()
+        {
+            for (auto &it : modules)
+            {
+                auto &m = *it.second;
+                if (!m.found)
+                {
+                    continue;
+                }
+                for (auto &at : m.imports)
+                {
+                    auto dep = modules[at.name].get();
+                    m.deps.push_back(dep->found ? dep : nullptr);
+                }
+                for (size_t i = 0; i < m.imports.size(); i++)
+                {
+                    bool twice = false;
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        twice = twice || m.imports[j].name == m.imports[i].name;
+                    }
+                    if (m.deps[i] != nullptr && !twice)
+                    {
+                        continue;
+                    }
+                    if (!m.parsed)
+                    {
+                        Parse(m);
+                    }
+                    auto &at = m.imports[i];
+                    m.diag.Report(compiler::Phase::kSemantic, at.row_number, at.column_number,
+                                  twice ? "module " + at.name + " is imported twice"
+                                        : "module " + at.name + " is not found");
+                    m.failed = true;
+                }
+            }
+            std::vector<Module *> path;
+            for (auto &it : modules)
+            {
+                if (it.second->found)
+                {
+                    Level(*it.second, path);
+                }
+            }
+        }
+
+        // 0 for a module without imports, else one more than its deepest import
+        int ModuleBuilder::Level(Module &m, std::vector<Module *> &path)
+        {
+            if (m.level >= 0)
+            {
+                return m.level;
+            }
+            m.level = -2; // on the path
+            path.push_back(&m);
+            int level = 0;
+            for (size_t i = 0; i < m.deps.size(); i++)
+            {
+                auto dep = m.deps[i];
+                if (dep == nullptr)
+                {
+                    continue;
+                }
+                if (dep->level == -2)
+                {
+                    Cycle(std::vector<Module *>(std::find(path.begin(), path.end(), dep), path.end()));
+                    continue;
+                }
+                level = std::max(level, Level(*dep, path) + 1);
+            }
+            path.pop_back();
+            m.level = level;
+            return level;
+        }
+
+        // every module of the cycle reports its import of the next one
+        void ModuleBuilder::Cycle(const std::vector<Module *> &cycle)
+        {
+            for (size_t i = 0; i < cycle.size(); i++)
+            {
+                auto &m = *cycle[i];
+                auto &next = cycle[(i + 1) % cycle.size()]->name;
+                string_t names;
+                for (size_t j = 0; j <= cycle.size(); j++)
+                {
+                    names += (j > 0 ? " -> " : "") + cycle[(i + j) % cycle.size()]->name;
+                }
+                if (!m.parsed)
+                {
+                    Parse(m);
+                }
+                for (auto &at : m.imports)
+                {
+                    if (at.name == next)
+                    {
+                        m.diag.Report(compiler::Phase::kSemantic, at.row_number, at.column_number,
+                                      "import cycle " + names);
+                        break;
+                    }
+                }
+                m.failed = true;
+            }
+        }
+
+        // the summary was built from this source against the current interfaces
+        bool ModuleBuilder::UpToDate(Module &m)
+        {
+            if (!m.summarized || m.summary.imports.size() != m.deps.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < m.deps.size(); i++)
+            {
+                auto &dep = m.summary.imports[i];
+                if (dep.module != m.deps[i]->name || dep.hash != m.deps[i]->interface.Hash())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // only reads the interfaces of the imports, which are done by now
+        void ModuleBuilder::Check(Module &m)
+        {
+            for (auto dep : m.deps)
+            {
+                m.failed = m.failed || dep == nullptr || dep->failed;
+            }
+            if (m.failed)
+            {
+                return;
+            }
+            if (UpToDate(m))
+            {
+                m.interface = m.summary;
+                return;
+            }
+            if (m.file == nullptr)
+            {
+                Parse(m);
+                if (m.failed)
+                {
+                    return;
+                }
+            }
+            SemanticVisitor v(m.diag);
+            v.SetJobs(1);
+            for (size_t i = 0; i < m.imports.size(); i++)
+            {
+                v.ImportModule(m.imports[i], m.deps[i]->interface);
+            }
+            v.Analyze(m.file);
+            m.checked = true;
+            if (m.diag.HasErrors())
+            {
+                m.failed = true;
+                std::remove(PathOf(m.name, ".lii").c_str());
+                return;
+            }
+            m.interface = Interface::Build(m.name, m.file.get(), v);
+            m.interface.source_hash = m.source_hash;
+            for (auto dep : m.deps)
+            {
+                m.interface.imports.push_back({dep->name, dep->interface.Hash()});
+            }
+            // written aside and renamed over, an interrupted build never leaves half a summary
+            auto path = PathOf(m.name, ".lii");
+            auto temp = path + ".tmp";
+            std::ofstream out(temp);
+            m.interface.Write(out);
+            out.close();
+            if (!out || std::rename(temp.c_str(), path.c_str()) != 0)
+            {
+                std::remove(temp.c_str());
+                std::remove(path.c_str());
+            }
+            m.file = nullptr; // the bodies are not needed by anyone now
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef LILANG_COMPILER_MODULE
+#define LILANG_COMPILER_MODULE
+
+#include <map>
+#include <memory>
+#include "./interface.h"
+#include "./diagnostics.h"
+
+/*
+separate compilation of the modules of a program
+
+module m is the file m.li in the source directory, its summary is written
+next to it as m.lii once m checks without errors. a build starts at a root
+module and finds its imports breadth first, a module whose summary still
+matches its source hash takes its imports from the summary and is not
+parsed at all.
+
+modules are then checked by levels, a level only imports from the levels
+before it and its modules are checked in parallel. a module is checked
+against the interfaces of its imports, never their bodies, and is reused
+untouched when its source and the interface hash of every import are the
+same as when its summary was written. a body edit keeps the interface hash
+of its module, so it only rechecks that module.
+
+a module importing one with errors is not checked.
+*/
+namespace lilang
+{
+    namespace ast
+    {
+        class ModuleBuilder
+        {
+        public:
+            // what the last build did
+            struct Stats
+            {
+                int parsed = 0;  // modules parsed
+                int checked = 0; // modules type checked
+                int reused = 0;  // modules taken from their summary
+            };
+
+            explicit ModuleBuilder(const string_t &dir);
+            ModuleBuilder(const ModuleBuilder &) = delete;
+            // threads parsing and checking modules
+            void SetJobs(int);
+            // false if root or any module it imports has errors
+            bool Build(const string_t &root);
+            const Stats &LastStats();
+            // interface of a module of the last build, nullptr if it has none
+            const Interface *InterfaceOf(const string_t &module);
+            // errors of a module of the last build, nullptr if it was not found
+            const compiler::Diagnostics *Diags(const string_t &module);
+            void PrintErrors();
+
+        private:
+            struct Module
+            {
+                string_t name;
+                bool found = false;
+                uint64_t source_hash = 0;
+                string_t source;
+                File::Ptr file;      // nullptr until parsed
+                bool summarized = false; // summary matches the source
+                Interface summary;
+                std::vector<Import> imports;
+                std::vector<Module *> deps; // one per import, nullptr if missing
+                compiler::Diagnostics diag;
+                int level = -1;
+                bool failed = false;
+                bool parsed = false;
+                bool checked = false;
+                Interface interface;
+            };
+
+            string_t dir;
+            int jobs;
+            Stats stats;
+            std::map<string_t, std::unique_ptr<Module>> modules;
+
+            string_t PathOf(const string_t &module, const char *ext);
+            void Load(Module &);
+            void Parse(Module &);
+            void Link();
+            int Level(Module &, std::vector<Module *> &path);
+            void Cycle(const std::vector<Module *> &);
+            bool UpToDate(Module &);
+            void Check(Module &);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,449 @@
+#include <climits>
+#include "./query.h"
+
+namespace lilang
+{
+    namespace ast
+    {
+        static const int kBodyRank = INT_MAX; // bodies see every top level name
+
+        Obj::Ptr QueryEngine::QueryScope::Resolve(NameId name)
+        {
+            auto obj = e->Resolve(name, rank);
+            if (seen.insert(name).second)
+            {
+                deps->push_back({name, obj});
+            }
+            return obj;
+        }
+
+        QueryEngine::QueryEngine() : names(NameTable::Global())
+        {
+            builtins[names.Intern("int")] = std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Int());
+            builtins[names.Intern("float")] = std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Float());
+            builtins[names.Intern("string")] = std::make_shared<Obj>(Obj::Kind::kType, TypeTable::String());
+            builtins[names.Intern("bool")] = std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Bool());
+        }
+
+        const compiler::Diagnostics &QueryEngine::Diags()
+        {
+            return diag;
+        }
+
+        const QueryEngine::Stats &QueryEngine::LastStats()
+        {
+            return stats;
+        }
+
+        Obj::Ptr QueryEngine::SignatureOf(const string_t &name)
+        {
+            auto it = bindings.find(names.Intern(name));
+            if (it == bindings.end())
+            {
+                return nullptr;
+            }
+            return it->second.obj;
+        }
+
+        compiler::Diagnostic::List QueryEngine::DiagnosticsOf(const Decl::Ptr &decl)
+        {
+            compiler::Diagnostic::List list;
+            auto it = entries.find(decl.get());
+            if (it == entries.end())
+            {
+                return list;
+            }
+            auto &e = it->second;
+            list = e.sig.diag.All();
+            list.insert(list.end(), e.body.diag.All().begin(), e.body.diag.All().end());
+            return list;
+        }
+
+        const compiler::Diagnostics &QueryEngine::Update(const File::Ptr &file)
+        {
+            stats = Stats();
+            changed.clear();
+            work.clear();
+            MatchDecls(file);
+            BindNames();
+
+            // signatures in rank order, a changed binding only affects higher ranks
+            for (auto e : funcs)
+            {
+                if (!e->sig.valid)
+                {
+                    work.insert({e->rank, e});
+                }
+            }
+            for (auto e : vars)
+            {
+                if (!e->sig.valid)
+                {
+                    work.insert({e->rank, e});
+                }
+            }
+            while (!work.empty())
+            {
+                auto e = work.begin()->second;
+                work.erase(work.begin());
+                if (!e->redeclared.empty() || (e->sig.valid && !DepsChanged(e->sig, e->rank)))
+                {
+                    continue;
+                }
+                ComputeSignature(*e);
+                for (auto &p : e->objs)
+                {
+                    auto &b = bindings[p.first];
+                    if (b.decl == e->node.get() && b.obj != p.second)
+                    {
+                        b.obj = p.second;
+                        MarkChanged(p.first);
+                    }
+                }
+            }
+
+            // bodies that are new or read a changed name
+            std::set<std::pair<int, Entry *>> bodies;
+            for (auto e : funcs)
+            {
+                if (!e->body.valid)
+                {
+                    bodies.insert({e->rank, e});
+                }
+            }
+            for (auto name : changed)
+            {
+                auto it = body_readers.find(name);
+                if (it == body_readers.end())
+                {
+                    continue;
+                }
+                for (auto decl : it->second)
+                {
+                    auto &e = entries.at(decl);
+                    bodies.insert({e.rank, &e});
+                }
+            }
+            for (auto &p : bodies)
+            {
+                auto e = p.second;
+                if (e->redeclared.empty() && (!e->body.valid || DepsChanged(e->body, kBodyRank)))
+                {
+                    ComputeBody(*e);
+                }
+            }
+            old_bindings.clear();
+            Collect();
+            return diag;
+        }
+
+        // keeps the entries of nodes still in the file, creates the new ones
+        void QueryEngine::MatchDecls(const File::Ptr &file)
+        {
+            for (auto &p : entries)
+            {
+                p.second.alive = false;
+            }
+            funcs.clear();
+            vars.clear();
+            for (auto &decl : file->declarations)
+            {
+                auto &e = entries[decl.get()];
+                if (e.node == nullptr)
+                {
+                    e.node = decl;
+                    auto fn = dynamic_cast<FuncDecl *>(decl.get());
+                    if (fn != nullptr)
+                    {
+                        e.fn = fn->fn_lit.get();
+                    }
+                    else
+                    {
+                        e.var = dynamic_cast<VarDecl *>(decl.get());
+                    }
+                }
+                e.alive = true;
+                if (e.fn != nullptr)
+                {
+                    funcs.push_back(&e);
+                }
+                else
+                {
+                    vars.push_back(&e);
+                }
+            }
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                if (it->second.alive)
+                {
+                    it++;
+                    continue;
+                }
+                Unlink(it->second, it->second.sig, sig_readers);
+                Unlink(it->second, it->second.body, body_readers);
+                it = entries.erase(it);
+            }
+        }
+
+        // which declaration binds each top level name, mirrors SemanticVisitor::Visit(File):
+        // functions first, then variables, a name bound before makes the declaration an error
+        void QueryEngine::BindNames()
+        {
+            old_bindings.swap(bindings);
+            bindings.clear();
+            auto last_obj = [](Entry *e, NameId name) -> Obj::Ptr {
+                for (auto it = e->objs.rbegin(); it != e->objs.rend(); it++)
+                {
+                    if (it->first == name)
+                    {
+                        return it->second;
+                    }
+                }
+                return nullptr;
+            };
+            auto bound = [&](NameId name) {
+                return builtins.count(name) != 0 || bindings.count(name) != 0;
+            };
+            int rank = 0;
+            for (auto e : funcs)
+            {
+                e->rank = rank++;
+                e->redeclared.clear();
+                auto name = e->fn->id;
+                if (bound(name))
+                {
+                    e->redeclared = e->fn->name;
+                    continue;
+                }
+                bindings[name] = {e->node.get(), e->rank, last_obj(e, name)};
+            }
+            for (auto e : vars)
+            {
+                e->rank = rank++;
+                e->redeclared.clear();
+                for (size_t i = 0; i < e->var->ids.size(); i++)
+                {
+                    if (bound(e->var->ids[i]))
+                    {
+                        e->redeclared = e->var->names[i];
+                        break;
+                    }
+                }
+                if (!e->redeclared.empty())
+                {
+                    continue;
+                }
+                for (auto name : e->var->ids)
+                {
+                    bindings[name] = {e->node.get(), e->rank, last_obj(e, name)};
+                }
+            }
+
+            for (auto &p : bindings)
+            {
+                auto it = old_bindings.find(p.first);
+                if (it == old_bindings.end() || it->second.decl != p.second.decl || it->second.obj != p.second.obj)
+                {
+                    MarkChanged(p.first);
+                }
+            }
+            for (auto &p : old_bindings)
+            {
+                if (bindings.count(p.first) == 0)
+                {
+                    MarkChanged(p.first);
+                }
+            }
+        }
+
+        Obj::Ptr QueryEngine::Resolve(NameId name, int rank)
+        {
+            auto b = builtins.find(name);
+            if (b != builtins.end())
+            {
+                return b->second;
+            }
+            auto it = bindings.find(name);
+            if (it == bindings.end() || it->second.rank >= rank)
+            {
+                return nullptr;
+            }
+            return it->second.obj;
+        }
+
+        void QueryEngine::MarkChanged(NameId name)
+        {
+            if (!changed.insert(name).second)
+            {
+                return;
+            }
+            auto it = sig_readers.find(name);
+            if (it == sig_readers.end())
+            {
+                return;
+            }
+            for (auto decl : it->second)
+            {
+                auto &e = entries.at(decl);
+                work.insert({e.rank, &e});
+            }
+        }
+
+        // only names changed by this update can resolve differently
+        bool QueryEngine::DepsChanged(const Query &q, int rank)
+        {
+            for (auto &dep : q.deps)
+            {
+                if (changed.count(dep.name) != 0 && Resolve(dep.name, rank) != dep.obj)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // an unchanged signature keeps its old object, readers comparing
+        // objects by identity then see no change, it now refers to the new node
+        Obj::Ptr QueryEngine::Cutoff(NameId name, Obj::Ptr obj)
+        {
+            auto it = old_bindings.find(name);
+            if (obj != nullptr && it != old_bindings.end() && it->second.obj != nullptr &&
+                it->second.obj->kind == obj->kind && it->second.obj->type == obj->type)
+            {
+                it->second.obj->storage = obj->storage;
+                return it->second.obj;
+            }
+            return obj;
+        }
+
+        void QueryEngine::ComputeSignature(Entry &e)
+        {
+            Unlink(e, e.sig, sig_readers);
+            e.sig.deps.clear();
+            e.sig.diag.Clear();
+            e.objs.clear();
+            QueryScope scope(this, e.rank, &e.sig.deps);
+            SemanticVisitor v(&scope);
+            v.diag = &e.sig.diag;
+            annots.Clear();
+            v.annots = &annots;
+            if (e.fn != nullptr)
+            {
+                auto name = e.fn->id;
+                e.objs.push_back({name, Cutoff(name, v.CheckSignature(e.fn))});
+                e.body.valid = false; // params and returns may differ
+            }
+            else
+            {
+                v.Analyze(e.var);
+                for (auto name : e.var->ids)
+                {
+                    e.objs.push_back({name, Cutoff(name, v.symbols.FindLocalSymbol(name))});
+                }
+            }
+            e.sig.valid = true;
+            e.sig.row_number = e.node->row_number;
+            e.sig.column_number = e.node->column_number;
+            Link(e, e.sig, sig_readers);
+            stats.signatures++;
+        }
+
+        void QueryEngine::ComputeBody(Entry &e)
+        {
+            Unlink(e, e.body, body_readers);
+            e.body.deps.clear();
+            e.body.diag.Clear();
+            QueryScope scope(this, kBodyRank, &e.body.deps);
+            SemanticVisitor v(&scope);
+            annots.Clear();
+            v.annots = &annots;
+            // the body reads the types of its params and returns, their errors belong to the signature
+            compiler::Diagnostics signature;
+            v.diag = &signature;
+            v.Walk(e.fn->type.get());
+            v.diag = &e.body.diag;
+            v.CheckBody(e.fn);
+            e.body.valid = true;
+            e.body.row_number = e.node->row_number;
+            e.body.column_number = e.node->column_number;
+            Link(e, e.body, body_readers);
+            stats.bodies++;
+        }
+
+        void QueryEngine::Link(Entry &e, Query &q, ReaderMap &readers)
+        {
+            for (auto &dep : q.deps)
+            {
+                readers[dep.name].insert(e.node.get());
+            }
+        }
+
+        void QueryEngine::Unlink(Entry &e, Query &q, ReaderMap &readers)
+        {
+            for (auto &dep : q.deps)
+            {
+                auto it = readers.find(dep.name);
+                if (it == readers.end())
+                {
+                    continue;
+                }
+                it->second.erase(e.node.get());
+                if (it->second.empty())
+                {
+                    readers.erase(it);
+                }
+            }
+        }
+
+        // same order as a full check: signatures, variables, bodies
+        void QueryEngine::Collect()
+        {
+            diag.Clear();
+            for (auto e : funcs)
+            {
+                if (!e->redeclared.empty())
+                {
+                    diag.Report(compiler::Phase::kSemantic, e->fn->row_number, e->fn->column_number,
+                                "function " + e->redeclared + " is redeclared");
+                    continue;
+                }
+                CollectQuery(*e, e->sig);
+            }
+            for (auto e : vars)
+            {
+                if (!e->redeclared.empty())
+                {
+                    diag.Report(compiler::Phase::kSemantic, e->var->row_number, e->var->column_number,
+                                "variable " + e->redeclared + " is redeclared");
+                    continue;
+                }
+                CollectQuery(*e, e->sig);
+            }
+            for (auto e : funcs)
+            {
+                if (e->redeclared.empty())
+                {
+                    CollectQuery(*e, e->body);
+                }
+            }
+        }
+
+        // records keep the position they had when computed, the declaration may
+        // have moved since, only its first line can share a line with the edit
+        void QueryEngine::CollectQuery(Entry &e, Query &q)
+        {
+            int row_delta = e.node->row_number - q.row_number;
+            int column_delta = e.node->column_number - q.column_number;
+            if (row_delta == 0 && column_delta == 0)
+            {
+                diag.Merge(q.diag);
+                return;
+            }
+            for (auto &d : q.diag.All())
+            {
+                int column = d.row_number == q.row_number ? d.column_number + column_delta : d.column_number;
+                diag.Report(d.phase, d.row_number + row_delta, column, d.msg);
+            }
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef LILANG_COMPILER_QUERY
+#define LILANG_COMPILER_QUERY
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include "./semantic.h"
+
+/*
+incremental semantic analysis on top level declarations
+
+every declaration node owns two memoized queries: its signature (the
+type of a function, the variables bound by a let) and the diagnostics
+of its body. a query records each global name it resolves together with
+the object it got back. after an edit only queries whose declaration is
+new, or that read a name whose binding changed, are computed again.
+
+a recomputed signature with the same kind and type keeps its old object,
+so a body-only edit stops at that function and never reaches its callers.
+
+declarations are matched by node identity, which is what the incremental
+parser keeps for unchanged declarations, cached diagnostics move with
+their declaration when an edit before it shifts it. the reported
+diagnostics are the same, in the same order, as a full SemanticVisitor
+run over the file.
+
+storage slots are only meant for backends, which run a full check: the
+queries do not renumber global slots or refresh the copies held by Ident.
+*/
+namespace lilang
+{
+    namespace ast
+    {
+        class QueryEngine
+        {
+        public:
+            // queries computed by the last update
+            struct Stats
+            {
+                int signatures = 0;
+                int bodies = 0;
+            };
+
+            QueryEngine();
+            const compiler::Diagnostics &Update(const File::Ptr &);
+            const compiler::Diagnostics &Diags();
+            const Stats &LastStats();
+            // nullptr if name is not a top level declaration
+            Obj::Ptr SignatureOf(const string_t &name);
+            compiler::Diagnostic::List DiagnosticsOf(const Decl::Ptr &);
+
+        private:
+            struct Dep
+            {
+                NameId name;
+                Obj::Ptr obj; // what the name resolved to
+            };
+
+            struct Query
+            {
+                bool valid = false;
+                std::vector<Dep> deps;
+                compiler::Diagnostics diag;
+                int row_number = 0; // of the declaration when computed
+                int column_number = 0;
+            };
+
+            struct Entry
+            {
+                Decl::Ptr node;
+                FuncLit *fn = nullptr; // one of fn and var is set
+                VarDecl *var = nullptr;
+                int rank = 0;        // names of lower rank are visible to the signature
+                bool alive = false;  // in the current file
+                string_t redeclared; // first name already bound, empty if accepted
+                Query sig;
+                Query body; // functions only
+                std::vector<std::pair<NameId, Obj::Ptr>> objs;
+            };
+
+            struct Binding
+            {
+                const Decl *decl;
+                int rank;
+                Obj::Ptr obj;
+            };
+
+            // resolver of one query, records the global names it reads
+            class QueryScope : public GlobalResolver
+            {
+            public:
+                QueryScope(QueryEngine *e, int rank, std::vector<Dep> *deps) : e(e), rank(rank), deps(deps) {}
+                Obj::Ptr Resolve(NameId) override;
+
+            private:
+                QueryEngine *e;
+                int rank;
+                std::vector<Dep> *deps;
+                std::unordered_set<NameId> seen;
+            };
+
+            typedef std::unordered_map<NameId, std::unordered_set<const Decl *>> ReaderMap;
+
+            NameTable &names;
+            std::unordered_map<NameId, Obj::Ptr> builtins;
+            std::unordered_map<const Decl *, Entry> entries;
+            std::vector<Entry *> funcs; // in declaration order
+            std::vector<Entry *> vars;
+            std::unordered_map<NameId, Binding> bindings;
+            std::unordered_map<NameId, Binding> old_bindings; // during an update
+            ReaderMap sig_readers;
+            ReaderMap body_readers;
+            std::unordered_set<NameId> changed;       // bindings changed by this update
+            std::set<std::pair<int, Entry *>> work; // signatures to revisit, by rank
+            compiler::Diagnostics diag;
+            Annotations annots; // scratch of one query, cleared by the next, only diagnostics are kept
+            Stats stats;
+
+            Obj::Ptr Resolve(NameId, int rank);
+            void MatchDecls(const File::Ptr &);
+            void BindNames();
+            void MarkChanged(NameId);
+            bool DepsChanged(const Query &, int rank);
+            Obj::Ptr Cutoff(NameId, Obj::Ptr);
+            void ComputeSignature(Entry &);
+            void ComputeBody(Entry &);
+            void Link(Entry &, Query &, ReaderMap &);
+            void Unlink(Entry &, Query &, ReaderMap &);
+            void Collect();
+            void CollectQuery(Entry &, Query &);
+        };
+    }
+}
+
+#endif
@@ -1,151 +1,468 @@
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include "./interface.h"
 #include "./semantic.h"
 
-#define lilang_semantic_trace
+//#define lilang_semantic_trace
 
-#define trace(S)                                \
-    do                                          \
-    {                                           \
-        RepeatStringLit(Scope::Depth * 4, "."); \
-        RepeatStringLit(1, S);                  \
-        RepeatStringLit(1, "\n");               \
+#ifdef lilang_semantic_trace
+#define trace(S)                                                  \
+    do                                                            \
+    {                                                             \
+        *out << string_t(symbols.Depth() * 4, '.') << S << "\n"; \
+    } while (0)
+#else
+#define trace(S) \
+    do           \
+    {            \
     } while (0)
+#endif
 
 namespace lilang
 {
     namespace ast
     {
-        int Scope::Depth = 0;
+        SymbolTable::SymbolTable(GlobalResolver *global)
+            : global(global), depth(0), used(0), slots(64, {kEmpty, -1})
+        {
+        }
 
-        void Scope::AddSymbol(const string_t &name, Obj::Ptr obj)
+        void SymbolTable::EnterScope()
         {
-#ifdef lilang_semantic_trace
-            stringstream_t ss;
-            ss << "Add Symbol " << name << " " << obj->String();
-            trace(ss.str());
-#endif
-            this->symbol_table[name] = obj;
+            depth++;
         }
 
-        Obj::Ptr Scope::FindSymbol(const string_t &name)
+        void SymbolTable::LeaveScope()
         {
-            auto val = symbol_table[name];
-            if (val != nullptr)
+            while (!bindings.empty() && bindings.back().depth == depth)
             {
-                return val;
+                auto &b = bindings.back();
+                Probe(b.name)->binding = b.shadowed;
+                bindings.pop_back();
             }
-            auto s = this->parent;
-            while (s)
+            depth--;
+        }
+
+        int SymbolTable::Depth()
+        {
+            return depth;
+        }
+
+        void SymbolTable::AddSymbol(NameId name, Obj::Ptr obj)
+        {
+            auto slot = Probe(name);
+            if (slot->name == kEmpty)
             {
-                auto val = s->symbol_table[name];
-                if (val != nullptr)
-                {
-                    return val;
-                }
-                s = s->parent;
+                slot->name = name;
+                used++;
+            }
+            if (slot->binding >= 0 && bindings[slot->binding].depth == depth)
+            {
+                bindings[slot->binding].obj = obj; // redeclared in the same scope
+                return;
+            }
+            bindings.push_back({name, depth, slot->binding, obj});
+            slot->binding = bindings.size() - 1;
+            if (used * 2 > slots.size())
+            {
+                Grow();
             }
-            return nullptr;
         }
 
-        bool Scope::IsSymBolDeclared(const string_t &name)
+        // never inserts
+        Obj::Ptr SymbolTable::FindSymbol(NameId name) const
         {
-            auto v = symbol_table[name];
-            if (v == nullptr)
+            auto obj = FindLocalSymbol(name);
+            if (obj == nullptr && global != nullptr)
             {
-                return false;
+                return global->Resolve(name);
+            }
+            return obj;
+        }
+
+        Obj::Ptr SymbolTable::FindLocalSymbol(NameId name) const
+        {
+            auto slot = Find(name);
+            if (slot->binding < 0)
+            {
+                return nullptr;
+            }
+            return bindings[slot->binding].obj;
+        }
+
+        Obj::Ptr SymbolTable::Resolve(NameId name)
+        {
+            return FindSymbol(name);
+        }
+
+        bool SymbolTable::IsSymbolDeclared(NameId name) const
+        {
+            auto slot = Find(name);
+            return slot->binding >= 0 && bindings[slot->binding].depth == depth;
+        }
+
+        // the slot holding name, or the empty slot where it would be inserted
+        SymbolTable::Slot *SymbolTable::Probe(NameId name)
+        {
+            return const_cast<Slot *>(Find(name));
+        }
+
+        const SymbolTable::Slot *SymbolTable::Find(NameId name) const
+        {
+            size_t mask = slots.size() - 1;
+            size_t i = (name * 2654435761u) & mask;
+            while (slots[i].name != name && slots[i].name != kEmpty)
+            {
+                i = (i + 1) & mask;
+            }
+            return &slots[i];
+        }
+
+        void SymbolTable::Grow()
+        {
+            std::vector<Slot> old(slots.size() * 2, {kEmpty, -1});
+            old.swap(slots);
+            for (auto &slot : old)
+            {
+                if (slot.name != kEmpty)
+                {
+                    *Probe(slot.name) = slot;
+                }
             }
-            return true;
         }
 
         SemanticVisitor::SemanticVisitor()
+            : SemanticVisitor(own_diag)
+        {
+        }
+
+        SemanticVisitor::SemanticVisitor(compiler::Diagnostics &d)
+            : types(TypeTable::Global()), names(NameTable::Global()), diag(&d), annots(&own_annots), out(&std::cout),
+              jobs(std::max(1, static_cast<int>(std::thread::hardware_concurrency()))) // 0 if it is unknown
         {
-            scope = std::make_shared<Scope>();
             // built-in symbols
-            auto type_int = std::make_shared<Type>(Type::Kind::kInt);
-            auto type_float = std::make_shared<Type>(Type::Kind::kFloat);
-            auto type_string = std::make_shared<Type>(Type::Kind::kString);
-            auto type_bool = std::make_shared<Type>(Type::Kind::kBool);
-            scope->AddSymbol("int", std::make_shared<Obj>(Obj::Kind::kType, type_int));
-            scope->AddSymbol("float", std::make_shared<Obj>(Obj::Kind::kType, type_float));
-            scope->AddSymbol("string", std::make_shared<Obj>(Obj::Kind::kType, type_string));
-            scope->AddSymbol("bool", std::make_shared<Obj>(Obj::Kind::kType, type_bool));
+            Declare(names.Intern("int"), std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Int()));
+            Declare(names.Intern("float"), std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Float()));
+            Declare(names.Intern("string"), std::make_shared<Obj>(Obj::Kind::kType, TypeTable::String()));
+            Declare(names.Intern("bool"), std::make_shared<Obj>(Obj::Kind::kType, TypeTable::Bool()));
+        }
+
+        SemanticVisitor::SemanticVisitor(GlobalResolver *global)
+            : types(TypeTable::Global()), names(NameTable::Global()), symbols(global), diag(&own_diag),
+              annots(&own_annots), out(&std::cout), jobs(1)
+        {
+        }
+
+        void SemanticVisitor::SetJobs(int n)
+        {
+            jobs = n < 1 ? 1 : n;
+            if (pool != nullptr && pool->Size() != jobs)
+            {
+                pool.reset();
+            }
+        }
+
+        // an imported object only gives its type to the checker and has no slot here, nothing links
+        // it to its module yet: every backend reports a use of it as not linked
+        void SemanticVisitor::ImportModule(const ast::Import &at, const Interface &in)
+        {
+            for (auto &e : in.exports)
+            {
+                auto id = names.Intern(e.name);
+                if (symbols.IsSymbolDeclared(id))
+                {
+                    auto from = imported.find(id);
+                    diag->Report(compiler::Phase::kSemantic, at.row_number, at.column_number,
+                                 from == imported.end()
+                                     ? e.name + " of " + at.name + " is redeclared"
+                                     : e.name + " is exported by both " + from->second + " and " + at.name);
+                    continue;
+                }
+                auto o = std::make_shared<Obj>(e.kind, e.type);
+                o->storage.kind = Storage::Kind::kExtern;
+                Declare(id, o);
+                imported[id] = at.name;
+            }
+        }
+
+        Obj::Ptr SemanticVisitor::Global(const string_t &name)
+        {
+            return symbols.FindLocalSymbol(names.Intern(name));
+        }
+
+        void SemanticVisitor::Declare(NameId name, Obj::Ptr obj)
+        {
+#ifdef lilang_semantic_trace
+            stringstream_t ss;
+            ss << "Add Symbol " << names.Str(name) << " " << obj->String();
+            trace(ss.str());
+#endif
+            symbols.AddSymbol(name, obj);
+        }
+
+        // slots of a scope are free again once it is left, so sibling scopes share them
+        Obj::Ptr SemanticVisitor::NewVar(Type::Ptr t)
+        {
+            auto o = std::make_shared<Obj>(Obj::Kind::kVar, t);
+            if (func == nullptr)
+            {
+                o->storage.kind = Storage::Kind::kGlobal;
+                o->storage.index = globals++;
+                return o;
+            }
+            o->storage.kind = Storage::Kind::kLocal;
+            o->storage.index = next_slot++;
+            o->storage.func = func;
+            func->frame_size = std::max(func->frame_size, next_slot);
+            return o;
         }
 
         void SemanticVisitor::EnterScope()
         {
-            auto s = std::make_shared<Scope>();
-            s->parent = scope;
-            scope = s;
-            Scope::Depth++;
+            symbols.EnterScope();
+            slot_marks.push_back(next_slot);
         }
 
         void SemanticVisitor::LeaveScope()
         {
-            scope = scope->parent;
-            Scope::Depth--;
+            symbols.LeaveScope();
+            next_slot = slot_marks.back();
+            slot_marks.pop_back();
+        }
+
+        void SemanticVisitor::EmitError(Node *at, const string_t &msg)
+        {
+            trace(msg);
+            diag->Report(compiler::Phase::kSemantic, at->row_number, at->column_number, msg);
         }
 
-        void SemanticVisitor::EmitError(const string_t &msg)
+        void SemanticVisitor::Analyze(const Node::Ptr &node)
         {
-            RepeatStringLit(Scope::Depth * 4, ".");
-            RepeatStringLit(1, msg);
-            RepeatStringLit(1, "\n");
-            errors.emplace_back(msg);
+            Analyze(node.get());
         }
 
-        void SemanticVisitor::Analyze(Node::Ptr node)
+        void SemanticVisitor::Analyze(Node *node)
         {
-            if (node == nullptr)
+            if (node != nullptr && node->node_kind == NodeKind::kFile)
             {
+                Visit(static_cast<File *>(node));
                 return;
             }
-            node->Accept(this);
+            Walk(node);
         }
 
-        void SemanticVisitor::AnalyzeExprList(Expr::List &list)
+        //********************************************************************
+        // walker hooks
+        //********************************************************************
+
+        // checks that must run before the children, false skips the node
+        bool SemanticVisitor::Open(Node *n)
         {
-            for (auto node : list)
+            switch (n->node_kind)
+            {
+            case NodeKind::kVarDecl:
             {
-                node->Accept(this);
+                auto decl = static_cast<VarDecl *>(n);
+                for (size_t i = 0; i < decl->ids.size(); i++)
+                {
+                    if (symbols.IsSymbolDeclared(decl->ids[i]))
+                    {
+                        EmitError(n, "variable " + decl->names[i] + " is redeclared");
+                        return false;
+                    }
+                }
             }
+            break;
+            case NodeKind::kFuncDecl:
+            {
+                auto lit = static_cast<FuncDecl *>(n)->fn_lit.get();
+                if (symbols.IsSymbolDeclared(lit->id))
+                {
+                    EmitError(n, "function " + lit->name + " is redeclared");
+                    return false;
+                }
+            }
+            break;
+            case NodeKind::kBlock:
+                scoped.push_back(n != bare);
+                if (n != bare)
+                {
+                    EnterScope();
+                }
+                bare = nullptr;
+                break;
+            case NodeKind::kWhileStmt:
+                outer_ctx.push_back(stmt_ctx);
+                stmt_ctx |= (break_bit | continue_bit);
+                break;
+            case NodeKind::kForStmt:
+                outer_ctx.push_back(stmt_ctx);
+                stmt_ctx |= (break_bit | continue_bit);
+                EnterScope();
+                break;
+            default:
+                break;
+            }
+            return true;
         }
 
-        void SemanticVisitor::AnalyzeStmtList(Stmt::List &list)
+        // conditions are checked before the blocks they guard, a function is
+        // declared before its body so that it may call itself
+        void SemanticVisitor::Step(Node *n, int i)
         {
-            for (auto node : list)
+            switch (n->node_kind)
             {
-                node->Accept(this);
+            case NodeKind::kFuncType:
+            {
+                // nothing after an invalid parameter or return type is checked
+                auto t = static_cast<FuncType *>(n);
+                if (i == 0)
+                {
+                    break;
+                }
+                int prev = i - 1;
+                auto type = prev < static_cast<int>(t->args.size()) ? t->args[prev]->type.get() : t->returns[prev - t->args.size()].get();
+                if (KindOf(type) != Obj::Kind::kType)
+                {
+                    SkipChildren();
+                }
+            }
+            break;
+            case NodeKind::kVarDecl:
+                if (i == 1 && static_cast<VarDecl *>(n)->type != nullptr)
+                {
+                    SkipChildren(); // the values are not checked against a declared type
+                }
+                break;
+            case NodeKind::kIfStmt:
+                if (i == 1)
+                {
+                    auto cond = static_cast<IfStmt *>(n)->condition.get();
+                    if (TypeOf(cond)->kind != Type::Kind::kBool)
+                    {
+                        EmitError(cond, Type::String(TypeOf(cond)) + " cannot used as condition in if");
+                    }
+                }
+                break;
+            case NodeKind::kWhileStmt:
+                if (i == 1)
+                {
+                    auto cond = static_cast<WhileStmt *>(n)->condition.get();
+                    if (TypeOf(cond)->kind != Type::Kind::kBool)
+                    {
+                        EmitError(cond, Type::String(TypeOf(cond)) + " cannot used as condition in while");
+                    }
+                }
+                break;
+            case NodeKind::kForStmt:
+                if (i == 2)
+                {
+                    auto cond = static_cast<ForStmt *>(n)->condition.get();
+                    if (TypeOf(cond)->kind != Type::Kind::kBool)
+                    {
+                        EmitError(cond, Type::String(TypeOf(cond)) + " cannot used as condition in for");
+                    }
+                }
+                else if (i == 3)
+                {
+                    bare = static_cast<ForStmt *>(n)->block.get(); // in the scope of init
+                }
+                break;
+            case NodeKind::kFuncLit:
+                if (i == 1)
+                {
+                    auto lit = static_cast<FuncLit *>(n);
+                    auto obj = FuncObj(lit);
+                    if (lit->name != "")
+                    {
+                        Declare(lit->id, obj);
+                    }
+                    EnterBody(lit);
+                }
+                break;
+            default:
+                break;
             }
         }
 
         void SemanticVisitor::PrintErrors()
         {
-            for (auto err : errors)
+            diag->Print();
+        }
+
+        compiler::Diagnostics &SemanticVisitor::Diags()
+        {
+            return *diag;
+        }
+
+        const ConstantTable &SemanticVisitor::Constants()
+        {
+            return constants;
+        }
+
+        const Annotations &SemanticVisitor::Annots()
+        {
+            return *annots;
+        }
+
+        void SemanticVisitor::Annotate(const Node *n, Obj::Kind kind, Type::Ptr t)
+        {
+            annots->Set(n, kind, t);
+        }
+
+        // unary operators and parentheses, only a well typed expression is folded
+        void SemanticVisitor::Fold(Expr *e, Expr *operand)
+        {
+            auto c = constants.Find(operand);
+            if (c == nullptr || TypeOf(e)->kind == Type::Kind::kInvalid)
+            {
+                return;
+            }
+            Constant v;
+            auto unary = dynamic_cast<UnaryExpr *>(e);
+            if (unary == nullptr)
             {
-                std::cout << err.msg << std::endl;
+                constants.Set(e, *c);
+            }
+            else if (Constant::Unary(unary->op, *c, v))
+            {
+                constants.Set(e, v);
+            }
+        }
+
+        void SemanticVisitor::Fold(BinaryExpr *e)
+        {
+            auto l = constants.Find(e->left.get());
+            auto r = constants.Find(e->right.get());
+            Constant v;
+            if (l != nullptr && r != nullptr && TypeOf(e)->kind != Type::Kind::kInvalid &&
+                Constant::Binary(e->op, *l, *r, v))
+            {
+                constants.Set(e, v);
             }
         }
 
-        void SemanticVisitor::Assign(Type::List &lhs, Expr::List &rhs)
+        void SemanticVisitor::Assign(Node *at, Type::List &lhs, Expr::List &rhs)
         {
             if (lhs.size() != rhs.size())
             {
                 // let x, y, z = func()
                 if (rhs.size() == 1 &&
-                    rhs[0]->obj->type->kind == Type::Kind::kTuple &&
-                    rhs[0]->obj->type->vals.size() == lhs.size())
+                    TypeOf(rhs[0])->kind == Type::Kind::kTuple &&
+                    TypeOf(rhs[0])->elem_count == lhs.size())
                 {
-                    for (int i = 0; i < lhs.size(); i++)
+                    for (size_t i = 0; i < lhs.size(); i++)
                     {
 
                         auto left_type = lhs[i];
-                        auto right_type = rhs[0]->obj->type->vals[i];
+                        auto right_type = TypeOf(rhs[0])->elems[i];
                         if (!Type::CouldAssign(right_type, left_type))
                         {
                             stringstream_t ss;
                             ss << "Cannot assign type " << Type::String(right_type)
                                << " to type " << Type::String(left_type);
-                            EmitError(ss.str());
+                            EmitError(at, ss.str());
                             return;
                         }
                     }
@@ -153,33 +470,102 @@ namespace lilang
                 }
                 else
                 {
-                    EmitError("the number of right side mismatch the left side");
+                    EmitError(at, "the number of right side mismatch the left side");
                     return;
                 }
             }
             else
             {
-                for (int i = 0; i < lhs.size(); i++)
+                for (size_t i = 0; i < lhs.size(); i++)
                 {
                     auto left_type = lhs[i];
-                    auto right_type = rhs[i]->obj->type;
+                    auto right_type = TypeOf(rhs[i]);
                     if (!Type::CouldAssign(right_type, left_type))
                     {
                         stringstream_t ss;
                         ss << "Cannot assign type " << Type::String(right_type)
                            << " to type " << Type::String(left_type);
-                        EmitError(ss.str());
+                        EmitError(at, ss.str());
                         return;
                     }
                 }
             }
         }
 
+        // phase one declares every function signature and global variable,
+        // phase two checks function bodies against that global scope
         void SemanticVisitor::Visit(File *f)
         {
-            for (auto decl : f->declarations)
+            constants.Clear();
+            annots->Reset(f->node_count); // workers write to it concurrently
+            globals = 0;
+            std::vector<FuncLit *> bodies;
+            for (auto &decl : f->declarations)
             {
-                decl->Accept(this);
+                auto fn = dynamic_cast<FuncDecl *>(decl.get());
+                if (fn == nullptr)
+                {
+                    continue;
+                }
+                auto lit = fn->fn_lit.get();
+                if (symbols.IsSymbolDeclared(lit->id))
+                {
+                    EmitError(lit, "function " + lit->name + " is redeclared");
+                    continue;
+                }
+                Declare(lit->id, CheckSignature(lit));
+                bodies.push_back(lit);
+            }
+            for (auto &decl : f->declarations)
+            {
+                if (dynamic_cast<VarDecl *>(decl.get()) != nullptr)
+                {
+                    Walk(decl.get());
+                }
+            }
+            f->global_count = globals;
+            CheckBodies(bodies);
+        }
+
+        // bodies only read the global scope, each worker has its own scopes and
+        // errors, outputs are merged in declaration order. a few bodies are done
+        // before the threads of a pool would even start
+        void SemanticVisitor::CheckBodies(std::vector<FuncLit *> &bodies)
+        {
+            if (jobs <= 1 || bodies.size() < kParallelBodies)
+            {
+                for (auto lit : bodies)
+                {
+                    CheckBody(lit);
+                }
+                return;
+            }
+            if (pool == nullptr)
+            {
+                pool.reset(new WorkStealingPool(jobs));
+            }
+            std::vector<std::unique_ptr<SemanticVisitor>> workers;
+            for (int i = 0; i < pool->Size(); i++)
+            {
+                workers.emplace_back(new SemanticVisitor(&symbols));
+            }
+            std::vector<compiler::Diagnostics> body_diags(bodies.size());
+            std::vector<stringstream_t> body_traces(bodies.size());
+            pool->ParallelFor(bodies.size(), [&](int w, int i) {
+                auto &v = *workers[w];
+                v.annots = annots;
+                v.diag = &body_diags[i];
+                v.out = &body_traces[i];
+                v.CheckBody(bodies[i]);
+            });
+            for (size_t i = 0; i < bodies.size(); i++)
+            {
+                *out << body_traces[i].str();
+                diag->Merge(body_diags[i]);
+            }
+            for (auto &v : workers)
+            {
+                constants.Merge(v->constants);
             }
         }
 
@@ -191,38 +577,37 @@ namespace lilang
         // may be wrong if A.B is a valid grammer
         void SemanticVisitor::Visit(Ident *ident)
         {
-            auto o = scope->FindSymbol(ident->name);
+            auto o = symbols.FindSymbol(ident->id);
             if (o == nullptr)
             {
-                EmitError(ident->name + " is not declared before");
-                ident->obj = Obj::InvalidInstance();
+                EmitError(ident, ident->name + " is not declared before");
+                annots->SetInvalid(ident);
                 return;
             }
-            ident->obj = o;
+            Annotate(ident, o->kind, o->type);
+            ident->storage = o->storage;
         }
 
         void SemanticVisitor::Visit(BinaryExpr *binary_expr)
         {
-            binary_expr->obj = Obj::InvalidInstance();
-            auto lhs = binary_expr->left;
-            auto rhs = binary_expr->right;
-            Analyze(lhs);
-            Analyze(rhs);
+            annots->SetInvalid(binary_expr);
+            auto &lhs = binary_expr->left;
+            auto &rhs = binary_expr->right;
             switch (binary_expr->op)
             {
             // both sides are bool
             case compiler::CodeType::kLogicAnd:
             case compiler::CodeType::kLogicOr:
             {
-                if (lhs->obj->type->kind == Type::Kind::kBool && rhs->obj->type->kind == Type::Kind::kBool)
+                if (TypeOf(lhs)->kind == Type::Kind::kBool && TypeOf(rhs)->kind == Type::Kind::kBool)
                 {
-                    binary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, lhs->obj->type);
+                    Annotate(binary_expr, Obj::Kind::kValue, TypeOf(lhs));
                 }
                 else
                 {
-                    EmitError("both side of ||/&& should be type bool");
+                    EmitError(binary_expr, "both side of ||/&& should be type bool");
                 }
-                return;
+                break;
             }
             // both sides have the same type and comparable
             case compiler::CodeType::kEqual:
@@ -232,16 +617,16 @@ namespace lilang
             case compiler::CodeType::kNotGreater:
             case compiler::CodeType::kNotLess:
             {
-                if (Type::CouldAssign(lhs->obj->type, rhs->obj->type) && Type::Comparable(lhs->obj->type))
+                if (Type::CouldAssign(TypeOf(lhs), TypeOf(rhs)) && Type::Comparable(TypeOf(lhs)))
                 {
-                    auto t = std::make_shared<Type>(Type::Kind::kBool);
-                    binary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    auto t = TypeTable::Bool();
+                    Annotate(binary_expr, Obj::Kind::kValue, t);
                 }
                 else
                 {
-                    EmitError("both sides of ==/!=/</>/<=/>= should have the same type and comparable");
+                    EmitError(binary_expr, "both sides of ==/!=/</>/<=/>= should have the same type and comparable");
                 }
-                return;
+                break;
             }
             // both side are int or float
             case compiler::CodeType::kAdd:
@@ -249,18 +634,20 @@ namespace lilang
             case compiler::CodeType::kMultiply:
             case compiler::CodeType::kDivide:
             {
-                if (lhs->obj->type->kind != Type::Kind::kInt && lhs->obj->type->kind != Type::Kind::kFloat ||
-                    rhs->obj->type->kind != Type::Kind::kInt && rhs->obj->type->kind != Type::Kind::kFloat)
+                if ((TypeOf(lhs)->kind != Type::Kind::kInt && TypeOf(lhs)->kind != Type::Kind::kFloat) ||
+                    (TypeOf(rhs)->kind != Type::Kind::kInt && TypeOf(rhs)->kind != Type::Kind::kFloat))
                 {
-                    EmitError("both sides of +/-/*// should be type int ot float");
+                    EmitError(binary_expr, "both sides of +/-/*// should be type int or float");
                 }
                 else
                 {
-                    // todo, float???
-                    auto t = std::make_shared<Type>(Type::Kind::kFloat);
-                    binary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    // int if both sides are int
+                    auto t = TypeOf(lhs)->kind == Type::Kind::kInt && TypeOf(rhs)->kind == Type::Kind::kInt
+                                 ? TypeTable::Int()
+                                 : TypeTable::Float();
+                    Annotate(binary_expr, Obj::Kind::kValue, t);
                 }
-                return;
+                break;
             }
             // both side are int
             case compiler::CodeType::kBitsOr:
@@ -268,257 +655,280 @@ namespace lilang
             case compiler::CodeType::kBitsAnd:
             case compiler::CodeType::kMod:
             {
-                if (lhs->obj->type->kind == Type::Kind::kInt && rhs->obj->type->kind == Type::Kind::kInt)
+                if (TypeOf(lhs)->kind == Type::Kind::kInt && TypeOf(rhs)->kind == Type::Kind::kInt)
                 {
-                    auto t = std::make_shared<Type>(Type::Kind::kInt);
-                    binary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    auto t = TypeTable::Int();
+                    Annotate(binary_expr, Obj::Kind::kValue, t);
                 }
                 else
                 {
-                    EmitError("both sides of |/&/^/% should be type int");
+                    EmitError(binary_expr, "both sides of |/&/^/% should be type int");
                 }
-                return;
+                break;
             }
             default:
                 exit(-1);
             }
+            Fold(binary_expr);
         }
 
         void SemanticVisitor::Visit(UnaryExpr *unary_expr)
         {
-            auto expr = unary_expr->expr;
-            Analyze(expr);
+            auto &expr = unary_expr->expr;
             switch (unary_expr->op)
             {
             case compiler::CodeType::kAdd:
             case compiler::CodeType::kSub:
+            {
+                auto kind = TypeOf(expr)->kind;
+                if (kind != Type::Kind::kInt && kind != Type::Kind::kFloat)
+                {
+                    EmitError(unary_expr, "+/-/^ expects a number operand");
+                    annots->SetInvalid(unary_expr);
+                }
+                else
+                {
+                    Annotate(unary_expr, Obj::Kind::kValue, TypeOf(expr));
+                }
+            }
+            break;
             case compiler::CodeType::kBitsXor:
             {
-                if (expr->obj->type->kind != Type::Kind::kInt)
+                auto kind = TypeOf(expr)->kind;
+                if (kind != Type::Kind::kInt)
                 {
-                    EmitError("+/-/^ expects a number operand");
-                    unary_expr->obj = Obj::InvalidInstance();
+                    // only a float is a number ^ cannot take
+                    EmitError(unary_expr, kind == Type::Kind::kFloat ? "^ expects an int operand"
+                                                                     : "+/-/^ expects a number operand");
+                    annots->SetInvalid(unary_expr);
                 }
                 else
                 {
-                    auto t = std::make_shared<Type>(Type::Kind::kInt);
-                    unary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    auto t = TypeTable::Int();
+                    Annotate(unary_expr, Obj::Kind::kValue, t);
                 }
             }
             break;
             case compiler::CodeType::kLogicNot:
             {
-                if (expr->obj->type->kind != Type::Kind::kBool)
+                if (TypeOf(expr)->kind != Type::Kind::kBool)
                 {
-                    EmitError("! expects a bool operand");
-                    unary_expr->obj = Obj::InvalidInstance();
+                    EmitError(unary_expr, "! expects a bool operand");
+                    annots->SetInvalid(unary_expr);
                 }
                 else
                 {
-                    auto t = std::make_shared<Type>(Type::Kind::kBool);
-                    unary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    auto t = TypeTable::Bool();
+                    Annotate(unary_expr, Obj::Kind::kValue, t);
                 }
             }
             break;
             case compiler::CodeType::kBitsAnd:
             {
-                if (!expr->obj->Addressable())
+                if (!Obj::Addressable(KindOf(expr)))
                 {
-                    EmitError("& expects an addressble operand");
-                    unary_expr->obj = Obj::InvalidInstance();
+                    EmitError(unary_expr, "& expects an addressble operand");
+                    annots->SetInvalid(unary_expr);
                 }
                 else
                 {
-                    auto t = std::make_shared<Type>(Type::Kind::kPointer, expr->obj->type);
-                    unary_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+                    auto t = types.Pointer(TypeOf(expr));
+                    Annotate(unary_expr, Obj::Kind::kValue, t);
                 }
             }
             break;
             default:
                 exit(-1);
             }
+            Fold(unary_expr, expr.get());
         }
 
         void SemanticVisitor::Visit(BasicLiteral *lit)
         {
-            auto obj = std::make_shared<Obj>(Obj::Kind::kValue, nullptr);
+            Type::Ptr t;
             switch (lit->type)
             {
             case compiler::CodeType::kNumber:
-                obj->type = std::make_shared<Type>(Type::Kind::kInt);
+                t = TypeTable::Int();
                 break;
             case compiler::CodeType::kFloat:
-                obj->type = std::make_shared<Type>(Type::Kind::kFloat);
+                t = TypeTable::Float();
                 break;
             case compiler::CodeType::kStringLiteral:
-                obj->type = std::make_shared<Type>(Type::Kind::kString);
+                t = TypeTable::String();
                 break;
             case compiler::CodeType::kBoolLit:
-                obj->type = std::make_shared<Type>(Type::Kind::kBool);
+                t = TypeTable::Bool();
                 break;
             default:
                 exit(-1);
             }
-            lit->obj = obj;
+            Annotate(lit, Obj::Kind::kValue, t);
+            Constant c;
+            if (Constant::FromLiteral(lit, c))
+            {
+                constants.Set(lit, c);
+            }
         }
 
         void SemanticVisitor::Visit(ParenExpr *paren_expr)
         {
-            Analyze(paren_expr->expr);
-            paren_expr->obj = paren_expr->expr->obj;
+            Annotate(paren_expr, KindOf(paren_expr->expr), TypeOf(paren_expr->expr));
+            Fold(paren_expr, paren_expr->expr.get());
         }
 
         void SemanticVisitor::Visit(CallExpr *call_expr)
         {
-            call_expr->obj = Obj::InvalidInstance();
-            auto expr = call_expr->expr;
-            Analyze(expr);
-            AnalyzeExprList(call_expr->args);
+            annots->SetInvalid(call_expr);
+            auto &expr = call_expr->expr;
             // type cast
-            if (expr->obj->kind == Obj::Kind::kType)
+            if (KindOf(expr) == Obj::Kind::kType)
             {
                 if (call_expr->args.size() != 1)
                 {
-                    EmitError("type cast expect one operand");
+                    EmitError(call_expr, "type cast expect one operand");
                     return;
                 }
-                auto operand = call_expr->args[0];
-                if (!Type::CouldAssign(operand->obj->type, expr->obj->type))
+                auto &operand = call_expr->args[0];
+                if (!Type::CouldAssign(TypeOf(operand), TypeOf(expr)))
                 {
                     stringstream_t ss;
-                    ss << "Cannot cast from " << Type::String(operand->obj->type)
-                       << " to " << Type::String(expr->obj->type);
-                    EmitError(ss.str());
+                    ss << "Cannot cast from " << Type::String(TypeOf(operand))
+                       << " to " << Type::String(TypeOf(expr));
+                    EmitError(call_expr, ss.str());
                     return;
                 }
-                call_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, expr->obj->type);
+                Annotate(call_expr, Obj::Kind::kValue, TypeOf(expr));
+                auto c = constants.Find(operand.get());
+                Constant v;
+                if (c != nullptr && Constant::Cast(*c, TypeOf(expr), v))
+                {
+                    constants.Set(call_expr, v);
+                }
                 return;
             }
             // variable of function OR function lit
-            else if (expr->obj->kind == Obj::Kind::kVar && expr->obj->type->kind == Type::Kind::kFn ||
-                     expr->obj->kind == Obj::Kind::kFunc)
+            else if ((KindOf(expr) == Obj::Kind::kVar && TypeOf(expr)->kind == Type::Kind::kFn) ||
+                     KindOf(expr) == Obj::Kind::kFunc)
             {
                 // skip
             }
             else
             {
-                EmitError("type or function expected, found type " + Type::String(expr->obj->type));
+                EmitError(call_expr, "type or function expected, found type " + Type::String(TypeOf(expr)));
                 return;
             }
-            auto args = expr->obj->type->params;
+            auto args = TypeOf(expr)->Params();
             if (args.size() != call_expr->args.size())
             {
-                auto call_args = call_expr->args;
+                auto &call_args = call_expr->args;
                 if (call_args.size() == 1 &&
-                    call_args[0]->obj->type->kind == Type::Kind::kTuple &&
-                    call_args[0]->obj->type->vals.size() == args.size())
+                    TypeOf(call_args[0])->kind == Type::Kind::kTuple &&
+                    TypeOf(call_args[0])->elem_count == args.size())
                 {
                     if (args.size() == 0)
                     {
-                        EmitError("function returns nothing, cannot used as a value");
+                        EmitError(call_expr, "function returns nothing, cannot used as a value");
                         return;
                     }
-                    for (int i = 0; i < args.size(); i++)
+                    for (size_t i = 0; i < args.size(); i++)
                     {
-                        if (!Type::CouldAssign(call_args[0]->obj->type->vals[i], args[i]))
+                        if (!Type::CouldAssign(TypeOf(call_args[0])->elems[i], args[i]))
                         {
                             stringstream_t ss;
-                            ss << "Cannot pass type " << Type::String(call_args[0]->obj->type->vals[i])
+                            ss << "Cannot pass type " << Type::String(TypeOf(call_args[0])->elems[i])
                                << " to type " << Type::String(args[i]);
-                            EmitError(ss.str());
+                            EmitError(call_expr, ss.str());
                             return;
                         }
                     }
                 }
                 else
                 {
-                    EmitError("call arguments number not equals to that of function arguments");
+                    EmitError(call_expr, "call arguments number not equals to that of function arguments");
                     return;
                 }
             }
             else
             {
-                for (int i = 0; i < args.size(); i++)
+                for (size_t i = 0; i < args.size(); i++)
                 {
-                    auto call_arg = call_expr->args[i];
-                    if (!Type::CouldAssign(call_arg->obj->type, args[i]))
+                    auto &call_arg = call_expr->args[i];
+                    if (!Type::CouldAssign(TypeOf(call_arg), args[i]))
                     {
                         stringstream_t ss;
                         ss << "function argument expects types " << Type::String(args[i])
-                           << " passed type " << Type::String(call_arg->obj->type);
-                        EmitError(ss.str());
+                           << " passed type " << Type::String(TypeOf(call_arg));
+                        EmitError(call_expr, ss.str());
                         return;
                     }
                 }
             }
             // function returns a tuple
             Type::Ptr t;
-            if (expr->obj->type->returns.size() == 1)
+            auto rets = TypeOf(expr)->Returns();
+            if (rets.size() == 1)
             {
-                t = expr->obj->type->returns[0];
+                t = rets[0];
             }
             else
             {
-                t = std::make_shared<Type>(Type::Kind::kTuple, expr->obj->type->returns);
+                t = types.Tuple(Type::List(rets.begin(), rets.end()));
             }
-            call_expr->obj = std::make_shared<Obj>(Obj::Kind::kValue, t);
+            Annotate(call_expr, Obj::Kind::kValue, t);
         }
 
         void SemanticVisitor::Visit(IndexExpr *index_expr)
         {
-            index_expr->obj = Obj::InvalidInstance();
-            auto operand = index_expr->operand;
-            auto index = index_expr->index;
-            Analyze(operand);
-            Analyze(index);
-            if (operand->obj->type->kind != Type::Kind::kArray)
+            annots->SetInvalid(index_expr);
+            auto &operand = index_expr->operand;
+            auto &index = index_expr->index;
+            if (TypeOf(operand)->kind != Type::Kind::kArray)
             {
-                EmitError("index operand must be array-type");
+                EmitError(index_expr, "index operand must be array-type");
                 return;
             }
-            if (index->obj->type->kind != Type::Kind::kInt)
+            if (TypeOf(index)->kind != Type::Kind::kInt)
             {
-                EmitError("array index must be a number");
+                EmitError(index_expr, "array index must be a number");
                 return;
             }
-            index_expr->obj = std::make_shared<Obj>(Obj::Kind::kIndexValue, operand->obj->type->base);
+            Annotate(index_expr, Obj::Kind::kIndexValue, TypeOf(operand)->base);
         }
 
         void SemanticVisitor::Visit(StarExpr *star_expr)
         {
-            auto expr = star_expr->expr;
-            Analyze(expr);
+            auto &expr = star_expr->expr;
             // pointer type
-            if (expr->obj->kind == Obj::Kind::kType)
+            if (KindOf(expr) == Obj::Kind::kType)
             {
-                auto t = std::make_shared<Type>(Type::Kind::kPointer, expr->obj->type);
-                star_expr->obj = std::make_shared<Obj>(Obj::Kind::kType, t);
+                auto t = types.Pointer(TypeOf(expr));
+                Annotate(star_expr, Obj::Kind::kType, t);
             }
             // dereference
-            else if (expr->obj->type->kind == Type::Kind::kPointer)
+            else if (TypeOf(expr)->kind == Type::Kind::kPointer)
             {
-                star_expr->obj = std::make_shared<Obj>(Obj::Kind::kIndirectPointer, expr->obj->type->base);
+                Annotate(star_expr, Obj::Kind::kIndirectPointer, TypeOf(expr)->base);
             }
             else
             {
-                EmitError("type or pointer variable expected");
-                star_expr->obj = Obj::InvalidInstance();
+                EmitError(star_expr, "type or pointer variable expected");
+                annots->SetInvalid(star_expr);
             }
         }
 
         void SemanticVisitor::Visit(ArrayType *array_type)
         {
-            auto expr = array_type->expr;
-            Analyze(expr);
-            if (expr->obj->kind != Obj::Kind::kType)
+            auto &expr = array_type->expr;
+            if (KindOf(expr) != Obj::Kind::kType)
             {
-                EmitError("[] expects a type");
-                array_type->obj = Obj::InvalidInstance();
+                EmitError(array_type, "[] expects a type");
+                annots->SetInvalid(array_type);
             }
             else
             {
-                auto t = std::make_shared<Type>(Type::Kind::kArray, expr->obj->type);
-                array_type->obj = std::make_shared<Obj>(Obj::Kind::kType, t);
+                auto t = types.Array(TypeOf(expr));
+                Annotate(array_type, Obj::Kind::kType, t);
             }
         }
 
@@ -526,68 +936,110 @@ namespace lilang
         {
             Type::List params;
             Type::List returns;
-            for (auto param : func_type->args)
+            for (auto &param : func_type->args)
             {
-                Analyze(param->type);
-                if (param->type->obj->kind != Obj::Kind::kType)
+                if (KindOf(param->type) != Obj::Kind::kType)
                 {
-                    EmitError("function argument type is not valid");
+                    EmitError(param->type.get(), "function argument type is not valid");
+                    annots->SetInvalid(func_type);
                     return;
                 }
                 else
                 {
-                    params.push_back(param->type->obj->type);
+                    params.push_back(TypeOf(param->type));
                 }
             }
-            for (auto ret : func_type->returns)
+            for (auto &ret : func_type->returns)
             {
-                Analyze(ret);
-                if (ret->obj->kind != Obj::Kind::kType)
+                if (KindOf(ret) != Obj::Kind::kType)
                 {
-                    EmitError("function return type is not valid");
+                    EmitError(ret.get(), "function return type is not valid");
+                    annots->SetInvalid(func_type);
                     return;
                 }
                 else
                 {
-                    returns.push_back(ret->obj->type);
+                    returns.push_back(TypeOf(ret));
                 }
             }
-            auto t = std::make_shared<Type>(Type::Kind::kFn, params, returns);
-            func_type->obj = std::make_shared<Obj>(Obj::Kind::kType, t);
+            auto t = types.Func(params, returns);
+            Annotate(func_type, Obj::Kind::kType, t);
         }
 
         void SemanticVisitor::Visit(FuncLit *lit)
         {
-            auto old_returns = this->returns;
-            Analyze(lit->type);
-            Type::List returns;
-            for (auto ret : lit->type->returns)
+            LeaveBody(lit);
+        }
+
+        // the object a name of the function binds to, once its type is checked
+        Obj::Ptr SemanticVisitor::FuncObj(FuncLit *lit)
+        {
+            auto obj = std::make_shared<Obj>(Obj::Kind::kFunc, TypeOf(lit->type));
+            obj->storage.kind = Storage::Kind::kFunc;
+            obj->storage.func = lit;
+            Annotate(lit, obj->kind, obj->type);
+            return obj;
+        }
+
+        Obj::Ptr SemanticVisitor::CheckSignature(FuncLit *lit)
+        {
+            Walk(lit->type.get());
+            return FuncObj(lit);
+        }
+
+        void SemanticVisitor::CheckBody(FuncLit *lit)
+        {
+            EnterBody(lit);
+            Walk(lit->body.get());
+            LeaveBody(lit);
+        }
+
+        void SemanticVisitor::EnterBody(FuncLit *lit)
+        {
+            // the saved states are kept, their return lists are reused by the next body
+            if (outer_funcs.size() == func_depth)
             {
-                returns.push_back(ret->obj->type);
+                outer_funcs.emplace_back();
             }
-            lit->obj = std::make_shared<Obj>(Obj::Kind::kFunc, lit->type->obj->type);
-            if (lit->name != "")
+            auto &outer = outer_funcs[func_depth++];
+            outer.returns.swap(returns);
+            outer.stmt_ctx = stmt_ctx;
+            outer.func = func;
+            outer.next_slot = next_slot;
+            returns.clear();
+            for (auto &ret : lit->type->returns)
             {
-                scope->AddSymbol(lit->name, lit->obj);
+                returns.push_back(TypeOf(ret));
             }
-            this->returns = returns;
+            stmt_ctx = 0; // break/continue do not cross function boundaries
+            func = lit;
+            next_slot = 0;
+            lit->frame_size = 0;
             EnterScope();
-            for (auto arg : lit->type->args)
+            // params take the first slots in order, unnamed ones included
+            for (auto &arg : lit->type->args)
             {
+                auto t = KindOf(arg->type) == Obj::Kind::kType
+                             ? TypeOf(arg->type)
+                             : TypeTable::Invalid();
+                auto o = NewVar(t);
                 if (arg->var_name != "_")
                 {
-                    if (scope->IsSymBolDeclared(arg->var_name))
+                    if (symbols.IsSymbolDeclared(arg->var_id))
                     {
-                        EmitError("duplicate arguments in function");
-                        return;
+                        EmitError(arg->type.get(), "duplicate arguments in function");
                     }
                     else
                     {
-                        scope->AddSymbol(arg->var_name, arg->type->obj);
+                        Declare(arg->var_id, o);
                     }
                 }
             }
-            AnalyzeStmtList(lit->body->stmts);
+            bare = lit->body.get();
+        }
+
+        void SemanticVisitor::LeaveBody(FuncLit *lit)
+        {
             if (returns.size() != 0 && !lit->body->HasTerminating())
             {
                 string_t name = lit->name;
@@ -595,10 +1047,14 @@ namespace lilang
                 {
                     name = "anonymous";
                 }
-                EmitError("function " + name + " doesn't return");
+                EmitError(lit, "function " + name + " doesn't return");
             }
             LeaveScope();
-            this->returns = old_returns;
+            auto &outer = outer_funcs[--func_depth];
+            returns.swap(outer.returns);
+            stmt_ctx = outer.stmt_ctx;
+            func = outer.func;
+            next_slot = outer.next_slot;
         }
 
         //********************************************************************
@@ -607,187 +1063,192 @@ namespace lilang
 
         void SemanticVisitor::Visit(VarDecl *decl)
         {
-            for (auto name : decl->names)
-            {
-                if (scope->IsSymBolDeclared(name))
-                {
-                    EmitError("variable " + name + " is redeclared");
-                    return;
-                }
-            }
+            decl->first_slot = func == nullptr ? globals : next_slot;
             if (decl->type != nullptr)
             {
-                Analyze(decl->type);
-                for (auto name : decl->names)
+                for (auto id : decl->ids)
                 {
-                    auto o = std::make_shared<Obj>(Obj::Kind::kVar, decl->type->obj->type);
-                    scope->AddSymbol(name, o);
+                    auto o = NewVar(TypeOf(decl->type));
+                    Declare(id, o);
                 }
             }
             else
             {
-                AnalyzeExprList(decl->vals);
                 if (decl->names.size() != decl->vals.size())
                 {
                     // let x, y, z = func()
                     if (decl->vals.size() == 1 &&
-                        decl->vals[0]->obj->type->kind == Type::Kind::kTuple &&
-                        decl->vals[0]->obj->type->vals.size() == decl->names.size())
+                        TypeOf(decl->vals[0])->kind == Type::Kind::kTuple &&
+                        TypeOf(decl->vals[0])->elem_count == decl->names.size())
                     {
-                        for (int i = 0; i < decl->names.size(); i++)
+                        for (size_t i = 0; i < decl->names.size(); i++)
                         {
-                            auto o = std::make_shared<Obj>(Obj::Kind::kVar, decl->vals[0]->obj->type->vals[i]);
-                            scope->AddSymbol(decl->names[i], o);
+                            auto o = NewVar(TypeOf(decl->vals[0])->elems[i]);
+                            Declare(decl->ids[i], o);
                         }
                         return;
                     }
                     else
                     {
-                        EmitError("the number of right expression mismatch the variable number");
+                        EmitError(decl, "the number of right expression mismatch the variable number");
+                        DeclareInvalid(decl);
                         return;
                     }
                 }
                 // let x, y, z = 10, 10, 10
                 // let x, y, z = func(), 10, 10
-                for (int i = 0; i < decl->names.size(); i++)
+                for (size_t i = 0; i < decl->names.size(); i++)
                 {
-                    auto expr = decl->vals[i];
-                    if (expr->obj->type->kind == Type::Kind::kTuple && expr->obj->type->vals.size() != 1)
+                    auto &expr = decl->vals[i];
+                    if (TypeOf(expr)->kind == Type::Kind::kTuple && TypeOf(expr)->elem_count != 1)
                     {
-                        EmitError("tuple" + Type::String(expr->obj->type) +
+                        EmitError(decl, "tuple" + Type::String(TypeOf(expr)) +
                                   " cannot assign to a single variable");
+                        DeclareInvalid(decl);
                         return;
                     }
                     else
                     {
-                        auto o = std::make_shared<Obj>(Obj::Kind::kVar, expr->obj->type);
-                        scope->AddSymbol(decl->names[i], o);
+                        auto o = NewVar(TypeOf(expr));
+                        Declare(decl->ids[i], o);
                     }
                 }
             }
         }
 
-        void SemanticVisitor::Visit(FuncDecl *decl)
+        // a declaration with errors still binds its names, so whether a variable
+        // is declared never depends on the types of its values
+        void SemanticVisitor::DeclareInvalid(VarDecl *decl)
         {
-            if (scope->IsSymBolDeclared(decl->fn_lit->name))
+            for (auto id : decl->ids)
             {
-                EmitError("function " + decl->fn_lit->name + " is redeclared");
-                return;
+                if (!symbols.IsSymbolDeclared(id))
+                {
+                    Declare(id, NewVar(TypeTable::Invalid()));
+                }
             }
-            Analyze(decl->fn_lit); // func type
+        }
+
+        void SemanticVisitor::Visit(FuncDecl *)
+        {
         }
 
         //********************************************************************
         // statement related
         //********************************************************************
 
-        void SemanticVisitor::Visit(IfStmt *if_stmt)
+        void SemanticVisitor::Visit(IfStmt *)
         {
-            auto cond = if_stmt->condition;
-            Analyze(cond);
-            if (cond->obj->type->kind != Type::Kind::kBool)
-            {
-                EmitError(Type::String(cond->obj->type) + " cannot used as condition in if");
-            }
-            Analyze(if_stmt->if_block);
-            Analyze(if_stmt->else_block);
         }
 
-        void SemanticVisitor::Visit(WhileStmt *while_stmt)
+        void SemanticVisitor::Visit(WhileStmt *)
         {
-            auto old_stmt_ctx = stmt_ctx;
-            stmt_ctx |= (break_bit | continue_bit);
-            auto cond = while_stmt->condition;
-            Analyze(cond);
-            if (cond->obj->type->kind != Type::Kind::kBool)
-            {
-                EmitError(Type::String(cond->obj->type) + " cannot used as condition in while");
-            }
-            Analyze(while_stmt->block);
-            stmt_ctx = old_stmt_ctx;
+            stmt_ctx = outer_ctx.back();
+            outer_ctx.pop_back();
         }
 
-        void SemanticVisitor::Visit(ForStmt *for_stmt)
+        void SemanticVisitor::Visit(ForStmt *)
         {
-            auto old_stmt_ctx = stmt_ctx;
-            stmt_ctx |= (break_bit | continue_bit);
-            EnterScope();
-            Analyze(for_stmt->init);
-            auto cond = for_stmt->condition;
-            Analyze(cond);
-            if (cond->obj->type->kind != Type::Kind::kBool)
-            {
-                EmitError(Type::String(cond->obj->type) + " cannot used as condition in for");
-            }
-            Analyze(for_stmt->post);
-            AnalyzeStmtList(for_stmt->block->stmts);
             LeaveScope();
-            stmt_ctx = old_stmt_ctx;
+            stmt_ctx = outer_ctx.back();
+            outer_ctx.pop_back();
         }
 
         void SemanticVisitor::Visit(AssignStmt *assign_stmt)
         {
-            auto lhs = assign_stmt->lhs;
-            auto rhs = assign_stmt->rhs;
-            AnalyzeExprList(lhs);
-            AnalyzeExprList(rhs);
+            auto &lhs = assign_stmt->lhs;
+            auto &rhs = assign_stmt->rhs;
             Type::List type_list;
-            for (auto expr : lhs)
+            for (auto &expr : lhs)
             {
-                if (!expr->obj->Assignable())
+                if (!Obj::Assignable(KindOf(expr)))
                 {
-                    EmitError("left side is not assignable");
+                    EmitError(expr.get(), "left side is not assignable");
                     return;
                 }
-                type_list.push_back(expr->obj->type);
+                type_list.push_back(TypeOf(expr));
+            }
+            if (assign_stmt->op == compiler::CodeType::kAssign)
+            {
+                Assign(assign_stmt, type_list, rhs);
+                return;
+            }
+            // x op= y, the operands must suit the operator op
+            if (lhs.size() != 1 || rhs.size() != 1)
+            {
+                EmitError(assign_stmt, "compound assignment expects one operand on each side");
+                return;
+            }
+            // y must fit x as in x = y, which reports it the same way
+            if (!Type::CouldAssign(TypeOf(rhs[0]), type_list[0]))
+            {
+                Assign(assign_stmt, type_list, rhs);
+                return;
+            }
+            // a string has no +, so it has no += either
+            auto l = TypeOf(lhs[0])->kind;
+            auto r = TypeOf(rhs[0])->kind;
+            switch (assign_stmt->op)
+            {
+            case compiler::CodeType::kAddAssign:
+            case compiler::CodeType::kSubAssign:
+            case compiler::CodeType::kMulAssign:
+            case compiler::CodeType::kDivAssign:
+                if ((l != Type::Kind::kInt && l != Type::Kind::kFloat) || (r != Type::Kind::kInt && r != Type::Kind::kFloat))
+                {
+                    EmitError(assign_stmt, "both sides of +=/-=/*=//= should be type int or float");
+                }
+                break;
+            default:
+                if (l != Type::Kind::kInt || r != Type::Kind::kInt)
+                {
+                    EmitError(assign_stmt, "both sides of |=/&=/^= should be type int");
+                }
             }
-            Assign(type_list, rhs);
         }
 
-        void SemanticVisitor::Visit(DeclStmt *decl_stmt)
+        void SemanticVisitor::Visit(DeclStmt *)
         {
-            Analyze(decl_stmt->decl);
         }
 
         void SemanticVisitor::Visit(RetStmt *ret_stmt)
         {
-            AnalyzeExprList(ret_stmt->vals);
             if (this->returns.size() > 0)
             {
-                Assign(returns, ret_stmt->vals);
+                Assign(ret_stmt, returns, ret_stmt->vals);
             }
             else if (ret_stmt->vals.size() > 0)
             {
-                EmitError("no return value expected");
+                EmitError(ret_stmt, "no return value expected");
             }
         }
 
-        void SemanticVisitor::Visit(Block *block)
+        void SemanticVisitor::Visit(Block *)
         {
-            EnterScope();
-            AnalyzeStmtList(block->stmts);
-            LeaveScope();
+            if (scoped.back())
+            {
+                LeaveScope();
+            }
+            scoped.pop_back();
         }
 
-        void SemanticVisitor::Visit(ExprStmt *expr_stmt)
+        void SemanticVisitor::Visit(ExprStmt *)
         {
-            auto expr = expr_stmt->expr;
-            Analyze(expr);
         }
 
-        void SemanticVisitor::Visit(ContinueStmt *)
+        void SemanticVisitor::Visit(ContinueStmt *stmt)
         {
             if ((stmt_ctx & continue_bit) == 0)
             {
-                EmitError("continue is allowed in for/while statement");
+                EmitError(stmt, "continue is allowed in for/while statement");
             }
         }
 
-        void SemanticVisitor::Visit(BreakStmt *)
+        void SemanticVisitor::Visit(BreakStmt *stmt)
         {
             if ((stmt_ctx & break_bit) == 0)
             {
-                EmitError("break is allowed in for/while statement");
+                EmitError(stmt, "break is allowed in for/while statement");
             }
         }
 
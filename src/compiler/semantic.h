@@ -2,86 +2,209 @@
 #define LILANG_COMPILER_SEMANTIC
 
 #include <map>
+#include <ostream>
 #include "./ast.h"
+#include "./annotation.h"
+#include "./constant.h"
+#include "./thread_pool.h"
 
 namespace lilang
 {
     namespace ast
     {
-        class Scope
+        class Interface;
+
+        // source of the names not bound in a symbol table
+        class GlobalResolver
         {
         public:
-            typedef std::shared_ptr<Scope> Ptr;
-
-            Ptr parent;
-            Scope() = default;
-            Scope(Ptr parent) : parent(parent) {}
-            void AddSymbol(const string_t &, Obj::Ptr);
-            Obj::Ptr FindSymbol(const string_t &);
-            bool IsSymBolDeclared(const string_t &); // in this scope
+            virtual ~GlobalResolver() = default;
+            virtual Obj::Ptr Resolve(NameId) = 0;
+        };
 
-            static int Depth;
+        // one flat open addressing table for all nested scopes
+        // every name maps to its innermost binding, a binding remembers the one it
+        // shadows, so leaving a scope only has to pop its bindings and restore those
+        // names not bound here are looked up in the (read only) global resolver
+        class SymbolTable : public GlobalResolver
+        {
+        public:
+            SymbolTable(GlobalResolver *global = nullptr);
+            void EnterScope();
+            void LeaveScope();
+            int Depth();
+            void AddSymbol(NameId, Obj::Ptr);
+            Obj::Ptr FindSymbol(NameId) const;
+            Obj::Ptr FindLocalSymbol(NameId) const; // global resolver excluded
+            bool IsSymbolDeclared(NameId) const;    // in this scope
+            Obj::Ptr Resolve(NameId);
 
         private:
-            std::map<string_t, Obj::Ptr> symbol_table;
+            struct Binding
+            {
+                NameId name;
+                int depth;
+                int shadowed; // previous binding of the same name, -1 if none
+                Obj::Ptr obj;
+            };
+            struct Slot
+            {
+                NameId name;
+                int binding; // -1 if the name is not bound now
+            };
+            static const NameId kEmpty = ~0u;
+
+            GlobalResolver *global;
+            int depth;
+            size_t used;
+            std::vector<Slot> slots;       // size is a power of 2
+            std::vector<Binding> bindings; // undo log, innermost scope at the back
+
+            Slot *Probe(NameId);
+            const Slot *Find(NameId) const;
+            void Grow();
         };
 
-        class SemanticVisitor : public Visitor
+        // walks the tree with an explicit stack, scopes and statement contexts are
+        // opened by the Pre and Step hooks, every node is checked by its Visit
+        // overload once its children are, dispatched by the node kind switch
+        class SemanticVisitor final : public StaticVisitor<SemanticVisitor>,
+                                      public IterativeWalker<SemanticVisitor>
         {
+            friend class QueryEngine;
+            friend class StaticVisitor<SemanticVisitor>;
+            friend class IterativeWalker<SemanticVisitor>;
+
         public:
             SemanticVisitor();
-            void Analyze(Node::Ptr node);
+            explicit SemanticVisitor(compiler::Diagnostics &); // report into a shared engine
+            SemanticVisitor(const SemanticVisitor &) = delete;
+            void Analyze(const Node::Ptr &node);
             void PrintErrors();
+            compiler::Diagnostics &Diags();
+            // types and value categories of the expressions of the last analysis
+            const Annotations &Annots();
+            // folded values of the constant expressions of the last analysis
+            const ConstantTable &Constants();
+            // threads checking function bodies, 1 checks them on the calling thread,
+            // as is any file with fewer than kParallelBodies functions. the default
+            // is one per hardware thread
+            void SetJobs(int);
+            static const size_t kParallelBodies = 32;
+            // declares the exports of an imported module in the top level scope,
+            // call before analyzing the importing file
+            void ImportModule(const ast::Import &at, const Interface &);
+            // top level object of the name, nullptr if there is none
+            Obj::Ptr Global(const string_t &);
 
-            void Visit(File *) override;
-            void Visit(Ident *) override;
-            void Visit(BinaryExpr *) override;
-            void Visit(UnaryExpr *) override;
-            void Visit(BasicLiteral *) override;
-            void Visit(ParenExpr *) override;
-            void Visit(CallExpr *) override;
-            void Visit(IndexExpr *) override;
-            void Visit(StarExpr *) override;
-            void Visit(ArrayType *) override;
-            void Visit(FuncType *) override;
-            void Visit(FuncLit *) override;
-            void Visit(VarDecl *) override;  // decl here
-            void Visit(FuncDecl *) override; /// decl here
-            void Visit(IfStmt *) override;
-            void Visit(WhileStmt *) override;
-            void Visit(ForStmt *) override;
-            void Visit(AssignStmt *) override;
-            void Visit(DeclStmt *) override; //decl here
-            void Visit(RetStmt *) override;
-            void Visit(Block *) override;
-            void Visit(ExprStmt *) override;
-            void Visit(EmptyStmt *) override;
-            void Visit(BadExpr *) override;
-            void Visit(BadStmt *) override;
-            void Visit(ContinueStmt *) override;
-            void Visit(BreakStmt *) override;
+            void Visit(File *);
 
         private:
-            Scope::Ptr scope;
+            void Visit(Ident *);
+            void Visit(BinaryExpr *);
+            void Visit(UnaryExpr *);
+            void Visit(BasicLiteral *);
+            void Visit(ParenExpr *);
+            void Visit(CallExpr *);
+            void Visit(IndexExpr *);
+            void Visit(StarExpr *);
+            void Visit(ArrayType *);
+            void Visit(FuncType *);
+            void Visit(FuncLit *);
+            void Visit(VarDecl *);  // decl here
+            void Visit(FuncDecl *); /// decl here
+            void Visit(IfStmt *);
+            void Visit(WhileStmt *);
+            void Visit(ForStmt *);
+            void Visit(AssignStmt *);
+            void Visit(DeclStmt *); //decl here
+            void Visit(RetStmt *);
+            void Visit(Block *);
+            void Visit(ExprStmt *);
+            void Visit(EmptyStmt *);
+            void Visit(BadExpr *);
+            void Visit(BadStmt *);
+            void Visit(ContinueStmt *);
+            void Visit(BreakStmt *);
+
+            TypeTable &types;
+            NameTable &names;
+            SymbolTable symbols;
+            compiler::Diagnostics own_diag;
+            compiler::Diagnostics *diag;
+            Annotations own_annots;
+            Annotations *annots;
+            ConstantTable constants;
+            std::ostream *out; // trace output
+            int jobs;
+            std::unique_ptr<WorkStealingPool> pool; // of jobs threads, made by the first parallel check and kept
+            std::map<NameId, string_t> imported; // module each imported name came from
+
+            SemanticVisitor(GlobalResolver *global); // checker of one body or query
             void EnterScope();
             void LeaveScope();
-            void EmitError(const string_t &);
-            void AnalyzeExprList(Expr::List &);
-            void AnalyzeStmtList(Stmt::List &);
-            void Assign(Type::List &, Expr::List &); // check assign
+            void Declare(NameId, Obj::Ptr);
+            Obj::Ptr NewVar(Type::Ptr); // variable with the next free slot
+            void DeclareInvalid(VarDecl *);
+            void EmitError(Node *at, const string_t &);
+            void Annotate(const Node *, Obj::Kind, Type::Ptr);
+            Type::Ptr TypeOf(const Node *n) const { return annots->TypeOf(n); }
+            Obj::Kind KindOf(const Node *n) const { return annots->KindOf(n); }
+            template <typename T>
+            Type::Ptr TypeOf(const std::shared_ptr<T> &n) const { return annots->TypeOf(n.get()); }
+            template <typename T>
+            Obj::Kind KindOf(const std::shared_ptr<T> &n) const { return annots->KindOf(n.get()); }
+            void Fold(Expr *, Expr *operand);
+            void Fold(BinaryExpr *);
+            Obj::Ptr FuncObj(FuncLit *);
+            Obj::Ptr CheckSignature(FuncLit *);
+            void CheckBody(FuncLit *);
+            void CheckBodies(std::vector<FuncLit *> &);
+            void Analyze(Node *);
+            // the hooks only call out for the few kinds that have work in them
+            static bool Has(uint32_t kinds, const Node *n) { return (kinds >> static_cast<int>(n->node_kind)) & 1; }
+            static const uint32_t kOpenKinds = 1u << static_cast<int>(NodeKind::kVarDecl) |
+                                               1u << static_cast<int>(NodeKind::kFuncDecl) |
+                                               1u << static_cast<int>(NodeKind::kBlock) |
+                                               1u << static_cast<int>(NodeKind::kWhileStmt) |
+                                               1u << static_cast<int>(NodeKind::kForStmt);
+            static const uint32_t kStepKinds = 1u << static_cast<int>(NodeKind::kFuncType) |
+                                               1u << static_cast<int>(NodeKind::kFuncLit) |
+                                               1u << static_cast<int>(NodeKind::kIfStmt) |
+                                               1u << static_cast<int>(NodeKind::kWhileStmt) |
+                                               1u << static_cast<int>(NodeKind::kForStmt);
+            bool Pre(Node *n) { return !Has(kOpenKinds, n) || Open(n); }
+            bool Stepped(Node *n)
+            {
+                return Has(kStepKinds, n) ||
+                       (n->node_kind == NodeKind::kVarDecl && static_cast<VarDecl *>(n)->type != nullptr);
+            }
+            void Step(Node *, int i);
+            void Post(Node *n) { Dispatch(n); }
+            bool Open(Node *);
+            void EnterBody(FuncLit *); // scope of the params, body statements go in it
+            void LeaveBody(FuncLit *);
+            void Assign(Node *at, Type::List &, Expr::List &); // check assign
+            struct FuncState
+            {
+                Type::List returns;
+                unsigned int stmt_ctx;
+                FuncLit *func;
+                int next_slot;
+            };
             Type::List returns;                      // function return types
+            std::vector<FuncState> outer_funcs;      // saved by EnterBody, the first func_depth are live
+            size_t func_depth = 0;
+            std::vector<unsigned int> outer_ctx;     // saved by each loop
+            std::vector<bool> scoped;                // whether each open block entered a scope
+            Node *bare = nullptr;                    // next block shares the scope of its parent
+            FuncLit *func = nullptr;                 // owner of the current frame, nullptr at top level
+            int next_slot = 0;                       // first free slot of the frame
+            int globals = 0;                         // global slots used
+            std::vector<int> slot_marks;             // next_slot when entering each scope
             unsigned int stmt_ctx = 0;                   // use bitset to record which statement is permistted
             unsigned int break_bit = 1;
             unsigned int continue_bit = 1 << 1;
-
-            class Error
-            {
-            public:
-                string_t msg;
-                Error() = default;
-                Error(const string_t &s) : msg(s) {}
-            };
-            std::vector<Error> errors;
         };
     }
 }
@@ -0,0 +1,193 @@
+#ifndef LILANG_COMPILER_SMALL_VECTOR
+#define LILANG_COMPILER_SMALL_VECTOR
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <initializer_list>
+#include <type_traits>
+
+namespace lilang
+{
+    // vector keeping the first N elements inline, it only touches the heap
+    // when it grows beyond N
+    template <typename T, int N>
+    class SmallVector
+    {
+    public:
+        typedef T value_type;
+        typedef T *iterator;
+        typedef const T *const_iterator;
+
+        SmallVector() : ptr(Inline()), len(0), cap(N) {}
+        SmallVector(std::initializer_list<T> list) : SmallVector()
+        {
+            reserve(list.size());
+            for (auto &v : list)
+            {
+                push_back(v);
+            }
+        }
+        SmallVector(const SmallVector &o) : SmallVector()
+        {
+            reserve(o.len);
+            for (auto &v : o)
+            {
+                push_back(v);
+            }
+        }
+        SmallVector(SmallVector &&o) noexcept : SmallVector()
+        {
+            Steal(o);
+        }
+        ~SmallVector()
+        {
+            clear();
+            Release();
+        }
+
+        SmallVector &operator=(const SmallVector &o)
+        {
+            if (this != &o)
+            {
+                clear();
+                reserve(o.len);
+                for (auto &v : o)
+                {
+                    push_back(v);
+                }
+            }
+            return *this;
+        }
+        SmallVector &operator=(SmallVector &&o) noexcept
+        {
+            if (this != &o)
+            {
+                clear();
+                Release();
+                ptr = Inline();
+                cap = N;
+                Steal(o);
+            }
+            return *this;
+        }
+
+        void push_back(const T &v)
+        {
+            emplace_back(v);
+        }
+        void push_back(T &&v)
+        {
+            emplace_back(std::move(v));
+        }
+        template <typename... Args>
+        void emplace_back(Args &&... args)
+        {
+            if (len == cap)
+            {
+                Grow(cap * 2 + 1, std::forward<Args>(args)...);
+                return;
+            }
+            new (ptr + len) T(std::forward<Args>(args)...);
+            len++;
+        }
+        void pop_back()
+        {
+            len--;
+            ptr[len].~T();
+        }
+        void clear()
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                ptr[i].~T();
+            }
+            len = 0;
+        }
+        void reserve(size_t n)
+        {
+            if (n <= cap)
+            {
+                return;
+            }
+            Move(static_cast<T *>(::operator new(n * sizeof(T))), n);
+        }
+
+        size_t size() const { return len; }
+        size_t capacity() const { return cap; }
+        bool empty() const { return len == 0; }
+        T *data() { return ptr; }
+        const T *data() const { return ptr; }
+        T &operator[](size_t i) { return ptr[i]; }
+        const T &operator[](size_t i) const { return ptr[i]; }
+        T &front() { return ptr[0]; }
+        const T &front() const { return ptr[0]; }
+        T &back() { return ptr[len - 1]; }
+        const T &back() const { return ptr[len - 1]; }
+        iterator begin() { return ptr; }
+        iterator end() { return ptr + len; }
+        const_iterator begin() const { return ptr; }
+        const_iterator end() const { return ptr + len; }
+
+    private:
+        T *ptr;
+        uint32_t len;
+        uint32_t cap;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type buf[N];
+
+        T *Inline()
+        {
+            return reinterpret_cast<T *>(buf);
+        }
+        // the new element is made before the old ones move, an argument may refer to one of them
+        template <typename... Args>
+        void Grow(size_t n, Args &&... args)
+        {
+            auto p = static_cast<T *>(::operator new(n * sizeof(T)));
+            new (p + len) T(std::forward<Args>(args)...);
+            Move(p, n);
+            len++;
+        }
+        void Move(T *p, size_t n)
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                new (p + i) T(std::move(ptr[i]));
+                ptr[i].~T();
+            }
+            Release();
+            ptr = p;
+            cap = n;
+        }
+        void Release()
+        {
+            if (ptr != Inline())
+            {
+                ::operator delete(ptr);
+            }
+        }
+        // o is left empty, a heap buffer is taken over as it is
+        void Steal(SmallVector &o)
+        {
+            if (o.ptr != o.Inline())
+            {
+                ptr = o.ptr;
+                len = o.len;
+                cap = o.cap;
+                o.ptr = o.Inline();
+                o.len = 0;
+                o.cap = N;
+                return;
+            }
+            for (uint32_t i = 0; i < o.len; i++)
+            {
+                new (ptr + i) T(std::move(o.ptr[i]));
+            }
+            len = o.len;
+            o.clear();
+        }
+    };
+}
+
+#endif
@@ -22,6 +22,7 @@ Parser::TokenMap Parser::statement_follow = {
 Parser::TokenMap Parser::declaration_start = {
     {CodeType::kLet, true},
     {CodeType::kFn, true},
+    {CodeType::kImport, true},
 };
 
 //********************************************************************
@@ -56,7 +57,7 @@ ast::TokenPos Parser::Expect(CodeType t)
     {
         stringstream_t ss;
         ss << CodeToken::Type2Str(t) << " expected, found " << cur_tok.value;
-        error_list.push_back({cur_pos, ss.str()});
+        AddError(ss.str());
     }
     NextToken();
     return cur_pos;
@@ -66,7 +67,13 @@ void Parser::ExpectError(const string_t &msg)
 {
     stringstream_t ss;
     ss << msg << " expected, found " << cur_tok.value;
-    error_list.push_back({cur_pos, ss.str()});
+    AddError(ss.str());
+}
+
+void Parser::AddError(const string_t &msg)
+{
+    auto &tok = tokens[cur_pos];
+    diag->Report(Phase::kSyntax, tok.row_number, tok.column_number, msg);
 }
 
 void Parser::Exhaust(TokenMap &mp)
@@ -97,18 +104,38 @@ Parser::Trace::~Trace()
     RepeatStringLit(1, ")\n");
 }
 
+Parser::Parser() : first_id(0), next_id(0), diag(&own_diag)
+{
+}
+
+Parser::Parser(Diagnostics &d) : first_id(0), next_id(0), diag(&d)
+{
+}
+
 void Parser::PrintErrors()
 {
-    if (error_list.size() == 0)
-    {
-        return;
-    }
-    std::cout << "Errors:" << std::endl;
-    for (auto err : error_list)
-    {
-        std::cout << "(" << tokens[err.pos].row_number << ", " << tokens[err.pos].column_number << ")"
-                  << err.msg << std::endl;
-    }
+    diag->Print();
+}
+
+// errors of every phase reported so far
+bool Parser::HasErrors()
+{
+    return diag->HasErrors();
+}
+
+Diagnostics &Parser::Diags()
+{
+    return *diag;
+}
+
+const std::vector<ast::TokenPos> &Parser::DeclPositions()
+{
+    return decl_pos;
+}
+
+void Parser::SetFirstNodeId(uint32_t id)
+{
+    first_id = id;
 }
 
 //********************************************************************
@@ -117,8 +144,7 @@ void Parser::PrintErrors()
 
 ast::File::Ptr Parser::ParseFile(const string_t &file_name)
 {
-    CodeError::List err_list;
-    auto tok_list = LexicalParser::ParseFile(file_name, err_list);
+    auto tok_list = LexicalParser::ParseFile(file_name, *diag);
     this->tokens = tok_list;
     this->cur_pos = 0;
     this->cur_iter = tokens.begin();
@@ -128,8 +154,7 @@ ast::File::Ptr Parser::ParseFile(const string_t &file_name)
 
 ast::File::Ptr Parser::ParseString(const string_t &str)
 {
-    CodeError::List err_list;
-    auto tok_list = LexicalParser::ParseString(str, err_list);
+    auto tok_list = LexicalParser::ParseString(str, *diag);
     this->tokens = tok_list;
     this->cur_pos = 0;
     this->cur_iter = tokens.begin();
@@ -149,17 +174,37 @@ ast::File::Ptr Parser::ParseTokens(CodeToken::List &list)
 ast::File::Ptr Parser::Parse()
 {
     ast::File::Ptr file = std::make_shared<ast::File>();
-    while (true)
+    decl_pos.clear();
+    next_id = first_id;
+    file->node_id = next_id++;
+    while (cur_tok.type == CodeType::kComment) // leading comments
+    {
+        cur_iter++;
+        cur_pos++;
+        cur_tok = *cur_iter;
+    }
+    while (cur_tok.type == CodeType::kImport)
+    {
+        file->imports.push_back(ParseImport());
+    }
+    while (!diag->Full())
     {
         switch (cur_tok.type)
         {
+        case CodeType::kImport:
+            AddError("imports must come before declarations");
+            ParseImport();
+            break;
         case CodeType::kLet:
+            decl_pos.push_back(cur_pos);
             file->AddDecl(ParseVarDecl());
             break;
         case CodeType::kFn:
+            decl_pos.push_back(cur_pos);
             file->AddDecl(ParseFuncDecl());
             break;
         case CodeType::kEOF:
+            file->node_count = next_id;
             return file;
         default:
         {
@@ -169,6 +214,7 @@ ast::File::Ptr Parser::Parse()
         break;
         }
     }
+    file->node_count = next_id;
     return file;
 }
 
@@ -224,9 +270,10 @@ ast::Expr::Ptr Parser::ParseBinaryExpression(int before_prec)
         {
             return x;
         }
+        auto op_pos = cur_pos;
         Expect(op);
         auto right = ParseBinaryExpression(cur_prec + 1);
-        x = std::make_shared<ast::BinaryExpr>(x, op, right);
+        x = At(op_pos, std::make_shared<ast::BinaryExpr>(std::move(x), op, std::move(right)));
     }
 }
 
@@ -235,6 +282,7 @@ ast::Expr::Ptr Parser::ParseUnaryExpression()
 #ifdef lilang_syntax_trace
     trace("UnaryExpr");
 #endif
+    auto pos = cur_pos;
     switch (cur_tok.type)
     {
     case CodeType::kAdd:
@@ -246,13 +294,13 @@ ast::Expr::Ptr Parser::ParseUnaryExpression()
         auto t = cur_tok.type;
         NextToken();
         auto ue = ParseUnaryExpression();
-        return std::make_shared<ast::UnaryExpr>(t, ue);
+        return At(pos, std::make_shared<ast::UnaryExpr>(t, std::move(ue)));
     }
     case CodeType::kMultiply: // dereference OR type
     {
         NextToken();
         auto ue = ParseUnaryExpression();
-        return std::make_shared<ast::StarExpr>(ue);
+        return At(pos, std::make_shared<ast::StarExpr>(std::move(ue)));
     }
     default:
         return ParsePrimaryExpression();
@@ -291,6 +339,7 @@ ast::Expr::Ptr Parser::ParseOperand()
 #ifdef lilang_syntax_trace
     trace("Operand");
 #endif
+    auto pos = cur_pos;
     switch (cur_tok.type)
     {
     case CodeType::kIdentifier: // variable
@@ -302,7 +351,7 @@ ast::Expr::Ptr Parser::ParseOperand()
         Expect(CodeType::kLeftParenthese);
         auto e = ParseExpression();
         Expect(CodeType::kRightParenthese);
-        return std::make_shared<ast::ParenExpr>(e);
+        return At(pos, std::make_shared<ast::ParenExpr>(std::move(e)));
     }
     case CodeType::kStringLiteral:
     case CodeType::kNumber:
@@ -315,7 +364,7 @@ ast::Expr::Ptr Parser::ParseOperand()
         auto t = ParseFuncType();
         if (cur_tok.type == CodeType::kLeftBrace)
         {
-            return std::make_shared<ast::FuncLit>(t, ParseBlock());
+            return At(pos, std::make_shared<ast::FuncLit>(std::move(t), ParseBlock()));
         }
         else
         {
@@ -333,12 +382,12 @@ ast::Expr::Ptr Parser::ParseOperand()
     }
     ExpectError("operand");
     Exhaust(expression_follow);
-    return std::make_shared<ast::BadExpr>();
+    return At(pos, std::make_shared<ast::BadExpr>());
 }
 
 ast::Expr::Ptr Parser::ParseIdent()
 {
-    auto ident = std::make_shared<ast::Ident>(cur_tok.value);
+    auto ident = At(cur_pos, std::make_shared<ast::Ident>(cur_tok.value));
     NextToken();
     return ident;
 }
@@ -348,12 +397,13 @@ ast::Expr::Ptr Parser::ParseCall(ast::Expr::Ptr e)
 #ifdef lilang_syntax_trace
     trace("Call");
 #endif
+    auto pos = cur_pos;
     ast::Expr::List arg_list;
     Expect(CodeType::kLeftParenthese);
     if (cur_tok.type == CodeType::kRightParenthese)
     {
         NextToken();
-        return std::make_shared<ast::CallExpr>(e);
+        return At(pos, std::make_shared<ast::CallExpr>(std::move(e)));
     }
     while (true)
     {
@@ -369,7 +419,7 @@ ast::Expr::Ptr Parser::ParseCall(ast::Expr::Ptr e)
         }
     }
     Expect(CodeType::kRightParenthese);
-    return std::make_shared<ast::CallExpr>(e, arg_list);
+    return At(pos, std::make_shared<ast::CallExpr>(std::move(e), std::move(arg_list)));
 }
 
 ast::Expr::Ptr Parser::ParseIndex(ast::Expr::Ptr o)
@@ -377,10 +427,11 @@ ast::Expr::Ptr Parser::ParseIndex(ast::Expr::Ptr o)
 #ifdef lilang_syntax_trace
     trace("Index");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kLeftBracket);
     auto i = ParseExpression();
     Expect(CodeType::kRightBracket);
-    return std::make_shared<ast::IndexExpr>(o, i);
+    return At(pos, std::make_shared<ast::IndexExpr>(std::move(o), std::move(i)));
 }
 
 // parse type
@@ -390,7 +441,7 @@ ast::Expr::Ptr Parser::ParseType()
     if (t == nullptr)
     {
         ExpectError("type");
-        return std::make_shared<ast::BadExpr>();
+        return At(cur_pos, std::make_shared<ast::BadExpr>());
     }
     return t;
 }
@@ -419,7 +470,7 @@ ast::Expr::Ptr Parser::ParseTypeName()
 #ifdef lilang_syntax_trace
     trace("TypeName");
 #endif
-    auto t = std::make_shared<ast::Ident>(cur_tok.value);
+    auto t = At(cur_pos, std::make_shared<ast::Ident>(cur_tok.value));
     NextToken();
     return t;
 }
@@ -430,9 +481,10 @@ ast::Expr::Ptr Parser::ParsePointerType()
 #ifdef lilang_syntax_trace
     trace("PointerExpr");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kMultiply);
     auto t = ParseType();
-    return std::make_shared<ast::StarExpr>(t);
+    return At(pos, std::make_shared<ast::StarExpr>(std::move(t)));
 }
 
 // [][][]*int
@@ -441,9 +493,10 @@ ast::Expr::Ptr Parser::ParseArrayType()
 #ifdef lilang_syntax_trace
     trace("ArrayExpr");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kLeftBracket);
     Expect(CodeType::kRightBracket);
-    return std::make_shared<ast::ArrayType>(ParseType());
+    return At(pos, std::make_shared<ast::ArrayType>(ParseType()));
 }
 
 // fn(int, int)()
@@ -452,10 +505,11 @@ ast::FuncType::Ptr Parser::ParseFuncType()
 #ifdef lilang_syntax_trace
     trace("FuncType");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kFn);
     auto args = ParseFnParamters();
     auto rets = ParseFnResults();
-    return std::make_shared<ast::FuncType>(args, rets);
+    return At(pos, std::make_shared<ast::FuncType>(std::move(args), std::move(rets)));
 }
 
 ast::Expr::Ptr Parser::ParseFuncLit()
@@ -463,10 +517,11 @@ ast::Expr::Ptr Parser::ParseFuncLit()
 #ifdef lilang_syntax_trace
     trace("FuncLit");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kFn);
     auto type = ParseFuncType();
     auto body = ParseBlock();
-    return std::make_shared<ast::FuncLit>(type, body);
+    return At(pos, std::make_shared<ast::FuncLit>(std::move(type), std::move(body)));
 }
 
 // (int x , int y, float z)
@@ -548,17 +603,17 @@ ast::Field::Ptr Parser::ParseField()
         cur_tok.type == CodeType::kRightParenthese ||
         cur_tok.type == CodeType::kEOF)
     {
-        return std::make_shared<ast::Field>("_", t);
+        return std::make_shared<ast::Field>("_", std::move(t));
     }
     auto name = cur_tok.value;
     NextToken();
-    return std::make_shared<ast::Field>(name, t);
+    return std::make_shared<ast::Field>(std::move(name), std::move(t));
 }
 
 // literal
 ast::Expr::Ptr Parser::ParseBasicLit()
 {
-    auto lit = std::make_shared<ast::BasicLiteral>(cur_tok.value, cur_tok.type);
+    auto lit = At(cur_pos, std::make_shared<ast::BasicLiteral>(cur_tok.value, cur_tok.type));
     NextToken();
     return lit;
 }
@@ -596,8 +651,9 @@ ast::Stmt::Ptr Parser::ParseStmt()
     }
     case CodeType::kSemiColon:
     {
+        auto pos = cur_pos;
         Expect(CodeType::kSemiColon);
-        return std::make_shared<ast::EmptyStmt>();
+        return At(pos, std::make_shared<ast::EmptyStmt>());
     }
     // first of expression
     case CodeType::kIdentifier:
@@ -620,9 +676,10 @@ ast::Stmt::Ptr Parser::ParseStmt()
     default:
         break;
     };
+    auto pos = cur_pos;
     ExpectError("statement");
     Exhaust(statement_follow); // if can not parse stmt, exhaust until ; OR }
-    return std::make_shared<ast::BadStmt>();
+    return At(pos, std::make_shared<ast::BadStmt>());
 }
 
 ast::Stmt::List Parser::ParseStmtList()
@@ -649,6 +706,7 @@ ast::Stmt::Ptr Parser::ParseSimpleStmt()
 #ifdef lilang_syntax_trace
     trace("SimpleStatement");
 #endif
+    auto pos = cur_pos;
     auto lhs = ParseExprList();
     switch (cur_tok.type)
     {
@@ -662,9 +720,11 @@ ast::Stmt::Ptr Parser::ParseSimpleStmt()
     case CodeType::kBitsXorAssign:
         //case CodeType::kShortAssign:
         {
+            auto op_pos = cur_pos;
+            auto op = cur_tok.type;
             NextToken();
             auto rhs = ParseExprList();
-            return std::make_shared<ast::AssignStmt>(lhs, rhs);
+            return At(op_pos, std::make_shared<ast::AssignStmt>(std::move(lhs), op, std::move(rhs)));
         }
     default:
         break;
@@ -672,10 +732,10 @@ ast::Stmt::Ptr Parser::ParseSimpleStmt()
     if (lhs.size() > 1)
     {
         ExpectError("one expression");
-        return std::make_shared<ast::BadStmt>();
+        return At(cur_pos, std::make_shared<ast::BadStmt>());
     }
     // todo, maybe add ++/-- or other features
-    return std::make_shared<ast::ExprStmt>(lhs[0]); // expression statement
+    return At(pos, std::make_shared<ast::ExprStmt>(std::move(lhs[0]))); // expression statement
 }
 
 ast::Stmt::Ptr Parser::ParseIfStmt()
@@ -683,25 +743,41 @@ ast::Stmt::Ptr Parser::ParseIfStmt()
 #ifdef lilang_syntax_trace
     trace("IfStatement");
 #endif
-    Expect(CodeType::kIf);
-    Expect(CodeType::kLeftParenthese);
-    auto cond = ParseExpression();
-    Expect(CodeType::kRightParenthese);
-    auto if_block = ParseBlock();
+    // an else if chain is read in a loop and linked from its end, a long
+    // chain must not nest calls
+    struct Branch
+    {
+        ast::TokenPos pos;
+        ast::Expr::Ptr cond;
+        ast::Stmt::Ptr if_block;
+    };
+    std::vector<Branch> chain;
     ast::Stmt::Ptr else_block = nullptr;
-    if (cur_tok.type == CodeType::kElse)
+    while (true)
     {
-        NextToken();
-        if (cur_tok.type == CodeType::kIf)
+        auto pos = cur_pos;
+        Expect(CodeType::kIf);
+        Expect(CodeType::kLeftParenthese);
+        auto cond = ParseExpression();
+        Expect(CodeType::kRightParenthese);
+        auto if_block = ParseBlock();
+        chain.push_back({pos, std::move(cond), std::move(if_block)});
+        if (cur_tok.type != CodeType::kElse)
         {
-            else_block = ParseIfStmt();
+            break;
         }
-        else
+        NextToken();
+        if (cur_tok.type != CodeType::kIf)
         {
             else_block = ParseBlock();
+            break;
         }
     }
-    return std::make_shared<ast::IfStmt>(cond, if_block, else_block);
+    for (auto it = chain.rbegin(); it != chain.rend(); it++)
+    {
+        else_block = At(it->pos, std::make_shared<ast::IfStmt>(std::move(it->cond), std::move(it->if_block), std::move(else_block)));
+    }
+    return else_block;
 }
 
 ast::Stmt::Ptr Parser::ParseWhileStmt()
@@ -709,12 +785,13 @@ ast::Stmt::Ptr Parser::ParseWhileStmt()
 #ifdef lilang_syntax_trace
     trace("WhileStatement");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kWhile);
     Expect(CodeType::kLeftParenthese);
     auto e = ParseExpression();
     Expect(CodeType::kRightParenthese);
     auto b = ParseBlock();
-    return std::make_shared<ast::WhileStmt>(e, b);
+    return At(pos, std::make_shared<ast::WhileStmt>(std::move(e), std::move(b)));
 }
 
 ast::Stmt::Ptr Parser::ParseForStmt()
@@ -722,6 +799,7 @@ ast::Stmt::Ptr Parser::ParseForStmt()
 #ifdef lilang_syntax_trace
     trace("IfStatement");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kFor);
     Expect(CodeType::kLeftParenthese);
     // init statement
@@ -740,7 +818,7 @@ ast::Stmt::Ptr Parser::ParseForStmt()
     auto post = ParseSimpleStmt();
     Expect(CodeType::kRightParenthese);
     auto b = ParseBlock();
-    return std::make_shared<ast::ForStmt>(init, cond, post, b);
+    return At(pos, std::make_shared<ast::ForStmt>(std::move(init), std::move(cond), std::move(post), std::move(b)));
 }
 
 ast::Stmt::Ptr Parser::ParseReturnStmt()
@@ -748,21 +826,23 @@ ast::Stmt::Ptr Parser::ParseReturnStmt()
 #ifdef lilang_syntax_trace
     trace("ReturnStatement");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kReturn);
     if (cur_tok.type == CodeType::kSemiColon)
     {
-        return std::make_shared<ast::RetStmt>();
+        return At(pos, std::make_shared<ast::RetStmt>());
     }
     auto rhs = ParseExprList();
     Expect(CodeType::kSemiColon);
-    return std::make_shared<ast::RetStmt>(rhs);
+    return At(pos, std::make_shared<ast::RetStmt>(std::move(rhs)));
 }
 
 // let x, y, z type;
 // let x, y, z = e1, e2, e3;
 ast::Stmt::Ptr Parser::ParseVarDeclStmt()
 {
-    return std::make_shared<ast::DeclStmt>(ParseVarDecl());
+    auto pos = cur_pos;
+    return At(pos, std::make_shared<ast::DeclStmt>(ParseVarDecl()));
 }
 
 ast::Block::Ptr Parser::ParseBlock()
@@ -770,10 +850,11 @@ ast::Block::Ptr Parser::ParseBlock()
 #ifdef lilang_syntax_trace
     trace("Block");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kLeftBrace);
     auto list = ParseStmtList();
     Expect(CodeType::kRightBrace);
-    return std::make_shared<ast::Block>(list);
+    return At(pos, std::make_shared<ast::Block>(std::move(list)));
 }
 
 ast::Stmt::Ptr Parser::ParseContinueStmt()
@@ -781,9 +862,10 @@ ast::Stmt::Ptr Parser::ParseContinueStmt()
 #ifdef lilang_syntax_trace
     trace("Continue");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kContinue);
     Expect(CodeType::kSemiColon);
-    return std::make_shared<ast::ContinueStmt>();
+    return At(pos, std::make_shared<ast::ContinueStmt>());
 }
 
 ast::Stmt::Ptr Parser::ParseBreakStmt()
@@ -791,9 +873,10 @@ ast::Stmt::Ptr Parser::ParseBreakStmt()
 #ifdef lilang_syntax_trace
     trace("Break");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kBreak);
     Expect(CodeType::kSemiColon);
-    return std::make_shared<ast::BreakStmt>();
+    return At(pos, std::make_shared<ast::BreakStmt>());
 }
 
 //********************************************************************
@@ -804,8 +887,9 @@ ast::Decl::Ptr Parser::ParseVarDecl()
 #ifdef lilang_syntax_trace
     trace("VarDecl");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kLet);
-    std::vector<string_t> names;
+    ast::VarDecl::NameList names;
     while (true)
     {
         names.push_back(cur_tok.value);
@@ -821,31 +905,46 @@ ast::Decl::Ptr Parser::ParseVarDecl()
         NextToken();
         auto rhs = ParseExprList();
         Expect(CodeType::kSemiColon);
-        return std::make_shared<ast::VarDecl>(names, rhs);
+        return At(pos, std::make_shared<ast::VarDecl>(std::move(names), std::move(rhs)));
     }
     else
     {
         auto t = ParseType();
         Expect(CodeType::kSemiColon);
-        return std::make_shared<ast::VarDecl>(names, t);
+        return At(pos, std::make_shared<ast::VarDecl>(std::move(names), std::move(t)));
     }
 }
 
+ast::Import Parser::ParseImport()
+{
+#ifdef lilang_syntax_trace
+    trace("Import");
+#endif
+    auto &tok = tokens[cur_pos];
+    Expect(CodeType::kImport);
+    ast::Import import{cur_tok.value, tok.row_number, tok.column_number};
+    Expect(CodeType::kIdentifier);
+    Expect(CodeType::kSemiColon);
+    return import;
+}
+
 ast::Decl::Ptr Parser::ParseFuncDecl()
 {
 #ifdef lilang_syntax_trace
     trace("FuncDecl");
 #endif
+    auto pos = cur_pos;
     Expect(CodeType::kFn);
     auto name = cur_tok.value;
     NextToken();
     auto args = ParseFnParamters();
     auto rets = ParseFnResults();
-    auto type = std::make_shared<ast::FuncType>(args, rets);
+    auto type = At(pos, std::make_shared<ast::FuncType>(std::move(args), std::move(rets)));
     auto body = ParseBlock();
-    auto lit = std::make_shared<ast::FuncLit>(type, body);
-    lit->name = name;
-    return std::make_shared<ast::FuncDecl>(lit);
+    auto lit = At(pos, std::make_shared<ast::FuncLit>(std::move(type), std::move(body)));
+    lit->name = std::move(name);
+    lit->id = ast::NameTable::Global().Intern(lit->name);
+    return At(pos, std::make_shared<ast::FuncDecl>(std::move(lit)));
 }
 
 #undef lilang_syntax_trace
\ No newline at end of file
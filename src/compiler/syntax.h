@@ -12,11 +12,19 @@ namespace lilang
         class Parser
         {
         public:
-            Parser() = default;
+            Parser();
+            explicit Parser(Diagnostics &); // report into a shared engine
+            Parser(const Parser &) = delete;
             ast::File::Ptr ParseFile(const string_t &);
             ast::File::Ptr ParseTokens(CodeToken::List &);
             ast::File::Ptr ParseString(const string_t &);
             void PrintErrors();
+            bool HasErrors();
+            Diagnostics &Diags();
+            // position of the first token of each top level declaration
+            const std::vector<ast::TokenPos> &DeclPositions();
+            // ids of the next parse start here, to extend a file parsed before
+            void SetFirstNodeId(uint32_t);
 
         private:
             using TokenMap = std::map<CodeType, bool>;
@@ -29,12 +37,28 @@ namespace lilang
             CodeToken::List::iterator cur_iter;
             CodeToken::List tokens;
             CodeToken cur_tok;
+            std::vector<ast::TokenPos> decl_pos;
+            uint32_t first_id;
+            uint32_t next_id;
+            Diagnostics own_diag;
+            Diagnostics *diag;
 
             // helper
             void NextToken();
             void Exhaust(TokenMap &);
             ast::TokenPos Expect(CodeType);
             void ExpectError(const string_t &msg);
+            void AddError(const string_t &msg); // at the current token
+
+            // stamps the position of the token at pos and a new id on node
+            template <typename T>
+            std::shared_ptr<T> At(ast::TokenPos pos, std::shared_ptr<T> node)
+            {
+                node->row_number = tokens[pos].row_number;
+                node->column_number = tokens[pos].column_number;
+                node->node_id = next_id++;
+                return node;
+            }
 
             // parse the top level
             ast::File::Ptr Parse();
@@ -76,6 +100,7 @@ namespace lilang
             ast::Stmt::Ptr ParseBreakStmt();
 
             // declaration related
+            ast::Import ParseImport();
             ast::Decl::Ptr ParseVarDecl();
             ast::Decl::Ptr ParseFuncDecl();
 
@@ -90,14 +115,6 @@ namespace lilang
                 Trace(const string_t &msg, Parser *);
                 ~Trace();
             };
-
-            // errors
-            typedef struct Error
-            {
-                ast::TokenPos pos;
-                string_t msg;
-            } Error;
-            std::vector<Error> error_list;
         };
     }
 }
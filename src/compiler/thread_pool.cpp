@@ -0,0 +1,124 @@
+#include "./thread_pool.h"
+
+namespace lilang
+{
+    WorkStealingPool::WorkStealingPool(int threads) : threads(threads < 1 ? 1 : threads)
+    {
+        for (int i = 0; i < this->threads; i++)
+        {
+            queues.emplace_back(new Queue());
+        }
+        for (int w = 1; w < this->threads; w++)
+        {
+            workers.emplace_back(&WorkStealingPool::Loop, this, w);
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &t : workers)
+        {
+            t.join();
+        }
+    }
+
+    int WorkStealingPool::Size()
+    {
+        return threads;
+    }
+
+    void WorkStealingPool::ParallelFor(int n, const std::function<void(int, int)> &task)
+    {
+        // contiguous chunks, neighbouring tasks tend to have similar cost,
+        // the workers are all waiting so the queues are filled without a lock
+        for (int w = 0; w < threads; w++)
+        {
+            int begin = n * w / threads;
+            int end = n * (w + 1) / threads;
+            for (int i = begin; i < end; i++)
+            {
+                queues[w]->tasks.push_back(i);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            current = &task;
+            busy = threads - 1;
+            round++;
+        }
+        wake.notify_all();
+        Work(0, task);
+        std::unique_lock<std::mutex> lock(mu);
+        done.wait(lock, [this] { return busy == 0; });
+        current = nullptr;
+    }
+
+    // own tasks are taken from the back, stolen ones from the front
+    bool WorkStealingPool::Pop(int worker, int &task)
+    {
+        auto &q = *queues[worker];
+        std::lock_guard<std::mutex> lock(q.mu);
+        if (q.tasks.empty())
+        {
+            return false;
+        }
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool WorkStealingPool::Steal(int worker, int &task)
+    {
+        for (int i = 1; i < threads; i++)
+        {
+            auto &q = *queues[(worker + i) % threads];
+            std::lock_guard<std::mutex> lock(q.mu);
+            if (!q.tasks.empty())
+            {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // no task is added while running, so all queues empty means done
+    void WorkStealingPool::Work(int worker, const std::function<void(int, int)> &task)
+    {
+        int i;
+        while (Pop(worker, i) || Steal(worker, i))
+        {
+            task(worker, i);
+        }
+    }
+
+    // waits for each call, works it and reports back
+    void WorkStealingPool::Loop(int worker)
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mu);
+        while (true)
+        {
+            wake.wait(lock, [&] { return stop || round != seen; });
+            if (stop)
+            {
+                return;
+            }
+            seen = round;
+            auto &t = *current;
+            lock.unlock();
+            Work(worker, t);
+            lock.lock();
+            if (--busy == 0)
+            {
+                done.notify_one();
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef LILANG_COMPILER_THREAD_POOL
+#define LILANG_COMPILER_THREAD_POOL
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+namespace lilang
+{
+    // runs a fixed set of indexed tasks on a group of threads, every worker owns
+    // a deque of task indexes and steals from the others once its own runs dry.
+    // the threads start with the pool and wait between calls, so a call costs a
+    // wake up rather than a thread per worker
+    class WorkStealingPool
+    {
+    public:
+        explicit WorkStealingPool(int threads);
+        ~WorkStealingPool();
+        int Size();
+        // task(worker, index) for every index in [0, n), returns when all are done
+        // the calling thread works as worker 0, calls must not overlap
+        void ParallelFor(int n, const std::function<void(int, int)> &task);
+
+    private:
+        struct Queue
+        {
+            std::mutex mu;
+            std::deque<int> tasks;
+        };
+
+        int threads;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers; // 1 to threads - 1
+
+        std::mutex mu;
+        std::condition_variable wake; // a call started or the pool stops
+        std::condition_variable done; // the last worker finished the call
+        const std::function<void(int, int)> *current = nullptr; // of the call running
+        uint64_t round = 0; // calls started
+        int busy = 0;       // workers still in the current call
+        bool stop = false;
+
+        bool Pop(int worker, int &task);
+        bool Steal(int worker, int &task);
+        void Work(int worker, const std::function<void(int, int)> &task);
+        void Loop(int worker);
+    };
+}
+
+#endif
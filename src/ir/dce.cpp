@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <unordered_set>
+#include "./passes.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        // marks from the effects back through the operands, what is not marked goes
+        bool DCE(Function &f)
+        {
+            std::unordered_set<Instr *> live;
+            std::vector<Instr *> work;
+            for (auto &b : f.blocks)
+            {
+                for (auto in : b->instrs)
+                {
+                    if (in->HasEffects() && live.insert(in).second)
+                    {
+                        work.push_back(in);
+                    }
+                }
+            }
+            while (!work.empty())
+            {
+                auto in = work.back();
+                work.pop_back();
+                for (auto a : in->args)
+                {
+                    if (!a->IsConst() && live.insert(a).second)
+                    {
+                        work.push_back(a);
+                    }
+                }
+            }
+            bool changed = false;
+            for (auto &b : f.blocks)
+            {
+                auto &list = b->instrs;
+                auto end = std::remove_if(list.begin(), list.end(), [&](Instr *in) {
+                    if (live.count(in) != 0)
+                    {
+                        return false;
+                    }
+                    in->block = nullptr;
+                    return true;
+                });
+                changed = changed || end != list.end();
+                list.erase(end, list.end());
+            }
+            return changed;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <unordered_set>
+#include "./dominators.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        Dominators::Dominators(const Function &f)
+        {
+            // postorder with an explicit stack of blocks and their next successor
+            std::unordered_set<const Block *> seen{f.Entry()};
+            std::vector<std::pair<Block *, size_t>> stack{{f.Entry(), 0}};
+            while (!stack.empty())
+            {
+                auto &top = stack.back();
+                auto &succs = top.first->Succs();
+                if (top.second < succs.size())
+                {
+                    auto s = succs[top.second++];
+                    if (seen.insert(s).second)
+                    {
+                        stack.push_back({s, 0});
+                    }
+                    continue;
+                }
+                rpo.push_back(top.first);
+                stack.pop_back();
+            }
+            std::reverse(rpo.begin(), rpo.end());
+            for (size_t i = 0; i < rpo.size(); i++)
+            {
+                index[rpo[i]] = i;
+            }
+
+            idom.assign(rpo.size(), -1);
+            idom[0] = 0;
+            auto intersect = [&](int a, int b) {
+                while (a != b)
+                {
+                    while (a > b)
+                    {
+                        a = idom[a];
+                    }
+                    while (b > a)
+                    {
+                        b = idom[b];
+                    }
+                }
+                return a;
+            };
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                for (size_t i = 1; i < rpo.size(); i++)
+                {
+                    int d = -1;
+                    for (auto p : rpo[i]->preds)
+                    {
+                        auto it = index.find(p);
+                        if (it == index.end() || idom[it->second] < 0)
+                        {
+                            continue;
+                        }
+                        d = d < 0 ? it->second : intersect(it->second, d);
+                    }
+                    if (d != idom[i])
+                    {
+                        idom[i] = d;
+                        changed = true;
+                    }
+                }
+            }
+
+            children.resize(rpo.size());
+            for (size_t i = 1; i < rpo.size(); i++)
+            {
+                children[idom[i]].push_back(rpo[i]);
+            }
+            enter.assign(rpo.size(), 0);
+            leave.assign(rpo.size(), 0);
+            int clock = 0;
+            std::vector<std::pair<int, size_t>> walk{{0, 0}};
+            enter[0] = clock++;
+            while (!walk.empty())
+            {
+                auto &top = walk.back();
+                if (top.second < children[top.first].size())
+                {
+                    int c = index[children[top.first][top.second++]];
+                    enter[c] = clock++;
+                    walk.push_back({c, 0});
+                    continue;
+                }
+                leave[top.first] = clock++;
+                walk.pop_back();
+            }
+        }
+
+        bool Dominators::Reachable(const Block *b) const
+        {
+            return index.count(b) != 0;
+        }
+
+        Block *Dominators::Idom(const Block *b) const
+        {
+            auto it = index.find(b);
+            return it == index.end() || it->second == 0 ? nullptr : rpo[idom[it->second]];
+        }
+
+        bool Dominators::Dominates(const Block *a, const Block *b) const
+        {
+            auto x = index.find(a);
+            auto y = index.find(b);
+            if (x == index.end() || y == index.end())
+            {
+                return false;
+            }
+            return enter[x->second] <= enter[y->second] && leave[y->second] <= leave[x->second];
+        }
+
+        const std::vector<Block *> &Dominators::Children(const Block *b) const
+        {
+            static const std::vector<Block *> none;
+            auto it = index.find(b);
+            return it == index.end() ? none : children[it->second];
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LILANG_IR_DOMINATORS
+#define LILANG_IR_DOMINATORS
+
+#include "./ir.h"
+
+/*
+dominator tree of a function
+
+computed with the iterative algorithm of cooper, harvey and kennedy over
+the reverse postorder, which converges in a couple of rounds on the
+reducible graphs lowering produces. a walk of the tree numbers every block
+on entry and exit, so whether a dominates b is two compares.
+
+blocks unreachable from the entry are in no tree and dominate nothing.
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        class Dominators
+        {
+        public:
+            explicit Dominators(const Function &);
+
+            bool Reachable(const Block *) const;
+            // nullptr for the entry and unreachable blocks
+            Block *Idom(const Block *) const;
+            bool Dominates(const Block *a, const Block *b) const;
+            const std::vector<Block *> &Children(const Block *) const;
+            // reachable blocks, a block before its successors except along back edges
+            const std::vector<Block *> &ReversePostorder() const { return rpo; }
+
+        private:
+            std::vector<Block *> rpo;
+            std::unordered_map<const Block *, int> index; // in rpo
+            std::vector<int> idom;
+            std::vector<std::vector<Block *>> children;
+            std::vector<int> enter, leave; // of the tree walk, by rpo index
+        };
+    }
+}
+
+#endif
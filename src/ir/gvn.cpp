@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include "./passes.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            bool Commutative(const Instr *in)
+            {
+                switch (in->op)
+                {
+                case Op::kAdd:
+                case Op::kMul:
+                case Op::kAnd:
+                case Op::kOr:
+                case Op::kXor:
+                case Op::kEq:
+                case Op::kNe:
+                    return true;
+                default:
+                    return false;
+                }
+            }
+
+            // what makes two instructions compute the same value; a phi is only
+            // the same as a phi of its block
+            typedef std::tuple<Op, Type, int64_t, const Block *, std::vector<Instr *>> Key;
+
+            class Numbering
+            {
+            public:
+                Numbering(Function &f, const Dominators &dom) : f(f), dom(dom) {}
+
+                bool Run()
+                {
+                    // preorder of the dominator tree, a scope per block
+                    std::vector<std::pair<Block *, size_t>> walk{{f.Entry(), 0}};
+                    std::vector<std::vector<Key>> scopes{{}};
+                    Visit(f.Entry(), scopes.back());
+                    while (!walk.empty())
+                    {
+                        auto &top = walk.back();
+                        auto &children = dom.Children(top.first);
+                        if (top.second < children.size())
+                        {
+                            auto c = children[top.second++];
+                            walk.push_back({c, 0});
+                            scopes.emplace_back();
+                            Visit(c, scopes.back());
+                            continue;
+                        }
+                        for (auto &k : scopes.back())
+                        {
+                            table.erase(k);
+                        }
+                        scopes.pop_back();
+                        walk.pop_back();
+                    }
+                    f.Replace(with);
+                    return !with.empty();
+                }
+
+            private:
+                Function &f;
+                const Dominators &dom;
+                std::map<Key, Instr *> table;
+                std::unordered_map<Instr *, Instr *> with;
+
+                Instr *Resolve(Instr *in) const
+                {
+                    auto it = with.find(in);
+                    return it == with.end() ? in : it->second;
+                }
+
+                void Visit(Block *b, std::vector<Key> &scope)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        for (auto &a : in->args)
+                        {
+                            a = Resolve(a);
+                        }
+                        if (!in->IsPure() && in->op != Op::kPhi)
+                        {
+                            continue;
+                        }
+                        auto args = in->args;
+                        if (Commutative(in) && args[1]->id < args[0]->id)
+                        {
+                            std::swap(args[0], args[1]);
+                        }
+                        Key k(in->op, in->type, in->imm, in->op == Op::kPhi ? b : nullptr, args);
+                        auto it = table.find(k);
+                        if (it != table.end())
+                        {
+                            with[in] = it->second;
+                            continue;
+                        }
+                        table[k] = in;
+                        scope.push_back(k);
+                    }
+                }
+            };
+        }
+
+        bool GVN(Function &f)
+        {
+            return GVN(f, Dominators(f));
+        }
+
+        bool GVN(Function &f, const Dominators &dom)
+        {
+            return Numbering(f, dom).Run();
+        }
+    }
+}
@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <unordered_set>
+#include "./ir.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            const char *kOpNames[] = {
+                "const", "param", "add", "sub", "mul", "div", "mod", "and", "or", "xor",
+                "neg", "bitnot", "not", "eq", "ne", "lt", "le", "i2f", "f2i", "phi",
+                "getglobal", "setglobal", "call", "callv", "extract", "newarray", "getindex", "setindex", "slot", "addrglobal",
+                "addrindex", "load", "store", "jump", "br", "ret",
+            };
+            static_assert(sizeof(kOpNames) / sizeof(kOpNames[0]) == static_cast<size_t>(Op::kCount), "a name per op");
+
+            const char *kTypeNames[] = {"void", "bool", "i64", "f64", "ref", "tuple"};
+
+            int64_t Bits(double f)
+            {
+                int64_t i;
+                std::memcpy(&i, &f, sizeof(i));
+                return i;
+            }
+
+            // the text of a value where it is used
+            class Namer
+            {
+            public:
+                explicit Namer(const Function &f)
+                {
+                    for (size_t i = 0; i < f.blocks.size(); i++)
+                    {
+                        blocks[f.blocks[i].get()] = i;
+                        for (auto in : f.blocks[i]->instrs)
+                        {
+                            if (in->type != Type::kVoid)
+                            {
+                                size_t n = values.size();
+                                values[in] = n;
+                            }
+                        }
+                    }
+                }
+
+                string_t Block(const ir::Block *b) const
+                {
+                    auto it = blocks.find(b);
+                    return it == blocks.end() ? "b?" : "b" + std::to_string(it->second);
+                }
+
+                string_t Value(const Instr *in) const
+                {
+                    if (!in->IsConst())
+                    {
+                        auto it = values.find(in);
+                        return it == values.end() ? "%?" : "%" + std::to_string(it->second);
+                    }
+                    switch (in->type)
+                    {
+                    case Type::kI64:
+                        return std::to_string(in->imm);
+                    case Type::kF64:
+                        return FloatText(in->F());
+                    case Type::kBool:
+                        return in->imm ? "true" : "false";
+                    default:
+                        if (in->str != nullptr)
+                        {
+                            return Quote(*in->str);
+                        }
+                        if (in->fn != nullptr)
+                        {
+                            return "@" + in->fn->name;
+                        }
+                        return "nil";
+                    }
+                }
+
+                static string_t FloatText(double f)
+                {
+                    if (std::isnan(f))
+                    {
+                        return "nan";
+                    }
+                    if (std::isinf(f))
+                    {
+                        return f < 0 ? "-inf" : "inf";
+                    }
+                    stringstream_t ss;
+                    ss << std::setprecision(17) << f;
+                    auto s = ss.str();
+                    if (s.find_first_of(".e") == string_t::npos)
+                    {
+                        s += ".0";
+                    }
+                    return s;
+                }
+
+                static string_t Quote(const string_t &s)
+                {
+                    string_t q = "\"";
+                    for (auto c : s)
+                    {
+                        if (c == '"' || c == '\\')
+                        {
+                            q += '\\';
+                            q += c;
+                        }
+                        else if (c == '\n')
+                        {
+                            q += "\\n";
+                        }
+                        else
+                        {
+                            q += c;
+                        }
+                    }
+                    return q + "\"";
+                }
+
+            private:
+                std::unordered_map<const ir::Block *, size_t> blocks;
+                std::unordered_map<const Instr *, size_t> values;
+            };
+
+            string_t TypeText(const Instr *in)
+            {
+                if (in->type != Type::kTuple)
+                {
+                    return TypeName(in->type);
+                }
+                string_t s = "(";
+                for (size_t i = 0; i < in->results.size(); i++)
+                {
+                    s += (i ? ", " : "") + string_t(TypeName(in->results[i]));
+                }
+                return s + ")";
+            }
+
+            void PrintInstr(std::ostream &os, const Namer &n, const Instr *in)
+            {
+                os << "    ";
+                if (in->type != Type::kVoid)
+                {
+                    os << n.Value(in) << " = ";
+                }
+                os << OpName(in->op);
+                auto list = [&](size_t from) {
+                    for (size_t i = from; i < in->args.size(); i++)
+                    {
+                        os << (i > from ? ", " : "") << n.Value(in->args[i]);
+                    }
+                };
+                switch (in->op)
+                {
+                case Op::kParam:
+                case Op::kGetGlobal:
+                case Op::kAddrGlobal:
+                    os << " " << TypeName(in->type) << " " << (in->op == Op::kParam ? "" : "g") << in->imm;
+                    break;
+                case Op::kSetGlobal:
+                    os << " g" << in->imm << ", " << n.Value(in->args[0]);
+                    break;
+                case Op::kEq:
+                case Op::kNe:
+                case Op::kLt:
+                case Op::kLe:
+                    os << " " << TypeName(in->args[0]->type) << " ";
+                    list(0);
+                    break;
+                case Op::kCall:
+                    os << " " << TypeText(in) << " @" << in->fn->name << "(";
+                    list(0);
+                    os << ")";
+                    break;
+                case Op::kCallValue:
+                    os << " " << TypeText(in) << " " << n.Value(in->args[0]) << "(";
+                    list(1);
+                    os << ")";
+                    break;
+                case Op::kExtract:
+                    os << " " << TypeName(in->type) << " " << n.Value(in->args[0]) << ", " << in->imm;
+                    break;
+                case Op::kPhi:
+                    os << " " << TypeName(in->type);
+                    for (size_t i = 0; i < in->args.size(); i++)
+                    {
+                        os << (i ? ", [" : " [") << n.Value(in->args[i]) << ", "
+                           << (i < in->block->preds.size() ? n.Block(in->block->preds[i]) : "b?") << "]";
+                    }
+                    break;
+                case Op::kAddrIndex:
+                    os << " " << TypeName(in->type) << " ";
+                    list(0);
+                    if (in->imm)
+                    {
+                        os << ", nocreate";
+                    }
+                    break;
+                case Op::kStore:
+                case Op::kRet:
+                    if (!in->args.empty())
+                    {
+                        os << " ";
+                        list(0);
+                    }
+                    break;
+                case Op::kJump:
+                    os << " " << n.Block(in->targets[0]);
+                    break;
+                case Op::kBranch:
+                    os << " " << n.Value(in->args[0]) << ", " << n.Block(in->targets[0]) << ", "
+                       << n.Block(in->targets[1]);
+                    break;
+                default:
+                    os << " " << TypeName(in->type);
+                    if (!in->args.empty())
+                    {
+                        os << " ";
+                        list(0);
+                    }
+                }
+                os << std::endl;
+            }
+        }
+
+        //********************************************************************
+        // instructions and blocks
+        //********************************************************************
+
+        double Instr::F() const
+        {
+            double f;
+            std::memcpy(&f, &imm, sizeof(f));
+            return f;
+        }
+
+        bool Instr::HasEffects() const
+        {
+            switch (op)
+            {
+            case Op::kDiv:
+            case Op::kMod:
+                // an int divisor other than a constant may be zero
+                return type == Type::kI64 && !(args[1]->IsConst() && args[1]->imm != 0);
+            case Op::kF2I:
+                return !(args[0]->IsConst() && args[0]->F() > -9223372036854775808.0 &&
+                         args[0]->F() < 9223372036854775808.0);
+            case Op::kParam:
+            case Op::kSetGlobal:
+            case Op::kCall:
+            case Op::kCallValue:
+            case Op::kGetIndex:
+            case Op::kSetIndex:
+            case Op::kAddrIndex:
+            case Op::kLoad:
+            case Op::kStore:
+            case Op::kJump:
+            case Op::kBranch:
+            case Op::kRet:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        bool Instr::IsPure() const
+        {
+            switch (op)
+            {
+            case Op::kConst:
+            case Op::kAdd:
+            case Op::kSub:
+            case Op::kMul:
+            case Op::kDiv:
+            case Op::kMod:
+            case Op::kAnd:
+            case Op::kOr:
+            case Op::kXor:
+            case Op::kNeg:
+            case Op::kBitNot:
+            case Op::kNot:
+            case Op::kEq:
+            case Op::kNe:
+            case Op::kLt:
+            case Op::kLe:
+            case Op::kI2F:
+            case Op::kF2I:
+            case Op::kExtract:
+            case Op::kAddrGlobal:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        const std::vector<Block *> &Block::Succs() const
+        {
+            static const std::vector<Block *> none;
+            auto t = Terminator();
+            return t == nullptr ? none : t->targets;
+        }
+
+        size_t Block::PredIndex(const Block *b) const
+        {
+            return std::find(preds.begin(), preds.end(), b) - preds.begin();
+        }
+
+        //********************************************************************
+        // functions
+        //********************************************************************
+
+        Block *Function::NewBlock()
+        {
+            blocks.emplace_back(new Block());
+            blocks.back()->id = next_block++;
+            return blocks.back().get();
+        }
+
+        Instr *Function::New(Op op, Type type, std::vector<Instr *> args)
+        {
+            pool.emplace_back();
+            auto in = &pool.back();
+            in->op = op;
+            in->type = type;
+            in->args = std::move(args);
+            in->id = next_instr++;
+            return in;
+        }
+
+        Instr *Function::Const(Type t, int64_t bits)
+        {
+            auto in = New(Op::kConst, t);
+            in->imm = bits;
+            return in;
+        }
+
+        Instr *Function::Int(int64_t i)
+        {
+            auto &in = ints[i];
+            return in != nullptr ? in : in = Const(Type::kI64, i);
+        }
+
+        Instr *Function::Float(double f)
+        {
+            auto &in = floats[Bits(f)];
+            return in != nullptr ? in : in = Const(Type::kF64, Bits(f));
+        }
+
+        Instr *Function::Bool(bool b)
+        {
+            auto &in = bools[b];
+            return in != nullptr ? in : in = Const(Type::kBool, b);
+        }
+
+        Instr *Function::Nil()
+        {
+            return nil != nullptr ? nil : nil = Const(Type::kRef, 0);
+        }
+
+        Instr *Function::String(const string_t *s)
+        {
+            auto &in = refs[s];
+            if (in == nullptr)
+            {
+                in = Const(Type::kRef, 0);
+                in->str = s;
+            }
+            return in;
+        }
+
+        Instr *Function::FuncRef(Function *f)
+        {
+            auto &in = refs[f];
+            if (in == nullptr)
+            {
+                in = Const(Type::kRef, 0);
+                in->fn = f;
+            }
+            return in;
+        }
+
+        Instr *Function::Zero(Type t)
+        {
+            switch (t)
+            {
+            case Type::kI64:
+                return Int(0);
+            case Type::kF64:
+                return Float(0);
+            case Type::kBool:
+                return Bool(false);
+            default:
+                return Nil();
+            }
+        }
+
+        Instr *Function::Append(Block *b, Instr *in)
+        {
+            in->block = b;
+            if (b->Terminator() != nullptr && !in->IsTerminator())
+            {
+                b->instrs.insert(b->instrs.end() - 1, in);
+            }
+            else
+            {
+                b->instrs.push_back(in);
+            }
+            return in;
+        }
+
+        Instr *Function::InsertPhi(Block *b, Type t)
+        {
+            auto phi = New(Op::kPhi, t);
+            phi->block = b;
+            auto at = b->instrs.begin();
+            while (at != b->instrs.end() && (*at)->op == Op::kPhi)
+            {
+                ++at;
+            }
+            b->instrs.insert(at, phi);
+            return phi;
+        }
+
+        void Function::Replace(const std::unordered_map<Instr *, Instr *> &with)
+        {
+            if (with.empty())
+            {
+                return;
+            }
+            auto resolve = [&](Instr *in) {
+                for (auto it = with.find(in); it != with.end() && it->second != in; it = with.find(in))
+                {
+                    in = it->second;
+                }
+                return in;
+            };
+            for (auto &b : blocks)
+            {
+                for (auto in : b->instrs)
+                {
+                    for (auto &a : in->args)
+                    {
+                        a = resolve(a);
+                    }
+                }
+            }
+            for (auto &r : with)
+            {
+                if (r.first->block != nullptr && r.first != r.second)
+                {
+                    Remove(r.first);
+                }
+            }
+        }
+
+        void Function::Remove(Instr *in)
+        {
+            auto &list = in->block->instrs;
+            list.erase(std::find(list.begin(), list.end(), in));
+            in->block = nullptr;
+        }
+
+        void Function::RemovePred(Block *b, Block *pred)
+        {
+            size_t i = b->PredIndex(pred);
+            if (i == b->preds.size())
+            {
+                return;
+            }
+            b->preds.erase(b->preds.begin() + i);
+            for (auto in : b->instrs)
+            {
+                if (in->op != Op::kPhi)
+                {
+                    break;
+                }
+                in->args.erase(in->args.begin() + i);
+            }
+        }
+
+        bool Function::RemoveUnreachable()
+        {
+            std::unordered_set<Block *> reached{Entry()};
+            std::vector<Block *> work{Entry()};
+            while (!work.empty())
+            {
+                auto b = work.back();
+                work.pop_back();
+                for (auto s : b->Succs())
+                {
+                    if (reached.insert(s).second)
+                    {
+                        work.push_back(s);
+                    }
+                }
+            }
+            if (reached.size() == blocks.size())
+            {
+                return false;
+            }
+            for (auto &b : blocks)
+            {
+                if (reached.count(b.get()) == 0)
+                {
+                    for (auto s : b->Succs())
+                    {
+                        RemovePred(s, b.get());
+                    }
+                    for (auto in : b->instrs)
+                    {
+                        in->block = nullptr;
+                    }
+                }
+            }
+            blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                        [&](const std::unique_ptr<Block> &b) { return reached.count(b.get()) == 0; }),
+                         blocks.end());
+            return true;
+        }
+
+        size_t Function::Size() const
+        {
+            size_t n = 0;
+            for (auto &b : blocks)
+            {
+                n += b->instrs.size();
+            }
+            return n;
+        }
+
+        Function *Module::Find(const string_t &name)
+        {
+            for (auto &f : functions)
+            {
+                if (f.name == name && &f != init)
+                {
+                    return &f;
+                }
+            }
+            return nullptr;
+        }
+
+        size_t Module::Size() const
+        {
+            size_t n = 0;
+            for (auto &f : functions)
+            {
+                n += f.Size();
+            }
+            return n;
+        }
+
+        void Copy(const Function &from, Function &to, std::unordered_map<const Instr *, Instr *> &map,
+                  const std::unordered_map<const Function *, Function *> &fns)
+        {
+            auto callee = [&](Function *f) {
+                auto it = fns.find(f);
+                return it != fns.end() ? it->second : f;
+            };
+            // an operand may be copied before its definition, a phi reads values of later blocks
+            auto copy = [&](const Instr *in) {
+                auto &c = map[in];
+                if (c != nullptr)
+                {
+                    return c;
+                }
+                if (!in->IsConst())
+                {
+                    return c = to.New(in->op, in->type);
+                }
+                switch (in->type)
+                {
+                case Type::kI64:
+                    return c = to.Int(in->imm);
+                case Type::kF64:
+                    return c = to.Float(in->F());
+                case Type::kBool:
+                    return c = to.Bool(in->imm != 0);
+                default:
+                    return c = in->str != nullptr  ? to.String(in->str)
+                               : in->fn != nullptr ? to.FuncRef(callee(in->fn))
+                                                   : to.Nil();
+                }
+            };
+            to.params = from.params;
+            to.returns = from.returns;
+            std::unordered_map<const Block *, Block *> blocks;
+            for (auto &b : from.blocks)
+            {
+                blocks[b.get()] = to.NewBlock();
+            }
+            for (auto &b : from.blocks)
+            {
+                auto nb = blocks[b.get()];
+                for (auto p : b->preds)
+                {
+                    nb->preds.push_back(blocks[p]);
+                }
+                for (auto in : b->instrs)
+                {
+                    auto c = copy(in);
+                    c->imm = in->imm;
+                    c->str = in->str;
+                    c->fn = in->fn == nullptr ? nullptr : callee(in->fn);
+                    c->results = in->results;
+                    c->pos = in->pos;
+                    for (auto a : in->args)
+                    {
+                        c->args.push_back(copy(a));
+                    }
+                    for (auto t : in->targets)
+                    {
+                        c->targets.push_back(blocks[t]);
+                    }
+                    c->block = nb;
+                    nb->instrs.push_back(c);
+                }
+            }
+        }
+
+        const char *OpName(Op op)
+        {
+            return kOpNames[static_cast<int>(op)];
+        }
+
+        const char *TypeName(Type t)
+        {
+            return kTypeNames[static_cast<int>(t)];
+        }
+
+        //********************************************************************
+        // text form
+        //********************************************************************
+
+        void Print(std::ostream &os, const Function &f)
+        {
+            Namer n(f);
+            os << "fn " << f.name << "(";
+            for (size_t i = 0; i < f.params.size(); i++)
+            {
+                os << (i ? ", " : "") << TypeName(f.params[i]);
+            }
+            os << ") ";
+            if (f.returns.size() == 1)
+            {
+                os << TypeName(f.returns[0]);
+            }
+            else if (f.returns.empty())
+            {
+                os << "void";
+            }
+            else
+            {
+                os << "(";
+                for (size_t i = 0; i < f.returns.size(); i++)
+                {
+                    os << (i ? ", " : "") << TypeName(f.returns[i]);
+                }
+                os << ")";
+            }
+            os << " {" << std::endl;
+            for (auto &b : f.blocks)
+            {
+                os << n.Block(b.get()) << ":";
+                for (size_t i = 0; i < b->preds.size(); i++)
+                {
+                    os << (i ? ", " : "    ; preds ") << n.Block(b->preds[i]);
+                }
+                os << std::endl;
+                for (auto in : b->instrs)
+                {
+                    PrintInstr(os, n, in);
+                }
+            }
+            os << "}" << std::endl;
+        }
+
+        void Print(std::ostream &os, const Module &m)
+        {
+            if (!m.globals.empty())
+            {
+                os << "globals";
+                for (size_t i = 0; i < m.globals.size(); i++)
+                {
+                    os << (i ? ", " : " ") << TypeName(m.globals[i]);
+                }
+                os << std::endl
+                   << std::endl;
+            }
+            for (auto &f : m.functions)
+            {
+                Print(os, f);
+                os << std::endl;
+            }
+        }
+    }
+}
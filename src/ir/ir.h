@@ -0,0 +1,210 @@
+#ifndef LILANG_IR_IR
+#define LILANG_IR_IR
+
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "../compiler/diagnostics.h"
+
+/*
+typed ssa intermediate representation
+
+a function is a list of basic blocks, the first one is the entry. a block
+holds its phis first and ends with exactly one terminator: jump, br or ret.
+every instruction defines at most one value and names the instructions it
+uses directly, there are no variables: a local assigned in two branches
+meets again in a phi whose operands follow the order of the predecessors.
+
+values are typed i64, f64, bool or ref. ref is any pointer sized cell the
+optimizer does not look into: strings, arrays, pointers and functions.
+arithmetic takes the type of its result, compares the type of their
+operands, so nothing is decided at run time.
+
+constants are instructions too, but they are owned by the function, live in
+no block and are printed in place of their uses. locals whose address is
+taken stay in memory: a slot in the entry block read with load and written
+with store.
+
+the text form is what Print writes and Parse reads, so a pass can be tested
+on a function written by hand:
+
+    fn abs(i64) i64 {
+    b0:
+        %0 = param i64 0
+        %1 = lt i64 %0, 0
+        br %1, b1, b2
+    b1:
+        %2 = neg i64 %0
+        ret %2
+    b2:
+        ret %0
+    }
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        enum class Type : uint8_t
+        {
+            kVoid,
+            kBool,
+            kI64,
+            kF64,
+            kRef,
+            kTuple, // the results of a call returning more than one value
+        };
+
+        enum class Op : uint8_t
+        {
+            kConst,
+            kParam, // imm is the index
+            kAdd,
+            kSub,
+            kMul,
+            kDiv, // traps on an int division by zero
+            kMod,
+            kAnd,
+            kOr,
+            kXor,
+            kNeg,
+            kBitNot,
+            kNot,
+            kEq,
+            kNe,
+            kLt,
+            kLe,
+            kI2F,
+            kF2I, // traps out of the int range
+            kPhi,
+            kGetGlobal, // imm is the global
+            kSetGlobal,
+            kCall,      // fn is the callee
+            kCallValue, // the callee is the first operand
+            kExtract,   // result imm of a call
+            kNewArray,
+            kGetIndex, // array, index
+            kSetIndex, // array, index, value; the array, created when nil
+            kSlot,     // a cell of the frame, in the entry block
+            kAddrGlobal,
+            kAddrIndex, // pointer to an array, index; imm 1 does not create a nil array
+            kLoad,
+            kStore,
+            kJump,
+            kBranch,
+            kRet,
+            kCount,
+        };
+
+        struct Block;
+        struct Function;
+
+        struct Instr
+        {
+            Op op;
+            Type type;
+            std::vector<Instr *> args;
+            int64_t imm = 0;                  // the bits of a constant, an index or a flag
+            const string_t *str = nullptr;    // a string constant
+            Function *fn = nullptr;           // a function constant, the callee of kCall
+            std::vector<Type> results;        // of a call returning a tuple
+            std::vector<Block *> targets;     // of a terminator
+            Block *block = nullptr;           // nullptr for constants and removed instructions
+            std::pair<int, int> pos{0, 0};    // row and column of what a trap reports
+            int id = 0;                       // in order of creation, printing renumbers
+
+            double F() const;
+            bool IsConst() const { return op == Op::kConst; }
+            bool IsTerminator() const { return op == Op::kJump || op == Op::kBranch || op == Op::kRet; }
+            // may trap, write memory or call, is not removed when unused
+            bool HasEffects() const;
+            // the same operands always give the same value, ignoring traps
+            bool IsPure() const;
+        };
+
+        struct Block
+        {
+            int id = 0;
+            std::vector<Instr *> instrs;
+            std::vector<Block *> preds; // the order of the phi operands
+
+            Instr *Terminator() const { return instrs.empty() || !instrs.back()->IsTerminator() ? nullptr : instrs.back(); }
+            const std::vector<Block *> &Succs() const;
+            size_t PredIndex(const Block *) const;
+        };
+
+        struct Function
+        {
+            string_t name;
+            std::vector<Type> params;
+            std::vector<Type> returns;
+            std::vector<std::unique_ptr<Block>> blocks; // the first is the entry
+
+            Block *Entry() const { return blocks.front().get(); }
+            Block *NewBlock();
+            // a new instruction, not yet in a block
+            Instr *New(Op, Type, std::vector<Instr *> args = {});
+            Instr *Int(int64_t);
+            Instr *Float(double);
+            Instr *Bool(bool);
+            Instr *Nil();
+            Instr *String(const string_t *);
+            Instr *FuncRef(Function *);
+            Instr *Zero(Type);
+            // appends to b, before its terminator if it has one and in is not one
+            Instr *Append(Block *b, Instr *in);
+            Instr *InsertPhi(Block *b, Type);
+
+            // every use of a key is changed to its value, chains are followed
+            void Replace(const std::unordered_map<Instr *, Instr *> &);
+            // drops the instructions that are not in a block anymore
+            void Remove(Instr *);
+            // unreachable blocks are removed along with their phi operands
+            bool RemoveUnreachable();
+            // drops the phi operands of pred in b, and pred from its preds
+            void RemovePred(Block *b, Block *pred);
+            size_t Size() const; // instructions in blocks
+
+        private:
+            std::deque<Instr> pool;
+            std::unordered_map<int64_t, Instr *> ints, floats;
+            std::unordered_map<const void *, Instr *> refs;
+            Instr *bools[2] = {nullptr, nullptr};
+            Instr *nil = nullptr;
+            int next_block = 0;
+            int next_instr = 0;
+
+            Instr *Const(Type, int64_t bits);
+        };
+
+        struct Module
+        {
+            std::deque<Function> functions;
+            Function *init = nullptr; // initializes the globals
+            std::vector<Type> globals;
+            std::deque<string_t> strings;
+
+            Function *Find(const string_t &name);
+            size_t Size() const;
+        };
+
+        const char *OpName(Op);
+        const char *TypeName(Type);
+
+        // the text form, values and blocks are numbered in order
+        void Print(std::ostream &, const Function &);
+        void Print(std::ostream &, const Module &);
+        // reads what Print writes, errors are reported at their row and column
+        bool Parse(const string_t &text, Module &, compiler::Diagnostics &);
+        // checks the invariants every pass keeps, reports what breaks them
+        bool Verify(const Function &, compiler::Diagnostics &);
+        bool Verify(const Module &, compiler::Diagnostics &);
+        // copies the params, results and blocks of from to to, which has no blocks yet; map gets
+        // the copy of each instruction, and a callee or function value found in fns is changed
+        void Copy(const Function &from, Function &to, std::unordered_map<const Instr *, Instr *> &map,
+                  const std::unordered_map<const Function *, Function *> &fns = {});
+    }
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include "./liveness.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            void Set(std::vector<uint64_t> &bits, size_t i) { bits[i / 64] |= uint64_t(1) << (i % 64); }
+            void Clear(std::vector<uint64_t> &bits, size_t i) { bits[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+            bool Has(const std::vector<uint64_t> &bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+        }
+
+        Liveness::Liveness(const Function &f)
+        {
+            for (auto &b : f.blocks)
+            {
+                size_t n = blocks.size();
+                blocks[b.get()] = n;
+                for (auto in : b->instrs)
+                {
+                    if (in->type != Type::kVoid)
+                    {
+                        index[in] = values.size();
+                        values.push_back(in);
+                    }
+                }
+            }
+            size_t words = (values.size() + 63) / 64;
+            live_in.assign(f.blocks.size(), Bits(words, 0));
+            live_out.assign(f.blocks.size(), Bits(words, 0));
+
+            // uses of values from other blocks, and the phi operands each block passes on
+            std::vector<Bits> gen(f.blocks.size(), Bits(words, 0));
+            std::vector<Bits> passes(f.blocks.size(), Bits(words, 0));
+            for (auto &e : f.blocks)
+            {
+                auto b = e.get();
+                for (auto in : b->instrs)
+                {
+                    for (size_t i = 0; i < in->args.size(); i++)
+                    {
+                        auto a = in->args[i];
+                        if (a->IsConst())
+                        {
+                            continue;
+                        }
+                        if (in->op == Op::kPhi)
+                        {
+                            Set(passes[blocks[b->preds[i]]], index[a]);
+                        }
+                        else if (a->block != b)
+                        {
+                            Set(gen[blocks[b]], index[a]);
+                        }
+                    }
+                }
+            }
+
+            // backward over the blocks until no set grows
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                for (size_t i = f.blocks.size(); i-- > 0;)
+                {
+                    auto b = f.blocks[i].get();
+                    Bits live = passes[i];
+                    for (auto s : b->Succs())
+                    {
+                        auto &from = live_in[blocks[s]];
+                        for (size_t w = 0; w < words; w++)
+                        {
+                            live[w] |= from[w];
+                        }
+                    }
+                    live_out[i] = live;
+                    for (auto in : b->instrs)
+                    {
+                        if (in->type != Type::kVoid)
+                        {
+                            Clear(live, index[in]);
+                        }
+                    }
+                    for (size_t w = 0; w < words; w++)
+                    {
+                        live[w] |= gen[i][w];
+                    }
+                    if (live != live_in[i])
+                    {
+                        live_in[i] = live;
+                        changed = true;
+                    }
+                }
+            }
+
+            // the live values at each instruction, walking every block backward
+            for (auto &e : f.blocks)
+            {
+                auto b = e.get();
+                Bits live = live_out[blocks[b]];
+                size_t count = 0;
+                for (auto w : live)
+                {
+                    count += __builtin_popcountll(w);
+                }
+                pressure = std::max(pressure, count);
+                for (size_t i = b->instrs.size(); i-- > 0;)
+                {
+                    auto in = b->instrs[i];
+                    if (in->op == Op::kPhi)
+                    {
+                        break;
+                    }
+                    if (in->type != Type::kVoid && Has(live, index[in]))
+                    {
+                        Clear(live, index[in]);
+                        count--;
+                    }
+                    for (auto a : in->args)
+                    {
+                        if (!a->IsConst() && !Has(live, index[a]))
+                        {
+                            Set(live, index[a]);
+                            count++;
+                        }
+                    }
+                    pressure = std::max(pressure, count);
+                }
+            }
+        }
+
+        bool Liveness::Test(const Bits &bits, const Instr *in) const
+        {
+            auto it = index.find(in);
+            return it != index.end() && Has(bits, it->second);
+        }
+
+        bool Liveness::LiveIn(const Block *b, const Instr *in) const
+        {
+            return Test(live_in[blocks.at(b)], in);
+        }
+
+        bool Liveness::LiveOut(const Block *b, const Instr *in) const
+        {
+            return Test(live_out[blocks.at(b)], in);
+        }
+
+        std::vector<Instr *> Liveness::LiveIn(const Block *b) const
+        {
+            return List(live_in[blocks.at(b)]);
+        }
+
+        std::vector<Instr *> Liveness::LiveOut(const Block *b) const
+        {
+            return List(live_out[blocks.at(b)]);
+        }
+
+        std::vector<Instr *> Liveness::List(const Bits &bits) const
+        {
+            std::vector<Instr *> live;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                if (Has(bits, i))
+                {
+                    live.push_back(values[i]);
+                }
+            }
+            return live;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef LILANG_IR_LIVENESS
+#define LILANG_IR_LIVENESS
+
+#include "./ir.h"
+
+/*
+values live at the boundaries of the blocks of a function
+
+a value is live where a later use may still read it. a phi reads its
+operand at the end of the matching predecessor, not in its own block, so
+that operand is live out of the predecessor only, and the phi itself is
+defined where its block starts. constants are never live, they are not
+held anywhere.
+
+the sets are bit vectors over the values of the function, solved backward
+until nothing changes. the most values live at one point bounds the
+registers a backend needs to keep the function out of memory.
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        class Liveness
+        {
+        public:
+            explicit Liveness(const Function &);
+
+            bool LiveIn(const Block *, const Instr *) const;
+            bool LiveOut(const Block *, const Instr *) const;
+            // in order of definition
+            std::vector<Instr *> LiveIn(const Block *) const;
+            std::vector<Instr *> LiveOut(const Block *) const;
+            // the most values live at once
+            size_t MaxPressure() const { return pressure; }
+
+        private:
+            typedef std::vector<uint64_t> Bits;
+
+            std::vector<Instr *> values;
+            std::unordered_map<const Instr *, size_t> index; // in values
+            std::unordered_map<const Block *, size_t> blocks;
+            std::vector<Bits> live_in, live_out;
+            size_t pressure = 0;
+
+            bool Test(const Bits &, const Instr *) const;
+            std::vector<Instr *> List(const Bits &) const;
+        };
+    }
+}
+
+#endif
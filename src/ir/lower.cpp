@@ -0,0 +1,1202 @@
+#include <algorithm>
+#include "./lower.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        using compiler::CodeType;
+
+        namespace
+        {
+            bool IsInt(ast::Type::Ptr t) { return t->kind == ast::Type::Kind::kInt; }
+            bool IsFloat(ast::Type::Ptr t) { return t->kind == ast::Type::Kind::kFloat; }
+
+            ast::Expr *Unparen(ast::Expr *e)
+            {
+                while (e->node_kind == ast::NodeKind::kParenExpr)
+                {
+                    e = static_cast<ast::ParenExpr *>(e)->expr.get();
+                }
+                return e;
+            }
+
+            uint64_t MemoryKey(const ast::FuncLit *lit, int slot)
+            {
+                return static_cast<uint64_t>(lit->node_id) << 32 | static_cast<uint32_t>(slot);
+            }
+
+            // the ir form of an operator, kCount if there is none
+            Op OpOf(CodeType t)
+            {
+                switch (t)
+                {
+                case CodeType::kAdd:
+                case CodeType::kAddAssign:
+                    return Op::kAdd;
+                case CodeType::kSub:
+                case CodeType::kSubAssign:
+                    return Op::kSub;
+                case CodeType::kMultiply:
+                case CodeType::kMulAssign:
+                    return Op::kMul;
+                case CodeType::kDivide:
+                case CodeType::kDivAssign:
+                    return Op::kDiv;
+                case CodeType::kMod:
+                    return Op::kMod;
+                case CodeType::kBitsAnd:
+                case CodeType::kBitsAndAssign:
+                    return Op::kAnd;
+                case CodeType::kBitsOr:
+                case CodeType::kBitsOrAssign:
+                    return Op::kOr;
+                case CodeType::kBitsXor:
+                case CodeType::kBitsXorAssign:
+                    return Op::kXor;
+                case CodeType::kEqual:
+                    return Op::kEq;
+                case CodeType::kNotEqual:
+                    return Op::kNe;
+                case CodeType::kLess:
+                case CodeType::kGreater:
+                    return Op::kLt;
+                case CodeType::kNotGreater:
+                case CodeType::kNotLess:
+                    return Op::kLe;
+                default:
+                    return Op::kCount;
+                }
+            }
+
+            bool FloatOp(Op op)
+            {
+                return op == Op::kAdd || op == Op::kSub || op == Op::kMul || op == Op::kDiv || op == Op::kEq ||
+                       op == Op::kNe || op == Op::kLt || op == Op::kLe;
+            }
+
+            // finds the locals that must have an address, the same places the
+            // emitter asks for one
+            class MemoryMarker final : public ast::StaticWalker<MemoryMarker>
+            {
+            public:
+                MemoryMarker(const ast::Annotations &a, std::unordered_set<uint64_t> &out) : annots(a), marked(out) {}
+
+                void Pre(ast::Node *n)
+                {
+                    if (n->node_kind == ast::NodeKind::kUnaryExpr &&
+                        static_cast<ast::UnaryExpr *>(n)->op == CodeType::kBitsAnd)
+                    {
+                        Chain(static_cast<ast::UnaryExpr *>(n)->expr.get());
+                    }
+                    if (n->node_kind != ast::NodeKind::kAssignStmt)
+                    {
+                        return;
+                    }
+                    auto s = static_cast<ast::AssignStmt *>(n);
+                    for (auto &l : s->lhs)
+                    {
+                        auto e = Unparen(l.get());
+                        if (e->node_kind == ast::NodeKind::kIdent)
+                        {
+                            continue;
+                        }
+                        if (s->op == CodeType::kAssign && e->node_kind == ast::NodeKind::kIndexExpr &&
+                            IsLocal(static_cast<ast::IndexExpr *>(e)->operand.get()))
+                        {
+                            continue; // written with setindex
+                        }
+                        Chain(e);
+                    }
+                }
+
+            private:
+                const ast::Annotations &annots;
+                std::unordered_set<uint64_t> &marked;
+
+                static bool IsLocal(ast::Expr *e)
+                {
+                    e = Unparen(e);
+                    return e->node_kind == ast::NodeKind::kIdent &&
+                           static_cast<ast::Ident *>(e)->storage.kind == ast::Storage::Kind::kLocal;
+                }
+
+                // the local at the base of an address
+                void Chain(ast::Expr *e)
+                {
+                    e = Unparen(e);
+                    if (e->node_kind == ast::NodeKind::kIdent)
+                    {
+                        auto &s = static_cast<ast::Ident *>(e)->storage;
+                        if (s.kind == ast::Storage::Kind::kLocal && s.func != nullptr)
+                        {
+                            marked.insert(MemoryKey(s.func, s.index));
+                        }
+                    }
+                    else if (e->node_kind == ast::NodeKind::kIndexExpr)
+                    {
+                        auto operand = static_cast<ast::IndexExpr *>(e)->operand.get();
+                        if (ast::Obj::Addressable(annots.KindOf(operand)))
+                        {
+                            Chain(operand);
+                        }
+                    }
+                }
+            };
+        }
+
+        Lowering::Lowering(compiler::Diagnostics &d) : diag(d) {}
+
+        void Lowering::Unsupported(ast::Node *n, const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kIr, n->row_number, n->column_number, msg);
+            if (rejected.count(s.f) == 0)
+            {
+                rejected[s.f] = {compiler::Phase::kIr, n->row_number, n->column_number, msg};
+            }
+            ok = false;
+        }
+
+        Type Lowering::IrType(ast::Type::Ptr t)
+        {
+            switch (t->kind)
+            {
+            case ast::Type::Kind::kInt:
+                return Type::kI64;
+            case ast::Type::Kind::kFloat:
+                return Type::kF64;
+            case ast::Type::Kind::kBool:
+                return Type::kBool;
+            case ast::Type::Kind::kTuple:
+                return Type::kTuple;
+            default:
+                return Type::kRef;
+            }
+        }
+
+        bool Lowering::Lower(const ast::File::Ptr &file, ast::SemanticVisitor &v, Module &m)
+        {
+            annots = &v.Annots();
+            constants = &v.Constants();
+            module = &m;
+            ok = true;
+            in_memory.clear();
+            MemoryMarker(*annots, in_memory).Walk(file.get());
+            m.globals.assign(file->global_count, Type::kI64);
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind != ast::NodeKind::kVarDecl)
+                {
+                    continue;
+                }
+                auto var = static_cast<ast::VarDecl *>(decl.get());
+                for (size_t i = 0; i < var->names.size(); i++)
+                {
+                    auto t = var->type != nullptr                  ? TypeOf(var->type.get())
+                             : var->vals.size() == var->names.size() ? TypeOf(var->vals[i].get())
+                                                                     : TypeOf(var->vals[0].get())->Vals()[i];
+                    m.globals[var->first_slot + i] = IrType(t);
+                }
+            }
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    auto lit = static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get();
+                    Declare(lit, lit->name);
+                }
+            }
+            m.functions.emplace_back();
+            m.init = &m.functions.back();
+            m.init->name = "<init>";
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    auto lit = static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get();
+                    Body(by_lit[lit], lit, nullptr);
+                }
+            }
+            // the global initializers go to one function, in order
+            Body(m.init, nullptr, &file->declarations);
+            annots = nullptr;
+            constants = nullptr;
+            module = nullptr;
+            return ok;
+        }
+
+        Function *Lowering::Declare(ast::FuncLit *lit, const string_t &name)
+        {
+            auto t = TypeOf(lit);
+            module->functions.emplace_back();
+            auto f = &module->functions.back();
+            f->name = name;
+            for (auto p : t->Params())
+            {
+                f->params.push_back(IrType(p));
+            }
+            for (auto r : t->Returns())
+            {
+                f->returns.push_back(IrType(r));
+            }
+            by_lit[lit] = f;
+            return f;
+        }
+
+        void Lowering::Body(Function *f, ast::FuncLit *lit, const ast::Decl::List *globals)
+        {
+            State saved;
+            std::swap(s, saved);
+            auto saved_at = at;
+            s.f = f;
+            s.lit = lit;
+            s.block = NewBlock();
+            Seal(s.block);
+            // lowering a node recurses into its children
+            string_t msg;
+            ast::Node *deep = nullptr;
+            if (lit != nullptr)
+            {
+                deep = ast::TooDeep(lit, msg);
+            }
+            for (size_t i = 0; lit == nullptr && deep == nullptr && i < globals->size(); i++)
+            {
+                auto decl = (*globals)[i].get();
+                deep = decl->node_kind == ast::NodeKind::kVarDecl ? ast::TooDeep(decl, msg) : nullptr;
+            }
+            if (deep != nullptr)
+            {
+                Unsupported(deep, msg);
+            }
+            else if (lit != nullptr)
+            {
+                at = {lit->row_number, lit->column_number};
+                for (int i = 0; i < lit->frame_size; i++)
+                {
+                    if (in_memory.count(MemoryKey(lit, i)) != 0)
+                    {
+                        s.memory[i] = Emit(Op::kSlot, Type::kRef);
+                    }
+                }
+                auto params = TypeOf(lit)->Params();
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    auto p = Emit(Op::kParam, f->params[i]);
+                    p->imm = i;
+                    auto cell = s.memory.find(i);
+                    if (cell != s.memory.end())
+                    {
+                        Emit(Op::kStore, Type::kVoid, {cell->second, p});
+                    }
+                    else
+                    {
+                        Write(Key(i, p->type), s.block, p);
+                    }
+                }
+                Block(lit->body.get());
+                at = {lit->body->row_number, lit->body->column_number};
+            }
+            else
+            {
+                for (auto &decl : *globals)
+                {
+                    if (decl->node_kind == ast::NodeKind::kVarDecl)
+                    {
+                        Declare(static_cast<ast::VarDecl *>(decl.get()));
+                    }
+                }
+            }
+            if (!Terminated())
+            {
+                std::vector<Instr *> zeros;
+                for (auto t : f->returns)
+                {
+                    zeros.push_back(f->Zero(t));
+                }
+                Emit(Op::kRet, Type::kVoid, zeros);
+            }
+            f->RemoveUnreachable();
+            RemoveTrivialPhis();
+            for (auto &b : f->blocks)
+            {
+                auto h = s.headers.find(b.get());
+                if (h != s.headers.end())
+                {
+                    loops[b.get()] = h->second;
+                }
+            }
+            std::swap(s, saved);
+            at = saved_at;
+        }
+
+        //********************************************************************
+        // ssa construction
+        //********************************************************************
+
+        Block *Lowering::NewBlock()
+        {
+            return s.f->NewBlock();
+        }
+
+        Instr *Lowering::Emit(Op op, Type t, std::vector<Instr *> args)
+        {
+            auto in = s.f->New(op, t, std::move(args));
+            in->pos = at;
+            return s.f->Append(s.block, in);
+        }
+
+        void Lowering::Edge(ir::Block *from, ir::Block *to)
+        {
+            to->preds.push_back(from);
+        }
+
+        void Lowering::Jump(ir::Block *to)
+        {
+            if (!Terminated())
+            {
+                Emit(Op::kJump, Type::kVoid)->targets.push_back(to);
+                Edge(s.block, to);
+            }
+        }
+
+        void Lowering::Dead()
+        {
+            s.block = NewBlock();
+            Seal(s.block);
+        }
+
+        // all the preds of b are known, the phis waiting for them get their operands
+        void Lowering::Seal(ir::Block *b)
+        {
+            auto waiting = std::move(s.incomplete[b]);
+            s.incomplete.erase(b);
+            s.sealed.insert(b);
+            for (auto &w : waiting)
+            {
+                for (auto p : b->preds)
+                {
+                    w.second->args.push_back(Read(w.first, p));
+                }
+            }
+        }
+
+        void Lowering::Write(int key, ir::Block *b, Instr *v)
+        {
+            s.defs[b][key] = v;
+        }
+
+        Instr *Lowering::Read(int key, ir::Block *b)
+        {
+            auto &defs = s.defs[b];
+            auto it = defs.find(key);
+            return it != defs.end() ? it->second : ReadRecursive(key, b);
+        }
+
+        Instr *Lowering::ReadRecursive(int key, ir::Block *b)
+        {
+            auto t = static_cast<Type>(key % 8);
+            Instr *v;
+            if (s.sealed.count(b) == 0)
+            {
+                v = s.f->InsertPhi(b, t);
+                s.incomplete[b].push_back({key, v});
+            }
+            else if (b->preds.empty())
+            {
+                v = s.f->Zero(t); // read before any write, on a path the checker allows
+            }
+            else if (b->preds.size() == 1)
+            {
+                v = Read(key, b->preds[0]);
+            }
+            else
+            {
+                // written first, so a loop back to b finds the phi
+                v = s.f->InsertPhi(b, t);
+                Write(key, b, v);
+                for (auto p : b->preds)
+                {
+                    v->args.push_back(Read(key, p));
+                }
+            }
+            Write(key, b, v);
+            return v;
+        }
+
+        // a phi whose operands are itself and one other value is that value
+        void Lowering::RemoveTrivialPhis()
+        {
+            std::unordered_map<Instr *, Instr *> with;
+            auto resolve = [&](Instr *in) {
+                for (auto it = with.find(in); it != with.end(); it = with.find(in))
+                {
+                    in = it->second;
+                }
+                return in;
+            };
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                for (auto &b : s.f->blocks)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        if (in->op != Op::kPhi || with.count(in) != 0)
+                        {
+                            continue;
+                        }
+                        Instr *same = nullptr;
+                        bool trivial = true;
+                        for (auto a : in->args)
+                        {
+                            a = resolve(a);
+                            if (a == in || a == same)
+                            {
+                                continue;
+                            }
+                            if (same != nullptr)
+                            {
+                                trivial = false;
+                                break;
+                            }
+                            same = a;
+                        }
+                        if (trivial)
+                        {
+                            with[in] = same != nullptr ? same : s.f->Zero(in->type);
+                            changed = true;
+                        }
+                    }
+                }
+            }
+            s.f->Replace(with);
+        }
+
+        //********************************************************************
+        // expressions
+        //********************************************************************
+
+        Instr *Lowering::Const(const ast::Constant &k)
+        {
+            switch (k.kind)
+            {
+            case ast::Type::Kind::kInt:
+                return s.f->Int(k.i);
+            case ast::Type::Kind::kFloat:
+                return s.f->Float(k.f);
+            default:
+                return s.f->Bool(k.b);
+            }
+        }
+
+        int Lowering::Local(ast::Expr *e)
+        {
+            e = Unparen(e);
+            if (e->node_kind != ast::NodeKind::kIdent)
+            {
+                return -1;
+            }
+            auto &st = static_cast<ast::Ident *>(e)->storage;
+            if (st.kind != ast::Storage::Kind::kLocal || st.func != s.lit || s.lit == nullptr ||
+                s.memory.count(st.index) != 0)
+            {
+                return -1;
+            }
+            return st.index;
+        }
+
+        Instr *Lowering::Value(ast::Expr *e)
+        {
+            auto k = constants->Find(e);
+            if (k != nullptr)
+            {
+                return Const(*k);
+            }
+            e = Unparen(e);
+            at = {e->row_number, e->column_number};
+            auto t = TypeOf(e);
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto id = static_cast<ast::Ident *>(e);
+                auto &st = id->storage;
+                switch (st.kind)
+                {
+                case ast::Storage::Kind::kLocal:
+                {
+                    if (st.func != s.lit || s.lit == nullptr)
+                    {
+                        Unsupported(id, id->name + " is a local of an enclosing function, closures are not supported");
+                        return s.f->Zero(IrType(t));
+                    }
+                    auto cell = s.memory.find(st.index);
+                    if (cell != s.memory.end())
+                    {
+                        return Emit(Op::kLoad, IrType(t), {cell->second});
+                    }
+                    return Read(Key(st.index, IrType(t)), s.block);
+                }
+                case ast::Storage::Kind::kGlobal:
+                {
+                    auto g = Emit(Op::kGetGlobal, IrType(t));
+                    g->imm = st.index;
+                    return g;
+                }
+                case ast::Storage::Kind::kFunc:
+                    return s.f->FuncRef(by_lit[st.func]);
+                default:
+                    Unsupported(id, "imported " + id->name + " is not linked");
+                    return s.f->Zero(IrType(t));
+                }
+            }
+            case ast::NodeKind::kBasicLiteral:
+                // numbers and bools are constants, what is left is a string
+                module->strings.push_back(static_cast<ast::BasicLiteral *>(e)->value);
+                return s.f->String(&module->strings.back());
+            case ast::NodeKind::kFuncLit:
+            {
+                auto lit = static_cast<ast::FuncLit *>(e);
+                auto f = Declare(lit, s.f->name + "." + std::to_string(++s.nested));
+                Body(f, lit, nullptr);
+                return s.f->FuncRef(f);
+            }
+            case ast::NodeKind::kBinaryExpr:
+                return Binary(static_cast<ast::BinaryExpr *>(e));
+            case ast::NodeKind::kUnaryExpr:
+                return Unary(static_cast<ast::UnaryExpr *>(e));
+            case ast::NodeKind::kCallExpr:
+            {
+                auto call = static_cast<ast::CallExpr *>(e);
+                if (annots->KindOf(call->expr.get()) == ast::Obj::Kind::kType)
+                {
+                    return Value(call->args[0].get(), t);
+                }
+                return Call(call);
+            }
+            case ast::NodeKind::kIndexExpr:
+            {
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                auto a = Value(ie->operand.get());
+                auto i = Value(ie->index.get());
+                at = {e->row_number, e->column_number};
+                return Emit(Op::kGetIndex, IrType(t), {a, i});
+            }
+            case ast::NodeKind::kStarExpr:
+            {
+                auto p = Value(static_cast<ast::StarExpr *>(e)->expr.get());
+                at = {e->row_number, e->column_number};
+                return Emit(Op::kLoad, IrType(t), {p});
+            }
+            default:
+                Unsupported(e, "expression cannot be lowered");
+                return s.f->Zero(IrType(t));
+            }
+        }
+
+        // the value converted to type to, a constant is converted right away
+        Instr *Lowering::Value(ast::Expr *e, ast::Type::Ptr to)
+        {
+            auto from = TypeOf(e);
+            auto k = constants->Find(e);
+            if (k != nullptr && IsInt(from) && IsFloat(to))
+            {
+                return s.f->Float(static_cast<double>(k->i));
+            }
+            auto v = Value(e);
+            at = {e->row_number, e->column_number};
+            return Convert(v, from, to);
+        }
+
+        Instr *Lowering::Convert(Instr *v, ast::Type::Ptr from, ast::Type::Ptr to)
+        {
+            if (IsInt(from) && IsFloat(to))
+            {
+                return Emit(Op::kI2F, Type::kF64, {v});
+            }
+            if (IsFloat(from) && IsInt(to))
+            {
+                return Emit(Op::kF2I, Type::kI64, {v});
+            }
+            return v;
+        }
+
+        Instr *Lowering::Binary(ast::BinaryExpr *e)
+        {
+            if (e->op == CodeType::kLogicAnd || e->op == CodeType::kLogicOr)
+            {
+                return Logic(e);
+            }
+            auto l = e->left.get();
+            auto r = e->right.get();
+            auto op = OpOf(e->op);
+            if (op == Op::kCount)
+            {
+                Unsupported(e, "operator cannot be lowered");
+                return s.f->Zero(IrType(TypeOf(e)));
+            }
+            bool swap = e->op == CodeType::kGreater || e->op == CodeType::kNotLess;
+            Instr *a, *b;
+            Type t;
+            if (IsFloat(TypeOf(l)) || IsFloat(TypeOf(r)))
+            {
+                // an int next to a float is converted, a constant one right away
+                if (!FloatOp(op))
+                {
+                    Unsupported(e, "operator cannot be lowered");
+                    return s.f->Zero(IrType(TypeOf(e)));
+                }
+                a = Value(l, ast::TypeTable::Float());
+                b = Value(r, ast::TypeTable::Float());
+                t = Type::kF64;
+            }
+            else
+            {
+                a = Value(l);
+                b = Value(r);
+                t = a->type;
+            }
+            if (swap)
+            {
+                std::swap(a, b);
+            }
+            at = {e->row_number, e->column_number};
+            bool compare = op == Op::kEq || op == Op::kNe || op == Op::kLt || op == Op::kLe;
+            return Emit(op, compare ? Type::kBool : t, {a, b});
+        }
+
+        // a bool computed by branching: the two outcomes meet in a phi
+        Instr *Lowering::Logic(ast::Expr *e)
+        {
+            auto yes = NewBlock();
+            auto no = NewBlock();
+            auto join = NewBlock();
+            Branch(e, yes, no);
+            Seal(yes);
+            Seal(no);
+            s.block = yes;
+            Jump(join);
+            s.block = no;
+            Jump(join);
+            Seal(join);
+            s.block = join;
+            auto phi = s.f->InsertPhi(join, Type::kBool);
+            phi->args = {s.f->Bool(true), s.f->Bool(false)};
+            return phi;
+        }
+
+        Instr *Lowering::Unary(ast::UnaryExpr *e)
+        {
+            auto x = e->expr.get();
+            switch (e->op)
+            {
+            case CodeType::kAdd:
+                return Value(x);
+            case CodeType::kSub:
+            {
+                auto v = Value(x);
+                return Emit(Op::kNeg, v->type, {v});
+            }
+            case CodeType::kBitsXor:
+                return Emit(Op::kBitNot, Type::kI64, {Value(x)});
+            case CodeType::kLogicNot:
+                return Emit(Op::kNot, Type::kBool, {Value(x)});
+            case CodeType::kBitsAnd:
+                return Address(x);
+            default:
+                Unsupported(e, "operator cannot be lowered");
+                return s.f->Zero(IrType(TypeOf(e)));
+            }
+        }
+
+        // a call of a top level function names it, other callees are values
+        Instr *Lowering::Call(ast::CallExpr *e)
+        {
+            auto callee = e->expr.get();
+            auto t = TypeOf(callee);
+            auto params = t->Params();
+            std::vector<ast::Type::Ptr> to(params.begin(), params.end());
+            Function *direct = nullptr;
+            auto target = Unparen(callee);
+            if (target->node_kind == ast::NodeKind::kIdent &&
+                static_cast<ast::Ident *>(target)->storage.kind == ast::Storage::Kind::kFunc)
+            {
+                direct = by_lit[static_cast<ast::Ident *>(target)->storage.func];
+            }
+            std::vector<Instr *> args;
+            if (direct == nullptr)
+            {
+                args.push_back(Value(callee));
+            }
+            auto vals = Values(e->args, to);
+            args.insert(args.end(), vals.begin(), vals.end());
+            at = {e->row_number, e->column_number};
+            auto returns = t->Returns();
+            Type rt = returns.size() == 0 ? Type::kVoid : returns.size() == 1 ? IrType(returns[0]) : Type::kTuple;
+            auto call = Emit(direct != nullptr ? Op::kCall : Op::kCallValue, rt, args);
+            call->fn = direct;
+            if (rt == Type::kTuple)
+            {
+                for (auto r : returns)
+                {
+                    call->results.push_back(IrType(r));
+                }
+            }
+            return call;
+        }
+
+        // the values of a list converted to the types in to, a single call may
+        // return them all
+        std::vector<Instr *> Lowering::Values(const ast::Expr::List &list, const std::vector<ast::Type::Ptr> &to)
+        {
+            std::vector<Instr *> out;
+            if (list.size() != to.size())
+            {
+                auto vals = TypeOf(list[0].get())->Vals();
+                auto call = Call(static_cast<ast::CallExpr *>(Unparen(list[0].get())));
+                for (size_t i = 0; i < to.size(); i++)
+                {
+                    auto x = Emit(Op::kExtract, IrType(vals[i]), {call});
+                    x->imm = i;
+                    out.push_back(Convert(x, vals[i], to[i]));
+                }
+                return out;
+            }
+            for (size_t i = 0; i < to.size(); i++)
+            {
+                out.push_back(Value(list[i].get(), to[i]));
+            }
+            return out;
+        }
+
+        // a pointer to where an assignable expression lives
+        Instr *Lowering::Address(ast::Expr *e)
+        {
+            e = Unparen(e);
+            at = {e->row_number, e->column_number};
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto &st = static_cast<ast::Ident *>(e)->storage;
+                if (st.kind == ast::Storage::Kind::kLocal && st.func == s.lit && s.memory.count(st.index) != 0)
+                {
+                    return s.memory[st.index];
+                }
+                if (st.kind == ast::Storage::Kind::kGlobal)
+                {
+                    auto p = Emit(Op::kAddrGlobal, Type::kRef);
+                    p->imm = st.index;
+                    return p;
+                }
+                Value(e); // reports why
+                if (ok)
+                {
+                    Unsupported(e, "expression is not assignable");
+                }
+                return s.f->Nil();
+            }
+            case ast::NodeKind::kStarExpr:
+                return Value(static_cast<ast::StarExpr *>(e)->expr.get());
+            case ast::NodeKind::kIndexExpr:
+            {
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                auto operand = ie->operand.get();
+                Instr *p;
+                bool create = true;
+                if (ast::Obj::Addressable(annots->KindOf(operand)))
+                {
+                    p = Address(operand);
+                }
+                else
+                {
+                    // a nil array that is not assignable is not created
+                    auto v = Value(operand);
+                    p = s.f->Append(s.f->Entry(), s.f->New(Op::kSlot, Type::kRef));
+                    Emit(Op::kStore, Type::kVoid, {p, v});
+                    create = false;
+                }
+                auto i = Value(ie->index.get());
+                at = {e->row_number, e->column_number};
+                auto r = Emit(Op::kAddrIndex, Type::kRef, {p, i});
+                r->imm = create ? 0 : 1;
+                return r;
+            }
+            default:
+                Unsupported(e, "expression is not assignable");
+                return s.f->Nil();
+            }
+        }
+
+        //********************************************************************
+        // statements
+        //********************************************************************
+
+        void Lowering::Stmt(ast::Stmt *st)
+        {
+            at = {st->row_number, st->column_number};
+            switch (st->node_kind)
+            {
+            case ast::NodeKind::kBlock:
+                Block(static_cast<ast::Block *>(st));
+                break;
+            case ast::NodeKind::kExprStmt:
+                // the value is not needed, what it calls or traps on still happens
+                Value(static_cast<ast::ExprStmt *>(st)->expr.get());
+                break;
+            case ast::NodeKind::kDeclStmt:
+                Declare(static_cast<ast::VarDecl *>(static_cast<ast::DeclStmt *>(st)->decl.get()));
+                break;
+            case ast::NodeKind::kAssignStmt:
+                Assign(static_cast<ast::AssignStmt *>(st));
+                break;
+            case ast::NodeKind::kIfStmt:
+                If(static_cast<ast::IfStmt *>(st));
+                break;
+            case ast::NodeKind::kWhileStmt:
+                While(static_cast<ast::WhileStmt *>(st));
+                break;
+            case ast::NodeKind::kForStmt:
+                For(static_cast<ast::ForStmt *>(st));
+                break;
+            case ast::NodeKind::kRetStmt:
+                Return(static_cast<ast::RetStmt *>(st));
+                break;
+            case ast::NodeKind::kEmptyStmt:
+                break;
+            case ast::NodeKind::kBreakStmt:
+                Jump(s.loops.back().exit);
+                Dead();
+                break;
+            case ast::NodeKind::kContinueStmt:
+                Jump(s.loops.back().next);
+                Dead();
+                break;
+            default:
+                Unsupported(st, "statement cannot be lowered");
+            }
+        }
+
+        void Lowering::Block(ast::Block *b)
+        {
+            for (auto &st : b->stmts)
+            {
+                Stmt(st.get());
+            }
+        }
+
+        // locals become values or go to their cells, top level names to the globals
+        void Lowering::Declare(ast::VarDecl *decl)
+        {
+            size_t n = decl->names.size();
+            int first = decl->first_slot;
+            std::vector<Instr *> vals;
+            std::vector<ast::Type::Ptr> to;
+            if (decl->type != nullptr)
+            {
+                auto t = TypeOf(decl->type.get());
+                for (size_t i = 0; i < n; i++)
+                {
+                    to.push_back(t);
+                    vals.push_back(t->kind == ast::Type::Kind::kArray ? Emit(Op::kNewArray, Type::kRef)
+                                                                       : s.f->Zero(IrType(t)));
+                }
+            }
+            else
+            {
+                if (decl->vals.size() != n)
+                {
+                    auto types = TypeOf(decl->vals[0].get())->Vals();
+                    to.assign(types.begin(), types.end());
+                }
+                else
+                {
+                    for (auto &v : decl->vals)
+                    {
+                        to.push_back(TypeOf(v.get()));
+                    }
+                }
+                vals = Values(decl->vals, to);
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                int slot = first + static_cast<int>(i);
+                if (s.lit == nullptr)
+                {
+                    Emit(Op::kSetGlobal, Type::kVoid, {vals[i]})->imm = slot;
+                    continue;
+                }
+                auto cell = s.memory.find(slot);
+                if (cell != s.memory.end())
+                {
+                    Emit(Op::kStore, Type::kVoid, {cell->second, vals[i]});
+                }
+                else
+                {
+                    Write(Key(slot, IrType(to[i])), s.block, vals[i]);
+                }
+            }
+        }
+
+        void Lowering::Assign(ast::AssignStmt *st)
+        {
+            if (st->op != CodeType::kAssign)
+            {
+                Update(st);
+                return;
+            }
+            // every value is computed before anything is assigned, so a, b = b, a swaps
+            std::vector<ast::Type::Ptr> to;
+            for (auto &l : st->lhs)
+            {
+                to.push_back(TypeOf(l.get()));
+            }
+            auto vals = Values(st->rhs, to);
+            for (size_t i = 0; i < st->lhs.size(); i++)
+            {
+                Store(st->lhs[i].get(), vals[i]);
+            }
+        }
+
+        // x op= y computes in float when either side is a float. every engine reads x
+        // before it computes y, a call in y that writes x is lost
+        void Lowering::Update(ast::AssignStmt *st)
+        {
+            auto l = st->lhs[0].get();
+            auto r = st->rhs[0].get();
+            auto lt = TypeOf(l);
+            auto rt = TypeOf(r);
+            auto op = OpOf(st->op);
+            bool ints = IsInt(lt) && IsInt(rt);
+            if (op == Op::kCount || (!ints && !FloatOp(op)))
+            {
+                Unsupported(st, "operator cannot be lowered");
+                return;
+            }
+            int slot = Local(l);
+            Instr *ptr = nullptr;
+            Instr *cur;
+            if (slot >= 0)
+            {
+                cur = Value(l);
+            }
+            else
+            {
+                ptr = Address(l);
+                cur = Emit(Op::kLoad, IrType(lt), {ptr});
+            }
+            auto f = ast::TypeTable::Float();
+            auto b = ints ? Value(r) : Value(r, f);
+            at = {st->row_number, st->column_number};
+            Instr *v;
+            if (ints)
+            {
+                v = Emit(op, Type::kI64, {cur, b});
+            }
+            else if (IsInt(lt))
+            {
+                // computed as a float and stored back to the int
+                auto x = Emit(op, Type::kF64, {Convert(cur, lt, f), b});
+                v = Convert(x, f, lt);
+            }
+            else
+            {
+                v = Emit(op, Type::kF64, {cur, b});
+            }
+            if (ptr != nullptr)
+            {
+                Emit(Op::kStore, Type::kVoid, {ptr, v});
+            }
+            else
+            {
+                Write(Key(slot, v->type), s.block, v);
+            }
+        }
+
+        void Lowering::Store(ast::Expr *lhs, Instr *v)
+        {
+            auto e = Unparen(lhs);
+            int slot = Local(e);
+            at = {e->row_number, e->column_number};
+            if (slot >= 0)
+            {
+                Write(Key(slot, v->type), s.block, v);
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kIdent &&
+                static_cast<ast::Ident *>(e)->storage.kind == ast::Storage::Kind::kGlobal)
+            {
+                Emit(Op::kSetGlobal, Type::kVoid, {v})->imm = static_cast<ast::Ident *>(e)->storage.index;
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kIndexExpr)
+            {
+                // an array in a local is written without taking addresses
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                int arr = Local(ie->operand.get());
+                if (arr >= 0)
+                {
+                    auto a = Value(ie->operand.get());
+                    auto i = Value(ie->index.get());
+                    at = {e->row_number, e->column_number};
+                    Write(Key(arr, Type::kRef), s.block, Emit(Op::kSetIndex, Type::kRef, {a, i, v}));
+                    return;
+                }
+            }
+            auto p = Address(e);
+            Emit(Op::kStore, Type::kVoid, {p, v});
+        }
+
+        // ends the block with a branch to yes when the condition holds, to no otherwise
+        void Lowering::Branch(ast::Expr *e, ir::Block *yes, ir::Block *no)
+        {
+            e = Unparen(e);
+            if (constants->IsTrue(e) || constants->IsFalse(e))
+            {
+                Jump(constants->IsTrue(e) ? yes : no);
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kUnaryExpr &&
+                static_cast<ast::UnaryExpr *>(e)->op == CodeType::kLogicNot)
+            {
+                Branch(static_cast<ast::UnaryExpr *>(e)->expr.get(), no, yes);
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kBinaryExpr)
+            {
+                auto b = static_cast<ast::BinaryExpr *>(e);
+                // a && b is false when a is, a || b is true when a is
+                if (b->op == CodeType::kLogicAnd || b->op == CodeType::kLogicOr)
+                {
+                    auto right = NewBlock();
+                    if (b->op == CodeType::kLogicAnd)
+                    {
+                        Branch(b->left.get(), right, no);
+                    }
+                    else
+                    {
+                        Branch(b->left.get(), yes, right);
+                    }
+                    Seal(right);
+                    s.block = right;
+                    Branch(b->right.get(), yes, no);
+                    return;
+                }
+            }
+            auto c = Value(e);
+            at = {e->row_number, e->column_number};
+            if (!Terminated())
+            {
+                auto br = Emit(Op::kBranch, Type::kVoid, {c});
+                br->targets = {yes, no};
+                Edge(s.block, yes);
+                Edge(s.block, no);
+            }
+        }
+
+        void Lowering::If(ast::IfStmt *st)
+        {
+            if (constants->IsTrue(st->condition.get()))
+            {
+                Stmt(st->if_block.get());
+                return;
+            }
+            if (constants->IsFalse(st->condition.get()))
+            {
+                if (st->else_block != nullptr)
+                {
+                    Stmt(st->else_block.get());
+                }
+                return;
+            }
+            auto then = NewBlock();
+            auto join = NewBlock();
+            auto other = st->else_block != nullptr ? NewBlock() : join;
+            Branch(st->condition.get(), then, other);
+            Seal(then);
+            s.block = then;
+            Stmt(st->if_block.get());
+            Jump(join);
+            if (other != join)
+            {
+                Seal(other);
+                s.block = other;
+                Stmt(st->else_block.get());
+                Jump(join);
+            }
+            Seal(join);
+            s.block = join;
+        }
+
+        // the condition is tested in a header the body jumps back to
+        void Lowering::While(ast::WhileStmt *st)
+        {
+            auto header = NewBlock();
+            auto body = NewBlock();
+            auto exit = NewBlock();
+            s.headers[header] = {st->row_number, st->column_number};
+            Jump(header);
+            s.block = header;
+            Branch(st->condition.get(), body, exit);
+            Seal(body);
+            s.loops.push_back({exit, header});
+            s.block = body;
+            Stmt(st->block.get());
+            Jump(header);
+            s.loops.pop_back();
+            Seal(header);
+            Seal(exit);
+            s.block = exit;
+        }
+
+        void Lowering::For(ast::ForStmt *st)
+        {
+            Stmt(st->init.get());
+            auto header = NewBlock();
+            auto body = NewBlock();
+            auto post = NewBlock();
+            auto exit = NewBlock();
+            s.headers[header] = {st->row_number, st->column_number};
+            Jump(header);
+            s.block = header;
+            Branch(st->condition.get(), body, exit);
+            Seal(body);
+            s.loops.push_back({exit, post});
+            s.block = body;
+            Block(st->block.get());
+            Jump(post);
+            s.loops.pop_back();
+            Seal(post);
+            s.block = post;
+            Stmt(st->post.get());
+            Jump(header);
+            Seal(header);
+            Seal(exit);
+            s.block = exit;
+        }
+
+        void Lowering::Return(ast::RetStmt *st)
+        {
+            auto returns = TypeOf(s.lit->type.get())->Returns();
+            std::vector<ast::Type::Ptr> to(returns.begin(), returns.end());
+            std::vector<Instr *> vals;
+            if (st->vals.empty())
+            {
+                for (auto t : s.f->returns)
+                {
+                    vals.push_back(s.f->Zero(t));
+                }
+            }
+            else
+            {
+                vals = Values(st->vals, to);
+            }
+            at = {st->row_number, st->column_number};
+            if (!Terminated())
+            {
+                Emit(Op::kRet, Type::kVoid, vals);
+            }
+            Dead();
+        }
+    }
+}
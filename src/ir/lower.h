@@ -0,0 +1,128 @@
+#ifndef LILANG_IR_LOWER
+#define LILANG_IR_LOWER
+
+#include <unordered_set>
+#include "../compiler/semantic.h"
+#include "./ir.h"
+
+/*
+lowering of a checked file to the ir
+
+ssa form is built while the statements are walked, with the algorithm of
+braun et al.: a block knows the last value of each local assigned in it,
+a read walks back through the predecessors and places a phi where paths
+meet. a block is sealed once all its predecessors are known, reads in a
+loop header before that get a phi whose operands are filled when the back
+edges are in. phis that turn out to merge a single value are dropped once
+the function is done.
+
+a local is found by its slot and type, so two variables sharing a slot in
+sibling scopes never meet in a phi. a local whose address is taken, or
+that is the base of an element written through a pointer, lives in a slot
+instruction of the entry block instead and is read with load.
+
+the engines' semantics are kept: the same conversions between int and
+float, && and || evaluate their right side only when needed, and a
+function that falls off its end returns zero values. closures over the
+locals of an enclosing function and imported names are not supported.
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        class Lowering
+        {
+        public:
+            explicit Lowering(compiler::Diagnostics &);
+            // false if the file uses a construct the ir cannot express
+            bool Lower(const ast::File::Ptr &, ast::SemanticVisitor &, Module &);
+            // the first such construct of each function that has one
+            const std::unordered_map<const Function *, compiler::Diagnostic> &Rejected() const { return rejected; }
+            // the header of each while and for loop left in the functions, with the position of the statement
+            const std::unordered_map<const ir::Block *, std::pair<int, int>> &Loops() const { return loops; }
+
+        private:
+            struct Loop
+            {
+                ir::Block *exit;
+                ir::Block *next; // where continue goes
+            };
+
+            // the function being lowered
+            struct State
+            {
+                Function *f = nullptr;
+                ast::FuncLit *lit = nullptr; // nullptr for the initializer
+                ir::Block *block = nullptr;  // where instructions are appended
+                std::unordered_map<ir::Block *, std::unordered_map<int, Instr *>> defs;
+                std::unordered_set<ir::Block *> sealed;
+                std::unordered_map<ir::Block *, std::vector<std::pair<int, Instr *>>> incomplete;
+                std::unordered_map<int, Instr *> memory; // slot instructions of the locals kept in memory
+                std::vector<Loop> loops;
+                std::unordered_map<ir::Block *, std::pair<int, int>> headers;
+                int nested = 0; // function literals named so far
+            };
+
+            compiler::Diagnostics &diag;
+            const ast::Annotations *annots = nullptr;
+            const ast::ConstantTable *constants = nullptr;
+            Module *module = nullptr;
+            std::unordered_map<const ast::FuncLit *, Function *> by_lit;
+            std::unordered_set<uint64_t> in_memory; // node id of the function and slot of the locals in memory
+            std::unordered_map<const Function *, compiler::Diagnostic> rejected;
+            std::unordered_map<const ir::Block *, std::pair<int, int>> loops;
+            State s;
+            std::pair<int, int> at; // position of what is lowered
+            bool ok = true;
+
+            ast::Type::Ptr TypeOf(const ast::Node *n) const { return annots->TypeOf(n); }
+            static Type IrType(ast::Type::Ptr);
+            void Unsupported(ast::Node *, const string_t &msg);
+            Function *Declare(ast::FuncLit *, const string_t &name);
+            void Body(Function *, ast::FuncLit *, const ast::Decl::List *globals);
+            void MarkMemory(const ast::File::Ptr &);
+
+            // ssa construction
+            ir::Block *NewBlock();
+            Instr *Emit(Op, Type, std::vector<Instr *> args = {});
+            void Edge(ir::Block *from, ir::Block *to);
+            void Jump(ir::Block *to);
+            void Seal(ir::Block *);
+            bool Terminated() const { return s.block->Terminator() != nullptr; }
+            void Write(int key, ir::Block *, Instr *);
+            Instr *Read(int key, ir::Block *);
+            Instr *ReadRecursive(int key, ir::Block *);
+            void RemoveTrivialPhis();
+            static int Key(int slot, Type t) { return slot * 8 + static_cast<int>(t); }
+
+            // expressions
+            Instr *Const(const ast::Constant &);
+            int Local(ast::Expr *); // slot of a local held in ssa values, -1 for anything else
+            Instr *Value(ast::Expr *);
+            Instr *Value(ast::Expr *, ast::Type::Ptr to);
+            Instr *Convert(Instr *, ast::Type::Ptr from, ast::Type::Ptr to);
+            Instr *Binary(ast::BinaryExpr *);
+            Instr *Logic(ast::Expr *);
+            Instr *Unary(ast::UnaryExpr *);
+            Instr *Call(ast::CallExpr *);
+            std::vector<Instr *> Values(const ast::Expr::List &, const std::vector<ast::Type::Ptr> &to);
+            Instr *Address(ast::Expr *);
+
+            // statements
+            void Stmt(ast::Stmt *);
+            void Block(ast::Block *);
+            void Declare(ast::VarDecl *);
+            void Assign(ast::AssignStmt *);
+            void Update(ast::AssignStmt *);
+            void Store(ast::Expr *lhs, Instr *v);
+            void Branch(ast::Expr *, ir::Block *yes, ir::Block *no);
+            void If(ast::IfStmt *);
+            void While(ast::WhileStmt *);
+            void For(ast::ForStmt *);
+            void Return(ast::RetStmt *);
+            void Dead(); // code after a jump goes to a block nothing reaches
+        };
+    }
+}
+
+#endif
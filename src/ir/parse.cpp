@@ -0,0 +1,756 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include "./ir.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            const char *kDelimiters = " \t,()[]:;=";
+
+            // one pass per function over its lines: labels first, then the instructions
+            class Parser
+            {
+            public:
+                Parser(const string_t &text, Module &m, compiler::Diagnostics &d) : module(m), diag(d)
+                {
+                    stringstream_t ss(text);
+                    for (string_t l; std::getline(ss, l);)
+                    {
+                        lines.push_back(l);
+                    }
+                }
+
+                bool Run()
+                {
+                    // every function is known before the first call is read
+                    for (row = 0; row < lines.size(); row++)
+                    {
+                        Start();
+                        if (Atom() == "fn")
+                        {
+                            auto name = Name();
+                            if (functions.count(name) != 0)
+                            {
+                                return Error("function " + name + " is defined twice");
+                            }
+                            module.functions.emplace_back();
+                            module.functions.back().name = name;
+                            functions[name] = &module.functions.back();
+                            if (name == "<init>")
+                            {
+                                module.init = &module.functions.back();
+                            }
+                        }
+                    }
+                    for (row = 0; row < lines.size(); row++)
+                    {
+                        Start();
+                        if (AtEnd())
+                        {
+                            continue;
+                        }
+                        auto word = Atom();
+                        if (word == "globals")
+                        {
+                            if (!Globals())
+                            {
+                                return false;
+                            }
+                        }
+                        else if (word == "fn")
+                        {
+                            if (!ParseFunction())
+                            {
+                                return false;
+                            }
+                        }
+                        else
+                        {
+                            return Error("expected fn or globals, found '" + word + "'");
+                        }
+                    }
+                    return true;
+                }
+
+            private:
+                Module &module;
+                compiler::Diagnostics &diag;
+                std::vector<string_t> lines;
+                size_t row = 0;
+                size_t col = 0;
+                size_t token = 0; // column of the last token
+                std::unordered_map<string_t, Function *> functions;
+
+                // of the function being read
+                Function *f = nullptr;
+                std::unordered_map<string_t, Block *> labels;
+                std::unordered_map<string_t, Instr *> values, pending;
+                std::unordered_map<Instr *, Instr *> forward;
+                std::vector<std::pair<Instr *, std::vector<string_t>>> phis;
+                std::unordered_map<Block *, std::vector<string_t>> listed; // preds in the comment of a label
+
+                bool Error(const string_t &msg)
+                {
+                    diag.Report(compiler::Phase::kIr, static_cast<int>(row + 1), static_cast<int>(token + 1), msg);
+                    return false;
+                }
+
+                //************************************************************
+                // tokens
+                //************************************************************
+
+                const string_t &Line() const { return lines[row]; }
+
+                void Start()
+                {
+                    col = token = 0;
+                    Skip();
+                }
+
+                void Skip()
+                {
+                    while (col < Line().size() && (Line()[col] == ' ' || Line()[col] == '\t' || Line()[col] == '\r'))
+                    {
+                        col++;
+                    }
+                    if (col < Line().size() && Line()[col] == ';')
+                    {
+                        col = Line().size(); // a comment runs to the end of the line
+                    }
+                }
+
+                bool AtEnd()
+                {
+                    Skip();
+                    return col == Line().size();
+                }
+
+                bool Peek(char c)
+                {
+                    Skip();
+                    return col < Line().size() && Line()[col] == c;
+                }
+
+                bool Accept(char c)
+                {
+                    if (!Peek(c))
+                    {
+                        return false;
+                    }
+                    token = col++;
+                    return true;
+                }
+
+                bool Expect(char c)
+                {
+                    if (Accept(c))
+                    {
+                        return true;
+                    }
+                    token = col;
+                    return Error(string_t("expected '") + c + "'");
+                }
+
+                string_t Atom()
+                {
+                    Skip();
+                    token = col;
+                    if (col < Line().size() && Line()[col] == '"')
+                    {
+                        return Quoted();
+                    }
+                    while (col < Line().size() && std::strchr(kDelimiters, Line()[col]) == nullptr)
+                    {
+                        col++;
+                    }
+                    return Line().substr(token, col - token);
+                }
+
+                string_t Quoted()
+                {
+                    size_t end = ++col;
+                    while (end < Line().size() && Line()[end] != '"')
+                    {
+                        end += Line()[end] == '\\' ? 2 : 1;
+                    }
+                    string_t s;
+                    for (; col < end && col < Line().size(); col++)
+                    {
+                        if (Line()[col] == '\\' && col + 1 < end)
+                        {
+                            col++;
+                            s += Line()[col] == 'n' ? '\n' : Line()[col];
+                        }
+                        else
+                        {
+                            s += Line()[col];
+                        }
+                    }
+                    col = std::min(end + 1, Line().size());
+                    return "\"" + s; // a leading quote tells a string from an atom
+                }
+
+                // a function name runs to its parameter list
+                string_t Name()
+                {
+                    Skip();
+                    token = col;
+                    while (col < Line().size() && Line()[col] != '(')
+                    {
+                        col++;
+                    }
+                    size_t end = col;
+                    while (end > token && Line()[end - 1] == ' ')
+                    {
+                        end--;
+                    }
+                    return Line().substr(token, end - token);
+                }
+
+                bool Number(const string_t &s, int64_t &out)
+                {
+                    char *end = nullptr;
+                    errno = 0;
+                    out = std::strtoll(s.c_str(), &end, 10);
+                    return !s.empty() && *end == 0 && errno == 0;
+                }
+
+                bool Index(char prefix, int64_t &out)
+                {
+                    auto s = Atom();
+                    if (prefix != 0 && (s.empty() || s[0] != prefix))
+                    {
+                        return Error(string_t("expected ") + prefix + "N, found '" + s + "'");
+                    }
+                    if (!Number(s.substr(prefix != 0), out) || out < 0)
+                    {
+                        return Error("expected an index, found '" + s + "'");
+                    }
+                    return true;
+                }
+
+                bool ParseType(Type &t, bool tuple = false, std::vector<Type> *results = nullptr)
+                {
+                    if (tuple && Accept('('))
+                    {
+                        t = Type::kTuple;
+                        do
+                        {
+                            Type r;
+                            if (!ParseType(r))
+                            {
+                                return false;
+                            }
+                            results->push_back(r);
+                        } while (Accept(','));
+                        return Expect(')');
+                    }
+                    auto s = Atom();
+                    for (int i = 0; i <= static_cast<int>(Type::kRef); i++)
+                    {
+                        if (s == TypeName(static_cast<Type>(i)))
+                        {
+                            t = static_cast<Type>(i);
+                            return true;
+                        }
+                    }
+                    return Error("expected a type, found '" + s + "'");
+                }
+
+                //************************************************************
+                // module
+                //************************************************************
+
+                bool Globals()
+                {
+                    do
+                    {
+                        Type t;
+                        if (!ParseType(t))
+                        {
+                            return false;
+                        }
+                        module.globals.push_back(t);
+                    } while (Accept(','));
+                    return AtEnd() || Error("expected the end of the line");
+                }
+
+                bool ParseFunction()
+                {
+                    f = functions[Name()];
+                    labels.clear();
+                    listed.clear();
+                    values.clear();
+                    pending.clear();
+                    forward.clear();
+                    phis.clear();
+                    if (!Expect('('))
+                    {
+                        return false;
+                    }
+                    if (!Accept(')'))
+                    {
+                        do
+                        {
+                            Type t;
+                            if (!ParseType(t))
+                            {
+                                return false;
+                            }
+                            f->params.push_back(t);
+                        } while (Accept(','));
+                        if (!Expect(')'))
+                        {
+                            return false;
+                        }
+                    }
+                    Type r;
+                    if (!ParseType(r, true, &f->returns))
+                    {
+                        return false;
+                    }
+                    if (r != Type::kVoid && r != Type::kTuple)
+                    {
+                        f->returns.push_back(r);
+                    }
+                    if (!Expect('{'))
+                    {
+                        return false;
+                    }
+
+                    // labels, so a branch may name a block further down
+                    size_t first = row + 1, last = first;
+                    for (; last < lines.size(); last++)
+                    {
+                        std::swap(row, last);
+                        Start();
+                        bool end = Accept('}');
+                        if (!end && !Line().empty() && Line()[col] == 'b' && Line().find(':') != string_t::npos)
+                        {
+                            auto label = Atom();
+                            if (Accept(':'))
+                            {
+                                if (labels.count(label) != 0)
+                                {
+                                    return Error("block " + label + " is defined twice");
+                                }
+                                labels[label] = f->NewBlock();
+                                Listed(labels[label]);
+                            }
+                        }
+                        std::swap(row, last);
+                        if (end)
+                        {
+                            break;
+                        }
+                    }
+                    if (last == lines.size())
+                    {
+                        return Error("function " + f->name + " has no '}'");
+                    }
+                    if (labels.empty())
+                    {
+                        return Error("function " + f->name + " has no blocks");
+                    }
+
+                    Block *b = nullptr;
+                    for (row = first; row < last; row++)
+                    {
+                        Start();
+                        if (AtEnd())
+                        {
+                            continue;
+                        }
+                        auto save = col;
+                        auto word = Atom();
+                        if (Accept(':'))
+                        {
+                            b = labels[word];
+                            continue;
+                        }
+                        col = save;
+                        if (b == nullptr)
+                        {
+                            return Error("instruction before the first block");
+                        }
+                        if (!ParseInstr(b))
+                        {
+                            return false;
+                        }
+                    }
+                    row = last;
+
+                    for (auto &p : pending)
+                    {
+                        if (values.count(p.first) == 0)
+                        {
+                            return Error("value " + p.first + " is used in " + f->name + " but never defined");
+                        }
+                        forward[p.second] = values[p.first];
+                    }
+                    f->Replace(forward);
+                    return Preds();
+                }
+
+                // the order Print writes after a label, kept when the text is read back
+                void Listed(Block *b)
+                {
+                    auto at = Line().find("; preds ", col);
+                    if (at == string_t::npos)
+                    {
+                        return;
+                    }
+                    stringstream_t ss(Line().substr(at + 8));
+                    for (string_t name; std::getline(ss, name, ',');)
+                    {
+                        name.erase(0, name.find_first_not_of(' '));
+                        name.erase(name.find_last_not_of(' ') + 1);
+                        listed[b].push_back(name);
+                    }
+                }
+
+                // preds follow the branches in block order unless a label lists
+                // them, phi operands are sorted to match
+                bool Preds()
+                {
+                    std::unordered_map<Block *, string_t> names;
+                    for (auto &l : labels)
+                    {
+                        names[l.second] = l.first;
+                    }
+                    token = 0; // at the closing brace
+                    for (auto &b : f->blocks)
+                    {
+                        if (b->Terminator() == nullptr)
+                        {
+                            return Error("block " + names[b.get()] + " has no terminator");
+                        }
+                        for (auto s : b->Succs())
+                        {
+                            if (s->PredIndex(b.get()) == s->preds.size())
+                            {
+                                s->preds.push_back(b.get());
+                            }
+                        }
+                    }
+                    for (auto &l : listed)
+                    {
+                        auto &preds = l.first->preds;
+                        std::vector<Block *> order;
+                        for (auto &name : l.second)
+                        {
+                            auto it = labels.find(name);
+                            if (it == labels.end() || l.first->PredIndex(it->second) == preds.size())
+                            {
+                                return Error("block " + names[l.first] + " lists " + name + " which does not branch to it");
+                            }
+                            order.push_back(it->second);
+                        }
+                        if (order.size() != preds.size())
+                        {
+                            return Error("block " + names[l.first] + " does not list all its preds");
+                        }
+                        preds = order;
+                    }
+                    for (auto &p : phis)
+                    {
+                        auto phi = p.first;
+                        auto &preds = phi->block->preds;
+                        if (p.second.size() != preds.size())
+                        {
+                            return Error("phi in " + names[phi->block] + " does not have an operand per pred");
+                        }
+                        std::vector<Instr *> args;
+                        for (auto pred : preds)
+                        {
+                            auto at = std::find(p.second.begin(), p.second.end(), names[pred]);
+                            if (at == p.second.end())
+                            {
+                                return Error("phi in " + names[phi->block] + " has no operand for " + names[pred]);
+                            }
+                            args.push_back(phi->args[at - p.second.begin()]);
+                        }
+                        phi->args = args;
+                    }
+                    return true;
+                }
+
+                //************************************************************
+                // instructions
+                //************************************************************
+
+                Instr *Value()
+                {
+                    auto s = Atom();
+                    if (s.empty())
+                    {
+                        Error("expected a value");
+                        return nullptr;
+                    }
+                    if (s[0] == '%')
+                    {
+                        auto it = values.find(s);
+                        if (it != values.end())
+                        {
+                            return it->second;
+                        }
+                        auto &p = pending[s];
+                        return p != nullptr ? p : p = f->New(Op::kCount, Type::kVoid);
+                    }
+                    if (s[0] == '"')
+                    {
+                        module.strings.push_back(s.substr(1));
+                        return f->String(&module.strings.back());
+                    }
+                    if (s[0] == '@')
+                    {
+                        auto it = functions.find(s.substr(1));
+                        if (it == functions.end())
+                        {
+                            Error("no function " + s.substr(1));
+                            return nullptr;
+                        }
+                        return f->FuncRef(it->second);
+                    }
+                    if (s == "true" || s == "false")
+                    {
+                        return f->Bool(s == "true");
+                    }
+                    if (s == "nil")
+                    {
+                        return f->Nil();
+                    }
+                    if (s == "nan" || s == "inf" || s == "-inf")
+                    {
+                        return f->Float(s == "nan" ? NAN : s == "inf" ? INFINITY : -INFINITY);
+                    }
+                    int64_t i;
+                    if (Number(s, i))
+                    {
+                        return f->Int(i);
+                    }
+                    char *end = nullptr;
+                    double d = std::strtod(s.c_str(), &end);
+                    if (*end == 0 && s.find_first_of(".e") != string_t::npos)
+                    {
+                        return f->Float(d);
+                    }
+                    Error("expected a value, found '" + s + "'");
+                    return nullptr;
+                }
+
+                bool Operand(Instr *in)
+                {
+                    auto v = Value();
+                    in->args.push_back(v);
+                    return v != nullptr;
+                }
+
+                bool Values(Instr *in, char close)
+                {
+                    if (close != 0 && Accept(close))
+                    {
+                        return true;
+                    }
+                    if (close == 0 && AtEnd())
+                    {
+                        return true;
+                    }
+                    do
+                    {
+                        if (!Operand(in))
+                        {
+                            return false;
+                        }
+                    } while (Accept(','));
+                    return close == 0 || Expect(close);
+                }
+
+                bool Target(Instr *in)
+                {
+                    auto s = Atom();
+                    auto it = labels.find(s);
+                    if (it == labels.end())
+                    {
+                        return Error("no block " + s);
+                    }
+                    in->targets.push_back(it->second);
+                    return true;
+                }
+
+                bool Callee(Instr *in)
+                {
+                    auto s = Atom();
+                    auto it = s.empty() || s[0] != '@' ? functions.end() : functions.find(s.substr(1));
+                    if (it == functions.end())
+                    {
+                        return Error("expected a function, found '" + s + "'");
+                    }
+                    in->fn = it->second;
+                    return true;
+                }
+
+                bool ParseInstr(Block *b)
+                {
+                    string_t def;
+                    if (Peek('%'))
+                    {
+                        def = Atom();
+                        if (!Expect('='))
+                        {
+                            return false;
+                        }
+                        if (values.count(def) != 0)
+                        {
+                            return Error("value " + def + " is defined twice");
+                        }
+                    }
+                    auto name = Atom();
+                    int op = 0;
+                    while (op < static_cast<int>(Op::kCount) && name != OpName(static_cast<Op>(op)))
+                    {
+                        op++;
+                    }
+                    if (op == static_cast<int>(Op::kCount) || op == static_cast<int>(Op::kConst))
+                    {
+                        return Error("unknown instruction '" + name + "'");
+                    }
+                    auto in = f->New(static_cast<Op>(op), Type::kVoid);
+                    in->pos = {static_cast<int>(row + 1), 0};
+                    if (!Operands(in))
+                    {
+                        return false;
+                    }
+                    if (!AtEnd())
+                    {
+                        token = col;
+                        return Error("expected the end of the line");
+                    }
+                    if (def.empty() != (in->type == Type::kVoid))
+                    {
+                        return Error(def.empty() ? "the value of " + name + " is not named" : name + " has no value");
+                    }
+                    if (!def.empty())
+                    {
+                        values[def] = in;
+                    }
+                    if (b->Terminator() != nullptr)
+                    {
+                        return Error("instruction after the terminator of its block");
+                    }
+                    f->Append(b, in);
+                    return true;
+                }
+
+                bool Operands(Instr *in)
+                {
+                    switch (in->op)
+                    {
+                    case Op::kParam:
+                        return ParseType(in->type) && Index(0, in->imm);
+                    case Op::kGetGlobal:
+                    case Op::kAddrGlobal:
+                        return ParseType(in->type) && Index('g', in->imm);
+                    case Op::kSetGlobal:
+                        return Index('g', in->imm) && Expect(',') && Values(in, 0);
+                    case Op::kEq:
+                    case Op::kNe:
+                    case Op::kLt:
+                    case Op::kLe:
+                    {
+                        Type t;
+                        in->type = Type::kBool;
+                        return ParseType(t) && Values(in, 0);
+                    }
+                    case Op::kCall:
+                        return ParseType(in->type, true, &in->results) && Callee(in) && Expect('(') &&
+                               Values(in, ')');
+                    case Op::kCallValue:
+                    {
+                        if (!ParseType(in->type, true, &in->results))
+                        {
+                            return false;
+                        }
+                        auto callee = Value();
+                        if (callee == nullptr)
+                        {
+                            return false;
+                        }
+                        in->args.push_back(callee);
+                        return Expect('(') && Values(in, ')');
+                    }
+                    case Op::kExtract:
+                        return ParseType(in->type) && Operand(in) && Expect(',') && Index(0, in->imm);
+                    case Op::kPhi:
+                    {
+                        if (!ParseType(in->type))
+                        {
+                            return false;
+                        }
+                        std::vector<string_t> from;
+                        do
+                        {
+                            if (!Expect('['))
+                            {
+                                return false;
+                            }
+                            auto v = Value();
+                            if (v == nullptr || !Expect(','))
+                            {
+                                return false;
+                            }
+                            in->args.push_back(v);
+                            from.push_back(Atom());
+                            if (labels.count(from.back()) == 0)
+                            {
+                                return Error("no block " + from.back());
+                            }
+                            if (!Expect(']'))
+                            {
+                                return false;
+                            }
+                        } while (Accept(','));
+                        phis.push_back({in, from});
+                        return true;
+                    }
+                    case Op::kAddrIndex:
+                        if (!ParseType(in->type) || !Operand(in) || !Expect(',') || !Operand(in))
+                        {
+                            return false;
+                        }
+                        if (Accept(','))
+                        {
+                            if (Atom() != "nocreate")
+                            {
+                                return Error("expected nocreate");
+                            }
+                            in->imm = 1;
+                        }
+                        return true;
+                    case Op::kStore:
+                    case Op::kRet:
+                        return Values(in, 0);
+                    case Op::kJump:
+                        return Target(in);
+                    case Op::kBranch:
+                        return Operand(in) && Expect(',') && Target(in) && Expect(',') && Target(in);
+                    default:
+                        return ParseType(in->type) && Values(in, 0);
+                    }
+                }
+            };
+        }
+
+        bool Parse(const string_t &text, Module &m, compiler::Diagnostics &diag)
+        {
+            return Parser(text, m, diag).Run();
+        }
+    }
+}
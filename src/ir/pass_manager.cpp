@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include "./pass_manager.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            typedef std::chrono::steady_clock Clock;
+
+            double Since(Clock::time_point start)
+            {
+                return std::chrono::duration<double>(Clock::now() - start).count();
+            }
+
+            const char *kAnalysisNames[] = {"dominators", "liveness"};
+
+            const uint32_t kDom = Bit(Analysis::kDominators);
+
+            // gvn and dce replace and remove instructions, never an edge
+            const PassInfo kPasses[] = {
+                {"sccp", [](Function &f, Analyses &) { return SCCP(f); }, 0, 0},
+                {"dce", [](Function &f, Analyses &) { return DCE(f); }, 0, kDom},
+                {"gvn", [](Function &f, Analyses &a) { return GVN(f, a.Dom()); }, kDom, kDom},
+                {"simplifycfg", [](Function &f, Analyses &) { return SimplifyCFG(f); }, 0, 0},
+            };
+        }
+
+        const PassInfo *FindPass(const string_t &name)
+        {
+            for (auto &p : kPasses)
+            {
+                if (name == p.name)
+                {
+                    return &p;
+                }
+            }
+            return nullptr;
+        }
+
+        //********************************************************************
+        // analyses
+        //********************************************************************
+
+        const Dominators &Analyses::Dom()
+        {
+            if (dom == nullptr)
+            {
+                auto start = Clock::now();
+                dom.reset(new Dominators(f));
+                auto &c = counters[static_cast<int>(Analysis::kDominators)];
+                c.computed++;
+                c.seconds += Since(start);
+            }
+            return *dom;
+        }
+
+        const Liveness &Analyses::Live()
+        {
+            if (live == nullptr)
+            {
+                auto start = Clock::now();
+                live.reset(new Liveness(f));
+                auto &c = counters[static_cast<int>(Analysis::kLiveness)];
+                c.computed++;
+                c.seconds += Since(start);
+            }
+            return *live;
+        }
+
+        void Analyses::Require(uint32_t mask)
+        {
+            if (mask & Bit(Analysis::kDominators))
+            {
+                Dom();
+            }
+            if (mask & Bit(Analysis::kLiveness))
+            {
+                Live();
+            }
+        }
+
+        void Analyses::Invalidate(uint32_t keep)
+        {
+            if (!(keep & Bit(Analysis::kDominators)))
+            {
+                dom.reset();
+            }
+            if (!(keep & Bit(Analysis::kLiveness)))
+            {
+                live.reset();
+            }
+        }
+
+        bool Analyses::Cached(Analysis a) const
+        {
+            return a == Analysis::kDominators ? dom != nullptr : live != nullptr;
+        }
+
+        //********************************************************************
+        // pipelines
+        //********************************************************************
+
+        bool PassManager::SetLevel(int level)
+        {
+            switch (level)
+            {
+            case 0:
+                pipeline.clear();
+                rounds = 1;
+                return true;
+            case 1:
+                rounds = 1;
+                return SetPipeline("simplifycfg,sccp,dce");
+            case 2:
+                rounds = kDefaultRounds;
+                return SetPipeline("sccp,gvn,dce,simplifycfg");
+            default:
+                diag.Report(compiler::Phase::kIr, 0, 0, "unknown optimization level " + std::to_string(level));
+                return false;
+            }
+        }
+
+        bool PassManager::SetPipeline(const string_t &names)
+        {
+            std::vector<const PassInfo *> passes;
+            size_t start = 0;
+            while (start < names.size())
+            {
+                auto end = names.find(',', start);
+                end = end == string_t::npos ? names.size() : end;
+                auto name = names.substr(start, end - start);
+                auto p = FindPass(name);
+                if (p == nullptr)
+                {
+                    diag.Report(compiler::Phase::kIr, 0, 0, "unknown pass '" + name + "'");
+                    return false;
+                }
+                passes.push_back(p);
+                start = end + 1;
+            }
+            pipeline = passes;
+            return true;
+        }
+
+        void PassManager::SetRounds(int n)
+        {
+            rounds = std::max(n, 1);
+        }
+
+        void PassManager::SetVerify(bool v)
+        {
+            verify = v;
+        }
+
+        bool PassManager::ParseArg(const string_t &arg)
+        {
+            if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0)
+            {
+                return SetLevel(arg[2] - '0');
+            }
+            if (arg.compare(0, 9, "--passes=") == 0)
+            {
+                return SetPipeline(arg.substr(9));
+            }
+            if (arg.compare(0, 9, "--rounds=") == 0)
+            {
+                SetRounds(std::atoi(arg.c_str() + 9));
+                return true;
+            }
+            if (arg == "--verify")
+            {
+                SetVerify(true);
+                return true;
+            }
+            return false;
+        }
+
+        Analyses &PassManager::Of(const Function &f)
+        {
+            auto &a = cache[&f];
+            if (a == nullptr)
+            {
+                a.reset(new Analyses(f));
+            }
+            return *a;
+        }
+
+        bool PassManager::Run(Module &m)
+        {
+            stats.clear();
+            for (auto &c : cache)
+            {
+                for (auto &counter : c.second->counters)
+                {
+                    counter = Analyses::Counter();
+                }
+            }
+            size_before = size_after = 0;
+            seconds = 0;
+            for (auto &f : m.functions)
+            {
+                if (!Run(f))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool PassManager::Run(Function &f)
+        {
+            auto start = Clock::now();
+            std::unordered_map<const PassInfo *, size_t> rows;
+            for (auto &s : stats)
+            {
+                rows[FindPass(s.name)] = &s - &stats[0];
+            }
+            for (auto p : pipeline)
+            {
+                if (rows.count(p) == 0)
+                {
+                    rows[p] = stats.size();
+                    stats.emplace_back();
+                    stats.back().name = p->name;
+                }
+            }
+            size_before += f.Size();
+            auto &a = Of(f);
+            bool changed = true;
+            for (int round = 0; round < rounds && changed; round++)
+            {
+                changed = false;
+                for (auto p : pipeline)
+                {
+                    auto &s = stats[rows[p]];
+                    a.Require(p->needs);
+                    auto size = f.Size();
+                    auto t = Clock::now();
+                    bool c = p->run(f, a);
+                    s.seconds += Since(t);
+                    s.runs++;
+                    s.removed += static_cast<int64_t>(size) - static_cast<int64_t>(f.Size());
+                    if (!c)
+                    {
+                        continue;
+                    }
+                    s.changed++;
+                    changed = true;
+                    a.Invalidate(p->preserves);
+                    if (verify && !Verify(f, diag))
+                    {
+                        diag.Report(compiler::Phase::kIr, 0, 0,
+                                    string_t("pass ") + p->name + " broke the invariants of " + f.name);
+                        return false;
+                    }
+                }
+            }
+            size_after += f.Size();
+            seconds += Since(start);
+            return true;
+        }
+
+        //********************************************************************
+        // report
+        //********************************************************************
+
+        std::vector<PassManager::Stat> PassManager::Report() const
+        {
+            auto report = stats;
+            for (int i = 0; i < static_cast<int>(Analysis::kCount); i++)
+            {
+                Stat s;
+                s.name = kAnalysisNames[i];
+                for (auto &c : cache)
+                {
+                    s.runs += c.second->counters[i].computed;
+                    s.seconds += c.second->counters[i].seconds;
+                }
+                report.push_back(s);
+            }
+            return report;
+        }
+
+        void PassManager::PrintReport(std::ostream &out) const
+        {
+            auto flags = out.flags();
+            auto precision = out.precision();
+            out << std::fixed << std::setprecision(3);
+            out << "pass            runs  changed        ms    removed" << std::endl;
+            for (auto &s : Report())
+            {
+                out << std::left << std::setw(14) << s.name << std::right << std::setw(6) << s.runs << std::setw(9)
+                    << s.changed << std::setw(10) << s.seconds * 1000 << std::setw(11) << s.removed << std::endl;
+            }
+            out << "total" << std::setw(34) << seconds * 1000 << std::setw(11)
+                << static_cast<int64_t>(size_before) - static_cast<int64_t>(size_after) << "    " << size_before
+                << " -> " << size_after << " instructions" << std::endl;
+            out.flags(flags);
+            out.precision(precision);
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef LILANG_IR_PASS_MANAGER
+#define LILANG_IR_PASS_MANAGER
+
+#include "./liveness.h"
+#include "./passes.h"
+
+/*
+pipelines of passes over the functions of a module
+
+a pipeline is a list of pass names run over each function in turn, again
+until a round changes nothing or the round limit is reached. -O0 runs
+nothing, -O1 one round of the cheap cleanups, -O2 every pass until the
+function settles.
+
+analyses are cached per function. one is computed when a pass, or a
+backend after the pipeline, first asks for it and is kept until a pass
+changes the function. a pass names the analyses it needs, computed before
+it runs, and the ones its changes keep valid: dce removes instructions but
+no edge, so the dominators stay.
+
+passes and analyses are timed, and the instructions each pass removes are
+counted, so the report shows where compile time goes and what it bought.
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        enum class Analysis : uint8_t
+        {
+            kDominators,
+            kLiveness,
+            kCount,
+        };
+
+        inline uint32_t Bit(Analysis a) { return 1u << static_cast<int>(a); }
+
+        // the analyses of one function, computed on demand
+        class Analyses
+        {
+        public:
+            struct Counter
+            {
+                int computed = 0;
+                double seconds = 0;
+            };
+
+            explicit Analyses(const Function &f) : f(f) {}
+
+            const Dominators &Dom();
+            const Liveness &Live();
+            void Require(uint32_t mask);
+            // drops every analysis not in keep
+            void Invalidate(uint32_t keep);
+            bool Cached(Analysis) const;
+
+        private:
+            friend class PassManager;
+
+            const Function &f;
+            std::unique_ptr<Dominators> dom;
+            std::unique_ptr<Liveness> live;
+            Counter counters[static_cast<int>(Analysis::kCount)];
+        };
+
+        struct PassInfo
+        {
+            const char *name;
+            bool (*run)(Function &, Analyses &);
+            uint32_t needs;     // computed before it runs
+            uint32_t preserves; // still valid when it changed the function
+        };
+
+        // nullptr for an unknown name
+        const PassInfo *FindPass(const string_t &name);
+
+        class PassManager
+        {
+        public:
+            struct Stat
+            {
+                string_t name;
+                int runs = 0;
+                int changed = 0; // runs that changed the function
+                double seconds = 0;
+                int64_t removed = 0; // instructions, negative when they were added
+            };
+
+            static const int kDefaultRounds = 8;
+
+            explicit PassManager(compiler::Diagnostics &diag) : diag(diag) {}
+
+            // 0, 1 or 2, sets the pipeline and the rounds
+            bool SetLevel(int);
+            // pass names separated by commas
+            bool SetPipeline(const string_t &);
+            void SetRounds(int);
+            // verifies a function after each pass that changed it
+            void SetVerify(bool);
+            // -O2, --passes=sccp,dce, --rounds=1 or --verify
+            bool ParseArg(const string_t &);
+
+            bool Run(Module &);
+            // one function, adding to the report of the last run
+            bool Run(Function &);
+            // valid until a pass changes f
+            Analyses &Of(const Function &f);
+
+            // of the last run, passes in pipeline order then the analyses
+            std::vector<Stat> Report() const;
+            void PrintReport(std::ostream &) const;
+
+        private:
+            compiler::Diagnostics &diag;
+            std::vector<const PassInfo *> pipeline;
+            int rounds = 1;
+            bool verify = false;
+            std::unordered_map<const Function *, std::unique_ptr<Analyses>> cache;
+            std::vector<Stat> stats; // by pass name, first run first
+            size_t size_before = 0, size_after = 0;
+            double seconds = 0;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LILANG_IR_PASSES
+#define LILANG_IR_PASSES
+
+#include "./dominators.h"
+
+/*
+optimizations on one function of the ir
+
+each pass keeps the invariants Verify checks and returns whether it changed
+anything, so a driver can repeat them until nothing moves.
+
+SCCP    sparse conditional constant propagation: values and branches known
+        at compile time, on the executable edges only. constants replace
+        the values, a branch on a constant becomes a jump and the blocks no
+        longer reached are removed.
+DCE     removes what no effect depends on, cycles of phis included.
+GVN     an expression already computed in a dominating block, with the same
+        operands, is not computed again.
+        commutative operands are ordered first.
+SimplifyCFG
+        folds constant branches, merges a block into its only predecessor,
+        skips blocks that only jump and removes phis of a single value.
+
+none of them moves a trap: a division by a value that may be zero, a
+conversion that may overflow, a call or a memory access stays where it is.
+*/
+namespace lilang
+{
+    namespace ir
+    {
+        bool SCCP(Function &);
+        bool DCE(Function &);
+        bool GVN(Function &);
+        bool GVN(Function &, const Dominators &); // dom is of f as it is
+        bool SimplifyCFG(Function &);
+    }
+}
+
+#endif
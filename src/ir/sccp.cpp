@@ -0,0 +1,294 @@
+#include <set>
+#include <unordered_set>
+#include "./passes.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            int64_t Wrap(uint64_t u) { return static_cast<int64_t>(u); }
+
+            bool InIntRange(double f)
+            {
+                return f > -9223372036854775808.0 && f < 9223372036854775808.0;
+            }
+
+            // the constant an instruction computes from constant operands, nullptr
+            // when it traps or is not computed at compile time; as the engines do
+            Instr *Fold(Function &f, const Instr *in, const std::vector<Instr *> &args)
+            {
+                auto a = args.size() > 0 ? args[0] : nullptr;
+                auto b = args.size() > 1 ? args[1] : nullptr;
+                bool floats = a != nullptr && a->type == Type::kF64;
+                switch (in->op)
+                {
+                case Op::kAdd:
+                    return floats ? f.Float(a->F() + b->F()) : f.Int(Wrap(static_cast<uint64_t>(a->imm) + b->imm));
+                case Op::kSub:
+                    return floats ? f.Float(a->F() - b->F()) : f.Int(Wrap(static_cast<uint64_t>(a->imm) - b->imm));
+                case Op::kMul:
+                    return floats ? f.Float(a->F() * b->F()) : f.Int(Wrap(static_cast<uint64_t>(a->imm) * b->imm));
+                case Op::kDiv:
+                    if (floats)
+                    {
+                        return f.Float(a->F() / b->F());
+                    }
+                    if (b->imm == 0)
+                    {
+                        return nullptr;
+                    }
+                    // INT64_MIN / -1 wraps around
+                    return f.Int(b->imm == -1 ? Wrap(0 - static_cast<uint64_t>(a->imm)) : a->imm / b->imm);
+                case Op::kMod:
+                    if (b->imm == 0)
+                    {
+                        return nullptr;
+                    }
+                    return f.Int(b->imm == -1 ? 0 : a->imm % b->imm);
+                case Op::kAnd:
+                    return f.Int(a->imm & b->imm);
+                case Op::kOr:
+                    return f.Int(a->imm | b->imm);
+                case Op::kXor:
+                    return f.Int(a->imm ^ b->imm);
+                case Op::kNeg:
+                    return floats ? f.Float(-a->F()) : f.Int(Wrap(0 - static_cast<uint64_t>(a->imm)));
+                case Op::kBitNot:
+                    return f.Int(~a->imm);
+                case Op::kNot:
+                    return f.Bool(!a->imm);
+                case Op::kEq:
+                case Op::kNe:
+                case Op::kLt:
+                case Op::kLe:
+                {
+                    bool r;
+                    if (floats)
+                    {
+                        double x = a->F(), y = b->F();
+                        r = in->op == Op::kEq ? x == y : in->op == Op::kNe ? x != y : in->op == Op::kLt ? x < y : x <= y;
+                    }
+                    else if (a->type == Type::kI64 || a->type == Type::kBool)
+                    {
+                        int64_t x = a->imm, y = b->imm;
+                        r = in->op == Op::kEq ? x == y : in->op == Op::kNe ? x != y : in->op == Op::kLt ? x < y : x <= y;
+                    }
+                    else
+                    {
+                        return nullptr; // references are compared at run time
+                    }
+                    return f.Bool(r);
+                }
+                case Op::kI2F:
+                    return f.Float(static_cast<double>(a->imm));
+                case Op::kF2I:
+                    return InIntRange(a->F()) ? f.Int(static_cast<int64_t>(a->F())) : nullptr;
+                default:
+                    return nullptr;
+                }
+            }
+
+            class Propagation
+            {
+            public:
+                explicit Propagation(Function &f) : f(f) {}
+
+                bool Run()
+                {
+                    for (auto &b : f.blocks)
+                    {
+                        for (auto in : b->instrs)
+                        {
+                            for (auto a : in->args)
+                            {
+                                users[a].push_back(in);
+                            }
+                        }
+                    }
+                    Reach(nullptr, f.Entry());
+                    while (!blocks.empty() || !values.empty())
+                    {
+                        while (!values.empty())
+                        {
+                            auto in = values.back();
+                            values.pop_back();
+                            if (executable.count(in->block) != 0)
+                            {
+                                Visit(in);
+                            }
+                        }
+                        if (!blocks.empty())
+                        {
+                            auto b = blocks.back();
+                            blocks.pop_back();
+                            for (auto in : b->instrs)
+                            {
+                                Visit(in);
+                            }
+                        }
+                    }
+                    return Rewrite();
+                }
+
+            private:
+                // a value missing from lattice is unknown yet, nullptr is not a constant
+                Function &f;
+                std::unordered_map<Instr *, Instr *> lattice;
+                std::unordered_map<Instr *, std::vector<Instr *>> users;
+                std::unordered_set<Block *> executable;
+                std::set<std::pair<Block *, Block *>> edges;
+                std::vector<Block *> blocks;
+                std::vector<Instr *> values;
+
+                bool Known(Instr *in) const { return in->IsConst() || lattice.count(in) != 0; }
+                Instr *Get(Instr *in) const { return in->IsConst() ? in : lattice.at(in); }
+
+                void Reach(Block *from, Block *to)
+                {
+                    if (!edges.insert({from, to}).second)
+                    {
+                        return;
+                    }
+                    if (executable.insert(to).second)
+                    {
+                        blocks.push_back(to);
+                        return;
+                    }
+                    // a new edge into a visited block changes its phis only
+                    for (auto in : to->instrs)
+                    {
+                        if (in->op != Op::kPhi)
+                        {
+                            break;
+                        }
+                        Visit(in);
+                    }
+                }
+
+                void Set(Instr *in, Instr *v)
+                {
+                    auto it = lattice.find(in);
+                    if (it != lattice.end())
+                    {
+                        if (it->second == v || it->second == nullptr)
+                        {
+                            return;
+                        }
+                        v = nullptr; // a second constant, it is not one
+                    }
+                    lattice[in] = v;
+                    for (auto u : users[in])
+                    {
+                        values.push_back(u);
+                    }
+                }
+
+                void Visit(Instr *in)
+                {
+                    switch (in->op)
+                    {
+                    case Op::kPhi:
+                    {
+                        auto b = in->block;
+                        for (size_t i = 0; i < in->args.size(); i++)
+                        {
+                            if (edges.count({b->preds[i], b}) == 0 || !Known(in->args[i]))
+                            {
+                                continue;
+                            }
+                            Set(in, Get(in->args[i]));
+                        }
+                        return;
+                    }
+                    case Op::kJump:
+                        Reach(in->block, in->targets[0]);
+                        return;
+                    case Op::kBranch:
+                    {
+                        if (!Known(in->args[0]))
+                        {
+                            return;
+                        }
+                        auto c = Get(in->args[0]);
+                        if (c == nullptr || !c->imm)
+                        {
+                            Reach(in->block, in->targets[1]);
+                        }
+                        if (c == nullptr || c->imm)
+                        {
+                            Reach(in->block, in->targets[0]);
+                        }
+                        return;
+                    }
+                    case Op::kRet:
+                        return;
+                    default:
+                        break;
+                    }
+                    if (in->type == Type::kVoid)
+                    {
+                        return;
+                    }
+                    if (!in->IsPure() || in->op == Op::kExtract || in->op == Op::kAddrGlobal)
+                    {
+                        Set(in, nullptr);
+                        return;
+                    }
+                    std::vector<Instr *> args;
+                    for (auto a : in->args)
+                    {
+                        if (!Known(a))
+                        {
+                            return; // waits for the operand
+                        }
+                        if (Get(a) == nullptr)
+                        {
+                            Set(in, nullptr);
+                            return;
+                        }
+                        args.push_back(Get(a));
+                    }
+                    Set(in, Fold(f, in, args));
+                }
+
+                bool Rewrite()
+                {
+                    bool changed = false;
+                    std::unordered_map<Instr *, Instr *> with;
+                    for (auto &l : lattice)
+                    {
+                        if (l.second != nullptr && l.first->block != nullptr &&
+                            executable.count(l.first->block) != 0)
+                        {
+                            with[l.first] = l.second;
+                        }
+                    }
+                    changed = !with.empty();
+                    f.Replace(with);
+                    for (auto &b : f.blocks)
+                    {
+                        auto t = b->Terminator();
+                        if (executable.count(b.get()) == 0 || t->op != Op::kBranch || !t->args[0]->IsConst())
+                        {
+                            continue;
+                        }
+                        auto taken = t->targets[t->args[0]->imm ? 0 : 1];
+                        f.RemovePred(t->targets[t->args[0]->imm ? 1 : 0], b.get());
+                        t->op = Op::kJump;
+                        t->args.clear();
+                        t->targets = {taken};
+                        changed = true;
+                    }
+                    return f.RemoveUnreachable() || changed;
+                }
+            };
+        }
+
+        bool SCCP(Function &f)
+        {
+            return Propagation(f).Run();
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include "./passes.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            // a branch on a constant jumps
+            bool FoldBranches(Function &f)
+            {
+                bool changed = false;
+                for (auto &b : f.blocks)
+                {
+                    auto t = b->Terminator();
+                    if (t->op != Op::kBranch || !t->args[0]->IsConst())
+                    {
+                        continue;
+                    }
+                    bool cond = t->args[0]->imm != 0;
+                    f.RemovePred(t->targets[cond ? 1 : 0], b.get());
+                    t->op = Op::kJump;
+                    t->args.clear();
+                    t->targets = {t->targets[cond ? 0 : 1]};
+                    changed = true;
+                }
+                return changed;
+            }
+
+            // phis whose operands are one value besides themselves
+            bool RemoveTrivialPhis(Function &f)
+            {
+                std::unordered_map<Instr *, Instr *> with;
+                for (auto &b : f.blocks)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        if (in->op != Op::kPhi)
+                        {
+                            break;
+                        }
+                        Instr *same = nullptr;
+                        bool trivial = true;
+                        for (auto a : in->args)
+                        {
+                            if (a == in || a == same)
+                            {
+                                continue;
+                            }
+                            trivial = trivial && same == nullptr;
+                            same = a;
+                        }
+                        if (trivial && same != nullptr)
+                        {
+                            with[in] = same;
+                        }
+                    }
+                }
+                f.Replace(with);
+                return !with.empty();
+            }
+
+            // b jumps to a block only it reaches: the block is appended to b
+            bool Merge(Function &f)
+            {
+                bool changed = false;
+                for (size_t i = 0; i < f.blocks.size(); i++)
+                {
+                    auto b = f.blocks[i].get();
+                    auto t = b->Terminator();
+                    if (t->op != Op::kJump)
+                    {
+                        continue;
+                    }
+                    auto next = t->targets[0];
+                    if (next == b || next->preds.size() != 1 || next == f.Entry())
+                    {
+                        continue;
+                    }
+                    std::unordered_map<Instr *, Instr *> with;
+                    for (auto in : next->instrs)
+                    {
+                        if (in->op == Op::kPhi)
+                        {
+                            with[in] = in->args[0];
+                        }
+                    }
+                    f.Replace(with);
+                    f.Remove(t);
+                    for (auto in : next->instrs)
+                    {
+                        in->block = b;
+                        b->instrs.push_back(in);
+                    }
+                    next->instrs.clear();
+                    for (auto s : b->Succs())
+                    {
+                        std::replace(s->preds.begin(), s->preds.end(), next, b);
+                    }
+                    f.blocks.erase(std::find_if(f.blocks.begin(), f.blocks.end(),
+                                                [&](const std::unique_ptr<Block> &p) { return p.get() == next; }));
+                    changed = true;
+                    i = static_cast<size_t>(-1); // the indices moved, start over
+                }
+                return changed;
+            }
+
+            // a block holding a jump only is skipped by its preds, when the
+            // target gets no second edge from one of them
+            bool Forward(Function &f)
+            {
+                bool changed = false;
+                for (auto &e : f.blocks)
+                {
+                    auto b = e.get();
+                    if (b == f.Entry() || b->instrs.size() != 1 || b->instrs[0]->op != Op::kJump)
+                    {
+                        continue;
+                    }
+                    auto to = b->instrs[0]->targets[0];
+                    if (to == b)
+                    {
+                        continue;
+                    }
+                    size_t from = to->PredIndex(b);
+                    auto preds = b->preds;
+                    for (auto p : preds)
+                    {
+                        if (to->PredIndex(p) != to->preds.size())
+                        {
+                            continue; // the phis of to would need two values for p
+                        }
+                        auto &targets = p->Terminator()->targets;
+                        std::replace(targets.begin(), targets.end(), b, to);
+                        b->preds.erase(std::find(b->preds.begin(), b->preds.end(), p));
+                        to->preds.push_back(p);
+                        for (auto in : to->instrs)
+                        {
+                            if (in->op != Op::kPhi)
+                            {
+                                break;
+                            }
+                            in->args.push_back(in->args[from]);
+                        }
+                        changed = true;
+                    }
+                }
+                return changed;
+            }
+        }
+
+        bool SimplifyCFG(Function &f)
+        {
+            bool changed = false;
+            for (bool again = true; again;)
+            {
+                again = FoldBranches(f);
+                again = f.RemoveUnreachable() || again;
+                again = RemoveTrivialPhis(f) || again;
+                again = Merge(f) || again;
+                again = Forward(f) || again;
+                changed = changed || again;
+            }
+            return changed;
+        }
+    }
+}
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <unordered_set>
+#include "./dominators.h"
+
+namespace lilang
+{
+    namespace ir
+    {
+        namespace
+        {
+            class Verifier
+            {
+            public:
+                Verifier(const Function &f, const Module *m, compiler::Diagnostics &d) : f(f), module(m), diag(d) {}
+
+                bool Run()
+                {
+                    if (f.blocks.empty())
+                    {
+                        Error(nullptr, nullptr, "has no blocks");
+                        return ok;
+                    }
+                    for (auto &b : f.blocks)
+                    {
+                        blocks.insert(b.get());
+                        for (auto in : b->instrs)
+                        {
+                            place[in] = b.get();
+                        }
+                    }
+                    for (auto &b : f.blocks)
+                    {
+                        Edges(b.get());
+                    }
+                    if (!ok)
+                    {
+                        return ok; // dominators need sound edges
+                    }
+                    Dominators dom(f);
+                    for (auto &b : f.blocks)
+                    {
+                        for (size_t i = 0; i < b->instrs.size(); i++)
+                        {
+                            Check(dom, b.get(), i);
+                        }
+                    }
+                    return ok;
+                }
+
+            private:
+                const Function &f;
+                const Module *module;
+                compiler::Diagnostics &diag;
+                std::unordered_set<const Block *> blocks;
+                std::unordered_map<const Instr *, const Block *> place;
+                bool ok = true;
+
+                void Error(const Block *b, const Instr *in, const string_t &msg)
+                {
+                    string_t where = "fn " + f.name;
+                    if (b != nullptr)
+                    {
+                        where += ", b" + std::to_string(b->id);
+                    }
+                    if (in != nullptr)
+                    {
+                        where += ", " + string_t(OpName(in->op)) + " #" + std::to_string(in->id);
+                    }
+                    diag.Report(compiler::Phase::kIr, 0, 0, where + ": " + msg);
+                    ok = false;
+                }
+
+                void Edges(const Block *b)
+                {
+                    auto t = b->Terminator();
+                    if (t == nullptr)
+                    {
+                        Error(b, nullptr, "does not end with a terminator");
+                        return;
+                    }
+                    size_t want = t->op == Op::kJump ? 1 : t->op == Op::kBranch ? 2 : 0;
+                    if (t->targets.size() != want)
+                    {
+                        Error(b, t, "has " + std::to_string(t->targets.size()) + " targets");
+                        return;
+                    }
+                    if (want == 2 && t->targets[0] == t->targets[1])
+                    {
+                        Error(b, t, "branches twice to the same block");
+                    }
+                    for (auto s : t->targets)
+                    {
+                        if (blocks.count(s) == 0)
+                        {
+                            Error(b, t, "targets a block of no function");
+                            continue;
+                        }
+                        if (s == f.Entry())
+                        {
+                            Error(b, t, "targets the entry");
+                        }
+                        if (s->PredIndex(b) == s->preds.size())
+                        {
+                            Error(b, t, "targets b" + std::to_string(s->id) + " which does not list it as a pred");
+                        }
+                    }
+                    std::unordered_set<const Block *> preds;
+                    for (auto p : b->preds)
+                    {
+                        if (!preds.insert(p).second)
+                        {
+                            Error(b, nullptr, "lists a pred twice");
+                        }
+                        if (blocks.count(p) == 0 ||
+                            std::find(p->Succs().begin(), p->Succs().end(), b) == p->Succs().end())
+                        {
+                            Error(b, nullptr, "lists a pred that does not branch to it");
+                        }
+                    }
+                }
+
+                void Check(const Dominators &dom, const Block *b, size_t i)
+                {
+                    auto in = b->instrs[i];
+                    if (in->block != b)
+                    {
+                        Error(b, in, "does not know its block");
+                    }
+                    if (in->IsTerminator() != (i + 1 == b->instrs.size()))
+                    {
+                        Error(b, in, in->IsTerminator() ? "is a terminator before the end" : "is not a terminator");
+                    }
+                    if (in->op == Op::kPhi && i > 0 && b->instrs[i - 1]->op != Op::kPhi)
+                    {
+                        Error(b, in, "follows an instruction that is not a phi");
+                    }
+                    if ((in->op == Op::kParam || in->op == Op::kSlot) && b != f.Entry())
+                    {
+                        Error(b, in, "is not in the entry");
+                    }
+                    if (in->op == Op::kPhi && in->args.size() != b->preds.size())
+                    {
+                        Error(b, in, "has " + std::to_string(in->args.size()) + " operands for " +
+                                         std::to_string(b->preds.size()) + " preds");
+                        return;
+                    }
+                    for (size_t k = 0; k < in->args.size(); k++)
+                    {
+                        auto a = in->args[k];
+                        if (a == nullptr)
+                        {
+                            Error(b, in, "has no operand " + std::to_string(k));
+                            return;
+                        }
+                        if (a->IsConst())
+                        {
+                            continue;
+                        }
+                        auto it = place.find(a);
+                        if (it == place.end())
+                        {
+                            Error(b, in, "uses #" + std::to_string(a->id) + " which is in no block");
+                            continue;
+                        }
+                        if (a->type == Type::kVoid)
+                        {
+                            Error(b, in, "uses #" + std::to_string(a->id) + " which has no value");
+                        }
+                        // an operand of a phi must be available at the end of its pred
+                        auto at = in->op == Op::kPhi ? b->preds[k] : b;
+                        if (!dom.Reachable(at))
+                        {
+                            continue;
+                        }
+                        bool before = it->second != at || in->op == Op::kPhi ||
+                                      std::find(b->instrs.begin(), b->instrs.begin() + i, a) != b->instrs.begin() + i;
+                        if (!dom.Dominates(it->second, at) || !before)
+                        {
+                            Error(b, in, "uses #" + std::to_string(a->id) + " where it is not defined");
+                        }
+                    }
+                    Types(b, in);
+                }
+
+                void Operands(const Block *b, const Instr *in, std::initializer_list<Type> want)
+                {
+                    if (in->args.size() != want.size())
+                    {
+                        Error(b, in, "has " + std::to_string(in->args.size()) + " operands");
+                        return;
+                    }
+                    size_t k = 0;
+                    for (auto t : want)
+                    {
+                        if (in->args[k]->type != t)
+                        {
+                            Error(b, in, "operand " + std::to_string(k) + " is " + TypeName(in->args[k]->type) +
+                                             ", not " + TypeName(t));
+                        }
+                        k++;
+                    }
+                }
+
+                void Result(const Block *b, const Instr *in, Type t)
+                {
+                    if (in->type != t)
+                    {
+                        Error(b, in, string_t("is ") + TypeName(in->type) + ", not " + TypeName(t));
+                    }
+                }
+
+                void Call(const Block *b, const Instr *in, const std::vector<Type> &params,
+                          const std::vector<Type> &returns, size_t first)
+                {
+                    if (in->args.size() - first != params.size())
+                    {
+                        Error(b, in, "passes " + std::to_string(in->args.size() - first) + " arguments for " +
+                                         std::to_string(params.size()));
+                        return;
+                    }
+                    for (size_t k = 0; k < params.size(); k++)
+                    {
+                        if (in->args[first + k]->type != params[k])
+                        {
+                            Error(b, in, "argument " + std::to_string(k) + " is " +
+                                             TypeName(in->args[first + k]->type));
+                        }
+                    }
+                    bool same = returns.size() == 0   ? in->type == Type::kVoid
+                                : returns.size() == 1 ? in->type == returns[0]
+                                                      : in->type == Type::kTuple && in->results == returns;
+                    if (!same)
+                    {
+                        Error(b, in, "does not have the type the callee returns");
+                    }
+                }
+
+                void Types(const Block *b, const Instr *in)
+                {
+                    auto t = in->type;
+                    switch (in->op)
+                    {
+                    case Op::kConst:
+                        Error(b, in, "is a constant in a block");
+                        break;
+                    case Op::kParam:
+                        if (in->imm < 0 || static_cast<size_t>(in->imm) >= f.params.size() ||
+                            f.params[in->imm] != t)
+                        {
+                            Error(b, in, "is not a param of the function");
+                        }
+                        break;
+                    case Op::kAdd:
+                    case Op::kSub:
+                    case Op::kMul:
+                    case Op::kDiv:
+                        if (t != Type::kI64 && t != Type::kF64)
+                        {
+                            Error(b, in, "is not a number");
+                        }
+                        Operands(b, in, {t, t});
+                        break;
+                    case Op::kMod:
+                    case Op::kAnd:
+                    case Op::kOr:
+                    case Op::kXor:
+                        Result(b, in, Type::kI64);
+                        Operands(b, in, {Type::kI64, Type::kI64});
+                        break;
+                    case Op::kNeg:
+                        if (t != Type::kI64 && t != Type::kF64)
+                        {
+                            Error(b, in, "is not a number");
+                        }
+                        Operands(b, in, {t});
+                        break;
+                    case Op::kBitNot:
+                        Result(b, in, Type::kI64);
+                        Operands(b, in, {Type::kI64});
+                        break;
+                    case Op::kNot:
+                        Result(b, in, Type::kBool);
+                        Operands(b, in, {Type::kBool});
+                        break;
+                    case Op::kEq:
+                    case Op::kNe:
+                    case Op::kLt:
+                    case Op::kLe:
+                        Result(b, in, Type::kBool);
+                        if (in->args.size() == 2)
+                        {
+                            Operands(b, in, {in->args[0]->type, in->args[0]->type});
+                        }
+                        else
+                        {
+                            Operands(b, in, {Type::kI64, Type::kI64});
+                        }
+                        break;
+                    case Op::kI2F:
+                        Result(b, in, Type::kF64);
+                        Operands(b, in, {Type::kI64});
+                        break;
+                    case Op::kF2I:
+                        Result(b, in, Type::kI64);
+                        Operands(b, in, {Type::kF64});
+                        break;
+                    case Op::kPhi:
+                        for (auto a : in->args)
+                        {
+                            if (a->type != t)
+                            {
+                                Error(b, in, string_t("has a ") + TypeName(a->type) + " operand");
+                            }
+                        }
+                        break;
+                    case Op::kGetGlobal:
+                    case Op::kAddrGlobal:
+                    case Op::kSetGlobal:
+                        if (module != nullptr &&
+                            (in->imm < 0 || static_cast<size_t>(in->imm) >= module->globals.size()))
+                        {
+                            Error(b, in, "names no global");
+                        }
+                        else if (module != nullptr && in->op == Op::kGetGlobal)
+                        {
+                            Result(b, in, module->globals[in->imm]);
+                        }
+                        else if (module != nullptr && in->op == Op::kSetGlobal)
+                        {
+                            Operands(b, in, {module->globals[in->imm]});
+                        }
+                        break;
+                    case Op::kCall:
+                        if (in->fn == nullptr)
+                        {
+                            Error(b, in, "has no callee");
+                            break;
+                        }
+                        Call(b, in, in->fn->params, in->fn->returns, 0);
+                        break;
+                    case Op::kCallValue:
+                        if (in->args.empty() || in->args[0]->type != Type::kRef)
+                        {
+                            Error(b, in, "calls a value that is not a function");
+                        }
+                        break;
+                    case Op::kExtract:
+                        if (in->args.size() != 1 || in->args[0]->type != Type::kTuple || in->imm < 0 ||
+                            static_cast<size_t>(in->imm) >= in->args[0]->results.size())
+                        {
+                            Error(b, in, "does not extract a result of a call");
+                        }
+                        else
+                        {
+                            Result(b, in, in->args[0]->results[in->imm]);
+                        }
+                        break;
+                    case Op::kNewArray:
+                    case Op::kSlot:
+                        Result(b, in, Type::kRef);
+                        Operands(b, in, {});
+                        break;
+                    case Op::kGetIndex:
+                        Operands(b, in, {Type::kRef, Type::kI64});
+                        break;
+                    case Op::kSetIndex:
+                        Result(b, in, Type::kRef);
+                        if (in->args.size() == 3)
+                        {
+                            Operands(b, in, {Type::kRef, Type::kI64, in->args[2]->type});
+                        }
+                        else
+                        {
+                            Operands(b, in, {Type::kRef, Type::kI64, Type::kVoid});
+                        }
+                        break;
+                    case Op::kAddrIndex:
+                        Result(b, in, Type::kRef);
+                        Operands(b, in, {Type::kRef, Type::kI64});
+                        break;
+                    case Op::kLoad:
+                        Operands(b, in, {Type::kRef});
+                        break;
+                    case Op::kStore:
+                        Result(b, in, Type::kVoid);
+                        if (in->args.size() == 2)
+                        {
+                            Operands(b, in, {Type::kRef, in->args[1]->type});
+                        }
+                        else
+                        {
+                            Operands(b, in, {Type::kRef, Type::kVoid});
+                        }
+                        break;
+                    case Op::kJump:
+                        Operands(b, in, {});
+                        break;
+                    case Op::kBranch:
+                        Operands(b, in, {Type::kBool});
+                        break;
+                    case Op::kRet:
+                        if (in->args.size() != f.returns.size())
+                        {
+                            Error(b, in, "returns " + std::to_string(in->args.size()) + " values for " +
+                                             std::to_string(f.returns.size()));
+                            break;
+                        }
+                        for (size_t k = 0; k < in->args.size(); k++)
+                        {
+                            if (in->args[k]->type != f.returns[k])
+                            {
+                                Error(b, in, "value " + std::to_string(k) + " is " + TypeName(in->args[k]->type));
+                            }
+                        }
+                        break;
+                    case Op::kCount:
+                        Error(b, in, "has no op");
+                        break;
+                    }
+                }
+            };
+        }
+
+        bool Verify(const Function &f, compiler::Diagnostics &diag)
+        {
+            return Verifier(f, nullptr, diag).Run();
+        }
+
+        bool Verify(const Module &m, compiler::Diagnostics &diag)
+        {
+            bool ok = true;
+            for (auto &f : m.functions)
+            {
+                ok = Verifier(f, &m, diag).Run() && ok;
+            }
+            return ok;
+        }
+    }
+}
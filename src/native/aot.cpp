@@ -0,0 +1,278 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "./aot.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            // the process entry and the routines the generated code calls, see codegen.h
+            const char *kRuntime = R"(	.text
+	.globl _start
+_start:
+	movq %rsp, %rax
+	subq $0x700000, %rax
+	movq %rax, __li_stack_limit(%rip)
+	andq $-16, %rsp
+	call __li_entry
+	# the result in decimal and a newline
+	subq $32, %rsp
+	leaq 31(%rsp), %rsi
+	movb $10, (%rsi)
+	movq %rax, %r8
+	movq %rax, %rcx
+	testq %rcx, %rcx
+	jns 1f
+	negq %rcx
+1:	movl $10, %r9d
+2:	movq %rcx, %rax
+	xorl %edx, %edx
+	divq %r9
+	addb $48, %dl
+	decq %rsi
+	movb %dl, (%rsi)
+	movq %rax, %rcx
+	testq %rcx, %rcx
+	jnz 2b
+	testq %r8, %r8
+	jns 3f
+	decq %rsi
+	movb $45, (%rsi)
+3:	leaq 32(%rsp), %rdx
+	subq %rsi, %rdx
+	movl $1, %edi
+	movl $1, %eax
+	syscall
+	xorl %edi, %edi
+	movl $231, %eax
+	syscall
+
+# rdi a nul terminated message, written to stderr with a newline, exits with 1
+__li_trap:
+	movq %rdi, %rsi
+	xorl %edx, %edx
+1:	cmpb $0, (%rsi,%rdx)
+	je 2f
+	incq %rdx
+	jmp 1b
+2:	movl $2, %edi
+	movl $1, %eax
+	syscall
+	leaq __li_newline(%rip), %rsi
+	movl $1, %edx
+	movl $2, %edi
+	movl $1, %eax
+	syscall
+	movl $1, %edi
+	movl $231, %eax
+	syscall
+
+# rdx bytes, a multiple of 8, zeroed in rax; keeps all but rdx and r11
+__li_alloc:
+	movq __li_heap(%rip), %rax
+	leaq (%rax,%rdx), %r11
+	cmpq __li_heap_end(%rip), %r11
+	ja 1f
+	movq %r11, __li_heap(%rip)
+	ret
+	# a new chunk of 1mb, a larger request gets its own
+1:	pushq %rcx
+	pushq %rsi
+	pushq %rdi
+	pushq %r8
+	pushq %r9
+	pushq %r10
+	pushq %rdx
+	movl $0x100000, %esi
+	cmpq %rsi, %rdx
+	jb 2f
+	movq %rdx, %rsi
+2:	pushq %rsi
+	xorl %edi, %edi
+	movl $3, %edx
+	movl $0x22, %r10d
+	movq $-1, %r8
+	xorl %r9d, %r9d
+	movl $9, %eax
+	syscall
+	popq %rsi
+	popq %rdx
+	cmpq $-4096, %rax
+	ja 4f
+	cmpq $0x100000, %rdx
+	jae 3f
+	leaq (%rax,%rdx), %r11
+	movq %r11, __li_heap(%rip)
+	leaq (%rax,%rsi), %r11
+	movq %r11, __li_heap_end(%rip)
+3:	popq %r10
+	popq %r9
+	popq %r8
+	popq %rdi
+	popq %rsi
+	popq %rcx
+	ret
+4:	leaq __li_out_of_memory(%rip), %rdi
+	jmp __li_trap
+
+# an empty array: its length and the segments 3 to 24
+__li_new_array:
+	movl $200, %edx
+	jmp __li_alloc
+
+# rax the array or nil, rcx the index, rdx 1 when nil is not created; rax the
+# array grown to hold the index, 0 when it is out of range
+__li_reserve:
+	cmpq $0x1000000, %rcx
+	jae 9f
+	testq %rax, %rax
+	jnz 1f
+	testq %rdx, %rdx
+	jnz 9f
+	call __li_new_array
+1:	cmpq %rcx, (%rax)
+	ja 8f
+	pushq %rbx
+	pushq %rsi
+	pushq %rdi
+	movq %rax, %rbx
+	# the segments from the one past the length to the one of the index
+	movq (%rbx), %rsi
+	addq $8, %rsi
+	bsrq %rsi, %rsi
+	leaq 8(%rcx), %rdi
+	bsrq %rdi, %rdi
+2:	cmpq %rdi, %rsi
+	ja 4f
+	cmpq $0, (%rbx,%rsi,8)
+	jne 3f
+	pushq %rcx
+	movq %rsi, %rcx
+	movl $8, %edx
+	shlq %cl, %rdx
+	popq %rcx
+	call __li_alloc
+	movq %rax, (%rbx,%rsi,8)
+3:	incq %rsi
+	jmp 2b
+4:	leaq 1(%rcx), %rax
+	movq %rax, (%rbx)
+	movq %rbx, %rax
+	popq %rdi
+	popq %rsi
+	popq %rbx
+8:	ret
+9:	xorl %eax, %eax
+	ret
+
+	.section .rodata
+__li_newline:
+	.byte 10
+__li_out_of_memory:
+	.asciz "out of memory"
+
+	.bss
+	.p2align 3
+__li_stack_limit:
+	.zero 8
+__li_heap:
+	.zero 8
+__li_heap_end:
+	.zero 8
+)";
+        }
+
+        bool Aot::Error(const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kNative, 0, 0, msg);
+            return false;
+        }
+
+        // runs the initializer and main, the result of main in rax as the vm converts it
+        bool Aot::Entry(ir::Module &m, MFunction &entry)
+        {
+            auto main = m.Find("main");
+            if (main == nullptr)
+            {
+                return Error("function main is not declared");
+            }
+            if (!main->params.empty())
+            {
+                return Error("function main expects " + std::to_string(main->params.size()) + " arguments");
+            }
+            auto rax = Operand::R(Reg::kRax), rsp = Operand::R(Reg::kRsp);
+            entry.symbol = "__li_entry";
+            entry.Emit(MOp::kPush, Operand::R(Reg::kRbp));
+            entry.Emit(MOp::kMov, rsp, Operand::R(Reg::kRbp));
+            entry.Emit(MOp::kCall, Operand::F(Mangle(m.init->name)));
+            size_t n = main->returns.size();
+            if (n > 2)
+            {
+                // a buffer for the results, aligned to 16 bytes
+                entry.Emit(MOp::kSub, Operand::I(8 * ((n + 1) & ~size_t(1))), rsp);
+                entry.Emit(MOp::kMov, rsp, Operand::R(Reg::kRdi));
+            }
+            entry.Emit(MOp::kCall, Operand::F(Mangle(main->name)));
+            if (n == 0)
+            {
+                entry.Emit(MOp::kMov, Operand::I(0), rax);
+            }
+            else if (main->returns[0] == ir::Type::kF64)
+            {
+                auto x = n > 2 ? Operand::M(Reg::kRax, 0) : Operand::R(Reg::kXmm0);
+                entry.Emit(MOp::kCvttsd2si, x, rax);
+            }
+            else if (n > 2)
+            {
+                entry.Emit(MOp::kMov, Operand::M(Reg::kRax, 0), rax);
+            }
+            entry.Emit(MOp::kMov, Operand::R(Reg::kRbp), rsp);
+            entry.Emit(MOp::kPop, Operand::R(Reg::kRbp));
+            entry.Emit(MOp::kRet);
+            return true;
+        }
+
+        bool Aot::Compile(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, std::ostream &out)
+        {
+            ir::Module m;
+            MModule mm;
+            if (!ir::Lowering(diag).Lower(root, semantic, m) || !pm.Run(m) || !Codegen(diag, pm).Generate(m, mm))
+            {
+                return false;
+            }
+            mm.functions.emplace_back();
+            if (!Entry(m, mm.functions.back()))
+            {
+                return false;
+            }
+            Print(out, mm);
+            out << kRuntime;
+            return out.good() || Error("cannot write the assembly");
+        }
+
+        bool Aot::Build(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, const string_t &path)
+        {
+            string_t s = path + ".s", o = path + ".o";
+            {
+                std::ofstream out(s);
+                if (!out)
+                {
+                    return Error("cannot write " + s);
+                }
+                if (!Compile(root, semantic, out))
+                {
+                    std::remove(s.c_str());
+                    return false;
+                }
+            }
+            bool ok = std::system(("as -o '" + o + "' '" + s + "'").c_str()) == 0 || Error("as failed on " + s);
+            ok = ok && (std::system(("ld -o '" + path + "' '" + o + "'").c_str()) == 0 || Error("ld failed on " + o));
+            std::remove(s.c_str());
+            std::remove(o.c_str());
+            return ok;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef LILANG_NATIVE_AOT
+#define LILANG_NATIVE_AOT
+
+#include "../ir/lower.h"
+#include "./codegen.h"
+
+/*
+ahead of time compilation of a checked file to a static executable
+
+the file is lowered to the ir, optimized by the pass manager and compiled
+to x86-64 assembly for the gnu assembler; as and ld of the system turn it
+into an executable that needs no libc. its runtime, written in assembly
+too, starts the process, allocates with mmap and writes with system calls.
+
+the executable runs the global initializers and main, prints what main
+returns the way the vm's Run converts it and exits with 0. a trap prints
+its position and message to stderr, as the vm's diagnostics do, and exits
+with 1. the stack may grow 7mb before the prologue of a function reports a
+stack overflow, which has no position.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        class Aot
+        {
+        public:
+            explicit Aot(compiler::Diagnostics &diag) : diag(diag), pm(diag) { pm.SetLevel(2); }
+
+            // the passes run before code generation, -O2 by default
+            ir::PassManager &Passes() { return pm; }
+
+            // the assembly of a file the visitor checked without errors
+            bool Compile(const ast::File::Ptr &, ast::SemanticVisitor &, std::ostream &out);
+            // assembles and links it to an executable at path
+            bool Build(const ast::File::Ptr &, ast::SemanticVisitor &, const string_t &path);
+
+        private:
+            compiler::Diagnostics &diag;
+            ir::PassManager pm;
+
+            bool Entry(ir::Module &, MFunction &);
+            bool Error(const string_t &msg);
+        };
+    }
+}
+
+#endif
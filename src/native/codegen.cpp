@@ -0,0 +1,1231 @@
+#include <algorithm>
+#include <functional>
+#include "./codegen.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            const Reg kIntArgs[] = {Reg::kRdi, Reg::kRsi, Reg::kRdx, Reg::kRcx, Reg::kR8, Reg::kR9};
+            const int kFloatArgs = 8;
+            const char *kGlobals = "li_globals";
+
+            bool FitsInt32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+            // a value where an instruction reads it
+            struct Src
+            {
+                Src(const Operand &op = Operand(), bool address = false) : op(op), address(address) {}
+
+                Operand op;
+                bool address; // op is memory whose address is the value
+            };
+
+            struct Move
+            {
+                Operand dst;
+                Src src;
+            };
+
+            // what the functions of a module share
+            struct Symbols
+            {
+                MModule &out;
+                std::unordered_map<const string_t *, string_t> strings;
+                std::unordered_map<string_t, string_t> messages;
+
+                string_t Data(const string_t &bytes)
+                {
+                    string_t symbol = ".Ls" + std::to_string(out.strings.size());
+                    out.strings.push_back({symbol, bytes});
+                    return symbol;
+                }
+
+                string_t String(const string_t *s)
+                {
+                    auto it = strings.find(s);
+                    return it != strings.end() ? it->second : strings[s] = Data(*s);
+                }
+
+                string_t Message(const string_t &text)
+                {
+                    auto it = messages.find(text);
+                    return it != messages.end() ? it->second : messages[text] = Data(text);
+                }
+            };
+
+            class FunctionCodegen
+            {
+            public:
+                FunctionCodegen(ir::Function &f, ir::Analyses &a, Symbols &syms, MFunction &out)
+                    : f(f), a(a), syms(syms), out(out)
+                {
+                }
+
+                void Run();
+
+            private:
+                ir::Function &f;
+                ir::Analyses &a;
+                Symbols &syms;
+                MFunction &out;
+                std::unique_ptr<Allocation> alloc;
+                std::vector<ir::Block *> order;
+                std::unordered_set<const ir::Instr *> skip;
+                std::unordered_set<const ir::Instr *> fused; // compares that set the flags of their branch
+                std::unordered_map<const ir::Instr *, std::vector<ir::Instr *>> extracts;
+                std::unordered_map<const ir::Instr *, int> cells; // frame cell of a slot
+                std::unordered_map<const ir::Block *, int> labels;
+                std::unordered_map<string_t, int> traps;
+                std::vector<std::function<void()>> stubs; // code out of the line, after the epilogue
+                int saved = 0, spills = 0, slots = 0, buffer = 0, outgoing = 0;
+                int epilogue = 0;
+                bool sret = false;
+
+                int Local(int k) const { return -8 * (saved + 1 + k); }
+                int SpillOffset(int slot) const { return Local(slot); }
+                int CellOffset(int cell) const { return Local(spills + cell); }
+                int BufferOffset() const { return -8 * (saved + spills + slots + buffer); }
+                int SretOffset() const { return Local(spills + slots + buffer); }
+
+                void Emit(MOp op, const Operand &x = Operand(), const Operand &y = Operand()) { out.Emit(op, x, y); }
+                void Emit(MOp op, Cond c, const Operand &x = Operand(), const Operand &y = Operand())
+                {
+                    out.Emit(op, c, x, y);
+                }
+                void Label(int l) { Emit(MOp::kLabel, Operand::L(l)); }
+
+                void Layout();
+                void Prologue();
+                void Epilogue();
+                void Block(size_t i);
+                void Instr(ir::Instr *in);
+
+                Src Val(const ir::Instr *v);
+                Operand Dst(const ir::Instr *v);
+                void Mov(const Operand &dst, const Src &src, Reg tmp = Reg::kR11);
+                void Parallel(std::vector<Move> moves);
+                Operand Gp(const ir::Instr *v, Reg tmp);
+                Operand IntSrc(const ir::Instr *v);
+                Operand FpSrc(const ir::Instr *v);
+                Operand Pointer(const ir::Instr *in, const ir::Instr *p);
+                int Trap(const ir::Instr *in, const string_t &msg);
+
+                void IntBinary(ir::Instr *in, MOp op, bool commutative);
+                void FloatBinary(ir::Instr *in, MOp op);
+                void Unary(ir::Instr *in, MOp op, const Operand &x);
+                void DivMod(ir::Instr *in);
+                Cond Compare(ir::Instr *in);
+                void SetFlag(ir::Instr *in);
+                void Call(ir::Instr *in);
+                void Return(ir::Instr *in);
+                void Branch(ir::Block *b, ir::Instr *in, size_t i);
+                void Element(Reg array, Reg index, Reg seg); // index becomes the element index in seg
+                void GetIndex(ir::Instr *in);
+                void SetIndex(ir::Instr *in);
+                void AddrIndex(ir::Instr *in);
+
+                std::vector<Move> EdgeMoves(ir::Block *from, ir::Block *to);
+                int EdgeLabel(ir::Block *from, ir::Block *to);
+                bool FallsInto(size_t i, ir::Block *to) const;
+                void JumpTo(size_t i, ir::Block *to, int label);
+            };
+
+            //**********************************************************************
+            // layout and frame
+            //**********************************************************************
+
+            void FunctionCodegen::Layout()
+            {
+                order = a.Dom().ReversePostorder();
+                for (auto b : order)
+                {
+                    labels[b] = out.NewLabel();
+                    for (size_t i = 0; i < b->instrs.size(); i++)
+                    {
+                        auto in = b->instrs[i];
+                        switch (in->op)
+                        {
+                        case ir::Op::kSlot:
+                            cells[in] = slots++;
+                            skip.insert(in);
+                            break;
+                        case ir::Op::kAddrGlobal:
+                            skip.insert(in);
+                            break;
+                        case ir::Op::kExtract:
+                            extracts[in->args[0]].push_back(in);
+                            break;
+                        case ir::Op::kEq:
+                        case ir::Op::kNe:
+                        case ir::Op::kLt:
+                        case ir::Op::kLe:
+                        {
+                            // used once, by the branch right after it
+                            auto next = i + 1 < b->instrs.size() ? b->instrs[i + 1] : nullptr;
+                            if (next == nullptr || next->op != ir::Op::kBranch || next->args[0] != in)
+                            {
+                                break;
+                            }
+                            bool once = true;
+                            for (auto &other : f.blocks)
+                            {
+                                for (auto user : other->instrs)
+                                {
+                                    once = once && (user == next || std::find(user->args.begin(), user->args.end(),
+                                                                              in) == user->args.end());
+                                }
+                            }
+                            if (once)
+                            {
+                                fused.insert(in);
+                                skip.insert(in);
+                            }
+                            break;
+                        }
+                        case ir::Op::kCall:
+                        case ir::Op::kCallValue:
+                        {
+                            size_t n = in->type == ir::Type::kTuple ? in->results.size() : 0;
+                            buffer = std::max(buffer, n > 2 ? static_cast<int>(n) : 0);
+                            std::vector<ir::Type> types;
+                            for (size_t k = in->op == ir::Op::kCall ? 0 : 1; k < in->args.size(); k++)
+                            {
+                                types.push_back(in->args[k]->type);
+                            }
+                            outgoing = std::max(outgoing, Classify(types, false, n > 2).stack);
+                            break;
+                        }
+                        default:
+                            break;
+                        }
+                    }
+                }
+                alloc.reset(new Allocation(f, order, a.Live(), skip));
+                saved = static_cast<int>(alloc->Saved().size());
+                spills = alloc->Spills();
+                sret = f.returns.size() > 2;
+            }
+
+            void FunctionCodegen::Prologue()
+            {
+                Emit(MOp::kPush, Operand::R(Reg::kRbp));
+                Emit(MOp::kMov, Operand::R(Reg::kRsp), Operand::R(Reg::kRbp));
+                for (auto r : alloc->Saved())
+                {
+                    Emit(MOp::kPush, Operand::R(r));
+                }
+                // the stack stays aligned to 16 bytes at calls
+                int cells = spills + slots + buffer + (sret ? 1 : 0) + outgoing;
+                if ((saved + cells) % 2 != 0)
+                {
+                    cells++;
+                }
+                if (cells != 0)
+                {
+                    Emit(MOp::kSub, Operand::I(8 * cells), Operand::R(Reg::kRsp));
+                }
+                Emit(MOp::kCmp, Operand::S("__li_stack_limit"), Operand::R(Reg::kRsp));
+                Emit(MOp::kJcc, Cond::kB, Operand::L(Trap(nullptr, "stack overflow")));
+                for (int c = 0; c < slots; c++)
+                {
+                    Emit(MOp::kMov, Operand::I(0), Operand::M(Reg::kRbp, CellOffset(c)));
+                }
+
+                // the arguments go where the allocation put the params
+                std::vector<ir::Instr *> params(f.params.size(), nullptr);
+                for (auto in : f.Entry()->instrs)
+                {
+                    if (in->op == ir::Op::kParam)
+                    {
+                        params[in->imm] = in;
+                    }
+                }
+                auto args = Classify(f.params, false, sret);
+                std::vector<Move> moves;
+                for (size_t k = 0; k < params.size(); k++)
+                {
+                    auto dst = params[k] == nullptr ? Operand() : Dst(params[k]);
+                    if (dst.kind == Operand::Kind::kNone)
+                    {
+                        continue;
+                    }
+                    auto src = args.locs[k];
+                    if (src.IsMem())
+                    {
+                        src = Operand::M(Reg::kRbp, 16 + src.disp);
+                    }
+                    moves.push_back({dst, {src}});
+                }
+                if (sret)
+                {
+                    moves.push_back({Operand::M(Reg::kRbp, SretOffset()), {Operand::R(Reg::kRdi)}});
+                }
+                Parallel(moves);
+            }
+
+            void FunctionCodegen::Epilogue()
+            {
+                Label(epilogue);
+                Emit(MOp::kLea, Operand::M(Reg::kRbp, -8 * saved), Operand::R(Reg::kRsp));
+                auto &regs = alloc->Saved();
+                for (auto r = regs.rbegin(); r != regs.rend(); ++r)
+                {
+                    Emit(MOp::kPop, Operand::R(*r));
+                }
+                Emit(MOp::kPop, Operand::R(Reg::kRbp));
+                Emit(MOp::kRet);
+            }
+
+            void FunctionCodegen::Run()
+            {
+                Layout();
+                epilogue = out.NewLabel();
+                Prologue();
+                for (size_t i = 0; i < order.size(); i++)
+                {
+                    Block(i);
+                }
+                Epilogue();
+                // a stub may add traps of its own
+                for (size_t i = 0; i < stubs.size(); i++)
+                {
+                    auto stub = stubs[i];
+                    stub();
+                }
+            }
+
+            //**********************************************************************
+            // values and moves
+            //**********************************************************************
+
+            Src FunctionCodegen::Val(const ir::Instr *v)
+            {
+                Src s;
+                if (v->IsConst())
+                {
+                    if (v->str != nullptr)
+                    {
+                        s.op = Operand::S(syms.String(v->str));
+                        s.address = true;
+                    }
+                    else if (v->fn != nullptr)
+                    {
+                        s.op = Operand::S(Mangle(v->fn->name));
+                        s.address = true;
+                    }
+                    else
+                    {
+                        s.op = Operand::I(v->imm);
+                    }
+                    return s;
+                }
+                if (v->op == ir::Op::kSlot)
+                {
+                    s.op = Operand::M(Reg::kRbp, CellOffset(cells.at(v)));
+                    s.address = true;
+                    return s;
+                }
+                if (v->op == ir::Op::kAddrGlobal)
+                {
+                    s.op = Operand::S(kGlobals, static_cast<int32_t>(8 * v->imm));
+                    s.address = true;
+                    return s;
+                }
+                s.op = Dst(v);
+                return s;
+            }
+
+            Operand FunctionCodegen::Dst(const ir::Instr *v)
+            {
+                auto l = alloc->Of(v);
+                switch (l.kind)
+                {
+                case Loc::Kind::kReg:
+                    return Operand::R(l.reg);
+                case Loc::Kind::kStack:
+                    return Operand::M(Reg::kRbp, SpillOffset(l.slot));
+                case Loc::Kind::kNone:
+                    break;
+                }
+                return Operand();
+            }
+
+            // tmp is the general register an indirect move goes through
+            void FunctionCodegen::Mov(const Operand &dst, const Src &src, Reg tmp)
+            {
+                if (dst.kind == Operand::Kind::kNone)
+                {
+                    return;
+                }
+                bool xmm = dst.IsReg() && IsXmm(dst.reg);
+                if (src.address)
+                {
+                    if (dst.IsReg() && !xmm)
+                    {
+                        Emit(MOp::kLea, src.op, dst);
+                        return;
+                    }
+                    Emit(MOp::kLea, src.op, Operand::R(tmp));
+                    Mov(dst, {Operand::R(tmp)});
+                    return;
+                }
+                if (src.op == dst)
+                {
+                    return;
+                }
+                if (src.op.IsImm())
+                {
+                    if (xmm || (dst.IsMem() && !FitsInt32(src.op.imm)))
+                    {
+                        Emit(MOp::kMov, src.op, Operand::R(tmp));
+                        Mov(dst, {Operand::R(tmp)});
+                        return;
+                    }
+                    Emit(MOp::kMov, src.op, dst);
+                    return;
+                }
+                bool from_xmm = src.op.IsReg() && IsXmm(src.op.reg);
+                if (src.op.IsMem() && dst.IsMem())
+                {
+                    Emit(MOp::kMov, src.op, Operand::R(tmp));
+                    Emit(MOp::kMov, Operand::R(tmp), dst);
+                }
+                else if (xmm && from_xmm)
+                {
+                    Emit(MOp::kMovsd, src.op, dst);
+                }
+                else if (xmm || from_xmm)
+                {
+                    Emit(src.op.IsMem() || dst.IsMem() ? MOp::kMovsd : MOp::kMovq, src.op, dst);
+                }
+                else
+                {
+                    Emit(MOp::kMov, src.op, dst);
+                }
+            }
+
+            // the moves read all their sources before writing, rax and r11 are scratch
+            void FunctionCodegen::Parallel(std::vector<Move> moves)
+            {
+                std::vector<Move> pending, late;
+                for (auto &m : moves)
+                {
+                    if (m.dst.kind == Operand::Kind::kNone || (!m.src.address && m.src.op == m.dst))
+                    {
+                        continue;
+                    }
+                    (m.src.address || m.src.op.IsImm() ? late : pending).push_back(m);
+                }
+                while (!pending.empty())
+                {
+                    size_t ready = pending.size();
+                    for (size_t i = 0; i < pending.size() && ready == pending.size(); i++)
+                    {
+                        bool read = false;
+                        for (size_t j = 0; j < pending.size(); j++)
+                        {
+                            read = read || (j != i && pending[j].src.op == pending[i].dst);
+                        }
+                        if (!read)
+                        {
+                            ready = i;
+                        }
+                    }
+                    if (ready == pending.size())
+                    {
+                        // a cycle: the first destination is saved and read from r11
+                        auto d = pending[0].dst;
+                        Mov(Operand::R(Reg::kR11), {d}, Reg::kRax);
+                        for (auto &m : pending)
+                        {
+                            if (m.src.op == d)
+                            {
+                                m.src.op = Operand::R(Reg::kR11);
+                            }
+                        }
+                        ready = 0;
+                    }
+                    Mov(pending[ready].dst, pending[ready].src, Reg::kRax);
+                    pending.erase(pending.begin() + ready);
+                }
+                for (auto &m : late)
+                {
+                    Mov(m.dst, m.src);
+                }
+            }
+
+            // the value in a general register, tmp if it is not in one
+            Operand FunctionCodegen::Gp(const ir::Instr *v, Reg tmp)
+            {
+                auto s = Val(v);
+                if (!s.address && s.op.IsReg() && !IsXmm(s.op.reg))
+                {
+                    return s.op;
+                }
+                Mov(Operand::R(tmp), s);
+                return Operand::R(tmp);
+            }
+
+            // a register, memory or 32 bit immediate source operand, through r11 if needed
+            Operand FunctionCodegen::IntSrc(const ir::Instr *v)
+            {
+                auto s = Val(v);
+                if (!s.address && (!s.op.IsImm() || FitsInt32(s.op.imm)))
+                {
+                    return s.op;
+                }
+                Mov(Operand::R(Reg::kR11), s);
+                return Operand::R(Reg::kR11);
+            }
+
+            // an xmm or memory source operand, a constant goes through xmm1
+            Operand FunctionCodegen::FpSrc(const ir::Instr *v)
+            {
+                auto s = Val(v);
+                if (!s.op.IsImm())
+                {
+                    return s.op;
+                }
+                Mov(Operand::R(Reg::kXmm1), s);
+                return Operand::R(Reg::kXmm1);
+            }
+
+            // the memory p points to, checked for nil where in uses it
+            Operand FunctionCodegen::Pointer(const ir::Instr *in, const ir::Instr *p)
+            {
+                auto s = Val(p);
+                if (s.address)
+                {
+                    return s.op;
+                }
+                auto r = Gp(p, Reg::kR11);
+                Emit(MOp::kTest, r, r);
+                Emit(MOp::kJcc, Cond::kE, Operand::L(Trap(in, "nil pointer dereference")));
+                return Operand::M(r.reg, 0);
+            }
+
+            // a label that reports msg at the position of in and exits
+            int FunctionCodegen::Trap(const ir::Instr *in, const string_t &msg)
+            {
+                compiler::Diagnostic d;
+                d.row_number = in == nullptr ? 0 : in->pos.first;
+                d.column_number = in == nullptr ? 0 : in->pos.second;
+                d.msg = msg;
+                auto text = d.String();
+                auto it = traps.find(text);
+                if (it != traps.end())
+                {
+                    return it->second;
+                }
+                int label = traps[text] = out.NewLabel();
+                auto symbol = syms.Message(text);
+                stubs.push_back([this, label, symbol]() {
+                    Label(label);
+                    Emit(MOp::kLea, Operand::S(symbol), Operand::R(Reg::kRdi));
+                    Emit(MOp::kJmp, Operand::F("__li_trap"));
+                });
+                return label;
+            }
+
+            //**********************************************************************
+            // instructions
+            //**********************************************************************
+
+            void FunctionCodegen::Block(size_t i)
+            {
+                auto b = order[i];
+                Label(labels.at(b));
+                for (auto in : b->instrs)
+                {
+                    if (in->op == ir::Op::kBranch)
+                    {
+                        Branch(b, in, i);
+                        continue;
+                    }
+                    if (in->op == ir::Op::kJump)
+                    {
+                        Parallel(EdgeMoves(b, in->targets[0]));
+                        JumpTo(i, in->targets[0], labels.at(in->targets[0]));
+                        continue;
+                    }
+                    if (in->op == ir::Op::kRet)
+                    {
+                        Return(in);
+                        if (i + 1 != order.size())
+                        {
+                            Emit(MOp::kJmp, Operand::L(epilogue));
+                        }
+                        continue;
+                    }
+                    if (skip.count(in) == 0)
+                    {
+                        Instr(in);
+                    }
+                }
+            }
+
+            void FunctionCodegen::Instr(ir::Instr *in)
+            {
+                bool floats = !in->args.empty() && in->args[0]->type == ir::Type::kF64;
+                auto rax = Operand::R(Reg::kRax);
+                switch (in->op)
+                {
+                case ir::Op::kParam:
+                case ir::Op::kPhi:
+                case ir::Op::kExtract:
+                    return;
+                case ir::Op::kAdd:
+                    return floats ? FloatBinary(in, MOp::kAddsd) : IntBinary(in, MOp::kAdd, true);
+                case ir::Op::kSub:
+                    return floats ? FloatBinary(in, MOp::kSubsd) : IntBinary(in, MOp::kSub, false);
+                case ir::Op::kMul:
+                    return floats ? FloatBinary(in, MOp::kMulsd) : IntBinary(in, MOp::kImul, true);
+                case ir::Op::kDiv:
+                    return floats ? FloatBinary(in, MOp::kDivsd) : DivMod(in);
+                case ir::Op::kMod:
+                    return DivMod(in);
+                case ir::Op::kAnd:
+                    return IntBinary(in, MOp::kAnd, true);
+                case ir::Op::kOr:
+                    return IntBinary(in, MOp::kOr, true);
+                case ir::Op::kXor:
+                    return IntBinary(in, MOp::kXor, true);
+                case ir::Op::kNeg:
+                    if (floats)
+                    {
+                        // flips the sign bit
+                        Mov(rax, Val(in->args[0]));
+                        Emit(MOp::kBtc, Operand::I(63), rax);
+                        Mov(Dst(in), {rax});
+                        return;
+                    }
+                    return Unary(in, MOp::kNeg, Operand());
+                case ir::Op::kBitNot:
+                    return Unary(in, MOp::kNot, Operand());
+                case ir::Op::kNot:
+                    return Unary(in, MOp::kXor, Operand::I(1));
+                case ir::Op::kEq:
+                case ir::Op::kNe:
+                case ir::Op::kLt:
+                case ir::Op::kLe:
+                    return SetFlag(in);
+                case ir::Op::kI2F:
+                {
+                    auto s = Val(in->args[0]);
+                    auto x = s.op.IsImm() ? Gp(in->args[0], Reg::kRax) : s.op;
+                    auto d = Dst(in);
+                    bool direct = d.IsReg();
+                    Emit(MOp::kCvtsi2sd, x, direct ? d : Operand::R(Reg::kXmm0));
+                    if (!direct)
+                    {
+                        Mov(d, {Operand::R(Reg::kXmm0)});
+                    }
+                    return;
+                }
+                case ir::Op::kF2I:
+                    // the conversion gives the int minimum when out of range, which the vm traps on too
+                    Emit(MOp::kCvttsd2si, FpSrc(in->args[0]), rax);
+                    Emit(MOp::kCmp, Operand::I(1), rax);
+                    Emit(MOp::kJcc, Cond::kO, Operand::L(Trap(in, "float value out of the int range")));
+                    Mov(Dst(in), {rax});
+                    return;
+                case ir::Op::kGetGlobal:
+                    Mov(Dst(in), {Operand::S(kGlobals, static_cast<int32_t>(8 * in->imm))});
+                    return;
+                case ir::Op::kSetGlobal:
+                    Mov(Operand::S(kGlobals, static_cast<int32_t>(8 * in->imm)), Val(in->args[0]));
+                    return;
+                case ir::Op::kCall:
+                case ir::Op::kCallValue:
+                    return Call(in);
+                case ir::Op::kNewArray:
+                    Emit(MOp::kCall, Operand::F("__li_new_array"));
+                    Mov(Dst(in), {rax});
+                    return;
+                case ir::Op::kGetIndex:
+                    return GetIndex(in);
+                case ir::Op::kSetIndex:
+                    return SetIndex(in);
+                case ir::Op::kAddrIndex:
+                    return AddrIndex(in);
+                case ir::Op::kLoad:
+                    Mov(Dst(in), {Pointer(in, in->args[0])}, Reg::kRax);
+                    return;
+                case ir::Op::kStore:
+                    Mov(Pointer(in, in->args[0]), Val(in->args[1]), Reg::kRax);
+                    return;
+                default:
+                    return;
+                }
+            }
+
+            void FunctionCodegen::IntBinary(ir::Instr *in, MOp op, bool commutative)
+            {
+                auto x = in->args[0], y = in->args[1];
+                auto d = Dst(in);
+                if (commutative && d.IsReg() && Val(y).op == d && Val(x).op != d)
+                {
+                    std::swap(x, y);
+                }
+                if (d.IsReg() && Val(y).op != d)
+                {
+                    Mov(d, Val(x));
+                    Emit(op, IntSrc(y), d);
+                    return;
+                }
+                auto rax = Operand::R(Reg::kRax);
+                Mov(rax, Val(x));
+                Emit(op, IntSrc(y), rax);
+                Mov(d, {rax});
+            }
+
+            void FunctionCodegen::FloatBinary(ir::Instr *in, MOp op)
+            {
+                auto d = Dst(in);
+                if (d.IsReg() && Val(in->args[1]).op != d)
+                {
+                    Mov(d, Val(in->args[0]));
+                    Emit(op, FpSrc(in->args[1]), d);
+                    return;
+                }
+                auto xmm0 = Operand::R(Reg::kXmm0);
+                Mov(xmm0, Val(in->args[0]));
+                Emit(op, FpSrc(in->args[1]), xmm0);
+                Mov(d, {xmm0});
+            }
+
+            void FunctionCodegen::Unary(ir::Instr *in, MOp op, const Operand &x)
+            {
+                auto d = Dst(in);
+                auto r = d.IsReg() ? d : Operand::R(Reg::kRax);
+                Mov(r, Val(in->args[0]));
+                Emit(op, op == MOp::kXor ? x : r, op == MOp::kXor ? r : Operand());
+                Mov(d, {r});
+            }
+
+            // idiv traps on a zero divisor and on the overflow of -1, the vm wraps that one
+            void FunctionCodegen::DivMod(ir::Instr *in)
+            {
+                bool div = in->op == ir::Op::kDiv;
+                auto rax = Operand::R(Reg::kRax), rdx = Operand::R(Reg::kRdx);
+                auto result = div ? rax : rdx;
+                auto x = in->args[0];
+                auto y = Val(in->args[1]).op;
+                if (y.IsImm() && (y.imm == 0 || y.imm == -1))
+                {
+                    if (y.imm == 0)
+                    {
+                        Emit(MOp::kJmp, Operand::L(Trap(in, "division by zero")));
+                        return;
+                    }
+                    if (div)
+                    {
+                        Mov(rax, Val(x));
+                        Emit(MOp::kNeg, rax);
+                    }
+                    Mov(Dst(in), {div ? rax : Operand::I(0)});
+                    return;
+                }
+                if (y.IsImm())
+                {
+                    Mov(Operand::R(Reg::kRcx), {y});
+                    y = Operand::R(Reg::kRcx);
+                }
+                else
+                {
+                    if (y.IsReg())
+                    {
+                        Emit(MOp::kTest, y, y);
+                    }
+                    else
+                    {
+                        Emit(MOp::kCmp, Operand::I(0), y);
+                    }
+                    Emit(MOp::kJcc, Cond::kE, Operand::L(Trap(in, "division by zero")));
+                    int minus = out.NewLabel(), done = out.NewLabel();
+                    Emit(MOp::kCmp, Operand::I(-1), y);
+                    Emit(MOp::kJcc, Cond::kE, Operand::L(minus));
+                    Mov(rax, Val(x));
+                    Emit(MOp::kCqo);
+                    Emit(MOp::kIdiv, y);
+                    Label(done);
+                    Mov(Dst(in), {result});
+                    stubs.push_back([=]() {
+                        Label(minus);
+                        if (div)
+                        {
+                            Mov(rax, Val(x));
+                            Emit(MOp::kNeg, rax);
+                        }
+                        else
+                        {
+                            Emit(MOp::kMov, Operand::I(0), rdx);
+                        }
+                        Emit(MOp::kJmp, Operand::L(done));
+                    });
+                    return;
+                }
+                Mov(rax, Val(x));
+                Emit(MOp::kCqo);
+                Emit(MOp::kIdiv, y);
+                Mov(Dst(in), {result});
+            }
+
+            // sets the flags for a compare and returns the condition it holds on; float eq
+            // and ne return e and ne, which also need the parity flag clear or set
+            Cond FunctionCodegen::Compare(ir::Instr *in)
+            {
+                auto x = in->args[0], y = in->args[1];
+                if (x->type == ir::Type::kF64)
+                {
+                    // ucomisd compares its destination to its source, unordered sets zf, pf and cf
+                    if (in->op == ir::Op::kLt || in->op == ir::Op::kLe)
+                    {
+                        std::swap(x, y);
+                    }
+                    auto r = Val(x).op;
+                    if (!r.IsReg())
+                    {
+                        Mov(Operand::R(Reg::kXmm0), Val(x));
+                        r = Operand::R(Reg::kXmm0);
+                    }
+                    Emit(MOp::kUcomisd, FpSrc(y), r);
+                    switch (in->op)
+                    {
+                    case ir::Op::kLt:
+                        return Cond::kA;
+                    case ir::Op::kLe:
+                        return Cond::kAe;
+                    case ir::Op::kEq:
+                        return Cond::kE;
+                    default:
+                        return Cond::kNe;
+                    }
+                }
+                auto l = Val(x);
+                auto r = IntSrc(y);
+                if (l.address || l.op.IsImm() || (l.op.IsMem() && r.IsMem()))
+                {
+                    Mov(Operand::R(Reg::kRax), l);
+                    l.op = Operand::R(Reg::kRax);
+                }
+                Emit(MOp::kCmp, r, l.op);
+                switch (in->op)
+                {
+                case ir::Op::kLt:
+                    return Cond::kL;
+                case ir::Op::kLe:
+                    return Cond::kLe;
+                case ir::Op::kEq:
+                    return Cond::kE;
+                default:
+                    return Cond::kNe;
+                }
+            }
+
+            void FunctionCodegen::SetFlag(ir::Instr *in)
+            {
+                auto c = Compare(in);
+                auto rax = Operand::R(Reg::kRax), rcx = Operand::R(Reg::kRcx);
+                Emit(MOp::kSet, c, rax);
+                Emit(MOp::kMovzb, rax, rax);
+                if (in->args[0]->type == ir::Type::kF64 && (in->op == ir::Op::kEq || in->op == ir::Op::kNe))
+                {
+                    bool eq = in->op == ir::Op::kEq;
+                    Emit(MOp::kSet, eq ? Cond::kNp : Cond::kP, rcx);
+                    Emit(MOp::kMovzb, rcx, rcx);
+                    Emit(eq ? MOp::kAnd : MOp::kOr, rcx, rax);
+                }
+                Mov(Dst(in), {rax});
+            }
+
+            void FunctionCodegen::Call(ir::Instr *in)
+            {
+                bool value = in->op == ir::Op::kCallValue;
+                size_t n = in->type == ir::Type::kTuple ? in->results.size() : in->type == ir::Type::kVoid ? 0 : 1;
+                bool indirect = n > 2;
+                std::vector<ir::Type> types;
+                for (size_t k = value ? 1 : 0; k < in->args.size(); k++)
+                {
+                    types.push_back(in->args[k]->type);
+                }
+                auto args = Classify(types, false, indirect);
+                std::vector<Move> moves;
+                for (size_t k = 0; k < types.size(); k++)
+                {
+                    moves.push_back({args.locs[k], Val(in->args[k + (value ? 1 : 0)])});
+                }
+                if (indirect)
+                {
+                    moves.push_back({Operand::R(Reg::kRdi), {Operand::M(Reg::kRbp, BufferOffset()), true}});
+                }
+                auto r10 = Operand::R(Reg::kR10);
+                if (value)
+                {
+                    moves.push_back({r10, Val(in->args[0])});
+                }
+                Parallel(moves);
+                if (value)
+                {
+                    Emit(MOp::kTest, r10, r10);
+                    Emit(MOp::kJcc, Cond::kE, Operand::L(Trap(in, "call of a nil function")));
+                    Emit(MOp::kCall, r10);
+                }
+                else
+                {
+                    Emit(MOp::kCall, Operand::F(Mangle(in->fn->name)));
+                }
+
+                if (in->type != ir::Type::kTuple)
+                {
+                    if (n == 1)
+                    {
+                        Mov(Dst(in), {Operand::R(in->type == ir::Type::kF64 ? Reg::kXmm0 : Reg::kRax)});
+                    }
+                    return;
+                }
+                auto results = Classify(in->results, true, false);
+                std::vector<Move> taken;
+                for (auto e : extracts[in])
+                {
+                    auto src = indirect ? Operand::M(Reg::kRbp, BufferOffset() + 8 * static_cast<int>(e->imm))
+                                        : results.locs[e->imm];
+                    taken.push_back({Dst(e), {src}});
+                }
+                Parallel(taken);
+            }
+
+            void FunctionCodegen::Return(ir::Instr *in)
+            {
+                if (in->args.size() > 2)
+                {
+                    auto r11 = Operand::R(Reg::kR11);
+                    Emit(MOp::kMov, Operand::M(Reg::kRbp, SretOffset()), r11);
+                    for (size_t k = 0; k < in->args.size(); k++)
+                    {
+                        Mov(Operand::M(Reg::kR11, 8 * static_cast<int>(k)), Val(in->args[k]), Reg::kRax);
+                    }
+                    Emit(MOp::kMov, r11, Operand::R(Reg::kRax));
+                    return;
+                }
+                std::vector<ir::Type> types;
+                for (auto v : in->args)
+                {
+                    types.push_back(v->type);
+                }
+                auto results = Classify(types, true, false);
+                std::vector<Move> moves;
+                for (size_t k = 0; k < in->args.size(); k++)
+                {
+                    moves.push_back({results.locs[k], Val(in->args[k])});
+                }
+                Parallel(moves);
+            }
+
+            //**********************************************************************
+            // arrays
+            //**********************************************************************
+
+            // index becomes the element index in the segment, seg the segment
+            void FunctionCodegen::Element(Reg array, Reg index, Reg seg)
+            {
+                auto i = Operand::R(index), s = Operand::R(seg);
+                Emit(MOp::kLea, Operand::M(index, 8), i);
+                Emit(MOp::kBsr, i, s);
+                Emit(MOp::kBtc, s, i);
+                Emit(MOp::kMov, Operand::M(array, 0, seg, 8), s);
+            }
+
+            void FunctionCodegen::GetIndex(ir::Instr *in)
+            {
+                int trap = Trap(in, "index out of range");
+                auto arr = Gp(in->args[0], Reg::kR11);
+                Emit(MOp::kTest, arr, arr);
+                Emit(MOp::kJcc, Cond::kE, Operand::L(trap));
+                auto i = Val(in->args[1]).op;
+                if (i.IsImm() && i.imm >= 0 && i.imm < (int64_t(1) << 24))
+                {
+                    // the segment and the offset are known
+                    int64_t j = i.imm + 8;
+                    int h = 63 - __builtin_clzll(static_cast<uint64_t>(j));
+                    Emit(MOp::kCmp, i, Operand::M(arr.reg, 0));
+                    Emit(MOp::kJcc, Cond::kBe, Operand::L(trap));
+                    Emit(MOp::kMov, Operand::M(arr.reg, 8 * h), Operand::R(Reg::kR11));
+                    Mov(Dst(in), {Operand::M(Reg::kR11, static_cast<int32_t>(8 * (j - (int64_t(1) << h))))},
+                        Reg::kRax);
+                    return;
+                }
+                auto rax = Operand::R(Reg::kRax);
+                Mov(rax, {i});
+                Emit(MOp::kCmp, rax, Operand::M(arr.reg, 0));
+                Emit(MOp::kJcc, Cond::kBe, Operand::L(trap));
+                Element(arr.reg, Reg::kRax, Reg::kRcx);
+                Mov(Dst(in), {Operand::M(Reg::kRcx, 0, Reg::kRax, 8)}, Reg::kRdx);
+            }
+
+            void FunctionCodegen::SetIndex(ir::Instr *in)
+            {
+                auto rax = Operand::R(Reg::kRax), rcx = Operand::R(Reg::kRcx), rdx = Operand::R(Reg::kRdx);
+                Mov(rax, Val(in->args[0]));
+                Mov(rcx, Val(in->args[1]));
+                int slow = out.NewLabel(), back = out.NewLabel();
+                Emit(MOp::kTest, rax, rax);
+                Emit(MOp::kJcc, Cond::kE, Operand::L(slow));
+                Emit(MOp::kCmp, rcx, Operand::M(Reg::kRax, 0));
+                Emit(MOp::kJcc, Cond::kBe, Operand::L(slow));
+                Label(back);
+                Emit(MOp::kLea, Operand::M(Reg::kRcx, 8), rdx);
+                Emit(MOp::kBsr, rdx, Operand::R(Reg::kR11));
+                Emit(MOp::kBtc, Operand::R(Reg::kR11), rdx);
+                Emit(MOp::kMov, Operand::M(Reg::kRax, 0, Reg::kR11, 8), Operand::R(Reg::kR11));
+                Mov(Operand::M(Reg::kR11, 0, Reg::kRdx, 8), Val(in->args[2]), Reg::kRcx);
+                Mov(Dst(in), {rax});
+                int trap = Trap(in, "index out of range");
+                stubs.push_back([=]() {
+                    Label(slow);
+                    Emit(MOp::kMov, Operand::I(0), rdx);
+                    Emit(MOp::kCall, Operand::F("__li_reserve"));
+                    Emit(MOp::kTest, rax, rax);
+                    Emit(MOp::kJcc, Cond::kE, Operand::L(trap));
+                    Emit(MOp::kJmp, Operand::L(back));
+                });
+            }
+
+            void FunctionCodegen::AddrIndex(ir::Instr *in)
+            {
+                auto rax = Operand::R(Reg::kRax), rcx = Operand::R(Reg::kRcx), rdx = Operand::R(Reg::kRdx);
+                auto p = in->args[0];
+                Mov(rax, {Pointer(in, p)});
+                Mov(rcx, Val(in->args[1]));
+                int slow = out.NewLabel(), back = out.NewLabel();
+                Emit(MOp::kTest, rax, rax);
+                Emit(MOp::kJcc, Cond::kE, Operand::L(slow));
+                Emit(MOp::kCmp, rcx, Operand::M(Reg::kRax, 0));
+                Emit(MOp::kJcc, Cond::kBe, Operand::L(slow));
+                Label(back);
+                Element(Reg::kRax, Reg::kRcx, Reg::kRdx);
+                Emit(MOp::kLea, Operand::M(Reg::kRdx, 0, Reg::kRcx, 8), rax);
+                Mov(Dst(in), {rax});
+                int trap = Trap(in, "index out of range");
+                int64_t nocreate = in->imm;
+                stubs.push_back([=]() {
+                    Label(slow);
+                    Emit(MOp::kMov, Operand::I(nocreate), rdx);
+                    Emit(MOp::kCall, Operand::F("__li_reserve"));
+                    Emit(MOp::kTest, rax, rax);
+                    Emit(MOp::kJcc, Cond::kE, Operand::L(trap));
+                    // the pointer was checked before, reading it again cannot trap
+                    auto s = Val(p);
+                    auto cell = s.address ? s.op : Operand::M(Gp(p, Reg::kR11).reg, 0);
+                    Emit(MOp::kMov, rax, cell);
+                    Emit(MOp::kJmp, Operand::L(back));
+                });
+            }
+
+            //**********************************************************************
+            // control flow
+            //**********************************************************************
+
+            std::vector<Move> FunctionCodegen::EdgeMoves(ir::Block *from, ir::Block *to)
+            {
+                std::vector<Move> moves;
+                size_t k = to->PredIndex(from);
+                for (auto in : to->instrs)
+                {
+                    if (in->op == ir::Op::kPhi)
+                    {
+                        moves.push_back({Dst(in), Val(in->args[k])});
+                    }
+                }
+                return moves;
+            }
+
+            // the block itself, or a stub doing the phi moves of the edge first
+            int FunctionCodegen::EdgeLabel(ir::Block *from, ir::Block *to)
+            {
+                auto moves = EdgeMoves(from, to);
+                bool any = false;
+                for (auto &m : moves)
+                {
+                    any = any || m.dst.kind != Operand::Kind::kNone;
+                }
+                if (!any)
+                {
+                    return labels.at(to);
+                }
+                int stub = out.NewLabel();
+                int target = labels.at(to);
+                stubs.push_back([=]() {
+                    Label(stub);
+                    Parallel(moves);
+                    Emit(MOp::kJmp, Operand::L(target));
+                });
+                return stub;
+            }
+
+            bool FunctionCodegen::FallsInto(size_t i, ir::Block *to) const
+            {
+                return i + 1 < order.size() && order[i + 1] == to;
+            }
+
+            void FunctionCodegen::JumpTo(size_t i, ir::Block *to, int label)
+            {
+                if (label != labels.at(to) || !FallsInto(i, to))
+                {
+                    Emit(MOp::kJmp, Operand::L(label));
+                }
+            }
+
+            void FunctionCodegen::Branch(ir::Block *b, ir::Instr *in, size_t i)
+            {
+                auto yes = in->targets[0], no = in->targets[1];
+                int t = EdgeLabel(b, yes), e = EdgeLabel(b, no);
+                auto c = in->args[0];
+                Cond cond = Cond::kNe;
+                bool parity = false; // float eq and ne
+                if (fused.count(c) != 0)
+                {
+                    cond = Compare(c);
+                    parity = c->args[0]->type == ir::Type::kF64 && (c->op == ir::Op::kEq || c->op == ir::Op::kNe);
+                }
+                else
+                {
+                    auto v = Val(c).op;
+                    if (v.IsImm())
+                    {
+                        auto to = v.imm != 0 ? yes : no;
+                        return JumpTo(i, to, v.imm != 0 ? t : e);
+                    }
+                    if (v.IsReg())
+                    {
+                        Emit(MOp::kTest, v, v);
+                    }
+                    else
+                    {
+                        Emit(MOp::kCmp, Operand::I(0), v);
+                    }
+                }
+                if (parity)
+                {
+                    // unordered is false for eq and true for ne
+                    Emit(MOp::kJcc, Cond::kP, Operand::L(cond == Cond::kE ? e : t));
+                    Emit(MOp::kJcc, cond, Operand::L(t));
+                    return JumpTo(i, no, e);
+                }
+                if (e == labels.at(no) && FallsInto(i, no))
+                {
+                    Emit(MOp::kJcc, cond, Operand::L(t));
+                    return;
+                }
+                if (t == labels.at(yes) && FallsInto(i, yes))
+                {
+                    Emit(MOp::kJcc, Negate(cond), Operand::L(e));
+                    return;
+                }
+                Emit(MOp::kJcc, cond, Operand::L(t));
+                Emit(MOp::kJmp, Operand::L(e));
+            }
+
+            // an extract follows its call, the results are taken right after it
+            bool HoistExtracts(ir::Function &f)
+            {
+                std::unordered_map<const ir::Instr *, std::vector<ir::Instr *>> of;
+                for (auto &b : f.blocks)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        if (in->op == ir::Op::kExtract)
+                        {
+                            of[in->args[0]].push_back(in);
+                        }
+                    }
+                }
+                bool changed = false;
+                for (auto &b : f.blocks)
+                {
+                    for (size_t i = 0; i < b->instrs.size(); i++)
+                    {
+                        auto it = of.find(b->instrs[i]);
+                        if (it == of.end())
+                        {
+                            continue;
+                        }
+                        for (size_t k = 0; k < it->second.size(); k++)
+                        {
+                            auto e = it->second[k];
+                            if (i + 1 + k < b->instrs.size() && b->instrs[i + 1 + k] == e)
+                            {
+                                continue;
+                            }
+                            auto &from = e->block->instrs;
+                            from.erase(std::find(from.begin(), from.end(), e));
+                            b->instrs.insert(b->instrs.begin() + i + 1 + k, e);
+                            e->block = b.get();
+                            changed = true;
+                        }
+                    }
+                }
+                return changed;
+            }
+        }
+
+        bool Codegen::Generate(ir::Module &m, MModule &out)
+        {
+            std::vector<ir::Function *> fs;
+            for (auto &f : m.functions)
+            {
+                fs.push_back(&f);
+            }
+            return Generate(m, fs, out);
+        }
+
+        bool Codegen::Generate(ir::Module &m, const std::vector<ir::Function *> &fs, MModule &out)
+        {
+            Symbols syms{out, {}, {}};
+            for (auto f : fs)
+            {
+                if (HoistExtracts(*f))
+                {
+                    pm.Of(*f).Invalidate(0);
+                }
+                out.functions.emplace_back();
+                auto &mf = out.functions.back();
+                mf.symbol = Mangle(f->name);
+                FunctionCodegen(*f, pm.Of(*f), syms, mf).Run();
+            }
+            out.globals = m.globals.size();
+            return !diag.HasErrors();
+        }
+
+        Classes Classify(const std::vector<ir::Type> &types, bool results, bool sret)
+        {
+            Classes c;
+            size_t ints = sret ? 1 : 0;
+            int floats = 0;
+            for (auto t : types)
+            {
+                if (results)
+                {
+                    c.locs.push_back(t == ir::Type::kF64 ? Operand::R(Xmm(floats++))
+                                                         : Operand::R(ints++ == 0 ? Reg::kRax : Reg::kRdx));
+                }
+                else if (t == ir::Type::kF64 && floats < kFloatArgs)
+                {
+                    c.locs.push_back(Operand::R(Xmm(floats++)));
+                }
+                else if (t != ir::Type::kF64 && ints < 6)
+                {
+                    c.locs.push_back(Operand::R(kIntArgs[ints++]));
+                }
+                else
+                {
+                    c.locs.push_back(Operand::M(Reg::kRsp, 8 * c.stack++));
+                }
+            }
+            return c;
+        }
+    }
+}
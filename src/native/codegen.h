@@ -0,0 +1,70 @@
+#ifndef LILANG_NATIVE_CODEGEN
+#define LILANG_NATIVE_CODEGEN
+
+#include "../ir/pass_manager.h"
+#include "./regalloc.h"
+
+/*
+x86-64 code for the functions of the ir
+
+functions follow the system v calling convention, so they can be called
+from c and the other way round: ints, bools and references in rdi, rsi,
+rdx, rcx, r8 and r9, floats in xmm0 to xmm7, the rest on the stack. one or
+two results come back in rax and rdx, or xmm0 and xmm1, classified like
+the two fields of a struct; more results are written to a buffer the
+caller passes as a hidden first argument, and its address comes back in
+rax.
+
+a compare used only by the branch after it sets the flags the branch
+jumps on. phi moves go at the end of a predecessor that jumps, or on a stub
+of their own for the edge of a branch.
+
+the code calls a small runtime through fixed symbols, which keeps every
+register but rax, rdx and r11:
+
+__li_new_array      an empty array in rax
+__li_reserve        rax the array or nil, rcx the index, rdx 1 when a nil
+                    array is not created; rax is the array grown past the
+                    index, 0 when the index is out of range
+__li_trap           rdi the message, does not return
+__li_stack_limit    the lowest stack address a prologue may reach
+li_globals          a cell for each global
+
+an array is a header with its length and segments: segment h, h from 3 to
+24, holds the 2^h elements from 2^h - 8, so element i is at (i + 8) - 2^h
+in segment bsr(i + 8). segments never move, a pointer to an element stays
+valid as the array grows, as in the engines.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        // where each argument or result of a call goes, in order: a register, or for an argument
+        // a cell at the stack pointer of the caller
+        struct Classes
+        {
+            std::vector<Operand> locs;
+            int stack = 0; // cells on the stack
+        };
+
+        // results and arguments take registers in order, the first int result is rax
+        Classes Classify(const std::vector<ir::Type> &types, bool results, bool sret);
+
+        class Codegen
+        {
+        public:
+            Codegen(compiler::Diagnostics &diag, ir::PassManager &pm) : diag(diag), pm(pm) {}
+
+            // m has been through the passes, an extract is moved right after its call
+            bool Generate(ir::Module &m, MModule &out);
+            // only the functions in fs, the others are referred to by symbol
+            bool Generate(ir::Module &m, const std::vector<ir::Function *> &fs, MModule &out);
+
+        private:
+            compiler::Diagnostics &diag;
+            ir::PassManager &pm;
+        };
+    }
+}
+
+#endif
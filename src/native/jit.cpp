@@ -0,0 +1,699 @@
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include "./jit.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            const size_t kSpace = size_t(1) << 30; // reserved, pages are committed as they are used
+            const size_t kPage = 4096;
+            const size_t kChunk = size_t(1) << 17; // cells of a chunk of the heap
+            const size_t kArray = 25;              // cells of an array header: its length and segments 3 to 24
+
+            // the cells of the runtime at the start of the data, the slots of the stubs follow,
+            // then the globals
+            enum Cell
+            {
+                kStackLimit,
+                kEntrySp, // the stack pointer of the innermost entry
+                kTrapMsg, // the message of the trap ending its call
+                kCells,
+            };
+
+            const Reg kSaved[] = {Reg::kRbx, Reg::kR12, Reg::kR13, Reg::kR14, Reg::kR15};
+            const Reg kIntArgs[] = {Reg::kRdi, Reg::kRsi, Reg::kRdx, Reg::kRcx, Reg::kR8, Reg::kR9};
+            const Reg kKept[] = {Reg::kRcx, Reg::kRsi, Reg::kRdi, Reg::kR8, Reg::kR9, Reg::kR10};
+
+            Operand R(Reg r) { return Operand::R(r); }
+
+            // a routine calling fn(jit, rax, rcx, rdx) that keeps every register but rax, rdx
+            // and r11, and traps when fn left a message
+            void Thunk(MFunction &t, const string_t &symbol, void *jit, int64_t (*fn)(Jit *, int64_t, int64_t, int64_t))
+            {
+                auto rsp = R(Reg::kRsp), rbp = R(Reg::kRbp), r11 = R(Reg::kR11);
+                t.symbol = symbol;
+                t.Emit(MOp::kPush, rbp);
+                t.Emit(MOp::kMov, rsp, rbp);
+                for (auto r : kKept)
+                {
+                    t.Emit(MOp::kPush, R(r));
+                }
+                t.Emit(MOp::kAnd, Operand::I(-16), rsp);
+                t.Emit(MOp::kSub, Operand::I(128), rsp);
+                for (int k = 0; k < 16; k++)
+                {
+                    t.Emit(MOp::kMovsd, R(Xmm(k)), Operand::M(Reg::kRsp, 8 * k));
+                }
+                t.Emit(MOp::kMov, R(Reg::kRax), R(Reg::kRsi));
+                t.Emit(MOp::kMov, R(Reg::kRdx), r11);
+                t.Emit(MOp::kMov, R(Reg::kRcx), R(Reg::kRdx));
+                t.Emit(MOp::kMov, r11, R(Reg::kRcx));
+                t.Emit(MOp::kMov, Operand::I(reinterpret_cast<int64_t>(jit)), R(Reg::kRdi));
+                t.Emit(MOp::kMov, Operand::I(reinterpret_cast<int64_t>(fn)), R(Reg::kRax));
+                t.Emit(MOp::kCall, R(Reg::kRax));
+                for (int k = 0; k < 16; k++)
+                {
+                    t.Emit(MOp::kMovsd, Operand::M(Reg::kRsp, 8 * k), R(Xmm(k)));
+                }
+                t.Emit(MOp::kLea, Operand::M(Reg::kRbp, -8 * 6), rsp);
+                for (int k = 5; k >= 0; k--)
+                {
+                    t.Emit(MOp::kPop, R(kKept[k]));
+                }
+                t.Emit(MOp::kPop, rbp);
+                int trap = t.NewLabel();
+                t.Emit(MOp::kCmp, Operand::I(0), Operand::S("__li_trap_msg"));
+                t.Emit(MOp::kJcc, Cond::kNe, Operand::L(trap));
+                t.Emit(MOp::kRet);
+                t.Emit(MOp::kLabel, Operand::L(trap));
+                t.Emit(MOp::kMov, Operand::S("__li_trap_msg"), R(Reg::kRdi));
+                t.Emit(MOp::kJmp, Operand::F("__li_trap"));
+            }
+        }
+
+        Jit::Jit(compiler::Diagnostics &diag) : diag(diag), pm(diag)
+        {
+            pm.SetLevel(2);
+        }
+
+        Jit::~Jit()
+        {
+            if (space != nullptr)
+            {
+                munmap(space, kSpace);
+            }
+        }
+
+        bool Jit::Error(const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kNative, 0, 0, msg);
+            return false;
+        }
+
+        // readable and writable, never executable while it is
+        uint8_t *Jit::Pages(size_t bytes)
+        {
+            size_t size = (bytes + kPage - 1) / kPage * kPage;
+            if (used + size > kSpace)
+            {
+                Error("the code space of the jit is full");
+                return nullptr;
+            }
+            auto p = space + used;
+            if (mprotect(p, size, PROT_READ | PROT_WRITE) != 0)
+            {
+                Error("cannot commit memory for the jit");
+                return nullptr;
+            }
+            used += size;
+            return p;
+        }
+
+        //**********************************************************************
+        // linking
+        //**********************************************************************
+
+        uint8_t *Jit::Place(const MModule &mm, std::vector<uint8_t *> &starts)
+        {
+            std::vector<uint8_t> bytes;
+            std::vector<Fixup> fixups;
+            std::unordered_map<string_t, size_t> local;
+            std::vector<size_t> offsets;
+            for (auto &f : mm.functions)
+            {
+                while (bytes.size() % 16 != 0)
+                {
+                    bytes.push_back(0xcc);
+                }
+                local[f.symbol] = bytes.size();
+                offsets.push_back(bytes.size());
+                Encode(f, bytes, fixups);
+            }
+            for (auto &s : mm.strings)
+            {
+                local[s.first] = bytes.size();
+                bytes.insert(bytes.end(), s.second.begin(), s.second.end());
+                bytes.push_back(0);
+            }
+            auto p = Pages(bytes.size());
+            if (p == nullptr)
+            {
+                return nullptr;
+            }
+            std::memcpy(p, bytes.data(), bytes.size());
+            for (auto &fx : fixups)
+            {
+                // a call goes to the code, the value of a function is its stub
+                uint8_t *target = nullptr;
+                auto fn = by_symbol.find(fx.symbol);
+                auto in = local.find(fx.symbol);
+                auto rt = runtime.find(fx.symbol);
+                if (fn != by_symbol.end())
+                {
+                    auto compiled = code.find(fn->second);
+                    target = !fx.branch                ? stubs[index[fn->second]]
+                             : in != local.end()       ? p + in->second
+                             : compiled != code.end()  ? compiled->second
+                                                       : stubs[index[fn->second]];
+                }
+                else if (in != local.end())
+                {
+                    target = p + in->second;
+                }
+                else if (rt != runtime.end())
+                {
+                    target = rt->second;
+                }
+                else
+                {
+                    Error("undefined symbol " + fx.symbol);
+                    return nullptr;
+                }
+                int64_t rel = (target + fx.disp) - (p + fx.next);
+                if (rel < INT32_MIN || rel > INT32_MAX)
+                {
+                    Error(fx.symbol + " is out of the reach of the code");
+                    return nullptr;
+                }
+                auto field = static_cast<int32_t>(rel);
+                std::memcpy(p + fx.at, &field, 4);
+            }
+            size_t size = (bytes.size() + kPage - 1) / kPage * kPage;
+            if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0)
+            {
+                Error("cannot make the code of the jit executable");
+                return nullptr;
+            }
+            code_size += bytes.size();
+            for (auto off : offsets)
+            {
+                starts.push_back(p + off);
+            }
+            return p;
+        }
+
+        // the routines the code calls and a stub for each function
+        bool Jit::Runtime()
+        {
+            auto rax = R(Reg::kRax), rdx = R(Reg::kRdx), rsp = R(Reg::kRsp), r11 = R(Reg::kR11);
+            MModule rt;
+            rt.functions.resize(4);
+            auto &trap = rt.functions[0];
+            trap.symbol = "__li_trap";
+            trap.Emit(MOp::kMov, R(Reg::kRdi), Operand::S("__li_trap_msg"));
+            trap.Emit(MOp::kMov, Operand::S("__li_entry_sp"), rsp);
+            trap.Emit(MOp::kMov, Operand::M(Reg::kRsp, 0), rax);
+            trap.Emit(MOp::kXor, rdx, rdx);
+            trap.Emit(MOp::kMovq, rdx, R(Reg::kXmm0));
+            trap.Emit(MOp::kMovq, rdx, R(Reg::kXmm1));
+            trap.Emit(MOp::kJmp, Operand::F("__li_leave"));
+
+            // the end of an entry, rsp at the result cell of its frame
+            auto &leave = rt.functions[1];
+            leave.symbol = "__li_leave";
+            leave.Emit(MOp::kAdd, Operand::I(8), rsp);
+            leave.Emit(MOp::kPop, r11);
+            leave.Emit(MOp::kMov, r11, Operand::S("__li_stack_limit"));
+            leave.Emit(MOp::kPop, r11);
+            leave.Emit(MOp::kMov, r11, Operand::S("__li_entry_sp"));
+            for (int k = 4; k >= 0; k--)
+            {
+                leave.Emit(MOp::kPop, R(kSaved[k]));
+            }
+            leave.Emit(MOp::kPop, R(Reg::kRbp));
+            leave.Emit(MOp::kRet);
+
+            Thunk(rt.functions[2], "__li_new_array", this, &Jit::NewArray);
+            Thunk(rt.functions[3], "__li_reserve", this, &Jit::Reserve);
+
+            rt.functions.emplace_back();
+            auto &uncompiled = rt.functions.back();
+            uncompiled.symbol = "__li_uncompiled";
+            uncompiled.Emit(MOp::kLea, Operand::S(".Lu"), R(Reg::kRdi));
+            uncompiled.Emit(MOp::kJmp, Operand::F("__li_trap"));
+            rt.strings.push_back({".Lu", "call of a function that is not compiled"});
+
+            size_t first = rt.functions.size();
+            for (size_t i = 0; i < m.functions.size(); i++)
+            {
+                rt.functions.emplace_back();
+                auto &stub = rt.functions.back();
+                stub.symbol = "__li_stub" + std::to_string(i);
+                stub.Emit(MOp::kJmp, Operand::S("__li_slots", static_cast<int32_t>(8 * i)));
+            }
+
+            std::vector<uint8_t *> starts;
+            if (Place(rt, starts) == nullptr)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < first; i++)
+            {
+                runtime[rt.functions[i].symbol] = starts[i];
+            }
+            for (size_t i = first; i < starts.size(); i++)
+            {
+                stubs.push_back(starts[i]);
+                cells[kCells + i - first] = reinterpret_cast<int64_t>(runtime["__li_uncompiled"]);
+            }
+            return true;
+        }
+
+        //**********************************************************************
+        // loading and compiling
+        //**********************************************************************
+
+        bool Jit::Load(const ast::File::Ptr &root, ast::SemanticVisitor &semantic)
+        {
+            if (!Prepare(root, semantic) || !Compile(m.init))
+            {
+                return false;
+            }
+            auto entry = reinterpret_cast<void (*)()>(Wrap(m.init, Mode::kEntry));
+            if (entry == nullptr)
+            {
+                return false;
+            }
+            entry();
+            if (Trapped())
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, Trap());
+                return false;
+            }
+            return true;
+        }
+
+        bool Jit::Prepare(const ast::File::Ptr &root, ast::SemanticVisitor &semantic)
+        {
+            if (loaded)
+            {
+                return Error("the jit has loaded a file already");
+            }
+            auto p = mmap(nullptr, kSpace, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p == MAP_FAILED)
+            {
+                return Error("cannot reserve memory for the jit");
+            }
+            space = static_cast<uint8_t *>(p);
+
+            // a function that cannot be lowered is reported when it is compiled
+            compiler::Diagnostics lowering;
+            ir::Lowering l(lowering);
+            l.Lower(root, semantic, m);
+            rejected = l.Rejected();
+            auto init = rejected.find(m.init);
+            if (init != rejected.end())
+            {
+                auto &d = init->second;
+                diag.Report(d.phase, d.row_number, d.column_number, d.msg);
+                return Error("the global initializers cannot be compiled");
+            }
+            for (auto &f : m.functions)
+            {
+                index[&f] = by_symbol.size();
+                by_symbol[Mangle(f.name)] = &f;
+            }
+
+            size_t n = kCells + m.functions.size() + m.globals.size() + 1;
+            cells = reinterpret_cast<int64_t *>(Pages(8 * n));
+            if (cells == nullptr)
+            {
+                return false;
+            }
+            runtime["__li_stack_limit"] = reinterpret_cast<uint8_t *>(cells + kStackLimit);
+            runtime["__li_entry_sp"] = reinterpret_cast<uint8_t *>(cells + kEntrySp);
+            runtime["__li_trap_msg"] = reinterpret_cast<uint8_t *>(cells + kTrapMsg);
+            runtime["__li_slots"] = reinterpret_cast<uint8_t *>(cells + kCells);
+            runtime["li_globals"] = reinterpret_cast<uint8_t *>(cells + kCells + m.functions.size());
+            if (!Runtime())
+            {
+                return false;
+            }
+            loaded = true;
+            return true;
+        }
+
+        bool Jit::Compile(const string_t &name)
+        {
+            auto f = loaded ? m.Find(name) : nullptr;
+            if (f == nullptr)
+            {
+                return Error(loaded ? "function " + name + " is not declared" : "the jit has not loaded a file");
+            }
+            return Compile(f);
+        }
+
+        bool Jit::Compiled(const string_t &name)
+        {
+            auto f = loaded ? m.Find(name) : nullptr;
+            return f != nullptr && code.count(f) != 0;
+        }
+
+        bool Jit::Compile(ir::Function *root)
+        {
+            // the functions it calls or takes the value of, which may call others
+            std::vector<ir::Function *> batch, todo{root};
+            std::unordered_set<const ir::Function *> seen;
+            while (!todo.empty())
+            {
+                auto f = todo.back();
+                todo.pop_back();
+                if (code.count(f) != 0 || !seen.insert(f).second)
+                {
+                    continue;
+                }
+                auto r = rejected.find(f);
+                if (r != rejected.end())
+                {
+                    diag.Report(r->second.phase, r->second.row_number, r->second.column_number, r->second.msg);
+                    return Error("function " + root->name + " cannot be compiled" +
+                                 (f == root ? "" : ", it reaches " + f->name));
+                }
+                if (optimized.insert(f).second && !pm.Run(*f))
+                {
+                    return false;
+                }
+                batch.push_back(f);
+                if (lazy)
+                {
+                    continue;
+                }
+                for (auto &b : f->blocks)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        if (in->fn != nullptr)
+                        {
+                            todo.push_back(in->fn);
+                        }
+                        for (auto arg : in->args)
+                        {
+                            if (arg->IsConst() && arg->fn != nullptr)
+                            {
+                                todo.push_back(arg->fn);
+                            }
+                        }
+                    }
+                }
+            }
+            if (batch.empty())
+            {
+                return true;
+            }
+
+            compiler::Diagnostics d;
+            MModule mm;
+            if (!Codegen(d, pm).Generate(m, batch, mm))
+            {
+                diag.Merge(d);
+                return false;
+            }
+            std::vector<uint8_t *> starts;
+            if (Place(mm, starts) == nullptr)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                code[batch[i]] = starts[i];
+                auto stub = index.find(batch[i]);
+                if (stub != index.end())
+                {
+                    cells[kCells + stub->second] = reinterpret_cast<int64_t>(starts[i]);
+                }
+            }
+            return true;
+        }
+
+        //**********************************************************************
+        // entries
+        //**********************************************************************
+
+        void *Jit::Wrap(ir::Function *f, Mode mode)
+        {
+            auto rsp = R(Reg::kRsp), rbp = R(Reg::kRbp), r11 = R(Reg::kR11), rax = R(Reg::kRax);
+            size_t n = f->returns.size();
+            bool run = mode == Mode::kRun, sret = mode == Mode::kEntry && n > 2;
+            MModule mm;
+            mm.functions.emplace_back();
+            auto &e = mm.functions.back();
+            e.symbol = "__li_entry";
+            e.Emit(MOp::kPush, rbp);
+            e.Emit(MOp::kMov, rsp, rbp);
+            for (auto r : kSaved)
+            {
+                e.Emit(MOp::kPush, R(r));
+            }
+            // the frame of a nested entry is restored when it returns
+            e.Emit(MOp::kMov, Operand::S("__li_entry_sp"), r11);
+            e.Emit(MOp::kPush, r11);
+            e.Emit(MOp::kMov, Operand::S("__li_stack_limit"), r11);
+            e.Emit(MOp::kPush, r11);
+            // what a trap returns in rax: the buffer of the results or 0
+            e.Emit(MOp::kSub, Operand::I(8), rsp);
+            e.Emit(MOp::kMov, sret ? R(Reg::kRdi) : Operand::I(0), Operand::M(Reg::kRsp, 0));
+            e.Emit(MOp::kMov, rsp, Operand::S("__li_entry_sp"));
+            e.Emit(MOp::kMov, Operand::I(0), Operand::S("__li_trap_msg"));
+            int nested = e.NewLabel();
+            e.Emit(MOp::kTest, r11, r11);
+            e.Emit(MOp::kJcc, Cond::kNe, Operand::L(nested));
+            e.Emit(MOp::kLea, Operand::M(Reg::kRsp, -static_cast<int32_t>(stack)), r11);
+            e.Emit(MOp::kMov, r11, Operand::S("__li_stack_limit"));
+            e.Emit(MOp::kLabel, Operand::L(nested));
+
+            if (mode == Mode::kCells)
+            {
+                // the arguments are read from the cells at rbx, the results written to the cells at r12
+                e.Emit(MOp::kMov, R(Reg::kRdi), R(Reg::kRbx));
+                e.Emit(MOp::kMov, R(Reg::kRsi), R(Reg::kR12));
+                auto args = Classify(f->params, false, n > 2);
+                if (args.stack != 0)
+                {
+                    e.Emit(MOp::kSub, Operand::I(8 * ((args.stack + 1) & ~1)), rsp);
+                }
+                for (size_t k = 0; k < f->params.size(); k++)
+                {
+                    auto cell = Operand::M(Reg::kRbx, static_cast<int32_t>(8 * k));
+                    auto &to = args.locs[k];
+                    if (to.IsMem())
+                    {
+                        e.Emit(MOp::kMov, cell, r11);
+                        e.Emit(MOp::kMov, r11, to);
+                    }
+                    else
+                    {
+                        e.Emit(f->params[k] == ir::Type::kF64 ? MOp::kMovsd : MOp::kMov, cell, to);
+                    }
+                }
+                if (n > 2)
+                {
+                    e.Emit(MOp::kMov, R(Reg::kR12), R(Reg::kRdi));
+                }
+            }
+            else
+            {
+                // c passes a bool in the low byte of its register
+                size_t ints = sret ? 1 : 0;
+                for (auto t : f->params)
+                {
+                    if (t != ir::Type::kF64 && ints < 6)
+                    {
+                        auto r = R(kIntArgs[ints++]);
+                        if (t == ir::Type::kBool)
+                        {
+                            e.Emit(MOp::kMovzb, r, r);
+                        }
+                    }
+                }
+            }
+            if (run && n > 2)
+            {
+                e.Emit(MOp::kSub, Operand::I(8 * ((n + 1) & ~size_t(1))), rsp);
+                e.Emit(MOp::kMov, rsp, R(Reg::kRdi));
+            }
+            e.Emit(MOp::kCall, Operand::F(Mangle(f->name)));
+            if (mode == Mode::kCells)
+            {
+                auto results = Classify(f->returns, true, false);
+                for (size_t k = 0; k < n && n <= 2; k++)
+                {
+                    auto cell = Operand::M(Reg::kR12, static_cast<int32_t>(8 * k));
+                    e.Emit(f->returns[k] == ir::Type::kF64 ? MOp::kMovsd : MOp::kMov, results.locs[k], cell);
+                }
+                e.Emit(MOp::kLea, Operand::M(Reg::kRbp, -8 * 8), rsp);
+            }
+            if (run)
+            {
+                if (n == 0)
+                {
+                    e.Emit(MOp::kMov, Operand::I(0), rax);
+                }
+                else if (f->returns[0] == ir::Type::kF64)
+                {
+                    e.Emit(MOp::kCvttsd2si, n > 2 ? Operand::M(Reg::kRax, 0) : R(Reg::kXmm0), rax);
+                }
+                else if (n > 2)
+                {
+                    e.Emit(MOp::kMov, Operand::M(Reg::kRax, 0), rax);
+                }
+                e.Emit(MOp::kLea, Operand::M(Reg::kRbp, -8 * 8), rsp);
+            }
+            e.Emit(MOp::kJmp, Operand::F("__li_leave"));
+
+            std::vector<uint8_t *> starts;
+            return Place(mm, starts) == nullptr ? nullptr : starts[0];
+        }
+
+        void *Jit::Entry(const string_t &name, const std::vector<ir::Type> &params, ir::Type result, size_t size)
+        {
+            auto f = loaded ? m.Find(name) : nullptr;
+            if (f == nullptr)
+            {
+                Error(loaded ? "function " + name + " is not declared" : "the jit has not loaded a file");
+                return nullptr;
+            }
+            auto &r = f->returns;
+            bool results = result == ir::Type::kVoid    ? r.empty()
+                           : result == ir::Type::kTuple ? r.size() > 1 && size == 8 * r.size()
+                                                        : r.size() == 1 && r[0] == result;
+            if (params != f->params || !results)
+            {
+                Error("the entry of " + name + " does not match its types");
+                return nullptr;
+            }
+            size_t ints = r.size() > 2 ? 1 : 0, floats = 0;
+            for (auto t : params)
+            {
+                (t == ir::Type::kF64 ? floats : ints)++;
+            }
+            if (ints > 6 || floats > 8)
+            {
+                Error("the entry of " + name + " would pass arguments on the stack, which is not supported");
+                return nullptr;
+            }
+            auto it = entries.find(name);
+            if (it != entries.end())
+            {
+                return it->second;
+            }
+            if (!Compile(f))
+            {
+                return nullptr;
+            }
+            auto e = Wrap(f, Mode::kEntry);
+            if (e != nullptr)
+            {
+                entries[name] = e;
+            }
+            return e;
+        }
+
+        bool Jit::Run(int64_t &result)
+        {
+            auto main = loaded ? m.Find("main") : nullptr;
+            if (main == nullptr)
+            {
+                return Error(loaded ? "function main is not declared" : "the jit has not loaded a file");
+            }
+            if (!main->params.empty())
+            {
+                return Error("function main expects " + std::to_string(main->params.size()) + " arguments");
+            }
+            auto it = entries.find("<run>");
+            if (it == entries.end())
+            {
+                auto e = Compile(main) ? Wrap(main, Mode::kRun) : nullptr;
+                if (e == nullptr)
+                {
+                    return false;
+                }
+                it = entries.insert({"<run>", e}).first;
+            }
+            result = reinterpret_cast<int64_t (*)()>(it->second)();
+            if (Trapped())
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, Trap());
+                return false;
+            }
+            return true;
+        }
+
+        bool Jit::Trapped() const
+        {
+            return cells != nullptr && cells[kTrapMsg] != 0;
+        }
+
+        string_t Jit::Trap() const
+        {
+            return Trapped() ? reinterpret_cast<const char *>(cells[kTrapMsg]) : "";
+        }
+
+        //**********************************************************************
+        // the heap
+        //**********************************************************************
+
+        // n zeroed cells, nullptr with a trap when memory runs out
+        int64_t *Jit::Alloc(size_t n)
+        {
+            if (heap == nullptr || heap + n > heap_end)
+            {
+                size_t size = std::max(n, kChunk);
+                auto chunk = new (std::nothrow) int64_t[size]();
+                if (chunk == nullptr)
+                {
+                    cells[kTrapMsg] = reinterpret_cast<int64_t>("out of memory");
+                    return nullptr;
+                }
+                chunks.emplace_back(chunk);
+                if (size > kChunk)
+                {
+                    return chunk;
+                }
+                heap = chunk;
+                heap_end = chunk + size;
+            }
+            auto p = heap;
+            heap += n;
+            return p;
+        }
+
+        int64_t Jit::NewArray(Jit *jit, int64_t, int64_t, int64_t)
+        {
+            return reinterpret_cast<int64_t>(jit->Alloc(kArray));
+        }
+
+        // the array grown to hold the index, 0 when the index is out of range
+        int64_t Jit::Reserve(Jit *jit, int64_t array, int64_t index, int64_t nocreate)
+        {
+            if (static_cast<uint64_t>(index) >= (uint64_t(1) << 24) || (array == 0 && nocreate != 0))
+            {
+                return 0;
+            }
+            auto a = array != 0 ? reinterpret_cast<int64_t *>(array) : jit->Alloc(kArray);
+            if (a == nullptr || static_cast<uint64_t>(a[0]) > static_cast<uint64_t>(index))
+            {
+                return reinterpret_cast<int64_t>(a);
+            }
+            // the segments from the one past the length to the one of the index
+            int last = 63 - __builtin_clzll(static_cast<uint64_t>(index) + 8);
+            for (int h = 63 - __builtin_clzll(static_cast<uint64_t>(a[0]) + 8); h <= last; h++)
+            {
+                if (a[h] == 0)
+                {
+                    auto seg = jit->Alloc(size_t(1) << h);
+                    if (seg == nullptr)
+                    {
+                        return 0;
+                    }
+                    a[h] = reinterpret_cast<int64_t>(seg);
+                }
+            }
+            a[0] = index + 1;
+            return reinterpret_cast<int64_t>(a);
+        }
+    }
+}
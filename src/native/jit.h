@@ -0,0 +1,163 @@
+#ifndef LILANG_NATIVE_JIT
+#define LILANG_NATIVE_JIT
+
+#include <type_traits>
+#include "../ir/lower.h"
+#include "./codegen.h"
+
+/*
+compilation of the functions of a checked file to machine code in the
+memory of the process
+
+the file is lowered once. a function is optimized and compiled the first
+time it is asked for, together with the functions it calls or takes the
+value of that are not compiled yet; the code is the code the ahead of time
+compiler prints, encoded and linked in place. a function using a construct
+the ir cannot express is reported at that construct and never compiled.
+
+one range of addresses is reserved up front, so code, data and the runtime
+reach each other with 32 bit displacements. no page is ever writable and
+executable at once: code is written to fresh pages, which then become read
+only and executable, and the globals and the cells of the runtime live on
+data pages that never execute. arrays are allocated by c++ routines the
+code calls through thunks keeping every register, see codegen.h.
+
+every function has a stub jumping through a cell to its code, or to a trap
+while it is not compiled. a function value is the address of its stub, a
+call from compiled code goes straight to the code.
+
+c++ calls a function through an entry: a function pointer of the c
+signature matching its types, int64_t for int, double for float, bool, and
+a pointer for anything else. one result is returned as is, more as a
+struct of as many 8 byte members. the calls an entry makes get a stack of
+their own size, and it catches their traps: the call returns zeros and
+Trapped tells what happened. a jit runs one call at a time.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        // the ir type of a c++ parameter or result of an entry, kTuple for a struct of results
+        template <typename T>
+        struct EntryType
+        {
+            static ir::Type Of()
+            {
+                return std::is_same<T, bool>::value                             ? ir::Type::kBool
+                       : std::is_same<T, double>::value                         ? ir::Type::kF64
+                       : std::is_integral<T>::value && sizeof(T) == 8           ? ir::Type::kI64
+                       : std::is_pointer<T>::value                              ? ir::Type::kRef
+                       : std::is_class<T>::value && sizeof(T) % 8 == 0          ? ir::Type::kTuple
+                                                                                : ir::Type::kVoid;
+            }
+            static size_t Size() { return sizeof(T); }
+        };
+
+        template <>
+        struct EntryType<void>
+        {
+            static ir::Type Of() { return ir::Type::kVoid; }
+            static size_t Size() { return 0; }
+        };
+
+        template <typename F>
+        struct EntrySignature;
+
+        template <typename R, typename... Args>
+        struct EntrySignature<R(Args...)>
+        {
+            typedef R Result;
+            static std::vector<ir::Type> Params() { return {EntryType<Args>::Of()...}; }
+        };
+
+        class Jit
+        {
+        public:
+            explicit Jit(compiler::Diagnostics &diag);
+            ~Jit();
+
+            // the passes run on a function before it is compiled, -O2 by default
+            ir::PassManager &Passes() { return pm; }
+            // the stack the calls of an entry may use, 4mb by default
+            void SetStack(size_t bytes) { stack = bytes; }
+
+            // lowers a file the visitor checked without errors and runs its global initializers
+            bool Load(const ast::File::Ptr &, ast::SemanticVisitor &);
+            // compiles a function and what it reaches that is not compiled yet
+            bool Compile(const string_t &name);
+            bool Compiled(const string_t &name);
+
+            // nullptr when the function cannot be compiled or F does not match its types
+            template <typename F>
+            F *Entry(const string_t &name)
+            {
+                typedef typename EntrySignature<F>::Result R;
+                return reinterpret_cast<F *>(
+                    Entry(name, EntrySignature<F>::Params(), EntryType<R>::Of(), EntryType<R>::Size()));
+            }
+
+            // calls main and converts its result the way the vm's Run does
+            bool Run(int64_t &result);
+
+            // the last call through an entry ended in a trap, with its position and message
+            bool Trapped() const;
+            string_t Trap() const;
+
+            // bytes of machine code, the runtime and the stubs included
+            size_t CodeSize() const { return code_size; }
+
+        private:
+            friend class Tiered;
+
+            enum class Mode
+            {
+                kEntry, // the c signature of its types
+                kRun,   // converts the result of main as Run does
+                kCells, // void(const int64_t *args, int64_t *results), a cell for each value
+            };
+
+            compiler::Diagnostics &diag;
+            ir::PassManager pm;
+            ir::Module m;
+            std::unordered_map<const ir::Function *, compiler::Diagnostic> rejected;
+            std::unordered_map<string_t, ir::Function *> by_symbol;
+            std::unordered_map<const ir::Function *, size_t> index; // of the stub and its cell
+            std::vector<uint8_t *> stubs;
+            std::unordered_map<const ir::Function *, uint8_t *> code;
+            std::unordered_set<const ir::Function *> optimized;
+            std::unordered_map<string_t, uint8_t *> runtime; // routines and cells by symbol
+            std::unordered_map<string_t, void *> entries;
+            uint8_t *space = nullptr; // the reserved range
+            size_t used = 0;
+            int64_t *cells = nullptr;
+            size_t code_size = 0;
+            size_t stack = 4 << 20;
+            bool loaded = false;
+            bool lazy = false; // a function is compiled alone, what it calls is reached through the stubs
+
+            // the heap of arrays, never freed before the jit
+            std::vector<std::unique_ptr<int64_t[]>> chunks;
+            int64_t *heap = nullptr, *heap_end = nullptr;
+
+            bool Error(const string_t &msg);
+            // lowers the file and places the runtime, the initializers are left to the caller
+            bool Prepare(const ast::File::Ptr &, ast::SemanticVisitor &);
+            uint8_t *Pages(size_t bytes);
+            // encodes, links and protects functions and their strings, nullptr on failure;
+            // starts gets the address of each function
+            uint8_t *Place(const MModule &, std::vector<uint8_t *> &starts);
+            bool Runtime();
+            bool Compile(ir::Function *);
+            void *Entry(const string_t &name, const std::vector<ir::Type> &params, ir::Type result, size_t size);
+            // an entry calling f
+            void *Wrap(ir::Function *f, Mode);
+
+            int64_t *Alloc(size_t n);
+            // called from the thunks with rax, rcx and rdx of the generated code
+            static int64_t NewArray(Jit *, int64_t, int64_t, int64_t);
+            static int64_t Reserve(Jit *, int64_t array, int64_t index, int64_t nocreate);
+        };
+    }
+}
+
+#endif
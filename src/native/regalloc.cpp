@@ -0,0 +1,181 @@
+#include <algorithm>
+#include "./regalloc.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            const Reg kCallerSaved[] = {Reg::kRsi, Reg::kRdi, Reg::kR8, Reg::kR9, Reg::kR10};
+            const Reg kCalleeSaved[] = {Reg::kRbx, Reg::kR12, Reg::kR13, Reg::kR14, Reg::kR15};
+
+            bool Allocated(const ir::Instr *v)
+            {
+                return v->block != nullptr && v->type != ir::Type::kVoid && v->type != ir::Type::kTuple;
+            }
+        }
+
+        Allocation::Allocation(const ir::Function &f, const std::vector<ir::Block *> &order, const ir::Liveness &live,
+                               const std::unordered_set<const ir::Instr *> &skip)
+        {
+            std::unordered_map<const ir::Instr *, size_t> index;
+            std::vector<Interval> intervals;
+            std::vector<int> calls;
+            auto touch = [&](const ir::Instr *v, int pos) {
+                if (!Allocated(v) || skip.count(v) != 0)
+                {
+                    return;
+                }
+                auto it = index.find(v);
+                if (it == index.end())
+                {
+                    index[v] = intervals.size();
+                    intervals.push_back({v, pos, pos, false, v->type == ir::Type::kF64});
+                    return;
+                }
+                auto &i = intervals[it->second];
+                i.start = std::min(i.start, pos);
+                i.end = std::max(i.end, pos);
+            };
+
+            int pos = 0, call = 0;
+            for (auto b : order)
+            {
+                int start = pos;
+                pos += 2;
+                for (auto in : b->instrs)
+                {
+                    int use = pos, def = pos + 1;
+                    pos += 2;
+                    if (in->op == ir::Op::kPhi)
+                    {
+                        touch(in, start);
+                        continue;
+                    }
+                    for (auto a : in->args)
+                    {
+                        touch(a, use);
+                    }
+                    if (in->op == ir::Op::kCall || in->op == ir::Op::kCallValue)
+                    {
+                        calls.push_back(use);
+                        call = def;
+                    }
+                    // the results of a call are all taken where it returns
+                    touch(in, in->op == ir::Op::kParam ? 0 : in->op == ir::Op::kExtract ? call : def);
+                }
+                int end = pos;
+                pos += 2;
+                for (auto v : live.LiveIn(b))
+                {
+                    touch(v, start);
+                }
+                for (auto v : live.LiveOut(b))
+                {
+                    touch(v, end);
+                }
+            }
+            for (auto &i : intervals)
+            {
+                auto c = std::upper_bound(calls.begin(), calls.end(), i.start);
+                i.crosses = c != calls.end() && *c < i.end;
+            }
+            Scan(intervals);
+        }
+
+        Loc Allocation::Of(const ir::Instr *v) const
+        {
+            auto it = locs.find(v);
+            return it == locs.end() ? Loc() : it->second;
+        }
+
+        void Allocation::Scan(std::vector<Interval> &intervals)
+        {
+            std::sort(intervals.begin(), intervals.end(), [](const Interval &a, const Interval &b) {
+                return a.start != b.start ? a.start < b.start : a.value->id < b.value->id;
+            });
+            std::vector<Interval *> active;
+            bool busy[static_cast<int>(Reg::kNone)] = {};
+            auto spill = [&](const Interval *i) {
+                Loc l;
+                l.kind = Loc::Kind::kStack;
+                l.slot = spills++;
+                locs[i->value] = l;
+            };
+            for (auto &cur : intervals)
+            {
+                // registers of intervals ended before this one are free again
+                auto end = std::remove_if(active.begin(), active.end(), [&](Interval *i) {
+                    if (i->end >= cur.start)
+                    {
+                        return false;
+                    }
+                    busy[static_cast<int>(locs[i->value].reg)] = false;
+                    return true;
+                });
+                active.erase(end, active.end());
+
+                std::vector<Reg> allowed;
+                if (cur.xmm)
+                {
+                    for (int x = 2; x < 16 && !cur.crosses; x++)
+                    {
+                        allowed.push_back(Xmm(x));
+                    }
+                }
+                else
+                {
+                    if (!cur.crosses)
+                    {
+                        allowed.insert(allowed.end(), std::begin(kCallerSaved), std::end(kCallerSaved));
+                    }
+                    allowed.insert(allowed.end(), std::begin(kCalleeSaved), std::end(kCalleeSaved));
+                }
+
+                Reg reg = Reg::kNone;
+                for (auto r : allowed)
+                {
+                    if (!busy[static_cast<int>(r)])
+                    {
+                        reg = r;
+                        break;
+                    }
+                }
+                if (reg == Reg::kNone)
+                {
+                    // the active interval ending last gives up its register if it ends after this one
+                    Interval *victim = nullptr;
+                    for (auto i : active)
+                    {
+                        auto r = locs[i->value].reg;
+                        if (std::find(allowed.begin(), allowed.end(), r) != allowed.end() &&
+                            (victim == nullptr || i->end > victim->end))
+                        {
+                            victim = i;
+                        }
+                    }
+                    if (victim == nullptr || victim->end <= cur.end)
+                    {
+                        spill(&cur);
+                        continue;
+                    }
+                    reg = locs[victim->value].reg;
+                    spill(victim);
+                    active.erase(std::find(active.begin(), active.end(), victim));
+                }
+                Loc l;
+                l.kind = Loc::Kind::kReg;
+                l.reg = reg;
+                locs[cur.value] = l;
+                busy[static_cast<int>(reg)] = true;
+                active.push_back(&cur);
+                if (std::find(std::begin(kCalleeSaved), std::end(kCalleeSaved), reg) != std::end(kCalleeSaved) &&
+                    std::find(saved.begin(), saved.end(), reg) == saved.end())
+                {
+                    saved.push_back(reg);
+                }
+            }
+        }
+    }
+}
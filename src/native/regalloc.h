@@ -0,0 +1,72 @@
+#ifndef LILANG_NATIVE_REGALLOC
+#define LILANG_NATIVE_REGALLOC
+
+#include <unordered_set>
+#include "../ir/liveness.h"
+#include "./x86_64.h"
+
+/*
+linear scan register allocation over the ssa values of a function
+
+the blocks are laid out in the given order and every instruction gets a use
+and a def position, so a value dying at an instruction can share its
+register with the value the instruction defines. a value lives on one
+interval, from its first definition or live-in point to its last use or
+live-out point; holes are ignored. the liveness of the ir gives the block
+boundaries, a phi operand is used at the end of its predecessor.
+
+the allocatable registers leave rax, rcx, rdx and r11 to the code
+generator and xmm0 and xmm1 to float code. a value live across a call may
+only take a callee saved register, rbx and r12 to r15; there is none for
+floats, so such a float is spilled. when the registers run out, the interval
+ending last is spilled for its whole life to a slot of the frame.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        struct Loc
+        {
+            enum class Kind : uint8_t
+            {
+                kNone, // constants and values the code generator rebuilds where used
+                kReg,
+                kStack,
+            };
+
+            Kind kind = Kind::kNone;
+            Reg reg = Reg::kNone;
+            int slot = 0; // spill slot
+        };
+
+        class Allocation
+        {
+        public:
+            // values in skip get no location
+            Allocation(const ir::Function &, const std::vector<ir::Block *> &order, const ir::Liveness &,
+                       const std::unordered_set<const ir::Instr *> &skip);
+
+            Loc Of(const ir::Instr *) const;
+            // the callee saved registers it used
+            const std::vector<Reg> &Saved() const { return saved; }
+            int Spills() const { return spills; }
+
+        private:
+            struct Interval
+            {
+                const ir::Instr *value;
+                int start, end;
+                bool crosses; // a call
+                bool xmm;
+            };
+
+            std::unordered_map<const ir::Instr *, Loc> locs;
+            std::vector<Reg> saved;
+            int spills = 0;
+
+            void Scan(std::vector<Interval> &);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,828 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include "../ir/liveness.h"
+#include "./tiered.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            Operand R(Reg r) { return Operand::R(r); }
+
+            double F(int64_t bits)
+            {
+                double f;
+                std::memcpy(&f, &bits, sizeof(f));
+                return f;
+            }
+
+            int64_t Bits(double f)
+            {
+                int64_t bits;
+                std::memcpy(&bits, &f, sizeof(bits));
+                return bits;
+            }
+
+            string_t Pos(std::pair<int, int> pos)
+            {
+                return "(" + std::to_string(pos.first) + ", " + std::to_string(pos.second) + ")";
+            }
+
+            // the cell of element i of an array, which holds it
+            int64_t *Element(int64_t array, int64_t i)
+            {
+                auto j = static_cast<uint64_t>(i) + 8;
+                int h = 63 - __builtin_clzll(j);
+                auto seg = reinterpret_cast<int64_t *>(reinterpret_cast<int64_t *>(array)[h]);
+                return seg + (j - (uint64_t(1) << h));
+            }
+
+            bool InRange(int64_t array, int64_t i)
+            {
+                return array != 0 && static_cast<uint64_t>(i) < static_cast<uint64_t>(*reinterpret_cast<int64_t *>(array));
+            }
+
+            // v has a second definition p in the new entry: a use reached from there reads p, one
+            // reached from v reads v, and where both meet a phi is placed, as lowering does
+            void Repair(ir::Function &f, ir::Instr *v, ir::Instr *p)
+            {
+                std::vector<std::pair<ir::Instr *, size_t>> uses;
+                for (auto &b : f.blocks)
+                {
+                    for (auto in : b->instrs)
+                    {
+                        for (size_t k = 0; k < in->args.size(); k++)
+                        {
+                            if (in->args[k] == v)
+                            {
+                                uses.push_back({in, k});
+                            }
+                        }
+                    }
+                }
+                std::unordered_map<ir::Block *, ir::Instr *> start;
+                std::vector<ir::Instr *> added;
+                std::function<ir::Instr *(ir::Block *)> at_start, at_end;
+                at_end = [&](ir::Block *b) { return b == p->block ? p : b == v->block ? v : at_start(b); };
+                at_start = [&](ir::Block *b) {
+                    auto it = start.find(b);
+                    if (it != start.end())
+                    {
+                        return it->second;
+                    }
+                    if (b->preds.size() == 1)
+                    {
+                        auto val = at_end(b->preds[0]);
+                        return start[b] = val;
+                    }
+                    // placed before its operands are known, a loop may lead back to it
+                    auto phi = start[b] = f.InsertPhi(b, v->type);
+                    added.push_back(phi);
+                    for (auto pred : b->preds)
+                    {
+                        auto val = at_end(pred);
+                        phi->args.push_back(val);
+                    }
+                    return phi;
+                };
+                for (auto &u : uses)
+                {
+                    auto in = u.first;
+                    if (in->op == ir::Op::kPhi)
+                    {
+                        in->args[u.second] = at_end(in->block->preds[u.second]);
+                    }
+                    else if (in->block != v->block)
+                    {
+                        in->args[u.second] = at_start(in->block);
+                    }
+                }
+                // a phi merging one value is that value
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (auto phi : added)
+                    {
+                        ir::Instr *same = nullptr;
+                        bool trivial = phi->block != nullptr;
+                        for (auto a : phi->args)
+                        {
+                            if (a != phi && a != same)
+                            {
+                                trivial = trivial && same == nullptr;
+                                same = a;
+                            }
+                        }
+                        if (trivial && same != nullptr)
+                        {
+                            f.Replace({{phi, same}});
+                            changed = true;
+                        }
+                    }
+                }
+            }
+
+            // the stub of function fn leads here while it is not compiled: the arguments go to cells,
+            // Enter runs the function, and its results are returned as the function would
+            void Bridge(MFunction &t, const ir::Function &f, void *tiered, size_t fn,
+                        void (*enter)(Tiered *, int64_t, const int64_t *, int64_t *))
+            {
+                auto rsp = R(Reg::kRsp), rbp = R(Reg::kRbp), r11 = R(Reg::kR11), rcx = R(Reg::kRcx);
+                size_t np = f.params.size(), nr = f.returns.size();
+                bool sret = nr > 2;
+                // the arguments, then the results or the buffer of the caller
+                size_t cells = np + (sret ? 1 : nr);
+                t.symbol = "__li_bridge" + std::to_string(fn);
+                t.Emit(MOp::kPush, rbp);
+                t.Emit(MOp::kMov, rsp, rbp);
+                if (cells != 0)
+                {
+                    t.Emit(MOp::kSub, Operand::I(8 * ((cells + 1) & ~size_t(1))), rsp);
+                }
+                auto args = Classify(f.params, false, sret);
+                for (size_t k = 0; k < np; k++)
+                {
+                    auto cell = Operand::M(Reg::kRsp, static_cast<int32_t>(8 * k));
+                    auto &from = args.locs[k];
+                    if (from.IsMem())
+                    {
+                        t.Emit(MOp::kMov, Operand::M(Reg::kRbp, 16 + from.disp), r11);
+                        t.Emit(MOp::kMov, r11, cell);
+                    }
+                    else
+                    {
+                        t.Emit(f.params[k] == ir::Type::kF64 ? MOp::kMovsd : MOp::kMov, from, cell);
+                    }
+                }
+                auto results = Operand::M(Reg::kRsp, static_cast<int32_t>(8 * np));
+                if (sret)
+                {
+                    t.Emit(MOp::kMov, R(Reg::kRdi), results);
+                    t.Emit(MOp::kMov, R(Reg::kRdi), rcx);
+                }
+                else
+                {
+                    t.Emit(MOp::kLea, results, rcx);
+                }
+                t.Emit(MOp::kMov, rsp, R(Reg::kRdx));
+                t.Emit(MOp::kMov, Operand::I(static_cast<int64_t>(fn)), R(Reg::kRsi));
+                t.Emit(MOp::kMov, Operand::I(reinterpret_cast<int64_t>(tiered)), R(Reg::kRdi));
+                t.Emit(MOp::kMov, Operand::I(reinterpret_cast<int64_t>(enter)), R(Reg::kRax));
+                t.Emit(MOp::kCall, R(Reg::kRax));
+                int trap = t.NewLabel();
+                t.Emit(MOp::kCmp, Operand::I(0), Operand::S("__li_trap_msg"));
+                t.Emit(MOp::kJcc, Cond::kNe, Operand::L(trap));
+                if (sret)
+                {
+                    t.Emit(MOp::kMov, results, R(Reg::kRax));
+                }
+                else
+                {
+                    auto locs = Classify(f.returns, true, false).locs;
+                    for (size_t k = 0; k < nr; k++)
+                    {
+                        auto cell = Operand::M(Reg::kRsp, static_cast<int32_t>(8 * (np + k)));
+                        t.Emit(f.returns[k] == ir::Type::kF64 ? MOp::kMovsd : MOp::kMov, cell, locs[k]);
+                    }
+                }
+                t.Emit(MOp::kMov, rbp, rsp);
+                t.Emit(MOp::kPop, rbp);
+                t.Emit(MOp::kRet);
+                t.Emit(MOp::kLabel, Operand::L(trap));
+                t.Emit(MOp::kMov, Operand::S("__li_trap_msg"), R(Reg::kRdi));
+                t.Emit(MOp::kJmp, Operand::F("__li_trap"));
+            }
+        }
+
+        Tiered::Tiered(compiler::Diagnostics &diag) : diag(diag), jit(optimizer)
+        {
+        }
+
+        void Tiered::SetThresholds(int64_t calls, int64_t loops)
+        {
+            hot_calls = calls;
+            hot_loops = loops;
+        }
+
+        bool Tiered::Error(const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kRuntime, 0, 0, msg);
+            return false;
+        }
+
+        void Tiered::Trace(const string_t &line)
+        {
+            if (trace != nullptr)
+            {
+                *trace << line << std::endl;
+            }
+        }
+
+        bool Tiered::Compiled(const string_t &name) const
+        {
+            for (auto &c : codes)
+            {
+                if (c.f->name == name && c.f != base.init)
+                {
+                    return c.entry != nullptr;
+                }
+            }
+            return false;
+        }
+
+        //**********************************************************************
+        // loading
+        //**********************************************************************
+
+        bool Tiered::Load(const ast::File::Ptr &root, ast::SemanticVisitor &semantic)
+        {
+            if (!codes.empty())
+            {
+                return Error("the tiered engine has loaded a file already");
+            }
+            ir::Lowering l(diag);
+            if (!l.Lower(root, semantic, base))
+            {
+                return false;
+            }
+            jit.lazy = true;
+            if (!jit.Prepare(root, semantic))
+            {
+                diag.Merge(optimizer);
+                return false;
+            }
+            limit = reinterpret_cast<int64_t *>(jit.runtime["__li_stack_limit"]);
+            trap_msg = reinterpret_cast<int64_t *>(jit.runtime["__li_trap_msg"]);
+            globals = reinterpret_cast<int64_t *>(jit.runtime["li_globals"]);
+
+            // both modules have the functions in the order they were lowered in
+            codes.resize(base.functions.size());
+            for (size_t i = 0; i < codes.size(); i++)
+            {
+                auto &c = codes[i];
+                c.f = &base.functions[i];
+                c.target = &jit.m.functions[i];
+                index[c.f] = i;
+                targets[c.f] = c.target;
+                by_stub[reinterpret_cast<int64_t>(jit.stubs[i])] = i;
+            }
+            for (auto &c : codes)
+            {
+                Prepare(c);
+                for (auto &b : c.f->blocks)
+                {
+                    auto loop = l.Loops().find(b.get());
+                    if (loop != l.Loops().end())
+                    {
+                        c.loops[b.get()].pos = loop->second;
+                        c.headers[b->id] = &c.loops[b.get()];
+                    }
+                }
+            }
+            if (!Bridges())
+            {
+                diag.Merge(optimizer);
+                return false;
+            }
+            std::vector<int64_t> none;
+            return Start(codes[index[base.init]], none.data());
+        }
+
+        // the layout of a frame and the values of the constants
+        void Tiered::Prepare(Code &c)
+        {
+            size_t ids = 0;
+            int blocks = 0;
+            std::vector<ir::Instr *> constants;
+            for (auto &b : c.f->blocks)
+            {
+                blocks = std::max(blocks, b->id + 1);
+                for (auto in : b->instrs)
+                {
+                    ids = std::max(ids, static_cast<size_t>(in->id) + 1);
+                    for (auto a : in->args)
+                    {
+                        ids = std::max(ids, static_cast<size_t>(a->id) + 1);
+                        if (a->IsConst())
+                        {
+                            constants.push_back(a);
+                        }
+                    }
+                }
+            }
+            c.headers.assign(blocks, nullptr);
+            c.area.assign(ids, 0);
+            c.cells = ids;
+            for (auto &b : c.f->blocks)
+            {
+                for (auto in : b->instrs)
+                {
+                    switch (in->op)
+                    {
+                    case ir::Op::kCall:
+                    case ir::Op::kCallValue:
+                        // the arguments, then the results when there is more than one
+                        c.area[in->id] = c.cells;
+                        c.cells += in->args.size() + (in->type == ir::Type::kTuple ? in->results.size() : 0);
+                        break;
+                    case ir::Op::kSlot:
+                        c.area[in->id] = c.cells++;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+            for (auto &b : c.f->blocks)
+            {
+                for (auto in : b->instrs)
+                {
+                    if (in->op == ir::Op::kExtract)
+                    {
+                        auto call = in->args[0];
+                        size_t args = call->args.size() - (call->op == ir::Op::kCallValue ? 1 : 0);
+                        c.area[in->id] = c.area[call->id] + args + in->imm;
+                    }
+                }
+            }
+            std::sort(constants.begin(), constants.end());
+            constants.erase(std::unique(constants.begin(), constants.end()), constants.end());
+            for (auto k : constants)
+            {
+                int64_t v = k->imm;
+                if (k->str != nullptr)
+                {
+                    v = reinterpret_cast<int64_t>(k->str->c_str());
+                }
+                else if (k->fn != nullptr)
+                {
+                    v = reinterpret_cast<int64_t>(jit.stubs[index[k->fn]]);
+                }
+                c.constants.push_back({k->id, v});
+            }
+        }
+
+        // a bridge for each function, where its stub goes until it is compiled
+        bool Tiered::Bridges()
+        {
+            MModule mm;
+            for (size_t i = 0; i < codes.size(); i++)
+            {
+                mm.functions.emplace_back();
+                Bridge(mm.functions.back(), *codes[i].f, this, i, &Tiered::Enter);
+            }
+            std::vector<uint8_t *> starts;
+            if (jit.Place(mm, starts) == nullptr)
+            {
+                return false;
+            }
+            auto slots = reinterpret_cast<int64_t *>(jit.runtime["__li_slots"]);
+            for (size_t i = 0; i < starts.size(); i++)
+            {
+                slots[i] = reinterpret_cast<int64_t>(starts[i]);
+            }
+            return true;
+        }
+
+        //**********************************************************************
+        // calls
+        //**********************************************************************
+
+        bool Tiered::Run(int64_t &result)
+        {
+            auto main = base.Find("main");
+            if (codes.empty() || main == nullptr)
+            {
+                return Error(codes.empty() ? "the tiered engine has not loaded a file" : "function main is not declared");
+            }
+            if (!main->params.empty())
+            {
+                return Error("function main expects " + std::to_string(main->params.size()) + " arguments");
+            }
+            std::vector<int64_t> results(std::max<size_t>(main->returns.size(), 1), 0);
+            if (!Start(codes[index[main]], results.data()))
+            {
+                return false;
+            }
+            result = main->returns.empty() ? 0 : results[0];
+            if (!main->returns.empty() && main->returns[0] == ir::Type::kF64)
+            {
+                // as cvttsd2si, out of range gives the int minimum
+                double f = F(results[0]);
+                result = f >= -9223372036854775808.0 && f < 9223372036854775808.0 ? static_cast<int64_t>(f) : INT64_MIN;
+            }
+            return true;
+        }
+
+        // the calls of a run get the stack of the jit, measured from here
+        bool Tiered::Start(Code &c, int64_t *results)
+        {
+            char here;
+            *limit = reinterpret_cast<int64_t>(&here) - static_cast<int64_t>(jit.stack);
+            *trap_msg = 0;
+            bool ok = Call(c, nullptr, results);
+            *limit = 0;
+            if (!ok)
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, jit.Trap());
+            }
+            return ok;
+        }
+
+        bool Tiered::Call(Code &c, const int64_t *args, int64_t *results)
+        {
+            if (c.entry == nullptr && !c.failed && hot_calls != 0 && ++c.calls >= hot_calls)
+            {
+                Promote(c);
+            }
+            return c.entry != nullptr ? Native(c.entry, args, results) : Interpret(c, args, results);
+        }
+
+        bool Tiered::Native(void *entry, const int64_t *args, int64_t *results)
+        {
+            reinterpret_cast<void (*)(const int64_t *, int64_t *)>(entry)(args, results);
+            return !jit.Trapped();
+        }
+
+        void Tiered::Enter(Tiered *t, int64_t fn, const int64_t *args, int64_t *results)
+        {
+            t->Call(t->codes[fn], args, results);
+        }
+
+        bool Tiered::Interpret(Code &c, const int64_t *args, int64_t *results)
+        {
+            char here;
+            if (reinterpret_cast<int64_t>(&here) < *limit)
+            {
+                return Trap(nullptr, "stack overflow");
+            }
+            if (frames.size() == depth)
+            {
+                frames.emplace_back();
+            }
+            auto &frame = frames[depth];
+            if (frame.size() < c.cells)
+            {
+                frame.resize(c.cells);
+            }
+            depth++;
+            bool ok = Execute(c, frame.data(), args, results);
+            depth--;
+            return ok;
+        }
+
+        // the message at the position of in, the run unwinds to where it started
+        bool Tiered::Trap(const ir::Instr *in, const string_t &msg)
+        {
+            compiler::Diagnostic d;
+            d.row_number = in == nullptr ? 0 : in->pos.first;
+            d.column_number = in == nullptr ? 0 : in->pos.second;
+            d.msg = msg;
+            *trap_msg = reinterpret_cast<int64_t>(messages.insert(d.String()).first->c_str());
+            return false;
+        }
+
+        //**********************************************************************
+        // the interpreter
+        //**********************************************************************
+
+        bool Tiered::Execute(Code &c, int64_t *r, const int64_t *args, int64_t *results)
+        {
+            for (auto &k : c.constants)
+            {
+                r[k.first] = k.second;
+            }
+            const ir::Block *from = nullptr, *b = c.f->Entry();
+            for (;;)
+            {
+                size_t i = 0, n = b->instrs.size();
+                if (from != nullptr)
+                {
+                    // the phis read the values at the end of the edge, all at once
+                    size_t k = b->PredIndex(from);
+                    phis.clear();
+                    for (; i < n && b->instrs[i]->op == ir::Op::kPhi; i++)
+                    {
+                        phis.push_back(r[b->instrs[i]->args[k]->id]);
+                    }
+                    for (size_t j = 0; j < i; j++)
+                    {
+                        r[b->instrs[j]->id] = phis[j];
+                    }
+                    auto loop = c.headers[b->id];
+                    if (loop != nullptr && !loop->failed && hot_loops != 0 &&
+                        (loop->entry != nullptr || (++loop->count >= hot_loops && Osr(c, b, *loop))))
+                    {
+                        Trace("enter " + c.f->name + ", loop " + Pos(loop->pos));
+                        std::vector<int64_t> live;
+                        for (auto v : loop->live)
+                        {
+                            live.push_back(r[v->id]);
+                        }
+                        return Native(loop->entry, live.data(), results);
+                    }
+                }
+                from = b;
+                for (; i < n; i++)
+                {
+                    auto in = b->instrs[i];
+                    auto &d = r[in->id];
+                    int64_t x = in->args.size() > 0 ? r[in->args[0]->id] : 0;
+                    int64_t y = in->args.size() > 1 ? r[in->args[1]->id] : 0;
+                    bool floats = !in->args.empty() && in->args[0]->type == ir::Type::kF64;
+                    auto ux = static_cast<uint64_t>(x), uy = static_cast<uint64_t>(y);
+                    switch (in->op)
+                    {
+                    case ir::Op::kParam:
+                        d = args[in->imm];
+                        break;
+                    case ir::Op::kAdd:
+                        d = floats ? Bits(F(x) + F(y)) : static_cast<int64_t>(ux + uy);
+                        break;
+                    case ir::Op::kSub:
+                        d = floats ? Bits(F(x) - F(y)) : static_cast<int64_t>(ux - uy);
+                        break;
+                    case ir::Op::kMul:
+                        d = floats ? Bits(F(x) * F(y)) : static_cast<int64_t>(ux * uy);
+                        break;
+                    case ir::Op::kDiv:
+                    case ir::Op::kMod:
+                        if (floats)
+                        {
+                            d = Bits(F(x) / F(y));
+                            break;
+                        }
+                        if (y == 0)
+                        {
+                            return Trap(in, "division by zero");
+                        }
+                        // the vm wraps the overflow of -1
+                        if (in->op == ir::Op::kDiv)
+                        {
+                            d = y == -1 ? static_cast<int64_t>(0 - ux) : x / y;
+                        }
+                        else
+                        {
+                            d = y == -1 ? 0 : x % y;
+                        }
+                        break;
+                    case ir::Op::kAnd:
+                        d = x & y;
+                        break;
+                    case ir::Op::kOr:
+                        d = x | y;
+                        break;
+                    case ir::Op::kXor:
+                        d = x ^ y;
+                        break;
+                    case ir::Op::kNeg:
+                        d = floats ? static_cast<int64_t>(ux ^ (uint64_t(1) << 63)) : static_cast<int64_t>(0 - ux);
+                        break;
+                    case ir::Op::kBitNot:
+                        d = ~x;
+                        break;
+                    case ir::Op::kNot:
+                        d = x ^ 1;
+                        break;
+                    case ir::Op::kEq:
+                        d = floats ? F(x) == F(y) : x == y;
+                        break;
+                    case ir::Op::kNe:
+                        d = floats ? F(x) != F(y) : x != y;
+                        break;
+                    case ir::Op::kLt:
+                        d = floats ? F(x) < F(y) : x < y;
+                        break;
+                    case ir::Op::kLe:
+                        d = floats ? F(x) <= F(y) : x <= y;
+                        break;
+                    case ir::Op::kI2F:
+                        d = Bits(static_cast<double>(x));
+                        break;
+                    case ir::Op::kF2I:
+                    {
+                        double f = F(x);
+                        d = f >= -9223372036854775808.0 && f < 9223372036854775808.0 ? static_cast<int64_t>(f)
+                                                                                    : INT64_MIN;
+                        if (d == INT64_MIN)
+                        {
+                            return Trap(in, "float value out of the int range");
+                        }
+                        break;
+                    }
+                    case ir::Op::kGetGlobal:
+                        d = globals[in->imm];
+                        break;
+                    case ir::Op::kSetGlobal:
+                        globals[in->imm] = x;
+                        break;
+                    case ir::Op::kAddrGlobal:
+                        d = reinterpret_cast<int64_t>(globals + in->imm);
+                        break;
+                    case ir::Op::kCall:
+                    case ir::Op::kCallValue:
+                    {
+                        bool value = in->op == ir::Op::kCallValue;
+                        if (value && x == 0)
+                        {
+                            return Trap(in, "call of a nil function");
+                        }
+                        auto &callee = codes[value ? by_stub[x] : index[in->fn]];
+                        auto cells = r + c.area[in->id];
+                        size_t na = in->args.size() - (value ? 1 : 0);
+                        for (size_t k = 0; k < na; k++)
+                        {
+                            cells[k] = r[in->args[k + (value ? 1 : 0)]->id];
+                        }
+                        if (!Call(callee, cells, in->type == ir::Type::kTuple ? cells + na : &d))
+                        {
+                            return false;
+                        }
+                        break;
+                    }
+                    case ir::Op::kExtract:
+                        d = r[c.area[in->id]];
+                        break;
+                    case ir::Op::kNewArray:
+                        d = Jit::NewArray(&jit, 0, 0, 0);
+                        if (d == 0)
+                        {
+                            return false;
+                        }
+                        break;
+                    case ir::Op::kGetIndex:
+                        if (!InRange(x, y))
+                        {
+                            return Trap(in, "index out of range");
+                        }
+                        d = *Element(x, y);
+                        break;
+                    case ir::Op::kSetIndex:
+                        if (!InRange(x, y))
+                        {
+                            x = Jit::Reserve(&jit, x, y, 0);
+                            if (x == 0)
+                            {
+                                return *trap_msg != 0 ? false : Trap(in, "index out of range");
+                            }
+                        }
+                        *Element(x, y) = r[in->args[2]->id];
+                        d = x;
+                        break;
+                    case ir::Op::kAddrIndex:
+                    {
+                        if (x == 0)
+                        {
+                            return Trap(in, "nil pointer dereference");
+                        }
+                        auto cell = reinterpret_cast<int64_t *>(x);
+                        if (!InRange(*cell, y))
+                        {
+                            auto a = Jit::Reserve(&jit, *cell, y, in->imm);
+                            if (a == 0)
+                            {
+                                return *trap_msg != 0 ? false : Trap(in, "index out of range");
+                            }
+                            *cell = a;
+                        }
+                        d = reinterpret_cast<int64_t>(Element(*cell, y));
+                        break;
+                    }
+                    case ir::Op::kSlot:
+                        r[c.area[in->id]] = 0;
+                        d = reinterpret_cast<int64_t>(r + c.area[in->id]);
+                        break;
+                    case ir::Op::kLoad:
+                    case ir::Op::kStore:
+                        if (x == 0)
+                        {
+                            return Trap(in, "nil pointer dereference");
+                        }
+                        if (in->op == ir::Op::kLoad)
+                        {
+                            d = *reinterpret_cast<int64_t *>(x);
+                        }
+                        else
+                        {
+                            *reinterpret_cast<int64_t *>(x) = y;
+                        }
+                        break;
+                    case ir::Op::kJump:
+                        b = in->targets[0];
+                        break;
+                    case ir::Op::kBranch:
+                        b = in->targets[x != 0 ? 0 : 1];
+                        break;
+                    case ir::Op::kRet:
+                        for (size_t k = 0; k < in->args.size(); k++)
+                        {
+                            results[k] = r[in->args[k]->id];
+                        }
+                        return true;
+                    default:
+                        break;
+                    }
+                }
+            }
+        }
+
+        //**********************************************************************
+        // compiling
+        //**********************************************************************
+
+        void Tiered::Promote(Code &c)
+        {
+            optimizer.Clear();
+            c.entry = jit.Compile(c.target) ? jit.Wrap(c.target, Jit::Mode::kCells) : nullptr;
+            if (c.entry != nullptr)
+            {
+                Trace("compile " + c.f->name + ": " + std::to_string(c.calls) + " calls");
+                return;
+            }
+            c.failed = true;
+            auto &all = optimizer.All();
+            Trace("keep " + c.f->name + " interpreted: " + (all.empty() ? "" : all.front().String()));
+        }
+
+        // a copy of the function entered at the header, its phis and the values live there are params
+        bool Tiered::Osr(Code &c, const ir::Block *header, Loop &loop)
+        {
+            loop.failed = true;
+            auto at = c.f->name + ", loop " + Pos(loop.pos);
+            for (auto in : header->instrs)
+            {
+                if (in->op == ir::Op::kPhi)
+                {
+                    loop.live.push_back(in);
+                }
+            }
+            for (auto v : ir::Liveness(*c.f).LiveIn(header))
+            {
+                if (v->op != ir::Op::kPhi || v->block != header)
+                {
+                    loop.live.push_back(v);
+                }
+                if (v->type == ir::Type::kTuple)
+                {
+                    Trace("keep " + at + " interpreted: a call returning more values is live at its header");
+                    return false;
+                }
+            }
+
+            jit.m.functions.emplace_back();
+            auto &f = jit.m.functions.back();
+            f.name = c.f->name + ".osr" + std::to_string(osr++);
+            jit.by_symbol[Mangle(f.name)] = &f;
+            std::unordered_map<const ir::Instr *, ir::Instr *> map;
+            ir::Copy(*c.f, f, map, targets);
+            size_t h = 0;
+            while (c.f->blocks[h].get() != header)
+            {
+                h++;
+            }
+            auto h_copy = f.blocks[h].get();
+            auto entry = f.NewBlock();
+            f.params.clear();
+            std::vector<ir::Instr *> params;
+            for (size_t k = 0; k < loop.live.size(); k++)
+            {
+                auto v = map[loop.live[k]];
+                auto p = f.Append(entry, f.New(ir::Op::kParam, v->type));
+                p->imm = static_cast<int64_t>(k);
+                p->pos = v->pos;
+                f.params.push_back(v->type);
+                params.push_back(p);
+            }
+            h_copy->preds.push_back(entry);
+            size_t k = 0;
+            for (; k < h_copy->instrs.size() && h_copy->instrs[k]->op == ir::Op::kPhi; k++)
+            {
+                h_copy->instrs[k]->args.push_back(params[k]);
+            }
+            f.Append(entry, f.New(ir::Op::kJump, ir::Type::kVoid))->targets.push_back(h_copy);
+            std::rotate(f.blocks.begin(), f.blocks.end() - 1, f.blocks.end());
+            // what led to the loop is gone, unless the loop is in another one
+            f.RemoveUnreachable();
+            for (; k < params.size(); k++)
+            {
+                Repair(f, map[loop.live[k]], params[k]);
+            }
+
+            optimizer.Clear();
+            bool ok = ir::Verify(f, optimizer) && jit.Compile(&f);
+            loop.entry = ok ? jit.Wrap(&f, Jit::Mode::kCells) : nullptr;
+            if (loop.entry == nullptr)
+            {
+                auto &all = optimizer.All();
+                Trace("keep " + at + " interpreted: " + (all.empty() ? "" : all.front().String()));
+                return false;
+            }
+            loop.failed = false;
+            Trace("compile " + at + ": " + std::to_string(loop.count) + " iterations");
+            return true;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef LILANG_NATIVE_TIERED
+#define LILANG_NATIVE_TIERED
+
+#include <deque>
+#include <ostream>
+#include "./jit.h"
+
+/*
+tiered execution of a checked file: an interpreter over the ir first, the
+jit for the code that turns out to be hot
+
+the file is lowered twice. the interpreter walks the blocks of one copy as
+they were lowered, the jit optimizes and compiles the functions of the
+other, so no function changes under a frame running it. both tiers share
+the memory of the jit: a value is a cell of 8 bytes, arrays and globals are
+the jit's, and a function value is the address of its stub in either tier.
+
+each function counts its calls and each loop the times its header is
+reached. a function called often enough is compiled alone; the stubs of
+the functions that are not compiled lead back to the interpreter through a
+bridge, so compiled code calls interpreted code and the other way round.
+
+a loop reached often enough moves to compiled code where it stands, on
+stack replacement: a copy of its function entered at the header of the
+loop takes the values live there as params and runs to the end of the
+call, and the interpreted frame returns what it returns. a local kept in
+memory is passed as the address of its cell in the frame. the copy is
+compiled once per loop, later frames enter it when they reach the loop.
+
+a trap in either tier ends the whole run with the message the jit gives.
+the trace gets a line for each function or loop compiled, each one that
+cannot be and stays interpreted, and each frame moving to a compiled loop.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        class Tiered
+        {
+        public:
+            explicit Tiered(compiler::Diagnostics &diag);
+
+            // the calls before a function is compiled and the times a loop header is reached
+            // before the loop is, 0 to stay interpreted
+            void SetThresholds(int64_t calls, int64_t loops);
+            // where the tier transitions go, a line each
+            void SetTrace(std::ostream *os) { trace = os; }
+            // the optimizing tier, its passes and stack
+            Jit &Optimizer() { return jit; }
+
+            // lowers a file the visitor checked without errors and runs its global initializers
+            bool Load(const ast::File::Ptr &, ast::SemanticVisitor &);
+            // calls main and converts its result the way the vm's Run does
+            bool Run(int64_t &result);
+
+            // the function has been compiled as a whole
+            bool Compiled(const string_t &name) const;
+
+        private:
+            // a loop of an interpreted function
+            struct Loop
+            {
+                std::pair<int, int> pos;
+                int64_t count = 0;
+                std::vector<const ir::Instr *> live; // the values the compiled copy takes, in order
+                void *entry = nullptr;               // of the copy, taking cells
+                bool failed = false;
+            };
+
+            // a function as the interpreter runs it
+            struct Code
+            {
+                ir::Function *f = nullptr;
+                ir::Function *target = nullptr; // the same function in the module of the jit
+                size_t cells = 0;               // of a frame
+                // a cell for each instruction by its id, then the areas of calls and slots
+                std::vector<size_t> area;
+                std::vector<std::pair<int, int64_t>> constants; // ids and values
+                std::unordered_map<const ir::Block *, Loop> loops;
+                std::vector<Loop *> headers; // by block id
+                int64_t calls = 0;
+                void *entry = nullptr; // of the compiled function, taking cells
+                bool failed = false;
+            };
+
+            compiler::Diagnostics &diag;
+            compiler::Diagnostics optimizer; // what the jit reports, compiling is not an error of the run
+            Jit jit;
+            ir::Module base;
+            std::vector<Code> codes; // in the order of the functions of both modules
+            std::unordered_map<const ir::Function *, size_t> index;
+            std::unordered_map<int64_t, size_t> by_stub;
+            std::unordered_map<const ir::Function *, ir::Function *> targets;
+            int64_t *limit = nullptr, *trap_msg = nullptr, *globals = nullptr;
+            std::unordered_set<string_t> messages;
+            std::deque<std::vector<int64_t>> frames; // by depth
+            std::vector<int64_t> phis;
+            size_t depth = 0;
+            int64_t hot_calls = 1000, hot_loops = 10000;
+            size_t osr = 0; // copies made
+            std::ostream *trace = nullptr;
+
+            bool Error(const string_t &msg);
+            void Trace(const string_t &line);
+            void Prepare(Code &);
+            bool Bridges();
+
+            // runs a call from its first tier, the results are written only when it does not trap
+            bool Start(Code &, int64_t *results);
+            bool Call(Code &, const int64_t *args, int64_t *results);
+            bool Interpret(Code &, const int64_t *args, int64_t *results);
+            bool Execute(Code &, int64_t *r, const int64_t *args, int64_t *results);
+            bool Native(void *entry, const int64_t *args, int64_t *results);
+            bool Trap(const ir::Instr *, const string_t &msg);
+
+            void Promote(Code &);
+            bool Osr(Code &, const ir::Block *header, Loop &);
+
+            // called from a bridge with the cells of the arguments and results
+            static void Enter(Tiered *, int64_t fn, const int64_t *args, int64_t *results);
+        };
+    }
+}
+
+#endif
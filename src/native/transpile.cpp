@@ -0,0 +1,1578 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include "./transpile.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        using ast::Type;
+        using compiler::CodeType;
+
+        namespace
+        {
+            // what the generated code calls, see transpile.h
+            const char *kRuntime = R"(/* translated from a checked lilang file */
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef LI_MAX_DEPTH
+#define LI_MAX_DEPTH 10000
+#endif
+
+typedef void (*li_code)(void);
+
+/* a function value, the struct of a literal goes on with what it captures */
+typedef struct li_fn
+{
+    li_code code;
+} li_fn;
+
+/* the length and the segments 3 to 24 of an array */
+typedef struct li_array
+{
+    int64_t length;
+    void *segs[25];
+} li_array;
+
+static int li_depth;
+
+static _Noreturn void li_trap(int row, int col, const char *msg)
+{
+    if (row > 0)
+    {
+        fprintf(stderr, "(%d, %d) ", row, col);
+    }
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static inline void li_enter(void)
+{
+    if (li_depth >= LI_MAX_DEPTH)
+    {
+        li_trap(0, 0, "stack overflow");
+    }
+    li_depth++;
+}
+
+static void *li_alloc(size_t size)
+{
+    void *p = calloc(1, size);
+    if (p == NULL)
+    {
+        li_trap(0, 0, "out of memory");
+    }
+    return p;
+}
+
+static li_array *li_new_array(void)
+{
+    return li_alloc(sizeof(li_array));
+}
+
+/* the segment of element i */
+static inline int li_segment(uint64_t i)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(i + 8);
+#else
+    int h = 0;
+    for (i += 8; i > 1; i >>= 1)
+    {
+        h++;
+    }
+    return h;
+#endif
+}
+
+static inline void *li_cell(li_array *a, int64_t i)
+{
+    int h = li_segment((uint64_t)i);
+    return (char *)a->segs[h] + 8 * ((uint64_t)i + 8 - ((uint64_t)1 << h));
+}
+
+/* an element to read */
+static inline void *li_at(li_array *a, int64_t i, int row, int col)
+{
+    if (a == NULL || (uint64_t)i >= (uint64_t)a->length)
+    {
+        li_trap(row, col, "index out of range");
+    }
+    return li_cell(a, i);
+}
+
+static void li_reserve(li_array *a, int64_t i, int row, int col)
+{
+    if (a == NULL || i < 0 || i >= ((int64_t)1 << 24))
+    {
+        li_trap(row, col, "index out of range");
+    }
+    for (int h = li_segment((uint64_t)a->length); h <= li_segment((uint64_t)i); h++)
+    {
+        if (a->segs[h] == NULL)
+        {
+            a->segs[h] = li_alloc((size_t)8 << h);
+        }
+    }
+    a->length = i + 1;
+}
+
+/* an element to write, the array grows to hold it */
+static inline void *li_grow(li_array *a, int64_t i, int row, int col)
+{
+    if (a == NULL || (uint64_t)i >= (uint64_t)a->length)
+    {
+        li_reserve(a, i, row, col);
+    }
+    return li_cell(a, i);
+}
+
+/* the same through the variable holding the array, nil is replaced by a new one */
+static inline void *li_ref(li_array **slot, int64_t i, int row, int col)
+{
+    if (*slot == NULL)
+    {
+        *slot = li_new_array();
+    }
+    return li_grow(*slot, i, row, col);
+}
+
+static inline void *li_deref(void *p, int row, int col)
+{
+    if (p == NULL)
+    {
+        li_trap(row, col, "nil pointer dereference");
+    }
+    return p;
+}
+
+static inline int64_t li_add(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+
+static inline int64_t li_sub(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+
+static inline int64_t li_mul(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+}
+
+static inline int64_t li_neg(int64_t a)
+{
+    return (int64_t)(0 - (uint64_t)a);
+}
+
+static inline int64_t li_div(int64_t a, int64_t b, int row, int col)
+{
+    if (b == 0)
+    {
+        li_trap(row, col, "division by zero");
+    }
+    return b == -1 ? li_neg(a) : a / b;
+}
+
+static inline int64_t li_mod(int64_t a, int64_t b, int row, int col)
+{
+    if (b == 0)
+    {
+        li_trap(row, col, "division by zero");
+    }
+    return b == -1 ? 0 : a % b;
+}
+
+static inline int64_t li_int(double f, int row, int col)
+{
+    if (!(f > -9223372036854775808.0 && f < 9223372036854775808.0))
+    {
+        li_trap(row, col, "float value out of the int range");
+    }
+    return (int64_t)f;
+}
+)";
+
+            bool IsInt(Type::Ptr t) { return t->kind == Type::Kind::kInt; }
+            bool IsFloat(Type::Ptr t) { return t->kind == Type::Kind::kFloat; }
+
+            ast::Expr *Unparen(ast::Expr *e)
+            {
+                while (e->node_kind == ast::NodeKind::kParenExpr)
+                {
+                    e = static_cast<ast::ParenExpr *>(e)->expr.get();
+                }
+                return e;
+            }
+
+            // a local by its function, slot and name, variables of sibling scopes
+            // that share a slot are told apart by the name at least
+            typedef std::tuple<const ast::FuncLit *, int, string_t> Var;
+
+            bool IsLocal(ast::Expr *e)
+            {
+                e = Unparen(e);
+                return e->node_kind == ast::NodeKind::kIdent &&
+                       static_cast<ast::Ident *>(e)->storage.kind == ast::Storage::Kind::kLocal;
+            }
+
+            // the literals and the locals used in a subtree
+            class Uses final : public ast::StaticWalker<Uses>
+            {
+            public:
+                std::vector<ast::FuncLit *> lits;
+                std::unordered_set<const ast::FuncLit *> inner;
+                std::vector<ast::Ident *> locals;
+                std::vector<ast::Ident *> addressed; // operands of &
+
+                void Pre(ast::Node *n)
+                {
+                    if (n->node_kind == ast::NodeKind::kFuncLit)
+                    {
+                        lits.push_back(static_cast<ast::FuncLit *>(n));
+                        inner.insert(lits.back());
+                    }
+                    else if (n->node_kind == ast::NodeKind::kIdent)
+                    {
+                        if (IsLocal(static_cast<ast::Ident *>(n)))
+                        {
+                            locals.push_back(static_cast<ast::Ident *>(n));
+                        }
+                    }
+                    else if (n->node_kind == ast::NodeKind::kUnaryExpr &&
+                             static_cast<ast::UnaryExpr *>(n)->op == CodeType::kBitsAnd &&
+                             IsLocal(static_cast<ast::UnaryExpr *>(n)->expr.get()))
+                    {
+                        addressed.push_back(static_cast<ast::Ident *>(Unparen(static_cast<ast::UnaryExpr *>(n)->expr.get())));
+                    }
+                }
+            };
+
+            // a function and the locals of enclosing functions it uses
+            struct Func
+            {
+                ast::FuncLit *lit;
+                int id;
+                string_t name; // of the c function
+                std::vector<ast::Ident *> captures; // one use of each
+            };
+
+            // a value computed in order with others
+            struct Item
+            {
+                std::function<string_t()> emit;
+                string_t type;
+                bool stable;   // nothing computed after it changes it
+                bool effects;  // may trap, call or write
+                bool constant;
+            };
+
+            class Emitter
+            {
+            public:
+                Emitter(compiler::Diagnostics &diag, ast::SemanticVisitor &v)
+                    : diag(diag), annots(&v.Annots()), constants(&v.Constants()) {}
+
+                bool Emit(const ast::File::Ptr &, std::ostream &);
+
+            private:
+                struct Line
+                {
+                    int depth;
+                    string_t text;
+                };
+                struct Loop
+                {
+                    int label; // of the post statement of a for loop, 0 for a while loop
+                    bool used;
+                };
+                // the function being emitted
+                struct State
+                {
+                    Func *f = nullptr; // nullptr for the initializer
+                    std::vector<Line> lines;
+                    std::vector<Loop> loops;
+                    int depth = 1;
+                    int temps = 0;
+                    int labels = 0;
+                };
+
+                compiler::Diagnostics &diag;
+                const ast::Annotations *annots;
+                const ast::ConstantTable *constants;
+                std::deque<Func> funcs;
+                std::unordered_map<const ast::FuncLit *, Func *> by_lit;
+                std::set<Var> boxed;     // locals captured by a literal
+                std::set<Var> addressed; // locals whose address is taken
+                std::unordered_set<const Func *> objects_made;
+                std::map<string_t, string_t> tuples;    // name by the member types
+                stringstream_t types, protos, objects, globals, code;
+                State s;
+                bool ok = true;
+
+                Type::Ptr TypeOf(const ast::Node *n) const { return annots->TypeOf(n); }
+                const ast::FuncLit *Current() const { return s.f == nullptr ? nullptr : s.f->lit; }
+                void Unsupported(ast::Node *, const string_t &msg);
+                void Analyze(const ast::File::Ptr &);
+                Func *Declare(ast::FuncLit *, const string_t &name);
+
+                // c text
+                string_t CType(Type::Ptr);
+                string_t Tuple(const ast::TypeSpan &);
+                string_t Result(Type::Ptr fn);
+                static string_t Declaration(const string_t &type, const string_t &name);
+                static string_t PointerTo(const string_t &type);
+                static string_t Cond(const string_t &c);
+                static string_t Pos(ast::Node *);
+                static string_t Local(const string_t &name, int slot);
+                string_t Field(ast::Ident *);
+                void Emit(const string_t &line);
+                string_t Temp(const string_t &type, const string_t &value);
+                static bool IsTemp(const string_t &);
+
+                // expressions
+                bool Stable(ast::Expr *);
+                bool Effects(ast::Expr *);
+                static bool AddressEffects(ast::Expr *);
+                Item ValueItem(ast::Expr *, Type::Ptr to);
+                std::vector<string_t> Ordered(const std::vector<Item> &, int keep = 0);
+                string_t Const(const ast::Constant &);
+                string_t Value(ast::Expr *);
+                string_t As(ast::Expr *, Type::Ptr to);
+                static string_t Convert(const string_t &v, Type::Ptr from, Type::Ptr to, ast::Node *at);
+                string_t Load(ast::Ident *);
+                string_t Binary(ast::BinaryExpr *);
+                string_t Logic(ast::BinaryExpr *);
+                string_t Unary(ast::UnaryExpr *);
+                string_t Index(ast::IndexExpr *);
+                string_t Call(ast::CallExpr *);
+                string_t Closure(ast::FuncLit *);
+                string_t Object(const Func *);
+                std::vector<string_t> Values(const ast::Expr::List &, const std::vector<Type::Ptr> &to, int keep = 0);
+                string_t Address(ast::Expr *);
+
+                // statements
+                void Body(Func *);
+                void Stmt(ast::Stmt *);
+                void Block(ast::Block *);
+                void Nested(ast::Stmt *);
+                void Define(ast::VarDecl *, size_t i, Type::Ptr, const string_t &v);
+                void Declare(ast::VarDecl *);
+                void Assign(ast::AssignStmt *);
+                void Update(ast::AssignStmt *);
+                void Loop(ast::Expr *cond, ast::Stmt *body, ast::Stmt *post);
+                void Return(ast::RetStmt *);
+            };
+
+            void Emitter::Unsupported(ast::Node *at, const string_t &msg)
+            {
+                diag.Report(compiler::Phase::kNative, at->row_number, at->column_number, msg);
+                ok = false;
+            }
+
+            //****************************************************************
+            // analysis
+            //****************************************************************
+
+            Func *Emitter::Declare(ast::FuncLit *lit, const string_t &name)
+            {
+                funcs.push_back({lit, static_cast<int>(funcs.size()), name, {}});
+                by_lit[lit] = &funcs.back();
+                return &funcs.back();
+            }
+
+            // names the functions and finds what each captures: a local used in a
+            // literal belongs to it, to a literal inside it or to an enclosing function
+            void Emitter::Analyze(const ast::File::Ptr &file)
+            {
+                for (auto &decl : file->declarations)
+                {
+                    if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                    {
+                        auto lit = static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get();
+                        Declare(lit, "f_" + lit->name);
+                    }
+                }
+                Uses all;
+                all.Walk(file.get());
+                int nested = 0;
+                for (auto lit : all.lits)
+                {
+                    if (by_lit.count(lit) == 0)
+                    {
+                        Declare(lit, "lit_" + std::to_string(nested++));
+                    }
+                }
+                for (auto id : all.addressed)
+                {
+                    addressed.insert(Var(id->storage.func, id->storage.index, id->name));
+                }
+                for (auto &f : funcs)
+                {
+                    Uses u;
+                    u.Walk(f.lit->body.get());
+                    std::set<Var> seen;
+                    for (auto id : u.locals)
+                    {
+                        auto owner = id->storage.func;
+                        if (owner == f.lit || u.inner.count(owner) != 0)
+                        {
+                            continue;
+                        }
+                        Var key(owner, id->storage.index, id->name);
+                        boxed.insert(key);
+                        if (seen.insert(key).second)
+                        {
+                            f.captures.push_back(id);
+                        }
+                    }
+                }
+            }
+
+            //****************************************************************
+            // c text
+            //****************************************************************
+
+            string_t Emitter::CType(Type::Ptr t)
+            {
+                switch (t->kind)
+                {
+                case Type::Kind::kInt:
+                    return "int64_t";
+                case Type::Kind::kFloat:
+                    return "double";
+                case Type::Kind::kBool:
+                    return "bool";
+                case Type::Kind::kString:
+                    return "const char *";
+                case Type::Kind::kArray:
+                    return "li_array *";
+                case Type::Kind::kFn:
+                    return "li_fn *";
+                case Type::Kind::kPointer:
+                {
+                    return PointerTo(CType(t->base));
+                }
+                case Type::Kind::kTuple:
+                    return Tuple(t->Vals());
+                default:
+                    return "int64_t";
+                }
+            }
+
+            // a struct per list of result types
+            string_t Emitter::Tuple(const ast::TypeSpan &vals)
+            {
+                std::vector<string_t> members;
+                string_t key;
+                for (auto t : vals)
+                {
+                    members.push_back(CType(t));
+                    key += members.back() + ";";
+                }
+                auto it = tuples.find(key);
+                if (it != tuples.end())
+                {
+                    return it->second;
+                }
+                auto name = "li_tuple" + std::to_string(tuples.size());
+                tuples[key] = name;
+                types << "typedef struct\n{\n";
+                for (size_t i = 0; i < members.size(); i++)
+                {
+                    types << "    " << Declaration(members[i], "v" + std::to_string(i)) << ";\n";
+                }
+                types << "} " << name << ";\n\n";
+                return name;
+            }
+
+            string_t Emitter::Result(Type::Ptr fn)
+            {
+                auto returns = fn->Returns();
+                return returns.size() == 0 ? "void" : returns.size() == 1 ? CType(returns[0]) : Tuple(returns);
+            }
+
+            string_t Emitter::Declaration(const string_t &type, const string_t &name)
+            {
+                return type + (type.back() == '*' ? "" : " ") + name;
+            }
+
+            string_t Emitter::PointerTo(const string_t &type)
+            {
+                return type + (type.back() == '*' ? "*" : " *");
+            }
+
+            // an expression in the parens of an if or while
+            string_t Emitter::Cond(const string_t &c)
+            {
+                int open = 0;
+                for (size_t i = 0; i < c.size(); i++)
+                {
+                    open += c[i] == '(' ? 1 : c[i] == ')' ? -1 : 0;
+                    if (open == 0 && i + 1 < c.size())
+                    {
+                        return "(" + c + ")";
+                    }
+                }
+                return c;
+            }
+
+            string_t Emitter::Pos(ast::Node *n)
+            {
+                return std::to_string(n->row_number) + ", " + std::to_string(n->column_number);
+            }
+
+            // the slot keeps sibling scopes that reuse a name apart, and no c keyword has a digit
+            string_t Emitter::Local(const string_t &name, int slot)
+            {
+                return (name == "_" ? "v" : name) + "_" + std::to_string(slot);
+            }
+
+            // the member of an environment pointing to a captured local
+            string_t Emitter::Field(ast::Ident *id)
+            {
+                return Local(id->name, id->storage.index) + "_" + std::to_string(by_lit[id->storage.func]->id);
+            }
+
+            void Emitter::Emit(const string_t &line)
+            {
+                s.lines.push_back({s.depth, line});
+            }
+
+            string_t Emitter::Temp(const string_t &type, const string_t &value)
+            {
+                auto name = "t" + std::to_string(s.temps++);
+                Emit(Declaration(type, name) + " = " + value + ";");
+                return name;
+            }
+
+            // a temporary or a member of one, nothing assigns them again
+            bool Emitter::IsTemp(const string_t &v)
+            {
+                size_t i = 1;
+                if (v.empty() || v[0] != 't')
+                {
+                    return false;
+                }
+                while (i < v.size() && isdigit(v[i]))
+                {
+                    i++;
+                }
+                if (i < v.size() && v[i] == '.')
+                {
+                    i += 2;
+                    while (i < v.size() && isdigit(v[i]))
+                    {
+                        i++;
+                    }
+                }
+                return i > 1 && i == v.size();
+            }
+
+            //****************************************************************
+            // expressions
+            //****************************************************************
+
+            // a constant or a local only this function reads and writes by name
+            bool Emitter::Stable(ast::Expr *e)
+            {
+                if (constants->Find(e) != nullptr)
+                {
+                    return true;
+                }
+                e = Unparen(e);
+                switch (e->node_kind)
+                {
+                case ast::NodeKind::kIdent:
+                {
+                    auto &st = static_cast<ast::Ident *>(e)->storage;
+                    if (st.kind == ast::Storage::Kind::kFunc)
+                    {
+                        return true;
+                    }
+                    Var key(st.func, st.index, static_cast<ast::Ident *>(e)->name);
+                    return st.kind == ast::Storage::Kind::kLocal && st.func == Current() && boxed.count(key) == 0 &&
+                           addressed.count(key) == 0;
+                }
+                case ast::NodeKind::kBasicLiteral:
+                case ast::NodeKind::kFuncLit:
+                    return true;
+                default:
+                    return false;
+                }
+            }
+
+            bool Emitter::Effects(ast::Expr *e)
+            {
+                if (constants->Find(e) != nullptr)
+                {
+                    return false;
+                }
+                switch (e->node_kind)
+                {
+                case ast::NodeKind::kIdent:
+                case ast::NodeKind::kBasicLiteral:
+                case ast::NodeKind::kFuncLit:
+                    return false;
+                case ast::NodeKind::kParenExpr:
+                    return Effects(static_cast<ast::ParenExpr *>(e)->expr.get());
+                case ast::NodeKind::kBinaryExpr:
+                {
+                    auto b = static_cast<ast::BinaryExpr *>(e);
+                    if ((b->op == CodeType::kDivide || b->op == CodeType::kMod) && IsInt(TypeOf(b->left.get())) &&
+                        IsInt(TypeOf(b->right.get())))
+                    {
+                        auto k = constants->Find(b->right.get());
+                        if (k == nullptr || k->i == 0 || k->i == -1)
+                        {
+                            return true;
+                        }
+                    }
+                    return Effects(b->left.get()) || Effects(b->right.get());
+                }
+                case ast::NodeKind::kUnaryExpr:
+                {
+                    auto u = static_cast<ast::UnaryExpr *>(e);
+                    return u->op == CodeType::kBitsAnd ? AddressEffects(u->expr.get()) : Effects(u->expr.get());
+                }
+                case ast::NodeKind::kCallExpr:
+                {
+                    auto c = static_cast<ast::CallExpr *>(e);
+                    if (annots->KindOf(c->expr.get()) != ast::Obj::Kind::kType)
+                    {
+                        return true;
+                    }
+                    auto arg = c->args[0].get();
+                    return Effects(arg) || (IsFloat(TypeOf(arg)) && IsInt(TypeOf(c->expr.get())));
+                }
+                default:
+                    return true;
+                }
+            }
+
+            // computing the address of a variable has none
+            bool Emitter::AddressEffects(ast::Expr *e)
+            {
+                return Unparen(e)->node_kind != ast::NodeKind::kIdent;
+            }
+
+            Item Emitter::ValueItem(ast::Expr *e, Type::Ptr to)
+            {
+                bool traps = IsFloat(TypeOf(e)) && IsInt(to);
+                return {[e, to, this]() { return As(e, to); }, CType(to), Stable(e) && !traps, Effects(e) || traps,
+                        constants->Find(e) != nullptr};
+            }
+
+            // the values in order: an item is moved to a temporary when a later one
+            // could change it or its effects must come first. keep 1 moves every
+            // item with effects, 2 every one that is not a constant
+            std::vector<string_t> Emitter::Ordered(const std::vector<Item> &items, int keep)
+            {
+                std::vector<string_t> out;
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    auto v = items[i].emit();
+                    bool move = (keep == 1 && items[i].effects) || (keep == 2 && !items[i].constant);
+                    for (size_t j = i + 1; j < items.size() && !items[i].stable && !move; j++)
+                    {
+                        move = !items[j].stable && (items[i].effects || items[j].effects);
+                    }
+                    out.push_back(move && !IsTemp(v) ? Temp(items[i].type, v) : v);
+                }
+                return out;
+            }
+
+            string_t Emitter::Const(const ast::Constant &k)
+            {
+                switch (k.kind)
+                {
+                case Type::Kind::kInt:
+                    return k.i == INT64_MIN ? "INT64_MIN" : "INT64_C(" + std::to_string(k.i) + ")";
+                case Type::Kind::kFloat:
+                {
+                    if (std::isnan(k.f))
+                    {
+                        return "NAN";
+                    }
+                    if (std::isinf(k.f))
+                    {
+                        return k.f > 0 ? "INFINITY" : "(-INFINITY)";
+                    }
+                    char buf[64];
+                    std::snprintf(buf, sizeof(buf), "%a", k.f);
+                    return k.f < 0 ? "(" + string_t(buf) + ")" : string_t(buf);
+                }
+                default:
+                    return k.b ? "true" : "false";
+                }
+            }
+
+            string_t Emitter::Value(ast::Expr *e)
+            {
+                auto k = constants->Find(e);
+                if (k != nullptr)
+                {
+                    return Const(*k);
+                }
+                switch (e->node_kind)
+                {
+                case ast::NodeKind::kIdent:
+                    return Load(static_cast<ast::Ident *>(e));
+                case ast::NodeKind::kBinaryExpr:
+                    return Binary(static_cast<ast::BinaryExpr *>(e));
+                case ast::NodeKind::kUnaryExpr:
+                    return Unary(static_cast<ast::UnaryExpr *>(e));
+                case ast::NodeKind::kBasicLiteral:
+                {
+                    // numbers and bools are constants, what is left is a string
+                    string_t lit = "\"";
+                    for (unsigned char c : static_cast<ast::BasicLiteral *>(e)->value)
+                    {
+                        if (isalnum(c) || c == ' ' || c == '_')
+                        {
+                            lit += static_cast<char>(c);
+                        }
+                        else
+                        {
+                            char buf[8];
+                            std::snprintf(buf, sizeof(buf), "\\%03o", c);
+                            lit += buf;
+                        }
+                    }
+                    return lit + "\"";
+                }
+                case ast::NodeKind::kParenExpr:
+                    return Value(static_cast<ast::ParenExpr *>(e)->expr.get());
+                case ast::NodeKind::kCallExpr:
+                    return Call(static_cast<ast::CallExpr *>(e));
+                case ast::NodeKind::kIndexExpr:
+                    return Index(static_cast<ast::IndexExpr *>(e));
+                case ast::NodeKind::kStarExpr:
+                {
+                    auto p = Value(static_cast<ast::StarExpr *>(e)->expr.get());
+                    return "(*(" + PointerTo(CType(TypeOf(e))) + ")li_deref(" + p + ", " + Pos(e) + "))";
+                }
+                case ast::NodeKind::kFuncLit:
+                    return Closure(static_cast<ast::FuncLit *>(e));
+                default:
+                    Unsupported(e, "expression cannot be translated");
+                    return "0";
+                }
+            }
+
+            // the value converted to type to, only int and float convert
+            string_t Emitter::As(ast::Expr *e, Type::Ptr to)
+            {
+                return Convert(Value(e), TypeOf(e), to, e);
+            }
+
+            string_t Emitter::Convert(const string_t &v, Type::Ptr from, Type::Ptr to, ast::Node *at)
+            {
+                if (IsInt(from) && IsFloat(to))
+                {
+                    return "((double)" + v + ")";
+                }
+                if (IsFloat(from) && IsInt(to))
+                {
+                    return "li_int(" + v + ", " + Pos(at) + ")";
+                }
+                return v;
+            }
+
+            string_t Emitter::Load(ast::Ident *id)
+            {
+                auto &st = id->storage;
+                switch (st.kind)
+                {
+                case ast::Storage::Kind::kLocal:
+                {
+                    if (st.func != Current())
+                    {
+                        return "(*env->" + Field(id) + ")";
+                    }
+                    auto name = Local(id->name, st.index);
+                    return boxed.count(Var(st.func, st.index, id->name)) != 0 ? "(*" + name + ")" : name;
+                }
+                case ast::Storage::Kind::kGlobal:
+                    return "g" + std::to_string(st.index) + "_" + id->name;
+                case ast::Storage::Kind::kFunc:
+                    return Object(by_lit[st.func]);
+                case ast::Storage::Kind::kExtern:
+                    Unsupported(id, "imported " + id->name + " is not linked");
+                    break;
+                default:
+                    Unsupported(id, id->name + " has no storage");
+                }
+                return "0";
+            }
+
+            string_t Emitter::Binary(ast::BinaryExpr *e)
+            {
+                auto l = e->left.get();
+                auto r = e->right.get();
+                if (e->op == CodeType::kLogicAnd || e->op == CodeType::kLogicOr)
+                {
+                    return Logic(e);
+                }
+                bool ints = IsInt(TypeOf(l)) && IsInt(TypeOf(r));
+                bool bools = TypeOf(l)->kind == Type::Kind::kBool;
+                auto to = ints || bools ? TypeOf(l) : ast::TypeTable::Float();
+                auto v = Ordered({ValueItem(l, to), ValueItem(r, to)});
+                auto infix = [&v](const char *op) { return "(" + v[0] + " " + op + " " + v[1] + ")"; };
+                auto call = [&v](const char *f) { return string_t(f) + "(" + v[0] + ", " + v[1] + ")"; };
+                switch (e->op)
+                {
+                case CodeType::kEqual:
+                    return infix("==");
+                case CodeType::kNotEqual:
+                    return infix("!=");
+                case CodeType::kLess:
+                    return infix("<");
+                case CodeType::kGreater:
+                    return infix(">");
+                case CodeType::kNotGreater:
+                    return infix("<=");
+                case CodeType::kNotLess:
+                    return infix(">=");
+                case CodeType::kAdd:
+                    return ints ? call("li_add") : infix("+");
+                case CodeType::kSub:
+                    return ints ? call("li_sub") : infix("-");
+                case CodeType::kMultiply:
+                    return ints ? call("li_mul") : infix("*");
+                case CodeType::kDivide:
+                case CodeType::kMod:
+                {
+                    bool div = e->op == CodeType::kDivide;
+                    if (!ints)
+                    {
+                        return infix("/");
+                    }
+                    auto k = constants->Find(r);
+                    if (k != nullptr && k->i != 0 && k->i != -1)
+                    {
+                        return infix(div ? "/" : "%");
+                    }
+                    return string_t(div ? "li_div(" : "li_mod(") + v[0] + ", " + v[1] + ", " + Pos(e) + ")";
+                }
+                case CodeType::kBitsAnd:
+                    return infix("&");
+                case CodeType::kBitsOr:
+                    return infix("|");
+                case CodeType::kBitsXor:
+                    return infix("^");
+                default:
+                    Unsupported(e, "operator cannot be translated");
+                    return "0";
+                }
+            }
+
+            // the right side only runs when needed, its statements go under an if
+            string_t Emitter::Logic(ast::BinaryExpr *e)
+            {
+                bool conj = e->op == CodeType::kLogicAnd;
+                auto a = Value(e->left.get());
+                if (!Effects(e->right.get()))
+                {
+                    return "(" + a + (conj ? " && " : " || ") + Value(e->right.get()) + ")";
+                }
+                auto t = Temp("bool", a);
+                Emit(conj ? "if (" + t + ")" : "if (!" + t + ")");
+                Emit("{");
+                s.depth++;
+                auto b = Value(e->right.get());
+                Emit(t + " = " + b + ";");
+                s.depth--;
+                Emit("}");
+                return t;
+            }
+
+            string_t Emitter::Unary(ast::UnaryExpr *e)
+            {
+                auto x = e->expr.get();
+                switch (e->op)
+                {
+                case CodeType::kAdd:
+                    return Value(x);
+                case CodeType::kSub:
+                    return IsInt(TypeOf(x)) ? "li_neg(" + Value(x) + ")" : "(-" + Value(x) + ")";
+                case CodeType::kBitsXor:
+                    return "(~" + Value(x) + ")";
+                case CodeType::kLogicNot:
+                    return "(!" + Value(x) + ")";
+                case CodeType::kBitsAnd:
+                    return "(&" + Address(x) + ")";
+                default:
+                    Unsupported(e, "operator cannot be translated");
+                    return "0";
+                }
+            }
+
+            string_t Emitter::Index(ast::IndexExpr *e)
+            {
+                auto operand = e->operand.get();
+                auto v = Ordered({ValueItem(operand, TypeOf(operand)), ValueItem(e->index.get(), ast::TypeTable::Int())});
+                return "(*(" + PointerTo(CType(TypeOf(e))) + ")li_at(" + v[0] + ", " + v[1] + ", " + Pos(e) + "))";
+            }
+
+            // a direct call of a top level function passes no function value, the
+            // callee of any other call is checked before the arguments are computed
+            string_t Emitter::Call(ast::CallExpr *e)
+            {
+                auto callee = e->expr.get();
+                auto t = TypeOf(callee);
+                if (annots->KindOf(callee) == ast::Obj::Kind::kType)
+                {
+                    return As(e->args[0].get(), t);
+                }
+                auto params = t->Params();
+                std::vector<Type::Ptr> to(params.begin(), params.end());
+                auto target = Unparen(callee);
+                string_t fn, self = "NULL";
+                if (target->node_kind == ast::NodeKind::kIdent &&
+                    static_cast<ast::Ident *>(target)->storage.kind == ast::Storage::Kind::kFunc)
+                {
+                    fn = by_lit[static_cast<ast::Ident *>(target)->storage.func]->name;
+                }
+                else
+                {
+                    self = Temp("li_fn *", Value(callee));
+                    Emit("if (" + self + " == NULL)");
+                    Emit("{");
+                    Emit("    li_trap(" + Pos(e) + ", \"call of a nil function\");");
+                    Emit("}");
+                    fn = "((" + Result(t) + " (*)(li_fn *";
+                    for (auto p : to)
+                    {
+                        fn += ", " + CType(p);
+                    }
+                    fn += "))" + self + "->code)";
+                }
+                auto args = Values(e->args, to);
+                string_t out = fn + "(" + self;
+                for (auto &a : args)
+                {
+                    out += ", " + a;
+                }
+                return out + ")";
+            }
+
+            // a literal without captures is a static struct, any other gets a new
+            // environment each time it is evaluated
+            string_t Emitter::Closure(ast::FuncLit *lit)
+            {
+                auto f = by_lit[lit];
+                if (f->captures.empty())
+                {
+                    return Object(f);
+                }
+                auto env = "struct " + f->name + "_env";
+                auto t = Temp(env + " *", "li_alloc(sizeof(" + env + "))");
+                Emit(t + "->code = (li_code)" + f->name + ";");
+                for (auto id : f->captures)
+                {
+                    auto &st = id->storage;
+                    auto box = st.func == Current() ? Local(id->name, st.index) : "env->" + Field(id);
+                    Emit(t + "->" + Field(id) + " = " + box + ";");
+                }
+                return "((li_fn *)" + t + ")";
+            }
+
+            // the static function value of a function without captures
+            string_t Emitter::Object(const Func *f)
+            {
+                if (objects_made.insert(f).second)
+                {
+                    objects << "static li_fn " << f->name << "_fn = {(li_code)" << f->name << "};\n";
+                }
+                return "(&" + f->name + "_fn)";
+            }
+
+            // the values of a list converted to the types in to, either one value
+            // per type or a single call whose results are spread
+            std::vector<string_t> Emitter::Values(const ast::Expr::List &list, const std::vector<Type::Ptr> &to, int keep)
+            {
+                if (list.size() != to.size())
+                {
+                    auto call = list[0].get();
+                    auto vals = TypeOf(call)->Vals();
+                    auto t = Temp(Tuple(vals), Value(call));
+                    std::vector<string_t> out;
+                    for (size_t i = 0; i < to.size(); i++)
+                    {
+                        auto v = Convert(t + ".v" + std::to_string(i), vals[i], to[i], call);
+                        out.push_back(keep != 0 && !IsTemp(v) ? Temp(CType(to[i]), v) : v);
+                    }
+                    return out;
+                }
+                std::vector<Item> items;
+                for (size_t i = 0; i < to.size(); i++)
+                {
+                    items.push_back(ValueItem(list[i].get(), to[i]));
+                }
+                return Ordered(items, keep);
+            }
+
+            // an lvalue, writing an element past the end grows the array and a nil
+            // array held by a variable is created
+            string_t Emitter::Address(ast::Expr *e)
+            {
+                e = Unparen(e);
+                switch (e->node_kind)
+                {
+                case ast::NodeKind::kIdent:
+                {
+                    auto id = static_cast<ast::Ident *>(e);
+                    if (id->storage.kind == ast::Storage::Kind::kLocal || id->storage.kind == ast::Storage::Kind::kGlobal)
+                    {
+                        return Load(id);
+                    }
+                    Unsupported(e, "expression is not assignable");
+                    return "v";
+                }
+                case ast::NodeKind::kStarExpr:
+                {
+                    auto p = Value(static_cast<ast::StarExpr *>(e)->expr.get());
+                    return "(*(" + PointerTo(CType(TypeOf(e))) + ")li_deref(" + p + ", " + Pos(e) + "))";
+                }
+                case ast::NodeKind::kIndexExpr:
+                {
+                    auto ie = static_cast<ast::IndexExpr *>(e);
+                    auto operand = ie->operand.get();
+                    auto elem = "(*(" + PointerTo(CType(TypeOf(e))) + ")";
+                    auto index = ValueItem(ie->index.get(), ast::TypeTable::Int());
+                    if (ast::Obj::Addressable(annots->KindOf(operand)))
+                    {
+                        Item slot = {[operand, this]() { return "(&" + Address(operand) + ")"; }, "li_array **",
+                                     Unparen(operand)->node_kind == ast::NodeKind::kIdent, AddressEffects(operand), false};
+                        auto v = Ordered({slot, index});
+                        return elem + "li_ref(" + v[0] + ", " + v[1] + ", " + Pos(e) + "))";
+                    }
+                    auto v = Ordered({ValueItem(operand, TypeOf(operand)), index});
+                    return elem + "li_grow(" + v[0] + ", " + v[1] + ", " + Pos(e) + "))";
+                }
+                default:
+                    Unsupported(e, "expression is not assignable");
+                    return "v";
+                }
+            }
+
+            //****************************************************************
+            // statements
+            //****************************************************************
+
+            void Emitter::Body(Func *f)
+            {
+                s = State();
+                s.f = f;
+                auto lit = f->lit;
+                auto t = TypeOf(lit);
+                auto params = t->Params();
+                string_t head = Declaration(Result(t), f->name) + "(li_fn *self";
+                std::vector<string_t> boxes;
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    auto name = Local(lit->type->args[i]->var_name, static_cast<int>(i));
+                    bool box = boxed.count(Var(lit, static_cast<int>(i), lit->type->args[i]->var_name)) != 0;
+                    head += ", " + Declaration(CType(params[i]), box ? name + "_arg" : name);
+                    if (box)
+                    {
+                        boxes.push_back(name);
+                        auto type = CType(params[i]);
+                        Emit(Declaration(PointerTo(type), name) + " = li_alloc(sizeof(" + type + "));");
+                        Emit("*" + name + " = " + name + "_arg;");
+                    }
+                }
+                head += ")";
+                if (!f->captures.empty())
+                {
+                    auto env = "struct " + f->name + "_env";
+                    s.lines.insert(s.lines.begin(), {1, env + " *env = (" + env + " *)self;"});
+                    types << env << "\n{\n    li_code code;\n";
+                    for (auto id : f->captures)
+                    {
+                        auto type = CType(TypeOf(id));
+                        types << "    " << Declaration(PointerTo(type), Field(id)) << ";\n";
+                    }
+                    types << "};\n\n";
+                }
+                s.lines.insert(s.lines.begin() + (f->captures.empty() ? 0 : 1), {1, "li_enter();"});
+                for (auto &stmt : lit->body->stmts)
+                {
+                    Stmt(stmt.get());
+                }
+                if (t->Returns().size() == 0)
+                {
+                    Emit("li_depth--;");
+                }
+                protos << "static " << head << ";\n";
+                code << "static " << head << "\n{\n";
+                for (auto &line : s.lines)
+                {
+                    code << string_t(4 * line.depth, ' ') << line.text << "\n";
+                }
+                code << "}\n\n";
+            }
+
+            void Emitter::Stmt(ast::Stmt *st)
+            {
+                switch (st->node_kind)
+                {
+                case ast::NodeKind::kBlock:
+                    Block(static_cast<ast::Block *>(st));
+                    break;
+                case ast::NodeKind::kExprStmt:
+                {
+                    auto v = Value(static_cast<ast::ExprStmt *>(st)->expr.get());
+                    if (!IsTemp(v))
+                    {
+                        Emit(v + ";");
+                    }
+                    break;
+                }
+                case ast::NodeKind::kDeclStmt:
+                    Declare(static_cast<ast::VarDecl *>(static_cast<ast::DeclStmt *>(st)->decl.get()));
+                    break;
+                case ast::NodeKind::kAssignStmt:
+                    Assign(static_cast<ast::AssignStmt *>(st));
+                    break;
+                case ast::NodeKind::kIfStmt:
+                {
+                    auto is = static_cast<ast::IfStmt *>(st);
+                    Emit("if " + Cond(Value(is->condition.get())));
+                    Nested(is->if_block.get());
+                    if (is->else_block != nullptr)
+                    {
+                        Emit("else");
+                        Nested(is->else_block.get());
+                    }
+                    break;
+                }
+                case ast::NodeKind::kWhileStmt:
+                {
+                    auto ws = static_cast<ast::WhileStmt *>(st);
+                    Loop(ws->condition.get(), ws->block.get(), nullptr);
+                    break;
+                }
+                case ast::NodeKind::kForStmt:
+                {
+                    auto fs = static_cast<ast::ForStmt *>(st);
+                    Emit("{");
+                    s.depth++;
+                    Stmt(fs->init.get());
+                    Loop(fs->condition.get(), fs->block.get(), fs->post.get());
+                    s.depth--;
+                    Emit("}");
+                    break;
+                }
+                case ast::NodeKind::kRetStmt:
+                    Return(static_cast<ast::RetStmt *>(st));
+                    break;
+                case ast::NodeKind::kEmptyStmt:
+                    break;
+                case ast::NodeKind::kBreakStmt:
+                    Emit("break;");
+                    break;
+                case ast::NodeKind::kContinueStmt:
+                {
+                    auto &loop = s.loops.back();
+                    if (loop.label == 0)
+                    {
+                        Emit("continue;");
+                    }
+                    else
+                    {
+                        loop.used = true;
+                        Emit("goto next_" + std::to_string(loop.label) + ";");
+                    }
+                    break;
+                }
+                default:
+                    Unsupported(st, "statement cannot be translated");
+                }
+            }
+
+            void Emitter::Block(ast::Block *b)
+            {
+                Emit("{");
+                s.depth++;
+                for (auto &st : b->stmts)
+                {
+                    Stmt(st.get());
+                }
+                s.depth--;
+                Emit("}");
+            }
+
+            // a statement in braces of its own, an else if may need statements
+            // before its condition
+            void Emitter::Nested(ast::Stmt *st)
+            {
+                if (st->node_kind == ast::NodeKind::kBlock)
+                {
+                    Block(static_cast<ast::Block *>(st));
+                    return;
+                }
+                Emit("{");
+                s.depth++;
+                Stmt(st);
+                s.depth--;
+                Emit("}");
+            }
+
+            // the statements computing the condition run before each test, continue
+            // in a for loop jumps to its post statement
+            void Emitter::Loop(ast::Expr *cond, ast::Stmt *body, ast::Stmt *post)
+            {
+                size_t mark = s.lines.size();
+                auto c = Value(cond);
+                std::vector<Line> pre(s.lines.begin() + mark, s.lines.end());
+                s.lines.resize(mark);
+                s.loops.push_back({post == nullptr ? 0 : ++s.labels, false});
+                if (pre.empty() && post == nullptr)
+                {
+                    Emit("while " + Cond(c));
+                    Nested(body);
+                    s.loops.pop_back();
+                    return;
+                }
+                Emit(pre.empty() ? "while " + Cond(c) : "for (;;)");
+                Emit("{");
+                s.depth++;
+                for (auto &line : pre)
+                {
+                    s.lines.push_back({line.depth + 1, line.text});
+                }
+                if (!pre.empty())
+                {
+                    Emit("if (!" + c + ")");
+                    Emit("{");
+                    Emit("    break;");
+                    Emit("}");
+                }
+                Nested(body);
+                if (s.loops.back().used)
+                {
+                    Emit("next_" + std::to_string(s.loops.back().label) + ":;");
+                }
+                if (post != nullptr)
+                {
+                    Stmt(post);
+                }
+                s.depth--;
+                Emit("}");
+                s.loops.pop_back();
+            }
+
+            // a global is set by the initializer, a captured local is boxed
+            void Emitter::Define(ast::VarDecl *decl, size_t i, Type::Ptr t, const string_t &v)
+            {
+                int slot = decl->first_slot + static_cast<int>(i);
+                auto type = CType(t);
+                if (s.f == nullptr)
+                {
+                    auto name = "g" + std::to_string(slot) + "_" + decl->names[i];
+                    globals << "static " << Declaration(type, name) << ";\n";
+                    Emit(name + " = " + v + ";");
+                    return;
+                }
+                auto name = Local(decl->names[i], slot);
+                if (boxed.count(Var(s.f->lit, slot, decl->names[i])) != 0)
+                {
+                    Emit(Declaration(PointerTo(type), name) + " = li_alloc(sizeof(" + type + "));");
+                    Emit("*" + name + " = " + v + ";");
+                    return;
+                }
+                Emit(Declaration(type, name) + " = " + v + ";");
+            }
+
+            // the names are new, no value reads them, so each is defined once computed
+            void Emitter::Declare(ast::VarDecl *decl)
+            {
+                size_t n = decl->names.size();
+                if (decl->type != nullptr)
+                {
+                    auto t = TypeOf(decl->type.get());
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        Define(decl, i, t, t->kind == Type::Kind::kArray ? "li_new_array()" : "0");
+                    }
+                    return;
+                }
+                if (decl->vals.size() != n)
+                {
+                    auto call = decl->vals[0].get();
+                    auto vals = TypeOf(call)->Vals();
+                    auto t = Temp(Tuple(vals), Value(call));
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        Define(decl, i, vals[i], t + ".v" + std::to_string(i));
+                    }
+                    return;
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    auto v = decl->vals[i].get();
+                    Define(decl, i, TypeOf(v), Value(v));
+                }
+            }
+
+            // the values are computed before the places they go to, all of them
+            // before anything is assigned, so a, b = b, a swaps
+            void Emitter::Assign(ast::AssignStmt *st)
+            {
+                auto &lhs = st->lhs;
+                auto &rhs = st->rhs;
+                if (st->op != CodeType::kAssign)
+                {
+                    Update(st);
+                    return;
+                }
+                if (lhs.size() == 1 && rhs.size() == 1)
+                {
+                    auto l = lhs[0].get();
+                    auto item = ValueItem(rhs[0].get(), TypeOf(l));
+                    auto v = item.emit();
+                    if (AddressEffects(l) && !item.stable && !IsTemp(v))
+                    {
+                        v = Temp(item.type, v);
+                    }
+                    Emit(Address(l) + " = " + v + ";");
+                    return;
+                }
+                std::vector<Type::Ptr> to;
+                for (auto &l : lhs)
+                {
+                    to.push_back(TypeOf(l.get()));
+                }
+                auto vals = Values(rhs, to, 2);
+                for (size_t i = 0; i < lhs.size(); i++)
+                {
+                    Emit(Address(lhs[i].get()) + " = " + vals[i] + ";");
+                }
+            }
+
+            // x op= y with a float on either side is computed in float and stored as x's type
+            void Emitter::Update(ast::AssignStmt *st)
+            {
+                auto l = st->lhs[0].get();
+                auto r = st->rhs[0].get();
+                auto lt = TypeOf(l);
+                bool ints = IsInt(lt) && IsInt(TypeOf(r));
+                string_t x;
+                if (AddressEffects(l))
+                {
+                    auto type = CType(lt);
+                    x = "(*" + Temp(PointerTo(type), "&" + Address(l)) + ")";
+                }
+                else
+                {
+                    x = Address(l);
+                }
+                // x comes first, as on the other engines, a call in the value may change it
+                auto cur = Effects(r) ? Temp(CType(lt), x) : x;
+                auto v = As(r, ints ? lt : ast::TypeTable::Float());
+                string_t y;
+                auto call = [&cur, &v](const char *f) { return string_t(f) + "(" + cur + ", " + v + ")"; };
+                auto infix = [&cur, &v, &lt](const char *op) {
+                    return "(" + (IsInt(lt) ? "(double)" + cur : cur) + " " + op + " " + v + ")";
+                };
+                switch (st->op)
+                {
+                case CodeType::kAddAssign:
+                    y = ints ? call("li_add") : infix("+");
+                    break;
+                case CodeType::kSubAssign:
+                    y = ints ? call("li_sub") : infix("-");
+                    break;
+                case CodeType::kMulAssign:
+                    y = ints ? call("li_mul") : infix("*");
+                    break;
+                case CodeType::kDivAssign:
+                {
+                    auto k = constants->Find(r);
+                    if (!ints)
+                    {
+                        y = infix("/");
+                    }
+                    else if (k != nullptr && k->i != 0 && k->i != -1)
+                    {
+                        y = "(" + cur + " / " + v + ")";
+                    }
+                    else
+                    {
+                        y = "li_div(" + cur + ", " + v + ", " + Pos(st) + ")";
+                    }
+                    break;
+                }
+                case CodeType::kBitsAndAssign:
+                    y = "(" + cur + " & " + v + ")";
+                    break;
+                case CodeType::kBitsOrAssign:
+                    y = "(" + cur + " | " + v + ")";
+                    break;
+                case CodeType::kBitsXorAssign:
+                    y = "(" + cur + " ^ " + v + ")";
+                    break;
+                default:
+                    Unsupported(st, "operator cannot be translated");
+                    return;
+                }
+                if (!ints && IsInt(lt))
+                {
+                    y = "li_int(" + y + ", " + Pos(st) + ")";
+                }
+                Emit(x + " = " + y + ";");
+            }
+
+            // the values are computed while the function still counts as entered
+            void Emitter::Return(ast::RetStmt *st)
+            {
+                auto returns = TypeOf(s.f->lit->type.get())->Returns();
+                std::vector<Type::Ptr> to(returns.begin(), returns.end());
+                if (st->vals.empty())
+                {
+                    Emit("li_depth--;");
+                    Emit("return;");
+                    return;
+                }
+                auto vals = Values(st->vals, to, 1);
+                Emit("li_depth--;");
+                if (to.size() == 1)
+                {
+                    Emit("return " + vals[0] + ";");
+                    return;
+                }
+                string_t list;
+                for (auto &v : vals)
+                {
+                    list += (list.empty() ? "" : ", ") + v;
+                }
+                Emit("return (" + Tuple(returns) + "){" + list + "};");
+            }
+
+            bool Emitter::Emit(const ast::File::Ptr &file, std::ostream &out)
+            {
+                Analyze(file);
+                ast::FuncLit *main = nullptr;
+                for (auto &f : funcs)
+                {
+                    if (f.name == "f_main")
+                    {
+                        main = f.lit;
+                    }
+                }
+                if (main == nullptr)
+                {
+                    diag.Report(compiler::Phase::kNative, 0, 0, "function main is not declared");
+                    return false;
+                }
+                auto mt = TypeOf(main);
+                if (mt->Params().size() != 0)
+                {
+                    diag.Report(compiler::Phase::kNative, 0, 0,
+                                "function main expects " + std::to_string(mt->Params().size()) + " arguments");
+                    return false;
+                }
+                for (auto &f : funcs)
+                {
+                    Body(&f);
+                }
+                // the initializer runs the global declarations in order
+                s = State();
+                for (auto &decl : file->declarations)
+                {
+                    if (decl->node_kind == ast::NodeKind::kVarDecl)
+                    {
+                        Declare(static_cast<ast::VarDecl *>(decl.get()));
+                    }
+                }
+                code << "static void li_init(void)\n{\n";
+                for (auto &line : s.lines)
+                {
+                    code << string_t(4 * line.depth, ' ') << line.text << "\n";
+                }
+                code << "}\n\n";
+                code << "int main(void)\n{\n    li_init();\n";
+                auto returns = mt->Returns();
+                if (returns.size() == 0)
+                {
+                    code << "    f_main(NULL);\n    printf(\"0\\n\");\n";
+                }
+                else
+                {
+                    code << "    printf(\"%lld\\n\", (long long)f_main(NULL)" << (returns.size() > 1 ? ".v0" : "")
+                         << ");\n";
+                }
+                code << "    return 0;\n}\n";
+                out << kRuntime << "\n" << types.str() << protos.str() << "\n" << objects.str() << "\n"
+                    << globals.str() << "\n" << code.str();
+                return ok;
+            }
+        }
+
+        bool Transpiler::Error(const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kNative, 0, 0, msg);
+            return false;
+        }
+
+        bool Transpiler::Translate(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, std::ostream &out)
+        {
+            if (semantic.Diags().HasErrors())
+            {
+                return Error("a file with errors cannot be translated");
+            }
+            // translating a node recurses into its children, as compiling the c does
+            string_t msg;
+            auto deep = ast::TooDeep(root.get(), msg);
+            if (deep != nullptr)
+            {
+                diag.Report(compiler::Phase::kNative, deep->row_number, deep->column_number, msg);
+                return false;
+            }
+            if (!Emitter(diag, semantic).Emit(root, out))
+            {
+                return false;
+            }
+            return out.good() || Error("cannot write the c source");
+        }
+
+        bool Transpiler::Build(const ast::File::Ptr &root, ast::SemanticVisitor &semantic, const string_t &path)
+        {
+            string_t c = path + ".c";
+            {
+                std::ofstream out(c);
+                if (!out)
+                {
+                    return Error("cannot write " + c);
+                }
+                if (!Translate(root, semantic, out))
+                {
+                    std::remove(c.c_str());
+                    return false;
+                }
+            }
+            bool ok = std::system((compiler + " -o '" + path + "' '" + c + "'").c_str()) == 0 ||
+                      Error(compiler + " failed on " + c);
+            std::remove(c.c_str());
+            return ok;
+        }
+    }
+}
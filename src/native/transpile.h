@@ -0,0 +1,60 @@
+#ifndef LILANG_NATIVE_TRANSPILE
+#define LILANG_NATIVE_TRANSPILE
+
+#include <ostream>
+#include "../compiler/semantic.h"
+
+/*
+translation of a checked file to portable c11, built by the c compiler of
+the system
+
+every function becomes a static c function whose first parameter is the
+function value it was called through. ints are int64_t, floats double,
+strings const char *, and a function returning more than one value
+returns a struct with one member per value. an array is a pointer to its
+length and its segments, segment h holds 1 << h elements of 8 bytes, so
+elements stay in place as it grows and assigned arrays are shared, as on
+the engines.
+
+a function value points to a struct whose first member is the code. the
+struct of a literal that uses locals of enclosing functions goes on with
+pointers to them: such a local lives on the heap from its declaration on,
+so a closure sees later assignments to it and outlives the call that
+made it.
+
+the engines' semantics are kept: operands are computed left to right, a
+part of an expression is moved to a temporary of its own where the c
+order of evaluation could differ, ints wrap around, and a trap prints its
+position and message to stderr and exits with 1. calls nested deeper
+than the interpreter's limit report a stack overflow, without a position.
+
+the executable runs the global initializers and main, prints what main
+returns the way the vm's Run converts it and exits with 0.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        class Transpiler
+        {
+        public:
+            explicit Transpiler(compiler::Diagnostics &diag) : diag(diag), compiler("gcc -O2 -std=c11") {}
+
+            // the command compiling the c source, -o and the paths are appended
+            void SetCompiler(const string_t &command) { compiler = command; }
+
+            // the c source of a file the visitor checked without errors
+            bool Translate(const ast::File::Ptr &, ast::SemanticVisitor &, std::ostream &out);
+            // compiles it to an executable at path
+            bool Build(const ast::File::Ptr &, ast::SemanticVisitor &, const string_t &path);
+
+        private:
+            compiler::Diagnostics &diag;
+            string_t compiler;
+
+            bool Error(const string_t &msg);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,714 @@
+#include <cctype>
+#include <iomanip>
+#include "./x86_64.h"
+
+namespace lilang
+{
+    namespace native
+    {
+        namespace
+        {
+            const char *kRegNames[] = {
+                "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10",
+                "r11", "r12", "r13", "r14", "r15", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+                "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+            };
+
+            const char *kByteNames[] = {
+                "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+            };
+
+            const char *kDwordNames[] = {
+                "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+            };
+
+            const char *kCondNames[] = {
+                "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g",
+            };
+
+            class Printer
+            {
+            public:
+                Printer(std::ostream &out, const string_t &prefix) : out(out), prefix(prefix) {}
+
+                void Inst(const MInst &in)
+                {
+                    switch (in.op)
+                    {
+                    case MOp::kLabel:
+                        out << Label(in.a.imm) << ":\n";
+                        return;
+                    case MOp::kMov:
+                        if (in.a.IsImm() && (in.a.imm < INT32_MIN || in.a.imm > INT32_MAX))
+                        {
+                            Line("movabsq", in.a, in.b);
+                            return;
+                        }
+                        Line("movq", in.a, in.b);
+                        return;
+                    case MOp::kLea:
+                        return Line("leaq", in.a, in.b);
+                    case MOp::kAdd:
+                        return Line("addq", in.a, in.b);
+                    case MOp::kSub:
+                        return Line("subq", in.a, in.b);
+                    case MOp::kImul:
+                        return Line("imulq", in.a, in.b);
+                    case MOp::kAnd:
+                        return Line("andq", in.a, in.b);
+                    case MOp::kOr:
+                        return Line("orq", in.a, in.b);
+                    case MOp::kXor:
+                        return Line("xorq", in.a, in.b);
+                    case MOp::kCmp:
+                        return Line("cmpq", in.a, in.b);
+                    case MOp::kTest:
+                        return Line("testq", in.a, in.b);
+                    case MOp::kNeg:
+                        return Line("negq", in.a);
+                    case MOp::kNot:
+                        return Line("notq", in.a);
+                    case MOp::kCqo:
+                        return Line("cqto");
+                    case MOp::kIdiv:
+                        return Line("idivq", in.a);
+                    case MOp::kSet:
+                        out << "\tset" << kCondNames[static_cast<int>(in.cond)] << " %" << kByteNames[Number(in.a.reg)]
+                            << "\n";
+                        return;
+                    case MOp::kMovzb:
+                        out << "\tmovzbl %" << kByteNames[Number(in.a.reg)] << ", %" << kDwordNames[Number(in.b.reg)]
+                            << "\n";
+                        return;
+                    case MOp::kBsr:
+                        return Line("bsrq", in.a, in.b);
+                    case MOp::kBtc:
+                        return Line("btcq", in.a, in.b);
+                    case MOp::kJmp:
+                        if (in.a.IsReg() || in.a.IsMem())
+                        {
+                            out << "\tjmp *";
+                            Write(in.a);
+                            out << "\n";
+                            return;
+                        }
+                        return Line("jmp", in.a);
+                    case MOp::kJcc:
+                        return Line(string_t("j") + kCondNames[static_cast<int>(in.cond)], in.a);
+                    case MOp::kCall:
+                        if (in.a.IsReg() || in.a.IsMem())
+                        {
+                            out << "\tcall *";
+                            Write(in.a);
+                            out << "\n";
+                            return;
+                        }
+                        return Line("call", in.a);
+                    case MOp::kRet:
+                        return Line("ret");
+                    case MOp::kPush:
+                        return Line("pushq", in.a);
+                    case MOp::kPop:
+                        return Line("popq", in.a);
+                    case MOp::kMovsd:
+                        // movapd copies a whole register without merging into the old value
+                        return Line(in.a.IsReg() && in.b.IsReg() ? "movapd" : "movsd", in.a, in.b);
+                    case MOp::kMovq:
+                        return Line("movq", in.a, in.b);
+                    case MOp::kAddsd:
+                        return Line("addsd", in.a, in.b);
+                    case MOp::kSubsd:
+                        return Line("subsd", in.a, in.b);
+                    case MOp::kMulsd:
+                        return Line("mulsd", in.a, in.b);
+                    case MOp::kDivsd:
+                        return Line("divsd", in.a, in.b);
+                    case MOp::kUcomisd:
+                        return Line("ucomisd", in.a, in.b);
+                    case MOp::kCvtsi2sd:
+                        return Line("cvtsi2sdq", in.a, in.b);
+                    case MOp::kCvttsd2si:
+                        return Line("cvttsd2siq", in.a, in.b);
+                    }
+                }
+
+            private:
+                std::ostream &out;
+                const string_t &prefix;
+
+                string_t Label(int64_t n) const { return ".L" + prefix + "_" + std::to_string(n); }
+
+                void Line(const string_t &name, const Operand &a = Operand(), const Operand &b = Operand())
+                {
+                    out << "\t" << name;
+                    if (a.kind != Operand::Kind::kNone)
+                    {
+                        out << " ";
+                        Write(a);
+                    }
+                    if (b.kind != Operand::Kind::kNone)
+                    {
+                        out << ", ";
+                        Write(b);
+                    }
+                    out << "\n";
+                }
+
+                void Write(const Operand &o)
+                {
+                    switch (o.kind)
+                    {
+                    case Operand::Kind::kReg:
+                        out << "%" << RegName(o.reg);
+                        return;
+                    case Operand::Kind::kImm:
+                        out << "$" << o.imm;
+                        return;
+                    case Operand::Kind::kMem:
+                        if (o.disp != 0)
+                        {
+                            out << o.disp;
+                        }
+                        out << "(%" << RegName(o.reg);
+                        if (o.index != Reg::kNone)
+                        {
+                            out << ", %" << RegName(o.index) << ", " << static_cast<int>(o.scale);
+                        }
+                        out << ")";
+                        return;
+                    case Operand::Kind::kSymbol:
+                        out << o.symbol;
+                        if (o.disp != 0)
+                        {
+                            out << "+" << o.disp;
+                        }
+                        out << "(%rip)";
+                        return;
+                    case Operand::Kind::kLabel:
+                        out << Label(o.imm);
+                        return;
+                    case Operand::Kind::kFunc:
+                        out << o.symbol;
+                        return;
+                    case Operand::Kind::kNone:
+                        return;
+                    }
+                }
+            };
+
+            bool FitsInt8(int64_t v) { return v >= INT8_MIN && v <= INT8_MAX; }
+            bool FitsInt32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+            // the bytes of one instruction at a time
+            class Encoder
+            {
+            public:
+                Encoder(std::vector<uint8_t> &code, std::vector<Fixup> &fixups, const std::vector<size_t> &labels)
+                    : code(code), fixups(fixups), labels(labels)
+                {
+                }
+
+                // near is the short form of a jump to a label
+                void Inst(const MInst &in, bool near)
+                {
+                    size_t first = fixups.size();
+                    Body(in, near);
+                    for (size_t i = first; i < fixups.size(); i++)
+                    {
+                        fixups[i].next = code.size();
+                    }
+                }
+
+            private:
+                std::vector<uint8_t> &code;
+                std::vector<Fixup> &fixups;
+                const std::vector<size_t> &labels; // offset of each label in code
+
+                void Byte(int64_t b) { code.push_back(static_cast<uint8_t>(b)); }
+
+                void Int32(int64_t v)
+                {
+                    for (int i = 0; i < 4; i++)
+                    {
+                        Byte(v >> (8 * i));
+                    }
+                }
+
+                void Int64(int64_t v)
+                {
+                    for (int i = 0; i < 8; i++)
+                    {
+                        Byte(v >> (8 * i));
+                    }
+                }
+
+                // byte forces a prefix so spl to dil are not read as ah to bh
+                void Rex(bool w, int reg, const Operand &rm, bool byte = false)
+                {
+                    int rex = (w ? 8 : 0) | (reg & 8 ? 4 : 0);
+                    if (rm.kind == Operand::Kind::kReg || rm.kind == Operand::Kind::kMem)
+                    {
+                        rex |= Number(rm.reg) & 8 ? 1 : 0;
+                        byte = byte && rm.kind == Operand::Kind::kReg && Number(rm.reg) >= 4;
+                    }
+                    if (rm.kind == Operand::Kind::kMem && rm.index != Reg::kNone)
+                    {
+                        rex |= Number(rm.index) & 8 ? 2 : 0;
+                    }
+                    if (rex != 0 || byte)
+                    {
+                        Byte(0x40 | rex);
+                    }
+                }
+
+                void ModRM(int reg, const Operand &rm)
+                {
+                    reg = (reg & 7) << 3;
+                    if (rm.kind == Operand::Kind::kReg)
+                    {
+                        Byte(0xc0 | reg | (Number(rm.reg) & 7));
+                        return;
+                    }
+                    if (rm.kind == Operand::Kind::kSymbol)
+                    {
+                        Byte(0x05 | reg);
+                        fixups.push_back({code.size(), 0, rm.symbol, rm.disp, false});
+                        Int32(0);
+                        return;
+                    }
+                    int base = Number(rm.reg) & 7;
+                    int mod = rm.disp == 0 && base != 5 ? 0 : FitsInt8(rm.disp) ? 1 : 2;
+                    if (rm.index == Reg::kNone && base != 4)
+                    {
+                        Byte(mod << 6 | reg | base);
+                    }
+                    else
+                    {
+                        int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+                        int index = rm.index == Reg::kNone ? 4 : Number(rm.index) & 7;
+                        Byte(mod << 6 | reg | 4);
+                        Byte(scale << 6 | index << 3 | base);
+                    }
+                    if (mod == 1)
+                    {
+                        Byte(rm.disp);
+                    }
+                    else if (mod == 2)
+                    {
+                        Int32(rm.disp);
+                    }
+                }
+
+                // [prefix] [rex] opcode modrm, a prefix or opcode byte of 0 is left out
+                void Op(int prefix, bool w, int op1, int op2, int reg, const Operand &rm, bool byte = false)
+                {
+                    if (prefix != 0)
+                    {
+                        Byte(prefix);
+                    }
+                    Rex(w, reg, rm, byte);
+                    Byte(op1);
+                    if (op2 >= 0)
+                    {
+                        Byte(op2);
+                    }
+                    ModRM(reg, rm);
+                }
+
+                int N(const Operand &o) const { return Number(o.reg); }
+
+                // add, or, and, sub, xor and cmp by the extension of their group
+                void Alu(int ext, const MInst &in)
+                {
+                    if (in.a.IsImm())
+                    {
+                        if (FitsInt8(in.a.imm))
+                        {
+                            Op(0, true, 0x83, -1, ext, in.b);
+                            Byte(in.a.imm);
+                        }
+                        else if (in.b.Is(Reg::kRax))
+                        {
+                            Byte(0x48);
+                            Byte(ext << 3 | 5);
+                            Int32(in.a.imm);
+                        }
+                        else
+                        {
+                            Op(0, true, 0x81, -1, ext, in.b);
+                            Int32(in.a.imm);
+                        }
+                    }
+                    else if (in.a.IsReg())
+                    {
+                        Op(0, true, ext << 3 | 1, -1, N(in.a), in.b);
+                    }
+                    else
+                    {
+                        Op(0, true, ext << 3 | 3, -1, N(in.b), in.a);
+                    }
+                }
+
+                // the relative target of a jump or call
+                void Target(const Operand &o, bool near)
+                {
+                    if (o.kind == Operand::Kind::kFunc)
+                    {
+                        fixups.push_back({code.size(), 0, o.symbol, 0, true});
+                        Int32(0);
+                        return;
+                    }
+                    int64_t end = static_cast<int64_t>(code.size()) + (near ? 1 : 4);
+                    int64_t rel = static_cast<int64_t>(labels[o.imm]) - end;
+                    near ? Byte(rel) : Int32(rel);
+                }
+
+                // the sse forms, the xmm register in reg
+                void Sse(int prefix, bool w, int op, int reg, const Operand &rm) { Op(prefix, w, 0x0f, op, reg, rm); }
+
+                void Body(const MInst &in, bool near)
+                {
+                    const Operand &a = in.a, &b = in.b;
+                    int cc = static_cast<int>(in.cond);
+                    switch (in.op)
+                    {
+                    case MOp::kLabel:
+                        return;
+                    case MOp::kMov:
+                        if (a.IsImm() && b.IsReg() && !FitsInt32(a.imm))
+                        {
+                            Rex(true, 0, b);
+                            Byte(0xb8 | (N(b) & 7));
+                            Int64(a.imm);
+                        }
+                        else if (a.IsImm())
+                        {
+                            Op(0, true, 0xc7, -1, 0, b);
+                            Int32(a.imm);
+                        }
+                        else if (a.IsReg())
+                        {
+                            Op(0, true, 0x89, -1, N(a), b);
+                        }
+                        else
+                        {
+                            Op(0, true, 0x8b, -1, N(b), a);
+                        }
+                        return;
+                    case MOp::kLea:
+                        return Op(0, true, 0x8d, -1, N(b), a);
+                    case MOp::kAdd:
+                        return Alu(0, in);
+                    case MOp::kOr:
+                        return Alu(1, in);
+                    case MOp::kAnd:
+                        return Alu(4, in);
+                    case MOp::kSub:
+                        return Alu(5, in);
+                    case MOp::kXor:
+                        return Alu(6, in);
+                    case MOp::kCmp:
+                        return Alu(7, in);
+                    case MOp::kTest:
+                        if (a.IsImm() && b.Is(Reg::kRax))
+                        {
+                            Byte(0x48);
+                            Byte(0xa9);
+                            Int32(a.imm);
+                        }
+                        else if (a.IsImm())
+                        {
+                            Op(0, true, 0xf7, -1, 0, b);
+                            Int32(a.imm);
+                        }
+                        else if (a.IsReg())
+                        {
+                            Op(0, true, 0x85, -1, N(a), b);
+                        }
+                        else
+                        {
+                            Op(0, true, 0x85, -1, N(b), a);
+                        }
+                        return;
+                    case MOp::kImul:
+                        if (a.IsImm())
+                        {
+                            Op(0, true, FitsInt8(a.imm) ? 0x6b : 0x69, -1, N(b), b);
+                            FitsInt8(a.imm) ? Byte(a.imm) : Int32(a.imm);
+                            return;
+                        }
+                        return Op(0, true, 0x0f, 0xaf, N(b), a);
+                    case MOp::kNeg:
+                        return Op(0, true, 0xf7, -1, 3, a);
+                    case MOp::kNot:
+                        return Op(0, true, 0xf7, -1, 2, a);
+                    case MOp::kCqo:
+                        Byte(0x48);
+                        Byte(0x99);
+                        return;
+                    case MOp::kIdiv:
+                        return Op(0, true, 0xf7, -1, 7, a);
+                    case MOp::kSet:
+                        return Op(0, false, 0x0f, 0x90 | cc, 0, a, true);
+                    case MOp::kMovzb:
+                        return Op(0, false, 0x0f, 0xb6, N(b), a, true);
+                    case MOp::kBsr:
+                        return Op(0, true, 0x0f, 0xbd, N(b), a);
+                    case MOp::kBtc:
+                        if (a.IsImm())
+                        {
+                            Op(0, true, 0x0f, 0xba, 7, b);
+                            Byte(a.imm);
+                            return;
+                        }
+                        return Op(0, true, 0x0f, 0xbb, N(a), b);
+                    case MOp::kJmp:
+                        if (a.kind == Operand::Kind::kLabel || a.kind == Operand::Kind::kFunc)
+                        {
+                            Byte(near && a.kind == Operand::Kind::kLabel ? 0xeb : 0xe9);
+                            return Target(a, near && a.kind == Operand::Kind::kLabel);
+                        }
+                        return Op(0, false, 0xff, -1, 4, a);
+                    case MOp::kJcc:
+                        if (near)
+                        {
+                            Byte(0x70 | cc);
+                        }
+                        else
+                        {
+                            Byte(0x0f);
+                            Byte(0x80 | cc);
+                        }
+                        return Target(a, near);
+                    case MOp::kCall:
+                        if (a.kind == Operand::Kind::kFunc)
+                        {
+                            Byte(0xe8);
+                            return Target(a, false);
+                        }
+                        return Op(0, false, 0xff, -1, 2, a);
+                    case MOp::kRet:
+                        Byte(0xc3);
+                        return;
+                    case MOp::kPush:
+                    case MOp::kPop:
+                        if (N(a) & 8)
+                        {
+                            Byte(0x41);
+                        }
+                        Byte((in.op == MOp::kPush ? 0x50 : 0x58) | (N(a) & 7));
+                        return;
+                    case MOp::kMovsd:
+                        if (a.IsReg() && b.IsReg())
+                        {
+                            return Sse(0x66, false, 0x28, N(b), a);
+                        }
+                        if (a.IsReg())
+                        {
+                            return Sse(0xf2, false, 0x11, N(a), b);
+                        }
+                        return Sse(0xf2, false, 0x10, N(b), a);
+                    case MOp::kMovq:
+                        if (IsXmm(b.reg))
+                        {
+                            return Sse(0x66, true, 0x6e, N(b), a);
+                        }
+                        return Sse(0x66, true, 0x7e, N(a), b);
+                    case MOp::kAddsd:
+                        return Sse(0xf2, false, 0x58, N(b), a);
+                    case MOp::kSubsd:
+                        return Sse(0xf2, false, 0x5c, N(b), a);
+                    case MOp::kMulsd:
+                        return Sse(0xf2, false, 0x59, N(b), a);
+                    case MOp::kDivsd:
+                        return Sse(0xf2, false, 0x5e, N(b), a);
+                    case MOp::kUcomisd:
+                        return Sse(0x66, false, 0x2e, N(b), a);
+                    case MOp::kCvtsi2sd:
+                        return Sse(0xf2, true, 0x2a, N(b), a);
+                    case MOp::kCvttsd2si:
+                        return Sse(0xf2, true, 0x2c, N(b), a);
+                    }
+                }
+            };
+
+            bool IsLabelJump(const MInst &in)
+            {
+                return (in.op == MOp::kJmp || in.op == MOp::kJcc) && in.a.kind == Operand::Kind::kLabel;
+            }
+        }
+
+        Operand Operand::R(Reg r)
+        {
+            Operand o;
+            o.kind = Kind::kReg;
+            o.reg = r;
+            return o;
+        }
+
+        Operand Operand::I(int64_t imm)
+        {
+            Operand o;
+            o.kind = Kind::kImm;
+            o.imm = imm;
+            return o;
+        }
+
+        Operand Operand::M(Reg base, int32_t disp, Reg index, uint8_t scale)
+        {
+            Operand o;
+            o.kind = Kind::kMem;
+            o.reg = base;
+            o.disp = disp;
+            o.index = index;
+            o.scale = scale;
+            return o;
+        }
+
+        Operand Operand::S(const string_t &symbol, int32_t disp)
+        {
+            Operand o;
+            o.kind = Kind::kSymbol;
+            o.symbol = symbol;
+            o.disp = disp;
+            return o;
+        }
+
+        Operand Operand::L(int label)
+        {
+            Operand o;
+            o.kind = Kind::kLabel;
+            o.imm = label;
+            return o;
+        }
+
+        Operand Operand::F(const string_t &symbol)
+        {
+            Operand o;
+            o.kind = Kind::kFunc;
+            o.symbol = symbol;
+            return o;
+        }
+
+        bool Operand::operator==(const Operand &o) const
+        {
+            return kind == o.kind && reg == o.reg && index == o.index && scale == o.scale && disp == o.disp &&
+                   imm == o.imm && symbol == o.symbol;
+        }
+
+        void MFunction::Emit(MOp op, const Operand &a, const Operand &b)
+        {
+            code.push_back({op, Cond::kO, a, b});
+        }
+
+        void MFunction::Emit(MOp op, Cond c, const Operand &a, const Operand &b)
+        {
+            code.push_back({op, c, a, b});
+        }
+
+        const char *RegName(Reg r)
+        {
+            return r == Reg::kNone ? "none" : kRegNames[static_cast<int>(r)];
+        }
+
+        // letters and digits stay, anything else is _ and its hex code
+        string_t Mangle(const string_t &name)
+        {
+            stringstream_t ss;
+            ss << "li_";
+            for (unsigned char c : name)
+            {
+                if (std::isalnum(c))
+                {
+                    ss << c;
+                }
+                else
+                {
+                    ss << "_" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
+                }
+            }
+            return ss.str();
+        }
+
+        void Print(std::ostream &out, const MFunction &f, const string_t &prefix)
+        {
+            Printer p(out, prefix);
+            out << "\t.p2align 4\n" << f.symbol << ":\n";
+            for (auto &in : f.code)
+            {
+                p.Inst(in);
+            }
+        }
+
+        void Print(std::ostream &out, const MModule &m)
+        {
+            out << "\t.text\n";
+            for (size_t i = 0; i < m.functions.size(); i++)
+            {
+                Print(out, m.functions[i], std::to_string(i));
+            }
+            out << "\t.section .rodata\n";
+            for (auto &s : m.strings)
+            {
+                out << s.first << ":\n\t.byte ";
+                for (unsigned char c : s.second)
+                {
+                    out << static_cast<int>(c) << ", ";
+                }
+                out << "0\n";
+            }
+            out << "\t.bss\n\t.p2align 3\nli_globals:\n\t.zero " << 8 * (m.globals + 1) << "\n";
+        }
+    
+        void Encode(const MFunction &f, std::vector<uint8_t> &code, std::vector<Fixup> &fixups)
+        {
+            // every jump to a label starts short; one out of reach grows, which moves the
+            // code after it, until the layout holds
+            std::vector<bool> near(f.code.size(), true);
+            std::vector<size_t> labels(f.labels, 0);
+            for (bool changed = true; changed;)
+            {
+                std::vector<uint8_t> bytes;
+                std::vector<Fixup> ignored;
+                std::vector<size_t> ends(f.code.size());
+                Encoder e(bytes, ignored, labels);
+                for (size_t i = 0; i < f.code.size(); i++)
+                {
+                    if (f.code[i].op == MOp::kLabel)
+                    {
+                        labels[f.code[i].a.imm] = bytes.size();
+                    }
+                    e.Inst(f.code[i], near[i]);
+                    ends[i] = bytes.size();
+                }
+                changed = false;
+                for (size_t i = 0; i < f.code.size(); i++)
+                {
+                    if (!near[i] || !IsLabelJump(f.code[i]))
+                    {
+                        continue;
+                    }
+                    int64_t rel = static_cast<int64_t>(labels[f.code[i].a.imm]) - static_cast<int64_t>(ends[i]);
+                    if (!FitsInt8(rel))
+                    {
+                        near[i] = false;
+                        changed = true;
+                    }
+                }
+            }
+            // the labels are relative to the start of the function
+            size_t start = code.size();
+            for (auto &l : labels)
+            {
+                l += start;
+            }
+            Encoder e(code, fixups, labels);
+            for (size_t i = 0; i < f.code.size(); i++)
+            {
+                e.Inst(f.code[i], near[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef LILANG_NATIVE_X86_64
+#define LILANG_NATIVE_X86_64
+
+#include <ostream>
+#include <vector>
+#include "../listl.h"
+
+/*
+x86-64 machine code as a list of instructions
+
+the code generator writes instructions, not text, so the same code can be
+printed for the system assembler or encoded in memory. operands follow the
+at&t order of the gnu assembler: the source first, the destination last.
+
+every instruction works on 64 bits, except setcc, which writes the low byte
+of its register, and movzb, which widens that byte. memory is either based
+on a register, with an optional scaled index, or a symbol addressed
+relative to the instruction pointer. labels are local to a function and
+numbered; symbols are functions, runtime routines and data.
+
+Encode writes the bytes the assembler would for the printed text, a jump
+short where its target is in reach, and leaves every symbol to a fixup the
+caller resolves once it knows where the code goes.
+*/
+namespace lilang
+{
+    namespace native
+    {
+        enum class Reg : uint8_t
+        {
+            kRax,
+            kRcx,
+            kRdx,
+            kRbx,
+            kRsp,
+            kRbp,
+            kRsi,
+            kRdi,
+            kR8,
+            kR9,
+            kR10,
+            kR11,
+            kR12,
+            kR13,
+            kR14,
+            kR15,
+            kXmm0,
+            kXmm1,
+            kXmm2,
+            kXmm3,
+            kXmm4,
+            kXmm5,
+            kXmm6,
+            kXmm7,
+            kXmm8,
+            kXmm9,
+            kXmm10,
+            kXmm11,
+            kXmm12,
+            kXmm13,
+            kXmm14,
+            kXmm15,
+            kNone,
+        };
+
+        inline bool IsXmm(Reg r) { return r >= Reg::kXmm0 && r <= Reg::kXmm15; }
+        inline Reg Xmm(int i) { return static_cast<Reg>(static_cast<int>(Reg::kXmm0) + i); }
+        // the 4 bit number of the encoding
+        inline int Number(Reg r) { return static_cast<int>(r) & 15; }
+
+        // in the order of the condition codes of the encoding
+        enum class Cond : uint8_t
+        {
+            kO,
+            kNo,
+            kB,
+            kAe,
+            kE,
+            kNe,
+            kBe,
+            kA,
+            kS,
+            kNs,
+            kP,
+            kNp,
+            kL,
+            kGe,
+            kLe,
+            kG,
+        };
+
+        inline Cond Negate(Cond c) { return static_cast<Cond>(static_cast<int>(c) ^ 1); }
+
+        struct Operand
+        {
+            enum class Kind : uint8_t
+            {
+                kNone,
+                kReg,
+                kImm,
+                kMem,    // disp(base, index, scale)
+                kSymbol, // memory at symbol + disp, or its address for lea
+                kLabel,  // target of a jump
+                kFunc,   // target of a call, by symbol
+            };
+
+            Kind kind = Kind::kNone;
+            Reg reg = Reg::kNone; // the register or the base
+            Reg index = Reg::kNone;
+            uint8_t scale = 1;
+            int32_t disp = 0;
+            int64_t imm = 0; // the immediate or the label
+            string_t symbol;
+
+            static Operand R(Reg);
+            static Operand I(int64_t);
+            static Operand M(Reg base, int32_t disp, Reg index = Reg::kNone, uint8_t scale = 1);
+            static Operand S(const string_t &symbol, int32_t disp = 0);
+            static Operand L(int label);
+            static Operand F(const string_t &symbol);
+
+            bool IsReg() const { return kind == Kind::kReg; }
+            bool IsMem() const { return kind == Kind::kMem || kind == Kind::kSymbol; }
+            bool IsImm() const { return kind == Kind::kImm; }
+            bool Is(Reg r) const { return kind == Kind::kReg && reg == r; }
+            bool operator==(const Operand &) const;
+            bool operator!=(const Operand &o) const { return !(*this == o); }
+        };
+
+        enum class MOp : uint8_t
+        {
+            kLabel, // a is the label
+            kMov,   // an immediate past 32 bits is a movabs
+            kLea,
+            kAdd,
+            kSub,
+            kImul,
+            kAnd,
+            kOr,
+            kXor,
+            kCmp,
+            kTest,
+            kNeg,
+            kNot,
+            kCqo,
+            kIdiv,
+            kSet,   // cond, a is the register of the byte
+            kMovzb, // the low byte of a into b
+            kBsr,
+            kBtc,
+            kJmp,
+            kJcc, // cond
+            kCall,
+            kRet,
+            kPush,
+            kPop,
+            kMovsd, // xmm and memory, or two xmm
+            kMovq,  // between a general register and an xmm
+            kAddsd,
+            kSubsd,
+            kMulsd,
+            kDivsd,
+            kUcomisd,
+            kCvtsi2sd,
+            kCvttsd2si,
+        };
+
+        struct MInst
+        {
+            MOp op;
+            Cond cond; // of kSet and kJcc
+            Operand a, b;
+        };
+
+        struct MFunction
+        {
+            string_t symbol;
+            std::vector<MInst> code;
+            int labels = 0;
+
+            int NewLabel() { return labels++; }
+            void Emit(MOp op, const Operand &a = Operand(), const Operand &b = Operand());
+            void Emit(MOp op, Cond c, const Operand &a = Operand(), const Operand &b = Operand());
+        };
+
+        struct MModule
+        {
+            std::vector<MFunction> functions;
+            std::vector<std::pair<string_t, string_t>> strings; // symbol and bytes, nul terminated
+            size_t globals = 0;                                 // cells of li_globals
+        };
+
+        // a 32 bit field of encoded code that refers to a symbol
+        struct Fixup
+        {
+            size_t at;   // offset of the field
+            size_t next; // offset of the end of the instruction, the field is relative to it
+            string_t symbol;
+            int32_t disp; // added to the address of the symbol
+            bool branch;  // the target of a call or jump, not data
+        };
+
+        // appends the machine code of a function to code, labels resolved
+        void Encode(const MFunction &, std::vector<uint8_t> &code, std::vector<Fixup> &fixups);
+
+        const char *RegName(Reg);
+        // a function symbol for the name of an ir function
+        string_t Mangle(const string_t &name);
+        // gnu assembler syntax, local labels are named .L<prefix>_<n>
+        void Print(std::ostream &, const MFunction &, const string_t &prefix);
+        void Print(std::ostream &, const MModule &);
+    }
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include <iomanip>
+#include "./bytecode.h"
+
+namespace lilang
+{
+    namespace runtime
+    {
+        namespace
+        {
+            const char *kNames[] = {
+                "MOVE", "I2F", "F2I", "GETGLOBAL", "SETGLOBAL", "ADD_I64", "ADD_F64", "SUB_I64", "SUB_F64", "MUL_I64",
+                "MUL_F64", "DIV_I64", "DIV_F64", "MOD_I64", "BITAND", "BITOR", "BITXOR", "EQ_I64", "EQ_F64", "NE_I64",
+                "NE_F64", "LT_I64", "LT_F64", "LE_I64", "LE_F64", "NEG_I64", "NEG_F64", "BITNOT", "NOT", "JUMP",
+                "JUMPIF", "JUMPIFNOT", "IFEQ_I64", "IFEQ_F64", "IFNE_I64", "IFNE_F64", "IFLT_I64", "IFLT_F64", "IFLE_I64", "IFLE_F64",
+                "IFNOTLT_F64", "IFNOTLE_F64", "FORLT_I64", "FORLE_I64", "CALL", "CALLVALUE", "RETURN", "RETURN1", "RETURN0", "NEWARRAY",
+                "GETINDEX", "SETINDEX", "ADDRLOCAL", "ADDRGLOBAL", "ADDRINDEX", "LOAD", "STORE",
+            };
+            static_assert(sizeof(kNames) / sizeof(kNames[0]) == static_cast<size_t>(Op::kCount), "a name per op");
+
+            enum class Form
+            {
+                kA,    // a only
+                kAB,   // a and a register b
+                kARK,  // a and RK(b)
+                kABC,  // a, a register b and RK(c)
+                kARKK, // a, RK(b) and RK(c)
+                kABx,  // a and a global index
+                kJump, // a jump, maybe on a
+                kCall, // frame at a, proto b
+                kRet,  // b registers from a
+                kRK,   // RK(b) only
+                kRKK,  // RK(b) and RK(c)
+                kNone,
+            };
+
+            Form FormOf(Op op)
+            {
+                switch (op)
+                {
+                case Op::kMove:
+                case Op::kI2F:
+                case Op::kF2I:
+                case Op::kNegI64:
+                case Op::kNegF64:
+                case Op::kBitNot:
+                case Op::kNot:
+                case Op::kStore:
+                    return Form::kARK;
+                case Op::kGetGlobal:
+                case Op::kSetGlobal:
+                case Op::kAddrGlobal:
+                    return Form::kABx;
+                case Op::kJump:
+                case Op::kJumpIf:
+                case Op::kJumpIfNot:
+                    return Form::kJump;
+                case Op::kCall:
+                    return Form::kCall;
+                case Op::kCallValue:
+                case Op::kAddrLocal:
+                case Op::kLoad:
+                    return Form::kAB;
+                case Op::kReturn:
+                    return Form::kRet;
+                case Op::kReturn1:
+                    return Form::kRK;
+                case Op::kReturn0:
+                    return Form::kNone;
+                case Op::kNewArray:
+                    return Form::kA;
+                case Op::kGetIndex:
+                case Op::kAddrIndex:
+                    return Form::kABC;
+                case Op::kSetIndex:
+                    return Form::kARKK;
+                case Op::kIfEqI64:
+                case Op::kIfEqF64:
+                case Op::kIfNeI64:
+                case Op::kIfNeF64:
+                case Op::kIfLtI64:
+                case Op::kIfLtF64:
+                case Op::kIfLeI64:
+                case Op::kIfLeF64:
+                case Op::kIfNotLtF64:
+                case Op::kIfNotLeF64:
+                    return Form::kRKK;
+                default:
+                    return Form::kARKK;
+                }
+            }
+
+            string_t Const(const Proto &p, int k)
+            {
+                auto v = p.consts[k];
+                auto t = p.const_types[k];
+                switch (t->kind)
+                {
+                case ast::Type::Kind::kInt:
+                    return std::to_string(v.i);
+                case ast::Type::Kind::kFloat:
+                {
+                    stringstream_t ss;
+                    ss << v.f;
+                    return ss.str();
+                }
+                case ast::Type::Kind::kBool:
+                    return v.b ? "true" : "false";
+                case ast::Type::Kind::kString:
+                    return "\"" + *v.s + "\"";
+                case ast::Type::Kind::kFn:
+                    return "fn " + (v.fn->name.empty() ? "<literal>" : v.fn->name);
+                default:
+                    return ast::Type::String(t);
+                }
+            }
+
+            string_t RK(const Proto &p, int x, string_t &note)
+            {
+                if (x & Instr::kConst)
+                {
+                    int k = x & ~Instr::kConst;
+                    note += (note.empty() ? "" : ", ") + ("k" + std::to_string(k) + " = " + Const(p, k));
+                    return "k" + std::to_string(k);
+                }
+                return "r" + std::to_string(x);
+            }
+        }
+
+        Instr Instr::ABC(Op op, uint8_t kind, int a, int b, int c)
+        {
+            Instr in;
+            in.op = op;
+            in.kind = kind;
+            in.a = static_cast<uint16_t>(a);
+            in.b = static_cast<uint16_t>(b);
+            in.c = static_cast<uint16_t>(c);
+            return in;
+        }
+
+        Instr Instr::ABx(Op op, int a, int bx)
+        {
+            auto u = static_cast<uint32_t>(bx);
+            return ABC(op, 0, a, u & 0xffff, u >> 16);
+        }
+
+        const Proto *Program::Find(const string_t &name) const
+        {
+            for (auto &p : protos)
+            {
+                if (p.fn.name == name && &p != init)
+                {
+                    return &p;
+                }
+            }
+            return nullptr;
+        }
+
+        size_t Program::Size() const
+        {
+            size_t n = 0;
+            for (auto &p : protos)
+            {
+                n += p.code.size();
+            }
+            return n;
+        }
+
+        const char *OpName(Op op)
+        {
+            return kNames[static_cast<int>(op)];
+        }
+
+        void Disassemble(std::ostream &os, const Proto &p)
+        {
+            os << "fn " << (p.fn.name.empty() ? "<literal>" : p.fn.name) << " (" << p.fn.params << " params, "
+               << p.fn.returns << " returns, " << p.registers << " registers, " << p.consts.size() << " constants)"
+               << std::endl;
+            for (size_t i = 0; i < p.code.size(); i++)
+            {
+                auto &in = p.code[i];
+                string_t note;
+                stringstream_t ops;
+                switch (FormOf(in.op))
+                {
+                case Form::kA:
+                    ops << "r" << in.a;
+                    break;
+                case Form::kAB:
+                    ops << "r" << in.a << " r" << in.b;
+                    break;
+                case Form::kARK:
+                    ops << "r" << in.a << " " << RK(p, in.b, note);
+                    break;
+                case Form::kABC:
+                    ops << "r" << in.a << " r" << in.b << " " << RK(p, in.c, note);
+                    break;
+                case Form::kARKK:
+                    ops << "r" << in.a << " " << RK(p, in.b, note) << " " << RK(p, in.c, note);
+                    break;
+                case Form::kABx:
+                    ops << "r" << in.a << " g" << in.Bx();
+                    break;
+                case Form::kJump:
+                    if (in.op != Op::kJump)
+                    {
+                        ops << "r" << in.a << " ";
+                    }
+                    ops << "-> " << std::setw(4) << std::setfill('0') << static_cast<int>(i) + 1 + in.Bx();
+                    break;
+                case Form::kCall:
+                    ops << "r" << in.a << " p" << in.b;
+                    break;
+                case Form::kRet:
+                    ops << "r" << in.a << " " << in.b;
+                    break;
+                case Form::kRK:
+                    ops << RK(p, in.b, note);
+                    break;
+                case Form::kRKK:
+                    ops << RK(p, in.b, note) << " " << RK(p, in.c, note);
+                    break;
+                case Form::kNone:
+                    break;
+                }
+                os << "  " << std::setw(4) << std::setfill('0') << i << std::setfill(' ') << "  [" << std::setw(3)
+                   << p.pos[i].first << "]  " << std::left << std::setw(14) << OpName(in.op)
+                   << std::setw(20) << ops.str() << std::right;
+                if (!note.empty())
+                {
+                    os << "; " << note;
+                }
+                os << std::endl;
+            }
+        }
+
+        void Disassemble(std::ostream &os, const Program &prog)
+        {
+            int i = 0;
+            for (auto &p : prog.protos)
+            {
+                os << "p" << i++ << " ";
+                Disassemble(os, p);
+            }
+        }
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef LILANG_RUNTIME_BYTECODE
+#define LILANG_RUNTIME_BYTECODE
+
+#include <deque>
+#include <ostream>
+#include <vector>
+#include "./value.h"
+
+/*
+register based bytecode
+
+every function is a proto: its instructions, a constant pool and the number
+of registers of its frame. registers are the cells of the frame, the first
+ones are the slots the semantic pass gave to params and locals, temporaries
+follow. an instruction reads its operands where they already live, so
+`s = s + i` is a single ADD s s i where a stack machine needs four.
+
+operands b and c of most instructions are RK: a register, or with kConst
+set an index into the constant pool.
+
+the opcodes are typed by the semantic pass: ADD_I64 and ADD_F64 instead of
+one ADD that looks at its operands. where an int meets a float, or an
+assignment converts between them, an explicit I2F or F2I is emitted, so no
+instruction decides at run time what its operands are.
+
+a compare that only decides a branch is fused with it, and so is the
+increment of a counted loop with its test: the pairs a profile of the
+benchmarks runs most. the fused instruction is followed by a plain JUMP
+that holds the offset, it is never dispatched on its own.
+
+a call evaluates its arguments into consecutive registers starting at a
+base, the callee frame starts at that base, so arguments are passed without
+a copy. results are written back from the first registers of the callee
+frame, the caller finds them at the base.
+*/
+namespace lilang
+{
+    namespace runtime
+    {
+        enum class Op : uint8_t
+        {
+            kMove,      // a = RK(b)
+            kI2F,       // a = float(RK(b))
+            kF2I,       // a = int(RK(b)), a float out of the int range traps
+            kGetGlobal, // a = globals[Bx]
+            kSetGlobal, // globals[Bx] = a
+            kAddI64,    // a = RK(b) + RK(c)
+            kAddF64,
+            kSubI64,
+            kSubF64,
+            kMulI64,
+            kMulF64,
+            kDivI64,
+            kDivF64,
+            kModI64,
+            kBitAnd,
+            kBitOr,
+            kBitXor,
+            kEqI64, // a = RK(b) == RK(c), bools and references compare as ints
+            kEqF64,
+            kNeI64,
+            kNeF64,
+            kLtI64,
+            kLtF64,
+            kLeI64,
+            kLeF64,
+            kNegI64, // a = -RK(b)
+            kNegF64,
+            kBitNot,    // a = ^RK(b)
+            kNot,       // a = !RK(b)
+            kJump,      // pc += Bx
+            kJumpIf,    // if a, pc += Bx
+            kJumpIfNot, // if !a, pc += Bx
+            kIfEqI64,   // if RK(b) == RK(c), take the JUMP that follows, else skip it
+            kIfEqF64,
+            kIfNeI64,
+            kIfNeF64,
+            kIfLtI64,
+            kIfLtF64,
+            kIfLeI64,
+            kIfLeF64,
+            kIfNotLtF64, // not the same as kIfLeF64 with the operands swapped when one is NaN
+            kIfNotLeF64,
+            kForLtI64, // a += RK(b), if a < RK(c) take the JUMP that follows
+            kForLeI64,
+            kCall,      // call proto b, frame at a
+            kCallValue, // call the function in register b, frame at a
+            kReturn,    // return b registers from a
+            kReturn1,   // return RK(b)
+            kReturn0,
+            kNewArray,   // a = new array
+            kGetIndex,   // a = b[RK(c)]
+            kSetIndex,   // a[RK(b)] = RK(c), a nil array in register a is created
+            kAddrLocal,  // a = &b
+            kAddrGlobal, // a = &globals[Bx]
+            kAddrIndex,  // a = &(*b)[RK(c)], *b is created when nil unless kind is kNoCreate
+            kLoad,       // a = *b
+            kStore,      // *a = RK(b)
+            kCount,
+        };
+
+        // kind of kAddrIndex
+        enum : uint8_t
+        {
+            kCreate = 0,
+            kNoCreate = 1, // the array is not addressable, a nil one is an index error
+        };
+
+        struct Instr
+        {
+            static const uint16_t kConst = 0x8000; // RK operand refers to the constant pool
+            static const int kMaxOperand = 0x7fff;
+
+            Op op;
+            uint8_t kind;
+            uint16_t a;
+            uint16_t b;
+            uint16_t c;
+
+            // b and c as one signed jump offset from the next instruction or global index
+            int32_t Bx() const { return static_cast<int32_t>(static_cast<uint32_t>(c) << 16 | b); }
+
+            static Instr ABC(Op op, uint8_t kind, int a, int b, int c);
+            static Instr ABx(Op op, int a, int bx);
+        };
+
+        struct Proto
+        {
+            Function fn; // fn.code points back to the proto
+            int index = 0; // in Program::protos, what kCall names
+            int registers = 0;
+            std::vector<Instr> code;
+            std::vector<Value> consts;
+            std::vector<ast::Type::Ptr> const_types; // for printing
+            std::vector<std::pair<int, int>> pos; // row and column of each instruction
+        };
+
+        struct Program
+        {
+            std::deque<Proto> protos;
+            Proto *init = nullptr; // initializes the globals
+            int global_count = 0;
+            std::deque<string_t> strings;
+
+            const Proto *Find(const string_t &name) const;
+            size_t Size() const; // instructions of all protos
+        };
+
+        const char *OpName(Op);
+        // one line per instruction, constants are printed next to their use
+        void Disassemble(std::ostream &, const Proto &);
+        void Disassemble(std::ostream &, const Program &);
+    }
+}
+
+#endif
@@ -0,0 +1,1231 @@
+#include "./emitter.h"
+
+namespace lilang
+{
+    namespace runtime
+    {
+        using ast::Type;
+        using compiler::CodeType;
+
+        namespace
+        {
+            bool IsInt(Type::Ptr t) { return t->kind == Type::Kind::kInt; }
+            bool IsFloat(Type::Ptr t) { return t->kind == Type::Kind::kFloat; }
+
+            ast::Expr *Unparen(ast::Expr *e)
+            {
+                while (e->node_kind == ast::NodeKind::kParenExpr)
+                {
+                    e = static_cast<ast::ParenExpr *>(e)->expr.get();
+                }
+                return e;
+            }
+
+            // the int form of an operator
+            Op ArithOf(CodeType t)
+            {
+                switch (t)
+                {
+                case CodeType::kAdd:
+                case CodeType::kAddAssign:
+                    return Op::kAddI64;
+                case CodeType::kSub:
+                case CodeType::kSubAssign:
+                    return Op::kSubI64;
+                case CodeType::kMultiply:
+                case CodeType::kMulAssign:
+                    return Op::kMulI64;
+                case CodeType::kDivide:
+                case CodeType::kDivAssign:
+                    return Op::kDivI64;
+                case CodeType::kMod:
+                    return Op::kModI64;
+                case CodeType::kBitsAnd:
+                case CodeType::kBitsAndAssign:
+                    return Op::kBitAnd;
+                case CodeType::kBitsOr:
+                case CodeType::kBitsOrAssign:
+                    return Op::kBitOr;
+                case CodeType::kBitsXor:
+                case CodeType::kBitsXorAssign:
+                    return Op::kBitXor;
+                case CodeType::kEqual:
+                    return Op::kEqI64;
+                case CodeType::kNotEqual:
+                    return Op::kNeI64;
+                case CodeType::kLess:
+                case CodeType::kGreater:
+                    return Op::kLtI64;
+                case CodeType::kNotGreater:
+                case CodeType::kNotLess:
+                    return Op::kLeI64;
+                default:
+                    return Op::kCount;
+                }
+            }
+
+            // the float form of an int operator, kCount if there is none
+            Op FloatOf(Op op)
+            {
+                switch (op)
+                {
+                case Op::kAddI64:
+                    return Op::kAddF64;
+                case Op::kSubI64:
+                    return Op::kSubF64;
+                case Op::kMulI64:
+                    return Op::kMulF64;
+                case Op::kDivI64:
+                    return Op::kDivF64;
+                case Op::kEqI64:
+                    return Op::kEqF64;
+                case Op::kNeI64:
+                    return Op::kNeF64;
+                case Op::kLtI64:
+                    return Op::kLtF64;
+                case Op::kLeI64:
+                    return Op::kLeF64;
+                default:
+                    return Op::kCount;
+                }
+            }
+
+            uint64_t LocalKey(const ast::FuncLit *lit, int slot)
+            {
+                return static_cast<uint64_t>(lit->node_id) << 32 | static_cast<uint32_t>(slot);
+            }
+
+            // the locals whose address is taken, a call can write their register
+            class AddressMarker final : public ast::StaticWalker<AddressMarker>
+            {
+            public:
+                explicit AddressMarker(std::unordered_set<uint64_t> &out) : marked(out) {}
+
+                void Pre(ast::Node *n)
+                {
+                    if (n->node_kind != ast::NodeKind::kUnaryExpr ||
+                        static_cast<ast::UnaryExpr *>(n)->op != CodeType::kBitsAnd)
+                    {
+                        return;
+                    }
+                    auto e = Unparen(static_cast<ast::UnaryExpr *>(n)->expr.get());
+                    if (e->node_kind != ast::NodeKind::kIdent)
+                    {
+                        return;
+                    }
+                    auto &s = static_cast<ast::Ident *>(e)->storage;
+                    if (s.kind == ast::Storage::Kind::kLocal && s.func != nullptr)
+                    {
+                        marked.insert(LocalKey(s.func, s.index));
+                    }
+                }
+
+            private:
+                std::unordered_set<uint64_t> &marked;
+            };
+        }
+
+        Emitter::Emitter(compiler::Diagnostics &d) : diag(d) {}
+
+        void Emitter::Unsupported(ast::Node *n, const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kRuntime, n->row_number, n->column_number, msg);
+            ok = false;
+        }
+
+        bool Emitter::Emit(const ast::File::Ptr &file, ast::SemanticVisitor &v, Program &p)
+        {
+            annots = &v.Annots();
+            constants = &v.Constants();
+            prog = &p;
+            ok = true;
+            // emitting a node recurses into its children
+            string_t msg;
+            auto deep = ast::TooDeep(file.get(), msg);
+            if (deep != nullptr)
+            {
+                Unsupported(deep, msg);
+                return false;
+            }
+            addressed.clear();
+            AddressMarker(addressed).Walk(file.get());
+            p.global_count = file->global_count;
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    auto lit = static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get();
+                    Declare(lit, lit->name);
+                }
+            }
+            p.protos.emplace_back();
+            p.init = &p.protos.back();
+            p.init->index = p.protos.size() - 1;
+            p.init->fn = {nullptr, nullptr, "<init>", 0, 0, 0, p.init};
+            for (auto &decl : file->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    EmitBody(by_lit[static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get()]);
+                    continue;
+                }
+                // the global initializers go to one function, in order
+                proto = p.init;
+                current = nullptr;
+                top = 0;
+                Declare(static_cast<ast::VarDecl *>(decl.get()));
+            }
+            proto = p.init;
+            at = {0, 0};
+            Add(Instr::ABC(Op::kReturn0, 0, 0, 0, 0));
+            annots = nullptr;
+            constants = nullptr;
+            return ok;
+        }
+
+        Proto *Emitter::Declare(ast::FuncLit *lit, const string_t &name)
+        {
+            auto t = TypeOf(lit);
+            prog->protos.emplace_back();
+            auto p = &prog->protos.back();
+            p->fn = {lit, t, name, lit->frame_size, static_cast<int>(t->Params().size()),
+                     static_cast<int>(t->Returns().size()), p};
+            p->index = prog->protos.size() - 1;
+            if (p->index > UINT16_MAX)
+            {
+                Unsupported(lit, "too many functions");
+            }
+            by_lit[lit] = p;
+            return p;
+        }
+
+        void Emitter::EmitBody(Proto *p)
+        {
+            auto saved_proto = proto;
+            auto saved_current = current;
+            auto saved_top = top;
+            auto saved_at = at;
+            std::vector<Loop> saved_loops;
+            saved_loops.swap(loops);
+            proto = p;
+            current = const_cast<ast::FuncLit *>(p->fn.lit);
+            // results are written to the first registers
+            top = std::max(current->frame_size, p->fn.returns);
+            p->registers = top;
+            Block(current->body.get());
+            at = {current->body->row_number, current->body->column_number};
+            Add(Instr::ABC(Op::kReturn0, 0, 0, 0, 0));
+            p->fn.frame_size = p->registers;
+            proto = saved_proto;
+            current = saved_current;
+            top = saved_top;
+            at = saved_at;
+            loops.swap(saved_loops);
+        }
+
+        //********************************************************************
+        // instructions and registers
+        //********************************************************************
+
+        size_t Emitter::Add(Instr in)
+        {
+            proto->code.push_back(in);
+            proto->pos.push_back(at);
+            return proto->code.size() - 1;
+        }
+
+        size_t Emitter::Jump(Op op, int a)
+        {
+            return Add(Instr::ABx(op, a, 0));
+        }
+
+        void Emitter::Patch(size_t jump)
+        {
+            Patch(jump, proto->code.size());
+        }
+
+        void Emitter::Patch(size_t jump, size_t target)
+        {
+            auto &in = proto->code[jump];
+            in = Instr::ABx(in.op, in.a, static_cast<int>(target) - static_cast<int>(jump) - 1);
+        }
+
+        int Emitter::Temp()
+        {
+            int r = top++;
+            if (top > proto->registers)
+            {
+                proto->registers = top;
+                if (top == Instr::kMaxOperand + 1)
+                {
+                    diag.Report(compiler::Phase::kRuntime, at.first, at.second, "function needs too many registers");
+                    ok = false;
+                }
+            }
+            return r;
+        }
+
+        int Emitter::Const(Value v, Type::Ptr t)
+        {
+            auto &consts = proto->consts;
+            for (size_t i = 0; i < consts.size(); i++)
+            {
+                if (consts[i].i == v.i && proto->const_types[i] == t)
+                {
+                    return Instr::kConst | static_cast<int>(i);
+                }
+            }
+            if (consts.size() == Instr::kMaxOperand)
+            {
+                diag.Report(compiler::Phase::kRuntime, at.first, at.second, "function needs too many constants");
+                ok = false;
+                return Instr::kConst;
+            }
+            consts.push_back(v);
+            proto->const_types.push_back(t);
+            return Instr::kConst | static_cast<int>(consts.size() - 1);
+        }
+
+        int Emitter::Const(const ast::Constant &k)
+        {
+            switch (k.kind)
+            {
+            case Type::Kind::kInt:
+                return Const(Value::Int(k.i), ast::TypeTable::Int());
+            case Type::Kind::kFloat:
+                return Const(Value::Float(k.f), ast::TypeTable::Float());
+            default:
+                return Const(Value::Bool(k.b), ast::TypeTable::Bool());
+            }
+        }
+
+        // the register of a local of the function being emitted, -1 for anything else
+        int Emitter::Local(ast::Expr *e)
+        {
+            e = Unparen(e);
+            if (e->node_kind != ast::NodeKind::kIdent)
+            {
+                return -1;
+            }
+            auto &s = static_cast<ast::Ident *>(e)->storage;
+            return s.kind == ast::Storage::Kind::kLocal && s.func == current && current != nullptr ? s.index : -1;
+        }
+
+        bool Emitter::Addressed(ast::Expr *e)
+        {
+            int slot = Local(e);
+            return slot >= 0 && addressed.count(LocalKey(current, slot)) != 0;
+        }
+
+        void Emitter::Move(int dst, int src, Type::Ptr from, Type::Ptr to)
+        {
+            Op op = IsInt(from) && IsFloat(to) ? Op::kI2F : IsFloat(from) && IsInt(to) ? Op::kF2I : Op::kMove;
+            if (dst != src || op != Op::kMove)
+            {
+                Add(Instr::ABC(op, 0, dst, src, 0));
+            }
+        }
+
+        //********************************************************************
+        // expressions
+        //********************************************************************
+
+        int Emitter::Operand(ast::Expr *e)
+        {
+            auto k = constants->Find(e);
+            if (k != nullptr)
+            {
+                return Const(*k);
+            }
+            e = Unparen(e);
+            at = {e->row_number, e->column_number};
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto id = static_cast<ast::Ident *>(e);
+                auto &s = id->storage;
+                if (s.kind == ast::Storage::Kind::kLocal)
+                {
+                    if (s.func != current || current == nullptr)
+                    {
+                        Unsupported(id, id->name + " is a local of an enclosing function, closures are not supported");
+                        return Const(Value::Zero(), TypeOf(id));
+                    }
+                    return s.index;
+                }
+                if (s.kind == ast::Storage::Kind::kFunc)
+                {
+                    auto v = Value::Zero();
+                    v.fn = &by_lit[s.func]->fn;
+                    return Const(v, TypeOf(id));
+                }
+                break;
+            }
+            case ast::NodeKind::kBasicLiteral:
+            {
+                // numbers and bools are constants, what is left is a string
+                prog->strings.push_back(static_cast<ast::BasicLiteral *>(e)->value);
+                auto v = Value::Zero();
+                v.s = &prog->strings.back();
+                return Const(v, TypeOf(e));
+            }
+            case ast::NodeKind::kFuncLit:
+            {
+                auto p = Declare(static_cast<ast::FuncLit *>(e), "");
+                EmitBody(p);
+                auto v = Value::Zero();
+                v.fn = &p->fn;
+                return Const(v, TypeOf(e));
+            }
+            case ast::NodeKind::kCallExpr:
+                if (annots->KindOf(static_cast<ast::CallExpr *>(e)->expr.get()) != ast::Obj::Kind::kType)
+                {
+                    return Call(static_cast<ast::CallExpr *>(e));
+                }
+                break;
+            default:
+                break;
+            }
+            int t = Temp();
+            Into(e, t);
+            return t;
+        }
+
+        // the operand converted to type to, a constant is converted right away
+        int Emitter::Operand(ast::Expr *e, Type::Ptr to)
+        {
+            auto from = TypeOf(e);
+            auto k = constants->Find(e);
+            if (k != nullptr && IsInt(from) && IsFloat(to))
+            {
+                return Const(Value::Float(static_cast<double>(k->i)), to);
+            }
+            int r = Operand(e);
+            if (IsInt(from) && IsFloat(to) || IsFloat(from) && IsInt(to))
+            {
+                int t = Temp();
+                Move(t, r, from, to);
+                return t;
+            }
+            return r;
+        }
+
+        void Emitter::Into(ast::Expr *e, Type::Ptr to, int dst)
+        {
+            auto from = TypeOf(e);
+            if (IsInt(from) && IsFloat(to) || IsFloat(from) && IsInt(to))
+            {
+                int r = Operand(e);
+                at = {e->row_number, e->column_number};
+                Move(dst, r, from, to);
+                return;
+            }
+            Into(e, dst);
+        }
+
+        // computes e into dst, dst is only written by the last instruction
+        void Emitter::Into(ast::Expr *e, int dst)
+        {
+            if (constants->Find(e) != nullptr)
+            {
+                Add(Instr::ABC(Op::kMove, 0, dst, Operand(e), 0));
+                return;
+            }
+            e = Unparen(e);
+            at = {e->row_number, e->column_number};
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto &s = static_cast<ast::Ident *>(e)->storage;
+                if (s.kind == ast::Storage::Kind::kGlobal)
+                {
+                    Add(Instr::ABx(Op::kGetGlobal, dst, s.index));
+                    return;
+                }
+                if (s.kind == ast::Storage::Kind::kExtern || s.kind == ast::Storage::Kind::kNone)
+                {
+                    Unsupported(e, "imported " + static_cast<ast::Ident *>(e)->name + " is not linked");
+                    return;
+                }
+                Move(dst, Operand(e), TypeOf(e), TypeOf(e));
+                return;
+            }
+            case ast::NodeKind::kBinaryExpr:
+                Binary(static_cast<ast::BinaryExpr *>(e), dst);
+                return;
+            case ast::NodeKind::kUnaryExpr:
+                Unary(static_cast<ast::UnaryExpr *>(e), dst);
+                return;
+            case ast::NodeKind::kCallExpr:
+            {
+                auto call = static_cast<ast::CallExpr *>(e);
+                if (annots->KindOf(call->expr.get()) == ast::Obj::Kind::kType)
+                {
+                    Into(call->args[0].get(), TypeOf(call), dst);
+                    return;
+                }
+                int base = Call(call);
+                Move(dst, base, TypeOf(e), TypeOf(e));
+                return;
+            }
+            case ast::NodeKind::kIndexExpr:
+            {
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                int a = Operand(ie->operand.get());
+                int i = Operand(ie->index.get());
+                at = {e->row_number, e->column_number};
+                Add(Instr::ABC(Op::kGetIndex, 0, dst, a, i));
+                return;
+            }
+            case ast::NodeKind::kStarExpr:
+            {
+                int p = Operand(static_cast<ast::StarExpr *>(e)->expr.get());
+                at = {e->row_number, e->column_number};
+                Add(Instr::ABC(Op::kLoad, 0, dst, p, 0));
+                return;
+            }
+            case ast::NodeKind::kBasicLiteral:
+            case ast::NodeKind::kFuncLit:
+                Move(dst, Operand(e), TypeOf(e), TypeOf(e));
+                return;
+            default:
+                Unsupported(e, "expression cannot run");
+            }
+        }
+
+        void Emitter::Binary(ast::BinaryExpr *e, int dst)
+        {
+            auto l = e->left.get();
+            auto r = e->right.get();
+            if (e->op == CodeType::kLogicAnd || e->op == CodeType::kLogicOr)
+            {
+                // the right side may read a local that is the destination
+                int t = dst >= FrameBase() ? dst : Temp();
+                Into(l, t);
+                size_t skip = Jump(e->op == CodeType::kLogicAnd ? Op::kJumpIfNot : Op::kJumpIf, t);
+                Into(r, t);
+                Patch(skip);
+                Move(dst, t, TypeOf(e), TypeOf(e));
+                return;
+            }
+            auto op = ArithOf(e->op);
+            if (op == Op::kCount)
+            {
+                Unsupported(e, "operator cannot run");
+                return;
+            }
+            int a, b;
+            bool floats = IsFloat(TypeOf(l)) || IsFloat(TypeOf(r));
+            if (floats)
+            {
+                // an int next to a float is converted, a constant one right away
+                op = FloatOf(op);
+                a = Operand(l, ast::TypeTable::Float());
+            }
+            else
+            {
+                a = Operand(l);
+            }
+            if (Addressed(l) && a == Local(l))
+            {
+                // the right side may write the local through a pointer, it is read first
+                int t = Temp();
+                Add(Instr::ABC(Op::kMove, 0, t, a, 0));
+                a = t;
+            }
+            b = floats ? Operand(r, ast::TypeTable::Float()) : Operand(r);
+            // a > b is b < a, the operands are still computed left to right
+            if (e->op == CodeType::kGreater || e->op == CodeType::kNotLess)
+            {
+                std::swap(a, b);
+            }
+            if (op == Op::kCount)
+            {
+                Unsupported(e, "operator cannot run");
+                return;
+            }
+            at = {e->row_number, e->column_number};
+            Add(Instr::ABC(op, 0, dst, a, b));
+        }
+
+        void Emitter::Unary(ast::UnaryExpr *e, int dst)
+        {
+            auto x = e->expr.get();
+            switch (e->op)
+            {
+            case CodeType::kAdd:
+                Into(x, dst);
+                return;
+            case CodeType::kSub:
+            {
+                int a = Operand(x);
+                Add(Instr::ABC(IsFloat(TypeOf(x)) ? Op::kNegF64 : Op::kNegI64, 0, dst, a, 0));
+                return;
+            }
+            case CodeType::kBitsXor:
+                Add(Instr::ABC(Op::kBitNot, 0, dst, Operand(x), 0));
+                return;
+            case CodeType::kLogicNot:
+                Add(Instr::ABC(Op::kNot, 0, dst, Operand(x), 0));
+                return;
+            case CodeType::kBitsAnd:
+                Move(dst, Address(x), TypeOf(e), TypeOf(e));
+                return;
+            default:
+                Unsupported(e, "operator cannot run");
+            }
+        }
+
+        // a call of a top level function names its proto, other callees are
+        // values. results are left in the registers from the returned base on
+        int Emitter::Call(ast::CallExpr *e)
+        {
+            auto callee = e->expr.get();
+            auto t = TypeOf(callee);
+            auto params = t->Params();
+            std::vector<Type::Ptr> to(params.begin(), params.end());
+            int returns = t->Returns().size();
+            const Proto *direct = nullptr;
+            auto target = Unparen(callee);
+            if (target->node_kind == ast::NodeKind::kIdent &&
+                static_cast<ast::Ident *>(target)->storage.kind == ast::Storage::Kind::kFunc)
+            {
+                direct = by_lit[static_cast<ast::Ident *>(target)->storage.func];
+            }
+            int fn = -1;
+            if (direct == nullptr)
+            {
+                fn = Operand(callee);
+                if (fn & Instr::kConst)
+                {
+                    int r = Temp();
+                    Add(Instr::ABC(Op::kMove, 0, r, fn, 0));
+                    fn = r;
+                }
+            }
+            int base = top;
+            Values(e->args, to, base);
+            at = {e->row_number, e->column_number};
+            if (direct != nullptr)
+            {
+                Add(Instr::ABC(Op::kCall, 0, base, direct->index, 0));
+            }
+            else
+            {
+                Add(Instr::ABC(Op::kCallValue, 0, base, fn, 0));
+            }
+            // the results stay until the end of the statement
+            top = base;
+            for (int i = 0; i < std::max(returns, 1); i++)
+            {
+                Temp();
+            }
+            return base;
+        }
+
+        // the values of a list converted to the types in to, into the registers
+        // from base, which must be the first free one
+        void Emitter::Values(const ast::Expr::List &list, const std::vector<Type::Ptr> &to, int base)
+        {
+            top = base;
+            if (list.size() != to.size())
+            {
+                // a call returning all the values
+                auto vals = TypeOf(list[0].get())->Vals();
+                int from = Call(static_cast<ast::CallExpr *>(Unparen(list[0].get())));
+                // from is past base when loading the callee took a register
+                for (size_t i = 0; i < to.size(); i++)
+                {
+                    Move(base + i, from + i, vals[i], to[i]);
+                }
+                top = std::max(top, base + static_cast<int>(to.size()));
+                return;
+            }
+            for (size_t i = 0; i < to.size(); i++)
+            {
+                Temp();
+            }
+            for (size_t i = 0; i < to.size(); i++)
+            {
+                Into(list[i].get(), to[i], base + i);
+            }
+        }
+
+        // a register holding where an assignable expression lives
+        int Emitter::Address(ast::Expr *e)
+        {
+            e = Unparen(e);
+            at = {e->row_number, e->column_number};
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto &s = static_cast<ast::Ident *>(e)->storage;
+                int slot = Local(e);
+                if (slot >= 0)
+                {
+                    int r = Temp();
+                    Add(Instr::ABC(Op::kAddrLocal, 0, r, slot, 0));
+                    return r;
+                }
+                if (s.kind == ast::Storage::Kind::kGlobal)
+                {
+                    int r = Temp();
+                    Add(Instr::ABx(Op::kAddrGlobal, r, s.index));
+                    return r;
+                }
+                Operand(e); // reports why
+                return Temp();
+            }
+            case ast::NodeKind::kStarExpr:
+            {
+                int p = Operand(static_cast<ast::StarExpr *>(e)->expr.get());
+                if (p & Instr::kConst)
+                {
+                    int r = Temp();
+                    Add(Instr::ABC(Op::kMove, 0, r, p, 0));
+                    p = r;
+                }
+                return p;
+            }
+            case ast::NodeKind::kIndexExpr:
+            {
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                auto operand = ie->operand.get();
+                int p;
+                uint8_t kind = kCreate;
+                if (ast::Obj::Addressable(annots->KindOf(operand)))
+                {
+                    p = Address(operand);
+                }
+                else
+                {
+                    // a nil array that is not assignable is not created
+                    int v = Temp();
+                    Into(operand, v);
+                    p = Temp();
+                    Add(Instr::ABC(Op::kAddrLocal, 0, p, v, 0));
+                    kind = kNoCreate;
+                }
+                int i = Operand(ie->index.get());
+                int r = Temp();
+                at = {e->row_number, e->column_number};
+                Add(Instr::ABC(Op::kAddrIndex, kind, r, p, i));
+                return r;
+            }
+            default:
+                Unsupported(e, "expression is not assignable");
+                return Temp();
+            }
+        }
+
+        //********************************************************************
+        // statements
+        //********************************************************************
+
+        void Emitter::Stmt(ast::Stmt *s)
+        {
+            int mark = top;
+            at = {s->row_number, s->column_number};
+            switch (s->node_kind)
+            {
+            case ast::NodeKind::kBlock:
+                Block(static_cast<ast::Block *>(s));
+                break;
+            case ast::NodeKind::kExprStmt:
+            {
+                auto e = static_cast<ast::ExprStmt *>(s)->expr.get();
+                // the value of a call is not needed, the call is made anyway
+                if (Unparen(e)->node_kind == ast::NodeKind::kCallExpr)
+                {
+                    Operand(e);
+                }
+                else
+                {
+                    Into(e, Temp());
+                }
+                break;
+            }
+            case ast::NodeKind::kDeclStmt:
+                Declare(static_cast<ast::VarDecl *>(static_cast<ast::DeclStmt *>(s)->decl.get()));
+                break;
+            case ast::NodeKind::kAssignStmt:
+                Assign(static_cast<ast::AssignStmt *>(s));
+                break;
+            case ast::NodeKind::kIfStmt:
+                If(static_cast<ast::IfStmt *>(s));
+                break;
+            case ast::NodeKind::kWhileStmt:
+                While(static_cast<ast::WhileStmt *>(s));
+                break;
+            case ast::NodeKind::kForStmt:
+                For(static_cast<ast::ForStmt *>(s));
+                break;
+            case ast::NodeKind::kRetStmt:
+                Return(static_cast<ast::RetStmt *>(s));
+                break;
+            case ast::NodeKind::kEmptyStmt:
+                break;
+            case ast::NodeKind::kBreakStmt:
+                loops.back().breaks.push_back(Jump(Op::kJump, 0));
+                break;
+            case ast::NodeKind::kContinueStmt:
+                loops.back().continues.push_back(Jump(Op::kJump, 0));
+                break;
+            default:
+                Unsupported(s, "statement cannot run");
+            }
+            top = mark;
+        }
+
+        void Emitter::Block(ast::Block *b)
+        {
+            for (auto &s : b->stmts)
+            {
+                Stmt(s.get());
+            }
+        }
+
+        // locals go to their registers, top level names to the globals
+        void Emitter::Declare(ast::VarDecl *decl)
+        {
+            int n = decl->names.size();
+            int first = decl->first_slot;
+            bool global = current == nullptr;
+            if (decl->type != nullptr)
+            {
+                auto t = annots->TypeOf(decl->type.get());
+                for (int i = 0; i < n; i++)
+                {
+                    int r = global ? Temp() : first + i;
+                    if (t->kind == Type::Kind::kArray)
+                    {
+                        Add(Instr::ABC(Op::kNewArray, 0, r, 0, 0));
+                    }
+                    else
+                    {
+                        Add(Instr::ABC(Op::kMove, 0, r, Const(Value::Zero(), t), 0));
+                    }
+                    if (global)
+                    {
+                        Add(Instr::ABx(Op::kSetGlobal, r, first + i));
+                    }
+                }
+                return;
+            }
+            std::vector<Type::Ptr> to;
+            if (decl->vals.size() != n)
+            {
+                auto vals = TypeOf(decl->vals[0].get())->Vals();
+                to.assign(vals.begin(), vals.end());
+            }
+            else
+            {
+                for (auto &v : decl->vals)
+                {
+                    to.push_back(TypeOf(v.get()));
+                }
+            }
+            if (!global && decl->vals.size() == n)
+            {
+                // the names are new, no value reads their registers
+                for (int i = 0; i < n; i++)
+                {
+                    Into(decl->vals[i].get(), first + i);
+                }
+                return;
+            }
+            int base = top;
+            Values(decl->vals, to, base);
+            for (int i = 0; i < n; i++)
+            {
+                if (global)
+                {
+                    Add(Instr::ABx(Op::kSetGlobal, base + i, first + i));
+                }
+                else
+                {
+                    Move(first + i, base + i, to[i], to[i]);
+                }
+            }
+        }
+
+        void Emitter::Assign(ast::AssignStmt *s)
+        {
+            if (s->op != CodeType::kAssign)
+            {
+                Update(s);
+                return;
+            }
+            auto &lhs = s->lhs;
+            auto &rhs = s->rhs;
+            if (lhs.size() == 1 && rhs.size() == 1)
+            {
+                auto l = lhs[0].get();
+                int slot = Local(l);
+                if (slot >= 0)
+                {
+                    Into(rhs[0].get(), TypeOf(l), slot);
+                    return;
+                }
+                Store(l, Operand(rhs[0].get(), TypeOf(l)));
+                return;
+            }
+            // every value is computed before anything is assigned, so a, b = b, a swaps
+            std::vector<Type::Ptr> to;
+            for (auto &l : lhs)
+            {
+                to.push_back(TypeOf(l.get()));
+            }
+            int base = top;
+            Values(rhs, to, base);
+            for (size_t i = 0; i < lhs.size(); i++)
+            {
+                Store(lhs[i].get(), base + i);
+            }
+        }
+
+        // x op= y computes in float when either side is a float. every engine reads x
+        // before it computes y, a call in y that writes x is lost
+        void Emitter::Update(ast::AssignStmt *s)
+        {
+            auto l = s->lhs[0].get();
+            auto r = s->rhs[0].get();
+            auto lt = TypeOf(l);
+            auto rt = TypeOf(r);
+            auto op = ArithOf(s->op);
+            bool ints = IsInt(lt) && IsInt(rt);
+            // a local y may write through a pointer is loaded like any other place
+            int slot = Addressed(l) ? -1 : Local(l);
+            int ptr = -1;
+            int cur = slot;
+            if (slot < 0)
+            {
+                ptr = Address(l);
+                cur = Temp();
+                Add(Instr::ABC(Op::kLoad, 0, cur, ptr, 0));
+            }
+            auto f = ast::TypeTable::Float();
+            int b = ints ? Operand(r) : Operand(r, f);
+            at = {s->row_number, s->column_number};
+            if (ints)
+            {
+                Add(Instr::ABC(op, 0, cur, cur, b));
+            }
+            else if (IsInt(lt))
+            {
+                // computed as a float and stored back to the int
+                int t = Temp();
+                Move(t, cur, lt, f);
+                Add(Instr::ABC(FloatOf(op), 0, t, t, b));
+                Move(cur, t, f, lt);
+            }
+            else
+            {
+                Add(Instr::ABC(FloatOf(op), 0, cur, cur, b));
+            }
+            if (ptr >= 0)
+            {
+                Add(Instr::ABC(Op::kStore, 0, ptr, cur, 0));
+            }
+        }
+
+        void Emitter::Store(ast::Expr *lhs, int src)
+        {
+            auto e = Unparen(lhs);
+            int slot = Local(e);
+            at = {e->row_number, e->column_number};
+            if (slot >= 0)
+            {
+                Add(Instr::ABC(Op::kMove, 0, slot, src, 0));
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kIdent &&
+                static_cast<ast::Ident *>(e)->storage.kind == ast::Storage::Kind::kGlobal)
+            {
+                if (src & Instr::kConst)
+                {
+                    int r = Temp();
+                    Add(Instr::ABC(Op::kMove, 0, r, src, 0));
+                    src = r;
+                }
+                Add(Instr::ABx(Op::kSetGlobal, src, static_cast<ast::Ident *>(e)->storage.index));
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kIndexExpr)
+            {
+                // an array in a local register is written without taking addresses
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                int arr = Local(ie->operand.get());
+                if (arr >= 0)
+                {
+                    int i = Operand(ie->index.get());
+                    at = {e->row_number, e->column_number};
+                    Add(Instr::ABC(Op::kSetIndex, 0, arr, i, src));
+                    return;
+                }
+            }
+            int p = Address(e);
+            Add(Instr::ABC(Op::kStore, 0, p, src, 0));
+        }
+
+        // jumps to targets when the condition is when, falls through otherwise
+        void Emitter::Branch(ast::Expr *e, bool when, std::vector<size_t> &targets)
+        {
+            e = Unparen(e);
+            if (constants->IsTrue(e) || constants->IsFalse(e))
+            {
+                if (constants->IsTrue(e) == when)
+                {
+                    targets.push_back(Jump(Op::kJump, 0));
+                }
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kUnaryExpr &&
+                static_cast<ast::UnaryExpr *>(e)->op == CodeType::kLogicNot)
+            {
+                Branch(static_cast<ast::UnaryExpr *>(e)->expr.get(), !when, targets);
+                return;
+            }
+            if (e->node_kind == ast::NodeKind::kBinaryExpr)
+            {
+                auto b = static_cast<ast::BinaryExpr *>(e);
+                // a && b is false when a is, a || b is true when a is
+                bool any = b->op == CodeType::kLogicOr;
+                if (b->op == CodeType::kLogicAnd || b->op == CodeType::kLogicOr)
+                {
+                    if (when == any)
+                    {
+                        Branch(b->left.get(), when, targets);
+                        Branch(b->right.get(), when, targets);
+                        return;
+                    }
+                    std::vector<size_t> skip;
+                    Branch(b->left.get(), !when, skip);
+                    Branch(b->right.get(), when, targets);
+                    for (auto j : skip)
+                    {
+                        Patch(j);
+                    }
+                    return;
+                }
+            }
+            int mark = top;
+            int r = Operand(e);
+            at = {e->row_number, e->column_number};
+            // a compare into a temporary becomes a compare that jumps
+            if (r >= mark && e->node_kind == ast::NodeKind::kBinaryExpr && !proto->code.empty() &&
+                proto->code.back().a == r)
+            {
+                auto &last = proto->code.back();
+                Op fused = Op::kCount;
+                bool swap = false; // not b < c is c <= b for ints
+                switch (last.op)
+                {
+                case Op::kEqI64:
+                    fused = when ? Op::kIfEqI64 : Op::kIfNeI64;
+                    break;
+                case Op::kEqF64:
+                    fused = when ? Op::kIfEqF64 : Op::kIfNeF64;
+                    break;
+                case Op::kNeI64:
+                    fused = when ? Op::kIfNeI64 : Op::kIfEqI64;
+                    break;
+                case Op::kNeF64:
+                    fused = when ? Op::kIfNeF64 : Op::kIfEqF64;
+                    break;
+                case Op::kLtI64:
+                    fused = when ? Op::kIfLtI64 : Op::kIfLeI64;
+                    swap = !when;
+                    break;
+                case Op::kLeI64:
+                    fused = when ? Op::kIfLeI64 : Op::kIfLtI64;
+                    swap = !when;
+                    break;
+                case Op::kLtF64:
+                    fused = when ? Op::kIfLtF64 : Op::kIfNotLtF64;
+                    break;
+                case Op::kLeF64:
+                    fused = when ? Op::kIfLeF64 : Op::kIfNotLeF64;
+                    break;
+                default:
+                    break;
+                }
+                if (fused != Op::kCount)
+                {
+                    last = Instr::ABC(fused, 0, 0, swap ? last.c : last.b, swap ? last.b : last.c);
+                    targets.push_back(Jump(Op::kJump, 0));
+                    top = mark;
+                    return;
+                }
+            }
+            targets.push_back(Jump(when ? Op::kJumpIf : Op::kJumpIfNot, r));
+            top = mark;
+        }
+
+        void Emitter::If(ast::IfStmt *s)
+        {
+            if (constants->IsTrue(s->condition.get()))
+            {
+                Stmt(s->if_block.get());
+                return;
+            }
+            if (constants->IsFalse(s->condition.get()))
+            {
+                if (s->else_block != nullptr)
+                {
+                    Stmt(s->else_block.get());
+                }
+                return;
+            }
+            std::vector<size_t> exits;
+            Branch(s->condition.get(), false, exits);
+            Stmt(s->if_block.get());
+            if (s->else_block != nullptr)
+            {
+                size_t end = Jump(Op::kJump, 0);
+                for (auto j : exits)
+                {
+                    Patch(j);
+                }
+                Stmt(s->else_block.get());
+                Patch(end);
+                return;
+            }
+            for (auto j : exits)
+            {
+                Patch(j);
+            }
+        }
+
+        // the condition is tested at the bottom, an iteration takes a single jump
+        void Emitter::While(ast::WhileStmt *s)
+        {
+            size_t entry = Jump(Op::kJump, 0);
+            size_t body = proto->code.size();
+            loops.emplace_back();
+            Stmt(s->block.get());
+            LoopTest(s->condition.get(), entry, body, entry);
+        }
+
+        void Emitter::For(ast::ForStmt *s)
+        {
+            Stmt(s->init.get());
+            if (Counted(s))
+            {
+                return;
+            }
+            size_t entry = Jump(Op::kJump, 0);
+            size_t body = proto->code.size();
+            loops.emplace_back();
+            Block(s->block.get());
+            size_t post = proto->code.size();
+            Stmt(s->post.get());
+            LoopTest(s->condition.get(), entry, body, post);
+        }
+
+        // for (...; i < n; i += k) with int i, n and k already in registers or
+        // constants: the test is copied in front of the loop, so the bottom is
+        // left with a single FORLT that increments, tests and jumps back
+        bool Emitter::Counted(ast::ForStmt *s)
+        {
+            if (s->post->node_kind != ast::NodeKind::kAssignStmt ||
+                Unparen(s->condition.get())->node_kind != ast::NodeKind::kBinaryExpr)
+            {
+                return false;
+            }
+            auto post = static_cast<ast::AssignStmt *>(s->post.get());
+            auto cond = static_cast<ast::BinaryExpr *>(Unparen(s->condition.get()));
+            if (post->op != CodeType::kAddAssign || post->lhs.size() != 1 || post->rhs.size() != 1 ||
+                (cond->op != CodeType::kLess && cond->op != CodeType::kNotGreater))
+            {
+                return false;
+            }
+            auto counter = post->lhs[0].get();
+            auto step = post->rhs[0].get();
+            auto limit = cond->right.get();
+            int i = Local(counter);
+            if (i < 0 || Local(cond->left.get()) != i || !IsInt(TypeOf(counter)) || !IsInt(TypeOf(step)) ||
+                !IsInt(TypeOf(limit)))
+            {
+                return false;
+            }
+            // both are read again on every iteration, they must not need code
+            for (auto e : {step, limit})
+            {
+                if (Local(e) < 0 && constants->Find(e) == nullptr)
+                {
+                    return false;
+                }
+            }
+            std::vector<size_t> exits;
+            Branch(s->condition.get(), false, exits);
+            size_t body = proto->code.size();
+            loops.emplace_back();
+            Block(s->block.get());
+            size_t next = proto->code.size();
+            at = {post->row_number, post->column_number};
+            Add(Instr::ABC(cond->op == CodeType::kLess ? Op::kForLtI64 : Op::kForLeI64, 0, i, Operand(step), Operand(limit)));
+            Patch(Jump(Op::kJump, 0), body);
+            for (auto j : exits)
+            {
+                Patch(j);
+            }
+            EndLoop(next);
+            return true;
+        }
+
+        // emits the test of a loop whose body starts at body, continue goes to next
+        void Emitter::LoopTest(ast::Expr *condition, size_t entry, size_t body, size_t next)
+        {
+            size_t test = proto->code.size();
+            Patch(entry);
+            std::vector<size_t> back;
+            at = {condition->row_number, condition->column_number};
+            Branch(condition, true, back);
+            for (auto j : back)
+            {
+                Patch(j, body);
+            }
+            EndLoop(next == entry ? test : next);
+        }
+
+        // breaks go to the next instruction, continues to next
+        void Emitter::EndLoop(size_t next)
+        {
+            for (auto j : loops.back().breaks)
+            {
+                Patch(j);
+            }
+            for (auto j : loops.back().continues)
+            {
+                Patch(j, next);
+            }
+            loops.pop_back();
+        }
+
+        void Emitter::Return(ast::RetStmt *s)
+        {
+            auto returns = TypeOf(current->type.get())->Returns();
+            std::vector<Type::Ptr> to(returns.begin(), returns.end());
+            if (s->vals.empty())
+            {
+                Add(Instr::ABC(Op::kReturn0, 0, 0, 0, 0));
+                return;
+            }
+            if (to.size() == 1)
+            {
+                int r = Operand(s->vals[0].get(), to[0]);
+                at = {s->row_number, s->column_number};
+                Add(Instr::ABC(Op::kReturn1, 0, 0, r, 0));
+                return;
+            }
+            int base = top;
+            Values(s->vals, to, base);
+            at = {s->row_number, s->column_number};
+            Add(Instr::ABC(Op::kReturn, 0, base, to.size(), 0));
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef LILANG_RUNTIME_EMITTER
+#define LILANG_RUNTIME_EMITTER
+
+#include <unordered_map>
+#include <unordered_set>
+#include "../compiler/semantic.h"
+#include "./bytecode.h"
+
+/*
+lowering of a checked file to register bytecode
+
+an expression is compiled to an operand: the register of a local or a
+constant when it already is one, a temporary otherwise. a value that has a
+place to go, a local on the left of `=` or the argument of a call, is
+computed right into it. temporaries live from their expression to the end
+of the statement.
+
+the same constructs as in the interpreter are not supported: closures over
+the locals of an enclosing function and imported names.
+*/
+namespace lilang
+{
+    namespace runtime
+    {
+        class Emitter
+        {
+        public:
+            explicit Emitter(compiler::Diagnostics &);
+            // false if the file uses a construct bytecode cannot express
+            bool Emit(const ast::File::Ptr &, ast::SemanticVisitor &, Program &);
+
+        private:
+            struct Loop
+            {
+                std::vector<size_t> breaks;
+                std::vector<size_t> continues;
+            };
+
+            compiler::Diagnostics &diag;
+            const ast::Annotations *annots = nullptr;
+            const ast::ConstantTable *constants = nullptr;
+            Program *prog = nullptr;
+            std::unordered_map<const ast::FuncLit *, Proto *> by_lit;
+            std::unordered_set<uint64_t> addressed; // node id of the function and slot of the locals whose address is taken
+            Proto *proto = nullptr;          // being emitted
+            ast::FuncLit *current = nullptr; // its literal, nullptr for the initializer
+            int top = 0;                     // first free register
+            std::vector<Loop> loops;
+            std::pair<int, int> at; // position of what is emitted
+            bool ok = true;
+
+            ast::Type::Ptr TypeOf(const ast::Node *n) const { return annots->TypeOf(n); }
+            int FrameBase() const { return current == nullptr ? 0 : current->frame_size; } // first temporary
+            void Unsupported(ast::Node *, const string_t &msg);
+            Proto *Declare(ast::FuncLit *, const string_t &name);
+            void EmitBody(Proto *);
+
+            size_t Add(Instr);
+            size_t Jump(Op, int a);
+            void Patch(size_t jump);                 // to the next instruction
+            void Patch(size_t jump, size_t target);
+            int Temp();
+            int Const(Value, ast::Type::Ptr);
+            int Const(const ast::Constant &);
+
+            int Operand(ast::Expr *);
+            int Operand(ast::Expr *, ast::Type::Ptr to);
+            void Into(ast::Expr *, int dst);
+            void Into(ast::Expr *, ast::Type::Ptr to, int dst);
+            void Move(int dst, int src, ast::Type::Ptr from, ast::Type::Ptr to);
+            int Local(ast::Expr *);
+            bool Addressed(ast::Expr *); // a local whose address is taken
+            void Binary(ast::BinaryExpr *, int dst);
+            void Unary(ast::UnaryExpr *, int dst);
+            int Call(ast::CallExpr *);
+            void Values(const ast::Expr::List &, const std::vector<ast::Type::Ptr> &to, int base);
+            int Address(ast::Expr *);
+
+            void Stmt(ast::Stmt *);
+            void Block(ast::Block *);
+            void Declare(ast::VarDecl *);
+            void Assign(ast::AssignStmt *);
+            void Update(ast::AssignStmt *);
+            void Store(ast::Expr *lhs, int src);
+            void Branch(ast::Expr *, bool when, std::vector<size_t> &targets);
+            void If(ast::IfStmt *);
+            void While(ast::WhileStmt *);
+            void For(ast::ForStmt *);
+            bool Counted(ast::ForStmt *);
+            void LoopTest(ast::Expr *condition, size_t entry, size_t body, size_t next);
+            void EndLoop(size_t next);
+            void Return(ast::RetStmt *);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,1226 @@
+#include "./interpreter.h"
+#include "./ops.h"
+
+namespace lilang
+{
+    namespace runtime
+    {
+        using ast::Type;
+        using compiler::CodeType;
+
+        namespace
+        {
+            bool IsInt(Type::Ptr t) { return t->kind == Type::Kind::kInt; }
+            bool IsFloat(Type::Ptr t) { return t->kind == Type::Kind::kFloat; }
+
+            // parens only group, they do not change what an expression is
+            ast::Expr *Unparen(ast::Expr *e)
+            {
+                while (e->node_kind == ast::NodeKind::kParenExpr)
+                {
+                    e = static_cast<ast::ParenExpr *>(e)->expr.get();
+                }
+                return e;
+            }
+        }
+
+        Interpreter::Interpreter()
+        {
+            scratch = Value::Zero();
+        }
+
+        compiler::Diagnostics &Interpreter::Diags()
+        {
+            return diag;
+        }
+
+        void Interpreter::SetLimits(size_t stack_cells, int calls)
+        {
+            stack.assign(stack_cells, Value::Zero());
+            stack_end = stack.data() + stack.size();
+            max_depth = calls;
+        }
+
+        void Interpreter::Unsupported(ast::Node *at, const string_t &msg)
+        {
+            diag.Report(compiler::Phase::kRuntime, at->row_number, at->column_number, msg);
+            loaded = false;
+        }
+
+        // the first error wins, what runs after it until the statement ends is discarded
+        Value Interpreter::Trap(ast::Node *at, const string_t &msg)
+        {
+            if (!trapped)
+            {
+                trapped = true;
+                diag.Report(compiler::Phase::kRuntime, at == nullptr ? 0 : at->row_number,
+                            at == nullptr ? 0 : at->column_number, msg);
+            }
+            return Value::Zero();
+        }
+
+        Array *Interpreter::NewArray()
+        {
+            arrays.emplace_back();
+            return &arrays.back();
+        }
+
+        Value Interpreter::ToInt(double f, ast::Node *at)
+        {
+            if (!(f > -9223372036854775808.0 && f < 9223372036854775808.0))
+            {
+                return Trap(at, "float value out of the int range");
+            }
+            return Value::Int(static_cast<int64_t>(f));
+        }
+
+        //********************************************************************
+        // loading
+        //********************************************************************
+
+        bool Interpreter::Load(const ast::File::Ptr &f, ast::SemanticVisitor &v)
+        {
+            file = f;
+            annots = &v.Annots();
+            constants = &v.Constants();
+            diag.Clear();
+            funcs.clear();
+            bodies.clear();
+            by_lit.clear();
+            inits.clear();
+            strings.clear();
+            arrays.clear();
+            initialized = false;
+            loaded = true;
+            rets.assign(1, Value::Zero()); // a call returns the first result even when there is none
+            if (v.Diags().HasErrors())
+            {
+                Unsupported(f.get(), "a file with errors cannot run");
+                return false;
+            }
+            // compiling and running a node recurses into its children
+            string_t msg;
+            auto deep = ast::TooDeep(f.get(), msg);
+            if (deep != nullptr)
+            {
+                Unsupported(deep, msg);
+                return false;
+            }
+            globals.assign(f->global_count, Value::Zero());
+            // every top level function exists before any body refers to it
+            for (auto &decl : f->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    auto lit = static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get();
+                    Declare(lit, lit->name);
+                }
+            }
+            current = nullptr;
+            for (auto &decl : f->declarations)
+            {
+                if (decl->node_kind == ast::NodeKind::kFuncDecl)
+                {
+                    CompileBody(by_lit[static_cast<ast::FuncDecl *>(decl.get())->fn_lit.get()]);
+                }
+                else
+                {
+                    inits.push_back(Declare(static_cast<ast::VarDecl *>(decl.get())));
+                }
+            }
+            annots = nullptr;
+            constants = nullptr;
+            return loaded;
+        }
+
+        Function *Interpreter::Declare(ast::FuncLit *lit, const string_t &name)
+        {
+            auto t = TypeOf(lit);
+            bodies.emplace_back();
+            funcs.push_back({lit, t, name, lit->frame_size, static_cast<int>(t->Params().size()),
+                             static_cast<int>(t->Returns().size()), &bodies.back()});
+            auto f = &funcs.back();
+            by_lit[lit] = f;
+            if (static_cast<size_t>(f->returns) > rets.size())
+            {
+                rets.resize(f->returns, Value::Zero());
+            }
+            return f;
+        }
+
+        void Interpreter::CompileBody(Function *f)
+        {
+            auto outer = current;
+            current = const_cast<ast::FuncLit *>(f->lit);
+            auto body = Block(current->body.get());
+            *const_cast<Exec *>(static_cast<const Exec *>(f->code)) = body;
+            current = outer;
+        }
+
+        //********************************************************************
+        // running
+        //********************************************************************
+
+        bool Interpreter::Enter(const Function *f, Value *fp, ast::Node *at)
+        {
+            char here;
+            auto native = reinterpret_cast<uintptr_t>(&here);
+            size_t used = native < native_base ? native_base - native : native - native_base;
+            if (fp + f->frame_size > stack_end || depth >= max_depth || used > kNativeStack)
+            {
+                Trap(at, "stack overflow");
+                return false;
+            }
+            return true;
+        }
+
+        Value Interpreter::Invoke(const Function *f, Value *fp)
+        {
+            depth++;
+            (*static_cast<const Exec *>(f->code))(fp);
+            depth--;
+            return rets[0];
+        }
+
+        bool Interpreter::Initialize()
+        {
+            if (!loaded)
+            {
+                return false;
+            }
+            if (stack.empty())
+            {
+                SetLimits(kDefaultStack, max_depth);
+            }
+            trapped = false;
+            depth = 0;
+            char here;
+            native_base = reinterpret_cast<uintptr_t>(&here);
+            if (initialized)
+            {
+                return true;
+            }
+            for (auto &init : inits)
+            {
+                if (init(stack.data()) == Flow::kTrap)
+                {
+                    return false;
+                }
+            }
+            initialized = true;
+            return true;
+        }
+
+        const Function *Interpreter::Find(const string_t &name)
+        {
+            for (auto &f : funcs)
+            {
+                if (f.name == name)
+                {
+                    return &f;
+                }
+            }
+            diag.Report(compiler::Phase::kRuntime, 0, 0, "function " + name + " is not declared");
+            return nullptr;
+        }
+
+        // runs a function on the bottom of the stack
+        bool Interpreter::Execute(const Function *f, const std::vector<Value> &args, std::vector<Value> &results)
+        {
+            if (args.size() != f->params)
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, "function " + f->name + " expects " +
+                                                                 std::to_string(f->params) + " arguments");
+                return false;
+            }
+            auto fp = stack.data();
+            if (!Enter(f, fp, const_cast<ast::FuncLit *>(f->lit)))
+            {
+                return false;
+            }
+            std::copy(args.begin(), args.end(), fp);
+            Invoke(f, fp);
+            if (trapped)
+            {
+                return false;
+            }
+            results.assign(rets.begin(), rets.begin() + f->returns);
+            return true;
+        }
+
+        bool Interpreter::Run(int64_t &result)
+        {
+            result = 0;
+            if (!Initialize())
+            {
+                return false;
+            }
+            auto main = Find("main");
+            std::vector<Value> results;
+            if (main == nullptr || !Execute(main, {}, results))
+            {
+                return false;
+            }
+            if (!results.empty())
+            {
+                auto t = main->type->Returns()[0];
+                result = IsInt(t) ? results[0].i : IsFloat(t) ? static_cast<int64_t>(results[0].f) : results[0].b;
+            }
+            return true;
+        }
+
+        bool Interpreter::Call(const string_t &name, const std::vector<Value> &args, std::vector<Value> &results)
+        {
+            if (!Initialize())
+            {
+                return false;
+            }
+            auto f = Find(name);
+            return f != nullptr && Execute(f, args, results);
+        }
+
+        //********************************************************************
+        // expressions
+        //********************************************************************
+
+        Interpreter::Code Interpreter::Compile(ast::Expr *e)
+        {
+            auto k = constants->Find(e);
+            if (k != nullptr)
+            {
+                auto v = k->kind == Type::Kind::kInt     ? Value::Int(k->i)
+                         : k->kind == Type::Kind::kFloat ? Value::Float(k->f)
+                                                         : Value::Bool(k->b);
+                return [v](Value *) { return v; };
+            }
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+                return Load(static_cast<ast::Ident *>(e));
+            case ast::NodeKind::kBinaryExpr:
+                return Binary(static_cast<ast::BinaryExpr *>(e));
+            case ast::NodeKind::kUnaryExpr:
+                return Unary(static_cast<ast::UnaryExpr *>(e));
+            case ast::NodeKind::kBasicLiteral:
+            {
+                // numbers and bools are constants, what is left is a string
+                strings.push_back(static_cast<ast::BasicLiteral *>(e)->value);
+                auto v = Value::Zero();
+                v.s = &strings.back();
+                return [v](Value *) { return v; };
+            }
+            case ast::NodeKind::kParenExpr:
+                return Compile(static_cast<ast::ParenExpr *>(e)->expr.get());
+            case ast::NodeKind::kCallExpr:
+                return Call(static_cast<ast::CallExpr *>(e));
+            case ast::NodeKind::kIndexExpr:
+                return Index(static_cast<ast::IndexExpr *>(e));
+            case ast::NodeKind::kStarExpr:
+            {
+                auto p = Compile(static_cast<ast::StarExpr *>(e)->expr.get());
+                return [p, e, this](Value *fp) {
+                    auto q = p(fp).p;
+                    return q == nullptr ? Trap(e, "nil pointer dereference") : *q;
+                };
+            }
+            case ast::NodeKind::kFuncLit:
+            {
+                auto f = Declare(static_cast<ast::FuncLit *>(e), "");
+                CompileBody(f);
+                auto v = Value::Zero();
+                v.fn = f;
+                return [v](Value *) { return v; };
+            }
+            default:
+                Unsupported(e, "expression cannot run");
+                return [](Value *) { return Value::Zero(); };
+            }
+        }
+
+        // the value converted to type to, only int and float convert
+        Interpreter::Code Interpreter::As(ast::Expr *e, Type::Ptr to)
+        {
+            auto from = TypeOf(e);
+            if (IsInt(from) && IsFloat(to))
+            {
+                auto c = Compile(e);
+                return [c](Value *fp) { return Value::Float(static_cast<double>(c(fp).i)); };
+            }
+            if (IsFloat(from) && IsInt(to))
+            {
+                auto c = Compile(e);
+                return [c, e, this](Value *fp) { return ToInt(c(fp).f, e); };
+            }
+            return Compile(e);
+        }
+
+        Interpreter::Code Interpreter::Zero(Type::Ptr t)
+        {
+            if (t->kind == Type::Kind::kArray)
+            {
+                return [this](Value *) {
+                    auto v = Value::Zero();
+                    v.a = NewArray();
+                    return v;
+                };
+            }
+            return [](Value *) { return Value::Zero(); };
+        }
+
+        // slot of a local of the function being compiled, -1 for anything else
+        int Interpreter::LocalSlot(ast::Expr *e)
+        {
+            e = Unparen(e);
+            if (e->node_kind != ast::NodeKind::kIdent || constants->Find(e) != nullptr)
+            {
+                return -1;
+            }
+            auto &s = static_cast<ast::Ident *>(e)->storage;
+            return s.kind == ast::Storage::Kind::kLocal && s.func == current ? s.index : -1;
+        }
+
+        Interpreter::Code Interpreter::Load(ast::Ident *id)
+        {
+            auto &s = id->storage;
+            switch (s.kind)
+            {
+            case ast::Storage::Kind::kLocal:
+            {
+                if (s.func != current)
+                {
+                    Unsupported(id, id->name + " is a local of an enclosing function, closures are not supported");
+                    break;
+                }
+                int slot = s.index;
+                return [slot](Value *fp) { return fp[slot]; };
+            }
+            case ast::Storage::Kind::kGlobal:
+            {
+                auto g = &globals[s.index];
+                return [g](Value *) { return *g; };
+            }
+            case ast::Storage::Kind::kFunc:
+            {
+                auto v = Value::Zero();
+                v.fn = by_lit[s.func];
+                return [v](Value *) { return v; };
+            }
+            case ast::Storage::Kind::kExtern:
+                Unsupported(id, "imported " + id->name + " is not linked");
+                break;
+            default:
+                Unsupported(id, id->name + " has no storage");
+            }
+            return [](Value *) { return Value::Zero(); };
+        }
+
+        // int operands, specialized for a constant right side and local slots
+        template <typename Op>
+        Interpreter::Code Interpreter::Ints(ast::Expr *l, ast::Expr *r)
+        {
+            int ls = LocalSlot(l);
+            auto k = constants->Find(r);
+            if (k != nullptr)
+            {
+                int64_t c = k->i;
+                if (ls >= 0)
+                {
+                    return [ls, c](Value *fp) { return Op::Int(fp[ls].i, c); };
+                }
+                auto a = Compile(l);
+                return [a, c](Value *fp) { return Op::Int(a(fp).i, c); };
+            }
+            int rs = LocalSlot(r);
+            if (ls >= 0 && rs >= 0)
+            {
+                return [ls, rs](Value *fp) { return Op::Int(fp[ls].i, fp[rs].i); };
+            }
+            auto a = Compile(l);
+            auto b = Compile(r);
+            // left before right, the order of the arguments of a call is open in c++
+            return [a, b](Value *fp) {
+                auto x = a(fp);
+                auto y = b(fp);
+                return Op::Int(x.i, y.i);
+            };
+        }
+
+        // int or float operands, computed in float
+        template <typename Op>
+        Interpreter::Code Interpreter::Floats(ast::Expr *l, ast::Expr *r)
+        {
+            auto a = As(l, ast::TypeTable::Float());
+            auto k = constants->Find(r);
+            if (k != nullptr)
+            {
+                double c = k->AsFloat();
+                return [a, c](Value *fp) { return Op::Float(a(fp).f, c); };
+            }
+            auto b = As(r, ast::TypeTable::Float());
+            return [a, b](Value *fp) {
+                auto x = a(fp);
+                auto y = b(fp);
+                return Op::Float(x.f, y.f);
+            };
+        }
+
+        Interpreter::Code Interpreter::Binary(ast::BinaryExpr *e)
+        {
+            auto l = e->left.get();
+            auto r = e->right.get();
+            bool ints = IsInt(TypeOf(l)) && IsInt(TypeOf(r));
+            switch (e->op)
+            {
+            case CodeType::kLogicAnd:
+            {
+                auto a = Compile(l);
+                auto b = Compile(r);
+                return [a, b](Value *fp) { return Value::Bool(a(fp).b && b(fp).b); };
+            }
+            case CodeType::kLogicOr:
+            {
+                auto a = Compile(l);
+                auto b = Compile(r);
+                return [a, b](Value *fp) { return Value::Bool(a(fp).b || b(fp).b); };
+            }
+            case CodeType::kEqual:
+            case CodeType::kNotEqual:
+                if (TypeOf(l)->kind == Type::Kind::kBool)
+                {
+                    auto a = Compile(l);
+                    auto b = Compile(r);
+                    if (e->op == CodeType::kEqual)
+                    {
+                        return [a, b](Value *fp) {
+                            auto x = a(fp);
+                            auto y = b(fp);
+                            return Value::Bool(x.b == y.b);
+                        };
+                    }
+                    return [a, b](Value *fp) {
+                        auto x = a(fp);
+                        auto y = b(fp);
+                        return Value::Bool(x.b != y.b);
+                    };
+                }
+                if (e->op == CodeType::kEqual)
+                {
+                    return ints ? Ints<Eq>(l, r) : Floats<Eq>(l, r);
+                }
+                return ints ? Ints<Ne>(l, r) : Floats<Ne>(l, r);
+            case CodeType::kLess:
+                return ints ? Ints<Lt>(l, r) : Floats<Lt>(l, r);
+            case CodeType::kGreater:
+                return ints ? Ints<Gt>(l, r) : Floats<Gt>(l, r);
+            case CodeType::kNotGreater:
+                return ints ? Ints<Le>(l, r) : Floats<Le>(l, r);
+            case CodeType::kNotLess:
+                return ints ? Ints<Ge>(l, r) : Floats<Ge>(l, r);
+            case CodeType::kAdd:
+                return ints ? Ints<Add>(l, r) : Floats<Add>(l, r);
+            case CodeType::kSub:
+                return ints ? Ints<Sub>(l, r) : Floats<Sub>(l, r);
+            case CodeType::kMultiply:
+                return ints ? Ints<Mul>(l, r) : Floats<Mul>(l, r);
+            case CodeType::kDivide:
+            case CodeType::kMod:
+            {
+                if (!ints)
+                {
+                    return Floats<Div>(l, r);
+                }
+                bool div = e->op == CodeType::kDivide;
+                auto k = constants->Find(r);
+                if (k != nullptr && k->i != 0 && k->i != -1)
+                {
+                    return div ? Ints<Div>(l, r) : Ints<Mod>(l, r);
+                }
+                auto a = Compile(l);
+                auto b = Compile(r);
+                return [a, b, div, e, this](Value *fp) {
+                    auto x = a(fp).i;
+                    auto y = b(fp).i;
+                    if (y == 0)
+                    {
+                        return Trap(e, "division by zero");
+                    }
+                    if (y == -1) // INT64_MIN / -1 wraps around
+                    {
+                        return Value::Int(div ? static_cast<int64_t>(0 - static_cast<uint64_t>(x)) : 0);
+                    }
+                    return Value::Int(div ? x / y : x % y);
+                };
+            }
+            case CodeType::kBitsAnd:
+                return Ints<And>(l, r);
+            case CodeType::kBitsOr:
+                return Ints<Or>(l, r);
+            case CodeType::kBitsXor:
+                return Ints<Xor>(l, r);
+            default:
+                Unsupported(e, "operator cannot run");
+                return [](Value *) { return Value::Zero(); };
+            }
+        }
+
+        Interpreter::Code Interpreter::Unary(ast::UnaryExpr *e)
+        {
+            auto x = e->expr.get();
+            switch (e->op)
+            {
+            case CodeType::kAdd:
+                return Compile(x);
+            case CodeType::kSub:
+            {
+                auto a = Compile(x);
+                if (IsInt(TypeOf(x)))
+                {
+                    return [a](Value *fp) { return Value::Int(static_cast<int64_t>(0 - static_cast<uint64_t>(a(fp).i))); };
+                }
+                return [a](Value *fp) { return Value::Float(-a(fp).f); };
+            }
+            case CodeType::kBitsXor:
+            {
+                auto a = Compile(x);
+                return [a](Value *fp) { return Value::Int(~a(fp).i); };
+            }
+            case CodeType::kLogicNot:
+            {
+                auto a = Compile(x);
+                return [a](Value *fp) { return Value::Bool(!a(fp).b); };
+            }
+            case CodeType::kBitsAnd:
+            {
+                auto r = Address(x);
+                return [r](Value *fp) {
+                    auto v = Value::Zero();
+                    v.p = r(fp);
+                    return v;
+                };
+            }
+            default:
+                Unsupported(e, "operator cannot run");
+                return [](Value *) { return Value::Zero(); };
+            }
+        }
+
+        Interpreter::Code Interpreter::Index(ast::IndexExpr *e)
+        {
+            auto a = Compile(e->operand.get());
+            auto i = Compile(e->index.get());
+            return [a, i, e, this](Value *fp) {
+                auto arr = a(fp).a;
+                auto k = i(fp).i;
+                if (arr == nullptr || k < 0 || static_cast<uint64_t>(k) >= arr->elems.size())
+                {
+                    return Trap(e, "index out of range");
+                }
+                return arr->elems[k];
+            };
+        }
+
+        // a call leaves all its results in rets and returns the first one,
+        // a direct call of a top level function skips loading the callee
+        Interpreter::Code Interpreter::Call(ast::CallExpr *e)
+        {
+            auto callee = e->expr.get();
+            auto t = TypeOf(callee);
+            if (annots->KindOf(callee) == ast::Obj::Kind::kType)
+            {
+                return As(e->args[0].get(), t);
+            }
+            auto params = t->Params();
+            std::vector<Type::Ptr> to(params.begin(), params.end());
+            const Function *direct = nullptr;
+            auto target = Unparen(callee);
+            if (target->node_kind == ast::NodeKind::kIdent &&
+                static_cast<ast::Ident *>(target)->storage.kind == ast::Storage::Kind::kFunc)
+            {
+                direct = by_lit[static_cast<ast::Ident *>(target)->storage.func];
+            }
+            int frame = FrameSize();
+            bool spread = e->args.size() != to.size();
+            if (direct != nullptr && !spread && to.size() == 0)
+            {
+                return [direct, frame, e, this](Value *fp) {
+                    auto nfp = fp + frame;
+                    return Enter(direct, nfp, e) ? Invoke(direct, nfp) : Value::Zero();
+                };
+            }
+            if (direct != nullptr && !spread && to.size() == 1)
+            {
+                auto a0 = As(e->args[0].get(), to[0]);
+                return [direct, a0, frame, e, this](Value *fp) {
+                    auto v0 = a0(fp);
+                    auto nfp = fp + frame;
+                    if (!Enter(direct, nfp, e))
+                    {
+                        return Value::Zero();
+                    }
+                    nfp[0] = v0;
+                    return Invoke(direct, nfp);
+                };
+            }
+            if (direct != nullptr && !spread && to.size() == 2)
+            {
+                auto a0 = As(e->args[0].get(), to[0]);
+                auto a1 = As(e->args[1].get(), to[1]);
+                return [direct, a0, a1, frame, e, this](Value *fp) {
+                    auto v0 = a0(fp);
+                    auto v1 = a1(fp);
+                    auto nfp = fp + frame;
+                    if (!Enter(direct, nfp, e))
+                    {
+                        return Value::Zero();
+                    }
+                    nfp[0] = v0;
+                    nfp[1] = v1;
+                    return Invoke(direct, nfp);
+                };
+            }
+            Code fn;
+            if (direct == nullptr)
+            {
+                fn = Compile(callee);
+            }
+            auto args = Values(e->args, to);
+            size_t n = to.size();
+            return [direct, fn, args, n, frame, e, this](Value *fp) {
+                auto f = direct;
+                if (f == nullptr)
+                {
+                    f = fn(fp).fn;
+                    if (f == nullptr)
+                    {
+                        return Trap(e, "call of a nil function");
+                    }
+                }
+                // arguments may call functions whose frames start at nfp too
+                Value small[8];
+                std::vector<Value> big;
+                auto tmp = small;
+                if (n > 8)
+                {
+                    big.resize(n);
+                    tmp = big.data();
+                }
+                args(fp, tmp);
+                auto nfp = fp + frame;
+                if (!Enter(f, nfp, e))
+                {
+                    return Value::Zero();
+                }
+                std::copy(tmp, tmp + n, nfp);
+                return Invoke(f, nfp);
+            };
+        }
+
+        // the values of a list converted to the types in to, either one value
+        // per type or a single call whose results are spread
+        Interpreter::Many Interpreter::Values(const ast::Expr::List &list, const std::vector<Type::Ptr> &to)
+        {
+            if (list.size() != to.size())
+            {
+                auto call = Compile(list[0].get());
+                auto vals = TypeOf(list[0].get())->Vals();
+                std::vector<int> casts; // 1 int to float, 2 float to int
+                for (size_t i = 0; i < to.size(); i++)
+                {
+                    casts.push_back(IsInt(vals[i]) && IsFloat(to[i]) ? 1 : IsFloat(vals[i]) && IsInt(to[i]) ? 2 : 0);
+                }
+                auto at = list[0].get();
+                return [call, casts, at, this](Value *fp, Value *out) {
+                    call(fp);
+                    for (size_t i = 0; i < casts.size(); i++)
+                    {
+                        out[i] = casts[i] == 0 ? rets[i] : casts[i] == 1 ? Value::Float(static_cast<double>(rets[i].i))
+                                                                          : ToInt(rets[i].f, at);
+                    }
+                };
+            }
+            std::vector<Code> codes;
+            for (size_t i = 0; i < to.size(); i++)
+            {
+                codes.push_back(As(list[i].get(), to[i]));
+            }
+            return [codes](Value *fp, Value *out) {
+                for (size_t i = 0; i < codes.size(); i++)
+                {
+                    out[i] = codes[i](fp);
+                }
+            };
+        }
+
+        // assigning through a reference to an array element past the end grows
+        // the array, a nil array on the way is created
+        Interpreter::Ref Interpreter::Address(ast::Expr *e)
+        {
+            e = Unparen(e);
+            switch (e->node_kind)
+            {
+            case ast::NodeKind::kIdent:
+            {
+                auto id = static_cast<ast::Ident *>(e);
+                auto &s = id->storage;
+                if (s.kind == ast::Storage::Kind::kLocal && s.func == current)
+                {
+                    int slot = s.index;
+                    return [slot](Value *fp) { return fp + slot; };
+                }
+                if (s.kind == ast::Storage::Kind::kGlobal)
+                {
+                    auto g = &globals[s.index];
+                    return [g](Value *) { return g; };
+                }
+                Load(id); // reports why
+                return [this](Value *) { return &scratch; };
+            }
+            case ast::NodeKind::kStarExpr:
+            {
+                auto p = Compile(static_cast<ast::StarExpr *>(e)->expr.get());
+                return [p, e, this](Value *fp) {
+                    auto q = p(fp).p;
+                    if (q == nullptr)
+                    {
+                        Trap(e, "nil pointer dereference");
+                        return &scratch;
+                    }
+                    return q;
+                };
+            }
+            case ast::NodeKind::kIndexExpr:
+            {
+                auto ie = static_cast<ast::IndexExpr *>(e);
+                auto operand = ie->operand.get();
+                auto i = Compile(ie->index.get());
+                Ref base;
+                Code value;
+                if (ast::Obj::Addressable(annots->KindOf(operand)))
+                {
+                    base = Address(operand);
+                }
+                else
+                {
+                    value = Compile(operand);
+                }
+                return [base, value, i, e, this](Value *fp) {
+                    Array *arr;
+                    if (base)
+                    {
+                        auto slot = base(fp);
+                        if (slot->a == nullptr && !trapped)
+                        {
+                            slot->a = NewArray();
+                        }
+                        arr = slot->a;
+                    }
+                    else
+                    {
+                        arr = value(fp).a;
+                    }
+                    auto k = i(fp).i;
+                    if (arr == nullptr || k < 0 || k >= Array::kMaxLength)
+                    {
+                        Trap(e, "index out of range");
+                        return &scratch;
+                    }
+                    if (static_cast<uint64_t>(k) >= arr->elems.size())
+                    {
+                        arr->elems.resize(k + 1, Value::Zero());
+                    }
+                    return &arr->elems[k];
+                };
+            }
+            default:
+                Unsupported(e, "expression is not assignable");
+                return [this](Value *) { return &scratch; };
+            }
+        }
+
+        //********************************************************************
+        // statements
+        //********************************************************************
+
+        Interpreter::Exec Interpreter::Compile(ast::Stmt *s)
+        {
+            switch (s->node_kind)
+            {
+            case ast::NodeKind::kBlock:
+                return Block(static_cast<ast::Block *>(s));
+            case ast::NodeKind::kExprStmt:
+            {
+                auto c = Compile(static_cast<ast::ExprStmt *>(s)->expr.get());
+                return [c, this](Value *fp) {
+                    c(fp);
+                    return trapped ? Flow::kTrap : Flow::kNext;
+                };
+            }
+            case ast::NodeKind::kDeclStmt:
+                return Declare(static_cast<ast::VarDecl *>(static_cast<ast::DeclStmt *>(s)->decl.get()));
+            case ast::NodeKind::kAssignStmt:
+                return Assign(static_cast<ast::AssignStmt *>(s));
+            case ast::NodeKind::kIfStmt:
+                return If(static_cast<ast::IfStmt *>(s));
+            case ast::NodeKind::kWhileStmt:
+                return While(static_cast<ast::WhileStmt *>(s));
+            case ast::NodeKind::kForStmt:
+                return For(static_cast<ast::ForStmt *>(s));
+            case ast::NodeKind::kRetStmt:
+                return Return(static_cast<ast::RetStmt *>(s));
+            case ast::NodeKind::kEmptyStmt:
+                return [](Value *) { return Flow::kNext; };
+            case ast::NodeKind::kBreakStmt:
+                return [](Value *) { return Flow::kBreak; };
+            case ast::NodeKind::kContinueStmt:
+                return [](Value *) { return Flow::kContinue; };
+            default:
+                Unsupported(s, "statement cannot run");
+                return [](Value *) { return Flow::kNext; };
+            }
+        }
+
+        Interpreter::Exec Interpreter::Block(ast::Block *b)
+        {
+            std::vector<Exec> list;
+            for (auto &s : b->stmts)
+            {
+                list.push_back(Compile(s.get()));
+            }
+            switch (list.size())
+            {
+            case 0:
+                return [](Value *) { return Flow::kNext; };
+            case 1:
+                return list[0];
+            case 2:
+            {
+                auto a = list[0];
+                auto b = list[1];
+                return [a, b](Value *fp) {
+                    auto f = a(fp);
+                    return f != Flow::kNext ? f : b(fp);
+                };
+            }
+            default:
+                return [list](Value *fp) {
+                    for (auto &s : list)
+                    {
+                        auto f = s(fp);
+                        if (f != Flow::kNext)
+                        {
+                            return f;
+                        }
+                    }
+                    return Flow::kNext;
+                };
+            }
+        }
+
+        // locals go to the slots of the frame, top level names to the globals
+        Interpreter::Exec Interpreter::Declare(ast::VarDecl *decl)
+        {
+            int n = decl->names.size();
+            int first = decl->first_slot;
+            bool global = current == nullptr;
+            auto g = global ? globals.data() + first : nullptr;
+            if (decl->type != nullptr)
+            {
+                auto z = Zero(annots->TypeOf(decl->type.get()));
+                return [z, n, first, g, this](Value *fp) {
+                    auto out = g != nullptr ? g : fp + first;
+                    for (int i = 0; i < n; i++)
+                    {
+                        out[i] = z(fp);
+                    }
+                    return Flow::kNext;
+                };
+            }
+            if (n == 1 && decl->vals.size() == 1 && !global)
+            {
+                auto c = Compile(decl->vals[0].get());
+                return [c, first, this](Value *fp) {
+                    fp[first] = c(fp);
+                    return trapped ? Flow::kTrap : Flow::kNext;
+                };
+            }
+            std::vector<Type::Ptr> to;
+            if (decl->vals.size() != n)
+            {
+                auto vals = TypeOf(decl->vals[0].get())->Vals();
+                to.assign(vals.begin(), vals.end());
+            }
+            else
+            {
+                for (auto &v : decl->vals)
+                {
+                    to.push_back(TypeOf(v.get()));
+                }
+            }
+            // the names are new, no value reads them, so they are written in place
+            auto m = Values(decl->vals, to);
+            return [m, first, g, this](Value *fp) {
+                m(fp, g != nullptr ? g : fp + first);
+                return trapped ? Flow::kTrap : Flow::kNext;
+            };
+        }
+
+        // x is read before y is computed, as on the other engines
+        template <typename Op>
+        Interpreter::Exec Interpreter::UpdateInt(Ref r, Code v)
+        {
+            return [r, v, this](Value *fp) {
+                auto p = r(fp);
+                auto x = p->i;
+                auto y = v(fp);
+                *p = Op::Int(x, y.i);
+                return trapped ? Flow::kTrap : Flow::kNext;
+            };
+        }
+
+        // x op= y with a float on either side, computed in float and stored as x's type
+        template <typename Op>
+        Interpreter::Exec Interpreter::UpdateFloat(ast::AssignStmt *s, Ref r, Code v)
+        {
+            bool li = IsInt(TypeOf(s->lhs[0].get()));
+            return [li, r, v, s, this](Value *fp) {
+                auto p = r(fp);
+                auto x = li ? static_cast<double>(p->i) : p->f;
+                auto y = Op::Float(x, v(fp).f).f;
+                *p = li ? ToInt(y, s) : Value::Float(y);
+                return trapped ? Flow::kTrap : Flow::kNext;
+            };
+        }
+
+        Interpreter::Exec Interpreter::Assign(ast::AssignStmt *s)
+        {
+            auto &lhs = s->lhs;
+            auto &rhs = s->rhs;
+            if (s->op != CodeType::kAssign)
+            {
+                auto l = lhs[0].get();
+                auto r = rhs[0].get();
+                bool ints = IsInt(TypeOf(l)) && IsInt(TypeOf(r));
+                int slot = LocalSlot(l);
+                auto k = constants->Find(r);
+                // i += 1 and the like
+                if (ints && slot >= 0 && k != nullptr && (s->op == CodeType::kAddAssign || s->op == CodeType::kSubAssign))
+                {
+                    auto c = s->op == CodeType::kAddAssign ? k->i : static_cast<int64_t>(0 - static_cast<uint64_t>(k->i));
+                    return [slot, c](Value *fp) {
+                        fp[slot] = Add::Int(fp[slot].i, c);
+                        return Flow::kNext;
+                    };
+                }
+                auto ref = Address(l);
+                auto v = ints ? Compile(r) : As(r, ast::TypeTable::Float());
+                switch (s->op)
+                {
+                case CodeType::kAddAssign:
+                    return ints ? UpdateInt<Add>(ref, v) : UpdateFloat<Add>(s, ref, v);
+                case CodeType::kSubAssign:
+                    return ints ? UpdateInt<Sub>(ref, v) : UpdateFloat<Sub>(s, ref, v);
+                case CodeType::kMulAssign:
+                    return ints ? UpdateInt<Mul>(ref, v) : UpdateFloat<Mul>(s, ref, v);
+                case CodeType::kDivAssign:
+                    if (!ints)
+                    {
+                        return UpdateFloat<Div>(s, ref, v);
+                    }
+                    return [ref, v, s, this](Value *fp) {
+                        auto y = v(fp).i;
+                        auto p = ref(fp);
+                        if (y == 0)
+                        {
+                            Trap(s, "division by zero");
+                            return Flow::kTrap;
+                        }
+                        p->i = y == -1 ? static_cast<int64_t>(0 - static_cast<uint64_t>(p->i)) : p->i / y;
+                        return trapped ? Flow::kTrap : Flow::kNext;
+                    };
+                case CodeType::kBitsAndAssign:
+                    return UpdateInt<And>(ref, v);
+                case CodeType::kBitsOrAssign:
+                    return UpdateInt<Or>(ref, v);
+                case CodeType::kBitsXorAssign:
+                    return UpdateInt<Xor>(ref, v);
+                default:
+                    Unsupported(s, "operator cannot run");
+                    return [](Value *) { return Flow::kNext; };
+                }
+            }
+            if (lhs.size() == 1 && rhs.size() == 1)
+            {
+                auto c = As(rhs[0].get(), TypeOf(lhs[0].get()));
+                int slot = LocalSlot(lhs[0].get());
+                if (slot >= 0)
+                {
+                    return [slot, c, this](Value *fp) {
+                        fp[slot] = c(fp);
+                        return trapped ? Flow::kTrap : Flow::kNext;
+                    };
+                }
+                auto ref = Address(lhs[0].get());
+                return [ref, c, this](Value *fp) {
+                    auto v = c(fp);
+                    *ref(fp) = v;
+                    return trapped ? Flow::kTrap : Flow::kNext;
+                };
+            }
+            // every value is computed before anything is assigned, so a, b = b, a swaps
+            std::vector<Type::Ptr> to;
+            std::vector<Ref> refs;
+            for (auto &l : lhs)
+            {
+                to.push_back(TypeOf(l.get()));
+                refs.push_back(Address(l.get()));
+            }
+            auto m = Values(rhs, to);
+            return [m, refs, this](Value *fp) {
+                Value small[8];
+                std::vector<Value> big;
+                auto tmp = small;
+                if (refs.size() > 8)
+                {
+                    big.resize(refs.size());
+                    tmp = big.data();
+                }
+                m(fp, tmp);
+                for (size_t i = 0; i < refs.size(); i++)
+                {
+                    *refs[i](fp) = tmp[i];
+                }
+                return trapped ? Flow::kTrap : Flow::kNext;
+            };
+        }
+
+        Interpreter::Exec Interpreter::If(ast::IfStmt *s)
+        {
+            auto then = Compile(s->if_block.get());
+            Exec other = [](Value *) { return Flow::kNext; };
+            if (s->else_block != nullptr)
+            {
+                other = Compile(s->else_block.get());
+            }
+            if (constants->IsTrue(s->condition.get()))
+            {
+                return then;
+            }
+            if (constants->IsFalse(s->condition.get()))
+            {
+                return other;
+            }
+            auto c = Compile(s->condition.get());
+            return [c, then, other, this](Value *fp) {
+                auto b = c(fp).b;
+                if (trapped)
+                {
+                    return Flow::kTrap;
+                }
+                return b ? then(fp) : other(fp);
+            };
+        }
+
+        Interpreter::Exec Interpreter::While(ast::WhileStmt *s)
+        {
+            auto c = Compile(s->condition.get());
+            auto body = Compile(s->block.get());
+            return [c, body, this](Value *fp) {
+                while (true)
+                {
+                    auto b = c(fp).b;
+                    if (trapped)
+                    {
+                        return Flow::kTrap;
+                    }
+                    if (!b)
+                    {
+                        return Flow::kNext;
+                    }
+                    auto f = body(fp);
+                    if (f == Flow::kBreak)
+                    {
+                        return Flow::kNext;
+                    }
+                    if (f == Flow::kReturn || f == Flow::kTrap)
+                    {
+                        return f;
+                    }
+                }
+            };
+        }
+
+        Interpreter::Exec Interpreter::For(ast::ForStmt *s)
+        {
+            auto init = Compile(s->init.get());
+            auto c = Compile(s->condition.get());
+            auto post = Compile(s->post.get());
+            auto body = Block(s->block.get());
+            return [init, c, post, body, this](Value *fp) {
+                auto f = init(fp);
+                if (f != Flow::kNext)
+                {
+                    return f;
+                }
+                while (true)
+                {
+                    auto b = c(fp).b;
+                    if (trapped)
+                    {
+                        return Flow::kTrap;
+                    }
+                    if (!b)
+                    {
+                        return Flow::kNext;
+                    }
+                    f = body(fp);
+                    if (f == Flow::kBreak)
+                    {
+                        return Flow::kNext;
+                    }
+                    if (f == Flow::kReturn || f == Flow::kTrap)
+                    {
+                        return f;
+                    }
+                    if (post(fp) == Flow::kTrap)
+                    {
+                        return Flow::kTrap;
+                    }
+                }
+            };
+        }
+
+        Interpreter::Exec Interpreter::Return(ast::RetStmt *s)
+        {
+            auto returns = TypeOf(current->type.get())->Returns();
+            std::vector<Type::Ptr> to(returns.begin(), returns.end());
+            if (s->vals.empty())
+            {
+                return [](Value *) { return Flow::kReturn; };
+            }
+            if (to.size() == 1)
+            {
+                auto c = As(s->vals[0].get(), to[0]);
+                return [c, this](Value *fp) {
+                    rets[0] = c(fp);
+                    return trapped ? Flow::kTrap : Flow::kReturn;
+                };
+            }
+            // a value may call a function that overwrites rets
+            auto m = Values(s->vals, to);
+            size_t n = to.size();
+            return [m, n, this](Value *fp) {
+                Value small[8];
+                std::vector<Value> big;
+                auto tmp = small;
+                if (n > 8)
+                {
+                    big.resize(n);
+                    tmp = big.data();
+                }
+                m(fp, tmp);
+                std::copy(tmp, tmp + n, rets.begin());
+                return trapped ? Flow::kTrap : Flow::kReturn;
+            };
+        }
+    }
+}
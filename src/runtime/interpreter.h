@@ -0,0 +1,139 @@
+#ifndef LILANG_RUNTIME_INTERPRETER
+#define LILANG_RUNTIME_INTERPRETER
+
+#include <functional>
+#include <unordered_map>
+#include "../compiler/semantic.h"
+#include "./value.h"
+
+/*
+closure compiling interpreter
+
+every node of a checked file is turned once into a C++ closure that already
+knows the types of its operands and where its names live: an int add of a
+slot and a constant, a float compare, a load of local slot 3. running the
+program only calls closures, it never looks at a node kind or a type again.
+
+a call puts the frame of the callee right after the frame of the caller on
+one contiguous stack of cells, the arguments in its first slots. results
+go through a small register file, so a single result is read right back.
+each call also nests native calls of the closures, the stack overflows when
+the cells run out, when calls nest too deep or when the native stack in use
+passes kNativeStack, whichever comes first: a native frame grows a lot in
+an unoptimized build.
+
+runtime errors (division by zero, index out of range, nil pointer, stack
+overflow) stop the program: the closure that hits one records it and
+yields a zero value, every statement checks for it on its way out.
+
+the runtime is an arena, arrays live until the interpreter is destroyed.
+closures over the locals of an enclosing function and imported names are
+not supported, a file using them does not load.
+*/
+namespace lilang
+{
+    namespace runtime
+    {
+        class Interpreter
+        {
+        public:
+            static const size_t kDefaultStack = 1 << 20; // cells
+            static const int kDefaultDepth = 10000;      // nested calls
+            static const size_t kNativeStack = 4 << 20;  // bytes of the native stack the calls may use
+
+            Interpreter();
+            Interpreter(const Interpreter &) = delete;
+            // compiles a file the visitor checked without errors
+            bool Load(const ast::File::Ptr &, ast::SemanticVisitor &);
+            // initializes the globals once and calls main, result is what main
+            // returns, 0 if it returns nothing
+            bool Run(int64_t &result);
+            // calls a top level function, results gets its return values
+            bool Call(const string_t &name, const std::vector<Value> &args, std::vector<Value> &results);
+            void SetLimits(size_t stack_cells, int depth);
+            compiler::Diagnostics &Diags();
+
+        private:
+            enum class Flow
+            {
+                kNext,
+                kBreak,
+                kContinue,
+                kReturn,
+                kTrap,
+            };
+            typedef std::function<Value(Value *)> Code;   // an expression, gets the frame
+            typedef std::function<Value *(Value *)> Ref;  // where an assignable expression lives
+            typedef std::function<Flow(Value *)> Exec;    // a statement
+            typedef std::function<void(Value *, Value *)> Many; // values of a list into the second cells
+
+            ast::File::Ptr file;
+            const ast::Annotations *annots = nullptr;
+            const ast::ConstantTable *constants = nullptr;
+            compiler::Diagnostics diag;
+            std::deque<Function> funcs;
+            std::deque<Exec> bodies;
+            std::unordered_map<const ast::FuncLit *, Function *> by_lit;
+            std::vector<Exec> inits; // global declarations in order
+            bool initialized = false;
+            std::vector<Value> globals;
+            std::vector<Value> stack;
+            Value *stack_end = nullptr;
+            int depth = 0;
+            int max_depth = kDefaultDepth;
+            uintptr_t native_base = 0; // address on the native stack where the program started
+            std::vector<Value> rets; // results of the last return, room for the most a function has
+            std::deque<Array> arrays;
+            std::deque<string_t> strings;
+            Value scratch; // written through a failed reference
+            bool trapped = false;
+            bool loaded = false;
+            ast::FuncLit *current = nullptr; // function being compiled
+
+            ast::Type::Ptr TypeOf(const ast::Node *n) const { return annots->TypeOf(n); }
+            void Unsupported(ast::Node *at, const string_t &msg);
+            Value Trap(ast::Node *at, const string_t &msg);
+            Array *NewArray();
+            Value ToInt(double, ast::Node *at);
+            int FrameSize() const { return current == nullptr ? 0 : current->frame_size; }
+            bool Enter(const Function *, Value *fp, ast::Node *at);
+            Value Invoke(const Function *, Value *fp);
+            bool Initialize();
+            const Function *Find(const string_t &name);
+            bool Execute(const Function *, const std::vector<Value> &args, std::vector<Value> &results);
+
+            Function *Declare(ast::FuncLit *, const string_t &name);
+            void CompileBody(Function *);
+            Code Compile(ast::Expr *);
+            Code As(ast::Expr *, ast::Type::Ptr to);
+            Code Zero(ast::Type::Ptr);
+            Code Load(ast::Ident *);
+            Code Binary(ast::BinaryExpr *);
+            Code Unary(ast::UnaryExpr *);
+            Code Call(ast::CallExpr *);
+            Code Index(ast::IndexExpr *);
+            Ref Address(ast::Expr *);
+            Many Values(const ast::Expr::List &, const std::vector<ast::Type::Ptr> &to);
+            int LocalSlot(ast::Expr *);
+            template <typename Op>
+            Code Ints(ast::Expr *, ast::Expr *);
+            template <typename Op>
+            Code Floats(ast::Expr *, ast::Expr *);
+
+            Exec Compile(ast::Stmt *);
+            Exec Block(ast::Block *);
+            Exec Declare(ast::VarDecl *);
+            Exec Assign(ast::AssignStmt *);
+            template <typename Op>
+            Exec UpdateInt(Ref, Code);
+            template <typename Op>
+            Exec UpdateFloat(ast::AssignStmt *, Ref, Code);
+            Exec If(ast::IfStmt *);
+            Exec While(ast::WhileStmt *);
+            Exec For(ast::ForStmt *);
+            Exec Return(ast::RetStmt *);
+        };
+    }
+}
+
+#endif
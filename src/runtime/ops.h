@@ -0,0 +1,81 @@
+#ifndef LILANG_RUNTIME_OPS
+#define LILANG_RUNTIME_OPS
+
+#include "./value.h"
+
+namespace lilang
+{
+    namespace runtime
+    {
+        // operators on unboxed operands shared by the engines, ints wrap around
+        struct Add
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b))); }
+            static Value Float(double a, double b) { return Value::Float(a + b); }
+        };
+        struct Sub
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b))); }
+            static Value Float(double a, double b) { return Value::Float(a - b); }
+        };
+        struct Mul
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b))); }
+            static Value Float(double a, double b) { return Value::Float(a * b); }
+        };
+        struct Div
+        {
+            // the divisor is known not to be 0 or -1
+            static Value Int(int64_t a, int64_t b) { return Value::Int(a / b); }
+            static Value Float(double a, double b) { return Value::Float(a / b); }
+        };
+        struct Mod
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(a % b); }
+        };
+        struct And
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(a & b); }
+        };
+        struct Or
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(a | b); }
+        };
+        struct Xor
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Int(a ^ b); }
+        };
+        struct Eq
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a == b); }
+            static Value Float(double a, double b) { return Value::Bool(a == b); }
+        };
+        struct Ne
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a != b); }
+            static Value Float(double a, double b) { return Value::Bool(a != b); }
+        };
+        struct Lt
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a < b); }
+            static Value Float(double a, double b) { return Value::Bool(a < b); }
+        };
+        struct Gt
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a > b); }
+            static Value Float(double a, double b) { return Value::Bool(a > b); }
+        };
+        struct Le
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a <= b); }
+            static Value Float(double a, double b) { return Value::Bool(a <= b); }
+        };
+        struct Ge
+        {
+            static Value Int(int64_t a, int64_t b) { return Value::Bool(a >= b); }
+            static Value Float(double a, double b) { return Value::Bool(a >= b); }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef LILANG_RUNTIME_VALUE
+#define LILANG_RUNTIME_VALUE
+
+#include <cstdint>
+#include <deque>
+#include "../compiler/ast.h"
+
+/*
+run time values shared by the execution engines
+
+a value is an untyped 8 byte cell, the code working on it knows its type
+from the semantic pass. zero bits are the zero value of every type: 0,
+0.0, false, and nil for strings, arrays, pointers and functions.
+
+arrays grow when an element past the end is assigned and keep their
+elements in place while growing, so a pointer to an element stays valid.
+*/
+namespace lilang
+{
+    namespace runtime
+    {
+        struct Array;
+        struct Function;
+
+        union Value
+        {
+            int64_t i;
+            double f;
+            bool b;
+            const string_t *s;
+            Array *a;
+            Value *p;
+            const Function *fn;
+
+            static Value Zero()
+            {
+                Value v;
+                v.i = 0;
+                return v;
+            }
+            static Value Int(int64_t x)
+            {
+                Value v;
+                v.i = x;
+                return v;
+            }
+            static Value Float(double x)
+            {
+                Value v;
+                v.f = x;
+                return v;
+            }
+            static Value Bool(bool x)
+            {
+                Value v;
+                v.i = 0;
+                v.b = x;
+                return v;
+            }
+        };
+
+        struct Array
+        {
+            static const int64_t kMaxLength = int64_t(1) << 24; // growing past it is an index error
+
+            std::deque<Value> elems;
+        };
+
+        // a function as a value, code is what the engine runs for it
+        struct Function
+        {
+            const ast::FuncLit *lit;
+            ast::Type::Ptr type;
+            string_t name; // empty for a literal
+            int frame_size; // cells of params and locals
+            int params;
+            int returns;
+            const void *code;
+        };
+    }
+}
+
+#endif
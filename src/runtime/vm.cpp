@@ -0,0 +1,545 @@
+#include <algorithm>
+#include "./vm.h"
+#include "./emitter.h"
+#include "./ops.h"
+
+#if defined(__GNUC__) && !defined(lilang_switch_dispatch)
+#define lilang_threaded
+#endif
+
+namespace lilang
+{
+    namespace runtime
+    {
+        namespace
+        {
+            // a register or a constant
+            inline Value RK(const Value *fp, const Value *k, uint16_t x)
+            {
+                return x & Instr::kConst ? k[x & ~Instr::kConst] : fp[x];
+            }
+
+            inline bool InIntRange(double f)
+            {
+                return f > -9223372036854775808.0 && f < 9223372036854775808.0;
+            }
+        }
+
+        VM::VM() {}
+
+        compiler::Diagnostics &VM::Diags()
+        {
+            return diag;
+        }
+
+        const Program &VM::Code() const
+        {
+            return prog;
+        }
+
+        void VM::SetLimits(size_t stack_cells, int depth)
+        {
+            stack.assign(stack_cells, Value::Zero());
+            stack_end = stack.data() + stack.size();
+            max_depth = depth;
+        }
+
+        Array *VM::NewArray()
+        {
+            arrays.emplace_back();
+            return &arrays.back();
+        }
+
+        bool VM::Load(const ast::File::Ptr &f, ast::SemanticVisitor &v)
+        {
+            file = f;
+            diag.Clear();
+            prog = Program();
+            compiled.clear();
+            arrays.clear();
+            initialized = false;
+            loaded = false;
+            if (v.Diags().HasErrors())
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, "a file with errors cannot run");
+                return false;
+            }
+            Emitter emitter(diag);
+            if (!emitter.Emit(f, v, prog))
+            {
+                return false;
+            }
+            for (auto &p : prog.protos)
+            {
+                Compiled c{&p, {}};
+                for (auto &in : p.code)
+                {
+                    c.code.push_back({nullptr, in});
+                }
+                compiled.push_back(std::move(c));
+            }
+            Thread();
+            globals.assign(prog.global_count, Value::Zero());
+            loaded = true;
+            return true;
+        }
+
+        // points every instruction at its handler, or at the profiler
+        void VM::Thread()
+        {
+#ifdef lilang_threaded
+            if (labels == nullptr)
+            {
+                Execute(nullptr, nullptr);
+            }
+            for (auto &c : compiled)
+            {
+                for (auto &slot : c.code)
+                {
+                    slot.label = labels[profiling ? static_cast<int>(Op::kCount) : static_cast<int>(slot.in.op)];
+                }
+            }
+#endif
+        }
+
+        void VM::SetProfile(bool on)
+        {
+            profiling = on;
+            pairs.assign(static_cast<size_t>(Op::kCount) * static_cast<size_t>(Op::kCount), 0);
+            Thread();
+        }
+
+        std::vector<VM::Pair> VM::Pairs() const
+        {
+            std::vector<Pair> list;
+            int n = static_cast<int>(Op::kCount);
+            for (size_t i = 0; i < pairs.size(); i++)
+            {
+                if (pairs[i] != 0)
+                {
+                    list.push_back({static_cast<Op>(i / n), static_cast<Op>(i % n), pairs[i]});
+                }
+            }
+            std::stable_sort(list.begin(), list.end(), [](const Pair &x, const Pair &y) { return x.count > y.count; });
+            return list;
+        }
+
+        bool VM::Trap(const Compiled *c, const Slot *pc, const string_t &msg)
+        {
+            auto &pos = c->proto->pos[pc - 1 - c->code.data()];
+            diag.Report(compiler::Phase::kRuntime, pos.first, pos.second, msg);
+            return false;
+        }
+
+        bool VM::Initialize()
+        {
+            if (!loaded)
+            {
+                return false;
+            }
+            if (stack.empty())
+            {
+                SetLimits(kDefaultStack, max_depth);
+            }
+            frames.clear();
+            if (initialized)
+            {
+                return true;
+            }
+            if (!Execute(&compiled[prog.init->index], stack.data()))
+            {
+                return false;
+            }
+            initialized = true;
+            return true;
+        }
+
+        bool VM::Run(int64_t &result)
+        {
+            result = 0;
+            std::vector<Value> results;
+            if (!Call("main", {}, results))
+            {
+                return false;
+            }
+            if (!results.empty())
+            {
+                auto t = prog.Find("main")->fn.type->Returns()[0];
+                result = t->kind == ast::Type::Kind::kInt     ? results[0].i
+                         : t->kind == ast::Type::Kind::kFloat ? static_cast<int64_t>(results[0].f)
+                                                              : results[0].b;
+            }
+            return true;
+        }
+
+        bool VM::Call(const string_t &name, const std::vector<Value> &args, std::vector<Value> &results)
+        {
+            if (!Initialize())
+            {
+                return false;
+            }
+            auto p = prog.Find(name);
+            if (p == nullptr)
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, "function " + name + " is not declared");
+                return false;
+            }
+            if (args.size() != p->fn.params)
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, "function " + name + " expects " +
+                                                                 std::to_string(p->fn.params) + " arguments");
+                return false;
+            }
+            auto fp = stack.data();
+            if (fp + p->registers > stack_end)
+            {
+                diag.Report(compiler::Phase::kRuntime, 0, 0, "stack overflow");
+                return false;
+            }
+            std::copy(args.begin(), args.end(), fp);
+            if (!Execute(&compiled[p->index], fp))
+            {
+                return false;
+            }
+            results.assign(fp, fp + p->fn.returns);
+            return true;
+        }
+
+        // runs c until it returns, calls made on the way run in the same loop.
+        // called with nullptr it only exports the addresses of the handlers
+        bool VM::Execute(const Compiled *c, Value *fp)
+        {
+#ifdef lilang_threaded
+            static const void *const handlers[] = {
+                &&L_kMove, &&L_kI2F, &&L_kF2I, &&L_kGetGlobal, &&L_kSetGlobal, &&L_kAddI64, &&L_kAddF64, &&L_kSubI64,
+                &&L_kSubF64, &&L_kMulI64, &&L_kMulF64, &&L_kDivI64, &&L_kDivF64, &&L_kModI64, &&L_kBitAnd, &&L_kBitOr,
+                &&L_kBitXor, &&L_kEqI64, &&L_kEqF64, &&L_kNeI64, &&L_kNeF64, &&L_kLtI64, &&L_kLtF64, &&L_kLeI64,
+                &&L_kLeF64, &&L_kNegI64, &&L_kNegF64, &&L_kBitNot, &&L_kNot, &&L_kJump, &&L_kJumpIf, &&L_kJumpIfNot,
+                &&L_kIfEqI64, &&L_kIfEqF64, &&L_kIfNeI64, &&L_kIfNeF64, &&L_kIfLtI64, &&L_kIfLtF64, &&L_kIfLeI64, &&L_kIfLeF64,
+                &&L_kIfNotLtF64, &&L_kIfNotLeF64, &&L_kForLtI64, &&L_kForLeI64, &&L_kCall, &&L_kCallValue, &&L_kReturn, &&L_kReturn1,
+                &&L_kReturn0, &&L_kNewArray, &&L_kGetIndex, &&L_kSetIndex, &&L_kAddrLocal, &&L_kAddrGlobal, &&L_kAddrIndex, &&L_kLoad,
+                &&L_kStore,
+                &&L_profile, // last, counts the pair and goes on to the handler
+            };
+            static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(Op::kCount) + 1,
+                          "a handler per op");
+            if (c == nullptr)
+            {
+                labels = handlers;
+                return true;
+            }
+#define CASE(op) L_##op
+#define NEXT()                  \
+    do                          \
+    {                           \
+        in = pc->in;            \
+        goto *(pc++)->label;    \
+    } while (0)
+#else
+#define CASE(op) case Op::op
+#define NEXT() break
+#endif
+            size_t entry = frames.size();
+            const Slot *pc = c->code.data();
+            const Value *k = c->proto->consts.data();
+            Value *g = globals.data();
+            Instr in;
+            int prev = static_cast<int>(Op::kCount);
+#ifdef lilang_threaded
+            NEXT();
+        L_profile:
+            if (prev != static_cast<int>(Op::kCount))
+            {
+                pairs[prev * static_cast<int>(Op::kCount) + static_cast<int>(in.op)]++;
+            }
+            prev = static_cast<int>(in.op);
+            goto *labels[static_cast<int>(in.op)];
+#else
+            for (;;)
+            {
+                in = pc->in;
+                pc++;
+                if (profiling)
+                {
+                    if (prev != static_cast<int>(Op::kCount))
+                    {
+                        pairs[prev * static_cast<int>(Op::kCount) + static_cast<int>(in.op)]++;
+                    }
+                    prev = static_cast<int>(in.op);
+                }
+                switch (in.op)
+                {
+#endif
+            CASE(kMove):
+                fp[in.a] = RK(fp, k, in.b);
+                NEXT();
+            CASE(kI2F):
+                fp[in.a] = Value::Float(static_cast<double>(RK(fp, k, in.b).i));
+                NEXT();
+            CASE(kF2I):
+            {
+                auto f = RK(fp, k, in.b).f;
+                if (!InIntRange(f))
+                {
+                    return Trap(c, pc, "float value out of the int range");
+                }
+                fp[in.a] = Value::Int(static_cast<int64_t>(f));
+                NEXT();
+            }
+            CASE(kGetGlobal):
+                fp[in.a] = g[in.Bx()];
+                NEXT();
+            CASE(kSetGlobal):
+                g[in.Bx()] = fp[in.a];
+                NEXT();
+
+#define lilang_binary(op, O, T, f)                                 \
+    CASE(op) : fp[in.a] = O::T(RK(fp, k, in.b).f, RK(fp, k, in.c).f); \
+    NEXT();
+                lilang_binary(kAddI64, Add, Int, i)
+                lilang_binary(kAddF64, Add, Float, f)
+                lilang_binary(kSubI64, Sub, Int, i)
+                lilang_binary(kSubF64, Sub, Float, f)
+                lilang_binary(kMulI64, Mul, Int, i)
+                lilang_binary(kMulF64, Mul, Float, f)
+                lilang_binary(kDivF64, Div, Float, f)
+                lilang_binary(kBitAnd, And, Int, i)
+                lilang_binary(kBitOr, Or, Int, i)
+                lilang_binary(kBitXor, Xor, Int, i)
+                lilang_binary(kEqI64, Eq, Int, i)
+                lilang_binary(kEqF64, Eq, Float, f)
+                lilang_binary(kNeI64, Ne, Int, i)
+                lilang_binary(kNeF64, Ne, Float, f)
+                lilang_binary(kLtI64, Lt, Int, i)
+                lilang_binary(kLtF64, Lt, Float, f)
+                lilang_binary(kLeI64, Le, Int, i)
+                lilang_binary(kLeF64, Le, Float, f)
+#undef lilang_binary
+
+            CASE(kDivI64):
+            {
+                auto x = RK(fp, k, in.b).i;
+                auto y = RK(fp, k, in.c).i;
+                if (y == 0)
+                {
+                    return Trap(c, pc, "division by zero");
+                }
+                // INT64_MIN / -1 wraps around
+                fp[in.a] = Value::Int(y == -1 ? static_cast<int64_t>(0 - static_cast<uint64_t>(x)) : x / y);
+                NEXT();
+            }
+            CASE(kModI64):
+            {
+                auto x = RK(fp, k, in.b).i;
+                auto y = RK(fp, k, in.c).i;
+                if (y == 0)
+                {
+                    return Trap(c, pc, "division by zero");
+                }
+                fp[in.a] = Value::Int(y == -1 ? 0 : x % y);
+                NEXT();
+            }
+            CASE(kNegI64):
+                fp[in.a] = Value::Int(static_cast<int64_t>(0 - static_cast<uint64_t>(RK(fp, k, in.b).i)));
+                NEXT();
+            CASE(kNegF64):
+                fp[in.a] = Value::Float(-RK(fp, k, in.b).f);
+                NEXT();
+            CASE(kBitNot):
+                fp[in.a] = Value::Int(~RK(fp, k, in.b).i);
+                NEXT();
+            CASE(kNot):
+                fp[in.a] = Value::Bool(!RK(fp, k, in.b).b);
+                NEXT();
+            CASE(kJump):
+                pc += in.Bx();
+                NEXT();
+            CASE(kJumpIf):
+                if (fp[in.a].b)
+                {
+                    pc += in.Bx();
+                }
+                NEXT();
+            CASE(kJumpIfNot):
+                if (!fp[in.a].b)
+                {
+                    pc += in.Bx();
+                }
+                NEXT();
+
+            // the offset of a fused jump is in the JUMP pc points at
+#define lilang_if(op, test, f)                                                         \
+    CASE(op) : pc += RK(fp, k, in.b).f test RK(fp, k, in.c).f ? 1 + pc->in.Bx() : 1; \
+    NEXT();
+                lilang_if(kIfEqI64, ==, i)
+                lilang_if(kIfEqF64, ==, f)
+                lilang_if(kIfNeI64, !=, i)
+                lilang_if(kIfNeF64, !=, f)
+                lilang_if(kIfLtI64, <, i)
+                lilang_if(kIfLtF64, <, f)
+                lilang_if(kIfLeI64, <=, i)
+                lilang_if(kIfLeF64, <=, f)
+#undef lilang_if
+            CASE(kIfNotLtF64):
+                pc += RK(fp, k, in.b).f < RK(fp, k, in.c).f ? 1 : 1 + pc->in.Bx();
+                NEXT();
+            CASE(kIfNotLeF64):
+                pc += RK(fp, k, in.b).f <= RK(fp, k, in.c).f ? 1 : 1 + pc->in.Bx();
+                NEXT();
+            CASE(kForLtI64):
+            {
+                auto i = Add::Int(fp[in.a].i, RK(fp, k, in.b).i);
+                fp[in.a] = i;
+                pc += i.i < RK(fp, k, in.c).i ? 1 + pc->in.Bx() : 1;
+                NEXT();
+            }
+            CASE(kForLeI64):
+            {
+                auto i = Add::Int(fp[in.a].i, RK(fp, k, in.b).i);
+                fp[in.a] = i;
+                pc += i.i <= RK(fp, k, in.c).i ? 1 + pc->in.Bx() : 1;
+                NEXT();
+            }
+            CASE(kCall):
+            CASE(kCallValue):
+            {
+                const Compiled *callee;
+                if (in.op == Op::kCall)
+                {
+                    callee = &compiled[in.b];
+                }
+                else
+                {
+                    auto fn = fp[in.b].fn;
+                    if (fn == nullptr)
+                    {
+                        return Trap(c, pc, "call of a nil function");
+                    }
+                    callee = &compiled[static_cast<const Proto *>(fn->code)->index];
+                }
+                auto nfp = fp + in.a;
+                if (nfp + callee->proto->registers > stack_end || frames.size() - entry >= max_depth)
+                {
+                    return Trap(c, pc, "stack overflow");
+                }
+                frames.push_back({c, pc, fp});
+                c = callee;
+                pc = c->code.data();
+                k = c->proto->consts.data();
+                fp = nfp;
+                NEXT();
+            }
+            CASE(kReturn):
+            CASE(kReturn1):
+            CASE(kReturn0):
+            {
+                if (in.op == Op::kReturn1)
+                {
+                    fp[0] = RK(fp, k, in.b);
+                }
+                else if (in.op == Op::kReturn)
+                {
+                    std::copy(fp + in.a, fp + in.a + in.b, fp);
+                }
+                if (frames.size() == entry)
+                {
+                    return true;
+                }
+                auto &f = frames.back();
+                c = f.code;
+                pc = f.pc;
+                fp = f.fp;
+                k = c->proto->consts.data();
+                frames.pop_back();
+                NEXT();
+            }
+            CASE(kNewArray):
+                fp[in.a].a = NewArray();
+                NEXT();
+            CASE(kGetIndex):
+            {
+                auto arr = fp[in.b].a;
+                auto i = RK(fp, k, in.c).i;
+                if (arr == nullptr || i < 0 || static_cast<uint64_t>(i) >= arr->elems.size())
+                {
+                    return Trap(c, pc, "index out of range");
+                }
+                fp[in.a] = arr->elems[i];
+                NEXT();
+            }
+            CASE(kSetIndex):
+            {
+                auto &arr = fp[in.a].a;
+                auto i = RK(fp, k, in.b).i;
+                if (i < 0 || i >= Array::kMaxLength)
+                {
+                    return Trap(c, pc, "index out of range");
+                }
+                if (arr == nullptr)
+                {
+                    arr = NewArray();
+                }
+                if (static_cast<uint64_t>(i) >= arr->elems.size())
+                {
+                    arr->elems.resize(i + 1, Value::Zero());
+                }
+                arr->elems[i] = RK(fp, k, in.c);
+                NEXT();
+            }
+            CASE(kAddrLocal):
+                fp[in.a].p = fp + in.b;
+                NEXT();
+            CASE(kAddrGlobal):
+                fp[in.a].p = g + in.Bx();
+                NEXT();
+            CASE(kAddrIndex):
+            {
+                auto slot = fp[in.b].p;
+                auto i = RK(fp, k, in.c).i;
+                if (i < 0 || i >= Array::kMaxLength || slot->a == nullptr && in.kind == kNoCreate)
+                {
+                    return Trap(c, pc, "index out of range");
+                }
+                if (slot->a == nullptr)
+                {
+                    slot->a = NewArray();
+                }
+                auto arr = slot->a;
+                if (static_cast<uint64_t>(i) >= arr->elems.size())
+                {
+                    arr->elems.resize(i + 1, Value::Zero());
+                }
+                fp[in.a].p = &arr->elems[i];
+                NEXT();
+            }
+            CASE(kLoad):
+            {
+                auto q = fp[in.b].p;
+                if (q == nullptr)
+                {
+                    return Trap(c, pc, "nil pointer dereference");
+                }
+                fp[in.a] = *q;
+                NEXT();
+            }
+            CASE(kStore):
+            {
+                auto q = fp[in.a].p;
+                if (q == nullptr)
+                {
+                    return Trap(c, pc, "nil pointer dereference");
+                }
+                *q = RK(fp, k, in.b);
+                NEXT();
+            }
+#ifndef lilang_threaded
+                default:
+                    return Trap(c, pc, "bad instruction");
+                }
+            }
+#endif
+#undef CASE
+#undef NEXT
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef LILANG_RUNTIME_VM
+#define LILANG_RUNTIME_VM
+
+#include "../compiler/semantic.h"
+#include "./bytecode.h"
+
+/*
+virtual machine running register bytecode
+
+one loop decodes and runs the instructions of every function, a call does
+not recurse on the C++ stack: it saves where the caller was and moves the
+frame pointer to the base of its arguments. the frames of all calls are on
+one contiguous stack of cells.
+
+with gcc and clang the code of every proto is threaded when it is loaded:
+each instruction carries the address of its handler and every handler ends
+with its own indirect jump to the next one, so the branch predictor sees a
+separate branch per handler instead of one shared switch. other compilers,
+or defining lilang_switch_dispatch, get a portable switch loop.
+
+profiling counts how often each pair of opcodes runs back to back, it is
+what the superinstructions were chosen from.
+
+runtime errors stop the program like in the interpreter, they are reported
+at the position of the instruction that hit them.
+*/
+namespace lilang
+{
+    namespace runtime
+    {
+        class VM
+        {
+        public:
+            static const size_t kDefaultStack = 1 << 20; // cells
+            static const int kDefaultDepth = 100000;     // nested calls
+
+            VM();
+            VM(const VM &) = delete;
+            // emits the bytecode of a file the visitor checked without errors
+            bool Load(const ast::File::Ptr &, ast::SemanticVisitor &);
+            // initializes the globals once and calls main, result is what main
+            // returns, 0 if it returns nothing
+            bool Run(int64_t &result);
+            // calls a top level function, results gets its return values
+            bool Call(const string_t &name, const std::vector<Value> &args, std::vector<Value> &results);
+            void SetLimits(size_t stack_cells, int depth);
+            // counts executed opcode pairs from now on, resets the counts
+            void SetProfile(bool);
+            struct Pair
+            {
+                Op first;
+                Op second;
+                uint64_t count;
+            };
+            // most frequent first
+            std::vector<Pair> Pairs() const;
+            const Program &Code() const;
+            compiler::Diagnostics &Diags();
+
+        private:
+            // an instruction and the address of its handler
+            struct Slot
+            {
+                const void *label;
+                Instr in;
+            };
+            struct Compiled
+            {
+                const Proto *proto;
+                std::vector<Slot> code;
+            };
+            // where a caller continues
+            struct Frame
+            {
+                const Compiled *code;
+                const Slot *pc;
+                Value *fp;
+            };
+
+            ast::File::Ptr file;
+            Program prog;
+            std::vector<Compiled> compiled; // by proto index
+            const void *const *labels = nullptr; // handler of each op when threaded, then the profiler
+            bool profiling = false;
+            std::vector<uint64_t> pairs; // by first * kCount + second
+            compiler::Diagnostics diag;
+            std::vector<Value> globals;
+            std::vector<Value> stack;
+            Value *stack_end = nullptr;
+            size_t max_depth = kDefaultDepth;
+            std::vector<Frame> frames;
+            std::deque<Array> arrays;
+            bool loaded = false;
+            bool initialized = false;
+
+            bool Initialize();
+            void Thread();
+            bool Execute(const Compiled *, Value *fp);
+            bool Trap(const Compiled *, const Slot *pc, const string_t &msg);
+            Array *NewArray();
+        };
+    }
+}
+
+#endif
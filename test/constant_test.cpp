@@ -0,0 +1,67 @@
+#include <iostream>
+#include <sstream>
+#include <map>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+int main()
+{
+    string_t src =
+        "let a = 10 * 100 + -1;\n"
+        "let b = 1 + 0.5;\n"
+        "let c = 7 / 2;\n"
+        "let d = (0x10 | 0b1) ^ 017;\n"
+        "let e = int(2.9) + 1;\n"
+        "let f = !(1 < 2) || 3 == 3.0;\n"
+        "let g = 1 / 0;\n"
+        "let h = a + 1;\n"
+        "let i = -2.5;\n"
+        "fn main() {\n"
+        "    while (true) {\n"
+        "        if (false) {\n"
+        "            break;\n"
+        "        }\n"
+        "    }\n"
+        "}\n";
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    diag.Print();
+    int failed = diag.HasErrors();
+
+    // expected value of each global, empty if it is not a constant
+    std::vector<string_t> expect = {"999", "1.5", "3", "30", "3", "true", "", "", "-2.5"};
+    std::vector<ast::Type::Kind> kinds = {ast::Type::Kind::kInt, ast::Type::Kind::kFloat, ast::Type::Kind::kInt,
+                                          ast::Type::Kind::kInt, ast::Type::Kind::kInt, ast::Type::Kind::kBool,
+                                          ast::Type::Kind::kInt, ast::Type::Kind::kInt, ast::Type::Kind::kFloat};
+    auto &constants = semantic.Constants();
+    for (int i = 0; i < expect.size(); i++)
+    {
+        auto decl = std::dynamic_pointer_cast<ast::VarDecl>(root->declarations[i]);
+        auto val = decl->vals[0].get();
+        auto c = constants.Find(val);
+        string_t got = c == nullptr ? "" : c->String();
+        std::cout << decl->names[0] << " = " << (got.empty() ? "<not constant>" : got) << std::endl;
+        if (got != expect[i] || semantic.Annots().TypeOf(val)->kind != kinds[i])
+        {
+            std::cout << "  expect " << expect[i] << std::endl;
+            failed++;
+        }
+    }
+
+    auto fn = std::dynamic_pointer_cast<ast::FuncDecl>(root->declarations[9])->fn_lit;
+    auto loop = std::dynamic_pointer_cast<ast::WhileStmt>(fn->body->stmts[0]);
+    auto cond = std::dynamic_pointer_cast<ast::IfStmt>(std::dynamic_pointer_cast<ast::Block>(loop->block)->stmts[0]);
+    if (!constants.IsTrue(loop->condition.get()) || !constants.IsFalse(cond->condition.get()))
+    {
+        std::cout << "conditions not known statically" << std::endl;
+        failed++;
+    }
+    return failed;
+}
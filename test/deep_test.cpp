@@ -0,0 +1,90 @@
+#include <iostream>
+#include <sstream>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// counts nodes with the explicit stack walker
+class Counter : public ast::IterativeWalker<Counter>
+{
+public:
+    size_t pre = 0;
+    size_t post = 0;
+
+    bool Pre(ast::Node *)
+    {
+        pre++;
+        return true;
+    }
+
+    void Post(ast::Node *)
+    {
+        post++;
+    }
+};
+
+// a tree far deeper than the call stack allows to recurse through must be
+// parsed, checked, walked and freed
+int check(const string_t &what, const string_t &src, int errors)
+{
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    Counter c;
+    c.Walk(root.get());
+    std::cout << what << ": " << c.pre << " nodes, " << diag.All().size() << " errors" << std::endl;
+    if (diag.All().size() != errors)
+    {
+        diag.Print();
+        return 1;
+    }
+    if (c.pre != c.post || c.pre < root->node_count / 2)
+    {
+        std::cout << "walk visited " << c.pre << " nodes, left " << c.post << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    const int kTerms = 200000;
+    const int kBranches = 50000;
+    int failed = 0;
+
+    // left deep spine of additions
+    stringstream_t sum;
+    sum << "fn main() int {\nreturn 1";
+    for (int i = 1; i < kTerms; i++)
+    {
+        sum << " + 1";
+    }
+    sum << ";\n}\n";
+    failed += check("sum", sum.str(), 0);
+
+    // a long else if chain, every branch returns
+    stringstream_t chain;
+    chain << "fn pick(int x) int {\n";
+    for (int i = 0; i < kBranches; i++)
+    {
+        chain << (i > 0 ? " else " : "") << "if (x == " << i << ") {\nreturn " << i << ";\n}";
+    }
+    chain << " else {\nreturn 0;\n}\n}\n";
+    failed += check("chain", chain.str(), 0);
+
+    // the same chain with a last branch that does not return
+    stringstream_t open;
+    open << "fn pick(int x) int {\n";
+    for (int i = 0; i < kBranches; i++)
+    {
+        open << (i > 0 ? " else " : "") << "if (x == " << i << ") {\nreturn " << i << ";\n}";
+    }
+    open << " else {\nx = 0;\n}\n}\n";
+    failed += check("open chain", open.str(), 1);
+    return failed;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../bench/generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// generated programs should pass both the parser and the checker
+int check(const bench::GeneratorOptions &opt)
+{
+    auto src = bench::ProgramGenerator(opt).Generate();
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    std::cout << opt.String() << ": " << src.size() << " bytes, "
+              << diag.Count(Phase::kSyntax) << " syntax errors, "
+              << diag.Count(Phase::kSemantic) << " semantic errors" << std::endl;
+    if (!diag.HasErrors())
+    {
+        return 0;
+    }
+    diag.Print();
+    return 1;
+}
+
+int main()
+{
+    int failed = 0;
+    bench::GeneratorOptions opt;
+    for (unsigned int seed = 1; seed <= 5; seed++)
+    {
+        opt.seed = seed;
+        failed += check(opt);
+    }
+    opt.max_depth = 6;
+    opt.expr_width = 12;
+    opt.call_density = 0.6;
+    failed += check(opt);
+    return failed;
+}
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#define private public
+#include "../src/compiler/incremental.h"
+#include "../bench/generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+string_t declName(ast::Decl::Ptr d)
+{
+    auto fn = std::dynamic_pointer_cast<ast::FuncDecl>(d);
+    if (fn != nullptr)
+    {
+        return fn->fn_lit->name;
+    }
+    return std::dynamic_pointer_cast<ast::VarDecl>(d)->names[0];
+}
+
+// node ids stay unique when new nodes are spliced among reused ones
+class IdChecker : public ast::Walker
+{
+public:
+    std::vector<bool> seen;
+    int bad = 0;
+
+protected:
+    void Pre(ast::Node *n) override
+    {
+        if (n->node_id >= seen.size() || seen[n->node_id])
+        {
+            bad++;
+            return;
+        }
+        seen[n->node_id] = true;
+    }
+};
+
+// the incremental result must look like a fresh parse of the same text
+int compare(IncrementalParser &inc)
+{
+    IdChecker ids;
+    ids.seen.resize(inc.File()->node_count);
+    ids.Walk(inc.File().get());
+    if (ids.bad != 0)
+    {
+        std::cout << ids.bad << " node ids duplicated or out of range" << std::endl;
+        return 1;
+    }
+    IncrementalParser fresh;
+    fresh.Parse(inc.Source());
+    auto &a = inc.File()->declarations;
+    auto &b = fresh.File()->declarations;
+    if (a.size() != b.size() || inc.regions.size() != fresh.regions.size())
+    {
+        std::cout << "declaration number mismatch" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < a.size(); i++)
+    {
+        auto &r1 = inc.regions[i];
+        auto &r2 = fresh.regions[i];
+        if (declName(a[i]) != declName(b[i]) || r1.offset != r2.offset ||
+            r1.row_number != r2.row_number || r1.column_number != r2.column_number)
+        {
+            std::cout << "declaration " << i << " mismatch" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int edit(IncrementalParser &inc, const TextEdit &e, int expect_changed, int expect_removed, bool expect_full)
+{
+    auto before = inc.File()->declarations;
+    auto changes = inc.Update(e);
+    auto &after = inc.File()->declarations;
+    int reused = 0;
+    for (auto &d : after)
+    {
+        reused += std::count(before.begin(), before.end(), d);
+    }
+    std::cout << "edit at " << e.offset << ": full " << changes.full
+              << ", changed " << changes.changed.size()
+              << ", removed " << changes.removed.size()
+              << ", reused " << reused << "/" << after.size() << std::endl;
+    if (changes.full != expect_full ||
+        (!expect_full && (changes.changed.size() != expect_changed ||
+                          changes.removed.size() != expect_removed ||
+                          reused + expect_changed != after.size())))
+    {
+        std::cout << "unexpected change set" << std::endl;
+        return 1;
+    }
+    return compare(inc);
+}
+
+int main()
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 50;
+    opt.statements = 5;
+    auto src = bench::ProgramGenerator(opt).Generate();
+    IncrementalParser inc;
+    inc.Parse(src);
+    int failed = compare(inc);
+
+    // edit inside one function body
+    auto body = inc.Source().find("return ", inc.Source().find("fn f_10("));
+    failed += edit(inc, {int(body) + 7, 0, "1 + "}, 1, 1, false);
+
+    // insert a new function
+    auto at = inc.Source().find("fn f_20(");
+    failed += edit(inc, {int(at), 0, "fn added() {\n}\n\nlet a, b int; "}, 2, 0, false);
+
+    // delete a function
+    auto from = inc.Source().find("fn f_30(");
+    auto to = inc.Source().find("fn f_31(");
+    failed += edit(inc, {int(from), int(to - from), ""}, 0, 1, false);
+
+    // syntax errors force a full parse until they are fixed
+    auto brace = inc.Source().find("{", inc.Source().find("fn f_40("));
+    failed += edit(inc, {int(brace), 1, ""}, 0, 0, true);
+    failed += edit(inc, {int(brace), 0, "{"}, 0, 0, true);
+    failed += edit(inc, {int(brace) + 1, 0, "\n"}, 1, 1, false);
+
+    // an edit outside the source is refused and changes nothing
+    auto source = inc.Source();
+    auto decls = inc.File()->declarations;
+    int size = source.size();
+    for (auto &e : std::vector<TextEdit>{{size + 1, 0, "x"}, {size - 2, 3, ""}, {-1, 1, ""}, {0, -1, ""}})
+    {
+        auto changes = inc.Update(e);
+        std::cout << "edit at " << e.offset << " of " << e.length << ": malformed " << changes.malformed << std::endl;
+        failed += !changes.malformed || !changes.changed.empty() || inc.Source() != source ||
+                  inc.File()->declarations != decls;
+    }
+    // the edit ending the source is inside it
+    failed += edit(inc, {size, 0, "\n"}, 1, 1, false);
+    return failed;
+}
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/runtime/interpreter.h"
+#include "./programs.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// runs main of src and compares what it returns
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    runtime::Interpreter in;
+    int64_t got = 0;
+    bool ok = !diag.HasErrors() && in.Load(root, semantic) && in.Run(got);
+    std::cout << what << ": " << got << std::endl;
+    if (!ok || got != expect)
+    {
+        diag.Print();
+        in.Diags().Print();
+        std::cout << "  expect " << expect << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// running main of src must fail with msg at row
+int trap(const string_t &what, const string_t &src, const string_t &msg, int row, size_t stack = 0)
+{
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    runtime::Interpreter in;
+    if (stack != 0)
+    {
+        in.SetLimits(stack, runtime::Interpreter::kDefaultDepth);
+    }
+    int64_t got = 0;
+    bool ok = !diag.HasErrors() && in.Load(root, semantic) && in.Run(got);
+    std::cout << what << ": ";
+    if (ok || !in.Diags().HasErrors())
+    {
+        diag.Print();
+        std::cout << "no error" << std::endl;
+        return 1;
+    }
+    auto &d = in.Diags().All().front();
+    std::cout << d.String() << std::endl;
+    return d.msg.find(msg) == string_t::npos || d.row_number != row;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += run("fib",
+                  "fn fib(int n) int {\n"
+                  "    if (n < 2) {\n"
+                  "        return n;\n"
+                  "    }\n"
+                  "    return fib(n - 1) + fib(n - 2);\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    return fib(20);\n"
+                  "}\n",
+                  6765);
+    failed += run("loops",
+                  "fn main() int {\n"
+                  "    let s = 0;\n"
+                  "    for (let i = 0; i < 100; i += 1) {\n"
+                  "        if (i % 7 == 0) {\n"
+                  "            continue;\n"
+                  "        }\n"
+                  "        if (i > 90) {\n"
+                  "            break;\n"
+                  "        }\n"
+                  "        s += i;\n"
+                  "    }\n"
+                  "    let j = 10;\n"
+                  "    while (j > 0) {\n"
+                  "        s = s * 2 - s;\n"
+                  "        j -= 3;\n"
+                  "    }\n"
+                  "    return s;\n"
+                  "}\n",
+                  3549);
+    failed += run("globals",
+                  "let g = 5;\n"
+                  "let h, k = g * 2, 1.5;\n"
+                  "fn bump() {\n"
+                  "    g += 1;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    bump();\n"
+                  "    bump();\n"
+                  "    return g + h + int(k * 2.0);\n"
+                  "}\n",
+                  20);
+    failed += run("floats",
+                  "fn half(float x) float {\n"
+                  "    return x / 2;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let f = half(7);\n"
+                  "    let i int;\n"
+                  "    i = f * 4.0;\n"
+                  "    f *= 3;\n"
+                  "    if (f >= 10.5 && !(f < 10.0)) {\n"
+                  "        i += 100;\n"
+                  "    }\n"
+                  "    return i;\n"
+                  "}\n",
+                  114);
+    failed += run("arrays",
+                  "fn fill(int n) []int {\n"
+                  "    let a []int;\n"
+                  "    for (let i = 0; i < n; i += 1) {\n"
+                  "        a[i] = i * i;\n"
+                  "    }\n"
+                  "    return a;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let a = fill(10);\n"
+                  "    let b = a;\n"
+                  "    b[0] = 1000;\n"
+                  "    a[2] += a[3];\n"
+                  "    return a[0] + a[2] + a[9];\n"
+                  "}\n",
+                  1094);
+    failed += run("pointers",
+                  "fn set(*int p, int v) {\n"
+                  "    *p = v;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let x = 1;\n"
+                  "    set(&x, 41);\n"
+                  "    let a []int;\n"
+                  "    a[3] = 0;\n"
+                  "    let q = &a[1];\n"
+                  "    *q = x + 1;\n"
+                  "    return a[1];\n"
+                  "}\n",
+                  42);
+    failed += run("tuples",
+                  "fn divmod(int a, int b) (int, int) {\n"
+                  "    return a / b, a % b;\n"
+                  "}\n"
+                  "fn add(int a, int b) int {\n"
+                  "    return a + b;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let q, r = divmod(47, 5);\n"
+                  "    q, r = r, q;\n"
+                  "    return q * 100 + r + add(divmod(9, 4));\n"
+                  "}\n",
+                  212);
+    failed += run("function values",
+                  "fn twice(fn(int) int f, int x) int {\n"
+                  "    return f(f(x));\n"
+                  "}\n"
+                  "fn inc(int x) int {\n"
+                  "    return x + 1;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let sq = fn(int x) int {\n"
+                  "        return x * x;\n"
+                  "    };\n"
+                  "    return twice(sq, 3) + twice(inc, 0);\n"
+                  "}\n",
+                  83);
+    failed += run("bits",
+                  "fn main() int {\n"
+                  "    let x = 12;\n"
+                  "    x |= 3;\n"
+                  "    x &= ^1;\n"
+                  "    x ^= 32;\n"
+                  "    return x + (-7 / 2) + (-7 % 2);\n"
+                  "}\n",
+                  42);
+    failed += run("wrap",
+                  "fn main() int {\n"
+                  "    let m = 9223372036854775807;\n"
+                  "    m += 1;\n"
+                  "    let d = -1;\n"
+                  "    if (m / d == m && m % d == 0 && m < 0) {\n"
+                  "        return 1;\n"
+                  "    }\n"
+                  "    return 0;\n"
+                  "}\n",
+                  1);
+    failed += run("no main result",
+                  "fn main() {\n"
+                  "    let x = 1;\n"
+                  "}\n",
+                  0);
+
+    failed += trap("division", "fn main() int {\n    let z = 0;\n    return 1 / z;\n}\n", "division by zero", 3);
+    failed += trap("index", "fn main() int {\n    let a []int;\n    a[1] = 1;\n    return a[2];\n}\n",
+                   "index out of range", 4);
+    failed += trap("negative index", "fn main() {\n    let a []int;\n    let i = -1;\n    a[i] = 1;\n}\n",
+                   "index out of range", 4);
+    failed += trap("nil pointer", "fn main() int {\n    let p *int;\n    return *p;\n}\n",
+                   "nil pointer dereference", 3);
+    failed += trap("overflow", "fn f(int n) int {\n    return f(n + 1);\n}\nfn main() int {\n    return f(0);\n}\n",
+                   "stack overflow", 2);
+    failed += trap("small stack", "fn f(int n) int {\n    let a, b, c = n, n, n;\n    return f(a + b + c);\n}\n"
+                   "fn main() int {\n    return f(0);\n}\n",
+                   "stack overflow", 3, 1000);
+    // deep enough to overflow the native stack of an unoptimized build before the call limit
+    failed += trap("deep recursion", "fn f(int n) int {\n    if (n == 0) {\n        return 0;\n    }\n"
+                   "    return f(n - 1) + 1;\n}\nfn main() int {\n    return f(1000000);\n}\n",
+                   "stack overflow", 5);
+    failed += trap("float to int", "fn main() int {\n    let f = 1000000000000.0 * 1000000000000.0;\n    return int(f);\n}\n",
+                   "float value out of the int range", 3);
+    failed += trap("closure", "fn main() int {\n    let x = 1;\n    let f = fn() int {\n        return x;\n    };\n"
+                   "    return f();\n}\n",
+                   "closures are not supported", 4);
+    failed += trap("no main", "fn f() {\n}\n", "function main is not declared", 0);
+    // a body nested deeper than the limit does not load, one below it runs
+    failed += run("deep sum", Sum(ast::kMaxNesting / 2), ast::kMaxNesting / 2);
+    failed += trap("deep expression", Sum(20000), "expression too deep", 3);
+
+    // Call passes arguments and collects all results
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString("fn swap(int a, float b) (float, int) {\n    return b, a;\n}\n");
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    runtime::Interpreter in;
+    std::vector<runtime::Value> results;
+    if (!in.Load(root, semantic) ||
+        !in.Call("swap", {runtime::Value::Int(3), runtime::Value::Float(0.5)}, results) ||
+        results.size() != 2 || results[0].f != 0.5 || results[1].i != 3)
+    {
+        in.Diags().Print();
+        std::cout << "call of swap failed" << std::endl;
+        failed++;
+    }
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
@@ -0,0 +1,823 @@
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/ir/lower.h"
+#include "../src/ir/pass_manager.h"
+
+// the ir of src, ok if it is valid
+struct Lowered : Checked
+{
+    ir::Module module;
+    bool ok;
+
+    explicit Lowered(const string_t &src) : Checked(src)
+    {
+        ok = !diag.HasErrors() && ir::Lowering(diag).Lower(root, *semantic, module) && ir::Verify(module, diag);
+    }
+};
+
+// runs the ir the way the engines run bytecode, to check that passes keep the results
+class Eval
+{
+public:
+    union Cell
+    {
+        int64_t i;
+        double f;
+        void *p;
+    };
+
+    explicit Eval(const ir::Module &m) : m(m), globals(m.globals.size(), Cell{0}) {}
+
+    bool Main(int64_t &result)
+    {
+        std::vector<Cell> out;
+        auto main = const_cast<ir::Module &>(m).Find("main");
+        if (!Call(m.init, {}, out) || main == nullptr || !Call(main, {}, out))
+        {
+            return false;
+        }
+        result = out[0].i;
+        return true;
+    }
+
+    string_t trap;
+
+private:
+    struct Array
+    {
+        std::deque<Cell> elems; // a pointer to an element stays valid as it grows
+    };
+
+    const ir::Module &m;
+    std::vector<Cell> globals;
+    std::deque<Array> arrays;
+    std::deque<Cell> slots;
+    size_t steps = 0;
+
+    Cell Const(const ir::Instr *in)
+    {
+        Cell c;
+        c.i = in->imm;
+        if (in->str != nullptr)
+        {
+            c.p = const_cast<string_t *>(in->str);
+        }
+        else if (in->fn != nullptr)
+        {
+            c.p = in->fn;
+        }
+        return c;
+    }
+
+    bool Trap(const string_t &msg)
+    {
+        trap = msg;
+        return false;
+    }
+
+    bool Call(const ir::Function *f, const std::vector<Cell> &args, std::vector<Cell> &out)
+    {
+        std::unordered_map<const ir::Instr *, Cell> vals;
+        std::unordered_map<const ir::Instr *, std::vector<Cell>> tuples;
+        auto get = [&](const ir::Instr *in) { return in->IsConst() ? Const(in) : vals[in]; };
+        const ir::Block *b = f->Entry(), *from = nullptr;
+        while (true)
+        {
+            // the phis of a block read their operands together
+            std::vector<std::pair<const ir::Instr *, Cell>> phis;
+            for (auto in : b->instrs)
+            {
+                if (in->op == ir::Op::kPhi)
+                {
+                    phis.push_back({in, get(in->args[b->PredIndex(from)])});
+                }
+            }
+            for (auto &p : phis)
+            {
+                vals[p.first] = p.second;
+            }
+            for (auto in : b->instrs)
+            {
+                if (++steps > 10000000)
+                {
+                    return Trap("too many steps");
+                }
+                Cell a = in->args.size() > 0 ? get(in->args[0]) : Cell{0};
+                Cell c = in->args.size() > 1 ? get(in->args[1]) : Cell{0};
+                bool floats = in->args.size() > 0 && in->args[0]->type == ir::Type::kF64;
+                Cell r{0};
+                switch (in->op)
+                {
+                case ir::Op::kPhi:
+                    continue;
+                case ir::Op::kParam:
+                    r = args[in->imm];
+                    break;
+                case ir::Op::kAdd:
+                    floats ? r.f = a.f + c.f : r.i = static_cast<int64_t>(static_cast<uint64_t>(a.i) + c.i);
+                    break;
+                case ir::Op::kSub:
+                    floats ? r.f = a.f - c.f : r.i = static_cast<int64_t>(static_cast<uint64_t>(a.i) - c.i);
+                    break;
+                case ir::Op::kMul:
+                    floats ? r.f = a.f * c.f : r.i = static_cast<int64_t>(static_cast<uint64_t>(a.i) * c.i);
+                    break;
+                case ir::Op::kDiv:
+                case ir::Op::kMod:
+                    if (floats)
+                    {
+                        r.f = a.f / c.f;
+                        break;
+                    }
+                    if (c.i == 0)
+                    {
+                        return Trap("division by zero");
+                    }
+                    r.i = in->op == ir::Op::kMod ? (c.i == -1 ? 0 : a.i % c.i)
+                                                 : (c.i == -1 ? static_cast<int64_t>(0 - static_cast<uint64_t>(a.i)) : a.i / c.i);
+                    break;
+                case ir::Op::kAnd:
+                    r.i = a.i & c.i;
+                    break;
+                case ir::Op::kOr:
+                    r.i = a.i | c.i;
+                    break;
+                case ir::Op::kXor:
+                    r.i = a.i ^ c.i;
+                    break;
+                case ir::Op::kNeg:
+                    floats ? r.f = -a.f : r.i = static_cast<int64_t>(0 - static_cast<uint64_t>(a.i));
+                    break;
+                case ir::Op::kBitNot:
+                    r.i = ~a.i;
+                    break;
+                case ir::Op::kNot:
+                    r.i = !a.i;
+                    break;
+                case ir::Op::kEq:
+                    r.i = floats ? a.f == c.f : a.i == c.i;
+                    break;
+                case ir::Op::kNe:
+                    r.i = floats ? a.f != c.f : a.i != c.i;
+                    break;
+                case ir::Op::kLt:
+                    r.i = floats ? a.f < c.f : a.i < c.i;
+                    break;
+                case ir::Op::kLe:
+                    r.i = floats ? a.f <= c.f : a.i <= c.i;
+                    break;
+                case ir::Op::kI2F:
+                    r.f = static_cast<double>(a.i);
+                    break;
+                case ir::Op::kF2I:
+                    if (!(a.f > -9223372036854775808.0 && a.f < 9223372036854775808.0))
+                    {
+                        return Trap("float value out of the int range");
+                    }
+                    r.i = static_cast<int64_t>(a.f);
+                    break;
+                case ir::Op::kGetGlobal:
+                    r = globals[in->imm];
+                    break;
+                case ir::Op::kSetGlobal:
+                    globals[in->imm] = a;
+                    break;
+                case ir::Op::kAddrGlobal:
+                    r.p = &globals[in->imm];
+                    break;
+                case ir::Op::kCall:
+                case ir::Op::kCallValue:
+                {
+                    std::vector<Cell> params, results;
+                    size_t first = in->op == ir::Op::kCall ? 0 : 1;
+                    for (size_t i = first; i < in->args.size(); i++)
+                    {
+                        params.push_back(get(in->args[i]));
+                    }
+                    auto callee = in->op == ir::Op::kCall ? in->fn : static_cast<const ir::Function *>(a.p);
+                    if (!Call(callee, params, results))
+                    {
+                        return false;
+                    }
+                    tuples[in] = results;
+                    r = results.empty() ? Cell{0} : results[0];
+                    break;
+                }
+                case ir::Op::kExtract:
+                    r = tuples[in->args[0]][in->imm];
+                    break;
+                case ir::Op::kNewArray:
+                    arrays.emplace_back();
+                    r.p = &arrays.back();
+                    break;
+                case ir::Op::kGetIndex:
+                {
+                    auto arr = static_cast<Array *>(a.p);
+                    if (arr == nullptr || c.i < 0 || static_cast<size_t>(c.i) >= arr->elems.size())
+                    {
+                        return Trap("index out of range");
+                    }
+                    r = arr->elems[c.i];
+                    break;
+                }
+                case ir::Op::kSetIndex:
+                case ir::Op::kAddrIndex:
+                {
+                    bool set = in->op == ir::Op::kSetIndex;
+                    Cell *cell = set ? &a : static_cast<Cell *>(a.p);
+                    if (c.i < 0 || c.i >= (1 << 24) || (cell->p == nullptr && in->imm != 0))
+                    {
+                        return Trap("index out of range");
+                    }
+                    if (cell->p == nullptr)
+                    {
+                        arrays.emplace_back();
+                        cell->p = &arrays.back();
+                    }
+                    auto arr = static_cast<Array *>(cell->p);
+                    if (static_cast<size_t>(c.i) >= arr->elems.size())
+                    {
+                        arr->elems.resize(c.i + 1, Cell{0});
+                    }
+                    if (set)
+                    {
+                        arr->elems[c.i] = get(in->args[2]);
+                        r = a;
+                    }
+                    else
+                    {
+                        r.p = &arr->elems[c.i];
+                    }
+                    break;
+                }
+                case ir::Op::kSlot:
+                    slots.push_back(Cell{0});
+                    r.p = &slots.back();
+                    break;
+                case ir::Op::kLoad:
+                    if (a.p == nullptr)
+                    {
+                        return Trap("nil pointer dereference");
+                    }
+                    r = *static_cast<Cell *>(a.p);
+                    break;
+                case ir::Op::kStore:
+                    if (a.p == nullptr)
+                    {
+                        return Trap("nil pointer dereference");
+                    }
+                    *static_cast<Cell *>(a.p) = c;
+                    break;
+                case ir::Op::kJump:
+                case ir::Op::kBranch:
+                    from = b;
+                    b = in->targets[in->op == ir::Op::kJump || a.i ? 0 : 1];
+                    break;
+                case ir::Op::kRet:
+                    out.clear();
+                    for (auto v : in->args)
+                    {
+                        out.push_back(get(v));
+                    }
+                    return true;
+                default:
+                    return Trap(string_t("cannot run ") + ir::OpName(in->op));
+                }
+                vals[in] = r;
+            }
+        }
+    }
+};
+
+void Optimize(ir::Module &m, int level = 2)
+{
+    Diagnostics diag;
+    ir::PassManager pm(diag);
+    pm.SetLevel(level);
+    pm.SetVerify(true);
+    if (!pm.Run(m))
+    {
+        diag.Print();
+    }
+}
+
+// main must return expect before and after the passes, which must leave valid ir
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Lowered c(src);
+    int64_t before = 0, after = 0;
+    size_t size = c.module.Size();
+    bool ok = c.ok && Eval(c.module).Main(before);
+    Optimize(c.module);
+    ok = ok && ir::Verify(c.module, c.diag) && Eval(c.module).Main(after);
+    std::cout << what << ": " << after << ", " << size << " -> " << c.module.Size() << " instructions" << std::endl;
+    if (!ok || before != expect || after != expect)
+    {
+        c.diag.Print();
+        ir::Print(std::cout, c.module);
+        std::cout << "  expect " << expect << ", before the passes " << before << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// the text of the ir after pass must be want
+int pass(const string_t &what, bool (*p)(ir::Function &), const string_t &text, const string_t &want)
+{
+    Diagnostics diag;
+    ir::Module m;
+    bool ok = ir::Parse(text, m, diag) && ir::Verify(m, diag);
+    for (auto &f : m.functions)
+    {
+        ok = ok && p(f);
+    }
+    ok = ok && ir::Verify(m, diag);
+    stringstream_t ss;
+    ir::Print(ss, m);
+    std::cout << what << ": " << (ok ? "changed" : "failed") << std::endl;
+    if (!ok || ss.str() != want)
+    {
+        diag.Print();
+        std::cout << ss.str() << "  expect\n"
+                  << want;
+        return 1;
+    }
+    return 0;
+}
+
+// verifying, or reading, text must fail with msg at row
+int invalid(const string_t &what, const string_t &text, const string_t &msg, int row)
+{
+    Diagnostics diag;
+    ir::Module m;
+    bool ok = ir::Parse(text, m, diag) && ir::Verify(m, diag);
+    std::cout << what << ": ";
+    if (ok || !diag.HasErrors())
+    {
+        std::cout << "no error" << std::endl;
+        return 1;
+    }
+    auto &d = diag.All().front();
+    std::cout << d.String() << std::endl;
+    return d.msg.find(msg) == string_t::npos || d.row_number != row || d.phase != Phase::kIr;
+}
+
+// each level must keep the result and leave no more instructions than the one below
+int levels(const string_t &what, const string_t &src, int64_t expect)
+{
+    size_t sizes[3];
+    int wrong = 0;
+    std::cout << what << ":";
+    for (int level = 0; level < 3; level++)
+    {
+        Lowered c(src);
+        int64_t got = 0;
+        Optimize(c.module, level);
+        sizes[level] = c.module.Size();
+        wrong += !c.ok || !Eval(c.module).Main(got) || got != expect;
+        std::cout << " -O" << level << " " << sizes[level];
+    }
+    std::cout << std::endl;
+    return wrong != 0 || sizes[1] > sizes[0] || sizes[2] > sizes[1];
+}
+
+// the values live out of each block, by their printed names
+string_t live(const ir::Function &f, const ir::Liveness &l)
+{
+    std::unordered_map<const ir::Instr *, int> names;
+    for (auto &b : f.blocks)
+    {
+        for (auto in : b->instrs)
+        {
+            if (in->type != ir::Type::kVoid)
+            {
+                names[in] = static_cast<int>(names.size());
+            }
+        }
+    }
+    stringstream_t ss;
+    for (auto &b : f.blocks)
+    {
+        ss << " b" << b->id << ":";
+        for (auto in : l.LiveOut(b.get()))
+        {
+            ss << " %" << names[in];
+        }
+    }
+    ss << " max " << l.MaxPressure();
+    return ss.str();
+}
+
+int main()
+{
+    int failed = 0;
+    const string_t fib = Source("fib");
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+    {
+        Lowered c(fib);
+        stringstream_t ss;
+        ir::Print(ss, *c.module.Find("fib"));
+        const string_t want =
+            "fn fib(i64) i64 {\n"
+            "b0:\n"
+            "    %0 = param i64 0\n"
+            "    %1 = lt i64 %0, 2\n"
+            "    br %1, b1, b2\n"
+            "b1:    ; preds b0\n"
+            "    ret %0\n"
+            "b2:    ; preds b0\n"
+            "    %2 = sub i64 %0, 1\n"
+            "    %3 = call i64 @fib(%2)\n"
+            "    %4 = sub i64 %0, 2\n"
+            "    %5 = call i64 @fib(%4)\n"
+            "    %6 = add i64 %3, %5\n"
+            "    ret %6\n"
+            "}\n";
+        std::cout << "fib ir: " << (ss.str() == want ? "as expected" : ss.str()) << std::endl;
+        failed += ss.str() != want;
+    }
+
+    // the constant branch is folded, the dead loop goes, the two products are one
+    {
+        Lowered c("fn f(int n) int {\n"
+                  "    let k = 4;\n"
+                  "    let d = k * 2;\n"
+                  "    if (d > 10) {\n"
+                  "        for (let i = 0; i < n; i += 1) {\n"
+                  "            d += i;\n"
+                  "        }\n"
+                  "    }\n"
+                  "    return n * d + d * n;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    return f(3);\n"
+                  "}\n");
+        Optimize(c.module);
+        stringstream_t ss;
+        ir::Print(ss, *c.module.Find("f"));
+        const string_t want =
+            "fn f(i64) i64 {\n"
+            "b0:\n"
+            "    %0 = param i64 0\n"
+            "    %1 = mul i64 %0, 8\n"
+            "    %2 = add i64 %1, %1\n"
+            "    ret %2\n"
+            "}\n";
+        std::cout << "pipeline: " << (ss.str() == want ? "as expected" : ss.str()) << std::endl;
+        failed += ss.str() != want;
+    }
+
+    // a body nested deeper than the limit is not lowered, one below it is
+    failed += run("deep sum", Sum(ast::kMaxNesting / 2), ast::kMaxNesting / 2);
+    {
+        Lowered c(Sum(20000));
+        auto &d = c.diag.All();
+        bool refused = !c.ok && !d.empty() && d.front().msg == "expression too deep";
+        std::cout << "deep expression: " << (d.empty() ? "lowered" : d.front().String()) << std::endl;
+        failed += !refused;
+    }
+
+    failed += levels("levels",
+                     "fn f(int n) int {\n"
+                     "    let k = 4;\n"
+                     "    let d = k * 2;\n"
+                     "    let s = 0;\n"
+                     "    for (let i = 0; i < n; i += 1) {\n"
+                     "        if (d < 5) {\n"
+                     "            s -= i;\n"
+                     "        }\n"
+                     "        s += n * d + d * n;\n"
+                     "    }\n"
+                     "    return s;\n"
+                     "}\n"
+                     "fn main() int {\n"
+                     "    return f(10);\n"
+                     "}\n",
+                     1600);
+
+    // analyses are kept while the passes leave the function as it is
+    {
+        Lowered c(fib);
+        ir::PassManager pm(c.diag);
+        bool ok = c.ok && pm.ParseArg("-O2") && pm.ParseArg("--verify") && pm.Run(c.module);
+        auto fn = c.module.Find("fib");
+        auto &a = pm.Of(*fn);
+        int before = a.counters[0].computed;
+        a.Dom();
+        a.Live();
+        a.Live();
+        auto report = pm.Report();
+        stringstream_t names;
+        for (auto &s : report)
+        {
+            names << s.name << " ";
+        }
+        pm.PrintReport(std::cout);
+        std::cout << "report: " << names.str() << std::endl;
+        // the three functions settle in one round, each computes its dominators once
+        ok = ok && names.str() == "sccp gvn dce simplifycfg dominators liveness " && report[1].runs == 3 && report[4].runs == 3 &&
+             report[1].changed == 0 && before == 1 && a.counters[0].computed == 1 && a.counters[1].computed == 1;
+        if (!ok)
+        {
+            c.diag.Print();
+            failed++;
+        }
+    }
+    {
+        Diagnostics diag;
+        ir::Module m;
+        ir::PassManager pm(diag);
+        bool ok = ir::Parse("fn f(i64) i64 {\n"
+                            "b0:\n"
+                            "    %0 = param i64 0\n"
+                            "    %1 = mul i64 %0, 3\n"
+                            "    br true, b1, b2\n"
+                            "b1:    ; preds b0\n"
+                            "    ret %0\n"
+                            "b2:    ; preds b0\n"
+                            "    ret 1\n"
+                            "}\n",
+                            m, diag);
+        auto &a = pm.Of(m.functions[0]);
+        a.Dom();
+        a.Live();
+        ok = ok && pm.SetPipeline("dce") && pm.Run(m);
+        bool kept = a.Cached(ir::Analysis::kDominators), dropped = !a.Cached(ir::Analysis::kLiveness);
+        ok = ok && pm.SetPipeline("simplifycfg") && pm.Run(m);
+        std::cout << "invalidation: dce keeps the dominators " << kept << ", drops liveness " << dropped
+                  << ", simplifycfg drops the dominators " << !a.Cached(ir::Analysis::kDominators) << std::endl;
+        if (!ok || !kept || !dropped || a.Cached(ir::Analysis::kDominators) || m.Size() != 2)
+        {
+            diag.Print();
+            failed++;
+        }
+    }
+    {
+        Diagnostics diag;
+        ir::PassManager pm(diag);
+        bool ok = !pm.ParseArg("--passes=sccp,licm") && !pm.ParseArg("-O3") && !pm.ParseArg("-march");
+        std::cout << "bad pipelines: " << diag.All().size() << " errors" << std::endl;
+        failed += !ok || diag.All().size() != 2 || diag.All()[0].msg != "unknown pass 'licm'";
+    }
+    {
+        Diagnostics diag;
+        ir::Module m;
+        bool ok = ir::Parse("fn sum(i64) i64 {\n"
+                            "b0:\n"
+                            "    %0 = param i64 0\n"
+                            "    jump b1\n"
+                            "b1:    ; preds b0, b2\n"
+                            "    %1 = phi i64 [0, b0], [%4, b2]\n"
+                            "    %2 = phi i64 [0, b0], [%5, b2]\n"
+                            "    %3 = lt i64 %2, %0\n"
+                            "    br %3, b2, b3\n"
+                            "b2:    ; preds b1\n"
+                            "    %4 = add i64 %1, %2\n"
+                            "    %5 = add i64 %2, 1\n"
+                            "    jump b1\n"
+                            "b3:    ; preds b1\n"
+                            "    ret %1\n"
+                            "}\n",
+                            m, diag);
+        auto &f = m.functions[0];
+        auto got = ok ? live(f, ir::Liveness(f)) : "";
+        std::cout << "liveness:" << got << std::endl;
+        failed += got != " b0: %0 b1: %0 %1 %2 b2: %0 %4 %5 b3: max 4";
+    }
+
+    failed += pass("sccp", ir::SCCP,
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    jump b1\n"
+                   "b1:    ; preds b0, b2\n"
+                   "    %1 = phi i64 [1, b0], [%3, b2]\n"
+                   "    %2 = lt i64 %1, %0\n"
+                   "    br %2, b2, b3\n"
+                   "b2:    ; preds b1\n"
+                   "    %3 = div i64 %1, 1\n"
+                   "    jump b1\n"
+                   "b3:    ; preds b1\n"
+                   "    %4 = mul i64 %1, 3\n"
+                   "    %5 = eq i64 %4, 3\n"
+                   "    br %5, b4, b5\n"
+                   "b4:    ; preds b3\n"
+                   "    ret %4\n"
+                   "b5:    ; preds b3\n"
+                   "    %6 = div i64 %4, 0\n"
+                   "    ret %6\n"
+                   "}\n",
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    jump b1\n"
+                   "b1:    ; preds b0, b2\n"
+                   "    %1 = lt i64 1, %0\n"
+                   "    br %1, b2, b3\n"
+                   "b2:    ; preds b1\n"
+                   "    jump b1\n"
+                   "b3:    ; preds b1\n"
+                   "    jump b4\n"
+                   "b4:    ; preds b3\n"
+                   "    ret 3\n"
+                   "}\n\n");
+    failed += pass("sccp keeps traps", ir::SCCP,
+                   "fn f() f64 {\n"
+                   "b0:\n"
+                   "    %0 = div i64 7, 0\n"
+                   "    %1 = f2i i64 9.5e+18\n"
+                   "    %2 = add i64 %0, %1\n"
+                   "    %3 = f2i i64 2.5\n"
+                   "    %4 = i2f f64 %3\n"
+                   "    %5 = div f64 %4, 0.0\n"
+                   "    %6 = mod i64 -9223372036854775808, -1\n"
+                   "    %7 = add i64 %2, %6\n"
+                   "    ret %5\n"
+                   "}\n",
+                   "fn f() f64 {\n"
+                   "b0:\n"
+                   "    %0 = div i64 7, 0\n"
+                   "    %1 = f2i i64 9.5e+18\n"
+                   "    %2 = add i64 %0, %1\n"
+                   "    %3 = add i64 %2, 0\n"
+                   "    ret inf\n"
+                   "}\n\n");
+    failed += pass("dce", ir::DCE,
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    %1 = mul i64 %0, %0\n"
+                   "    %2 = div i64 %0, %0\n"
+                   "    %3 = div i64 %0, 2\n"
+                   "    jump b1\n"
+                   "b1:    ; preds b0, b1\n"
+                   "    %4 = phi i64 [%1, b0], [%5, b1]\n"
+                   "    %5 = add i64 %4, %3\n"
+                   "    %6 = lt i64 %0, 3\n"
+                   "    br %6, b1, b2\n"
+                   "b2:    ; preds b1\n"
+                   "    %7 = newarray ref\n"
+                   "    ret %0\n"
+                   "}\n",
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    %1 = div i64 %0, %0\n"
+                   "    jump b1\n"
+                   "b1:    ; preds b0, b1\n"
+                   "    %2 = lt i64 %0, 3\n"
+                   "    br %2, b1, b2\n"
+                   "b2:    ; preds b1\n"
+                   "    ret %0\n"
+                   "}\n\n");
+    failed += pass("gvn", ir::GVN,
+                   "fn f(i64, i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    %1 = param i64 1\n"
+                   "    %2 = add i64 %0, %1\n"
+                   "    %3 = lt i64 %0, %1\n"
+                   "    br %3, b1, b2\n"
+                   "b1:    ; preds b0\n"
+                   "    %4 = add i64 %1, %0\n"
+                   "    %5 = mul i64 %4, %2\n"
+                   "    %6 = sub i64 %1, %0\n"
+                   "    jump b3\n"
+                   "b2:    ; preds b0\n"
+                   "    %7 = sub i64 %1, %0\n"
+                   "    jump b3\n"
+                   "b3:    ; preds b1, b2\n"
+                   "    %8 = phi i64 [%5, b1], [%7, b2]\n"
+                   "    %9 = sub i64 %1, %0\n"
+                   "    %10 = load i64 @f\n"
+                   "    %11 = load i64 @f\n"
+                   "    %12 = add i64 %8, %9\n"
+                   "    %13 = add i64 %10, %11\n"
+                   "    %14 = add i64 %12, %13\n"
+                   "    ret %14\n"
+                   "}\n",
+                   "fn f(i64, i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    %1 = param i64 1\n"
+                   "    %2 = add i64 %0, %1\n"
+                   "    %3 = lt i64 %0, %1\n"
+                   "    br %3, b1, b2\n"
+                   "b1:    ; preds b0\n"
+                   "    %4 = mul i64 %2, %2\n"
+                   "    %5 = sub i64 %1, %0\n"
+                   "    jump b3\n"
+                   "b2:    ; preds b0\n"
+                   "    %6 = sub i64 %1, %0\n"
+                   "    jump b3\n"
+                   "b3:    ; preds b1, b2\n"
+                   "    %7 = phi i64 [%4, b1], [%6, b2]\n"
+                   "    %8 = sub i64 %1, %0\n"
+                   "    %9 = load i64 @f\n"
+                   "    %10 = load i64 @f\n"
+                   "    %11 = add i64 %7, %8\n"
+                   "    %12 = add i64 %9, %10\n"
+                   "    %13 = add i64 %11, %12\n"
+                   "    ret %13\n"
+                   "}\n\n");
+    failed += pass("simplify cfg", ir::SimplifyCFG,
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    br true, b1, b2\n"
+                   "b1:    ; preds b0\n"
+                   "    %1 = lt i64 %0, 0\n"
+                   "    br %1, b3, b4\n"
+                   "b2:    ; preds b0\n"
+                   "    jump b5\n"
+                   "b3:    ; preds b1\n"
+                   "    jump b5\n"
+                   "b4:    ; preds b1\n"
+                   "    %2 = neg i64 %0\n"
+                   "    jump b5\n"
+                   "b5:    ; preds b2, b3, b4\n"
+                   "    %3 = phi i64 [1, b2], [%0, b3], [%2, b4]\n"
+                   "    %4 = phi i64 [%0, b2], [%0, b3], [%0, b4]\n"
+                   "    %5 = add i64 %3, %4\n"
+                   "    ret %5\n"
+                   "}\n",
+                   "fn f(i64) i64 {\n"
+                   "b0:\n"
+                   "    %0 = param i64 0\n"
+                   "    %1 = lt i64 %0, 0\n"
+                   "    br %1, b2, b1\n"
+                   "b1:    ; preds b0\n"
+                   "    %2 = neg i64 %0\n"
+                   "    jump b2\n"
+                   "b2:    ; preds b1, b0\n"
+                   "    %3 = phi i64 [%2, b1], [%0, b0]\n"
+                   "    %4 = add i64 %3, %0\n"
+                   "    ret %4\n"
+                   "}\n\n");
+
+    // text that Print wrote reads back to the same text
+    {
+        Lowered c("let s = \"a \\\"quoted\\\" word\";\n"
+                  "let g = 0.1;\n"
+                  "fn pair(float x) (int, float) {\n"
+                  "    let a []float;\n"
+                  "    a[2] = x;\n"
+                  "    let p = &a[2];\n"
+                  "    *p *= 1000000.0;\n"
+                  "    return int(x), a[2] * a[2] + g;\n"
+                  "}\n"
+                  "fn main() int {\n"
+                  "    let i, f = pair(-2.5);\n"
+                  "    if (f != f || f > 1.0) {\n"
+                  "        return i;\n"
+                  "    }\n"
+                  "    return 0;\n"
+                  "}\n");
+        stringstream_t first, second;
+        ir::Print(first, c.module);
+        ir::Module m;
+        bool ok = c.ok && ir::Parse(first.str(), m, c.diag) && ir::Verify(m, c.diag);
+        ir::Print(second, m);
+        std::cout << "round trip: " << m.Size() << " instructions" << std::endl;
+        if (!ok || first.str() != second.str() || m.init == nullptr || m.globals.size() != 2)
+        {
+            c.diag.Print();
+            std::cout << first.str() << "  read back as\n"
+                      << second.str();
+            failed++;
+        }
+    }
+
+    failed += invalid("undefined value", "fn f() i64 {\nb0:\n    ret %3\n}\n", "never defined", 4);
+    failed += invalid("unknown op", "fn f() i64 {\nb0:\n    %0 = frob i64 1\n    ret %0\n}\n", "unknown instruction", 3);
+    failed += invalid("no terminator", "fn f() void {\nb0:\n    %0 = add i64 1, 2\n}\n", "no terminator", 4);
+    failed += invalid("bad type", "globals i65\n", "expected a type", 1);
+    failed += invalid("mixed operands",
+                      "fn f(f64) f64 {\nb0:\n    %0 = param f64 0\n    %1 = add f64 %0, 1\n    ret %1\n}\n",
+                      "operand 1 is i64", 0);
+    failed += invalid("not dominated",
+                      "fn f(bool) i64 {\n"
+                      "b0:\n"
+                      "    %0 = param bool 0\n"
+                      "    br %0, b1, b2\n"
+                      "b1:\n"
+                      "    %1 = add i64 1, 2\n"
+                      "    jump b2\n"
+                      "b2:\n"
+                      "    ret %1\n"
+                      "}\n",
+                      "where it is not defined", 0);
+    failed += invalid("ret count", "fn f() (i64, i64) {\nb0:\n    ret 1\n}\n", "returns 1 values for 2", 0);
+    failed += invalid("call args", "fn f(i64) void {\nb0:\n    call void @f(true)\n    ret\n}\n", "argument 0 is bool", 0);
+
+    std::cout << failed << " failed" << std::endl;
+    return failed;
+}
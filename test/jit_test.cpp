@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/native/jit.h"
+#include "../src/runtime/vm.h"
+
+// main compiled at -O0 and -O2 must return what it returns on the vm
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    runtime::VM vm;
+    int64_t ref = 0;
+    bool ok = !c.diag.HasErrors() && vm.Load(c.root, *c.semantic) && vm.Run(ref) && ref == expect;
+    std::cout << what << ":";
+    int failed = !ok;
+    for (int level : {0, 2})
+    {
+        native::Jit jit(c.diag);
+        int64_t got = 0;
+        bool done = jit.Passes().SetLevel(level) && jit.Load(c.root, *c.semantic) && jit.Run(got);
+        std::cout << " -O" << level << " " << got;
+        failed += !done || got != expect;
+        if (!done)
+        {
+            std::cout << std::endl;
+            c.diag.Print();
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+// the call must end in the trap of the vm, a stack overflow has no position
+int trap(const string_t &what, const string_t &src)
+{
+    Checked c(src);
+    runtime::VM vm;
+    vm.SetLimits(runtime::VM::kDefaultStack, 1000);
+    int64_t got = 0;
+    if (c.diag.HasErrors() || !vm.Load(c.root, *c.semantic) || vm.Run(got))
+    {
+        c.diag.Print();
+        std::cout << what << ": no error on the vm" << std::endl;
+        return 1;
+    }
+    auto &d = vm.Diags().All().front();
+    auto expect = d.msg == "stack overflow" ? d.msg : d.String();
+    std::cout << what << ": " << d.String();
+    int failed = 0;
+    for (int level : {0, 2})
+    {
+        Diagnostics diag;
+        native::Jit jit(diag);
+        bool loaded = jit.Passes().SetLevel(level) && jit.Load(c.root, *c.semantic);
+        failed += !loaded || jit.Run(got) || jit.Trap() != expect;
+        if (!loaded || jit.Trap() != expect)
+        {
+            std::cout << " -O" << level << " " << jit.Trap();
+            diag.Print();
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+int check(const string_t &what, bool ok)
+{
+    std::cout << what << ": " << (ok ? "ok" : "failed") << std::endl;
+    return !ok;
+}
+
+struct Pair
+{
+    double x;
+    int64_t n;
+};
+
+struct Triple
+{
+    int64_t a;
+    double b;
+    int64_t c;
+};
+
+// functions called from c++, compiled when first asked for
+int entries()
+{
+    Checked c("let calls = 0;\n"
+              "fn fib(int n) int {\n"
+              "    if (n < 2) {\n"
+              "        return n;\n"
+              "    }\n"
+              "    return fib(n - 1) + fib(n - 2);\n"
+              "}\n"
+              "fn norm(float x, float y) float {\n"
+              "    calls += 1;\n"
+              "    return x * x + y * y;\n"
+              "}\n"
+              "fn two(float x, int n) (float, int) {\n"
+              "    return x * 2, n + calls;\n"
+              "}\n"
+              "fn three(int a, float b) (int, float, int) {\n"
+              "    return a + 1, b * 3, a * a;\n"
+              "}\n"
+              "fn pick(bool b, int x, int y) int {\n"
+              "    if (b) {\n"
+              "        return x;\n"
+              "    }\n"
+              "    return y;\n"
+              "}\n"
+              "fn squares(int n) []int {\n"
+              "    let a []int;\n"
+              "    for (let i = 0; i < n; i += 1) {\n"
+              "        a[i] = i * i;\n"
+              "    }\n"
+              "    return a;\n"
+              "}\n"
+              "fn sum([]int a, int n) int {\n"
+              "    let s = 0;\n"
+              "    for (let i = 0; i < n; i += 1) {\n"
+              "        s += a[i];\n"
+              "    }\n"
+              "    return s;\n"
+              "}\n"
+              "fn unused() int {\n"
+              "    return 0;\n"
+              "}\n");
+    native::Jit jit(c.diag);
+    int failed = check("load", !c.diag.HasErrors() && jit.Load(c.root, *c.semantic) && !jit.Compiled("fib"));
+    auto fib = jit.Entry<int64_t(int64_t)>("fib");
+    failed += check("fib", fib != nullptr && fib(25) == 75025 && jit.Compiled("fib") && !jit.Compiled("unused"));
+    auto norm = jit.Entry<double(double, double)>("norm");
+    failed += check("floats", norm != nullptr && norm(3, 4) == 25 && norm(0.5, 0) == 0.25);
+    auto two = jit.Entry<Pair(double, int64_t)>("two");
+    Pair p = two != nullptr ? two(1.25, 40) : Pair{0, 0};
+    failed += check("two results", p.x == 2.5 && p.n == 42);
+    auto three = jit.Entry<Triple(int64_t, double)>("three");
+    Triple t = three != nullptr ? three(4, 0.5) : Triple{0, 0, 0};
+    failed += check("three results", t.a == 5 && t.b == 1.5 && t.c == 16);
+    auto pick = jit.Entry<int64_t(bool, int64_t, int64_t)>("pick");
+    failed += check("bools", pick != nullptr && pick(true, 1, 2) == 1 && pick(false, 1, 2) == 2);
+    auto squares = jit.Entry<int64_t *(int64_t)>("squares");
+    auto sum = jit.Entry<int64_t(int64_t *, int64_t)>("sum");
+    failed += check("arrays", squares != nullptr && sum != nullptr && sum(squares(10), 10) == 285);
+    // a trap returns zeros, the next call runs again
+    failed += check("trap", sum(squares(3), 5) == 0 && jit.Trapped() && jit.Trap() == "(34, 14) index out of range" &&
+                                fib(10) == 55 && !jit.Trapped());
+    failed += check("mismatch", jit.Entry<double(int64_t)>("fib") == nullptr && jit.Entry<void()>("fib") == nullptr &&
+                                    jit.Entry<int64_t()>("missing") == nullptr);
+    // the two mismatches are one record
+    failed += check("reports", c.diag.Count(Phase::kNative) == 2 &&
+                                   c.diag.All().back().msg == "function missing is not declared");
+    return failed;
+}
+
+// a function the ir cannot express is reported, the others still compile
+int unsupported()
+{
+    Checked c("fn adder(int n) fn(int) int {\n"
+              "    return fn(int x) int {\n"
+              "        return x + n;\n"
+              "    };\n"
+              "}\n"
+              "fn use() int {\n"
+              "    let f = adder(1);\n"
+              "    return f(2);\n"
+              "}\n"
+              "fn fine(int x) int {\n"
+              "    return x * 2;\n"
+              "}\n");
+    native::Jit jit(c.diag);
+    int failed = check("closure load", !c.diag.HasErrors() && jit.Load(c.root, *c.semantic));
+    failed += check("closure", !jit.Compile("use") && !jit.Compiled("adder") && c.diag.Count(Phase::kIr) == 1 &&
+                                   c.diag.All()[0].row_number == 3 &&
+                                   c.diag.All()[0].msg == "n is a local of an enclosing function, closures are not supported" &&
+                                   c.diag.All()[1].msg == "function use cannot be compiled, it reaches adder.1");
+    auto fine = jit.Entry<int64_t(int64_t)>("fine");
+    failed += check("fine", fine != nullptr && fine(21) == 42);
+    return failed;
+}
+
+// no page of the process is writable and executable
+int protection()
+{
+    Checked c("fn f(int x) int {\n    return x + 1;\n}\n");
+    native::Jit jit(c.diag);
+    auto f = jit.Load(c.root, *c.semantic) ? jit.Entry<int64_t(int64_t)>("f") : nullptr;
+    std::ifstream maps("/proc/self/maps");
+    string_t range, perms, rest;
+    int rwx = 0;
+    while (maps >> range >> perms && std::getline(maps, rest))
+    {
+        rwx += perms[1] == 'w' && perms[2] == 'x';
+    }
+    return check("w^x", f != nullptr && f(1) == 2 && rwx == 0);
+}
+
+int main()
+{
+    int failed = 0;
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+
+    for (auto &f : kFailures)
+    {
+        failed += trap(f.name, f.src);
+    }
+
+    failed += entries();
+    failed += unsupported();
+    failed += protection();
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
@@ -48,20 +48,16 @@ void printTokens(CodeToken::List &list)
     }
 }
 
-void printErrors(CodeError::List &list)
+void printErrors(Diagnostics &diag)
 {
     std::cout << "ERRORS" << std::endl;
-    for (auto err : list)
-    {
-        std::cout << "(" << err.row_number << ", " << err.column_number << ") "
-                  << err.error_msg << std::endl;
-    }
+    diag.Print();
 }
 
 int main()
 {
-    CodeError::List err_list;
-    auto tok_list = LexicalParser::ParseString(err_code, err_list);
+    Diagnostics diag;
+    auto tok_list = LexicalParser::ParseString(err_code, diag);
     printTokens(tok_list);
-    printErrors(err_list);
+    printErrors(diag);
 }
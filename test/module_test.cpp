@@ -0,0 +1,260 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#define private public
+#include "../src/compiler/module.h"
+#include "../src/compiler/semantic.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+string_t dir;
+
+void write(const string_t &module, const string_t &src)
+{
+    std::ofstream(dir + "/" + module + ".li") << src;
+}
+
+void clean(const std::vector<string_t> &modules)
+{
+    for (auto &m : modules)
+    {
+        std::remove((dir + "/" + m + ".lii").c_str());
+    }
+}
+
+// builds root and compares the outcome and how many modules had to be parsed and checked
+int build(const string_t &what, const string_t &root, bool ok, int parsed, int checked, int reused, int jobs = 1)
+{
+    ast::ModuleBuilder b(dir);
+    b.SetJobs(jobs);
+    bool got = b.Build(root);
+    auto &s = b.LastStats();
+    std::cout << what << ": " << (got ? "ok" : "failed") << ", " << s.parsed << " parsed, " << s.checked
+              << " checked, " << s.reused << " reused" << std::endl;
+    if (got != ok || s.parsed != parsed || s.checked != checked || s.reused != reused)
+    {
+        b.PrintErrors();
+        return 1;
+    }
+    return 0;
+}
+
+// the first error of root must contain msg
+int error(const string_t &what, const string_t &root, const string_t &msg, int row)
+{
+    ast::ModuleBuilder b(dir);
+    b.Build(root);
+    auto diag = b.Diags(root);
+    std::cout << what << ": ";
+    if (diag == nullptr || !diag->HasErrors())
+    {
+        std::cout << "no error" << std::endl;
+        return 1;
+    }
+    auto &d = diag->All().front();
+    std::cout << d.String() << std::endl;
+    return d.msg.find(msg) == string_t::npos || d.row_number != row;
+}
+
+int types()
+{
+    auto &t = ast::TypeTable::Global();
+    auto i = ast::TypeTable::Int(), f = ast::TypeTable::Float();
+    std::vector<ast::Type::Ptr> list = {
+        i,
+        ast::TypeTable::Bool(),
+        t.Pointer(t.Array(ast::TypeTable::String())),
+        t.Func({}, {}),
+        t.Func({i, t.Pointer(f)}, {f, i}),
+        t.Func({t.Func({i}, {i})}, {t.Array(t.Func({}, {f}))}),
+        t.Tuple({i, f}),
+    };
+    int failed = 0;
+    for (auto type : list)
+    {
+        auto code = ast::Interface::EncodeType(type);
+        if (ast::Interface::DecodeType(code) != type)
+        {
+            std::cout << "round trip of " << ast::Type::String(type) << " as " << code << " failed" << std::endl;
+            failed++;
+        }
+    }
+    for (auto bad : {"", "x", "*", "F1.0.", "F1.0.ii", "T2.i", "F1i", "ii"})
+    {
+        if (ast::Interface::DecodeType(bad) != nullptr)
+        {
+            std::cout << "malformed code " << bad << " decoded" << std::endl;
+            failed++;
+        }
+    }
+    std::cout << "types: " << list.size() << " round trips" << std::endl;
+    return failed;
+}
+
+// a corrupt or truncated summary is rejected with a reason, never thrown over
+int summaries()
+{
+    const string_t head = "lilang-interface 1\n";
+    std::vector<string_t> bad = {
+        head,
+        head + "module m\n",
+        head + "source 1f\n",
+        head + "module m\nsource zz\n",
+        head + "module m\nsource\n",
+        head + "module m\nsource -1\n",
+        head + "module m\nsource 1ffffffffffffffffffff\n",
+        head + "module m\nsource 1f\nimport b x\n",
+        head + "module m\nsource 1f\nfn f F99999999999999999999.0.\n",
+        head + "module m\nsource 1f\nfn f T2147483647.i\n",
+        head + "module m\nsource 1f\nvar v\n",
+    };
+    int failed = 0;
+    for (auto &text : bad)
+    {
+        stringstream_t ss(text);
+        ast::Interface in;
+        string_t err;
+        if (ast::Interface::Read(ss, in, err) || err.empty())
+        {
+            std::cout << "corrupt summary read: " << text << std::endl;
+            failed++;
+        }
+    }
+    stringstream_t good(head + "module m\nsource 1f\nimport b 2e\nfn f F1.0.i\n");
+    ast::Interface in;
+    string_t err;
+    if (!ast::Interface::Read(good, in, err) || in.source_hash != 0x1f || in.imports[0].hash != 0x2e)
+    {
+        std::cout << "valid summary rejected: " << err << std::endl;
+        failed++;
+    }
+    std::cout << "summaries: " << bad.size() << " corrupt ones rejected" << std::endl;
+    return failed;
+}
+
+int main()
+{
+    char path[] = "/tmp/lilang_module_XXXXXX";
+    if (mkdtemp(path) == nullptr)
+    {
+        std::cout << "no temp directory" << std::endl;
+        return 1;
+    }
+    dir = path;
+    int failed = types() + summaries();
+
+    // a imports b and c, c imports b
+    write("b", "fn twice(int x) int {\nreturn x * 2;\n}\nlet base = 10;\n");
+    write("c", "import b;\nfn quad(int x) int {\nreturn twice(twice(x));\n}\n");
+    write("a", "import b;\nimport c;\nfn main() int {\nreturn quad(base) + twice(1);\n}\n");
+    failed += build("first", "a", true, 3, 3, 0);
+    failed += build("again", "a", true, 0, 0, 3);
+
+    ast::ModuleBuilder b(dir);
+    b.Build("a");
+    std::ifstream lii(dir + "/b.lii");
+    ast::Interface in;
+    string_t err;
+    if (!ast::Interface::Read(lii, in, err) || in.Hash() != b.InterfaceOf("b")->Hash() || in.exports.size() != 2)
+    {
+        std::cout << "summary of b does not read back: " << err << std::endl;
+        failed++;
+    }
+
+    // a damaged summary is rebuilt from the source
+    std::ofstream(dir + "/b.lii") << "lilang-interface 1\nmodule b\nsource zz\n";
+    failed += build("corrupt", "a", true, 1, 1, 2);
+    std::ofstream(dir + "/b.lii") << "lilang-interface 1\nmodule b\n";
+    failed += build("truncated", "a", true, 1, 1, 2);
+    std::ifstream tmp(dir + "/b.lii.tmp");
+    if (tmp)
+    {
+        std::cout << "temporary summary left behind" << std::endl;
+        failed++;
+    }
+
+    // the exports of b stay the same, so c and a are reused
+    write("b", "fn twice(int x) int {\nreturn x + x;\n}\nlet base = 10;\n");
+    failed += build("body", "a", true, 1, 1, 2);
+    // a new export changes the interface of b
+    write("b", "fn twice(int x) int {\nreturn x + x;\n}\nlet base = 10;\nlet extra = 1;\n");
+    failed += build("signature", "a", true, 3, 3, 0);
+    // c is checked against the changed signature, a is not checked at all
+    write("b", "fn twice(int x) bool {\nreturn x > 0;\n}\nlet base = 10;\n");
+    failed += build("type error", "a", false, 2, 2, 0);
+    failed += error("type error", "c", "", 3);
+    write("b", "fn twice(int x) int {\nreturn x * 2;\n}\nlet base = 10;\n");
+    failed += build("fixed", "a", true, 3, 3, 0);
+
+    write("d", "fn f() {\n}\nimport nothere;\n");
+    failed += error("late import", "d", "imports must come before declarations", 3);
+    write("d", "import b;\nimport nothere;\nfn f() {\n}\n");
+    failed += error("missing", "d", "module nothere is not found", 2);
+    write("d", "import b;\nimport b;\n");
+    failed += error("twice", "d", "module b is imported twice", 2);
+    write("x", "import y;\n");
+    write("y", "\nimport x;\n");
+    failed += error("cycle", "x", "import cycle x -> y -> x", 1);
+    failed += error("cycle", "y", "import cycle y -> x -> y", 2);
+    write("e", "fn twice() {\n}\n");
+    write("f", "import b;\nimport e;\n");
+    failed += error("conflict", "f", "twice is exported by both b and e", 2);
+    write("g", "import b;\nfn twice() {\n}\n");
+    failed += error("redeclared", "g", "function twice is redeclared", 2);
+    write("h", "import b;\nfn f() int {\nreturn twice;\n}\n");
+    failed += error("wrong use", "h", "", 3);
+    failed += error("no root", "nothere", "module nothere is not found", 0);
+
+    // many independent modules below one root, checked in parallel
+    const int kLeaves = 40;
+    stringstream_t root;
+    std::vector<string_t> all = {"root"};
+    for (int i = 0; i < kLeaves; i++)
+    {
+        auto m = "leaf" + std::to_string(i);
+        write(m, "import b;\nfn f" + std::to_string(i) + "(int x) int {\nreturn twice(x) + base;\n}\n");
+        root << "import " << m << ";\n";
+        all.push_back(m);
+    }
+    root << "fn main() int {\nreturn f0(1) + f" << kLeaves - 1 << "(2);\n}\n";
+    write("root", root.str());
+    failed += build("serial", "root", true, kLeaves + 1, kLeaves + 1, 1);
+    std::vector<uint64_t> serial;
+    ast::ModuleBuilder s(dir);
+    s.Build("root");
+    for (auto &m : all)
+    {
+        serial.push_back(s.InterfaceOf(m)->Hash());
+    }
+    clean(all);
+    failed += build("parallel", "root", true, kLeaves + 1, kLeaves + 1, 1, 4);
+    ast::ModuleBuilder p(dir);
+    p.SetJobs(4);
+    p.Build("root");
+    for (int i = 0; i < all.size(); i++)
+    {
+        if (p.InterfaceOf(all[i])->Hash() != serial[i])
+        {
+            std::cout << "interface of " << all[i] << " differs when built in parallel" << std::endl;
+            failed++;
+        }
+    }
+
+    clean(all);
+    clean({"a", "b", "c", "d", "e", "f", "g", "h", "x", "y"});
+    for (auto &m : all)
+    {
+        std::remove((dir + "/" + m + ".li").c_str());
+    }
+    for (auto m : {"a", "b", "c", "d", "e", "f", "g", "h", "x", "y"})
+    {
+        std::remove((dir + "/" + m + ".li").c_str());
+    }
+    std::remove(dir.c_str());
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/native/aot.h"
+#include "../src/runtime/vm.h"
+
+const char *kBinary = "./native_test_bin";
+
+string_t slurp(const string_t &path)
+{
+    std::ifstream in(path);
+    stringstream_t ss;
+    ss << in.rdbuf();
+    std::remove(path.c_str());
+    return ss.str();
+}
+
+// builds src at level and runs it, -1 if it does not build
+int execute(Checked &c, int level, string_t &out, string_t &err)
+{
+    native::Aot aot(c.diag);
+    if (c.diag.HasErrors() || !aot.Passes().SetLevel(level) || !aot.Build(c.root, *c.semantic, kBinary))
+    {
+        c.diag.Print();
+        return -1;
+    }
+    string_t bin(kBinary);
+    int status = std::system((bin + " > " + bin + ".out 2> " + bin + ".err").c_str());
+    out = slurp(bin + ".out");
+    err = slurp(bin + ".err");
+    std::remove(kBinary);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// the executables at -O0 and -O2 must print what main returns on the vm
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    runtime::VM vm;
+    int64_t ref = 0;
+    bool ok = !c.diag.HasErrors() && vm.Load(c.root, *c.semantic) && vm.Run(ref) && ref == expect;
+    std::cout << what << ":";
+    int failed = !ok;
+    for (int level : {0, 2})
+    {
+        string_t out, err;
+        int status = execute(c, level, out, err);
+        std::cout << " -O" << level << " " << (out.empty() ? "none" : out.substr(0, out.size() - 1));
+        failed += status != 0 || out != std::to_string(expect) + "\n";
+        if (status != 0)
+        {
+            std::cout << " (exit " << status << ") " << err;
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+// the executables must exit with 1 after printing the trap of the vm, a stack
+// overflow is reported without a position
+int trap(const string_t &what, const string_t &src)
+{
+    Checked c(src);
+    runtime::VM vm;
+    vm.SetLimits(runtime::VM::kDefaultStack, 1000);
+    int64_t got = 0;
+    if (c.diag.HasErrors() || !vm.Load(c.root, *c.semantic) || vm.Run(got))
+    {
+        c.diag.Print();
+        std::cout << what << ": no error on the vm" << std::endl;
+        return 1;
+    }
+    auto &d = vm.Diags().All().front();
+    auto expect = (d.msg == "stack overflow" ? d.msg : d.String()) + "\n";
+    std::cout << what << ": " << d.String();
+    int failed = 0;
+    for (int level : {0, 2})
+    {
+        string_t out, err;
+        int status = execute(c, level, out, err);
+        failed += status != 1 || err != expect || !out.empty();
+        if (status != 1 || err != expect)
+        {
+            std::cout << " -O" << level << " exit " << status << " " << err;
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+// the assembly at -O2 must contain each of want and none of avoid
+int code(const string_t &what, const string_t &src, const std::vector<string_t> &want,
+         const std::vector<string_t> &avoid)
+{
+    Checked c(src);
+    native::Aot aot(c.diag);
+    stringstream_t ss;
+    if (c.diag.HasErrors() || !aot.Compile(c.root, *c.semantic, ss))
+    {
+        c.diag.Print();
+        return 1;
+    }
+    auto text = ss.str();
+    // the runtime follows the generated code
+    text = text.substr(0, text.find(".globl _start"));
+    int failed = 0;
+    for (auto &w : want)
+    {
+        failed += text.find(w) == string_t::npos;
+    }
+    for (auto &a : avoid)
+    {
+        failed += text.find(a) != string_t::npos;
+    }
+    std::cout << what << ": " << (failed ? "unexpected code" : "ok") << std::endl;
+    if (failed)
+    {
+        std::cout << text;
+    }
+    return failed != 0;
+}
+
+int main()
+{
+    int failed = 0;
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+
+    for (auto &f : kFailures)
+    {
+        failed += trap(f.name, f.src);
+    }
+
+    // a compare that only branches sets the flags of the jump
+    failed += code("fused compare",
+                   "fn f(int n) int {\n    let s = 0;\n    for (let i = 0; i < n; i += 1) {\n"
+                   "        s += i;\n    }\n    return s;\n}\nfn main() int {\n    return f(10);\n}\n",
+                   {"li_f:", "cmpq", "jl"}, {"setl"});
+    // values live across a call stay in callee saved registers
+    failed += code("callee saved",
+                   "fn g(int x) int {\n    return x;\n}\nfn f(int a) int {\n    return g(a) + a;\n}\n"
+                   "fn main() int {\n    return f(1);\n}\n",
+                   {"pushq %rbx", "popq %rbx"}, {});
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <set>
+#include <mutex>
+#include <thread>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+#include "../src/compiler/thread_pool.h"
+#include "../bench/generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+struct Result
+{
+    std::vector<string_t> errors;
+    string_t trace;
+};
+
+Result check(const string_t &src, int jobs)
+{
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    stringstream_t trace;
+    ast::SemanticVisitor semantic(diag);
+    semantic.out = &trace;
+    semantic.SetJobs(jobs);
+    semantic.Analyze(root);
+    Result r;
+    for (auto &d : diag.All())
+    {
+        r.errors.push_back(d.String());
+    }
+    r.trace = trace.str();
+    return r;
+}
+
+// a parallel check must report exactly what a sequential one does
+int main()
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 200;
+    auto src = bench::ProgramGenerator(opt).Generate();
+    // a few broken functions spread over the file, the first one also uses
+    // a function declared after it
+    src = "fn bad_0() int {\n    let a = later();\n    a = true;\n}\n\n" + src;
+    src += "fn later() int {\n    return 1;\n}\n\n";
+    src += "fn bad_1() {\n    let b float;\n    b = undefined;\n    break;\n}\n\n";
+    src += "fn bad_2(int x, int x) {\n    x = true;\n}\n";
+
+    auto seq = check(src, 1);
+    int failed = 0;
+    for (int jobs : {2, 4, 8})
+    {
+        auto par = check(src, jobs);
+        bool same = par.errors == seq.errors && par.trace == seq.trace;
+        std::cout << "jobs " << jobs << ": " << par.errors.size() << " errors, "
+                  << (same ? "same as sequential" : "differs from sequential") << std::endl;
+        failed += !same;
+    }
+    // the pool keeps its threads between calls
+    {
+        WorkStealingPool pool(4);
+        std::set<std::thread::id> threads;
+        std::mutex mu;
+        int64_t sum = 0;
+        for (int call = 0; call < 100; call++)
+        {
+            std::vector<int64_t> out(50);
+            pool.ParallelFor(out.size(), [&](int, int i) {
+                out[i] = i;
+                std::lock_guard<std::mutex> lock(mu);
+                threads.insert(std::this_thread::get_id());
+            });
+            for (auto v : out)
+            {
+                sum += v;
+            }
+        }
+        bool kept = sum == 100 * 49 * 50 / 2 && threads.size() <= 4;
+        std::cout << "100 calls on a pool of 4: " << threads.size() << " threads, sum " << sum << std::endl;
+        failed += !kept;
+    }
+    // a small file is checked on the calling thread, a checker has at least one job
+    {
+        Diagnostics diag;
+        Parser parser(diag);
+        auto root = parser.ParseString("fn f() int {\n    return 1;\n}\nfn main() int {\n    return f();\n}\n");
+        ast::SemanticVisitor semantic(diag);
+        semantic.Analyze(root);
+        std::cout << "small file: " << semantic.jobs << " jobs, " << (semantic.pool == nullptr ? "no pool" : "a pool")
+                  << std::endl;
+        failed += semantic.jobs < 1 || semantic.pool != nullptr || diag.HasErrors();
+    }
+    if (seq.errors.size() != 7)
+    {
+        std::cout << "expected 7 errors, got " << seq.errors.size() << std::endl;
+        for (auto &e : seq.errors)
+        {
+            std::cout << e << std::endl;
+        }
+        failed++;
+    }
+    return failed;
+}
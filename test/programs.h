@@ -0,0 +1,514 @@
+#ifndef LILANG_TEST_PROGRAMS
+#define LILANG_TEST_PROGRAMS
+
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+
+/*
+programs shared by the tests of the engines
+
+every engine runs each of them and compares what main returns, or the trap
+it ends in, with expect and with its reference engine. a program added here
+is checked on all of them, so a divergence shows up as a failing test.
+included after the standard headers of the test.
+*/
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// src parsed and checked, the diagnostics say if it is valid
+struct Checked
+{
+    Diagnostics diag;
+    ast::File::Ptr root;
+    std::unique_ptr<ast::SemanticVisitor> semantic;
+
+    explicit Checked(const string_t &src)
+    {
+        Parser parser(diag);
+        root = parser.ParseString(src);
+        semantic.reset(new ast::SemanticVisitor(diag));
+        semantic->Analyze(root);
+    }
+};
+
+struct Program
+{
+    const char *name;
+    const char *src;
+    int64_t expect; // what main returns
+};
+
+// running main ends with msg at row
+struct Failure
+{
+    const char *name;
+    const char *src;
+    const char *msg;
+    int row;
+};
+
+const Program kPrograms[] = {
+    {"fib",
+     "fn fib(int n) int {\n"
+     "    if (n < 2) {\n"
+     "        return n;\n"
+     "    }\n"
+     "    return fib(n - 1) + fib(n - 2);\n"
+     "}\n"
+     "fn main() int {\n"
+     "    return fib(20);\n"
+     "}\n",
+     6765},
+    {"loops",
+     "fn main() int {\n"
+     "    let s = 0;\n"
+     "    for (let i = 0; i < 100; i += 1) {\n"
+     "        if (i % 7 == 0) {\n"
+     "            continue;\n"
+     "        }\n"
+     "        if (i > 90 || s < 0) {\n"
+     "            break;\n"
+     "        }\n"
+     "        s += i;\n"
+     "    }\n"
+     "    let j = 10;\n"
+     "    while (j > 0 && true) {\n"
+     "        s = s * 2 - s;\n"
+     "        j -= 3;\n"
+     "    }\n"
+     "    return s;\n"
+     "}\n",
+     3549},
+    {"globals",
+     "let g = 5;\n"
+     "let h, k = g * 2, 1.5;\n"
+     "let a []int;\n"
+     "fn bump() {\n"
+     "    g += 1;\n"
+     "    a[g] = g;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    bump();\n"
+     "    bump();\n"
+     "    return g + h + int(k * 2.0) + a[6] + a[7];\n"
+     "}\n",
+     33},
+    {"floats",
+     "fn half(float x) float {\n"
+     "    return x / 2;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let f = half(7);\n"
+     "    let i int;\n"
+     "    i = f * 4.0;\n"
+     "    f *= 3;\n"
+     "    i += 0.5;\n"
+     "    if (f >= 10.5 && !(f < 10.0) && 1 < f) {\n"
+     "        i += 100;\n"
+     "    }\n"
+     "    return i - int(-f);\n"
+     "}\n",
+     124},
+    {"arrays",
+     "fn fill(int n) []int {\n"
+     "    let a []int;\n"
+     "    for (let i = 0; i < n; i += 1) {\n"
+     "        a[i] = i * i;\n"
+     "    }\n"
+     "    return a;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let a = fill(10);\n"
+     "    let b = a;\n"
+     "    b[0] = 1000;\n"
+     "    a[2] += a[3];\n"
+     "    let m [][]int;\n"
+     "    m[1][2] = 5;\n"
+     "    m[1][2] *= 2;\n"
+     "    return a[0] + a[2] + a[9] + m[1][2];\n"
+     "}\n",
+     1104},
+    {"pointers",
+     "fn set(*int p, int v) {\n"
+     "    *p = v;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let x = 1;\n"
+     "    set(&x, 41);\n"
+     "    let a []int;\n"
+     "    a[3] = 0;\n"
+     "    let q = &a[1];\n"
+     "    *q = x + 1;\n"
+     "    *q += 1;\n"
+     "    return a[1];\n"
+     "}\n",
+     43},
+    {"tuples",
+     "fn divmod(int a, int b) (int, int) {\n"
+     "    return a / b, a % b;\n"
+     "}\n"
+     "fn add(float a, int b) int {\n"
+     "    return a + b;\n"
+     "}\n"
+     "let gq, gr = divmod(7, 2);\n"
+     "fn main() int {\n"
+     "    let q, r = divmod(47, 5);\n"
+     "    q, r = r, q;\n"
+     "    return q * 100 + r + add(divmod(9, 4)) + gq * gr;\n"
+     "}\n",
+     215},
+    {"function values",
+     "fn twice(fn(int) int f, int x) int {\n"
+     "    return f(f(x));\n"
+     "}\n"
+     "fn inc(int x) int {\n"
+     "    return x + 1;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let sq = fn(int x) int {\n"
+     "        return x * x;\n"
+     "    };\n"
+     "    let g = inc;\n"
+     "    return twice(sq, 3) + twice(g, 0) + sq(g(1));\n"
+     "}\n",
+     87},
+    {"logic",
+     "fn main() int {\n"
+     "    let a, b = true, false;\n"
+     "    b = a && b;\n"
+     "    a = b || a;\n"
+     "    let c = a == !b;\n"
+     "    if (c != false && (1 > 2 || a)) {\n"
+     "        return 1;\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     1},
+    {"bits",
+     "fn main() int {\n"
+     "    let x = 12;\n"
+     "    x |= 3;\n"
+     "    x &= ^1;\n"
+     "    x ^= 32;\n"
+     "    return x + (-7 / 2) + (-7 % 2);\n"
+     "}\n",
+     42},
+    {"counted loops",
+     "fn main() int {\n"
+     "    let s, n, k = 0, 10, 3;\n"
+     "    for (let i = 0; i < n; i += 1) {\n"
+     "        if (i == 2) {\n"
+     "            continue;\n"
+     "        }\n"
+     "        for (let j = i; j <= 20; j += k) {\n"
+     "            if (j > 15) {\n"
+     "                break;\n"
+     "            }\n"
+     "            s += j;\n"
+     "        }\n"
+     "    }\n"
+     "    for (let i = 5; i < 5; i += 1) {\n"
+     "        s = -1;\n"
+     "    }\n"
+     "    return s;\n"
+     "}\n",
+     338},
+    {"nan compares",
+     "fn main() int {\n"
+     "    let z = 0.0;\n"
+     "    let x = z / z;\n"
+     "    let s = 0;\n"
+     "    if (!(x < 1.0)) {\n"
+     "        s += 1;\n"
+     "    }\n"
+     "    if (!(x >= 1.0)) {\n"
+     "        s += 10;\n"
+     "    }\n"
+     "    if (x != x) {\n"
+     "        s += 100;\n"
+     "    }\n"
+     "    let e = x == x;\n"
+     "    if (e) {\n"
+     "        s = -2;\n"
+     "    }\n"
+     "    while (x <= 1.0) {\n"
+     "        s = -1;\n"
+     "    }\n"
+     "    return s;\n"
+     "}\n",
+     111},
+    {"sibling scopes",
+     "fn main() int {\n"
+     "    let s = 0;\n"
+     "    if (s == 0) {\n"
+     "        let x = 2.5;\n"
+     "        s += x;\n"
+     "    } else {\n"
+     "        let y = 3;\n"
+     "        s += y;\n"
+     "    }\n"
+     "    for (let i = 0; i < 3; i += 1) {\n"
+     "        let t = i;\n"
+     "        s += t;\n"
+     "    }\n"
+     "    return s;\n"
+     "}\n",
+     5},
+    {"wrapping",
+     "fn div(int a, int b) int {\n"
+     "    return a / b + a % b;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let m = -9223372036854775807 - 1;\n"
+     "    let big = 1099511627776 * 1024;\n"
+     "    return div(m, -1) + div(-17, 5) + (m - 1) + big % 1000;\n"
+     "}\n",
+     618},
+    // past the registers: ints and floats on the stack, in both directions
+    {"many arguments",
+     "fn f(int a, float x, int b, int c, float y, int d, int e, int f, int g, int h, float z,\n"
+     "      float u, float v, float w, float p, float q, float r) int {\n"
+     "    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h +\n"
+     "           int(x + 2 * y + 3 * z + 4 * u + 5 * v + 6 * w + 7 * p + 8 * q + 9 * r);\n"
+     "}\n"
+     "fn main() int {\n"
+     "    return f(1, 1.5, 2, 3, 2.5, 4, 5, 6, 7, 8, 3.5, 4.5, 5.5, 6.5, 7.5, 8.5, 9.5);\n"
+     "}\n",
+     204 + 307},
+    {"results",
+     "fn two(float x, int n) (float, int) {\n"
+     "    return x * 2, n + 1;\n"
+     "}\n"
+     "fn three(int a, float b) (int, float, int) {\n"
+     "    return a + 1, b * 3, a * a;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let x, n = two(1.25, 4);\n"
+     "    let a, b, c = three(n, x);\n"
+     "    let s = 0;\n"
+     "    for (let i = 0; i < 3; i += 1) {\n"
+     "        let p, q, r = three(i, b);\n"
+     "        s += p + int(q) + r;\n"
+     "    }\n"
+     "    return a * 1000 + int(b * 10) + c + s;\n"
+     "}\n",
+     6000 + 75 + 25 + 77},
+    // twenty results, passed on by a return of a call
+    {"many results",
+     "fn many(int a, float b) (int, int, int, int, int, int, int, int, int, int, float, int,\n"
+     "        int, int, int, int, int, int, int, int) {\n"
+     "    return a, a + 1, a + 2, a + 3, a + 4, a + 5, a + 6, a + 7, a + 8, a + 9, b, a + 11,\n"
+     "           a + 12, a + 13, a + 14, a + 15, a + 16, a + 17, a + 18, a + 19;\n"
+     "}\n"
+     "fn pass(int a) (int, int, int, int, int, int, int, int, int, int, float, int, int, int,\n"
+     "        int, int, int, int, int, int) {\n"
+     "    return many(a, 0.5);\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15, v16, v17,\n"
+     "        v18, v19 = pass(1);\n"
+     "    return v0 + v9 * 100 + int(v10 * 10) * 10000 + v19 * 1000000;\n"
+     "}\n",
+     1 + 10 * 100 + 5 * 10000 + 20 * 1000000},
+    // more values live across calls than there are callee saved registers
+    {"spills",
+     "fn id(int x) int {\n"
+     "    return x;\n"
+     "}\n"
+     "fn fid(float x) float {\n"
+     "    return x;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let a, b, c, d, e, f, g, h = id(1), id(2), id(3), id(4), id(5), id(6), id(7), id(8);\n"
+     "    let x, y = fid(0.5), fid(0.25);\n"
+     "    let s = 0;\n"
+     "    for (let i = 0; i < 10; i += 1) {\n"
+     "        s += id(a) + b * c + d * e + f * g + h + int(x * 4.0 + y * 4.0);\n"
+     "    }\n"
+     "    return s + a + b + c + d + e + f + g + h;\n"
+     "}\n",
+     10 * (1 + 6 + 20 + 42 + 8 + 3) + 36},
+    {"swaps",
+     "fn main() int {\n"
+     "    let a, b, c = 1, 2, 3;\n"
+     "    let x, y = 1.5, 2.5;\n"
+     "    for (let i = 0; i < 5; i += 1) {\n"
+     "        a, b, c = b, c, a;\n"
+     "        x, y = y, x;\n"
+     "    }\n"
+     "    return a * 100 + b * 10 + c + int(x * 10.0);\n"
+     "}\n",
+     312 + 25},
+    {"big arrays",
+     "fn main() int {\n"
+     "    let a []int;\n"
+     "    let n = 300000;\n"
+     "    for (let i = n - 1; i >= 0; i -= 1) {\n"
+     "        a[i] = i;\n"
+     "    }\n"
+     "    let f []float;\n"
+     "    f[5] = 2.5;\n"
+     "    let s = 0;\n"
+     "    for (let i = 0; i < n; i += 1000) {\n"
+     "        s += a[i];\n"
+     "    }\n"
+     "    return s + int(f[5] * 2.0) + int(f[4]);\n"
+     "}\n",
+     44850000 + 5},
+    // the left operand is computed before the right one
+    {"operand order",
+     "let g = 5;\n"
+     "let x = 0.5;\n"
+     "let b = false;\n"
+     "fn f() int {\n"
+     "    g = 100;\n"
+     "    return 1;\n"
+     "}\n"
+     "fn h() float {\n"
+     "    x = 8.0;\n"
+     "    return 2.0;\n"
+     "}\n"
+     "fn t() bool {\n"
+     "    b = true;\n"
+     "    return true;\n"
+     "}\n"
+     "fn z() int {\n"
+     "    g = 0;\n"
+     "    return 1;\n"
+     "}\n"
+     "fn set(*int p) int {\n"
+     "    *p = 100;\n"
+     "    return 1;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let s = g + f();\n"
+     "    g = 5;\n"
+     "    if (g < f() + 10) {\n"
+     "        s += 10;\n"
+     "    }\n"
+     "    let y = x * h();\n"
+     "    if (b == t()) {\n"
+     "        s += 100;\n"
+     "    }\n"
+     "    b = false;\n"
+     "    if (b != t()) {\n"
+     "        s += 1000;\n"
+     "    }\n"
+     "    g = 5;\n"
+     "    if (g > z()) {\n"
+     "        s += 10000;\n"
+     "    }\n"
+     "    let l = 3;\n"
+     "    s += l + set(&l);\n"
+     "    return s * 10 + int(y);\n"
+     "}\n",
+     110201},
+    // x op= y reads x before it computes y
+    {"update order",
+     "let g = 5;\n"
+     "let a []int;\n"
+     "let x = 0.5;\n"
+     "fn f() int {\n"
+     "    g = 100;\n"
+     "    a[0] = 100;\n"
+     "    return 1;\n"
+     "}\n"
+     "fn h() float {\n"
+     "    x = 8.0;\n"
+     "    return 2.0;\n"
+     "}\n"
+     "fn set(*int p) int {\n"
+     "    *p = 100;\n"
+     "    return 1;\n"
+     "}\n"
+     "fn half(*int p) float {\n"
+     "    *p = 100;\n"
+     "    return 0.5;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    g += f();\n"
+     "    let s = g;\n"
+     "    a[0] = 7;\n"
+     "    a[0] += f();\n"
+     "    g = 20;\n"
+     "    let p = &g;\n"
+     "    *p -= f();\n"
+     "    x *= h();\n"
+     "    let l = 3;\n"
+     "    l += set(&l);\n"
+     "    let k = 8;\n"
+     "    k *= half(&k);\n"
+     "    return s * 10000000 + a[0] * 100000 + g * 1000 + l * 100 + k * 10 + int(x);\n"
+     "}\n",
+     6 * 10000000 + 100 * 100000 + 19 * 1000 + 4 * 100 + 4 * 10 + 1},
+    // values are computed left to right, also where c leaves the order open
+    {"evaluation order",
+     "let g = 1;\n"
+     "let log []int;\n"
+     "let n = 0;\n"
+     "fn bump(int by) int {\n"
+     "    g += by;\n"
+     "    log[n] = by;\n"
+     "    n += 1;\n"
+     "    return by;\n"
+     "}\n"
+     "fn main() int {\n"
+     "    let a = g + bump(10) * g;\n"
+     "    let b []int;\n"
+     "    b[bump(1)] = bump(2) + g;\n"
+     "    g += bump(100);\n"
+     "    let x, y = bump(3), g;\n"
+     "    let ok = g > 1000 && bump(1000) > 0 || bump(7) == 7;\n"
+     "    let s = 0;\n"
+     "    for (let i = 0; i < n; i += 1) {\n"
+     "        s = s * 10 + log[i] % 10;\n"
+     "    }\n"
+     "    return a * 1000000000 + b[1] * 10000000 + g * 10 + x + y + s;\n"
+     "}\n",
+     111000000000 + 150000000 + 1240 + 3 + 117 + 21037},
+};
+
+const Failure kFailures[] = {
+    {"division", "fn main() int {\n    let z = 0;\n    return 1 / z;\n}\n", "division by zero", 3},
+    {"index", "fn main() int {\n    let a []int;\n    a[1] = 1;\n    return a[2];\n}\n", "index out of range", 4},
+    {"negative index", "fn main() int {\n    let a []int;\n    let i = -1;\n    a[i] = 1;\n    return 0;\n}\n",
+     "index out of range", 4},
+    {"nil pointer", "fn main() int {\n    let p *int;\n    return *p;\n}\n", "nil pointer dereference", 3},
+    {"nil function", "fn main() int {\n    let f fn() int;\n    return f();\n}\n", "nil function", 3},
+    {"overflow", "fn f(int n) int {\n    return f(n + 1);\n}\nfn main() int {\n    return f(0);\n}\n",
+     "stack overflow", 2},
+    {"float to int", "fn main() int {\n    let f = 1000000000000.0 * 1000000000000.0;\n    return int(f);\n}\n",
+     "float value out of the int range", 3},
+    // only the first trap is reported
+    {"first trap", "fn main() int {\n    let a []int;\n    let z = 0;\n    let x = 1 / z;\n    return x + a[0];\n}\n",
+     "division by zero", 4},
+};
+
+// the source of the program called name
+inline const char *Source(const string_t &name)
+{
+    for (auto &p : kPrograms)
+    {
+        if (name == p.name)
+        {
+            return p.src;
+        }
+    }
+    return "";
+}
+
+// main returns the sum of n terms, a spine of additions n levels deep
+inline string_t Sum(int n)
+{
+    stringstream_t s;
+    s << "fn main() int {\n    let x = 1;\n    return x";
+    for (int i = 1; i < n; i++)
+    {
+        s << " + x";
+    }
+    s << ";\n}\n";
+    return s.str();
+}
+
+#endif
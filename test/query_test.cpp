@@ -0,0 +1,136 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#define private public
+#include "../src/compiler/incremental.h"
+#include "../src/compiler/query.h"
+#include "../bench/generator.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+std::vector<string_t> full(const string_t &src)
+{
+    Parser parser;
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic;
+    semantic.SetJobs(1);
+    semantic.Analyze(root);
+    std::vector<string_t> list;
+    for (auto &d : semantic.Diags().All())
+    {
+        list.push_back(d.String());
+    }
+    return list;
+}
+
+// the queries must report exactly what a full check of the same text does
+int edit(IncrementalParser &inc, ast::QueryEngine &q, const string_t &what, const TextEdit &e,
+         int max_signatures, int max_bodies)
+{
+    inc.Update(e);
+    auto &diag = q.Update(inc.File());
+    auto &s = q.LastStats();
+    std::vector<string_t> got;
+    for (auto &d : diag.All())
+    {
+        got.push_back(d.String());
+    }
+    auto expect = full(inc.Source());
+    std::cout << what << ": " << s.signatures << " signatures, " << s.bodies << " bodies, "
+              << got.size() << " errors" << std::endl;
+    if (got != expect)
+    {
+        std::cout << "diagnostics differ from a full check" << std::endl;
+        for (auto &d : got)
+        {
+            std::cout << "  got    " << d << std::endl;
+        }
+        for (auto &d : expect)
+        {
+            std::cout << "  expect " << d << std::endl;
+        }
+        return 1;
+    }
+    if (s.signatures > max_signatures || s.bodies > max_bodies)
+    {
+        std::cout << "too many queries recomputed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    bench::GeneratorOptions opt;
+    opt.functions = 100;
+    opt.statements = 5;
+    IncrementalParser inc;
+    inc.Parse(bench::ProgramGenerator(opt).Generate());
+    ast::QueryEngine q;
+    q.Update(inc.File());
+    int failed = 0;
+    if (q.Diags().HasErrors() || q.LastStats().bodies != 101)
+    {
+        std::cout << "initial check failed" << std::endl;
+        failed++;
+    }
+    auto &src = inc.Source();
+
+    // body only: the signature is recomputed but unchanged, no caller is touched
+    auto body = src.find("return ", src.find("fn f_10("));
+    failed += edit(inc, q, "body edit", {int(body) + 7, 0, "1 + "}, 1, 1);
+    failed += edit(inc, q, "body error", {int(src.find("{", src.find("fn f_20("))) + 1, 0, "\nlet e int; e = true;"}, 1, 1);
+
+    // a new parameter invalidates every caller
+    auto params = src.find("(", src.find("fn f_5(")) + 1;
+    failed += edit(inc, q, "signature edit", {int(params), 0, "float extra, "}, 100, 101);
+    failed += edit(inc, q, "signature undo", {int(params), 13, ""}, 100, 101);
+
+    // globals and redeclarations
+    auto first = src.find("fn f_0(");
+    failed += edit(inc, q, "new global", {int(first), 0, "let late = f_3(1);\n"}, 2, 101);
+    failed += edit(inc, q, "redeclared", {int(src.find("fn f_1(")), 0, "fn f_2() {\n}\n"}, 2, 101);
+    auto dup = src.find("fn f_2() {\n}\n");
+    failed += edit(inc, q, "redeclaration removed", {int(dup), 13, ""}, 2, 101);
+
+    // delete a function, its callers now see an undeclared name
+    auto from = src.find("fn f_30(");
+    auto to = src.find("fn f_31(");
+    failed += edit(inc, q, "function removed", {int(from), int(to - from), ""}, 1, 101);
+
+    // node ids keep growing over edits, the scratch annotations only span one declaration
+    for (int i = 0; i < 50; i++)
+    {
+        body = src.find("return ", src.find("fn f_10("));
+        inc.Update({int(body) + 7, 0, "1 + "});
+        q.Update(inc.File());
+    }
+    std::cout << "50 edits: " << inc.File()->node_count << " node ids, " << q.annots.Size() << " annotation cells"
+              << std::endl;
+    if (q.annots.Size() * 10 > inc.File()->node_count)
+    {
+        failed++;
+    }
+
+    // latency of a body edit on a large program
+    opt.functions = 3000;
+    opt.statements = 20;
+    inc.Parse(bench::ProgramGenerator(opt).Generate());
+    q.Update(inc.File());
+    auto lines = std::count(src.begin(), src.end(), '\n');
+    body = src.find("return ", src.find("fn f_1500("));
+    inc.Update({int(body) + 7, 0, "1 + "});
+    auto start = std::chrono::steady_clock::now();
+    q.Update(inc.File());
+    std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+    std::cout << lines << " lines, body edit rechecked " << q.LastStats().bodies << " bodies in "
+              << ms.count() << " ms" << std::endl;
+    if (q.LastStats().bodies != 1)
+    {
+        failed++;
+    }
+    return failed;
+}
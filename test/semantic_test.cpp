@@ -1,3 +1,6 @@
+#include <iostream>
+#include <sstream>
+#include <map>
 #define private public
 
 #include "../src/compiler/syntax.h"
@@ -6,12 +9,42 @@
 using namespace lilang;
 using namespace lilang::compiler;
 
+// the first error of src is msg, none if msg is empty
+int check(const string_t &what, const string_t &src, const string_t &msg)
+{
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    string_t got = diag.All().empty() ? "" : diag.All().front().msg;
+    std::cout << what << ": " << (got.empty() ? "no error" : got) << std::endl;
+    return got != msg;
+}
+
 int main()
 {
     string_t f = "./example/testcode.li";
-    Parser parser;
+    Diagnostics diag;
+    Parser parser(diag);
     auto root = parser.ParseFile(f);
-    parser.PrintErrors();
-    ast::SemanticVisitor semantic;
+    ast::SemanticVisitor semantic(diag);
     semantic.Analyze(root);
-}
\ No newline at end of file
+    diag.Print();
+
+    // x op= y is checked as x = y, then against the operator
+    int failed = 0;
+    failed += check("update", "fn main() {\n    let a = 1;\n    a += 2.5;\n    a |= 4;\n}\n", "");
+    failed += check("update with bool", "fn main() {\n    let a = 1;\n    a += true;\n}\n",
+                    "Cannot assign type bool to type int");
+    failed += check("update of a string", "fn main() {\n    let s = \"a\";\n    s += \"b\";\n}\n",
+                    "both sides of +=/-=/*=//= should be type int or float");
+    failed += check("bits of a float", "fn main() {\n    let x = 1.5;\n    x |= 1;\n}\n",
+                    "both sides of |=/&=/^= should be type int");
+    // +, - and ^ share their message, a float only fits + and -
+    failed += check("negated bool", "fn main() {\n    let b = -true;\n}\n", "+/-/^ expects a number operand");
+    failed += check("flipped string", "fn main() {\n    let b = ^\"a\";\n}\n", "+/-/^ expects a number operand");
+    failed += check("flipped float", "fn main() {\n    let b = ^1.5;\n}\n", "^ expects an int operand");
+    failed += check("negated float", "fn main() {\n    let b = -1.5;\n}\n", "");
+    return failed;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <sstream>
+#include <map>
+#define private public
+#include "../src/compiler/syntax.h"
+#include "../src/compiler/semantic.h"
+
+using namespace lilang;
+using namespace lilang::compiler;
+
+// records the storage of every identifier by name and row
+class Collector : public ast::Walker
+{
+public:
+    std::map<string_t, ast::Storage> found;
+
+protected:
+    void Pre(ast::Node *n) override
+    {
+        auto ident = dynamic_cast<ast::Ident *>(n);
+        if (ident != nullptr)
+        {
+            found[ident->name + "@" + std::to_string(ident->row_number)] = ident->storage;
+        }
+    }
+};
+
+int expect(Collector &c, const string_t &key, ast::Storage::Kind kind, int index, ast::FuncLit *func)
+{
+    auto it = c.found.find(key);
+    if (it == c.found.end())
+    {
+        std::cout << key << " not found" << std::endl;
+        return 1;
+    }
+    auto &s = it->second;
+    std::cout << key << ": kind " << static_cast<int>(s.kind) << " index " << s.index << std::endl;
+    if (s.kind != kind || s.index != index || (func != nullptr && s.func != func))
+    {
+        std::cout << "  expect kind " << static_cast<int>(kind) << " index " << index << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    string_t src =
+        "let g0 = 1;\n"                      // 1
+        "let g1, g2 = 2, 3;\n"               // 2
+        "fn f(int a, int u, int b) int {\n"  // 3
+        "    let c = a + b + g2;\n"          // 4
+        "    {\n"                            // 5
+        "        let d = c;\n"               // 6
+        "        d = d + 1;\n"               // 7
+        "    }\n"                            // 8
+        "    {\n"                            // 9
+        "        let e, h = 1, 2;\n"         // 10
+        "        e = h;\n"                   // 11
+        "    }\n"                            // 12
+        "    let k = fn(int x) int {\n"      // 13
+        "        return x + c;\n"            // 14
+        "    };\n"                           // 15
+        "    a = 2;\n"                       // 16
+        "    return f(k(a), 0, c);\n"        // 17
+        "}\n";
+    Diagnostics diag;
+    Parser parser(diag);
+    auto root = parser.ParseString(src);
+    ast::SemanticVisitor semantic(diag);
+    semantic.Analyze(root);
+    diag.Print();
+    int failed = diag.HasErrors();
+
+    Collector c;
+    c.Walk(root.get());
+    auto f = std::dynamic_pointer_cast<ast::FuncDecl>(root->declarations[2])->fn_lit.get();
+    using K = ast::Storage::Kind;
+    failed += expect(c, "g2@4", K::kGlobal, 2, nullptr);
+    failed += expect(c, "a@4", K::kLocal, 0, f);
+    failed += expect(c, "b@4", K::kLocal, 2, f);
+    failed += expect(c, "c@6", K::kLocal, 3, f);
+    failed += expect(c, "d@7", K::kLocal, 4, f);
+    // sibling blocks share slots
+    failed += expect(c, "e@11", K::kLocal, 4, f);
+    failed += expect(c, "h@11", K::kLocal, 5, f);
+    // a literal has its own frame, captured names keep the outer one
+    failed += expect(c, "x@14", K::kLocal, 0, nullptr);
+    failed += expect(c, "c@14", K::kLocal, 3, f);
+    failed += expect(c, "k@17", K::kLocal, 4, f);
+    failed += expect(c, "a@16", K::kLocal, 0, f);
+    failed += expect(c, "f@17", K::kFunc, -1, f);
+    if (root->global_count != 3 || f->frame_size != 6 || c.found["x@14"].func == f)
+    {
+        std::cout << "globals " << root->global_count << ", frame " << f->frame_size << std::endl;
+        failed++;
+    }
+    return failed;
+}
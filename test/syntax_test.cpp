@@ -1,4 +1,6 @@
 #include <iostream>
+#include <sstream>
+#include <map>
 #define private public
 #include "../src/compiler/lexical.h"
 #include "../src/compiler/syntax.h"
@@ -72,13 +74,8 @@ fn lzp(int test, int, float) (int)
 int main()
 {
     int x;
-    CodeError::List err_list;
-    auto tok_list = LexicalParser::ParseString(fn_decl, err_list);
-    for (auto err : err_list)
-    {
-        std::cout << err.error_msg << std::endl;
-    }
     Parser parser;
+    auto tok_list = LexicalParser::ParseString(fn_decl, parser.Diags());
     parser.tokens = tok_list;
     parser.cur_pos = 0;
     parser.cur_iter = parser.tokens.begin();
@@ -0,0 +1,292 @@
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/native/tiered.h"
+#include "../src/runtime/vm.h"
+
+// calls and loop iterations before compiling: never, at once, soon enough to mix the tiers, loops only,
+// the default
+const std::pair<int64_t, int64_t> kThresholds[] = {{0, 0}, {1, 1}, {2, 3}, {0, 2}, {1000, 10000}};
+
+// main must return what it returns on the vm, whenever the code is compiled
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    runtime::VM vm;
+    int64_t ref = 0;
+    bool ok = !c.diag.HasErrors() && vm.Load(c.root, *c.semantic) && vm.Run(ref) && ref == expect;
+    std::cout << what << ":";
+    int failed = !ok;
+    for (auto &t : kThresholds)
+    {
+        native::Tiered tiered(c.diag);
+        tiered.SetThresholds(t.first, t.second);
+        int64_t got = 0;
+        bool done = tiered.Load(c.root, *c.semantic) && tiered.Run(got);
+        std::cout << " " << got;
+        failed += !done || got != expect;
+        if (!done)
+        {
+            std::cout << std::endl;
+            c.diag.Print();
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+// the call must end in the trap of the vm, a stack overflow has no position
+int trap(const string_t &what, const string_t &src)
+{
+    Checked c(src);
+    runtime::VM vm;
+    vm.SetLimits(runtime::VM::kDefaultStack, 1000);
+    int64_t got = 0;
+    if (c.diag.HasErrors() || !vm.Load(c.root, *c.semantic) || vm.Run(got))
+    {
+        c.diag.Print();
+        std::cout << what << ": no error on the vm" << std::endl;
+        return 1;
+    }
+    auto &d = vm.Diags().All().front();
+    auto expect = d.msg == "stack overflow" ? d.msg : d.String();
+    std::cout << what << ": " << d.String();
+    int failed = 0;
+    for (auto &t : kThresholds)
+    {
+        Diagnostics diag;
+        native::Tiered tiered(diag);
+        tiered.SetThresholds(t.first, t.second);
+        bool loaded = tiered.Load(c.root, *c.semantic);
+        bool trapped = loaded && !tiered.Run(got) && diag.All().size() == 1 && diag.All().front().msg == expect;
+        failed += !trapped;
+        if (!trapped)
+        {
+            std::cout << " " << t.first << "/" << t.second << ":";
+            diag.Print();
+        }
+    }
+    std::cout << std::endl;
+    return failed != 0;
+}
+
+int check(const string_t &what, bool ok)
+{
+    std::cout << what << ": " << (ok ? "ok" : "failed") << std::endl;
+    return !ok;
+}
+
+// the lines of the trace that start with prefix
+int lines(const string_t &trace, const string_t &prefix)
+{
+    std::istringstream in(trace);
+    int n = 0;
+    for (string_t line; std::getline(in, line);)
+    {
+        n += line.compare(0, prefix.size(), prefix) == 0;
+    }
+    return n;
+}
+// a loop moves to compiled code in the middle of main, with a local kept in memory
+int osr()
+{
+    Checked c("fn main() int {\n"
+              "    let s = 0;\n"
+              "    let x = 0;\n"
+              "    let p = &x;\n"
+              "    for (let i = 0; i < 100000; i += 1) {\n"
+              "        s += i % 7;\n"
+              "        *p += 1;\n"
+              "    }\n"
+              "    return s + x;\n"
+              "}\n");
+    int64_t expect = 100000;
+    for (int64_t i = 0; i < 100000; i++)
+    {
+        expect += i % 7;
+    }
+    std::ostringstream trace;
+    native::Tiered tiered(c.diag);
+    tiered.SetThresholds(1000, 100);
+    tiered.SetTrace(&trace);
+    int64_t got = 0;
+    bool ok = tiered.Load(c.root, *c.semantic) && tiered.Run(got);
+    int failed = check("osr main", ok && got == expect && !tiered.Compiled("main"));
+    failed += check("osr trace", trace.str() == "compile main, loop (5, 4): 100 iterations\n"
+                                                "enter main, loop (5, 4)\n");
+    if (failed != 0)
+    {
+        std::cout << got << " " << expect << std::endl << trace.str();
+        c.diag.Print();
+    }
+    return failed;
+}
+
+// the inner loop moves, and the copy goes on with the outer one, which defines what the inner reads
+int nested()
+{
+    Checked c("fn main() int {\n"
+              "    let s = 0;\n"
+              "    for (let i = 0; i < 300; i += 1) {\n"
+              "        let base = i * 2;\n"
+              "        let j = 0;\n"
+              "        while (j < 300) {\n"
+              "            s += base + j % 3;\n"
+              "            j += 1;\n"
+              "        }\n"
+              "        s -= base;\n"
+              "    }\n"
+              "    return s;\n"
+              "}\n");
+    runtime::VM vm;
+    int64_t expect = 0, got = 0;
+    bool ok = vm.Load(c.root, *c.semantic) && vm.Run(expect);
+    std::ostringstream trace;
+    native::Tiered tiered(c.diag);
+    tiered.SetThresholds(1000, 500);
+    tiered.SetTrace(&trace);
+    ok = ok && tiered.Load(c.root, *c.semantic) && tiered.Run(got);
+    int failed = check("nested loops", ok && got == expect && lines(trace.str(), "enter main, loop (6, 8)") == 1);
+    if (failed != 0)
+    {
+        std::cout << got << " " << expect << std::endl << trace.str();
+        c.diag.Print();
+    }
+    return failed;
+}
+
+// later frames reaching a compiled loop enter it at once
+int reuse()
+{
+    Checked c("fn sum(int n) int {\n"
+              "    let s = 0;\n"
+              "    while (n > 0) {\n"
+              "        s += n;\n"
+              "        n -= 1;\n"
+              "    }\n"
+              "    return s;\n"
+              "}\n"
+              "fn main() int {\n"
+              "    let s = 0;\n"
+              "    for (let i = 0; i < 5; i += 1) {\n"
+              "        s += sum(1000 + i);\n"
+              "    }\n"
+              "    return s;\n"
+              "}\n");
+    std::ostringstream trace;
+    native::Tiered tiered(c.diag);
+    tiered.SetThresholds(100, 500);
+    tiered.SetTrace(&trace);
+    int64_t got = 0;
+    bool ok = tiered.Load(c.root, *c.semantic) && tiered.Run(got);
+    int64_t expect = 0;
+    for (int64_t i = 0; i < 5; i++)
+    {
+        expect += (1000 + i) * (1001 + i) / 2;
+    }
+    int failed = check("reuse", ok && got == expect && lines(trace.str(), "compile sum, loop (3, 4)") == 1 &&
+                                    lines(trace.str(), "enter sum, loop (3, 4)") == 5);
+    if (failed != 0)
+    {
+        std::cout << got << " " << expect << std::endl << trace.str();
+        c.diag.Print();
+    }
+    return failed;
+}
+
+// hot functions are compiled one by one, compiled code calls interpreted code through the bridges
+int promotion()
+{
+    Checked c("let total = 0;\n"
+              "fn cold(int x) int {\n"
+              "    total += 1;\n"
+              "    return x * 3;\n"
+              "}\n"
+              "fn rare(int a, float b, int c, int d, int e, int f, int g, int h) (int, float, int) {\n"
+              "    return a + h, b * 2.0, c * g;\n"
+              "}\n"
+              "fn pair(float x, int n) (float, int) {\n"
+              "    return x + 0.5, n - 1;\n"
+              "}\n"
+              "fn hot(int x) int {\n"
+              "    let r = cold(x) + 1;\n"
+              "    if (x % 5 == 0) {\n"
+              "        let a, b, c = rare(x, 1.5, 2, 3, 4, 5, 6, 7);\n"
+              "        let y, n = pair(b, c);\n"
+              "        r += a + int(y) + n;\n"
+              "    }\n"
+              "    return r;\n"
+              "}\n"
+              "fn apply(fn(int) int f, int x) int {\n"
+              "    return f(x);\n"
+              "}\n"
+              "fn main() int {\n"
+              "    let s = 0;\n"
+              "    for (let i = 0; i < 20; i += 1) {\n"
+              "        s += hot(i) + apply(hot, i);\n"
+              "    }\n"
+              "    return s + total;\n"
+              "}\n");
+    runtime::VM vm;
+    int64_t expect = 0, got = 0;
+    bool ok = vm.Load(c.root, *c.semantic) && vm.Run(expect);
+    std::ostringstream trace;
+    native::Tiered tiered(c.diag);
+    tiered.SetThresholds(10, 0);
+    tiered.SetTrace(&trace);
+    ok = ok && tiered.Load(c.root, *c.semantic) && tiered.Run(got);
+    int failed = check("promotion", ok && got == expect);
+    failed += check("promotion trace", trace.str() == "compile hot: 10 calls\n"
+                                                      "compile cold: 10 calls\n"
+                                                      "compile apply: 10 calls\n");
+    failed += check("tiers", tiered.Compiled("hot") && tiered.Compiled("cold") && !tiered.Compiled("rare") &&
+                                 !tiered.Compiled("pair") && !tiered.Compiled("main"));
+    if (failed != 0)
+    {
+        std::cout << got << " " << expect << std::endl << trace.str();
+        c.diag.Print();
+    }
+    return failed;
+}
+
+// the interpreter runs what the ir expresses, as the jit does
+int unsupported()
+{
+    Checked c("fn adder(int n) fn(int) int {\n"
+              "    return fn(int x) int {\n"
+              "        return x + n;\n"
+              "    };\n"
+              "}\n"
+              "fn main() int {\n"
+              "    return adder(1)(2);\n"
+              "}\n");
+    native::Tiered tiered(c.diag);
+    bool loaded = tiered.Load(c.root, *c.semantic);
+    return check("closure", !loaded && c.diag.HasErrors());
+}
+
+int main()
+{
+    int failed = 0;
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+
+    for (auto &f : kFailures)
+    {
+        failed += trap(f.name, f.src);
+    }
+
+    failed += osr();
+    failed += nested();
+    failed += reuse();
+    failed += promotion();
+    failed += unsupported();
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
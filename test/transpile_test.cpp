@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/native/transpile.h"
+#include "../src/runtime/interpreter.h"
+
+const char *kBinary = "./transpile_test_bin";
+
+string_t slurp(const string_t &path)
+{
+    std::ifstream in(path);
+    stringstream_t ss;
+    ss << in.rdbuf();
+    std::remove(path.c_str());
+    return ss.str();
+}
+
+// builds and runs the translation of src, -1 if it does not build
+int execute(Checked &c, string_t &out, string_t &err)
+{
+    native::Transpiler t(c.diag);
+    if (c.diag.HasErrors() || !t.Build(c.root, *c.semantic, kBinary))
+    {
+        c.diag.Print();
+        return -1;
+    }
+    string_t bin(kBinary);
+    int status = std::system((bin + " > " + bin + ".out 2> " + bin + ".err").c_str());
+    out = slurp(bin + ".out");
+    err = slurp(bin + ".err");
+    std::remove(kBinary);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int check(const string_t &what, Checked &c, int64_t expect)
+{
+    string_t out, err;
+    int status = execute(c, out, err);
+    std::cout << what << ": " << (out.empty() ? "none" : out.substr(0, out.size() - 1));
+    if (status != 0)
+    {
+        std::cout << " (exit " << status << ") " << err;
+    }
+    std::cout << std::endl;
+    return status != 0 || out != std::to_string(expect) + "\n";
+}
+
+// the executable must print what main returns on the interpreter
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    runtime::Interpreter interp;
+    int64_t ref = 0;
+    if (c.diag.HasErrors() || !interp.Load(c.root, *c.semantic) || !interp.Run(ref) || ref != expect)
+    {
+        c.diag.Print();
+        interp.Diags().Print();
+        std::cout << what << ": interpreter returns " << ref << std::endl;
+        return 1;
+    }
+    return check(what, c, expect);
+}
+
+// closures do not run on the interpreter: the value is worked out by hand
+int known(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    return check(what, c, expect);
+}
+
+// the executable must exit with 1 after printing the trap of the interpreter,
+// a stack overflow is reported without a position
+int trap(const string_t &what, const string_t &src)
+{
+    Checked c(src);
+    runtime::Interpreter interp;
+    interp.SetLimits(runtime::Interpreter::kDefaultStack, runtime::Interpreter::kDefaultDepth);
+    int64_t got = 0;
+    if (c.diag.HasErrors() || !interp.Load(c.root, *c.semantic) || interp.Run(got))
+    {
+        c.diag.Print();
+        std::cout << what << ": no error on the interpreter" << std::endl;
+        return 1;
+    }
+    auto &d = interp.Diags().All().front();
+    auto expect = (d.msg == "stack overflow" ? d.msg : d.String()) + "\n";
+    string_t out, err;
+    int status = execute(c, out, err);
+    std::cout << what << ": " << d.String();
+    int failed = status != 1 || err != expect || !out.empty();
+    if (failed)
+    {
+        std::cout << " exit " << status << " " << err;
+    }
+    std::cout << std::endl;
+    return failed;
+}
+
+// the c source must contain each of want
+int source(const string_t &what, const string_t &src, const std::vector<string_t> &want)
+{
+    Checked c(src);
+    native::Transpiler t(c.diag);
+    stringstream_t ss;
+    if (c.diag.HasErrors() || !t.Translate(c.root, *c.semantic, ss))
+    {
+        c.diag.Print();
+        return 1;
+    }
+    auto text = ss.str();
+    int failed = 0;
+    for (auto &w : want)
+    {
+        failed += text.find(w) == string_t::npos;
+    }
+    std::cout << what << ": " << (failed ? "unexpected source" : "ok") << std::endl;
+    if (failed)
+    {
+        std::cout << text;
+    }
+    return failed;
+}
+
+int main()
+{
+    int failed = 0;
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+
+    failed += known("counters",
+                      "fn counter(int start) fn() int {\n"
+                      "    let n = start;\n"
+                      "    return fn() int {\n"
+                      "        n += 1;\n"
+                      "        return n;\n"
+                      "    };\n"
+                      "}\n"
+                      "fn main() int {\n"
+                      "    let c = counter(10);\n"
+                      "    c();\n"
+                      "    let d = counter(0);\n"
+                      "    return c() * 100 + d();\n"
+                      "}\n",
+                      1201);
+    // each iteration declares its own j, the literals share the global
+    failed += known("captures",
+                      "let g = 3;\n"
+                      "fn adder(int a) fn(int) fn(int) int {\n"
+                      "    return fn(int b) fn(int) int {\n"
+                      "        return fn(int c) int {\n"
+                      "            return a * 100 + b * 10 + c;\n"
+                      "        };\n"
+                      "    };\n"
+                      "}\n"
+                      "fn main() int {\n"
+                      "    let fs []fn() int;\n"
+                      "    for (let i = 0; i < 3; i += 1) {\n"
+                      "        let j = i;\n"
+                      "        fs[i] = fn() int {\n"
+                      "            return j * g;\n"
+                      "        };\n"
+                      "    }\n"
+                      "    g = 5;\n"
+                      "    let f0, f1, f2 = fs[0], fs[1], fs[2];\n"
+                      "    let a1 = adder(1);\n"
+                      "    let a2 = a1(2);\n"
+                      "    return f0() + f1() + f2() + a2(3) * 100;\n"
+                      "}\n",
+                      15 + 12300);
+    // a literal writes the local it shares with its function
+    failed += known("shared locals",
+                      "fn apply(fn(int) int f, int n) {\n"
+                      "    for (let i = 0; i < n; i += 1) {\n"
+                      "        f(i);\n"
+                      "    }\n"
+                      "}\n"
+                      "fn main() int {\n"
+                      "    let sum = 0;\n"
+                      "    let p = &sum;\n"
+                      "    apply(fn(int x) int {\n"
+                      "        sum += x;\n"
+                      "        return sum;\n"
+                      "    }, 5);\n"
+                      "    *p += 100;\n"
+                      "    return sum;\n"
+                      "}\n",
+                      110);
+
+    for (auto &f : kFailures)
+    {
+        failed += trap(f.name, f.src);
+    }
+
+    failed += source("structs",
+                     "fn two(int a) (int, float) {\n    return a, 1.5;\n}\n"
+                     "fn main() int {\n    let x, y = two(1);\n    return x + int(y);\n}\n",
+                     {"} li_tuple0;", "static li_tuple0 f_two(li_fn *self, int64_t a_0)", "f_two(NULL, INT64_C(1))"});
+
+    // a body nested deeper than the limit is not translated, one below it runs
+    failed += run("deep sum", Sum(ast::kMaxNesting / 2), ast::kMaxNesting / 2);
+    {
+        Checked c(Sum(20000));
+        stringstream_t ss;
+        auto &d = c.diag.All();
+        bool refused = !native::Transpiler(c.diag).Translate(c.root, *c.semantic, ss) && !d.empty() &&
+                       d.front().msg == "expression too deep";
+        std::cout << "deep expression: " << (d.empty() ? "translated" : d.front().String()) << std::endl;
+        failed += !refused;
+    }
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}
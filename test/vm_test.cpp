@@ -0,0 +1,126 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#define private public
+#include "./programs.h"
+#include "../src/runtime/interpreter.h"
+#include "../src/runtime/vm.h"
+
+// runs main on the vm and the interpreter, both must return expect
+int run(const string_t &what, const string_t &src, int64_t expect)
+{
+    Checked c(src);
+    runtime::VM vm;
+    runtime::Interpreter in;
+    int64_t got = 0, ref = 0;
+    bool ok = !c.diag.HasErrors() && vm.Load(c.root, *c.semantic) && vm.Run(got);
+    bool ref_ok = in.Load(c.root, *c.semantic) && in.Run(ref);
+    std::cout << what << ": " << got << std::endl;
+    if (!ok || got != expect || !ref_ok || ref != expect)
+    {
+        c.diag.Print();
+        vm.Diags().Print();
+        runtime::Disassemble(std::cout, vm.Code());
+        std::cout << "  expect " << expect << ", interpreter " << ref << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// running main must fail with msg at row
+int trap(const string_t &what, const string_t &src, const string_t &msg, int row)
+{
+    Checked c(src);
+    runtime::VM vm;
+    vm.SetLimits(runtime::VM::kDefaultStack, 1000);
+    int64_t got = 0;
+    bool ok = !c.diag.HasErrors() && vm.Load(c.root, *c.semantic) && vm.Run(got);
+    std::cout << what << ": ";
+    if (ok || !vm.Diags().HasErrors())
+    {
+        c.diag.Print();
+        std::cout << "no error" << std::endl;
+        return 1;
+    }
+    auto &d = vm.Diags().All().front();
+    std::cout << d.String() << std::endl;
+    return d.msg.find(msg) == string_t::npos || d.row_number != row;
+}
+
+// the disassembly of function name must have count instructions and contain each of want
+int code(const string_t &what, const string_t &src, const string_t &name, size_t count,
+         const std::vector<string_t> &want)
+{
+    Checked c(src);
+    runtime::VM vm;
+    if (!vm.Load(c.root, *c.semantic))
+    {
+        vm.Diags().Print();
+        return 1;
+    }
+    auto p = vm.Code().Find(name);
+    stringstream_t ss;
+    runtime::Disassemble(ss, *p);
+    int failed = p->code.size() != count;
+    for (auto &w : want)
+    {
+        failed += ss.str().find(w) == string_t::npos;
+    }
+    std::cout << what << ": " << p->code.size() << " instructions" << std::endl;
+    if (failed)
+    {
+        std::cout << ss.str() << "  expect " << count << std::endl;
+    }
+    return failed != 0;
+}
+
+int main()
+{
+    int failed = 0;
+    for (auto &p : kPrograms)
+    {
+        failed += run(p.name, p.src, p.expect);
+    }
+
+    for (auto &f : kFailures)
+    {
+        failed += trap(f.name, f.src, f.msg, f.row);
+    }
+    failed += trap("closure", "fn main() int {\n    let x = 1;\n    let f = fn() int {\n        return x;\n    };\n"
+                   "    return f();\n}\n",
+                   "closures are not supported", 4);
+    // a body nested deeper than the limit is not emitted, one below it runs
+    failed += run("deep sum", Sum(ast::kMaxNesting / 2), ast::kMaxNesting / 2);
+    failed += trap("deep expression", Sum(20000), "expression too deep", 3);
+
+    // operands are read where they live
+    failed += code("accumulate", "fn f(int s, int i) int {\n    s = s + i;\n    s += 1;\n    return s;\n}\n", "f", 4,
+                   {"ADD_I64       r0 r0 r1", "ADD_I64       r0 r0 k0", "RETURN1       r0"});
+    failed += code("fib", Source("fib"), "fib", 10, {"IFLE_I64      k0 r0", "CALL          r2 p0", "CALL          r3 p0"});
+    // compares that only branch jump, a counted loop ends with one instruction
+    failed += code("counted", "fn f(int n) int {\n    let s = 0;\n    for (let i = 0; i < n; i += 1) {\n"
+                   "        s += i;\n    }\n    return s;\n}\n", "f", 9,
+                   {"IFLE_I64      r0 r2", "FORLT_I64     r2 k1 r0", "ADD_I64       r1 r1 r2"});
+    // an int meeting a float is converted by its own instruction
+    failed += code("mixed", "fn f(float x, int i) float {\n    return x * i + 1;\n}\n", "f", 5,
+                   {"I2F           r4 r1", "MUL_F64       r3 r0 r4", "ADD_F64       r2 r3 k0"});
+    failed += code("mixed update", "fn f(int i, float x) int {\n    i *= x;\n    return i;\n}\n", "f", 5,
+                   {"I2F           r2 r0", "MUL_F64       r2 r2 r1", "F2I           r0 r2"});
+
+    // the pairs of the loop above, back to back on every iteration
+    {
+        Checked c("fn main() int {\n    let s = 0;\n    for (let i = 0; i < 100; i += 1) {\n"
+                  "        s += i;\n    }\n    return s;\n}\n");
+        runtime::VM vm;
+        int64_t got = 0;
+        vm.SetProfile(true);
+        bool ok = vm.Load(c.root, *c.semantic) && vm.Run(got);
+        auto pairs = vm.Pairs();
+        std::cout << "profile: " << pairs.size() << " pairs" << std::endl;
+        failed += !ok || got != 4950 || pairs.size() < 2 || pairs[0].first != runtime::Op::kAddI64 ||
+                  pairs[0].second != runtime::Op::kForLtI64 || pairs[0].count != 100 || pairs[1].count != 99;
+    }
+
+    std::cout << (failed ? "FAILED " : "passed ") << failed << std::endl;
+    return failed;
+}